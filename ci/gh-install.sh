@@ -93,10 +93,12 @@ case "$ID" in
             libglib2.0-doc
             libgpgme-dev
             liblzma-dev
+            liburing-dev
             libmount-dev
             libselinux1-dev
             libsoup-3.0-dev
             libsystemd-dev
+            libzstd-dev
             libtool
             libcap2-bin
             jq
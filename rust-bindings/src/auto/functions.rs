@@ -150,6 +150,13 @@ pub fn create_directory_metadata(dir_info: &gio::FileInfo, xattrs: Option<&glib:
     }
 }
 
+//#[cfg(feature = "v2026_5")]
+//#[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+//#[doc(alias = "ostree_diff_commits")]
+//pub fn diff_commits(repo: &Repo, src_commit: &str, target_commit: &str, callback: /*Unimplemented*/FnMut(/*Ignored*/DiffChange, &str, ObjectType, Option<&str>, Option<&str>) -> Result<(), glib::Error>, cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<(), glib::Error> {
+//    unsafe { TODO: call ffi:ostree_diff_commits() }
+//}
+
 #[doc(alias = "ostree_diff_dirs")]
 pub fn diff_dirs(flags: DiffFlags, a: &impl IsA<gio::File>, b: &impl IsA<gio::File>, modified: &[&DiffItem], removed: &[gio::File], added: &[gio::File], cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<(), glib::Error> {
     unsafe {
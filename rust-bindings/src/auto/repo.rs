@@ -133,6 +133,19 @@ impl Repo {
         }
     }
 
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    #[doc(alias = "ostree_repo_chunk_objects")]
+    pub fn chunk_objects(&self, min_size: u64, cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<u32, glib::Error> {
+        unsafe {
+            let mut out_n_chunked = std::mem::MaybeUninit::uninit();
+            let mut error = std::ptr::null_mut();
+            let is_ok = ffi::ostree_repo_chunk_objects(self.to_glib_none().0, min_size, out_n_chunked.as_mut_ptr(), cancellable.map(|p| p.as_ref()).to_glib_none().0, &mut error);
+            debug_assert_eq!(is_ok == glib::ffi::GFALSE, !error.is_null());
+            if error.is_null() { Ok(out_n_chunked.assume_init()) } else { Err(from_glib_full(error)) }
+        }
+    }
+
     #[doc(alias = "ostree_repo_commit_add_composefs_metadata")]
     pub fn commit_add_composefs_metadata(&self, format_version: u32, dict: &glib::VariantDict, repo_root: &RepoFile, cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<(), glib::Error> {
         unsafe {
@@ -207,6 +220,13 @@ impl Repo {
         }
     }
 
+    //#[cfg(feature = "v2026_5")]
+    //#[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    //#[doc(alias = "ostree_repo_fsck_objects")]
+    //pub fn fsck_objects(&self, objects: /*Unknown conversion*//*Unimplemented*/HashTable TypeId { ns_id: 0, id: 25 }/TypeId { ns_id: 0, id: 25 }, options: Option<&glib::Variant>, callback: /*Unimplemented*/FnMut(&Repo, &str, ObjectType, Option<&glib::Error>) -> Result<(), glib::Error>, cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<(), glib::Error> {
+    //    unsafe { TODO: call ffi:ostree_repo_fsck_objects() }
+    //}
+
     #[cfg(feature = "v2019_2")]
     #[cfg_attr(docsrs, doc(cfg(feature = "v2019_2")))]
     #[doc(alias = "ostree_repo_get_bootloader")]
@@ -263,6 +283,21 @@ impl Repo {
         }
     }
 
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    #[doc(alias = "ostree_repo_get_metadata_cache_stats")]
+    #[doc(alias = "get_metadata_cache_stats")]
+    pub fn metadata_cache_stats(&self) -> (u64, u64, u64, u64) {
+        unsafe {
+            let mut out_hits = std::mem::MaybeUninit::uninit();
+            let mut out_misses = std::mem::MaybeUninit::uninit();
+            let mut out_evictions = std::mem::MaybeUninit::uninit();
+            let mut out_size = std::mem::MaybeUninit::uninit();
+            ffi::ostree_repo_get_metadata_cache_stats(self.to_glib_none().0, out_hits.as_mut_ptr(), out_misses.as_mut_ptr(), out_evictions.as_mut_ptr(), out_size.as_mut_ptr());
+            (out_hits.assume_init(), out_misses.assume_init(), out_evictions.assume_init(), out_size.assume_init())
+        }
+    }
+
     #[cfg(feature = "v2018_9")]
     #[cfg_attr(docsrs, doc(cfg(feature = "v2018_9")))]
     #[doc(alias = "ostree_repo_get_min_free_space_bytes")]
@@ -576,6 +611,19 @@ impl Repo {
         }
     }
 
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    #[doc(alias = "ostree_repo_pack_objects")]
+    pub fn pack_objects(&self, cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<u32, glib::Error> {
+        unsafe {
+            let mut out_n_packed = std::mem::MaybeUninit::uninit();
+            let mut error = std::ptr::null_mut();
+            let is_ok = ffi::ostree_repo_pack_objects(self.to_glib_none().0, out_n_packed.as_mut_ptr(), cancellable.map(|p| p.as_ref()).to_glib_none().0, &mut error);
+            debug_assert_eq!(is_ok == glib::ffi::GFALSE, !error.is_null());
+            if error.is_null() { Ok(out_n_packed.assume_init()) } else { Err(from_glib_full(error)) }
+        }
+    }
+
     #[doc(alias = "ostree_repo_prepare_transaction")]
     pub fn prepare_transaction(&self, cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<bool, glib::Error> {
         unsafe {
@@ -1085,6 +1133,13 @@ impl Repo {
     //    unsafe { TODO: call ffi:ostree_repo_traverse_commit() }
     //}
 
+    //#[cfg(feature = "v2026_5")]
+    //#[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    //#[doc(alias = "ostree_repo_traverse_commit_set")]
+    //pub fn traverse_commit_set(&self, flags: RepoCommitTraverseFlags, commit_checksum: &str, maxdepth: i32, inout_reachable: /*Ignored*/&mut RepoObjectSet, cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<(), glib::Error> {
+    //    unsafe { TODO: call ffi:ostree_repo_traverse_commit_set() }
+    //}
+
     //#[doc(alias = "ostree_repo_traverse_commit_union")]
     //pub fn traverse_commit_union(&self, commit_checksum: &str, maxdepth: i32, inout_reachable: /*Unknown conversion*//*Unimplemented*/HashTable TypeId { ns_id: 0, id: 25 }/TypeId { ns_id: 0, id: 25 }, cancellable: Option<&impl IsA<gio::Cancellable>>) -> Result<(), glib::Error> {
     //    unsafe { TODO: call ffi:ostree_repo_traverse_commit_union() }
@@ -59,6 +59,15 @@ impl RepoCommitModifier {
         }
     }
 
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    #[doc(alias = "ostree_repo_commit_modifier_set_n_jobs")]
+    pub fn set_n_jobs(&self, n_jobs: u32) {
+        unsafe {
+            ffi::ostree_repo_commit_modifier_set_n_jobs(self.to_glib_none().0, n_jobs);
+        }
+    }
+
     #[doc(alias = "ostree_repo_commit_modifier_set_sepolicy")]
     pub fn set_sepolicy(&self, sepolicy: Option<&SePolicy>) {
         unsafe {
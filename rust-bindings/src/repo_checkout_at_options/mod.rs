@@ -38,6 +38,9 @@ pub struct RepoCheckoutAtOptions {
     pub subpath: Option<PathBuf>,
     /// A cache from device, inode pairs to checksums.
     pub devino_to_csum_cache: Option<RepoDevInoCache>,
+    /// Number of threads to check out directories with; 0 and 1 check out serially.
+    #[cfg(any(feature = "v2026_5", feature = "dox"))]
+    pub n_jobs: i32,
     /// A callback function to decide which files and directories will be checked out from the
     /// repo. See the documentation on [RepoCheckoutFilter](struct.RepoCheckoutFilter.html) for more
     /// information on the signature.
@@ -75,6 +78,8 @@ impl Default for RepoCheckoutAtOptions {
             process_passthrough_whiteouts: false,
             subpath: None,
             devino_to_csum_cache: None,
+            #[cfg(any(feature = "v2026_5", feature = "dox"))]
+            n_jobs: 0,
             #[cfg(any(feature = "v2018_2", feature = "dox"))]
             filter: None,
             #[cfg(any(feature = "v2017_6", feature = "dox"))]
@@ -134,6 +139,11 @@ impl<'a> ToGlibPtr<'a, *const ffi::OstreeRepoCheckoutAtOptions> for RepoCheckout
             options.process_passthrough_whiteouts = self.process_passthrough_whiteouts.into_glib();
         }
 
+        #[cfg(any(feature = "v2026_5", feature = "dox"))]
+        {
+            options.n_jobs = self.n_jobs;
+        }
+
         // We keep these complex values alive by returning them in our Stash. Technically, some of
         // these are being kept alive by `self` already, but it's better to be consistent here.
         let subpath = self.subpath.to_glib_none();
@@ -206,7 +216,8 @@ mod tests {
             assert_eq!((*ptr).unused_bools, [GFALSE; 3]);
             assert_eq!((*ptr).subpath, ptr::null());
             assert_eq!((*ptr).devino_to_csum_cache, ptr::null_mut());
-            assert_eq!((*ptr).unused_ints, [0; 6]);
+            assert_eq!((*ptr).n_jobs, 0);
+            assert_eq!((*ptr).unused_ints, [0; 5]);
             assert_eq!((*ptr).unused_ptrs, [ptr::null_mut(); 3]);
             #[cfg(any(feature = "v2018_2", feature = "dox"))]
             assert_eq!((*ptr).filter, None);
@@ -237,6 +248,8 @@ mod tests {
             process_passthrough_whiteouts: true,
             subpath: Some("sub/path".into()),
             devino_to_csum_cache: Some(RepoDevInoCache::new()),
+            #[cfg(any(feature = "v2026_5", feature = "dox"))]
+            n_jobs: 4,
             #[cfg(any(feature = "v2018_2", feature = "dox"))]
             filter: RepoCheckoutFilter::new(|_repo, _path, _stat| {
                 crate::RepoCheckoutFilterResult::Skip
@@ -276,7 +289,9 @@ mod tests {
                 (*ptr).devino_to_csum_cache,
                 options.devino_to_csum_cache.to_glib_none().0
             );
-            assert_eq!((*ptr).unused_ints, [0; 6]);
+            #[cfg(any(feature = "v2026_5", feature = "dox"))]
+            assert_eq!((*ptr).n_jobs, 4);
+            assert_eq!((*ptr).unused_ints, [0; 5]);
             assert_eq!((*ptr).unused_ptrs, [ptr::null_mut(); 3]);
             #[cfg(any(feature = "v2018_2", feature = "dox"))]
             assert!((*ptr).filter == Some(repo_checkout_filter::filter_trampoline_unwindsafe));
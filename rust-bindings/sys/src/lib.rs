@@ -43,6 +43,11 @@ pub const OSTREE_DEPLOYMENT_UNLOCKED_DEVELOPMENT: OstreeDeploymentUnlockedState
 pub const OSTREE_DEPLOYMENT_UNLOCKED_HOTFIX: OstreeDeploymentUnlockedState = 2;
 pub const OSTREE_DEPLOYMENT_UNLOCKED_TRANSIENT: OstreeDeploymentUnlockedState = 3;
 
+pub type OstreeDiffChange = c_int;
+pub const OSTREE_DIFF_CHANGE_MODIFIED: OstreeDiffChange = 0;
+pub const OSTREE_DIFF_CHANGE_REMOVED: OstreeDiffChange = 1;
+pub const OSTREE_DIFF_CHANGE_ADDED: OstreeDiffChange = 2;
+
 pub type OstreeGpgError = c_int;
 pub const OSTREE_GPG_ERROR_NO_SIGNATURE: OstreeGpgError = 0;
 pub const OSTREE_GPG_ERROR_INVALID_SIGNATURE: OstreeGpgError = 1;
@@ -256,6 +261,17 @@ pub const OSTREE_SYSROOT_UPGRADER_PULL_FLAGS_ALLOW_OLDER: OstreeSysrootUpgraderP
 pub const OSTREE_SYSROOT_UPGRADER_PULL_FLAGS_SYNTHETIC: OstreeSysrootUpgraderPullFlags = 2;
 
 // Callbacks
+pub type OstreeDiffCommitsCallback = Option<
+    unsafe extern "C" fn(
+        OstreeDiffChange,
+        *const c_char,
+        OstreeObjectType,
+        *const c_char,
+        *const c_char,
+        gpointer,
+        *mut *mut glib::GError,
+    ) -> gboolean,
+>;
 pub type OstreeRepoCheckoutFilter = Option<
     unsafe extern "C" fn(
         *mut OstreeRepo,
@@ -280,6 +296,16 @@ pub type OstreeRepoCommitModifierXattrCallback = Option<
         gpointer,
     ) -> *mut glib::GVariant,
 >;
+pub type OstreeRepoFsckObjectCallback = Option<
+    unsafe extern "C" fn(
+        *mut OstreeRepo,
+        *const c_char,
+        OstreeObjectType,
+        *const glib::GError,
+        gpointer,
+        *mut *mut glib::GError,
+    ) -> gboolean,
+>;
 pub type OstreeRepoImportArchiveTranslatePathname = Option<
     unsafe extern "C" fn(*mut OstreeRepo, *const stat, *const c_char, gpointer) -> *mut c_char,
 >;
@@ -491,7 +517,8 @@ pub struct OstreeRepoCheckoutAtOptions {
     pub unused_bools: [gboolean; 3],
     pub subpath: *const c_char,
     pub devino_to_csum_cache: *mut OstreeRepoDevInoCache,
-    pub unused_ints: [c_int; 6],
+    pub n_jobs: c_int,
+    pub unused_ints: [c_int; 5],
     pub unused_ptrs: [gpointer; 3],
     pub filter: OstreeRepoCheckoutFilter,
     pub filter_user_data: gpointer,
@@ -518,6 +545,7 @@ impl ::std::fmt::Debug for OstreeRepoCheckoutAtOptions {
             .field("unused_bools", &self.unused_bools)
             .field("subpath", &self.subpath)
             .field("devino_to_csum_cache", &self.devino_to_csum_cache)
+            .field("n_jobs", &self.n_jobs)
             .field("unused_ints", &self.unused_ints)
             .field("unused_ptrs", &self.unused_ptrs)
             .field("filter", &self.filter)
@@ -756,6 +784,36 @@ impl ::std::fmt::Debug for OstreeRepoImportArchiveOptions {
     }
 }
 
+#[repr(C)]
+#[allow(dead_code)]
+pub struct OstreeRepoObjectSet {
+    _data: [u8; 0],
+    _marker: core::marker::PhantomData<(*mut u8, core::marker::PhantomPinned)>,
+}
+
+impl ::std::fmt::Debug for OstreeRepoObjectSet {
+    fn fmt(&self, f: &mut ::std::fmt::Formatter) -> ::std::fmt::Result {
+        f.debug_struct(&format!("OstreeRepoObjectSet @ {self:p}"))
+            .finish()
+    }
+}
+
+#[derive(Copy, Clone)]
+#[repr(C)]
+pub struct OstreeRepoObjectSetIter {
+    pub set: *mut OstreeRepoObjectSet,
+    pub index: size_t,
+    pub checksum: [c_char; 65],
+    pub padding: [gpointer; 4],
+}
+
+impl ::std::fmt::Debug for OstreeRepoObjectSetIter {
+    fn fmt(&self, f: &mut ::std::fmt::Formatter) -> ::std::fmt::Result {
+        f.debug_struct(&format!("OstreeRepoObjectSetIter @ {self:p}"))
+            .finish()
+    }
+}
+
 #[derive(Copy, Clone)]
 #[repr(C)]
 pub struct OstreeRepoPruneOptions {
@@ -1394,6 +1452,12 @@ extern "C" {
         modifier: *mut OstreeRepoCommitModifier,
         cache: *mut OstreeRepoDevInoCache,
     );
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_commit_modifier_set_n_jobs(
+        modifier: *mut OstreeRepoCommitModifier,
+        n_jobs: c_uint,
+    );
     pub fn ostree_repo_commit_modifier_set_sepolicy(
         modifier: *mut OstreeRepoCommitModifier,
         sepolicy: *mut OstreeSePolicy,
@@ -1495,6 +1559,68 @@ extern "C" {
     #[cfg_attr(docsrs, doc(cfg(feature = "v2018_6")))]
     pub fn ostree_repo_finder_result_freev(results: *mut *mut OstreeRepoFinderResult);
 
+    //=========================================================================
+    // OstreeRepoObjectSet
+    //=========================================================================
+    pub fn ostree_repo_object_set_get_type() -> GType;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_new() -> *mut OstreeRepoObjectSet;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_add(
+        set: *mut OstreeRepoObjectSet,
+        checksum: *const c_char,
+        objtype: OstreeObjectType,
+    ) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_add_bytes(
+        set: *mut OstreeRepoObjectSet,
+        csum: *const [u8; 32],
+        objtype: OstreeObjectType,
+    ) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_contains(
+        set: *mut OstreeRepoObjectSet,
+        checksum: *const c_char,
+        objtype: OstreeObjectType,
+    ) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_contains_bytes(
+        set: *mut OstreeRepoObjectSet,
+        csum: *const [u8; 32],
+        objtype: OstreeObjectType,
+    ) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_ref(set: *mut OstreeRepoObjectSet) -> *mut OstreeRepoObjectSet;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_size(set: *mut OstreeRepoObjectSet) -> c_uint;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_unref(set: *mut OstreeRepoObjectSet);
+
+    //=========================================================================
+    // OstreeRepoObjectSetIter
+    //=========================================================================
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_iter_init(
+        iter: *mut OstreeRepoObjectSetIter,
+        set: *mut OstreeRepoObjectSet,
+    );
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_object_set_iter_next(
+        iter: *mut OstreeRepoObjectSetIter,
+        out_checksum: *mut *const c_char,
+        out_objtype: *mut OstreeObjectType,
+    ) -> gboolean;
+
     //=========================================================================
     // OstreeRepoTransactionStats
     //=========================================================================
@@ -1932,6 +2058,15 @@ extern "C" {
         cancellable: *mut gio::GCancellable,
         error: *mut *mut glib::GError,
     ) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_chunk_objects(
+        self_: *mut OstreeRepo,
+        min_size: u64,
+        out_n_chunked: *mut c_uint,
+        cancellable: *mut gio::GCancellable,
+        error: *mut *mut glib::GError,
+    ) -> gboolean;
     pub fn ostree_repo_commit_add_composefs_metadata(
         self_: *mut OstreeRepo,
         format_version: c_uint,
@@ -1999,6 +2134,17 @@ extern "C" {
         cancellable: *mut gio::GCancellable,
         error: *mut *mut glib::GError,
     ) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_fsck_objects(
+        self_: *mut OstreeRepo,
+        objects: *mut glib::GHashTable,
+        options: *mut glib::GVariant,
+        callback: OstreeRepoFsckObjectCallback,
+        user_data: gpointer,
+        cancellable: *mut gio::GCancellable,
+        error: *mut *mut glib::GError,
+    ) -> gboolean;
     #[cfg(feature = "v2019_2")]
     #[cfg_attr(docsrs, doc(cfg(feature = "v2019_2")))]
     pub fn ostree_repo_get_bootloader(self_: *mut OstreeRepo) -> *const c_char;
@@ -2013,6 +2159,15 @@ extern "C" {
     #[cfg_attr(docsrs, doc(cfg(feature = "v2016_4")))]
     pub fn ostree_repo_get_dfd(self_: *mut OstreeRepo) -> c_int;
     pub fn ostree_repo_get_disable_fsync(self_: *mut OstreeRepo) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_get_metadata_cache_stats(
+        self_: *mut OstreeRepo,
+        out_hits: *mut u64,
+        out_misses: *mut u64,
+        out_evictions: *mut u64,
+        out_size: *mut u64,
+    );
     #[cfg(feature = "v2018_9")]
     #[cfg_attr(docsrs, doc(cfg(feature = "v2018_9")))]
     pub fn ostree_repo_get_min_free_space_bytes(
@@ -2254,6 +2409,14 @@ extern "C" {
         cancellable: *mut gio::GCancellable,
         error: *mut *mut glib::GError,
     ) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_pack_objects(
+        self_: *mut OstreeRepo,
+        out_n_packed: *mut c_uint,
+        cancellable: *mut gio::GCancellable,
+        error: *mut *mut glib::GError,
+    ) -> gboolean;
     pub fn ostree_repo_prepare_transaction(
         self_: *mut OstreeRepo,
         out_transaction_resume: *mut gboolean,
@@ -2661,6 +2824,17 @@ extern "C" {
         cancellable: *mut gio::GCancellable,
         error: *mut *mut glib::GError,
     ) -> gboolean;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_repo_traverse_commit_set(
+        repo: *mut OstreeRepo,
+        flags: OstreeRepoCommitTraverseFlags,
+        commit_checksum: *const c_char,
+        maxdepth: c_int,
+        inout_reachable: *mut OstreeRepoObjectSet,
+        cancellable: *mut gio::GCancellable,
+        error: *mut *mut glib::GError,
+    ) -> gboolean;
     pub fn ostree_repo_traverse_commit_union(
         repo: *mut OstreeRepo,
         commit_checksum: *const c_char,
@@ -3810,6 +3984,17 @@ extern "C" {
         dir_info: *mut gio::GFileInfo,
         xattrs: *mut glib::GVariant,
     ) -> *mut glib::GVariant;
+    #[cfg(feature = "v2026_5")]
+    #[cfg_attr(docsrs, doc(cfg(feature = "v2026_5")))]
+    pub fn ostree_diff_commits(
+        repo: *mut OstreeRepo,
+        src_commit: *const c_char,
+        target_commit: *const c_char,
+        callback: OstreeDiffCommitsCallback,
+        user_data: gpointer,
+        cancellable: *mut gio::GCancellable,
+        error: *mut *mut glib::GError,
+    ) -> gboolean;
     pub fn ostree_diff_dirs(
         flags: OstreeDiffFlags,
         a: *mut gio::GFile,
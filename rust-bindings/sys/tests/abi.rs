@@ -257,6 +257,13 @@ const RUST_LAYOUTS: &[(&str, Layout)] = &[
             alignment: align_of::<OstreeDeploymentUnlockedState>(),
         },
     ),
+    (
+        "OstreeDiffChange",
+        Layout {
+            size: size_of::<OstreeDiffChange>(),
+            alignment: align_of::<OstreeDiffChange>(),
+        },
+    ),
     (
         "OstreeDiffDirsOptions",
         Layout {
@@ -474,6 +481,13 @@ const RUST_LAYOUTS: &[(&str, Layout)] = &[
             alignment: align_of::<OstreeRepoMode>(),
         },
     ),
+    (
+        "OstreeRepoObjectSetIter",
+        Layout {
+            size: size_of::<OstreeRepoObjectSetIter>(),
+            alignment: align_of::<OstreeRepoObjectSetIter>(),
+        },
+    ),
     (
         "OstreeRepoPruneFlags",
         Layout {
@@ -610,6 +624,9 @@ const RUST_CONSTANTS: &[(&str, &str)] = &[
     ("(gint) OSTREE_DEPLOYMENT_UNLOCKED_HOTFIX", "2"),
     ("(gint) OSTREE_DEPLOYMENT_UNLOCKED_NONE", "0"),
     ("(gint) OSTREE_DEPLOYMENT_UNLOCKED_TRANSIENT", "3"),
+    ("(gint) OSTREE_DIFF_CHANGE_ADDED", "2"),
+    ("(gint) OSTREE_DIFF_CHANGE_MODIFIED", "0"),
+    ("(gint) OSTREE_DIFF_CHANGE_REMOVED", "1"),
     ("(guint) OSTREE_DIFF_FLAGS_IGNORE_XATTRS", "1"),
     ("(guint) OSTREE_DIFF_FLAGS_NONE", "0"),
     ("OSTREE_DIRMETA_GVARIANT_STRING", "(uuua(ayay))"),
@@ -43,6 +43,9 @@ int main() {
     PRINT_CONSTANT((gint) OSTREE_DEPLOYMENT_UNLOCKED_HOTFIX);
     PRINT_CONSTANT((gint) OSTREE_DEPLOYMENT_UNLOCKED_NONE);
     PRINT_CONSTANT((gint) OSTREE_DEPLOYMENT_UNLOCKED_TRANSIENT);
+    PRINT_CONSTANT((gint) OSTREE_DIFF_CHANGE_ADDED);
+    PRINT_CONSTANT((gint) OSTREE_DIFF_CHANGE_MODIFIED);
+    PRINT_CONSTANT((gint) OSTREE_DIFF_CHANGE_REMOVED);
     PRINT_CONSTANT((guint) OSTREE_DIFF_FLAGS_IGNORE_XATTRS);
     PRINT_CONSTANT((guint) OSTREE_DIFF_FLAGS_NONE);
     PRINT_CONSTANT(OSTREE_DIRMETA_GVARIANT_STRING);
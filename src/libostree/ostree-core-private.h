@@ -152,6 +152,10 @@ gboolean _ostree_validate_structureof_metadata (OstreeObjectType objtype, GVaria
 
 gboolean _ostree_verify_metadata_object (OstreeObjectType objtype, const char *expected_checksum,
                                          GVariant *metadata, GError **error);
+gboolean _ostree_verify_checksummed_metadata_object (OstreeObjectType objtype,
+                                                     const char *expected_checksum,
+                                                     const char *actual_checksum,
+                                                     GVariant *metadata, GError **error);
 
 #define _OSTREE_METADATA_GPGSIGS_NAME "ostree.gpgsigs"
 #define _OSTREE_METADATA_GPGSIGS_TYPE G_VARIANT_TYPE ("aay")
@@ -179,4 +183,6 @@ gboolean _ostree_raw_file_to_archive_stream (GInputStream *input, GFileInfo *fil
 gboolean _ostree_compare_timestamps (const char *current_rev, guint64 current_ts,
                                      const char *new_rev, guint64 new_ts, GError **error);
 
+gboolean _ostree_get_timestamp_now (gint64 *out_timestamp, GError **error);
+
 G_END_DECLS
@@ -2153,6 +2153,19 @@ _ostree_verify_metadata_object (OstreeObjectType objtype, const char *expected_c
 
   char actual_checksum[OSTREE_SHA256_STRING_LEN + 1];
   ot_checksum_get_hexdigest (&hasher, actual_checksum, sizeof (actual_checksum));
+  return _ostree_verify_checksummed_metadata_object (objtype, expected_checksum, actual_checksum,
+                                                     metadata, error);
+}
+
+/* Like _ostree_verify_metadata_object(), but with the checksum of
+ * @metadata already computed.
+ */
+gboolean
+_ostree_verify_checksummed_metadata_object (OstreeObjectType objtype,
+                                            const char *expected_checksum,
+                                            const char *actual_checksum, GVariant *metadata,
+                                            GError **error)
+{
   if (!_ostree_compare_object_checksum (objtype, expected_checksum, actual_checksum, error))
     return FALSE;
 
@@ -2670,6 +2683,36 @@ _ostree_compare_timestamps (const char *current_rev, guint64 current_ts, const c
       new_rev, new_ts_str, current_rev, current_ts_str);
 }
 
+/*
+ * _ostree_get_timestamp_now:
+ * @out_timestamp: (out): Seconds since the epoch
+ *
+ * Get the current time for a new object, unless it's overridden by the
+ * [standard](https://reproducible-builds.org/specs/source-date-epoch/)
+ * `SOURCE_DATE_EPOCH` environment variable for reproducible output.
+ */
+gboolean
+_ostree_get_timestamp_now (gint64 *out_timestamp, GError **error)
+{
+  const gchar *env_timestamp = g_getenv ("SOURCE_DATE_EPOCH");
+  if (env_timestamp == NULL)
+    {
+      g_autoptr (GDateTime) now = g_date_time_new_now_utc ();
+      *out_timestamp = g_date_time_to_unix (now);
+      return TRUE;
+    }
+
+  gchar *ret = NULL;
+  errno = 0;
+  const gint64 timestamp = g_ascii_strtoll (env_timestamp, &ret, 10);
+  if (errno != 0)
+    return glnx_throw_errno_prefix (error, "Parsing SOURCE_DATE_EPOCH");
+  if (ret == env_timestamp)
+    return glnx_throw (error, "Failed to convert SOURCE_DATE_EPOCH");
+  *out_timestamp = timestamp;
+  return TRUE;
+}
+
 #ifndef OSTREE_DISABLE_GPGME
 GVariant *
 _ostree_detached_metadata_append_gpg_sig (GVariant *existing_metadata, GBytes *signature_bytes)
@@ -413,6 +413,332 @@ out:
   return ret;
 }
 
+typedef struct
+{
+  OstreeRepo *repo;
+  OstreeDiffCommitsCallback callback;
+  gpointer user_data;
+  GString *path; /* Of the directory being compared, without a trailing / */
+  GCancellable *cancellable;
+} DiffCommitsData;
+
+/* Find @name in the sorted files or dirs of a dirtree */
+static gssize
+dirtree_find (GVariant *entries, const char *name)
+{
+  gsize lo = 0;
+  gsize hi = g_variant_n_children (entries);
+  while (lo < hi)
+    {
+      const gsize mid = lo + (hi - lo) / 2;
+      g_autoptr (GVariant) entry = g_variant_get_child_value (entries, mid);
+      const char *mid_name;
+      g_variant_get_child (entry, 0, "&s", &mid_name);
+      const int c = strcmp (name, mid_name);
+      if (c == 0)
+        return mid;
+      else if (c < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return -1;
+}
+
+/* Field 1 of files and dirs is the file or dirtree checksum, and field 2 of
+ * dirs the dirmeta checksum.
+ */
+static gboolean
+dirtree_get_checksum (GVariant *entries, gsize i, guint field, char *out_checksum, GError **error)
+{
+  g_autoptr (GVariant) entry = g_variant_get_child_value (entries, i);
+  g_autoptr (GVariant) csum_v = g_variant_get_child_value (entry, field);
+  const guchar *csum = ostree_checksum_bytes_peek_validate (csum_v, error);
+  if (!csum)
+    return FALSE;
+  ostree_checksum_inplace_from_bytes (csum, out_checksum);
+  return TRUE;
+}
+
+static gboolean
+load_dirtree (DiffCommitsData *data, const char *checksum, GVariant **out_files,
+              GVariant **out_dirs, GError **error)
+{
+  g_autoptr (GVariant) tree = NULL;
+  if (!ostree_repo_load_variant (data->repo, OSTREE_OBJECT_TYPE_DIR_TREE, checksum, &tree, error))
+    return FALSE;
+  *out_files = g_variant_get_child_value (tree, 0);
+  *out_dirs = g_variant_get_child_value (tree, 1);
+  return TRUE;
+}
+
+static gboolean
+emit_change (DiffCommitsData *data, OstreeDiffChange change, const char *name,
+             OstreeObjectType objtype, const char *src_checksum, const char *target_checksum,
+             GError **error)
+{
+  const gsize len = data->path->len;
+  g_string_append_c (data->path, '/');
+  g_string_append (data->path, name);
+  const gboolean ret = data->callback (change, data->path->str, objtype, src_checksum,
+                                       target_checksum, data->user_data, error);
+  g_string_truncate (data->path, len);
+  return ret;
+}
+
+static gboolean
+diff_commits_add_recurse (DiffCommitsData *data, const char *contents_checksum, GError **error)
+{
+  g_autoptr (GVariant) files = NULL;
+  g_autoptr (GVariant) dirs = NULL;
+  if (!load_dirtree (data, contents_checksum, &files, &dirs, error))
+    return FALSE;
+
+  const gsize n_files = g_variant_n_children (files);
+  for (gsize i = 0; i < n_files; i++)
+    {
+      const char *name;
+      char checksum[OSTREE_SHA256_STRING_LEN + 1];
+      g_variant_get_child (files, i, "(&s@ay)", &name, NULL);
+      if (!dirtree_get_checksum (files, i, 1, checksum, error))
+        return FALSE;
+      if (!emit_change (data, OSTREE_DIFF_CHANGE_ADDED, name, OSTREE_OBJECT_TYPE_FILE, NULL,
+                        checksum, error))
+        return FALSE;
+    }
+
+  const gsize n_dirs = g_variant_n_children (dirs);
+  for (gsize i = 0; i < n_dirs; i++)
+    {
+      const char *name;
+      char tree_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      char meta_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      g_variant_get_child (dirs, i, "(&s@ay@ay)", &name, NULL, NULL);
+      if (!dirtree_get_checksum (dirs, i, 1, tree_checksum, error)
+          || !dirtree_get_checksum (dirs, i, 2, meta_checksum, error))
+        return FALSE;
+      if (!emit_change (data, OSTREE_DIFF_CHANGE_ADDED, name, OSTREE_OBJECT_TYPE_DIR_META, NULL,
+                        meta_checksum, error))
+        return FALSE;
+
+      const gsize len = data->path->len;
+      g_string_append_c (data->path, '/');
+      g_string_append (data->path, name);
+      if (!diff_commits_add_recurse (data, tree_checksum, error))
+        return FALSE;
+      g_string_truncate (data->path, len);
+    }
+
+  return TRUE;
+}
+
+/* Reports changes in the same order as ostree_diff_dirs(): first those to
+ * the entries of @src_contents, recursing into common directories as they
+ * are reached, then the entries only in @target_contents.
+ */
+static gboolean
+diff_commits_recurse (DiffCommitsData *data, const char *src_contents, const char *target_contents,
+                      GError **error)
+{
+  if (g_cancellable_set_error_if_cancelled (data->cancellable, error))
+    return FALSE;
+
+  g_autoptr (GVariant) src_files = NULL;
+  g_autoptr (GVariant) src_dirs = NULL;
+  g_autoptr (GVariant) target_files = NULL;
+  g_autoptr (GVariant) target_dirs = NULL;
+  if (!load_dirtree (data, src_contents, &src_files, &src_dirs, error))
+    return FALSE;
+  if (!load_dirtree (data, target_contents, &target_files, &target_dirs, error))
+    return FALSE;
+
+  char src_checksum[OSTREE_SHA256_STRING_LEN + 1];
+  char target_checksum[OSTREE_SHA256_STRING_LEN + 1];
+
+  const gsize n_src_files = g_variant_n_children (src_files);
+  for (gsize i = 0; i < n_src_files; i++)
+    {
+      const char *name;
+      g_variant_get_child (src_files, i, "(&s@ay)", &name, NULL);
+      if (!dirtree_get_checksum (src_files, i, 1, src_checksum, error))
+        return FALSE;
+
+      gssize j = dirtree_find (target_files, name);
+      if (j >= 0)
+        {
+          if (!dirtree_get_checksum (target_files, j, 1, target_checksum, error))
+            return FALSE;
+          if (strcmp (src_checksum, target_checksum) != 0
+              && !emit_change (data, OSTREE_DIFF_CHANGE_MODIFIED, name, OSTREE_OBJECT_TYPE_FILE,
+                               src_checksum, target_checksum, error))
+            return FALSE;
+        }
+      else if ((j = dirtree_find (target_dirs, name)) >= 0)
+        {
+          if (!dirtree_get_checksum (target_dirs, j, 2, target_checksum, error))
+            return FALSE;
+          if (!emit_change (data, OSTREE_DIFF_CHANGE_MODIFIED, name, OSTREE_OBJECT_TYPE_DIR_META,
+                            src_checksum, target_checksum, error))
+            return FALSE;
+        }
+      else if (!emit_change (data, OSTREE_DIFF_CHANGE_REMOVED, name, OSTREE_OBJECT_TYPE_FILE,
+                             src_checksum, NULL, error))
+        return FALSE;
+    }
+
+  const gsize n_src_dirs = g_variant_n_children (src_dirs);
+  for (gsize i = 0; i < n_src_dirs; i++)
+    {
+      const char *name;
+      g_variant_get_child (src_dirs, i, "(&s@ay@ay)", &name, NULL, NULL);
+      if (!dirtree_get_checksum (src_dirs, i, 2, src_checksum, error))
+        return FALSE;
+
+      gssize j = dirtree_find (target_dirs, name);
+      if (j >= 0)
+        {
+          if (!dirtree_get_checksum (target_dirs, j, 2, target_checksum, error))
+            return FALSE;
+          if (strcmp (src_checksum, target_checksum) != 0
+              && !emit_change (data, OSTREE_DIFF_CHANGE_MODIFIED, name,
+                               OSTREE_OBJECT_TYPE_DIR_META, src_checksum, target_checksum, error))
+            return FALSE;
+
+          /* Identical subtrees are skipped without loading anything in them */
+          if (!dirtree_get_checksum (src_dirs, i, 1, src_checksum, error)
+              || !dirtree_get_checksum (target_dirs, j, 1, target_checksum, error))
+            return FALSE;
+          if (strcmp (src_checksum, target_checksum) != 0)
+            {
+              const gsize len = data->path->len;
+              g_string_append_c (data->path, '/');
+              g_string_append (data->path, name);
+              if (!diff_commits_recurse (data, src_checksum, target_checksum, error))
+                return FALSE;
+              g_string_truncate (data->path, len);
+            }
+        }
+      else if ((j = dirtree_find (target_files, name)) >= 0)
+        {
+          if (!dirtree_get_checksum (target_files, j, 1, target_checksum, error))
+            return FALSE;
+          if (!emit_change (data, OSTREE_DIFF_CHANGE_MODIFIED, name, OSTREE_OBJECT_TYPE_FILE,
+                            src_checksum, target_checksum, error))
+            return FALSE;
+        }
+      /* Like ostree_diff_dirs(), the contents of removed directories aren't listed */
+      else if (!emit_change (data, OSTREE_DIFF_CHANGE_REMOVED, name, OSTREE_OBJECT_TYPE_DIR_META,
+                             src_checksum, NULL, error))
+        return FALSE;
+    }
+
+  const gsize n_target_files = g_variant_n_children (target_files);
+  for (gsize i = 0; i < n_target_files; i++)
+    {
+      const char *name;
+      g_variant_get_child (target_files, i, "(&s@ay)", &name, NULL);
+      if (dirtree_find (src_files, name) >= 0 || dirtree_find (src_dirs, name) >= 0)
+        continue;
+      if (!dirtree_get_checksum (target_files, i, 1, target_checksum, error))
+        return FALSE;
+      if (!emit_change (data, OSTREE_DIFF_CHANGE_ADDED, name, OSTREE_OBJECT_TYPE_FILE, NULL,
+                        target_checksum, error))
+        return FALSE;
+    }
+
+  const gsize n_target_dirs = g_variant_n_children (target_dirs);
+  for (gsize i = 0; i < n_target_dirs; i++)
+    {
+      const char *name;
+      g_variant_get_child (target_dirs, i, "(&s@ay@ay)", &name, NULL, NULL);
+      if (dirtree_find (src_dirs, name) >= 0 || dirtree_find (src_files, name) >= 0)
+        continue;
+      if (!dirtree_get_checksum (target_dirs, i, 2, target_checksum, error))
+        return FALSE;
+      if (!emit_change (data, OSTREE_DIFF_CHANGE_ADDED, name, OSTREE_OBJECT_TYPE_DIR_META, NULL,
+                        target_checksum, error))
+        return FALSE;
+
+      if (!dirtree_get_checksum (target_dirs, i, 1, target_checksum, error))
+        return FALSE;
+      const gsize len = data->path->len;
+      g_string_append_c (data->path, '/');
+      g_string_append (data->path, name);
+      if (!diff_commits_add_recurse (data, target_checksum, error))
+        return FALSE;
+      g_string_truncate (data->path, len);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+load_commit_root (OstreeRepo *repo, const char *commit_checksum, char *out_contents,
+                  GError **error)
+{
+  g_autoptr (GVariant) commit = NULL;
+  if (!ostree_repo_load_commit (repo, commit_checksum, &commit, NULL, error))
+    return FALSE;
+
+  g_autoptr (GVariant) contents_v = NULL;
+  g_variant_get_child (commit, 6, "@ay", &contents_v);
+  const guchar *csum = ostree_checksum_bytes_peek_validate (contents_v, error);
+  if (!csum)
+    return glnx_prefix_error (error, "Invalid commit %s", commit_checksum);
+  ostree_checksum_inplace_from_bytes (csum, out_contents);
+  return TRUE;
+}
+
+/**
+ * ostree_diff_commits:
+ * @repo: Repo
+ * @src_commit: Checksum of the source commit
+ * @target_commit: Checksum of the target commit
+ * @callback: (scope call): Called for each change
+ * @user_data: User data for @callback
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Compute the difference between two commits, calling @callback for each
+ * file or directory which was modified, removed or added.  This gives the
+ * same results as ostree_diff_dirs() on the roots of the commits, but
+ * works on the dirtree objects directly and doesn't descend into
+ * directories whose contents are the same in both, so the time it takes
+ * depends on the size of the change rather than of the commits.
+ *
+ * As with ostree_diff_dirs(), the contents of a removed directory aren't
+ * reported, but those of an added one are, after the directory itself;
+ * a change to the metadata of the root directory isn't reported.
+ *
+ * Since: 2026.5
+ */
+gboolean
+ostree_diff_commits (OstreeRepo *repo, const char *src_commit, const char *target_commit,
+                     OstreeDiffCommitsCallback callback, gpointer user_data,
+                     GCancellable *cancellable, GError **error)
+{
+  g_return_val_if_fail (OSTREE_IS_REPO (repo), FALSE);
+  g_return_val_if_fail (callback != NULL, FALSE);
+
+  char src_contents[OSTREE_SHA256_STRING_LEN + 1];
+  char target_contents[OSTREE_SHA256_STRING_LEN + 1];
+  if (!load_commit_root (repo, src_commit, src_contents, error))
+    return FALSE;
+  if (!load_commit_root (repo, target_commit, target_contents, error))
+    return FALSE;
+
+  if (strcmp (src_contents, target_contents) == 0)
+    return TRUE;
+
+  g_autoptr (GString) path = g_string_new ("");
+  DiffCommitsData data = { .repo = repo,
+                           .callback = callback,
+                           .user_data = user_data,
+                           .path = path,
+                           .cancellable = cancellable };
+  return diff_commits_recurse (&data, src_contents, target_contents, error);
+}
+
 static void
 print_diff_item (char prefix, GFile *base, GFile *file)
 {
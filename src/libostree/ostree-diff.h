@@ -103,6 +103,48 @@ gboolean ostree_diff_dirs_with_options (OstreeDiffFlags flags, GFile *a, GFile *
                                         OstreeDiffDirsOptions *options, GCancellable *cancellable,
                                         GError **error);
 
+/**
+ * OstreeDiffChange:
+ * @OSTREE_DIFF_CHANGE_MODIFIED: The file or directory metadata changed, or its type did
+ * @OSTREE_DIFF_CHANGE_REMOVED: Only in the source commit
+ * @OSTREE_DIFF_CHANGE_ADDED: Only in the target commit
+ *
+ * Since: 2026.5
+ */
+typedef enum
+{
+  OSTREE_DIFF_CHANGE_MODIFIED,
+  OSTREE_DIFF_CHANGE_REMOVED,
+  OSTREE_DIFF_CHANGE_ADDED,
+} OstreeDiffChange;
+
+/**
+ * OstreeDiffCommitsCallback:
+ * @change: What changed
+ * @path: Absolute path in the commits
+ * @objtype: %OSTREE_OBJECT_TYPE_FILE or %OSTREE_OBJECT_TYPE_DIR_META for a
+ *   directory, in the target commit if it's there and otherwise the source
+ * @src_checksum: (nullable): Checksum of the file or dirmeta object in the source commit
+ * @target_checksum: (nullable): Checksum of the file or dirmeta object in the target commit
+ * @user_data: User data
+ * @error: Error
+ *
+ * See ostree_diff_commits().
+ *
+ * Returns: %TRUE to continue, %FALSE (with @error set) to stop
+ *
+ * Since: 2026.5
+ */
+typedef gboolean (*OstreeDiffCommitsCallback) (OstreeDiffChange change, const char *path,
+                                               OstreeObjectType objtype, const char *src_checksum,
+                                               const char *target_checksum, gpointer user_data,
+                                               GError **error);
+
+_OSTREE_PUBLIC
+gboolean ostree_diff_commits (OstreeRepo *repo, const char *src_commit, const char *target_commit,
+                              OstreeDiffCommitsCallback callback, gpointer user_data,
+                              GCancellable *cancellable, GError **error);
+
 _OSTREE_PUBLIC
 void ostree_diff_print (GFile *a, GFile *b, GPtrArray *modified, GPtrArray *removed,
                         GPtrArray *added);
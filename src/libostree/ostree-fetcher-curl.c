@@ -93,6 +93,7 @@ struct OstreeFetcher
   GHashTable *sockets;              /* Set<SockInfo> */
 
   guint64 bytes_transferred;
+  OstreeFetcherConnectionStats connection_stats;
 };
 
 /* Information associated with a request */
@@ -109,7 +110,11 @@ struct FetcherRequest
   struct curl_slist *req_headers;
   char *if_none_match;       /* request ETag */
   guint64 if_modified_since; /* seconds since the epoch */
+  guint64 range_start;
+  guint64 range_length; /* 0 if this isn't a range request */
   gboolean is_membuf;
+  OstreeFetcherWriteFunc write_func; /* Non-NULL for streamed requests */
+  gpointer write_data;
   GError *caught_write_error;
   GLnxTmpfile tmpf;
   GString *output_buf;
@@ -308,6 +313,30 @@ ensure_tmpfile (FetcherRequest *req, GError **error)
     return _ostree_fetcher_tmpf (req->fetcher->tmpdir_dfd, &req->tmpf, error);
 }
 
+/* The setup times are all measured from the start of the transfer, and are
+ * zero if it reused a connection.
+ */
+static void
+record_connection_stats (OstreeFetcher *fetcher, CURL *easy)
+{
+  long n_connects = 0;
+  double lookup_time = 0, connect_time = 0, tls_time = 0;
+
+  if (curl_easy_getinfo (easy, CURLINFO_NUM_CONNECTS, &n_connects) != CURLE_OK || n_connects <= 0)
+    return;
+  (void)curl_easy_getinfo (easy, CURLINFO_NAMELOOKUP_TIME, &lookup_time);
+  (void)curl_easy_getinfo (easy, CURLINFO_CONNECT_TIME, &connect_time);
+  (void)curl_easy_getinfo (easy, CURLINFO_APPCONNECT_TIME, &tls_time);
+
+  OstreeFetcherConnectionStats *stats = &fetcher->connection_stats;
+  stats->n_connections += n_connects;
+  stats->dns_usec += lookup_time * G_USEC_PER_SEC;
+  if (connect_time > lookup_time)
+    stats->connect_usec += (connect_time - lookup_time) * G_USEC_PER_SEC;
+  if (tls_time > connect_time)
+    stats->tls_usec += (tls_time - connect_time) * G_USEC_PER_SEC;
+}
+
 /* Check for completed transfers, and remove their easy handles */
 static void
 check_multi_info (OstreeFetcher *fetcher)
@@ -342,6 +371,9 @@ check_multi_info (OstreeFetcher *fetcher)
 
       req = g_task_get_task_data (task);
 
+      if (!is_file)
+        record_connection_stats (fetcher, easy);
+
       gboolean retry_all = (!is_file && req->fetcher->opt_retry_all);
 
       if (req->caught_write_error)
@@ -401,6 +433,10 @@ check_multi_info (OstreeFetcher *fetcher)
                   continued_request = TRUE;
                 }
             }
+          else if (req->write_func)
+            {
+              g_task_return_boolean (task, TRUE);
+            }
           else if (req->is_membuf)
             {
               GBytes *ret;
@@ -607,7 +643,21 @@ write_cb (void *ptr, size_t size, size_t nmemb, void *data)
         }
     }
 
-  if (req->is_membuf)
+  if (req->write_func)
+    {
+      /* The body of an error response is not the file we asked for; we
+       * report the status once the transfer is done.  file: URIs have no
+       * response code.
+       */
+      long response = 0;
+      rc = curl_easy_getinfo (req->easy, CURLINFO_RESPONSE_CODE, &response);
+      g_assert_cmpint (rc, ==, CURLM_OK);
+      if (response != 0 && !(response >= 200 && response < 300))
+        return realsize;
+      if (!req->write_func (ptr, realsize, req->write_data, &req->caught_write_error))
+        return -1;
+    }
+  else if (req->is_membuf)
     g_string_append_len (req->output_buf, ptr, realsize);
   else
     {
@@ -732,6 +782,14 @@ _ostree_fetcher_set_max_outstanding_fetcher_requests (OstreeFetcher *self,
                                                       guint32 opt_max_outstanding_fetcher_requests)
 {
   self->opt_max_outstanding_fetcher_requests = opt_max_outstanding_fetcher_requests;
+#if CURL_AT_LEAST_VERSION(7, 30, 0)
+  /* The pull code adapts how many requests it has in flight up to this
+   * maximum, so allow that many connections.
+   */
+  CURLMcode rc = curl_multi_setopt (self->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                                    (long)opt_max_outstanding_fetcher_requests);
+  g_assert_cmpint (rc, ==, CURLM_OK);
+#endif
 }
 
 void
@@ -847,6 +905,15 @@ initiate_next_curl_request (FetcherRequest *req, GTask *task)
       req->req_headers = curl_slist_append (req->req_headers, mod_date);
     }
 
+  if (req->range_length > 0)
+    {
+      g_autofree char *range = g_strdup_printf ("%" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT,
+                                                req->range_start,
+                                                req->range_start + req->range_length - 1);
+      rc = curl_easy_setopt (req->easy, CURLOPT_RANGE, range);
+      g_assert_cmpint (rc, ==, CURLM_OK);
+    }
+
   /* Append a copy of @extra_headers to @req_headers, as the former could change
    * between requests or while a request is in flight */
   for (const struct curl_slist *l = self->extra_headers; l != NULL; l = l->next)
@@ -1004,6 +1071,8 @@ static void
 _ostree_fetcher_request_async (OstreeFetcher *self, GPtrArray *mirrorlist, const char *filename,
                                OstreeFetcherRequestFlags flags, const char *if_none_match,
                                guint64 if_modified_since, gboolean is_membuf, guint64 max_size,
+                               guint64 range_start, guint64 range_length,
+                               OstreeFetcherWriteFunc write_func, gpointer write_data,
                                int priority, GCancellable *cancellable,
                                GAsyncReadyCallback callback, gpointer user_data)
 {
@@ -1034,7 +1103,11 @@ _ostree_fetcher_request_async (OstreeFetcher *self, GPtrArray *mirrorlist, const
   req->flags = flags;
   req->if_none_match = g_strdup (if_none_match);
   req->if_modified_since = if_modified_since;
+  req->range_start = range_start;
+  req->range_length = range_length;
   req->is_membuf = is_membuf;
+  req->write_func = write_func;
+  req->write_data = write_data;
   /* We'll allocate the tmpfile on demand, so we handle
    * file I/O errors just in the write func.
    */
@@ -1060,8 +1133,8 @@ _ostree_fetcher_request_to_tmpfile (OstreeFetcher *self, GPtrArray *mirrorlist,
                                     GAsyncReadyCallback callback, gpointer user_data)
 {
   _ostree_fetcher_request_async (self, mirrorlist, filename, flags, if_none_match,
-                                 if_modified_since, FALSE, max_size, priority, cancellable,
-                                 callback, user_data);
+                                 if_modified_since, FALSE, max_size, 0, 0, NULL, NULL, priority,
+                                 cancellable, callback, user_data);
 }
 
 gboolean
@@ -1101,8 +1174,8 @@ _ostree_fetcher_request_to_membuf (OstreeFetcher *self, GPtrArray *mirrorlist, c
                                    gpointer user_data)
 {
   _ostree_fetcher_request_async (self, mirrorlist, filename, flags, if_none_match,
-                                 if_modified_since, TRUE, max_size, priority, cancellable, callback,
-                                 user_data);
+                                 if_modified_since, TRUE, max_size, 0, 0, NULL, NULL, priority,
+                                 cancellable, callback, user_data);
 }
 
 gboolean
@@ -1139,8 +1212,76 @@ _ostree_fetcher_request_to_membuf_finish (OstreeFetcher *self, GAsyncResult *res
   return TRUE;
 }
 
+/* Fetch @filename, passing its body to @write_func as it arrives rather than
+ * storing it; finish with _ostree_fetcher_request_to_stream_finish().  Only
+ * the body of a successful response is passed on, so a failed mirror never
+ * reaches @write_func.
+ */
+void
+_ostree_fetcher_request_to_stream (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                   const char *filename, OstreeFetcherRequestFlags flags,
+                                   guint64 max_size, int priority, OstreeFetcherWriteFunc write_func,
+                                   gpointer write_data, GCancellable *cancellable,
+                                   GAsyncReadyCallback callback, gpointer user_data)
+{
+  g_return_if_fail (write_func != NULL);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, FALSE, max_size, 0, 0,
+                                 write_func, write_data, priority, cancellable, callback,
+                                 user_data);
+}
+
+gboolean
+_ostree_fetcher_request_to_stream_finish (OstreeFetcher *self, GAsyncResult *result,
+                                          GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+  g_return_val_if_fail (g_async_result_is_tagged (result, _ostree_fetcher_request_async), FALSE);
+
+  return g_task_propagate_boolean ((GTask *)result, error);
+}
+
 guint64
 _ostree_fetcher_bytes_transferred (OstreeFetcher *self)
 {
   return self->bytes_transferred;
 }
+
+gboolean
+_ostree_fetcher_get_connection_stats (OstreeFetcher *self, OstreeFetcherConnectionStats *out_stats)
+{
+  *out_stats = self->connection_stats;
+  return TRUE;
+}
+
+/* Fetch @range_length bytes of @filename starting at @range_start; finish with
+ * _ostree_fetcher_request_to_tmpfile_finish().  A server which ignores the
+ * range makes the request fail since the response exceeds @range_length.
+ */
+void
+_ostree_fetcher_request_range_to_tmpfile (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                          const char *filename, OstreeFetcherRequestFlags flags,
+                                          guint64 range_start, guint64 range_length, int priority,
+                                          GCancellable *cancellable, GAsyncReadyCallback callback,
+                                          gpointer user_data)
+{
+  g_return_if_fail (range_length > 0);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, FALSE, range_length,
+                                 range_start, range_length, NULL, NULL, priority, cancellable,
+                                 callback, user_data);
+}
+
+/* Like _ostree_fetcher_request_range_to_tmpfile(), but finish with
+ * _ostree_fetcher_request_to_membuf_finish().
+ */
+void
+_ostree_fetcher_request_range_to_membuf (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                         const char *filename, OstreeFetcherRequestFlags flags,
+                                         guint64 range_start, guint64 range_length, int priority,
+                                         GCancellable *cancellable, GAsyncReadyCallback callback,
+                                         gpointer user_data)
+{
+  g_return_if_fail (range_length > 0);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, TRUE, range_length,
+                                 range_start, range_length, NULL, NULL, priority, cancellable,
+                                 callback, user_data);
+}
@@ -95,9 +95,13 @@ typedef struct
   SoupRequest *request;
 
   gboolean is_membuf;
+  OstreeFetcherWriteFunc write_func; /* Non-NULL for streamed requests */
+  gpointer write_data;
   OstreeFetcherRequestFlags flags;
   char *if_none_match;       /* request ETag */
   guint64 if_modified_since; /* seconds since the epoch */
+  guint64 range_start;
+  guint64 range_length; /* 0 if this isn't a range request */
   GInputStream *request_body;
   GLnxTmpfile tmpf;
   GOutputStream *out_stream;
@@ -467,6 +471,14 @@ create_pending_soup_request (OstreeFetcherPendingURI *pending, GError **error)
       g_autofree char *mod_date = g_date_time_format (date_time, "%a, %d %b %Y %H:%M:%S %Z");
       soup_message_headers_append (msg->request_headers, "If-Modified-Since", mod_date);
     }
+
+  if (SOUP_IS_REQUEST_HTTP (pending->request) && pending->range_length > 0)
+    {
+      glnx_unref_object SoupMessage *msg
+          = soup_request_http_get_message ((SoupRequestHTTP *)pending->request);
+      soup_message_headers_set_range (msg->request_headers, pending->range_start,
+                                      pending->range_start + pending->range_length - 1);
+    }
 }
 
 static void
@@ -840,7 +852,7 @@ finish_stream (OstreeFetcherPendingURI *pending, GCancellable *cancellable, GErr
       g_mutex_unlock (&pending->thread_closure->output_stream_set_lock);
     }
 
-  if (!pending->is_membuf)
+  if (!pending->is_membuf && !pending->write_func)
     {
       if (!glnx_fstat (pending->tmpf.fd, &stbuf, error))
         goto out;
@@ -848,7 +860,18 @@ finish_stream (OstreeFetcherPendingURI *pending, GCancellable *cancellable, GErr
 
   pending->state = OSTREE_FETCHER_STATE_COMPLETE;
 
-  if (!pending->is_membuf)
+  if (pending->write_func)
+    {
+      if (pending->current_size < pending->content_length)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Download incomplete");
+          goto out;
+        }
+      g_mutex_lock (&pending->thread_closure->output_stream_set_lock);
+      pending->thread_closure->total_downloaded += pending->current_size;
+      g_mutex_unlock (&pending->thread_closure->output_stream_set_lock);
+    }
+  else if (!pending->is_membuf)
     {
       if (stbuf.st_size < pending->content_length)
         {
@@ -882,6 +905,17 @@ remove_pending (OstreeFetcherPendingURI *pending)
   pending_uri_unref (pending);
 }
 
+/* HTTP range requests are handled by the server; for file:// URIs we seek to
+ * the start of the range and stop reading at its end instead.
+ */
+static gsize
+pending_next_read_size (OstreeFetcherPendingURI *pending)
+{
+  if (!SOUP_IS_REQUEST_HTTP (pending->request) && pending->range_length > 0)
+    return MIN (8192, pending->range_length - pending->current_size);
+  return 8192;
+}
+
 static void
 on_out_splice_complete (GObject *object, GAsyncResult *result, gpointer user_data)
 {
@@ -898,8 +932,9 @@ on_out_splice_complete (GObject *object, GAsyncResult *result, gpointer user_dat
   if (bytes_written < 0)
     goto out;
 
-  g_input_stream_read_bytes_async (pending->request_body, 8192, G_PRIORITY_DEFAULT, cancellable,
-                                   on_stream_read, g_object_ref (task));
+  g_input_stream_read_bytes_async (pending->request_body, pending_next_read_size (pending),
+                                   G_PRIORITY_DEFAULT, cancellable, on_stream_read,
+                                   g_object_ref (task));
 
 out:
   if (local_error)
@@ -927,7 +962,7 @@ on_stream_read (GObject *object, GAsyncResult *result, gpointer user_data)
   /* Only open the output stream on demand to ensure we use as
    * few file descriptors as possible.
    */
-  if (!pending->out_stream)
+  if (!pending->out_stream && !pending->write_func)
     {
       if (!pending->is_membuf)
         {
@@ -963,7 +998,9 @@ on_stream_read (GObject *object, GAsyncResult *result, gpointer user_data)
     {
       if (!finish_stream (pending, cancellable, &local_error))
         goto out;
-      if (pending->is_membuf)
+      if (pending->write_func)
+        g_task_return_boolean (task, TRUE);
+      else if (pending->is_membuf)
         {
           g_task_return_pointer (
               task,
@@ -1002,6 +1039,19 @@ on_stream_read (GObject *object, GAsyncResult *result, gpointer user_data)
 
       pending->current_size += bytes_read;
 
+      /* Note this runs in the session thread */
+      if (pending->write_func)
+        {
+          gsize len;
+          const guint8 *buf = g_bytes_get_data (bytes, &len);
+          if (!pending->write_func (buf, len, pending->write_data, &local_error))
+            goto out;
+          g_input_stream_read_bytes_async (pending->request_body, pending_next_read_size (pending),
+                                           G_PRIORITY_DEFAULT, cancellable, on_stream_read,
+                                           g_object_ref (task));
+          goto out;
+        }
+
       /* We do this instead of _write_bytes_async() as that's not
        * guaranteed to do a complete write.
        */
@@ -1045,6 +1095,11 @@ on_request_sent (GObject *object, GAsyncResult *result, gpointer user_data)
     goto out;
   g_assert_no_error (local_error);
 
+  if (!SOUP_IS_REQUEST_HTTP (object) && pending->range_length > 0
+      && !g_seekable_seek (G_SEEKABLE (pending->request_body), pending->range_start, G_SEEK_SET,
+                           cancellable, &local_error))
+    goto out;
+
   if (SOUP_IS_REQUEST_HTTP (object))
     {
       msg = soup_request_http_get_message ((SoupRequestHTTP *)object);
@@ -1147,8 +1202,9 @@ on_request_sent (GObject *object, GAsyncResult *result, gpointer user_data)
 
   pending->content_length = soup_request_get_content_length (pending->request);
 
-  g_input_stream_read_bytes_async (pending->request_body, 8192, G_PRIORITY_DEFAULT, cancellable,
-                                   on_stream_read, g_object_ref (task));
+  g_input_stream_read_bytes_async (pending->request_body, pending_next_read_size (pending),
+                                   G_PRIORITY_DEFAULT, cancellable, on_stream_read,
+                                   g_object_ref (task));
 
 out:
   if (local_error)
@@ -1167,6 +1223,8 @@ static void
 _ostree_fetcher_request_async (OstreeFetcher *self, GPtrArray *mirrorlist, const char *filename,
                                OstreeFetcherRequestFlags flags, const char *if_none_match,
                                guint64 if_modified_since, gboolean is_membuf, guint64 max_size,
+                               guint64 range_start, guint64 range_length,
+                               OstreeFetcherWriteFunc write_func, gpointer write_data,
                                int priority, GCancellable *cancellable,
                                GAsyncReadyCallback callback, gpointer user_data)
 {
@@ -1186,8 +1244,12 @@ _ostree_fetcher_request_async (OstreeFetcher *self, GPtrArray *mirrorlist, const
   pending->flags = flags;
   pending->if_none_match = g_strdup (if_none_match);
   pending->if_modified_since = if_modified_since;
+  pending->range_start = range_start;
+  pending->range_length = range_length;
   pending->max_size = max_size;
   pending->is_membuf = is_membuf;
+  pending->write_func = write_func;
+  pending->write_data = write_data;
 
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_source_tag (task, _ostree_fetcher_request_async);
@@ -1208,8 +1270,8 @@ _ostree_fetcher_request_to_tmpfile (OstreeFetcher *self, GPtrArray *mirrorlist,
                                     GAsyncReadyCallback callback, gpointer user_data)
 {
   _ostree_fetcher_request_async (self, mirrorlist, filename, flags, if_none_match,
-                                 if_modified_since, FALSE, max_size, priority, cancellable,
-                                 callback, user_data);
+                                 if_modified_since, FALSE, max_size, 0, 0, NULL, NULL, priority,
+                                 cancellable, callback, user_data);
 }
 
 gboolean
@@ -1254,8 +1316,8 @@ _ostree_fetcher_request_to_membuf (OstreeFetcher *self, GPtrArray *mirrorlist, c
                                    gpointer user_data)
 {
   _ostree_fetcher_request_async (self, mirrorlist, filename, flags, if_none_match,
-                                 if_modified_since, TRUE, max_size, priority, cancellable, callback,
-                                 user_data);
+                                 if_modified_since, TRUE, max_size, 0, 0, NULL, NULL, priority,
+                                 cancellable, callback, user_data);
 }
 
 gboolean
@@ -1292,6 +1354,35 @@ _ostree_fetcher_request_to_membuf_finish (OstreeFetcher *self, GAsyncResult *res
   return TRUE;
 }
 
+/* Fetch @filename, passing its body to @write_func as it arrives rather than
+ * storing it; finish with _ostree_fetcher_request_to_stream_finish().  Only
+ * the body of a successful response is passed on, so a failed mirror never
+ * reaches @write_func.  With this backend @write_func is invoked from the
+ * session thread.
+ */
+void
+_ostree_fetcher_request_to_stream (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                   const char *filename, OstreeFetcherRequestFlags flags,
+                                   guint64 max_size, int priority, OstreeFetcherWriteFunc write_func,
+                                   gpointer write_data, GCancellable *cancellable,
+                                   GAsyncReadyCallback callback, gpointer user_data)
+{
+  g_return_if_fail (write_func != NULL);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, FALSE, max_size, 0, 0,
+                                 write_func, write_data, priority, cancellable, callback,
+                                 user_data);
+}
+
+gboolean
+_ostree_fetcher_request_to_stream_finish (OstreeFetcher *self, GAsyncResult *result,
+                                          GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+  g_return_val_if_fail (g_async_result_is_tagged (result, _ostree_fetcher_request_async), FALSE);
+
+  return g_task_propagate_boolean ((GTask *)result, error);
+}
+
 guint64
 _ostree_fetcher_bytes_transferred (OstreeFetcher *self)
 {
@@ -1317,3 +1408,46 @@ _ostree_fetcher_bytes_transferred (OstreeFetcher *self)
 
   return ret;
 }
+
+/* libsoup doesn't expose connection setup times */
+gboolean
+_ostree_fetcher_get_connection_stats (OstreeFetcher *self, OstreeFetcherConnectionStats *out_stats)
+{
+  *out_stats = (OstreeFetcherConnectionStats){
+    0,
+  };
+  return FALSE;
+}
+
+/* Fetch @range_length bytes of @filename starting at @range_start; finish with
+ * _ostree_fetcher_request_to_tmpfile_finish().  A server which ignores the
+ * range makes the request fail since the response exceeds @range_length.
+ */
+void
+_ostree_fetcher_request_range_to_tmpfile (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                          const char *filename, OstreeFetcherRequestFlags flags,
+                                          guint64 range_start, guint64 range_length, int priority,
+                                          GCancellable *cancellable, GAsyncReadyCallback callback,
+                                          gpointer user_data)
+{
+  g_return_if_fail (range_length > 0);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, FALSE, range_length,
+                                 range_start, range_length, NULL, NULL, priority, cancellable,
+                                 callback, user_data);
+}
+
+/* Like _ostree_fetcher_request_range_to_tmpfile(), but finish with
+ * _ostree_fetcher_request_to_membuf_finish().
+ */
+void
+_ostree_fetcher_request_range_to_membuf (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                         const char *filename, OstreeFetcherRequestFlags flags,
+                                         guint64 range_start, guint64 range_length, int priority,
+                                         GCancellable *cancellable, GAsyncReadyCallback callback,
+                                         gpointer user_data)
+{
+  g_return_if_fail (range_length > 0);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, TRUE, range_length,
+                                 range_start, range_length, NULL, NULL, priority, cancellable,
+                                 callback, user_data);
+}
@@ -50,9 +50,13 @@ typedef struct
   GFile *file;
 
   gboolean is_membuf;
+  OstreeFetcherWriteFunc write_func; /* Non-NULL for streamed requests */
+  gpointer write_data;
   OstreeFetcherRequestFlags flags;
   char *if_none_match;       /* request ETag */
   guint64 if_modified_since; /* seconds since the epoch */
+  guint64 range_start;
+  guint64 range_length; /* 0 if this isn't a range request */
   GInputStream *response_body;
   GLnxTmpfile tmpf;
   GOutputStream *out_stream;
@@ -163,6 +167,11 @@ create_request_message (FetcherRequest *request)
                                    "If-Modified-Since", mod_date);
     }
 
+  if (request->range_length > 0)
+    soup_message_headers_set_range (soup_message_get_request_headers (request->message),
+                                    request->range_start,
+                                    request->range_start + request->range_length - 1);
+
   if ((request->fetcher->config_flags & OSTREE_FETCHER_FLAGS_TLS_PERMISSIVE) != 0)
     g_signal_connect (request->message, "accept-certificate",
                       G_CALLBACK (_message_accept_cert_loose), NULL);
@@ -427,7 +436,15 @@ finish_stream (FetcherRequest *request, GCancellable *cancellable, GError **erro
         return FALSE;
     }
 
-  if (!request->is_membuf)
+  if (request->write_func)
+    {
+      if (request->content_length >= 0 && request->current_size < request->content_length)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Download incomplete");
+          return FALSE;
+        }
+    }
+  else if (!request->is_membuf)
     {
       struct stat stbuf;
 
@@ -446,6 +463,17 @@ finish_stream (FetcherRequest *request, GCancellable *cancellable, GError **erro
 
 static void on_stream_read (GObject *object, GAsyncResult *result, gpointer user_data);
 
+/* HTTP range requests are handled by the server; for file:// URIs we seek to
+ * the start of the range and stop reading at its end instead.
+ */
+static gsize
+request_next_read_size (FetcherRequest *request)
+{
+  if (request->file && request->range_length > 0)
+    return MIN (8192, request->range_length - request->current_size);
+  return 8192;
+}
+
 static void
 on_out_splice_complete (GObject *object, GAsyncResult *result, gpointer user_data)
 {
@@ -464,8 +492,9 @@ on_out_splice_complete (GObject *object, GAsyncResult *result, gpointer user_dat
   request->fetcher->bytes_transferred += bytes_written;
 
   GCancellable *cancellable = g_task_get_cancellable (task);
-  g_input_stream_read_bytes_async (request->response_body, 8192, G_PRIORITY_DEFAULT, cancellable,
-                                   on_stream_read, g_object_ref (task));
+  g_input_stream_read_bytes_async (request->response_body, request_next_read_size (request),
+                                   G_PRIORITY_DEFAULT, cancellable, on_stream_read,
+                                   g_object_ref (task));
 }
 
 static void
@@ -478,7 +507,7 @@ on_stream_read (GObject *object, GAsyncResult *result, gpointer user_data)
   /* Only open the output stream on demand to ensure we use as
    * few file descriptors as possible.
    */
-  if (!request->out_stream)
+  if (!request->out_stream && !request->write_func)
     {
       if (!request->is_membuf)
         {
@@ -523,7 +552,9 @@ on_stream_read (GObject *object, GAsyncResult *result, gpointer user_data)
           g_task_return_error (task, local_error);
           return;
         }
-      if (request->is_membuf)
+      if (request->write_func)
+        g_task_return_boolean (task, TRUE);
+      else if (request->is_membuf)
         {
           GBytes *mem_bytes
               = g_memory_output_stream_steal_as_bytes ((GMemoryOutputStream *)request->out_stream);
@@ -567,6 +598,22 @@ on_stream_read (GObject *object, GAsyncResult *result, gpointer user_data)
 
       request->current_size += bytes_read;
 
+      if (request->write_func)
+        {
+          gsize len;
+          const guint8 *buf = g_bytes_get_data (bytes, &len);
+          if (!request->write_func (buf, len, request->write_data, &local_error))
+            {
+              g_task_return_error (task, local_error);
+              return;
+            }
+          request->fetcher->bytes_transferred += bytes_read;
+          g_input_stream_read_bytes_async (request->response_body,
+                                           request_next_read_size (request), G_PRIORITY_DEFAULT,
+                                           cancellable, on_stream_read, g_object_ref (task));
+          return;
+        }
+
       /* We do this instead of _write_bytes_async() as that's not
        * guaranteed to do a complete write.
        */
@@ -598,6 +645,14 @@ on_request_sent (GObject *object, GAsyncResult *result, gpointer user_data)
       return;
     }
 
+  if (request->file && request->range_length > 0
+      && !g_seekable_seek (G_SEEKABLE (request->response_body), request->range_start, G_SEEK_SET,
+                           g_task_get_cancellable (task), &local_error))
+    {
+      g_task_return_error (task, local_error);
+      return;
+    }
+
   if (request->message)
     {
       SoupStatus status = soup_message_get_status (request->message);
@@ -683,8 +738,9 @@ on_request_sent (GObject *object, GAsyncResult *result, gpointer user_data)
     }
 
   GCancellable *cancellable = g_task_get_cancellable (task);
-  g_input_stream_read_bytes_async (request->response_body, 8192, G_PRIORITY_DEFAULT, cancellable,
-                                   on_stream_read, g_object_ref (task));
+  g_input_stream_read_bytes_async (request->response_body, request_next_read_size (request),
+                                   G_PRIORITY_DEFAULT, cancellable, on_stream_read,
+                                   g_object_ref (task));
 }
 
 static SoupSession *
@@ -737,6 +793,8 @@ static void
 _ostree_fetcher_request_async (OstreeFetcher *self, GPtrArray *mirrorlist, const char *filename,
                                OstreeFetcherRequestFlags flags, const char *if_none_match,
                                guint64 if_modified_since, gboolean is_membuf, guint64 max_size,
+                               guint64 range_start, guint64 range_length,
+                               OstreeFetcherWriteFunc write_func, gpointer write_data,
                                int priority, GCancellable *cancellable,
                                GAsyncReadyCallback callback, gpointer user_data)
 {
@@ -750,8 +808,12 @@ _ostree_fetcher_request_async (OstreeFetcher *self, GPtrArray *mirrorlist, const
   request->flags = flags;
   request->if_none_match = g_strdup (if_none_match);
   request->if_modified_since = if_modified_since;
+  request->range_start = range_start;
+  request->range_length = range_length;
   request->max_size = max_size;
   request->is_membuf = is_membuf;
+  request->write_func = write_func;
+  request->write_data = write_data;
   request->fetcher = self;
   request->mainctx = g_main_context_ref_thread_default ();
 
@@ -797,8 +859,8 @@ _ostree_fetcher_request_to_tmpfile (OstreeFetcher *self, GPtrArray *mirrorlist,
                                     GAsyncReadyCallback callback, gpointer user_data)
 {
   _ostree_fetcher_request_async (self, mirrorlist, filename, flags, if_none_match,
-                                 if_modified_since, FALSE, max_size, priority, cancellable,
-                                 callback, user_data);
+                                 if_modified_since, FALSE, max_size, 0, 0, NULL, NULL, priority,
+                                 cancellable, callback, user_data);
 }
 
 gboolean
@@ -838,8 +900,8 @@ _ostree_fetcher_request_to_membuf (OstreeFetcher *self, GPtrArray *mirrorlist, c
                                    gpointer user_data)
 {
   _ostree_fetcher_request_async (self, mirrorlist, filename, flags, if_none_match,
-                                 if_modified_since, TRUE, max_size, priority, cancellable, callback,
-                                 user_data);
+                                 if_modified_since, TRUE, max_size, 0, 0, NULL, NULL, priority,
+                                 cancellable, callback, user_data);
 }
 
 gboolean
@@ -871,8 +933,79 @@ _ostree_fetcher_request_to_membuf_finish (OstreeFetcher *self, GAsyncResult *res
   return TRUE;
 }
 
+/* Fetch @filename, passing its body to @write_func as it arrives rather than
+ * storing it; finish with _ostree_fetcher_request_to_stream_finish().  Only
+ * the body of a successful response is passed on, so a failed mirror never
+ * reaches @write_func.
+ */
+void
+_ostree_fetcher_request_to_stream (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                   const char *filename, OstreeFetcherRequestFlags flags,
+                                   guint64 max_size, int priority, OstreeFetcherWriteFunc write_func,
+                                   gpointer write_data, GCancellable *cancellable,
+                                   GAsyncReadyCallback callback, gpointer user_data)
+{
+  g_return_if_fail (write_func != NULL);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, FALSE, max_size, 0, 0,
+                                 write_func, write_data, priority, cancellable, callback,
+                                 user_data);
+}
+
+gboolean
+_ostree_fetcher_request_to_stream_finish (OstreeFetcher *self, GAsyncResult *result,
+                                          GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+  g_return_val_if_fail (g_async_result_is_tagged (result, _ostree_fetcher_request_async), FALSE);
+
+  return g_task_propagate_boolean ((GTask *)result, error);
+}
+
 guint64
 _ostree_fetcher_bytes_transferred (OstreeFetcher *self)
 {
   return self->bytes_transferred;
 }
+
+/* libsoup doesn't expose connection setup times */
+gboolean
+_ostree_fetcher_get_connection_stats (OstreeFetcher *self, OstreeFetcherConnectionStats *out_stats)
+{
+  *out_stats = (OstreeFetcherConnectionStats){
+    0,
+  };
+  return FALSE;
+}
+
+/* Fetch @range_length bytes of @filename starting at @range_start; finish with
+ * _ostree_fetcher_request_to_tmpfile_finish().  A server which ignores the
+ * range makes the request fail since the response exceeds @range_length.
+ */
+void
+_ostree_fetcher_request_range_to_tmpfile (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                          const char *filename, OstreeFetcherRequestFlags flags,
+                                          guint64 range_start, guint64 range_length, int priority,
+                                          GCancellable *cancellable, GAsyncReadyCallback callback,
+                                          gpointer user_data)
+{
+  g_return_if_fail (range_length > 0);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, FALSE, range_length,
+                                 range_start, range_length, NULL, NULL, priority, cancellable,
+                                 callback, user_data);
+}
+
+/* Like _ostree_fetcher_request_range_to_tmpfile(), but finish with
+ * _ostree_fetcher_request_to_membuf_finish().
+ */
+void
+_ostree_fetcher_request_range_to_membuf (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                         const char *filename, OstreeFetcherRequestFlags flags,
+                                         guint64 range_start, guint64 range_length, int priority,
+                                         GCancellable *cancellable, GAsyncReadyCallback callback,
+                                         gpointer user_data)
+{
+  g_return_if_fail (range_length > 0);
+  _ostree_fetcher_request_async (self, mirrorlist, filename, flags, NULL, 0, TRUE, range_length,
+                                 range_start, range_length, NULL, NULL, priority, cancellable,
+                                 callback, user_data);
+}
@@ -64,6 +64,22 @@ typedef enum
   OSTREE_FETCHER_REQUEST_LINKABLE = (1 << 2),
 } OstreeFetcherRequestFlags;
 
+/* Receives successive pieces of a response body; see
+ * _ostree_fetcher_request_to_stream().  Returning %FALSE aborts the request
+ * with @error.
+ */
+typedef gboolean (*OstreeFetcherWriteFunc) (const guint8 *buf, gsize len, gpointer user_data,
+                                            GError **error);
+
+/* Time spent setting up new connections, summed over all of them */
+typedef struct
+{
+  guint n_connections;
+  guint64 dns_usec;
+  guint64 connect_usec;
+  guint64 tls_usec;
+} OstreeFetcherConnectionStats;
+
 void _ostree_fetcher_uri_free (OstreeFetcherURI *uri);
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (OstreeFetcherURI, _ostree_fetcher_uri_free)
 
@@ -117,6 +133,9 @@ void _ostree_fetcher_set_extra_user_agent (OstreeFetcher *self, const char *extr
 
 guint64 _ostree_fetcher_bytes_transferred (OstreeFetcher *self);
 
+gboolean _ostree_fetcher_get_connection_stats (OstreeFetcher *self,
+                                               OstreeFetcherConnectionStats *out_stats);
+
 void _ostree_fetcher_request_to_tmpfile (OstreeFetcher *self, GPtrArray *mirrorlist,
                                          const char *filename, OstreeFetcherRequestFlags flags,
                                          const char *if_none_match, guint64 if_modified_since,
@@ -139,6 +158,29 @@ gboolean _ostree_fetcher_request_to_membuf_finish (OstreeFetcher *self, GAsyncRe
                                                    char **out_etag, guint64 *out_last_modified,
                                                    GError **error);
 
+void _ostree_fetcher_request_to_stream (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                        const char *filename, OstreeFetcherRequestFlags flags,
+                                        guint64 max_size, int priority,
+                                        OstreeFetcherWriteFunc write_func, gpointer write_data,
+                                        GCancellable *cancellable, GAsyncReadyCallback callback,
+                                        gpointer user_data);
+
+gboolean _ostree_fetcher_request_to_stream_finish (OstreeFetcher *self, GAsyncResult *result,
+                                                   GError **error);
+
+void _ostree_fetcher_request_range_to_tmpfile (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                               const char *filename,
+                                               OstreeFetcherRequestFlags flags,
+                                               guint64 range_start, guint64 range_length,
+                                               int priority, GCancellable *cancellable,
+                                               GAsyncReadyCallback callback, gpointer user_data);
+
+void _ostree_fetcher_request_range_to_membuf (OstreeFetcher *self, GPtrArray *mirrorlist,
+                                              const char *filename, OstreeFetcherRequestFlags flags,
+                                              guint64 range_start, guint64 range_length,
+                                              int priority, GCancellable *cancellable,
+                                              GAsyncReadyCallback callback, gpointer user_data);
+
 G_END_DECLS
 
 #endif
@@ -25,6 +25,7 @@
 #include <gio/gfiledescriptorbased.h>
 #include <gio/gunixoutputstream.h>
 #include <glib-unix.h>
+#include <sys/stat.h>
 #include <sys/xattr.h>
 
 #include "ostree-core-private.h"
@@ -49,11 +50,13 @@ typedef struct
   GString *path_buf;         /* buffer for real path if filtering enabled */
   GString *selabel_path_buf; /* buffer for selinux path if labeling enabled; this may be
                                 the same buffer as path_buf */
+  OtUring *uring;            /* if hardlinks can be batched; see checkout_dir_files_batched() */
 } CheckoutState;
 
 static void
 checkout_state_clear (CheckoutState *state)
 {
+  g_clear_pointer (&state->uring, ot_uring_free);
   if (state->path_buf)
     g_string_free (state->path_buf, TRUE);
   if (state->selabel_path_buf && (state->selabel_path_buf != state->path_buf))
@@ -829,7 +832,10 @@ checkout_one_file_at (OstreeRepo *repo, OstreeRepoCheckoutAtOptions *options, Ch
                   key->ino = stbuf.st_ino;
                   memcpy (key->checksum, checksum, OSTREE_SHA256_STRING_LEN + 1);
 
+                  /* This may be called from multiple threads for parallel checkouts */
+                  g_mutex_lock (&repo->cache_lock);
                   g_hash_table_add ((GHashTable *)options->devino_to_csum_cache, key);
+                  g_mutex_unlock (&repo->cache_lock);
                 }
 
               if (hardlink_res != HARDLINK_RESULT_NOT_SUPPORTED)
@@ -969,27 +975,41 @@ pop_path_element (OstreeRepoCheckoutAtOptions *options, CheckoutState *state, co
     g_string_truncate (state->selabel_path_buf, state->selabel_path_buf->len - n);
 }
 
+/* Metadata for a directory we're checking out, which is applied by
+ * checkout_dir_finish() once all of its children have been created.
+ */
+typedef struct
+{
+  gboolean did_exist;
+  guint32 uid;
+  guint32 gid;
+  guint32 mode;
+} CheckoutDirMeta;
+
 /*
- * checkout_tree_at:
+ * checkout_dir_begin:
  * @self: Repo
- * @mode: Options controlling all files
+ * @options: Options controlling all files
  * @state: Any state we're carrying through
- * @overwrite_mode: Whether or not to overwrite files
  * @destination_parent_fd: Place tree here
  * @destination_name: Use this name for tree
- * @source: Source tree
- * @source_info: Source info
+ * @dirtree_checksum: Source dirtree
+ * @dirmeta_checksum: Source dirmeta
+ * @out_dirtree: (out): Loaded dirtree, or %NULL if the directory was filtered out
+ * @out_destination_dfd: (out): File descriptor for the created directory
+ * @out_meta: (out): Metadata to pass to checkout_dir_finish()
  * @cancellable: Cancellable
  * @error: Error
  *
- * Like ostree_repo_checkout_tree(), but check out @source into the
- * relative @destination_name, located by @destination_parent_fd.
+ * Create the directory @destination_name (initially with mode 0700), and set
+ * its extended attributes; the contents are handled by the caller.
  */
 static gboolean
-checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
-                          CheckoutState *state, int destination_parent_fd,
-                          const char *destination_name, const char *dirtree_checksum,
-                          const char *dirmeta_checksum, GCancellable *cancellable, GError **error)
+checkout_dir_begin (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, CheckoutState *state,
+                    int destination_parent_fd, const char *destination_name,
+                    const char *dirtree_checksum, const char *dirmeta_checksum,
+                    GVariant **out_dirtree, int *out_destination_dfd, CheckoutDirMeta *out_meta,
+                    GCancellable *cancellable, GError **error)
 {
   gboolean did_exist = FALSE;
   gboolean is_opaque_whiteout = FALSE;
@@ -998,6 +1018,8 @@ checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options
   g_autoptr (GVariant) dirmeta = NULL;
   g_autoptr (GVariant) xattrs = NULL;
 
+  *out_dirtree = NULL;
+
   if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_TREE, dirtree_checksum, &dirtree,
                                  error))
     return FALSE;
@@ -1136,28 +1158,239 @@ checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options
         return glnx_prefix_error (error, "Processing dirmeta %s", dirmeta_checksum);
     }
 
-  /* Process files in this subdir */
-  {
-    g_autoptr (GVariant) dir_file_contents = g_variant_get_child_value (dirtree, 0);
-    GVariantIter viter;
-    g_variant_iter_init (&viter, dir_file_contents);
-    const char *fname;
-    g_autoptr (GVariant) contents_csum_v = NULL;
-    while (g_variant_iter_loop (&viter, "(&s@ay)", &fname, &contents_csum_v))
-      {
-        push_path_element (options, state, fname, FALSE);
+  out_meta->did_exist = did_exist;
+  out_meta->uid = uid;
+  out_meta->gid = gid;
+  out_meta->mode = mode;
+  *out_destination_dfd = glnx_steal_fd (&destination_dfd);
+  *out_dirtree = g_steal_pointer (&dirtree);
+  return TRUE;
+}
 
-        char tmp_checksum[OSTREE_SHA256_STRING_LEN + 1];
-        _ostree_checksum_inplace_from_bytes_v (contents_csum_v, tmp_checksum);
+/* Whether checkout_one_file_at() would simply hardlink every object which
+ * is a symlink or a non-empty regular file; see checkout_dir_files_batched().
+ */
+static gboolean
+can_batch_hardlinks (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options)
+{
+  return self->mode == OSTREE_REPO_MODE_BARE && options->mode == OSTREE_REPO_CHECKOUT_MODE_NONE
+         && !options->force_copy && !options->filter && !options->devino_to_csum_cache
+         && !options->process_whiteouts;
+}
 
-        if (!checkout_one_file_at (self, options, state, tmp_checksum, destination_dfd, fname,
-                                   cancellable, error))
-          return FALSE;
+/* The common case of checking out from a bare repository is to hardlink
+ * every file, which costs a few syscalls per file.  Instead, stat all of
+ * a directory's objects in one io_uring batch, then hardlink in a second
+ * batch those which checkout_one_file_at() would hardlink anyway.  Any
+ * other file, or one where linking fails (for example because it exists
+ * already, or the object is in a parent repo), is checked out by
+ * checkout_one_file_at() as usual, which handles overwrite modes and
+ * errors.
+ */
+static gboolean
+checkout_dir_files_batched (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
+                            CheckoutState *state, GVariant *dir_file_contents, int destination_dfd,
+                            GCancellable *cancellable, GError **error)
+{
+  OtUring *uring = state->uring;
+  const gsize n = g_variant_n_children (dir_file_contents);
+  g_autofree struct statx *stbufs = g_new0 (struct statx, n);
 
-        pop_path_element (options, state, fname, FALSE);
-      }
-    contents_csum_v = NULL; /* iter_loop freed it */
-  }
+  ot_uring_reset (uring);
+  for (gsize i = 0; i < n; i++)
+    {
+      const char *fname;
+      g_autoptr (GVariant) contents_csum_v = NULL;
+      g_variant_get_child (dir_file_contents, i, "(&s@ay)", &fname, &contents_csum_v);
+      char checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (contents_csum_v, checksum);
+      char loose_path[_OSTREE_LOOSE_PATH_MAX];
+      _ostree_loose_path (loose_path, checksum, OSTREE_OBJECT_TYPE_FILE, OSTREE_REPO_MODE_BARE);
+      ot_uring_queue_statx (uring, self->objects_dir_fd, loose_path, AT_SYMLINK_NOFOLLOW,
+                            STATX_TYPE | STATX_SIZE, &stbufs[i]);
+    }
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+  if (!ot_uring_submit (uring, error))
+    return FALSE;
+
+  g_autofree gboolean *linkable = g_new0 (gboolean, n);
+  for (gsize i = 0; i < n; i++)
+    {
+      const char *fname;
+      g_variant_get_child (dir_file_contents, i, "(&s@ay)", &fname, NULL);
+      const struct statx *stbuf = &stbufs[i];
+      /* Empty files are always copied */
+      const gboolean is_link_or_nonempty
+          = S_ISLNK (stbuf->stx_mode) || (S_ISREG (stbuf->stx_mode) && stbuf->stx_size > 0);
+      linkable[i] = ot_uring_get_result (uring, i) == 0 && is_link_or_nonempty
+                    && !g_str_has_prefix (fname, OSTREE_QUOTED_OVERLAYFS_WHITEOUT_PREFIX)
+                    && ot_util_filename_validate (fname, NULL);
+    }
+
+  ot_uring_reset (uring);
+  g_autofree guint *ops = g_new0 (guint, n);
+  for (gsize i = 0; i < n; i++)
+    {
+      if (!linkable[i])
+        continue;
+      const char *fname;
+      g_autoptr (GVariant) contents_csum_v = NULL;
+      g_variant_get_child (dir_file_contents, i, "(&s@ay)", &fname, &contents_csum_v);
+      char checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (contents_csum_v, checksum);
+      char loose_path[_OSTREE_LOOSE_PATH_MAX];
+      _ostree_loose_path (loose_path, checksum, OSTREE_OBJECT_TYPE_FILE, OSTREE_REPO_MODE_BARE);
+      ops[i] = ot_uring_queue_linkat (uring, self->objects_dir_fd, loose_path, destination_dfd,
+                                      fname);
+    }
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+  if (!ot_uring_submit (uring, error))
+    return FALSE;
+
+  for (gsize i = 0; i < n; i++)
+    {
+      if (linkable[i] && ot_uring_get_result (uring, ops[i]) == 0)
+        continue;
+
+      const char *fname;
+      g_autoptr (GVariant) contents_csum_v = NULL;
+      g_variant_get_child (dir_file_contents, i, "(&s@ay)", &fname, &contents_csum_v);
+      char checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (contents_csum_v, checksum);
+      if (!checkout_one_file_at (self, options, state, checksum, destination_dfd, fname,
+                                 cancellable, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Check out the non-directory entries of @dirtree into @destination_dfd */
+static gboolean
+checkout_dir_files (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, CheckoutState *state,
+                    GVariant *dirtree, int destination_dfd, GCancellable *cancellable,
+                    GError **error)
+{
+  g_autoptr (GVariant) dir_file_contents = g_variant_get_child_value (dirtree, 0);
+  if (state->uring)
+    return checkout_dir_files_batched (self, options, state, dir_file_contents, destination_dfd,
+                                       cancellable, error);
+
+  GVariantIter viter;
+  g_variant_iter_init (&viter, dir_file_contents);
+  const char *fname;
+  g_autoptr (GVariant) contents_csum_v = NULL;
+  while (g_variant_iter_loop (&viter, "(&s@ay)", &fname, &contents_csum_v))
+    {
+      push_path_element (options, state, fname, FALSE);
+
+      char tmp_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (contents_csum_v, tmp_checksum);
+
+      if (!checkout_one_file_at (self, options, state, tmp_checksum, destination_dfd, fname,
+                                 cancellable, error))
+        return FALSE;
+
+      pop_path_element (options, state, fname, FALSE);
+    }
+  contents_csum_v = NULL; /* iter_loop freed it */
+
+  return TRUE;
+}
+
+/* Apply the final mode, ownership and timestamp to a directory created by
+ * checkout_dir_begin(), once all of its children exist.
+ */
+static gboolean
+checkout_dir_finish (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, int destination_dfd,
+                     const CheckoutDirMeta *meta, GError **error)
+{
+  /* We do fchmod/fchown last so that no one else could access the
+   * partially created directory and change content we're laying out.
+   */
+  if (!meta->did_exist)
+    {
+      guint32 canonical_mode;
+      /* Silently ignore world-writable directories (plus sticky, suid bits,
+       * etc.) when doing a checkout for bare-user-only repos, or if requested explicitly.
+       * This is related to the logic in ostree-repo-commit.c for files.
+       * See also: https://github.com/ostreedev/ostree/pull/909 i.e.
+       * 0c4b3a2b6da950fd78e63f9afec602f6188f1ab0
+       */
+      if (self->mode == OSTREE_REPO_MODE_BARE_USER_ONLY || options->bareuseronly_dirs)
+        canonical_mode = (meta->mode & 0775) | S_IFDIR;
+      else
+        canonical_mode = meta->mode;
+      if (TEMP_FAILURE_RETRY (fchmod (destination_dfd, canonical_mode)) < 0)
+        return glnx_throw_errno_prefix (error, "fchmod");
+    }
+
+  if (!meta->did_exist && options->mode != OSTREE_REPO_CHECKOUT_MODE_USER)
+    {
+      if (TEMP_FAILURE_RETRY (fchown (destination_dfd, meta->uid, meta->gid)) < 0)
+        return glnx_throw_errno (error);
+    }
+
+  /* Set directory mtime to OSTREE_TIMESTAMP, so that it is constant for all checkouts.
+   * Must be done after setting permissions and creating all children.  Note we skip doing
+   * this for directories that already exist (under the theory we possibly don't own them),
+   * and we also skip it if doing copying checkouts, which is mostly for /etc.
+   */
+  if (!meta->did_exist && !options->force_copy)
+    {
+      const struct timespec times[2]
+          = { { OSTREE_TIMESTAMP, UTIME_OMIT }, { OSTREE_TIMESTAMP, 0 } };
+      if (TEMP_FAILURE_RETRY (futimens (destination_dfd, times)) < 0)
+        return glnx_throw_errno (error);
+    }
+
+  if (fsync_is_enabled (self, options))
+    {
+      if (fsync (destination_dfd) == -1)
+        return glnx_throw_errno (error);
+    }
+
+  return TRUE;
+}
+
+/*
+ * checkout_tree_at:
+ * @self: Repo
+ * @mode: Options controlling all files
+ * @state: Any state we're carrying through
+ * @overwrite_mode: Whether or not to overwrite files
+ * @destination_parent_fd: Place tree here
+ * @destination_name: Use this name for tree
+ * @source: Source tree
+ * @source_info: Source info
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like ostree_repo_checkout_tree(), but check out @source into the
+ * relative @destination_name, located by @destination_parent_fd.
+ */
+static gboolean
+checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
+                          CheckoutState *state, int destination_parent_fd,
+                          const char *destination_name, const char *dirtree_checksum,
+                          const char *dirmeta_checksum, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GVariant) dirtree = NULL;
+  glnx_autofd int destination_dfd = -1;
+  CheckoutDirMeta meta;
+
+  if (!checkout_dir_begin (self, options, state, destination_parent_fd, destination_name,
+                           dirtree_checksum, dirmeta_checksum, &dirtree, &destination_dfd, &meta,
+                           cancellable, error))
+    return FALSE;
+  if (dirtree == NULL)
+    return TRUE; /* Filtered out */
+
+  /* Process files in this subdir */
+  if (!checkout_dir_files (self, options, state, dirtree, destination_dfd, cancellable, error))
+    return FALSE;
 
   /* Process subdirectories */
   {
@@ -1194,51 +1427,269 @@ checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options
       }
   }
 
-  /* We do fchmod/fchown last so that no one else could access the
-   * partially created directory and change content we're laying out.
-   */
-  if (!did_exist)
+  return checkout_dir_finish (self, options, destination_dfd, &meta, error);
+}
+
+/* The parallel variant of checkout_tree_at_recurse(), used when
+ * OstreeRepoCheckoutAtOptions.n_jobs is greater than one.  Each directory is
+ * a task for a thread pool: the task creates the directory, checks out its
+ * files, and queues a new task for each subdirectory.  The final directory
+ * metadata (mode, ownership, mtime) must only be applied once everything below
+ * it exists, so every task counts its unfinished subdirectories; whichever
+ * thread finishes the last one applies the metadata and then does the same
+ * for the parent.
+ *
+ * Tasks don't hold directory fds while queued; instead they are reopened
+ * relative to the toplevel destination fd, so the number of open files doesn't
+ * scale with the width of the tree.
+ */
+typedef struct CheckoutDirTask CheckoutDirTask;
+struct CheckoutDirTask
+{
+  CheckoutDirTask *parent;
+  char *name;
+  char *relpath; /* Relative to CheckoutPool.destination_parent_fd */
+  char dirtree_checksum[OSTREE_SHA256_STRING_LEN + 1];
+  char dirmeta_checksum[OSTREE_SHA256_STRING_LEN + 1];
+  CheckoutDirMeta meta;
+  gboolean created;
+  /* Atomic; one for the task itself, plus one per unfinished subdirectory */
+  gint pending;
+};
+
+static CheckoutDirTask *
+checkout_dir_task_new (CheckoutDirTask *parent, const char *name, const char *dirtree_checksum,
+                       const char *dirmeta_checksum)
+{
+  CheckoutDirTask *task = g_new0 (CheckoutDirTask, 1);
+  task->parent = parent;
+  task->name = g_strdup (name);
+  task->relpath = parent ? g_build_filename (parent->relpath, name, NULL) : g_strdup (name);
+  memcpy (task->dirtree_checksum, dirtree_checksum, sizeof (task->dirtree_checksum));
+  memcpy (task->dirmeta_checksum, dirmeta_checksum, sizeof (task->dirmeta_checksum));
+  task->pending = 1;
+  if (parent)
+    g_atomic_int_inc (&parent->pending);
+  return task;
+}
+
+static void
+checkout_dir_task_free (CheckoutDirTask *task)
+{
+  g_free (task->name);
+  g_free (task->relpath);
+  g_free (task);
+}
+
+typedef struct
+{
+  OstreeRepo *repo;
+  OstreeRepoCheckoutAtOptions *options;
+  int destination_parent_fd;
+  GCancellable *cancellable;
+  GThreadPool *pool;
+
+  GMutex lock;
+  GCond cond;
+  /* Protected by @lock */
+  guint n_outstanding;
+  GError *error;
+} CheckoutPool;
+
+static gboolean
+checkout_pool_has_error (CheckoutPool *cpool)
+{
+  g_mutex_lock (&cpool->lock);
+  gboolean ret = cpool->error != NULL;
+  g_mutex_unlock (&cpool->lock);
+  return ret;
+}
+
+static void
+checkout_pool_take_error (CheckoutPool *cpool, GError *error)
+{
+  g_mutex_lock (&cpool->lock);
+  if (cpool->error == NULL)
+    cpool->error = error;
+  else
+    g_error_free (error);
+  g_mutex_unlock (&cpool->lock);
+}
+
+static gboolean
+checkout_pool_push (CheckoutPool *cpool, CheckoutDirTask *task, GError **error)
+{
+  g_mutex_lock (&cpool->lock);
+  cpool->n_outstanding++;
+  g_mutex_unlock (&cpool->lock);
+
+  if (!g_thread_pool_push (cpool->pool, task, error))
     {
-      guint32 canonical_mode;
-      /* Silently ignore world-writable directories (plus sticky, suid bits,
-       * etc.) when doing a checkout for bare-user-only repos, or if requested explicitly.
-       * This is related to the logic in ostree-repo-commit.c for files.
-       * See also: https://github.com/ostreedev/ostree/pull/909 i.e.
-       * 0c4b3a2b6da950fd78e63f9afec602f6188f1ab0
-       */
-      if (self->mode == OSTREE_REPO_MODE_BARE_USER_ONLY || options->bareuseronly_dirs)
-        canonical_mode = (mode & 0775) | S_IFDIR;
-      else
-        canonical_mode = mode;
-      if (TEMP_FAILURE_RETRY (fchmod (destination_dfd, canonical_mode)) < 0)
-        return glnx_throw_errno_prefix (error, "fchmod");
+      g_mutex_lock (&cpool->lock);
+      cpool->n_outstanding--;
+      g_mutex_unlock (&cpool->lock);
+      return FALSE;
     }
 
-  if (!did_exist && options->mode != OSTREE_REPO_CHECKOUT_MODE_USER)
+  return TRUE;
+}
+
+/* Drop one pending reference on @task; if it was the last one, the directory
+ * is complete, so apply its metadata and continue with its parent.
+ */
+static void
+checkout_dir_task_complete_one (CheckoutPool *cpool, CheckoutDirTask *task)
+{
+  while (task != NULL && g_atomic_int_dec_and_test (&task->pending))
     {
-      if (TEMP_FAILURE_RETRY (fchown (destination_dfd, uid, gid)) < 0)
-        return glnx_throw_errno (error);
+      CheckoutDirTask *parent = task->parent;
+
+      if (task->created && !checkout_pool_has_error (cpool))
+        {
+          g_autoptr (GError) local_error = NULL;
+          glnx_autofd int dfd = -1;
+          if (!glnx_opendirat (cpool->destination_parent_fd, task->relpath, TRUE, &dfd,
+                               &local_error)
+              || !checkout_dir_finish (cpool->repo, cpool->options, dfd, &task->meta,
+                                       &local_error))
+            checkout_pool_take_error (cpool, g_steal_pointer (&local_error));
+        }
+
+      checkout_dir_task_free (task);
+      task = parent;
     }
+}
 
-  /* Set directory mtime to OSTREE_TIMESTAMP, so that it is constant for all checkouts.
-   * Must be done after setting permissions and creating all children.  Note we skip doing
-   * this for directories that already exist (under the theory we possibly don't own them),
-   * and we also skip it if doing copying checkouts, which is mostly for /etc.
+static gboolean
+checkout_dir_task_run (CheckoutPool *cpool, CheckoutDirTask *task, GError **error)
+{
+  OstreeRepo *self = cpool->repo;
+  OstreeRepoCheckoutAtOptions *options = cpool->options;
+  /* Path tracking is only needed for filters and SELinux labeling, neither of
+   * which is used in parallel mode.
    */
-  if (!did_exist && !options->force_copy)
+  g_auto (CheckoutState) state = {
+    0,
+  };
+
+  glnx_autofd int parent_dfd_owned = -1;
+  int parent_dfd = cpool->destination_parent_fd;
+  if (task->parent)
     {
-      const struct timespec times[2]
-          = { { OSTREE_TIMESTAMP, UTIME_OMIT }, { OSTREE_TIMESTAMP, 0 } };
-      if (TEMP_FAILURE_RETRY (futimens (destination_dfd, times)) < 0)
-        return glnx_throw_errno (error);
+      if (!glnx_opendirat (cpool->destination_parent_fd, task->parent->relpath, TRUE,
+                           &parent_dfd_owned, error))
+        return FALSE;
+      parent_dfd = parent_dfd_owned;
     }
 
-  if (fsync_is_enabled (self, options))
+  g_autoptr (GVariant) dirtree = NULL;
+  glnx_autofd int destination_dfd = -1;
+  if (!checkout_dir_begin (self, options, &state, parent_dfd, task->name, task->dirtree_checksum,
+                           task->dirmeta_checksum, &dirtree, &destination_dfd, &task->meta,
+                           cpool->cancellable, error))
+    return FALSE;
+  if (dirtree == NULL)
+    return TRUE; /* Filtered out */
+  task->created = TRUE;
+
+  if (!checkout_dir_files (self, options, &state, dirtree, destination_dfd, cpool->cancellable,
+                           error))
+    return FALSE;
+
+  g_autoptr (GVariant) dir_subdirs = g_variant_get_child_value (dirtree, 1);
+  const char *dname;
+  g_autoptr (GVariant) subdirtree_csum_v = NULL;
+  g_autoptr (GVariant) subdirmeta_csum_v = NULL;
+  GVariantIter viter;
+  g_variant_iter_init (&viter, dir_subdirs);
+  while (
+      g_variant_iter_loop (&viter, "(&s@ay@ay)", &dname, &subdirtree_csum_v, &subdirmeta_csum_v))
     {
-      if (fsync (destination_dfd) == -1)
-        return glnx_throw_errno (error);
+      /* See the comment in checkout_tree_at_recurse() */
+      if (!ot_util_filename_validate (dname, error))
+        return FALSE;
+
+      char subdirtree_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (subdirtree_csum_v, subdirtree_checksum);
+      char subdirmeta_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (subdirmeta_csum_v, subdirmeta_checksum);
+
+      CheckoutDirTask *subtask
+          = checkout_dir_task_new (task, dname, subdirtree_checksum, subdirmeta_checksum);
+      if (!checkout_pool_push (cpool, subtask, error))
+        {
+          /* Undo the pending reference taken on us */
+          g_atomic_int_add (&task->pending, -1);
+          checkout_dir_task_free (subtask);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static void
+checkout_pool_worker (gpointer data, gpointer user_data)
+{
+  CheckoutDirTask *task = data;
+  CheckoutPool *cpool = user_data;
+  g_autoptr (GError) local_error = NULL;
+
+  if (!checkout_pool_has_error (cpool)
+      && !checkout_dir_task_run (cpool, task, &local_error))
+    checkout_pool_take_error (cpool, g_steal_pointer (&local_error));
+
+  checkout_dir_task_complete_one (cpool, task);
+
+  g_mutex_lock (&cpool->lock);
+  cpool->n_outstanding--;
+  g_cond_signal (&cpool->cond);
+  g_mutex_unlock (&cpool->lock);
+}
+
+static gboolean
+checkout_tree_at_parallel (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
+                           int destination_parent_fd, const char *destination_name,
+                           const char *dirtree_checksum, const char *dirmeta_checksum,
+                           GCancellable *cancellable, GError **error)
+{
+  CheckoutPool cpool = {
+    0,
+  };
+  cpool.repo = self;
+  cpool.options = options;
+  cpool.destination_parent_fd = destination_parent_fd;
+  cpool.cancellable = cancellable;
+  cpool.pool = g_thread_pool_new (checkout_pool_worker, &cpool, options->n_jobs, FALSE, error);
+  if (!cpool.pool)
+    return FALSE;
+  g_mutex_init (&cpool.lock);
+  g_cond_init (&cpool.cond);
+
+  CheckoutDirTask *root
+      = checkout_dir_task_new (NULL, destination_name, dirtree_checksum, dirmeta_checksum);
+  g_autoptr (GError) local_error = NULL;
+  if (!checkout_pool_push (&cpool, root, &local_error))
+    {
+      checkout_dir_task_free (root);
+      checkout_pool_take_error (&cpool, g_steal_pointer (&local_error));
     }
 
+  /* Wait for all tasks; note this includes the ones that failed */
+  g_mutex_lock (&cpool.lock);
+  while (cpool.n_outstanding > 0)
+    g_cond_wait (&cpool.cond, &cpool.lock);
+  g_mutex_unlock (&cpool.lock);
+
+  g_thread_pool_free (cpool.pool, FALSE, TRUE);
+  g_mutex_clear (&cpool.lock);
+  g_cond_clear (&cpool.cond);
+
+  if (cpool.error)
+    {
+      g_propagate_error (error, cpool.error);
+      return FALSE;
+    }
   return TRUE;
 }
 
@@ -1460,6 +1911,20 @@ checkout_tree_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, int de
   g_assert_cmpint (g_file_info_get_file_type (source_info), ==, G_FILE_TYPE_DIRECTORY);
   const char *dirtree_checksum = ostree_repo_file_tree_get_contents_checksum (source);
   const char *dirmeta_checksum = ostree_repo_file_tree_get_metadata_checksum (source);
+
+  /* Filters and SELinux labeling rely on the path tracked in @state, whiteout
+   * processing may delete content that another thread is writing, and the
+   * uncompressed object cache isn't thread safe; do those serially.
+   */
+  const gboolean can_parallelize = options->n_jobs > 1 && !options->filter && !options->sepolicy
+                                   && !options->process_whiteouts && !can_cache;
+  if (can_parallelize)
+    return checkout_tree_at_parallel (self, options, destination_parent_fd, destination_name,
+                                      dirtree_checksum, dirmeta_checksum, cancellable, error);
+
+  if (can_batch_hardlinks (self, options))
+    state.uring = ot_uring_new ();
+
   return checkout_tree_at_recurse (self, options, &state, destination_parent_fd, destination_name,
                                    dirtree_checksum, dirmeta_checksum, cancellable, error);
 }
@@ -0,0 +1,883 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gio/gunixinputstream.h>
+#include <zlib.h>
+
+#include "bupsplit.h"
+#include "ostree-autocleanups.h"
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "otutil.h"
+
+/* Chunked file objects are an alternative storage for large content objects
+ * of archive repositories.  A one byte change to a large file otherwise
+ * yields a new content object which has to be stored and fetched in full;
+ * instead, ostree_repo_chunk_objects() splits the content at boundaries
+ * found by the bupsplit rolling checksum (as used for static deltas, see
+ * ostree-rollsum.c), so that unchanged regions produce identical chunks,
+ * which are stored once and which pull only fetches if it doesn't have them
+ * already.
+ *
+ * The object checksum is that of the whole file as usual; the chunks are
+ * only a storage and transfer format, reassembled by ostree_repo_load_file().
+ * Chunks which are no longer used by any chunked object are removed by
+ * prune.
+ */
+
+/* Chunks are at least CHUNK_MIN_SIZE bytes (apart from the last one), at
+ * most CHUNK_MAX_SIZE bytes, and otherwise end where the rolling checksum
+ * has CHUNK_SPLIT_BITS low bits set, for an average of about 128 KiB.
+ */
+#define CHUNK_MIN_SIZE (64 * 1024)
+#define CHUNK_MAX_SIZE (1024 * 1024)
+#define CHUNK_SPLIT_BITS 16
+
+/* Other writers may pick larger chunks, but we want a bound on the memory
+ * used to verify a chunk fetched from a remote.
+ */
+#define CHUNK_MAX_ACCEPTED_SIZE (16 * 1024 * 1024)
+
+#define OSTREE_TYPE_CHUNKED_INPUT_STREAM (_ostree_chunked_input_stream_get_type ())
+G_DECLARE_FINAL_TYPE (OstreeChunkedInputStream, _ostree_chunked_input_stream, OSTREE,
+                      CHUNKED_INPUT_STREAM, GInputStream)
+
+/* Reads the chunks of a chunked file object in order, opening each one only
+ * when the previous one has been read.
+ */
+struct _OstreeChunkedInputStream
+{
+  GInputStream parent_instance;
+
+  OstreeRepo *repo;
+  GVariant *chunks; /* a(ayt) */
+  gsize index;
+  GInputStream *current;
+};
+
+G_DEFINE_TYPE (OstreeChunkedInputStream, _ostree_chunked_input_stream, G_TYPE_INPUT_STREAM)
+
+static void
+_ostree_chunked_input_stream_finalize (GObject *object)
+{
+  OstreeChunkedInputStream *self = OSTREE_CHUNKED_INPUT_STREAM (object);
+
+  g_clear_object (&self->current);
+  g_clear_pointer (&self->chunks, g_variant_unref);
+  g_clear_object (&self->repo);
+
+  G_OBJECT_CLASS (_ostree_chunked_input_stream_parent_class)->finalize (object);
+}
+
+static gboolean open_chunk (OstreeRepo *self, const char *digest, GInputStream **out_input,
+                            GError **error);
+
+static gssize
+_ostree_chunked_input_stream_read (GInputStream *stream, void *buffer, gsize count,
+                                   GCancellable *cancellable, GError **error)
+{
+  OstreeChunkedInputStream *self = OSTREE_CHUNKED_INPUT_STREAM (stream);
+
+  while (TRUE)
+    {
+      if (self->current == NULL)
+        {
+          if (self->index == g_variant_n_children (self->chunks))
+            return 0;
+
+          g_autoptr (GVariant) digest_v = NULL;
+          g_variant_get_child (self->chunks, self->index, "(@ayt)", &digest_v, NULL);
+          char digest[OSTREE_SHA256_STRING_LEN + 1];
+          _ostree_checksum_inplace_from_bytes_v (digest_v, digest);
+          if (!open_chunk (self->repo, digest, &self->current, error))
+            return -1;
+          self->index++;
+        }
+
+      gssize n_read = g_input_stream_read (self->current, buffer, count, cancellable, error);
+      if (n_read != 0)
+        return n_read;
+      g_clear_object (&self->current);
+    }
+}
+
+static gboolean
+_ostree_chunked_input_stream_close (GInputStream *stream, GCancellable *cancellable,
+                                    GError **error)
+{
+  OstreeChunkedInputStream *self = OSTREE_CHUNKED_INPUT_STREAM (stream);
+
+  g_clear_object (&self->current);
+  return TRUE;
+}
+
+static void
+_ostree_chunked_input_stream_class_init (OstreeChunkedInputStreamClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GInputStreamClass *stream_class = G_INPUT_STREAM_CLASS (klass);
+
+  gobject_class->finalize = _ostree_chunked_input_stream_finalize;
+  stream_class->read_fn = _ostree_chunked_input_stream_read;
+  stream_class->close_fn = _ostree_chunked_input_stream_close;
+}
+
+static void
+_ostree_chunked_input_stream_init (OstreeChunkedInputStream *self)
+{
+}
+
+static GInputStream *
+_ostree_chunked_input_stream_new (OstreeRepo *repo, GVariant *chunks)
+{
+  OstreeChunkedInputStream *self = g_object_new (OSTREE_TYPE_CHUNKED_INPUT_STREAM, NULL);
+  self->repo = g_object_ref (repo);
+  self->chunks = g_variant_ref (chunks);
+  return (GInputStream *)self;
+}
+
+static void
+chunk_path (char *buf, const char *digest)
+{
+  snprintf (buf, _OSTREE_LOOSE_PATH_MAX, "%s/%.2s/%s.chunk", _OSTREE_CHUNK_DIR, digest,
+            digest + 2);
+}
+
+static gboolean
+open_chunk (OstreeRepo *self, const char *digest, GInputStream **out_input, GError **error)
+{
+  char path[_OSTREE_LOOSE_PATH_MAX];
+  chunk_path (path, digest);
+
+  glnx_autofd int fd = -1;
+  if (!glnx_openat_rdonly (self->objects_dir_fd, path, TRUE, &fd, error))
+    return glnx_prefix_error (error, "Opening chunk %s", digest);
+
+  g_autoptr (GInputStream) input = g_unix_input_stream_new (g_steal_fd (&fd), TRUE);
+  g_autoptr (GConverter) decompressor
+      = (GConverter *)g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW);
+  *out_input = g_converter_input_stream_new (input, decompressor);
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_chunked_file_path:
+ * @buf: Output buffer, must be _OSTREE_LOOSE_PATH_MAX in size
+ *
+ * Like _ostree_loose_path(), for the chunked form of content object
+ * @checksum.
+ */
+void
+_ostree_repo_chunked_file_path (char *buf, const char *checksum)
+{
+  snprintf (buf, _OSTREE_LOOSE_PATH_MAX, "%.2s/%s.filechunks", checksum, checksum + 2);
+}
+
+/*
+ * _ostree_repo_chunked_file_lookup:
+ * @out_found: Set to %TRUE if content object @checksum is stored chunked
+ * @out_descriptor: (out) (optional): Its _OSTREE_CHUNKED_FILE_GVARIANT_FORMAT descriptor
+ *
+ * Look up the chunked form of content object @checksum.  Repositories in
+ * modes other than archive never have chunked objects.
+ */
+gboolean
+_ostree_repo_chunked_file_lookup (OstreeRepo *self, const char *checksum, gboolean *out_found,
+                                  GVariant **out_descriptor, GError **error)
+{
+  *out_found = FALSE;
+  if (out_descriptor)
+    *out_descriptor = NULL;
+
+  if (self->mode != OSTREE_REPO_MODE_ARCHIVE)
+    return TRUE;
+
+  char path[_OSTREE_LOOSE_PATH_MAX];
+  _ostree_repo_chunked_file_path (path, checksum);
+
+  if (!out_descriptor)
+    {
+      if (!glnx_fstatat_allow_noent (self->objects_dir_fd, path, NULL, 0, error))
+        return FALSE;
+      *out_found = (errno == 0);
+      return TRUE;
+    }
+
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (self->objects_dir_fd, path, &fd, error))
+    return FALSE;
+  if (fd == -1)
+    return TRUE;
+
+  if (!ot_variant_read_fd (fd, 0, _OSTREE_CHUNKED_FILE_GVARIANT_FORMAT, TRUE, out_descriptor,
+                           error))
+    return glnx_prefix_error (error, "Loading chunked object %s", checksum);
+  *out_found = TRUE;
+  return TRUE;
+}
+
+/*
+ * _ostree_chunked_file_validate:
+ *
+ * Check that @descriptor, which may come from an untrusted source, describes
+ * a regular file whose chunks add up to its size.
+ */
+gboolean
+_ostree_chunked_file_validate (GVariant *descriptor, GError **error)
+{
+  guint64 size;
+  guint32 mode;
+  g_autoptr (GVariant) chunks = NULL;
+  g_variant_get (descriptor, "(tuuu@a(ayay)@a(ayt))", &size, NULL, NULL, &mode, NULL, &chunks);
+
+  if (!S_ISREG (GUINT32_FROM_BE (mode)))
+    return glnx_throw (error, "Chunked object is not a regular file");
+
+  guint64 total = 0;
+  const gsize n_chunks = g_variant_n_children (chunks);
+  for (gsize i = 0; i < n_chunks; i++)
+    {
+      g_autoptr (GVariant) digest_v = NULL;
+      guint64 chunk_size;
+      g_variant_get_child (chunks, i, "(@ayt)", &digest_v, &chunk_size);
+      if (!ostree_validate_structureof_csum_v (digest_v, error))
+        return glnx_prefix_error (error, "Invalid chunk");
+      chunk_size = GUINT64_FROM_BE (chunk_size);
+      if (chunk_size == 0 || chunk_size > CHUNK_MAX_ACCEPTED_SIZE)
+        return glnx_throw (error, "Invalid chunk size %" G_GUINT64_FORMAT, chunk_size);
+      total += chunk_size;
+    }
+
+  if (total != GUINT64_FROM_BE (size))
+    return glnx_throw (error,
+                       "Chunks add up to %" G_GUINT64_FORMAT " bytes, expected %" G_GUINT64_FORMAT,
+                       total, GUINT64_FROM_BE (size));
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_chunked_file_parse:
+ * @out_input: (out) (optional): The reassembled file content
+ *
+ * Like ostree_content_stream_parse(), for a chunked object @descriptor.
+ */
+gboolean
+_ostree_repo_chunked_file_parse (OstreeRepo *self, GVariant *descriptor,
+                                 GInputStream **out_input, GFileInfo **out_file_info,
+                                 GVariant **out_xattrs, GError **error)
+{
+  guint64 size;
+  guint32 uid, gid, mode;
+  g_autoptr (GVariant) xattrs = NULL;
+  g_autoptr (GVariant) chunks = NULL;
+  g_variant_get (descriptor, "(tuuu@a(ayay)@a(ayt))", &size, &uid, &gid, &mode, &xattrs, &chunks);
+
+  if (out_file_info)
+    {
+      g_autoptr (GFileInfo) file_info = _ostree_mode_uidgid_to_gfileinfo (
+          GUINT32_FROM_BE (mode), GUINT32_FROM_BE (uid), GUINT32_FROM_BE (gid));
+      g_file_info_set_size (file_info, GUINT64_FROM_BE (size));
+      *out_file_info = g_steal_pointer (&file_info);
+    }
+  if (out_input)
+    *out_input = _ostree_chunked_input_stream_new (self, chunks);
+  if (out_xattrs)
+    *out_xattrs = g_steal_pointer (&xattrs);
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_chunked_file_storage_size:
+ *
+ * Return the size of the descriptor of a chunked object plus that of its
+ * chunks, some of which may also be used by other objects.
+ */
+gboolean
+_ostree_repo_chunked_file_storage_size (OstreeRepo *self, const char *checksum,
+                                        guint64 *out_size, GError **error)
+{
+  char path[_OSTREE_LOOSE_PATH_MAX];
+  _ostree_repo_chunked_file_path (path, checksum);
+  struct stat stbuf;
+  if (!glnx_fstatat (self->objects_dir_fd, path, &stbuf, 0, error))
+    return FALSE;
+  guint64 size = stbuf.st_size;
+
+  gboolean found;
+  g_autoptr (GVariant) descriptor = NULL;
+  if (!_ostree_repo_chunked_file_lookup (self, checksum, &found, &descriptor, error))
+    return FALSE;
+  if (!found)
+    return glnx_throw (error, "Chunked object %s disappeared", checksum);
+
+  g_autoptr (GVariant) chunks = g_variant_get_child_value (descriptor, 5);
+  const gsize n_chunks = g_variant_n_children (chunks);
+  for (gsize i = 0; i < n_chunks; i++)
+    {
+      g_autoptr (GVariant) digest_v = NULL;
+      g_variant_get_child (chunks, i, "(@ayt)", &digest_v, NULL);
+      char digest[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (digest_v, digest);
+      chunk_path (path, digest);
+      if (!glnx_fstatat (self->objects_dir_fd, path, &stbuf, 0, error))
+        return glnx_prefix_error (error, "Chunk of %s", checksum);
+      size += stbuf.st_size;
+    }
+
+  *out_size = size;
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_has_chunk:
+ *
+ * Set @out_have_chunk to whether chunk @digest is stored in @self.
+ */
+gboolean
+_ostree_repo_has_chunk (OstreeRepo *self, const char *digest, gboolean *out_have_chunk,
+                        GError **error)
+{
+  char path[_OSTREE_LOOSE_PATH_MAX];
+  chunk_path (path, digest);
+  if (!glnx_fstatat_allow_noent (self->objects_dir_fd, path, NULL, 0, error))
+    return FALSE;
+  *out_have_chunk = (errno == 0);
+  return TRUE;
+}
+
+static GBytes *
+compress_chunk (const guint8 *buf, gsize len, int level, GError **error)
+{
+  z_stream stream = {
+    0,
+  };
+  if (deflateInit2 (&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return glnx_null_throw (error, "Failed to initialize zlib");
+
+  const gsize bound = deflateBound (&stream, len);
+  g_autofree guint8 *out = g_malloc (bound);
+  stream.next_in = (Bytef *)buf;
+  stream.avail_in = len;
+  stream.next_out = out;
+  stream.avail_out = bound;
+  int res = deflate (&stream, Z_FINISH);
+  const gsize out_len = stream.total_out;
+  deflateEnd (&stream);
+  if (res != Z_STREAM_END)
+    return glnx_null_throw (error, "Failed to compress chunk: %d", res);
+
+  return g_bytes_new_take (g_steal_pointer (&out), out_len);
+}
+
+/* Decompress @compressed, which must yield @size bytes with SHA-256 @digest */
+static gboolean
+verify_chunk (GBytes *compressed, const char *digest, guint64 size, GError **error)
+{
+  if (size == 0 || size > CHUNK_MAX_ACCEPTED_SIZE)
+    return glnx_throw (error, "Invalid chunk size %" G_GUINT64_FORMAT, size);
+
+  z_stream stream = {
+    0,
+  };
+  if (inflateInit2 (&stream, -MAX_WBITS) != Z_OK)
+    return glnx_throw (error, "Failed to initialize zlib");
+
+  gsize compressed_len;
+  const guint8 *compressed_buf = g_bytes_get_data (compressed, &compressed_len);
+  g_autofree guint8 *out = g_malloc (size);
+  stream.next_in = (Bytef *)compressed_buf;
+  stream.avail_in = compressed_len;
+  stream.next_out = out;
+  stream.avail_out = size;
+  int res = inflate (&stream, Z_FINISH);
+  const gboolean complete = res == Z_STREAM_END && stream.avail_in == 0 && stream.total_out == size;
+  inflateEnd (&stream);
+  if (!complete)
+    return glnx_throw (error, "Corrupted chunk %s", digest);
+
+  g_auto (OtChecksum) checksum = {
+    0,
+  };
+  ot_checksum_init (&checksum);
+  ot_checksum_update (&checksum, out, size);
+  char actual[OSTREE_SHA256_STRING_LEN + 1];
+  ot_checksum_get_hexdigest (&checksum, actual, sizeof (actual));
+  if (strcmp (actual, digest) != 0)
+    return glnx_throw (error, "Corrupted chunk %s; actual checksum is %s", digest, actual);
+
+  return TRUE;
+}
+
+/* Store chunk @digest.  With @sync set, which is for callers that don't
+ * sync the filesystem themselves before relying on it, the chunk and its
+ * directory entry are on disk when this returns.
+ */
+static gboolean
+store_chunk (OstreeRepo *self, const char *digest, GBytes *compressed, gboolean sync,
+             GCancellable *cancellable, GError **error)
+{
+  char path[_OSTREE_LOOSE_PATH_MAX];
+  chunk_path (path, digest);
+
+  g_auto (GLnxTmpfile) tmpf = {
+    0,
+  };
+  if (!glnx_open_tmpfile_linkable_at (self->tmp_dir_fd, ".", O_WRONLY | O_CLOEXEC, &tmpf, error))
+    return FALSE;
+  gsize len;
+  const guint8 *buf = g_bytes_get_data (compressed, &len);
+  if (glnx_loop_write (tmpf.fd, buf, len) < 0)
+    return glnx_throw_errno_prefix (error, "write");
+  if (sync && fsync (tmpf.fd) == -1)
+    return glnx_throw_errno_prefix (error, "fsync");
+
+  /* chunks/xx */
+  g_autofree char *dir = g_strndup (path, strlen (_OSTREE_CHUNK_DIR) + 3);
+  if (!glnx_fstatat_allow_noent (self->objects_dir_fd, dir, NULL, 0, error))
+    return FALSE;
+  const gboolean created_dir = (errno == ENOENT);
+  if (!glnx_shutil_mkdir_p_at (self->objects_dir_fd, dir, DEFAULT_DIRECTORY_MODE, cancellable,
+                               error))
+    return FALSE;
+  if (!glnx_link_tmpfile_at (&tmpf, GLNX_LINK_TMPFILE_NOREPLACE_IGNORE_EXIST, self->objects_dir_fd,
+                             path, error))
+    return FALSE;
+
+  if (sync)
+    {
+      /* chunks/xx, and the directories above it if we just created it */
+      const char *sync_dirs[] = { dir, _OSTREE_CHUNK_DIR, "." };
+      const guint n_sync_dirs = created_dir ? G_N_ELEMENTS (sync_dirs) : 1;
+      for (guint i = 0; i < n_sync_dirs; i++)
+        {
+          glnx_autofd int dir_fd = -1;
+          if (!glnx_opendirat (self->objects_dir_fd, sync_dirs[i], TRUE, &dir_fd, error))
+            return FALSE;
+          if (fsync (dir_fd) == -1)
+            return glnx_throw_errno_prefix (error, "fsync");
+        }
+    }
+
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_write_chunk:
+ * @compressed: The chunk as stored in a remote repository
+ *
+ * Verify that @compressed is chunk @digest of @size bytes, and store it.
+ */
+gboolean
+_ostree_repo_write_chunk (OstreeRepo *self, const char *digest, guint64 size, GBytes *compressed,
+                          GCancellable *cancellable, GError **error)
+{
+  if (!verify_chunk (compressed, digest, size, error))
+    return FALSE;
+  /* The descriptor referring to it may be written before the transaction
+   * syncs anything.
+   */
+  return store_chunk (self, digest, compressed, !self->disable_fsync, cancellable, error);
+}
+
+/* Return the length of the next chunk at the start of @buf, which holds
+ * @len bytes of the remaining content, and all of it if @len is less than
+ * CHUNK_MAX_SIZE.
+ */
+static gsize
+find_chunk_boundary (const guint8 *buf, gsize len)
+{
+  if (len <= CHUNK_MIN_SIZE)
+    return len;
+
+  /* Let the rolling checksum window fill up before the minimum size */
+  gsize offset = CHUNK_MIN_SIZE - BUP_WINDOWSIZE;
+  while (offset < len)
+    {
+      int bits = 0;
+      int n = bupsplit_find_ofs (buf + offset, len - offset, &bits);
+      if (n == 0)
+        break;
+      offset += n;
+      if (offset >= CHUNK_MIN_SIZE && bits >= CHUNK_SPLIT_BITS)
+        return offset;
+    }
+
+  return len;
+}
+
+/* Split @input of @size bytes into chunks, storing them and adding them to
+ * @chunks_builder.
+ */
+static gboolean
+write_chunks (OstreeRepo *self, GInputStream *input, guint64 size, GVariantBuilder *chunks_builder,
+              GCancellable *cancellable, GError **error)
+{
+  g_autofree guint8 *buf = g_malloc (CHUNK_MAX_SIZE);
+  gsize buf_len = 0;
+  gboolean eof = FALSE;
+  guint64 total = 0;
+
+  while (TRUE)
+    {
+      if (!eof)
+        {
+          gsize n_read;
+          if (!g_input_stream_read_all (input, buf + buf_len, CHUNK_MAX_SIZE - buf_len, &n_read,
+                                        cancellable, error))
+            return FALSE;
+          eof = buf_len + n_read < CHUNK_MAX_SIZE;
+          buf_len += n_read;
+        }
+      if (buf_len == 0)
+        break;
+
+      const gsize len = find_chunk_boundary (buf, buf_len);
+
+      g_auto (OtChecksum) checksum = {
+        0,
+      };
+      ot_checksum_init (&checksum);
+      ot_checksum_update (&checksum, buf, len);
+      guint8 digest[OSTREE_SHA256_DIGEST_LEN];
+      ot_checksum_get_digest (&checksum, digest, sizeof (digest));
+      char digest_str[OSTREE_SHA256_STRING_LEN + 1];
+      ostree_checksum_inplace_from_bytes (digest, digest_str);
+
+      gboolean have_chunk = FALSE;
+      if (!_ostree_repo_has_chunk (self, digest_str, &have_chunk, error))
+        return FALSE;
+      if (!have_chunk)
+        {
+          g_autoptr (GBytes) compressed
+              = compress_chunk (buf, len, self->zlib_compression_level, error);
+          if (!compressed)
+            return FALSE;
+          if (!store_chunk (self, digest_str, compressed, FALSE, cancellable, error))
+            return FALSE;
+        }
+      g_variant_builder_add (chunks_builder, "(@ayt)", ostree_checksum_to_bytes_v (digest_str),
+                             GUINT64_TO_BE ((guint64)len));
+
+      memmove (buf, buf + len, buf_len - len);
+      buf_len -= len;
+      total += len;
+    }
+
+  if (total != size)
+    return glnx_throw (error,
+                       "Expected %" G_GUINT64_FORMAT " bytes of content, got %" G_GUINT64_FORMAT,
+                       size, total);
+  return TRUE;
+}
+
+static gboolean
+write_descriptor (OstreeRepo *self, const char *checksum, GVariant *descriptor,
+                  GCancellable *cancellable, GError **error)
+{
+  char path[_OSTREE_LOOSE_PATH_MAX];
+  _ostree_repo_chunked_file_path (path, checksum);
+  if (!_ostree_repo_ensure_loose_objdir_at (self->objects_dir_fd, path, cancellable, error))
+    return FALSE;
+  /* Descriptors are loaded as trusted, and one from a remote may not be in
+   * normal form.
+   */
+  g_autoptr (GVariant) normalized = g_variant_get_normal_form (descriptor);
+  if (!glnx_file_replace_contents_at (
+          self->objects_dir_fd, path, g_variant_get_data (normalized),
+          g_variant_get_size (normalized),
+          self->disable_fsync ? GLNX_FILE_REPLACE_NODATASYNC : GLNX_FILE_REPLACE_DATASYNC_NEW,
+          cancellable, error))
+    return FALSE;
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_write_chunked_file:
+ * @descriptor: Validated descriptor of content object @expected_checksum
+ *
+ * Write content object @expected_checksum from chunks already stored in
+ * @self, verifying its checksum.  Archive repositories keep the object
+ * chunked; in other modes it is reassembled, and the chunks are only kept
+ * until the next prune.
+ */
+gboolean
+_ostree_repo_write_chunked_file (OstreeRepo *self, const char *expected_checksum,
+                                 GVariant *descriptor, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GInputStream) input = NULL;
+  g_autoptr (GFileInfo) file_info = NULL;
+  g_autoptr (GVariant) xattrs = NULL;
+  if (!_ostree_repo_chunked_file_parse (self, descriptor, &input, &file_info, &xattrs, error))
+    return FALSE;
+
+  if (self->mode != OSTREE_REPO_MODE_ARCHIVE)
+    {
+      g_autoptr (GInputStream) object_input = NULL;
+      guint64 length;
+      if (!ostree_raw_file_to_content_stream (input, file_info, xattrs, &object_input, &length,
+                                              cancellable, error))
+        return FALSE;
+      g_autofree guchar *csum = NULL;
+      return ostree_repo_write_content (self, expected_checksum, object_input, length, &csum,
+                                        cancellable, error);
+    }
+
+  g_autofree guchar *csum = NULL;
+  if (!ostree_checksum_file_from_input (file_info, xattrs, input, OSTREE_OBJECT_TYPE_FILE, &csum,
+                                        cancellable, error))
+    return FALSE;
+  char actual_checksum[OSTREE_SHA256_STRING_LEN + 1];
+  ostree_checksum_inplace_from_bytes (csum, actual_checksum);
+  if (!_ostree_compare_object_checksum (OSTREE_OBJECT_TYPE_FILE, expected_checksum,
+                                        actual_checksum, error))
+    return FALSE;
+
+  return write_descriptor (self, expected_checksum, descriptor, cancellable, error);
+}
+
+/*
+ * _ostree_repo_prune_chunks:
+ * @out_n_pruned: (out): Number of chunks removed
+ *
+ * Remove the chunks which aren't used by any chunked object of @self.  The
+ * caller should hold an exclusive lock, since chunks are written before the
+ * objects using them.
+ */
+gboolean
+_ostree_repo_prune_chunks (OstreeRepo *self, guint *out_n_pruned, GCancellable *cancellable,
+                           GError **error)
+{
+  *out_n_pruned = 0;
+
+  g_auto (GLnxDirFdIterator) chunks_iter = {
+    0,
+  };
+  gboolean exists = FALSE;
+  if (!ot_dfd_iter_init_allow_noent (self->objects_dir_fd, _OSTREE_CHUNK_DIR, &chunks_iter,
+                                     &exists, error))
+    return FALSE;
+  if (!exists)
+    return TRUE;
+
+  /* Collect the chunks used by every chunked object */
+  g_autoptr (GHashTable) used = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  for (guint i = 0; i < 256; i++)
+    {
+      char prefix[3];
+      snprintf (prefix, sizeof (prefix), "%02x", i);
+      g_auto (GLnxDirFdIterator) dfd_iter = {
+        0,
+      };
+      gboolean prefix_exists = FALSE;
+      if (!ot_dfd_iter_init_allow_noent (self->objects_dir_fd, prefix, &dfd_iter, &prefix_exists,
+                                         error))
+        return FALSE;
+      while (prefix_exists)
+        {
+          struct dirent *dent;
+          if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, cancellable, error))
+            return FALSE;
+          if (dent == NULL)
+            break;
+          if (!g_str_has_suffix (dent->d_name, ".filechunks"))
+            continue;
+
+          glnx_autofd int fd = -1;
+          if (!glnx_openat_rdonly (dfd_iter.fd, dent->d_name, TRUE, &fd, error))
+            return FALSE;
+          g_autoptr (GVariant) descriptor = NULL;
+          if (!ot_variant_read_fd (fd, 0, _OSTREE_CHUNKED_FILE_GVARIANT_FORMAT, TRUE, &descriptor,
+                                   error))
+            return glnx_prefix_error (error, "Loading %s/%s", prefix, dent->d_name);
+
+          g_autoptr (GVariant) chunks = g_variant_get_child_value (descriptor, 5);
+          const gsize n_chunks = g_variant_n_children (chunks);
+          for (gsize j = 0; j < n_chunks; j++)
+            {
+              g_autoptr (GVariant) digest_v = NULL;
+              g_variant_get_child (chunks, j, "(@ayt)", &digest_v, NULL);
+              g_hash_table_add (used, ostree_checksum_from_bytes_v (digest_v));
+            }
+        }
+    }
+
+  while (TRUE)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&chunks_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+      if (dent->d_type != DT_DIR || strlen (dent->d_name) != 2)
+        continue;
+
+      g_auto (GLnxDirFdIterator) dfd_iter = {
+        0,
+      };
+      if (!glnx_dirfd_iterator_init_at (chunks_iter.fd, dent->d_name, FALSE, &dfd_iter, error))
+        return FALSE;
+      while (TRUE)
+        {
+          struct dirent *chunk_dent;
+          if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &chunk_dent, cancellable, error))
+            return FALSE;
+          if (chunk_dent == NULL)
+            break;
+
+          const char *dot = strrchr (chunk_dent->d_name, '.');
+          if (dot == NULL || strcmp (dot, ".chunk") != 0 || dot - chunk_dent->d_name != 62)
+            continue;
+          char digest[OSTREE_SHA256_STRING_LEN + 1];
+          memcpy (digest, dent->d_name, 2);
+          memcpy (digest + 2, chunk_dent->d_name, 62);
+          digest[OSTREE_SHA256_STRING_LEN] = '\0';
+          if (g_hash_table_contains (used, digest))
+            continue;
+
+          if (!glnx_unlinkat (dfd_iter.fd, chunk_dent->d_name, 0, error))
+            return FALSE;
+          (*out_n_pruned)++;
+        }
+    }
+
+  g_debug ("Pruned %u unused chunks, %u in use", *out_n_pruned, g_hash_table_size (used));
+  return TRUE;
+}
+
+/**
+ * ostree_repo_chunk_objects:
+ * @self: Repo
+ * @min_size: Minimum size in bytes of the content to chunk
+ * @out_n_chunked: (out) (optional): Number of objects which were chunked
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Store the loose regular file content objects of an archive repository
+ * whose content is at least @min_size bytes as chunked objects.  Their
+ * content is split at boundaries determined by a rolling checksum, so that
+ * versions of a large file which only differ in parts share most of their
+ * chunks; each chunk is stored once, under `objects/chunks`.
+ *
+ * Chunked objects are still found by ostree_repo_has_object() and read by
+ * ostree_repo_load_file(), which reassembles the content; their checksum is
+ * unchanged.  Chunks no longer used by any object are removed by
+ * ostree_repo_prune().
+ *
+ * Only clients which understand chunked objects can pull them over HTTP; a
+ * summary regenerated after chunking has the `ostree.summary.chunked-files`
+ * metadata key set, and such clients then only fetch the chunks they don't
+ * have yet.
+ *
+ * Locking: exclusive
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_chunk_objects (OstreeRepo *self, guint64 min_size, guint *out_n_chunked,
+                           GCancellable *cancellable, GError **error)
+{
+  if (self->mode != OSTREE_REPO_MODE_ARCHIVE)
+    return glnx_throw (error, "Chunked objects are only supported in archive repositories");
+
+  g_autoptr (OstreeRepoAutoLock) lock
+      = ostree_repo_auto_lock_push (self, OSTREE_REPO_LOCK_EXCLUSIVE, cancellable, error);
+  if (!lock)
+    return FALSE;
+
+  g_autoptr (GHashTable) objects = ostree_repo_list_objects_set (
+      self, OSTREE_REPO_LIST_OBJECTS_LOOSE | OSTREE_REPO_LIST_OBJECTS_NO_PARENTS, cancellable,
+      error);
+  if (!objects)
+    return FALSE;
+
+  /* Checksum → descriptor of each object whose chunks have been written */
+  g_autoptr (GHashTable) descriptors
+      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+  GLNX_HASH_TABLE_FOREACH (objects, GVariant *, key)
+    {
+      const char *checksum;
+      OstreeObjectType objtype;
+      ostree_object_name_deserialize (key, &checksum, &objtype);
+      if (objtype != OSTREE_OBJECT_TYPE_FILE)
+        continue;
+
+      /* Already chunked objects have no .filez */
+      char loose_path[_OSTREE_LOOSE_PATH_MAX];
+      _ostree_loose_path (loose_path, checksum, objtype, self->mode);
+      glnx_autofd int fd = -1;
+      if (!ot_openat_ignore_enoent (self->objects_dir_fd, loose_path, &fd, error))
+        return FALSE;
+      if (fd == -1)
+        continue;
+
+      struct stat stbuf;
+      if (!glnx_fstat (fd, &stbuf, error))
+        return FALSE;
+      g_autoptr (GInputStream) file_stream = g_unix_input_stream_new (g_steal_fd (&fd), TRUE);
+      g_autoptr (GInputStream) input = NULL;
+      g_autoptr (GFileInfo) file_info = NULL;
+      g_autoptr (GVariant) xattrs = NULL;
+      if (!ostree_content_stream_parse (TRUE, file_stream, stbuf.st_size, TRUE, &input,
+                                        &file_info, &xattrs, cancellable, error))
+        return glnx_prefix_error (error, "Loading %s", checksum);
+
+      if (g_file_info_get_file_type (file_info) != G_FILE_TYPE_REGULAR)
+        continue;
+      const guint64 size = g_file_info_get_size (file_info);
+      if (size < min_size || size == 0)
+        continue;
+
+      g_auto (GVariantBuilder) chunks_builder = OT_VARIANT_BUILDER_INITIALIZER;
+      g_variant_builder_init (&chunks_builder, G_VARIANT_TYPE ("a(ayt)"));
+      if (!write_chunks (self, input, size, &chunks_builder, cancellable, error))
+        return glnx_prefix_error (error, "Chunking %s", checksum);
+      g_autoptr (GVariant) chunks = g_variant_ref_sink (g_variant_builder_end (&chunks_builder));
+
+      if (xattrs == NULL)
+        xattrs = g_variant_ref_sink (g_variant_new_array (G_VARIANT_TYPE ("(ayay)"), NULL, 0));
+      g_autoptr (GVariant) descriptor = g_variant_ref_sink (g_variant_new (
+          "(tuuu@a(ayay)@a(ayt))", GUINT64_TO_BE (size),
+          GUINT32_TO_BE (g_file_info_get_attribute_uint32 (file_info, "unix::uid")),
+          GUINT32_TO_BE (g_file_info_get_attribute_uint32 (file_info, "unix::gid")),
+          GUINT32_TO_BE (g_file_info_get_attribute_uint32 (file_info, "unix::mode")), xattrs,
+          chunks));
+      g_debug ("Chunked %s into %" G_GSIZE_FORMAT " chunks", checksum,
+               g_variant_n_children (chunks));
+      g_hash_table_insert (descriptors, g_strdup (checksum), g_steal_pointer (&descriptor));
+    }
+
+  /* The chunks must be durable before any .filez goes away; sync them all
+   * at once rather than per object.
+   */
+  if (g_hash_table_size (descriptors) > 0 && !_ostree_repo_syncfs (self, error))
+    return FALSE;
+
+  GLNX_HASH_TABLE_FOREACH_KV (descriptors, const char *, checksum, GVariant *, descriptor)
+    {
+      if (!write_descriptor (self, checksum, descriptor, cancellable, error))
+        return FALSE;
+      char loose_path[_OSTREE_LOOSE_PATH_MAX];
+      _ostree_loose_path (loose_path, checksum, OSTREE_OBJECT_TYPE_FILE, self->mode);
+      if (!ot_ensure_unlinked_at (self->objects_dir_fd, loose_path, error))
+        return FALSE;
+    }
+
+  if (out_n_chunked)
+    *out_n_chunked = g_hash_table_size (descriptors);
+  return TRUE;
+}
@@ -32,6 +32,7 @@
 #include <sys/ioctl.h>
 #include <sys/statvfs.h>
 #include <sys/xattr.h>
+#include <zlib.h>
 
 #include "ostree-checksum-input-stream.h"
 #include "ostree-core-private.h"
@@ -178,11 +179,15 @@ ot_security_smack_reset_fd (int fd)
 #endif
 }
 
-/* Given an O_TMPFILE regular file, link it into place. */
+/* Given an O_TMPFILE regular file, link it into place.  Only if
+ * @content_verified, meaning the checksum of a content object was computed
+ * from what was written, is its fs-verity digest recorded.
+ */
 gboolean
 _ostree_repo_commit_tmpf_final (OstreeRepo *self, const char *checksum, OstreeObjectType objtype,
-                                GLnxTmpfile *tmpf, gboolean *out_existed, GCancellable *cancellable,
-                                GError **error)
+                                GLnxTmpfile *tmpf, gboolean content_verified,
+                                GBytes *file_header, gboolean *out_existed,
+                                GCancellable *cancellable, GError **error)
 {
   char tmpbuf[_OSTREE_LOOSE_PATH_MAX];
   _ostree_loose_path (tmpbuf, checksum, objtype, self->mode);
@@ -193,6 +198,8 @@ _ostree_repo_commit_tmpf_final (OstreeRepo *self, const char *checksum, OstreeOb
 
   if (!_ostree_tmpf_fsverity (self, tmpf, NULL, error))
     return FALSE;
+  if (objtype == OSTREE_OBJECT_TYPE_FILE && content_verified)
+    _ostree_repo_fsverity_record (self, tmpf->fd, checksum, file_header);
 
   gboolean existed = FALSE;
   g_autoptr (GError) local_error = NULL;
@@ -243,11 +250,13 @@ commit_path_final (OstreeRepo *self, const char *checksum, OstreeObjectType objt
 
 /* Given either a file or symlink, apply the final metadata to it depending on
  * the repository mode. Note that @checksum is assumed to have been validated by
- * the caller.
+ * the caller; @content_verified says whether it was computed from the content,
+ * rather than trusted.
  */
 static gboolean
 commit_loose_regfile_object (OstreeRepo *self, const char *checksum, GLnxTmpfile *tmpf, guint32 uid,
-                             guint32 gid, guint32 mode, GVariant *xattrs, gboolean *out_existed,
+                             guint32 gid, guint32 mode, GVariant *xattrs,
+                             gboolean content_verified, gboolean *out_existed,
                              GCancellable *cancellable, GError **error)
 {
   if (self->mode == OSTREE_REPO_MODE_BARE)
@@ -318,8 +327,20 @@ commit_loose_regfile_object (OstreeRepo *self, const char *checksum, GLnxTmpfile
         return glnx_throw_errno_prefix (error, "fsync");
     }
 
-  if (!_ostree_repo_commit_tmpf_final (self, checksum, OSTREE_OBJECT_TYPE_FILE, tmpf, out_existed,
-                                       cancellable, error))
+  /* Content objects in bare repositories carry their metadata outside the
+   * file data covered by fs-verity; see _ostree_repo_fsverity_record().
+   */
+  g_autoptr (GBytes) file_header = NULL;
+  if (content_verified && self->fs_verity_wanted != _OSTREE_FEATURE_NO
+      && _ostree_repo_mode_is_bare (self->mode))
+    {
+      g_autoptr (GFileInfo) finfo = _ostree_mode_uidgid_to_gfileinfo (mode, uid, gid);
+      file_header = _ostree_file_header_new (finfo, xattrs);
+    }
+
+  if (!_ostree_repo_commit_tmpf_final (self, checksum, OSTREE_OBJECT_TYPE_FILE, tmpf,
+                                       content_verified, file_header, out_existed, cancellable,
+                                       error))
     return FALSE;
 
   return TRUE;
@@ -385,8 +406,12 @@ repo_has_size_entry (OstreeRepo *self, OstreeObjectType objtype, const gchar *ch
   if (objtype > OSTREE_OBJECT_TYPE_DIR_META)
     return TRUE;
 
+  /* Content objects may be written from multiple threads; see WriteContentPool */
+  g_mutex_lock (&self->txn_lock);
   repo_ensure_size_entries (self);
-  return (g_hash_table_lookup (self->object_sizes, checksum) != NULL);
+  gboolean ret = g_hash_table_lookup (self->object_sizes, checksum) != NULL;
+  g_mutex_unlock (&self->txn_lock);
+  return ret;
 }
 
 static void
@@ -397,9 +422,11 @@ repo_store_size_entry (OstreeRepo *self, OstreeObjectType objtype, const gchar *
   if (objtype > OSTREE_OBJECT_TYPE_DIR_META)
     return;
 
+  g_mutex_lock (&self->txn_lock);
   repo_ensure_size_entries (self);
   g_hash_table_replace (self->object_sizes, g_strdup (checksum),
                         content_size_cache_entry_new (objtype, unpacked, archived));
+  g_mutex_unlock (&self->txn_lock);
 }
 
 static int
@@ -480,6 +507,40 @@ throw_min_free_space_error (OstreeRepo *self, guint64 bytes_required, GError **e
                        err_msg);
 }
 
+/* Reserve space for the completed @tmpf against the min-free-space settings;
+ * only applies during transactions.  Callers credit @out_blocks_reserved back
+ * if the object turns out to exist already.
+ */
+static gboolean
+reserve_tmpf_space (OstreeRepo *self, GLnxTmpfile *tmpf, fsblkcnt_t *out_blocks_reserved,
+                    GError **error)
+{
+  *out_blocks_reserved = 0;
+  if (!((self->min_free_space_percent > 0 || self->min_free_space_mb > 0) && self->in_transaction))
+    return TRUE;
+
+  struct stat st_buf;
+  if (!glnx_fstat (tmpf->fd, &st_buf, error))
+    return FALSE;
+
+  g_mutex_lock (&self->txn_lock);
+  g_assert_cmpint (self->txn.blocksize, >, 0);
+
+  fsblkcnt_t object_blocks_reserved = (st_buf.st_size / self->txn.blocksize) + 1;
+  if (object_blocks_reserved > self->txn.max_blocks)
+    {
+      self->cleanup_stagedir = TRUE;
+      g_mutex_unlock (&self->txn_lock);
+      return throw_min_free_space_error (self, st_buf.st_size, error);
+    }
+  /* This is the main bit that needs mutex protection */
+  self->txn.max_blocks -= object_blocks_reserved;
+  g_mutex_unlock (&self->txn_lock);
+
+  *out_blocks_reserved = object_blocks_reserved;
+  return TRUE;
+}
+
 typedef struct
 {
   gboolean initialized;
@@ -551,26 +612,8 @@ _ostree_repo_bare_content_commit (OstreeRepo *self, OstreeRepoBareContent *barew
   g_assert (real->initialized);
 
   fsblkcnt_t object_blocks_reserved = 0;
-  if ((self->min_free_space_percent > 0 || self->min_free_space_mb > 0) && self->in_transaction)
-    {
-      struct stat st_buf;
-      if (!glnx_fstat (real->tmpf.fd, &st_buf, error))
-        return FALSE;
-
-      g_mutex_lock (&self->txn_lock);
-      g_assert_cmpint (self->txn.blocksize, >, 0);
-
-      object_blocks_reserved = (st_buf.st_size / self->txn.blocksize) + 1;
-      if (object_blocks_reserved > self->txn.max_blocks)
-        {
-          self->cleanup_stagedir = TRUE;
-          g_mutex_unlock (&self->txn_lock);
-          return throw_min_free_space_error (self, st_buf.st_size, error);
-        }
-      /* This is the main bit that needs mutex protection */
-      self->txn.max_blocks -= object_blocks_reserved;
-      g_mutex_unlock (&self->txn_lock);
-    }
+  if (!reserve_tmpf_space (self, &real->tmpf, &object_blocks_reserved, error))
+    return FALSE;
 
   ot_checksum_get_hexdigest (&real->checksum, checksum_buf, buflen);
 
@@ -581,7 +624,8 @@ _ostree_repo_bare_content_commit (OstreeRepo *self, OstreeRepoBareContent *barew
 
   gboolean obj_existed;
   if (!commit_loose_regfile_object (self, checksum_buf, &real->tmpf, real->uid, real->gid,
-                                    real->mode, real->xattrs, &obj_existed, cancellable, error))
+                                    real->mode, real->xattrs, TRUE, &obj_existed, cancellable,
+                                    error))
     return FALSE;
   /* If the object already existed, credit back the space reservation we
    * made above — no new disk space was consumed.
@@ -611,6 +655,316 @@ _ostree_repo_bare_content_cleanup (OstreeRepoBareContent *regwrite)
   real->initialized = FALSE;
 }
 
+/* Writes a content object into the repo from its archive (.filez)
+ * encoding as the data arrives, so that pull does not need to spool
+ * fetched objects to a temporary file and read them back.  Archive
+ * repos keep the received data as the object; other modes decompress
+ * it straight into the object's tmpfile.  Either way the uncompressed
+ * content is checksummed on the way through.
+ */
+struct OstreeRepoContentIngest
+{
+  OstreeRepo *repo;
+  char *expected_checksum;
+  OstreeRepoImportFlags flags;
+
+  GByteArray *header; /* Encoded file header, until it is complete */
+  GFileInfo *file_info;
+  GVariant *xattrs;
+
+  GLnxTmpfile tmpf; /* Archive repos: the object as received */
+  OtChecksum checksum;
+  OstreeRepoBareContent barewrite; /* Other modes */
+
+  z_stream zstream;
+  gboolean zstream_initialized;
+  gboolean zstream_end;
+  guint64 content_len; /* Uncompressed bytes seen so far */
+};
+
+/* Whether _ostree_repo_content_ingest_new() can be used for @self; the
+ * rest go through ostree_repo_write_content().
+ */
+gboolean
+_ostree_repo_content_ingest_supported (OstreeRepo *self)
+{
+  /* Payload links and size entries are computed by write_content_object() */
+  return self->mode != OSTREE_REPO_MODE_BARE_SPLIT_XATTRS && !self->generate_sizes
+         && self->payload_link_threshold == G_MAXUINT64;
+}
+
+/* Only _OSTREE_REPO_IMPORT_FLAGS_VERIFY_BAREUSERONLY is meaningful in @flags;
+ * the object is always verified against @expected_checksum.
+ */
+OstreeRepoContentIngest *
+_ostree_repo_content_ingest_new (OstreeRepo *self, const char *expected_checksum,
+                                 OstreeRepoImportFlags flags)
+{
+  g_assert (_ostree_repo_content_ingest_supported (self));
+
+  OstreeRepoContentIngest *ingest = g_new0 (OstreeRepoContentIngest, 1);
+  ingest->repo = g_object_ref (self);
+  ingest->expected_checksum = g_strdup (expected_checksum);
+  ingest->flags = flags;
+  ingest->header = g_byte_array_new ();
+  return ingest;
+}
+
+void
+_ostree_repo_content_ingest_free (OstreeRepoContentIngest *ingest)
+{
+  if (ingest->zstream_initialized)
+    inflateEnd (&ingest->zstream);
+  _ostree_repo_bare_content_cleanup (&ingest->barewrite);
+  ot_checksum_clear (&ingest->checksum);
+  glnx_tmpfile_clear (&ingest->tmpf);
+  g_clear_pointer (&ingest->xattrs, g_variant_unref);
+  g_clear_object (&ingest->file_info);
+  g_clear_pointer (&ingest->header, g_byte_array_unref);
+  g_free (ingest->expected_checksum);
+  g_object_unref (ingest->repo);
+  g_free (ingest);
+}
+
+/* The header is a 32 bit big-endian length and 4 bytes of padding,
+ * followed by the variant; see ostree_content_stream_parse().
+ */
+static gsize
+content_ingest_header_target (OstreeRepoContentIngest *ingest)
+{
+  if (ingest->header->len < 8)
+    return 8;
+  guint32 header_size;
+  memcpy (&header_size, ingest->header->data, sizeof (header_size));
+  return 8 + GUINT32_FROM_BE (header_size);
+}
+
+static gboolean
+content_ingest_start (OstreeRepoContentIngest *ingest, GError **error)
+{
+  OstreeRepo *self = ingest->repo;
+
+  g_autoptr (GInputStream) header_in
+      = g_memory_input_stream_new_from_data (ingest->header->data, ingest->header->len, NULL);
+  if (!ostree_content_stream_parse (TRUE, header_in, ingest->header->len, FALSE, NULL,
+                                    &ingest->file_info, &ingest->xattrs, NULL, error))
+    return glnx_prefix_error (error, "Parsing %s.filez", ingest->expected_checksum);
+
+  if ((ingest->flags & _OSTREE_REPO_IMPORT_FLAGS_VERIFY_BAREUSERONLY) > 0
+      && !_ostree_validate_bareuseronly_mode_finfo (ingest->file_info, ingest->expected_checksum,
+                                                    error))
+    return FALSE;
+
+  switch (g_file_info_get_file_type (ingest->file_info))
+    {
+    case G_FILE_TYPE_REGULAR:
+      break;
+    case G_FILE_TYPE_SYMBOLIC_LINK:
+      /* Written from the header alone on commit */
+      return TRUE;
+    default:
+      return glnx_throw (error, "Unsupported file type %u",
+                         g_file_info_get_file_type (ingest->file_info));
+    }
+
+  if (self->mode == OSTREE_REPO_MODE_ARCHIVE)
+    {
+      if (!glnx_open_tmpfile_linkable_at (commit_tmp_dfd (self), ".", O_WRONLY | O_CLOEXEC,
+                                          &ingest->tmpf, error))
+        return FALSE;
+      /* Store the header in normal form, as write_content_object() does, rather
+       * than as received; it is parsed as trusted when loading the object.
+       */
+      g_autoptr (GBytes) zlib_header = _ostree_zlib_file_header_new (ingest->file_info,
+                                                                    ingest->xattrs);
+      gsize zlib_header_len;
+      const guint8 *zlib_header_buf = g_bytes_get_data (zlib_header, &zlib_header_len);
+      if (glnx_loop_write (ingest->tmpf.fd, zlib_header_buf, zlib_header_len) < 0)
+        return glnx_throw_errno_prefix (error, "write");
+
+      g_autoptr (GBytes) header = _ostree_file_header_new (ingest->file_info, ingest->xattrs);
+      ot_checksum_init (&ingest->checksum);
+      ot_checksum_update_bytes (&ingest->checksum, header);
+    }
+  else
+    {
+      const guint32 uid = g_file_info_get_attribute_uint32 (ingest->file_info, "unix::uid");
+      const guint32 gid = g_file_info_get_attribute_uint32 (ingest->file_info, "unix::gid");
+      const guint32 mode = g_file_info_get_attribute_uint32 (ingest->file_info, "unix::mode");
+      if (!_ostree_repo_bare_content_open (self, ingest->expected_checksum,
+                                           g_file_info_get_size (ingest->file_info), uid, gid,
+                                           mode, ingest->xattrs, &ingest->barewrite, NULL, error))
+        return FALSE;
+    }
+
+  if (inflateInit2 (&ingest->zstream, -MAX_WBITS) != Z_OK)
+    return glnx_throw (error, "Failed to initialize zlib");
+  ingest->zstream_initialized = TRUE;
+  return TRUE;
+}
+
+static gboolean
+content_ingest_body (OstreeRepoContentIngest *ingest, const guint8 *buf, gsize len,
+                     GError **error)
+{
+  if (!ingest->zstream_initialized)
+    return glnx_throw (error, "Unexpected data after symbolic link header");
+  if (ingest->zstream_end)
+    return glnx_throw (error, "Unexpected data after compressed content");
+
+  const guint64 expected_len = g_file_info_get_size (ingest->file_info);
+  ingest->zstream.next_in = (Bytef *)buf;
+  ingest->zstream.avail_in = len;
+  while (!ingest->zstream_end)
+    {
+      guint8 out[16384];
+      ingest->zstream.next_out = out;
+      ingest->zstream.avail_out = sizeof (out);
+      int res = inflate (&ingest->zstream, Z_NO_FLUSH);
+      if (res == Z_STREAM_END)
+        ingest->zstream_end = TRUE;
+      else if (res == Z_BUF_ERROR)
+        break; /* Needs more input */
+      else if (res != Z_OK)
+        return glnx_throw (error, "Decompressing content: %s",
+                           ingest->zstream.msg ? ingest->zstream.msg : "zlib error");
+
+      const gsize n = sizeof (out) - ingest->zstream.avail_out;
+      ingest->content_len += n;
+      if (ingest->content_len > expected_len)
+        return glnx_throw (error, "Content exceeds size %" G_GUINT64_FORMAT " from file header",
+                           expected_len);
+      if (ingest->tmpf.initialized)
+        ot_checksum_update (&ingest->checksum, out, n);
+      else if (!_ostree_repo_bare_content_write (ingest->repo, &ingest->barewrite, out, n, NULL,
+                                                 error))
+        return FALSE;
+
+      if (ingest->zstream.avail_in == 0 && ingest->zstream.avail_out > 0)
+        break;
+    }
+
+  /* Archive repos keep the compressed stream as the object, so only what
+   * inflate() consumed may be stored; anything after the end of the stream
+   * would otherwise be kept for good.
+   */
+  const gsize consumed = len - ingest->zstream.avail_in;
+  if (ingest->tmpf.initialized && glnx_loop_write (ingest->tmpf.fd, buf, consumed) < 0)
+    return glnx_throw_errno_prefix (error, "write");
+  if (ingest->zstream.avail_in > 0)
+    return glnx_throw (error, "Unexpected data after compressed content");
+
+  return TRUE;
+}
+
+/* Feed the next @len bytes of the object's archive encoding */
+gboolean
+_ostree_repo_content_ingest_write (OstreeRepoContentIngest *ingest, const guint8 *buf, gsize len,
+                                   GError **error)
+{
+  while (ingest->file_info == NULL && len > 0)
+    {
+      const gsize target = content_ingest_header_target (ingest);
+      const gsize n = MIN (len, target - ingest->header->len);
+      g_byte_array_append (ingest->header, buf, n);
+      buf += n;
+      len -= n;
+      if (ingest->header->len < target)
+        return TRUE;
+
+      if (target == 8)
+        {
+          const gsize header_target = content_ingest_header_target (ingest);
+          if (header_target == 8 || header_target > 8 + OSTREE_MAX_METADATA_SIZE)
+            return glnx_throw (error, "Invalid file header size %" G_GSIZE_FORMAT,
+                               header_target - 8);
+        }
+      else if (!content_ingest_start (ingest, error))
+        return FALSE;
+    }
+
+  if (len == 0)
+    return TRUE;
+  return content_ingest_body (ingest, buf, len, error);
+}
+
+/* Verify the complete object and link it into the repo */
+gboolean
+_ostree_repo_content_ingest_commit (OstreeRepoContentIngest *ingest, GCancellable *cancellable,
+                                    GError **error)
+{
+  OstreeRepo *self = ingest->repo;
+
+  if (ingest->file_info == NULL)
+    return glnx_throw (error, "Truncated file header");
+
+  const guint32 uid = g_file_info_get_attribute_uint32 (ingest->file_info, "unix::uid");
+  const guint32 gid = g_file_info_get_attribute_uint32 (ingest->file_info, "unix::gid");
+  const guint32 mode = g_file_info_get_attribute_uint32 (ingest->file_info, "unix::mode");
+
+  if (g_file_info_get_file_type (ingest->file_info) == G_FILE_TYPE_SYMBOLIC_LINK)
+    {
+      const char *target = g_file_info_get_symlink_target (ingest->file_info);
+      g_autofree char *checksum = ostree_repo_write_symlink (
+          self, ingest->expected_checksum, uid, gid, ingest->xattrs, target, cancellable, error);
+      return checksum != NULL;
+    }
+
+  g_assert (ingest->zstream_initialized);
+  const guint64 expected_len = g_file_info_get_size (ingest->file_info);
+  /* An empty file may come without any compressed data at all */
+  if (!ingest->zstream_end && !(expected_len == 0 && ingest->zstream.total_in == 0))
+    return glnx_throw (error, "Truncated compressed content");
+  if (ingest->content_len != expected_len)
+    return glnx_throw (error,
+                       "Content size %" G_GUINT64_FORMAT " does not match %" G_GUINT64_FORMAT
+                       " from file header",
+                       ingest->content_len, expected_len);
+
+  if (ingest->tmpf.initialized)
+    {
+      char actual_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      ot_checksum_get_hexdigest (&ingest->checksum, actual_checksum, sizeof (actual_checksum));
+      if (!_ostree_compare_object_checksum (OSTREE_OBJECT_TYPE_FILE, ingest->expected_checksum,
+                                            actual_checksum, error))
+        return FALSE;
+
+      if (!glnx_fchmod (ingest->tmpf.fd, 0644, error))
+        return FALSE;
+
+      fsblkcnt_t object_blocks_reserved = 0;
+      if (!reserve_tmpf_space (self, &ingest->tmpf, &object_blocks_reserved, error))
+        return FALSE;
+
+      gboolean obj_existed;
+      if (!commit_loose_regfile_object (self, ingest->expected_checksum, &ingest->tmpf, uid, gid,
+                                        mode, ingest->xattrs, TRUE, &obj_existed, cancellable,
+                                        error))
+        return FALSE;
+      if (obj_existed)
+        {
+          g_mutex_lock (&self->txn_lock);
+          self->txn.max_blocks += object_blocks_reserved;
+          g_mutex_unlock (&self->txn_lock);
+        }
+    }
+  else
+    {
+      char actual_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      if (!_ostree_repo_bare_content_commit (self, &ingest->barewrite, actual_checksum,
+                                             sizeof (actual_checksum), cancellable, error))
+        return FALSE;
+    }
+
+  g_mutex_lock (&self->txn_lock);
+  self->txn.stats.content_objects_written++;
+  self->txn.stats.content_bytes_written += expected_len;
+  self->txn.stats.content_objects_total++;
+  g_mutex_unlock (&self->txn_lock);
+
+  return TRUE;
+}
+
 /* Allocate an O_TMPFILE, write everything from @input to it, but
  * not exceeding @length.
  */
@@ -1215,8 +1569,8 @@ write_content_object (OstreeRepo *self, const char *expected_checksum, GInputStr
         return FALSE;
 
       /* This path is for regular files */
-      if (!commit_loose_regfile_object (self, actual_checksum, &tmpf, uid, gid, mode, xattrs, NULL,
-                                        cancellable, error))
+      if (!commit_loose_regfile_object (self, actual_checksum, &tmpf, uid, gid, mode, xattrs,
+                                        checksum_input != NULL, NULL, cancellable, error))
         return FALSE;
 
       if (!_create_payload_link (self, actual_checksum, actual_payload_checksum, file_info,
@@ -1345,10 +1699,14 @@ adopt_and_commit_regfile (OstreeRepo *self, int dfd, const char *name, GFileInfo
   return TRUE;
 }
 
-/* Main driver for writing a metadata (non-content) object. */
+/* Main driver for writing a metadata (non-content) object. If
+ * @computed_checksum is given, it is the checksum of @buf, already
+ * computed by the caller.
+ */
 static gboolean
 write_metadata_object (OstreeRepo *self, OstreeObjectType objtype, const char *expected_checksum,
-                       GBytes *buf, guchar **out_csum, GCancellable *cancellable, GError **error)
+                       GBytes *buf, const char *computed_checksum, guchar **out_csum,
+                       GCancellable *cancellable, GError **error)
 {
   g_assert (expected_checksum != NULL || out_csum != NULL);
 
@@ -1375,14 +1733,19 @@ write_metadata_object (OstreeRepo *self, OstreeObjectType objtype, const char *e
     }
   else
     {
-      g_auto (OtChecksum) checksum = {
-        0,
-      };
-      ot_checksum_init (&checksum);
       gsize len;
       const guint8 *bufdata = g_bytes_get_data (buf, &len);
-      ot_checksum_update (&checksum, bufdata, len);
-      ot_checksum_get_hexdigest (&checksum, actual_checksum, sizeof (actual_checksum));
+      if (computed_checksum)
+        memcpy (actual_checksum, computed_checksum, sizeof (actual_checksum));
+      else
+        {
+          g_auto (OtChecksum) checksum = {
+            0,
+          };
+          ot_checksum_init (&checksum);
+          ot_checksum_update (&checksum, bufdata, len);
+          ot_checksum_get_hexdigest (&checksum, actual_checksum, sizeof (actual_checksum));
+        }
       gboolean have_obj;
       if (!_ostree_repo_has_loose_object (self, actual_checksum, objtype, &have_obj, cancellable,
                                           error))
@@ -1436,8 +1799,8 @@ write_metadata_object (OstreeRepo *self, OstreeObjectType objtype, const char *e
     return FALSE;
 
   /* And commit it into place */
-  if (!_ostree_repo_commit_tmpf_final (self, actual_checksum, objtype, &tmpf, NULL, cancellable,
-                                       error))
+  if (!_ostree_repo_commit_tmpf_final (self, actual_checksum, objtype, &tmpf, FALSE, NULL, NULL,
+                                       cancellable, error))
     return FALSE;
 
   if (objtype == OSTREE_OBJECT_TYPE_COMMIT)
@@ -1789,6 +2152,64 @@ fsync_object_dirs (OstreeRepo *self, GCancellable *cancellable, GError **error)
   return TRUE;
 }
 
+/* Move all the staged objects in @child_dfd, whose names are in @names,
+ * into the objects directory @prefix using one batch of renames; the
+ * equivalent of the synchronous loop in rename_pending_loose_objects().
+ */
+static gboolean
+rename_pending_loose_objects_batched (OstreeRepo *self, OtUring *uring, int child_dfd,
+                                      const char *prefix, GPtrArray *names, GError **error)
+{
+  if (names->len == 0)
+    return TRUE;
+
+  char loose_objpath[_OSTREE_LOOSE_PATH_MAX];
+  loose_objpath[0] = prefix[0];
+  loose_objpath[1] = prefix[1];
+  loose_objpath[2] = '/';
+  if (!_ostree_repo_ensure_loose_objdir_at (self->objects_dir_fd, loose_objpath, NULL, error))
+    return FALSE;
+
+  ot_uring_reset (uring);
+  for (guint i = 0; i < names->len; i++)
+    {
+      const char *name = names->pdata[i];
+      g_strlcpy (loose_objpath + 3, name, sizeof (loose_objpath) - 3);
+      const guint flags = g_str_has_suffix (name, ".commitmeta") ? 0 : RENAME_NOREPLACE;
+      ot_uring_queue_renameat (uring, child_dfd, name, self->objects_dir_fd, loose_objpath, flags);
+    }
+  if (!ot_uring_submit (uring, error))
+    return FALSE;
+
+  for (guint i = 0; i < names->len; i++)
+    {
+      const char *name = names->pdata[i];
+      const int r = ot_uring_get_result (uring, i);
+      if (r == 0)
+        continue;
+      g_strlcpy (loose_objpath + 3, name, sizeof (loose_objpath) - 3);
+      if (g_str_has_suffix (name, ".commitmeta"))
+        {
+          if (!glnx_renameat (child_dfd, name, self->objects_dir_fd, loose_objpath, error))
+            return FALSE;
+          continue;
+        }
+      /* Retry anything unexpected synchronously, which also handles
+       * filesystems without RENAME_NOREPLACE.
+       */
+      if (r != -EEXIST
+          && glnx_renameat2_noreplace (child_dfd, name, self->objects_dir_fd, loose_objpath) == 0)
+        continue;
+      if (r != -EEXIST && errno != EEXIST)
+        return glnx_throw_errno_prefix (error, "renameat2(noreplace, %s)", loose_objpath);
+      /* Object already present with same content; drop staging copy */
+      if (!glnx_unlinkat (child_dfd, name, 0, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 /* Called for commit, to iterate over the "staging" directory and rename all the
  * objects into the primary objects/ location. Notably this is called only after
  * syncfs() has potentially been invoked to ensure that all objects have been
@@ -1802,6 +2223,8 @@ rename_pending_loose_objects (OstreeRepo *self, GCancellable *cancellable, GErro
   g_auto (GLnxDirFdIterator) dfd_iter = {
     0,
   };
+  /* If available, each object directory is moved in one batch */
+  g_autoptr (OtUring) uring = ot_uring_new ();
 
   if (!glnx_dirfd_iterator_init_at (self->commit_stagedir.fd, ".", FALSE, &dfd_iter, error))
     return FALSE;
@@ -1828,6 +2251,25 @@ rename_pending_loose_objects (OstreeRepo *self, GCancellable *cancellable, GErro
       if (!glnx_dirfd_iterator_init_at (dfd_iter.fd, dent->d_name, FALSE, &child_dfd_iter, error))
         return FALSE;
 
+      if (uring)
+        {
+          g_autoptr (GPtrArray) names = g_ptr_array_new_with_free_func (g_free);
+          while (TRUE)
+            {
+              struct dirent *child_dent;
+              if (!glnx_dirfd_iterator_next_dent (&child_dfd_iter, &child_dent, cancellable,
+                                                  error))
+                return FALSE;
+              if (child_dent == NULL)
+                break;
+              g_ptr_array_add (names, g_strdup (child_dent->d_name));
+            }
+          if (!rename_pending_loose_objects_batched (self, uring, child_dfd_iter.fd, dent->d_name,
+                                                     names, error))
+            return FALSE;
+          continue;
+        }
+
       char loose_objpath[_OSTREE_LOOSE_PATH_MAX];
       loose_objpath[0] = dent->d_name[0];
       loose_objpath[1] = dent->d_name[1];
@@ -2309,6 +2751,9 @@ ostree_repo_commit_transaction (OstreeRepo *self, OstreeRepoTransactionStats *ou
   if (!fsync_object_dirs (self, cancellable, error))
     return FALSE;
 
+  if (!_ostree_repo_fsverity_flush (self, cancellable, error))
+    return FALSE;
+
   g_debug ("txn commit %s", glnx_basename (self->commit_stagedir.path));
   if (!glnx_tmpdir_delete (&self->commit_stagedir, cancellable, error))
     return FALSE;
@@ -2321,6 +2766,9 @@ ostree_repo_commit_transaction (OstreeRepo *self, OstreeRepoTransactionStats *ou
   if (self->loose_object_devino_hash)
     g_hash_table_remove_all (self->loose_object_devino_hash);
 
+  if (!_ostree_repo_pack_flush_removals (self, cancellable, error))
+    return FALSE;
+
   if (self->txn.refs)
     if (!_ostree_repo_update_refs (self, self->txn.refs, cancellable, error))
       return FALSE;
@@ -2393,6 +2841,10 @@ ostree_repo_abort_transaction (OstreeRepo *self, GCancellable *cancellable, GErr
 
   g_clear_pointer (&self->txn.refs, g_hash_table_destroy);
   g_clear_pointer (&self->txn.collection_refs, g_hash_table_destroy);
+  _ostree_repo_pack_discard_removals (self);
+  g_mutex_lock (&self->txn_lock);
+  g_clear_pointer (&self->txn.fsverity_records, g_byte_array_unref);
+  g_mutex_unlock (&self->txn_lock);
 
   glnx_tmpdir_unset (&self->commit_stagedir);
   glnx_release_lock_file (&self->commit_stagedir_lock);
@@ -2420,6 +2872,31 @@ ostree_repo_abort_transaction (OstreeRepo *self, GCancellable *cancellable, GErr
   return TRUE;
 }
 
+/* If we have an expected checksum, see if we already have the object.
+ * This mirrors the same logic in ostree_repo_write_content().
+ */
+static gboolean
+have_metadata_object (OstreeRepo *self, OstreeObjectType objtype, const char *expected_checksum,
+                      GVariant *object, gboolean *out_have_obj, GCancellable *cancellable,
+                      GError **error)
+{
+  if (!_ostree_repo_has_loose_object (self, expected_checksum, objtype, out_have_obj, cancellable,
+                                      error))
+    return FALSE;
+  if (*out_have_obj)
+    {
+      /* Update size metadata if needed */
+      if (self->generate_sizes && !repo_has_size_entry (self, objtype, expected_checksum))
+        {
+          /* Make sure we have a fully serialized object */
+          g_autoptr (GVariant) trusted = g_variant_get_normal_form (object);
+          gsize size = g_variant_get_size (trusted);
+          repo_store_size_entry (self, objtype, expected_checksum, size, size);
+        }
+    }
+  return TRUE;
+}
+
 /**
  * ostree_repo_write_metadata:
  * @self: Repo
@@ -2442,26 +2919,14 @@ ostree_repo_write_metadata (OstreeRepo *self, OstreeObjectType objtype,
                             GCancellable *cancellable, GError **error)
 {
   g_autoptr (GVariant) normalized = NULL;
-  /* First, if we have an expected checksum, see if we already have this
-   * object.  This mirrors the same logic in ostree_repo_write_content().
-   */
   if (expected_checksum)
     {
       gboolean have_obj;
-      if (!_ostree_repo_has_loose_object (self, expected_checksum, objtype, &have_obj, cancellable,
-                                          error))
+      if (!have_metadata_object (self, objtype, expected_checksum, object, &have_obj, cancellable,
+                                 error))
         return FALSE;
       if (have_obj)
         {
-          /* Update size metadata if needed */
-          if (self->generate_sizes && !repo_has_size_entry (self, objtype, expected_checksum))
-            {
-              /* Make sure we have a fully serialized object */
-              g_autoptr (GVariant) trusted = g_variant_get_normal_form (object);
-              gsize size = g_variant_get_size (trusted);
-              repo_store_size_entry (self, objtype, expected_checksum, size, size);
-            }
-
           if (out_csum)
             *out_csum = ostree_checksum_to_bytes (expected_checksum);
           return TRUE;
@@ -2481,13 +2946,91 @@ ostree_repo_write_metadata (OstreeRepo *self, OstreeObjectType objtype,
     return FALSE;
 
   g_autoptr (GBytes) vdata = g_variant_get_data_as_bytes (normalized);
-  if (!write_metadata_object (self, objtype, expected_checksum, vdata, out_csum, cancellable,
-                              error))
+  if (!write_metadata_object (self, objtype, expected_checksum, vdata, NULL, out_csum,
+                              cancellable, error))
     return FALSE;
 
   return TRUE;
 }
 
+/**
+ * _ostree_repo_write_metadata_many:
+ * @self: Repo
+ * @n_objects: Number of objects
+ * @objtypes: (array length=n_objects): Object types
+ * @expected_checksums: (array length=n_objects) (nullable): Checksums to validate against
+ * @objects: (array length=n_objects): Metadata objects
+ * @out_csums: (optional): Return location for @n_objects consecutive binary checksums
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like calling ostree_repo_write_metadata() for each object, but the
+ * objects are checksummed together with ot_checksum_many().  With
+ * @expected_checksums, objects already in the repository aren't
+ * checksummed at all.
+ */
+gboolean
+_ostree_repo_write_metadata_many (OstreeRepo *self, guint n_objects,
+                                  const OstreeObjectType *objtypes,
+                                  const char *const *expected_checksums, GVariant *const *objects,
+                                  guint8 *out_csums, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GPtrArray) vdatas = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+  g_autofree guint *indexes = g_new (guint, n_objects);
+  g_autofree const guint8 **bufs = g_new (const guint8 *, n_objects);
+  g_autofree gsize *lens = g_new (gsize, n_objects);
+
+  for (guint i = 0; i < n_objects; i++)
+    {
+      const char *expected_checksum = expected_checksums ? expected_checksums[i] : NULL;
+      g_autoptr (GVariant) normalized = NULL;
+      if (expected_checksum)
+        {
+          gboolean have_obj;
+          if (!have_metadata_object (self, objtypes[i], expected_checksum, objects[i], &have_obj,
+                                     cancellable, error))
+            return FALSE;
+          if (have_obj)
+            {
+              if (out_csums)
+                ostree_checksum_inplace_to_bytes (expected_checksum,
+                                                  out_csums + i * OSTREE_SHA256_DIGEST_LEN);
+              continue;
+            }
+          normalized = g_variant_ref (objects[i]);
+        }
+      else
+        normalized = g_variant_get_normal_form (objects[i]);
+
+      if (!_ostree_validate_structureof_metadata (objtypes[i], objects[i], error))
+        return FALSE;
+
+      GBytes *vdata = g_variant_get_data_as_bytes (normalized);
+      indexes[vdatas->len] = i;
+      bufs[vdatas->len] = g_bytes_get_data (vdata, &lens[vdatas->len]);
+      g_ptr_array_add (vdatas, vdata);
+    }
+
+  g_autofree guint8 *digests = g_malloc (MAX (vdatas->len, 1) * OSTREE_SHA256_DIGEST_LEN);
+  ot_checksum_many (bufs, lens, vdatas->len, digests);
+
+  for (guint i = 0; i < vdatas->len; i++)
+    {
+      const guint j = indexes[i];
+      const guint8 *digest = digests + i * OSTREE_SHA256_DIGEST_LEN;
+      char actual_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      ostree_checksum_inplace_from_bytes (digest, actual_checksum);
+      if (!write_metadata_object (self, objtypes[j],
+                                  expected_checksums ? expected_checksums[j] : NULL,
+                                  vdatas->pdata[i], actual_checksum, NULL, cancellable, error))
+        return FALSE;
+      if (out_csums)
+        memcpy (out_csums + j * OSTREE_SHA256_DIGEST_LEN, digest, OSTREE_SHA256_DIGEST_LEN);
+    }
+
+  return TRUE;
+}
+
 /**
  * ostree_repo_write_metadata_stream_trusted:
  * @self: Repo
@@ -2965,22 +3508,8 @@ ostree_repo_write_commit (OstreeRepo *self, const char *parent, const char *subj
                           char **out_commit, GCancellable *cancellable, GError **error)
 {
   gint64 timestamp = 0;
-  const gchar *env_timestamp = g_getenv ("SOURCE_DATE_EPOCH");
-  if (env_timestamp == NULL)
-    {
-      g_autoptr (GDateTime) now = g_date_time_new_now_utc ();
-      timestamp = g_date_time_to_unix (now);
-    }
-  else
-    {
-      gchar *ret = NULL;
-      errno = 0;
-      timestamp = g_ascii_strtoll (env_timestamp, &ret, 10);
-      if (errno != 0)
-        return glnx_throw_errno_prefix (error, "Parsing SOURCE_DATE_EPOCH");
-      if (ret == env_timestamp)
-        return glnx_throw (error, "Failed to convert SOURCE_DATE_EPOCH");
-    }
+  if (!_ostree_get_timestamp_now (&timestamp, error))
+    return FALSE;
 
   return ostree_repo_write_commit_with_time (self, parent, subject, body, metadata, root, timestamp,
                                              out_commit, cancellable, error);
@@ -3414,11 +3943,6 @@ static gboolean write_directory_to_mtree_internal (OstreeRepo *self, GFile *dir,
                                                    OstreeRepoCommitModifier *modifier,
                                                    GPtrArray *path, GCancellable *cancellable,
                                                    GError **error);
-static gboolean write_dfd_iter_to_mtree_internal (OstreeRepo *self, GLnxDirFdIterator *src_dfd_iter,
-                                                  OstreeMutableTree *mtree,
-                                                  OstreeRepoCommitModifier *modifier,
-                                                  GPtrArray *path, GCancellable *cancellable,
-                                                  GError **error);
 
 typedef enum
 {
@@ -3426,6 +3950,213 @@ typedef enum
   WRITE_DIR_CONTENT_FLAGS_CAN_ADOPT = 1,
 } WriteDirContentFlags;
 
+/* When ostree_repo_commit_modifier_set_n_jobs() is used, the expensive part of
+ * committing a regular file (checksumming, compressing and writing it into the
+ * staging directory) is handed off to a pool of worker threads.  Everything
+ * else (directory enumeration, filter and xattr callbacks, dirmeta writes) stays
+ * on the calling thread, in the same order as the serial path; so do all
+ * updates to the mutable trees, which are applied as results are collected.
+ * Since an #OstreeMutableTree is keyed by name, the final tree is identical to
+ * the one we'd have built serially.
+ */
+typedef struct
+{
+  OstreeMutableTree *mtree;
+  char *name;
+  int fd;
+  GFileInfo *file_info;
+  GVariant *xattrs;
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+} WriteContentJob;
+
+static void
+write_content_job_free (WriteContentJob *job)
+{
+  glnx_close_fd (&job->fd);
+  g_clear_object (&job->mtree);
+  g_free (job->name);
+  g_clear_object (&job->file_info);
+  g_clear_pointer (&job->xattrs, g_variant_unref);
+  g_free (job);
+}
+
+typedef struct
+{
+  OstreeRepo *repo;
+  GThreadPool *pool;
+  GCancellable *cancellable;
+
+  GMutex lock;
+  GCond cond;
+  /* All of the below are protected by @lock */
+  guint n_outstanding;
+  guint max_outstanding;
+  GPtrArray *completed; /* (element-type WriteContentJob) */
+  GError *error;
+  gboolean aborted;
+} WriteContentPool;
+
+static void
+write_content_pool_worker (gpointer data, gpointer user_data)
+{
+  WriteContentJob *job = data;
+  WriteContentPool *wpool = user_data;
+  g_autoptr (GError) local_error = NULL;
+
+  g_mutex_lock (&wpool->lock);
+  gboolean skip = wpool->error != NULL || wpool->aborted;
+  g_mutex_unlock (&wpool->lock);
+
+  if (!skip)
+    {
+      g_autoptr (GInputStream) file_input = g_unix_input_stream_new (job->fd, FALSE);
+      g_autofree guchar *csum = NULL;
+      if (write_content_object (wpool->repo, NULL, file_input, job->file_info, job->xattrs, &csum,
+                                wpool->cancellable, &local_error))
+        ostree_checksum_inplace_from_bytes (csum, job->checksum);
+    }
+  /* Don't hold on to the fd until the main thread gets around to us */
+  glnx_close_fd (&job->fd);
+
+  g_mutex_lock (&wpool->lock);
+  if (local_error != NULL)
+    {
+      if (wpool->error == NULL)
+        wpool->error = g_steal_pointer (&local_error);
+      write_content_job_free (job);
+    }
+  else if (skip)
+    write_content_job_free (job);
+  else
+    g_ptr_array_add (wpool->completed, job);
+  g_assert_cmpuint (wpool->n_outstanding, >, 0);
+  wpool->n_outstanding--;
+  g_cond_signal (&wpool->cond);
+  g_mutex_unlock (&wpool->lock);
+}
+
+static gboolean
+write_content_pool_init (WriteContentPool *wpool, OstreeRepo *repo, guint n_jobs,
+                         GCancellable *cancellable, GError **error)
+{
+  g_assert (n_jobs > 1);
+  wpool->repo = repo;
+  wpool->cancellable = cancellable;
+  g_mutex_init (&wpool->lock);
+  g_cond_init (&wpool->cond);
+  /* Each queued job holds an open fd, so bound how far ahead of the workers
+   * the directory walk may get.
+   */
+  wpool->max_outstanding = n_jobs * 4;
+  wpool->completed = g_ptr_array_new_with_free_func ((GDestroyNotify)write_content_job_free);
+  wpool->pool = g_thread_pool_new (write_content_pool_worker, wpool, n_jobs, FALSE, error);
+  return wpool->pool != NULL;
+}
+
+/* Add the checksums of all jobs finished so far to their trees. Must be called
+ * from the thread that owns the trees.
+ */
+static gboolean
+write_content_pool_apply_completed (WriteContentPool *wpool, GError **error)
+{
+  g_autoptr (GPtrArray) completed = NULL;
+
+  g_mutex_lock (&wpool->lock);
+  if (wpool->error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&wpool->error));
+      g_mutex_unlock (&wpool->lock);
+      return FALSE;
+    }
+  completed = g_steal_pointer (&wpool->completed);
+  wpool->completed = g_ptr_array_new_with_free_func ((GDestroyNotify)write_content_job_free);
+  g_mutex_unlock (&wpool->lock);
+
+  for (guint i = 0; i < completed->len; i++)
+    {
+      WriteContentJob *job = completed->pdata[i];
+      if (!ostree_mutable_tree_replace_file (job->mtree, job->name, job->checksum, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Queue writing the regular file open as @fd; the fd is stolen. */
+static gboolean
+write_content_pool_push (WriteContentPool *wpool, OstreeMutableTree *mtree, const char *name,
+                         int *fd, GFileInfo *file_info, GVariant *xattrs, GError **error)
+{
+  g_mutex_lock (&wpool->lock);
+  while (wpool->n_outstanding >= wpool->max_outstanding && wpool->error == NULL)
+    g_cond_wait (&wpool->cond, &wpool->lock);
+  g_mutex_unlock (&wpool->lock);
+
+  if (!write_content_pool_apply_completed (wpool, error))
+    return FALSE;
+
+  WriteContentJob *job = g_new0 (WriteContentJob, 1);
+  job->mtree = g_object_ref (mtree);
+  job->name = g_strdup (name);
+  job->fd = glnx_steal_fd (fd);
+  job->file_info = g_object_ref (file_info);
+  job->xattrs = xattrs ? g_variant_ref (xattrs) : NULL;
+
+  g_mutex_lock (&wpool->lock);
+  wpool->n_outstanding++;
+  g_mutex_unlock (&wpool->lock);
+
+  if (!g_thread_pool_push (wpool->pool, job, error))
+    {
+      g_mutex_lock (&wpool->lock);
+      wpool->n_outstanding--;
+      g_mutex_unlock (&wpool->lock);
+      write_content_job_free (job);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Wait for all queued writes, and apply their results */
+static gboolean
+write_content_pool_finish (WriteContentPool *wpool, GError **error)
+{
+  g_mutex_lock (&wpool->lock);
+  while (wpool->n_outstanding > 0)
+    g_cond_wait (&wpool->cond, &wpool->lock);
+  g_mutex_unlock (&wpool->lock);
+
+  return write_content_pool_apply_completed (wpool, error);
+}
+
+static void
+write_content_pool_clear (WriteContentPool *wpool)
+{
+  if (wpool->completed == NULL)
+    return;
+
+  /* Wait for any jobs still running; their results are discarded */
+  if (wpool->pool != NULL)
+    {
+      g_mutex_lock (&wpool->lock);
+      wpool->aborted = TRUE;
+      g_mutex_unlock (&wpool->lock);
+      g_thread_pool_free (g_steal_pointer (&wpool->pool), FALSE, TRUE);
+    }
+  g_clear_pointer (&wpool->completed, g_ptr_array_unref);
+  g_clear_error (&wpool->error);
+  g_mutex_clear (&wpool->lock);
+  g_cond_clear (&wpool->cond);
+}
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (WriteContentPool, write_content_pool_clear)
+
+static gboolean write_dfd_iter_to_mtree_internal (OstreeRepo *self, GLnxDirFdIterator *src_dfd_iter,
+                                                  OstreeMutableTree *mtree,
+                                                  OstreeRepoCommitModifier *modifier,
+                                                  WriteContentPool *wpool, GPtrArray *path,
+                                                  GCancellable *cancellable, GError **error);
+
 /* Given either a dir_enum or a dfd_iter, writes the directory entry (which is
  * itself a directory) to the mtree. For subdirs, we go back through either
  * write_dfd_iter_to_mtree_internal (dfd_iter case) or
@@ -3436,7 +4167,8 @@ write_dir_entry_to_mtree_internal (OstreeRepo *self, OstreeRepoFile *repo_dir,
                                    GFileEnumerator *dir_enum, GLnxDirFdIterator *dfd_iter,
                                    WriteDirContentFlags writeflags, GFileInfo *child_info,
                                    OstreeMutableTree *mtree, OstreeRepoCommitModifier *modifier,
-                                   GPtrArray *path, GCancellable *cancellable, GError **error)
+                                   WriteContentPool *wpool, GPtrArray *path,
+                                   GCancellable *cancellable, GError **error)
 {
   g_assert (dir_enum != NULL || dfd_iter != NULL);
   g_assert (g_file_info_get_file_type (child_info) == G_FILE_TYPE_DIRECTORY);
@@ -3505,8 +4237,8 @@ write_dir_entry_to_mtree_internal (OstreeRepo *self, OstreeRepoFile *repo_dir,
       if (!glnx_dirfd_iterator_init_at (dfd_iter->fd, name, FALSE, &child_dfd_iter, error))
         return FALSE;
 
-      if (!write_dfd_iter_to_mtree_internal (self, &child_dfd_iter, child_mtree, modifier, path,
-                                             cancellable, error))
+      if (!write_dfd_iter_to_mtree_internal (self, &child_dfd_iter, child_mtree, modifier, wpool,
+                                             path, cancellable, error))
         return FALSE;
 
       if (delete_after_commit)
@@ -3529,7 +4261,8 @@ write_content_to_mtree_internal (OstreeRepo *self, OstreeRepoFile *repo_dir,
                                  GFileEnumerator *dir_enum, GLnxDirFdIterator *dfd_iter,
                                  WriteDirContentFlags writeflags, GFileInfo *child_info,
                                  OstreeMutableTree *mtree, OstreeRepoCommitModifier *modifier,
-                                 GPtrArray *path, GCancellable *cancellable, GError **error)
+                                 WriteContentPool *wpool, GPtrArray *path,
+                                 GCancellable *cancellable, GError **error)
 {
   g_assert (dir_enum != NULL || dfd_iter != NULL);
 
@@ -3717,6 +4450,13 @@ write_content_to_mtree_internal (OstreeRepo *self, OstreeRepoFile *repo_dir,
         return FALSE;
       did_adopt = TRUE;
     }
+  /* Regular files are checksummed and written by the worker pool, if any */
+  else if (wpool != NULL && file_type == G_FILE_TYPE_REGULAR && dfd_iter != NULL)
+    {
+      if (!write_content_pool_push (wpool, mtree, name, &file_input_fd, modified_info, xattrs,
+                                    error))
+        return FALSE;
+    }
   else
     {
       g_autoptr (GInputStream) file_input = NULL;
@@ -3854,14 +4594,15 @@ write_directory_to_mtree_internal (OstreeRepo *self, GFile *dir, OstreeMutableTr
             {
               if (!write_dir_entry_to_mtree_internal (self, repo_dir, dir_enum, NULL,
                                                       WRITE_DIR_CONTENT_FLAGS_NONE, child_info,
-                                                      mtree, modifier, path, cancellable, error))
+                                                      mtree, modifier, NULL, path, cancellable,
+                                                      error))
                 return FALSE;
             }
           else
             {
               if (!write_content_to_mtree_internal (self, repo_dir, dir_enum, NULL,
                                                     WRITE_DIR_CONTENT_FLAGS_NONE, child_info, mtree,
-                                                    modifier, path, cancellable, error))
+                                                    modifier, NULL, path, cancellable, error))
                 return FALSE;
             }
         }
@@ -3875,7 +4616,8 @@ write_directory_to_mtree_internal (OstreeRepo *self, GFile *dir, OstreeMutableTr
 static gboolean
 write_dfd_iter_to_mtree_internal (OstreeRepo *self, GLnxDirFdIterator *src_dfd_iter,
                                   OstreeMutableTree *mtree, OstreeRepoCommitModifier *modifier,
-                                  GPtrArray *path, GCancellable *cancellable, GError **error)
+                                  WriteContentPool *wpool, GPtrArray *path,
+                                  GCancellable *cancellable, GError **error)
 {
   g_autoptr (GFileInfo) modified_info = NULL;
   g_autoptr (GVariant) xattrs = NULL;
@@ -3945,7 +4687,7 @@ write_dfd_iter_to_mtree_internal (OstreeRepo *self, GLnxDirFdIterator *src_dfd_i
       if (S_ISDIR (stbuf.st_mode))
         {
           if (!write_dir_entry_to_mtree_internal (self, NULL, NULL, src_dfd_iter, flags, child_info,
-                                                  mtree, modifier, path, cancellable, error))
+                                                  mtree, modifier, wpool, path, cancellable, error))
             return FALSE;
 
           /* We handled the dir, move onto the next */
@@ -3967,7 +4709,7 @@ write_dfd_iter_to_mtree_internal (OstreeRepo *self, GLnxDirFdIterator *src_dfd_i
 
       /* Write a content object, we handled directories above */
       if (!write_content_to_mtree_internal (self, NULL, NULL, src_dfd_iter, flags, child_info,
-                                            mtree, modifier, path, cancellable, error))
+                                            mtree, modifier, wpool, path, cancellable, error))
         return FALSE;
     }
 
@@ -4038,11 +4780,22 @@ ostree_repo_write_dfd_to_mtree (OstreeRepo *self, int dfd, const char *path,
   if (!glnx_dirfd_iterator_init_at (dfd, path, FALSE, &dfd_iter, error))
     return FALSE;
 
+  g_auto (WriteContentPool) wpool = {
+    0,
+  };
+  const guint n_jobs = modifier ? modifier->n_jobs : 1;
+  if (n_jobs > 1 && !write_content_pool_init (&wpool, self, n_jobs, cancellable, error))
+    return FALSE;
+
   g_autoptr (GPtrArray) pathbuilder = g_ptr_array_new ();
-  if (!write_dfd_iter_to_mtree_internal (self, &dfd_iter, mtree, modifier, pathbuilder, cancellable,
+  if (!write_dfd_iter_to_mtree_internal (self, &dfd_iter, mtree, modifier,
+                                         wpool.pool ? &wpool : NULL, pathbuilder, cancellable,
                                          error))
     return FALSE;
 
+  if (wpool.pool != NULL && !write_content_pool_finish (&wpool, error))
+    return FALSE;
+
   /* And now finally remove the toplevel; see also the handling for this flag in
    * the write_dfd_iter_to_mtree_internal() function. As a special case we don't
    * try to remove `.` (since we'd get EINVAL); that's what's used in
@@ -4059,6 +4812,78 @@ ostree_repo_write_dfd_to_mtree (OstreeRepo *self, int dfd, const char *path,
   return TRUE;
 }
 
+/* Serialize the dirtree for @mtree, whose subdirectories must all have
+ * been written.
+ */
+static GVariant *
+create_tree_variant_from_mtree (OstreeMutableTree *mtree)
+{
+  g_autoptr (GHashTable) dir_contents_checksums = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr (GHashTable) dir_metadata_checksums = g_hash_table_new (g_str_hash, g_str_equal);
+
+  GLNX_HASH_TABLE_FOREACH_KV (ostree_mutable_tree_get_subdirs (mtree), const char *, name,
+                              OstreeMutableTree *, child_dir)
+    {
+      const char *child_contents_checksum = ostree_mutable_tree_get_contents_checksum (child_dir);
+      g_assert (child_contents_checksum != NULL);
+      g_hash_table_insert (dir_contents_checksums, (char *)name, (char *)child_contents_checksum);
+      g_hash_table_insert (dir_metadata_checksums, (char *)name,
+                           (char *)ostree_mutable_tree_get_metadata_checksum (child_dir));
+    }
+
+  return create_tree_variant_from_hashes (ostree_mutable_tree_get_files (mtree),
+                                          dir_contents_checksums, dir_metadata_checksums);
+}
+
+/* Write the dirtrees of all subdirectories of @mtree, recursively.  The
+ * dirtrees of siblings are independent, so they are checksummed together.
+ */
+static gboolean
+write_mtree_subdirs (OstreeRepo *self, OstreeMutableTree *mtree, GCancellable *cancellable,
+                     GError **error)
+{
+  g_autoptr (GPtrArray) pending = g_ptr_array_new ();
+  g_autoptr (GPtrArray) serialized_trees
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+
+  GLNX_HASH_TABLE_FOREACH_V (ostree_mutable_tree_get_subdirs (mtree), OstreeMutableTree *,
+                             child_dir)
+    {
+      if (!ostree_mutable_tree_check_error (child_dir, error))
+        return glnx_prefix_error (error, "mtree");
+      if (!ostree_mutable_tree_get_metadata_checksum (child_dir))
+        return glnx_throw (error, "Can't commit an empty tree");
+      if (ostree_mutable_tree_get_contents_checksum (child_dir))
+        continue;
+
+      if (!write_mtree_subdirs (self, child_dir, cancellable, error))
+        return FALSE;
+      g_ptr_array_add (pending, child_dir);
+      g_ptr_array_add (serialized_trees, create_tree_variant_from_mtree (child_dir));
+    }
+
+  if (pending->len == 0)
+    return TRUE;
+
+  g_autofree OstreeObjectType *objtypes = g_new (OstreeObjectType, pending->len);
+  for (guint i = 0; i < pending->len; i++)
+    objtypes[i] = OSTREE_OBJECT_TYPE_DIR_TREE;
+  g_autofree guint8 *csums = g_malloc (pending->len * OSTREE_SHA256_DIGEST_LEN);
+  if (!_ostree_repo_write_metadata_many (self, pending->len, objtypes, NULL,
+                                         (GVariant *const *)serialized_trees->pdata, csums,
+                                         cancellable, error))
+    return FALSE;
+
+  for (guint i = 0; i < pending->len; i++)
+    {
+      char checksum[OSTREE_SHA256_STRING_LEN + 1];
+      ostree_checksum_inplace_from_bytes (csums + i * OSTREE_SHA256_DIGEST_LEN, checksum);
+      ostree_mutable_tree_set_contents_checksum (pending->pdata[i], checksum);
+    }
+
+  return TRUE;
+}
+
 /**
  * ostree_repo_write_mtree:
  * @self: Repo
@@ -4092,35 +4917,13 @@ ostree_repo_write_mtree (OstreeRepo *self, OstreeMutableTree *mtree, GFile **out
     }
   else
     {
-      g_autoptr (GHashTable) dir_metadata_checksums = NULL;
-      g_autoptr (GHashTable) dir_contents_checksums = NULL;
-      g_autoptr (GVariant) serialized_tree = NULL;
       g_autofree guchar *contents_csum = NULL;
       char contents_checksum_buf[OSTREE_SHA256_STRING_LEN + 1];
 
-      dir_contents_checksums = g_hash_table_new_full (
-          g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
-      dir_metadata_checksums = g_hash_table_new_full (
-          g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
-
-      GLNX_HASH_TABLE_FOREACH_KV (ostree_mutable_tree_get_subdirs (mtree), const char *, name,
-                                  OstreeMutableTree *, child_dir)
-        {
-          g_autoptr (GFile) child_file = NULL;
-          if (!ostree_repo_write_mtree (self, child_dir, &child_file, cancellable, error))
-            return FALSE;
-
-          g_hash_table_replace (dir_contents_checksums, g_strdup (name),
-                                g_strdup (ostree_repo_file_tree_get_contents_checksum (
-                                    OSTREE_REPO_FILE (child_file))));
-          g_hash_table_replace (dir_metadata_checksums, g_strdup (name),
-                                g_strdup (ostree_repo_file_tree_get_metadata_checksum (
-                                    OSTREE_REPO_FILE (child_file))));
-        }
-
-      serialized_tree = create_tree_variant_from_hashes (
-          ostree_mutable_tree_get_files (mtree), dir_contents_checksums, dir_metadata_checksums);
+      if (!write_mtree_subdirs (self, mtree, cancellable, error))
+        return FALSE;
 
+      g_autoptr (GVariant) serialized_tree = create_tree_variant_from_mtree (mtree);
       if (!ostree_repo_write_metadata (self, OSTREE_OBJECT_TYPE_DIR_TREE, NULL, serialized_tree,
                                        &contents_csum, cancellable, error))
         return FALSE;
@@ -4158,6 +4961,7 @@ ostree_repo_commit_modifier_new (OstreeRepoCommitModifierFlags flags,
   modifier->filter = commit_filter;
   modifier->user_data = user_data;
   modifier->destroy_notify = destroy_notify;
+  modifier->n_jobs = 1;
 
   return modifier;
 }
@@ -4288,6 +5092,26 @@ ostree_repo_commit_modifier_set_devino_cache (OstreeRepoCommitModifier *modifier
   modifier->devino_cache = g_hash_table_ref ((GHashTable *)cache);
 }
 
+/**
+ * ostree_repo_commit_modifier_set_n_jobs:
+ * @modifier: Commit modifier
+ * @n_jobs: Number of worker threads; 0 or 1 means no threads
+ *
+ * By default, ostree_repo_write_dfd_to_mtree() checksums and writes each
+ * regular file serially.  If @n_jobs is greater than one, up to
+ * that many files are checksummed and written concurrently from a pool of
+ * worker threads.  Directory traversal, and invocations of the filter and
+ * xattr callbacks, still happen serially from the calling thread, and the
+ * resulting tree is identical to the one produced by the serial path.
+ *
+ * Since: 2026.5
+ */
+void
+ostree_repo_commit_modifier_set_n_jobs (OstreeRepoCommitModifier *modifier, guint n_jobs)
+{
+  modifier->n_jobs = MAX (n_jobs, 1);
+}
+
 OstreeRepoDevInoCache *
 ostree_repo_devino_cache_ref (OstreeRepoDevInoCache *cache)
 {
@@ -4380,6 +5204,19 @@ import_one_object_direct (OstreeRepo *dest_repo, OstreeRepo *src_repo, const cha
   char loose_path_buf[_OSTREE_LOOSE_PATH_MAX];
   _ostree_loose_path (loose_path_buf, checksum, objtype, dest_repo->mode);
 
+  /* Objects in a pack file or chunked have no loose path to link or copy */
+  gboolean is_packed = FALSE;
+  if (!_ostree_repo_pack_lookup (src_repo, checksum, objtype, &is_packed, NULL, error))
+    return FALSE;
+  if (!is_packed && objtype == OSTREE_OBJECT_TYPE_FILE
+      && !_ostree_repo_chunked_file_lookup (src_repo, checksum, &is_packed, NULL, error))
+    return FALSE;
+  if (is_packed)
+    {
+      *out_was_supported = FALSE;
+      return TRUE;
+    }
+
   /* hardlinks require the owner to match and to be on the same device */
   const gboolean can_hardlink
       = src_repo->owner_uid == dest_repo->owner_uid && src_repo->device == dest_repo->device;
@@ -4514,8 +5351,8 @@ import_one_object_direct (OstreeRepo *dest_repo, OstreeRepo *src_repo, const cha
           (void)futimens (tmp_dest.fd, ts);
         }
 
-      if (!_ostree_repo_commit_tmpf_final (dest_repo, checksum, objtype, &tmp_dest, NULL,
-                                           cancellable, error))
+      if (!_ostree_repo_commit_tmpf_final (dest_repo, checksum, objtype, &tmp_dest, FALSE, NULL,
+                                           NULL, cancellable, error))
         return FALSE;
     }
 
@@ -0,0 +1,272 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <sys/stat.h>
+
+#include "ostree-autocleanups.h"
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "otutil.h"
+
+/* The fsck journal records, for each loose object which last passed
+ * verification, the identity of the file on disk (inode, size, mtime and
+ * ctime) and when it was verified.  Objects are immutable, so as long as
+ * the file is unchanged there is no need to checksum it again; anything
+ * which rewrites it, including touching its xattrs, changes the ctime.
+ * Entries older than a maximum age are verified again regardless, to catch
+ * corruption below the filesystem.
+ *
+ * Packed objects and objects found in a staging directory are never
+ * journaled and are always verified.
+ */
+
+#define JOURNAL_KEY_LEN (OSTREE_SHA256_DIGEST_LEN + 1)
+#define JOURNAL_N_FIELDS 5
+#define JOURNAL_RECORD_LEN (JOURNAL_KEY_LEN + JOURNAL_N_FIELDS * sizeof (guint64))
+#define JOURNAL_VERSION 1
+
+struct OstreeRepoFsckJournal
+{
+  OstreeRepo *repo;
+  guint64 max_age;
+  guint64 now;
+  GVariant *data;        /* _OSTREE_FSCK_JOURNAL_GVARIANT_FORMAT, or %NULL */
+  const guint8 *records; /* Sorted by key */
+  gsize n_records;
+  GArray *new_records;   /* OstreeRepoFsckJournalRecord */
+};
+
+void
+_ostree_repo_fsck_journal_free (OstreeRepoFsckJournal *journal)
+{
+  g_clear_pointer (&journal->data, g_variant_unref);
+  g_clear_pointer (&journal->new_records, g_array_unref);
+  g_free (journal);
+}
+
+static int
+compare_record_keys (gconstpointer a, gconstpointer b)
+{
+  return memcmp (a, b, JOURNAL_KEY_LEN);
+}
+
+/**
+ * _ostree_repo_fsck_journal_load:
+ * @self: Repo
+ * @max_age: Maximum age in seconds of a verification to trust
+ * @out_journal: (out): The journal
+ * @error: Error
+ *
+ * Load the fsck journal.  Anything we can't make sense of (including a
+ * journal from a future version) is treated as empty.
+ */
+gboolean
+_ostree_repo_fsck_journal_load (OstreeRepo *self, guint64 max_age,
+                                OstreeRepoFsckJournal **out_journal, GError **error)
+{
+  g_autoptr (OstreeRepoFsckJournal) journal = g_new0 (OstreeRepoFsckJournal, 1);
+  journal->repo = self;
+  journal->max_age = max_age;
+  journal->now = g_get_real_time () / G_USEC_PER_SEC;
+  journal->new_records = g_array_new (FALSE, FALSE, sizeof (OstreeRepoFsckJournalRecord));
+
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, _OSTREE_FSCK_JOURNAL_PATH, &fd, error))
+    return FALSE;
+  if (fd != -1)
+    {
+      g_autoptr (GVariant) data = NULL;
+      if (!ot_variant_read_fd (fd, 0, _OSTREE_FSCK_JOURNAL_GVARIANT_FORMAT, FALSE, &data, error))
+        return FALSE;
+
+      guint32 version;
+      g_autoptr (GVariant) records = NULL;
+      g_variant_get (data, "(u@ay)", &version, &records);
+      const gsize records_size = g_variant_get_size (records);
+      if (GUINT32_FROM_BE (version) == JOURNAL_VERSION && records_size % JOURNAL_RECORD_LEN == 0)
+        {
+          journal->records = g_variant_get_data (records);
+          journal->n_records = records_size / JOURNAL_RECORD_LEN;
+          journal->data = g_steal_pointer (&data);
+        }
+      else
+        g_debug ("Ignoring invalid fsck journal");
+    }
+
+  *out_journal = g_steal_pointer (&journal);
+  return TRUE;
+}
+
+static void
+record_decode (const guint8 *buf, OstreeRepoFsckJournalRecord *record)
+{
+  guint64 fields[JOURNAL_N_FIELDS];
+  memcpy (record->key, buf, JOURNAL_KEY_LEN);
+  memcpy (fields, buf + JOURNAL_KEY_LEN, sizeof (fields));
+  record->ino = GUINT64_FROM_BE (fields[0]);
+  record->size = GUINT64_FROM_BE (fields[1]);
+  record->mtime = GUINT64_FROM_BE (fields[2]);
+  record->ctime = GUINT64_FROM_BE (fields[3]);
+  record->verified = GUINT64_FROM_BE (fields[4]);
+}
+
+static void
+record_encode (const OstreeRepoFsckJournalRecord *record, guint8 *buf)
+{
+  const guint64 fields[JOURNAL_N_FIELDS]
+      = { GUINT64_TO_BE (record->ino), GUINT64_TO_BE (record->size),
+          GUINT64_TO_BE (record->mtime), GUINT64_TO_BE (record->ctime),
+          GUINT64_TO_BE (record->verified) };
+  memcpy (buf, record->key, JOURNAL_KEY_LEN);
+  memcpy (buf + JOURNAL_KEY_LEN, fields, sizeof (fields));
+}
+
+static inline guint64
+timespec_to_ns (const struct timespec *ts)
+{
+  return (guint64)ts->tv_sec * G_GUINT64_CONSTANT (1000000000) + ts->tv_nsec;
+}
+
+/**
+ * _ostree_repo_fsck_journal_check:
+ * @journal: Journal
+ * @checksum: Object checksum
+ * @objtype: Object type
+ * @out_record: (out caller-allocates): Journal record for the object as it
+ *   is now, to be passed to _ostree_repo_fsck_journal_add() once verified;
+ *   zeroed if the object can't be journaled
+ * @out_current: (out): Whether the object was verified recently enough, and
+ *   is unchanged since
+ * @error: Error
+ *
+ * May be called from any thread.
+ */
+gboolean
+_ostree_repo_fsck_journal_check (OstreeRepoFsckJournal *journal, const char *checksum,
+                                 OstreeObjectType objtype,
+                                 OstreeRepoFsckJournalRecord *out_record,
+                                 gboolean *out_current, GError **error)
+{
+  memset (out_record, 0, sizeof (*out_record));
+  *out_current = FALSE;
+
+  char loose_path[_OSTREE_LOOSE_PATH_MAX];
+  _ostree_loose_path (loose_path, checksum, objtype, journal->repo->mode);
+  struct stat stbuf;
+  if (!glnx_fstatat_allow_noent (journal->repo->objects_dir_fd, loose_path, &stbuf,
+                                 AT_SYMLINK_NOFOLLOW, error))
+    return FALSE;
+  if (errno == ENOENT)
+    return TRUE;
+
+  OstreeRepoFsckJournalRecord record = {
+    0,
+  };
+  ostree_checksum_inplace_to_bytes (checksum, record.key);
+  record.key[OSTREE_SHA256_DIGEST_LEN] = objtype;
+  record.ino = stbuf.st_ino;
+  record.size = stbuf.st_size;
+  record.mtime = timespec_to_ns (&stbuf.st_mtim);
+  record.ctime = timespec_to_ns (&stbuf.st_ctim);
+  record.verified = journal->now;
+
+  const guint8 *found = journal->records
+                            ? bsearch (record.key, journal->records, journal->n_records,
+                                       JOURNAL_RECORD_LEN, compare_record_keys)
+                            : NULL;
+  if (found)
+    {
+      OstreeRepoFsckJournalRecord old;
+      record_decode (found, &old);
+      if (old.ino == record.ino && old.size == record.size && old.mtime == record.mtime
+          && old.ctime == record.ctime && old.verified <= journal->now
+          && journal->now - old.verified < journal->max_age)
+        {
+          record.verified = old.verified;
+          *out_current = TRUE;
+        }
+    }
+
+  *out_record = record;
+  return TRUE;
+}
+
+/**
+ * _ostree_repo_fsck_journal_add:
+ * @journal: Journal
+ * @record: Record from _ostree_repo_fsck_journal_check()
+ *
+ * Record that an object is valid.  Only objects added here since the
+ * journal was loaded are kept when it is written.
+ */
+void
+_ostree_repo_fsck_journal_add (OstreeRepoFsckJournal *journal,
+                               const OstreeRepoFsckJournalRecord *record)
+{
+  if (record->key[OSTREE_SHA256_DIGEST_LEN] == 0)
+    return;
+  g_array_append_vals (journal->new_records, record, 1);
+}
+
+/**
+ * _ostree_repo_fsck_journal_write:
+ * @journal: Journal
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Replace the journal on disk with the records added since it was loaded.
+ */
+gboolean
+_ostree_repo_fsck_journal_write (OstreeRepoFsckJournal *journal, GCancellable *cancellable,
+                                 GError **error)
+{
+  OstreeRepo *repo = journal->repo;
+
+  /* The key is the first member, so this sorts by key */
+  g_array_sort (journal->new_records, compare_record_keys);
+
+  const guint n = journal->new_records->len;
+  g_autofree guint8 *buf = g_malloc (MAX (n, 1) * JOURNAL_RECORD_LEN);
+  gsize len = 0;
+  for (guint i = 0; i < n; i++)
+    {
+      const OstreeRepoFsckJournalRecord *record
+          = &g_array_index (journal->new_records, OstreeRepoFsckJournalRecord, i);
+      /* The same object may be verified more than once */
+      if (len > 0 && memcmp (buf + len - JOURNAL_RECORD_LEN, record->key, JOURNAL_KEY_LEN) == 0)
+        continue;
+      record_encode (record, buf + len);
+      len += JOURNAL_RECORD_LEN;
+    }
+
+  g_autoptr (GVariant) data = g_variant_ref_sink (
+      g_variant_new ("(u@ay)", GUINT32_TO_BE (JOURNAL_VERSION),
+                     g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, buf, len, 1)));
+
+  if (!glnx_shutil_mkdir_p_at (repo->repo_dir_fd, "state", 0775, cancellable, error))
+    return FALSE;
+  if (!glnx_file_replace_contents_at (
+          repo->repo_dir_fd, _OSTREE_FSCK_JOURNAL_PATH, g_variant_get_data (data),
+          g_variant_get_size (data),
+          repo->disable_fsync ? GLNX_FILE_REPLACE_NODATASYNC : GLNX_FILE_REPLACE_DATASYNC_NEW,
+          cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
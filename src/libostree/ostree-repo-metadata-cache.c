@@ -0,0 +1,218 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "otutil.h"
+
+/* The metadata cache keeps recently loaded commit, dirtree and dirmeta
+ * objects in memory, up to the core.metadata-cache-size configured for the
+ * repository, evicting the least recently used first; a size of 0 disables
+ * it.  The cache lives as long as the OstreeRepo and is only resized when
+ * the configuration is reloaded, so other threads may keep using it then.
+ * Those objects are immutable, so the only way an entry can go stale is for
+ * the object to be deleted; that is handled for deletions through this
+ * OstreeRepo, but not for other processes pruning the repository.
+ */
+
+#define KEY_LEN (OSTREE_SHA256_DIGEST_LEN + 1)
+
+typedef struct
+{
+  guint8 key[KEY_LEN]; /* Binary checksum and object type */
+  GVariant *variant;
+  gsize size;
+  GList link; /* In the LRU queue, most recently used first */
+} CacheEntry;
+
+struct OstreeRepoMetadataCache
+{
+  GMutex lock; /* All other members should only be accessed with this held */
+  gsize max_size;
+  gsize size;
+  GHashTable *entries; /* key → owned CacheEntry */
+  GQueue lru;
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+};
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_variant_unref (entry->variant);
+  g_free (entry);
+}
+
+static guint
+cache_key_hash (gconstpointer key)
+{
+  /* The checksum is already uniformly distributed */
+  guint hash;
+  memcpy (&hash, key, sizeof (hash));
+  return hash;
+}
+
+static gboolean
+cache_key_equal (gconstpointer a, gconstpointer b)
+{
+  return memcmp (a, b, KEY_LEN) == 0;
+}
+
+static void
+cache_key_init (guint8 *key, OstreeObjectType objtype, const char *checksum)
+{
+  ostree_checksum_inplace_to_bytes (checksum, key);
+  key[OSTREE_SHA256_DIGEST_LEN] = objtype;
+}
+
+/* Returns: (transfer full): A cache holding nothing until it is given a
+ * size with _ostree_repo_metadata_cache_set_max_size()
+ */
+OstreeRepoMetadataCache *
+_ostree_repo_metadata_cache_new (void)
+{
+  OstreeRepoMetadataCache *cache = g_new0 (OstreeRepoMetadataCache, 1);
+  g_mutex_init (&cache->lock);
+  cache->entries = g_hash_table_new_full (cache_key_hash, cache_key_equal, NULL,
+                                          (GDestroyNotify)cache_entry_free);
+  g_queue_init (&cache->lru);
+  return cache;
+}
+
+void
+_ostree_repo_metadata_cache_free (OstreeRepoMetadataCache *cache)
+{
+  g_debug ("metadata cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+           " misses, %" G_GUINT64_FORMAT " evictions",
+           cache->hits, cache->misses, cache->evictions);
+  g_hash_table_unref (cache->entries);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+/* Whether objects of this type are worth caching; detached commit metadata
+ * is excluded since it can change.
+ */
+gboolean
+_ostree_repo_metadata_cache_accepts (OstreeObjectType objtype)
+{
+  return objtype == OSTREE_OBJECT_TYPE_COMMIT || objtype == OSTREE_OBJECT_TYPE_DIR_TREE
+         || objtype == OSTREE_OBJECT_TYPE_DIR_META;
+}
+
+/* Returns: (transfer full) (nullable): The cached object */
+GVariant *
+_ostree_repo_metadata_cache_lookup (OstreeRepoMetadataCache *cache, OstreeObjectType objtype,
+                                    const char *checksum)
+{
+  guint8 key[KEY_LEN];
+  cache_key_init (key, objtype, checksum);
+
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  if (cache->max_size == 0)
+    return NULL;
+  CacheEntry *entry = g_hash_table_lookup (cache->entries, key);
+  if (entry == NULL)
+    {
+      cache->misses++;
+      return NULL;
+    }
+
+  cache->hits++;
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  return g_variant_ref (entry->variant);
+}
+
+static void
+remove_entry (OstreeRepoMetadataCache *cache, CacheEntry *entry)
+{
+  g_queue_unlink (&cache->lru, &entry->link);
+  cache->size -= entry->size;
+  g_hash_table_remove (cache->entries, entry->key);
+}
+
+void
+_ostree_repo_metadata_cache_insert (OstreeRepoMetadataCache *cache, OstreeObjectType objtype,
+                                    const char *checksum, GVariant *variant)
+{
+  const gsize size = g_variant_get_size (variant) + sizeof (CacheEntry);
+  g_autofree CacheEntry *new_entry = g_new0 (CacheEntry, 1);
+  cache_key_init (new_entry->key, objtype, checksum);
+
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  if (size > cache->max_size)
+    return;
+  /* Another thread may have loaded it at the same time */
+  if (g_hash_table_contains (cache->entries, new_entry->key))
+    return;
+
+  while (cache->size + size > cache->max_size)
+    {
+      remove_entry (cache, g_queue_peek_tail (&cache->lru));
+      cache->evictions++;
+    }
+
+  CacheEntry *entry = g_steal_pointer (&new_entry);
+  entry->variant = g_variant_ref (variant);
+  entry->size = size;
+  entry->link.data = entry;
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  g_hash_table_add (cache->entries, entry);
+  cache->size += size;
+}
+
+void
+_ostree_repo_metadata_cache_remove (OstreeRepoMetadataCache *cache, OstreeObjectType objtype,
+                                    const char *checksum)
+{
+  guint8 key[KEY_LEN];
+  cache_key_init (key, objtype, checksum);
+
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  CacheEntry *entry = g_hash_table_lookup (cache->entries, key);
+  if (entry)
+    remove_entry (cache, entry);
+}
+
+/* Set the size limit, evicting objects to honour it, and restart the
+ * statistics.
+ */
+void
+_ostree_repo_metadata_cache_set_max_size (OstreeRepoMetadataCache *cache, gsize max_size)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  cache->max_size = max_size;
+  while (cache->size > cache->max_size)
+    remove_entry (cache, g_queue_peek_tail (&cache->lru));
+  cache->hits = cache->misses = cache->evictions = 0;
+}
+
+void
+_ostree_repo_metadata_cache_get_stats (OstreeRepoMetadataCache *cache, guint64 *out_hits,
+                                       guint64 *out_misses, guint64 *out_evictions,
+                                       guint64 *out_size)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&cache->lock);
+  *out_hits = cache->hits;
+  *out_misses = cache->misses;
+  *out_evictions = cache->evictions;
+  *out_size = cache->size;
+}
@@ -0,0 +1,315 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "ostree.h"
+#include "otutil.h"
+
+/**
+ * SECTION:ostree-repo-object-set
+ * @title: Object sets
+ * @short_description: Compact sets of object names
+ *
+ * An #OstreeRepoObjectSet is a set of (checksum, object type) pairs, as an
+ * alternative to the #GHashTable of serialized object names returned by
+ * ostree_repo_traverse_new_reachable().  Each entry takes 33 bytes in an
+ * open-addressed table, rather than a separately allocated #GVariant per
+ * object, which makes a large difference when traversing entire
+ * repositories with millions of objects.  See
+ * ostree_repo_traverse_commit_set().
+ *
+ * Since: 2026.5
+ */
+
+/* A slot holds the binary checksum followed by the object type; since
+ * object types start at 1, a zero type marks an empty slot.
+ */
+#define SLOT_SIZE (OSTREE_SHA256_DIGEST_LEN + 1)
+#define INITIAL_N_SLOTS 64
+
+struct OstreeRepoObjectSet
+{
+  gint refcount;
+  guint8 *slots;
+  gsize n_slots; /* Always a power of two */
+  guint n_items;
+};
+
+G_DEFINE_BOXED_TYPE (OstreeRepoObjectSet, ostree_repo_object_set, ostree_repo_object_set_ref,
+                     ostree_repo_object_set_unref);
+
+/**
+ * ostree_repo_object_set_new:
+ *
+ * Returns: (transfer full): A new, empty set
+ *
+ * Since: 2026.5
+ */
+OstreeRepoObjectSet *
+ostree_repo_object_set_new (void)
+{
+  OstreeRepoObjectSet *set = g_new0 (OstreeRepoObjectSet, 1);
+  set->refcount = 1;
+  set->n_slots = INITIAL_N_SLOTS;
+  set->slots = g_malloc0 (set->n_slots * SLOT_SIZE);
+  return set;
+}
+
+/**
+ * ostree_repo_object_set_ref:
+ * @set: A set
+ *
+ * Returns: (transfer full): @set
+ *
+ * Since: 2026.5
+ */
+OstreeRepoObjectSet *
+ostree_repo_object_set_ref (OstreeRepoObjectSet *set)
+{
+  g_return_val_if_fail (set != NULL, NULL);
+  g_atomic_int_inc (&set->refcount);
+  return set;
+}
+
+/**
+ * ostree_repo_object_set_unref:
+ * @set: A set
+ *
+ * Since: 2026.5
+ */
+void
+ostree_repo_object_set_unref (OstreeRepoObjectSet *set)
+{
+  g_return_if_fail (set != NULL);
+  if (!g_atomic_int_dec_and_test (&set->refcount))
+    return;
+  g_free (set->slots);
+  g_free (set);
+}
+
+static inline gsize
+slot_hash (const guint8 *csum, guint8 objtype)
+{
+  /* Checksums are already uniformly distributed */
+  guint64 v;
+  memcpy (&v, csum, sizeof (v));
+  return (gsize)(v ^ objtype);
+}
+
+/* Find the slot for the given object, which is either the one holding it
+ * or the empty one where it should go.
+ */
+static guint8 *
+find_slot (const guint8 *slots, gsize n_slots, const guint8 *csum, guint8 objtype)
+{
+  const gsize mask = n_slots - 1;
+  gsize i = slot_hash (csum, objtype) & mask;
+
+  while (TRUE)
+    {
+      guint8 *slot = (guint8 *)slots + i * SLOT_SIZE;
+      const guint8 slot_objtype = slot[OSTREE_SHA256_DIGEST_LEN];
+      if (slot_objtype == 0)
+        return slot;
+      if (slot_objtype == objtype && memcmp (slot, csum, OSTREE_SHA256_DIGEST_LEN) == 0)
+        return slot;
+      i = (i + 1) & mask;
+    }
+}
+
+static void
+grow (OstreeRepoObjectSet *set)
+{
+  const gsize new_n_slots = set->n_slots * 2;
+  guint8 *new_slots = g_malloc0 (new_n_slots * SLOT_SIZE);
+
+  for (gsize i = 0; i < set->n_slots; i++)
+    {
+      const guint8 *slot = set->slots + i * SLOT_SIZE;
+      const guint8 objtype = slot[OSTREE_SHA256_DIGEST_LEN];
+      if (objtype == 0)
+        continue;
+      memcpy (find_slot (new_slots, new_n_slots, slot, objtype), slot, SLOT_SIZE);
+    }
+
+  g_free (set->slots);
+  set->slots = new_slots;
+  set->n_slots = new_n_slots;
+}
+
+/**
+ * ostree_repo_object_set_add_bytes:
+ * @set: A set
+ * @csum: (array fixed-size=32): Binary checksum
+ * @objtype: Object type
+ *
+ * Like ostree_repo_object_set_add(), but taking a binary checksum.
+ *
+ * Returns: %TRUE if the object was not already in @set
+ *
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_object_set_add_bytes (OstreeRepoObjectSet *set, const guint8 *csum,
+                                  OstreeObjectType objtype)
+{
+  g_return_val_if_fail (objtype >= OSTREE_OBJECT_TYPE_FILE && objtype <= OSTREE_OBJECT_TYPE_LAST,
+                        FALSE);
+
+  /* Keep the load factor under 3/4 */
+  if ((set->n_items + 1) * 4 > set->n_slots * 3)
+    grow (set);
+
+  guint8 *slot = find_slot (set->slots, set->n_slots, csum, objtype);
+  if (slot[OSTREE_SHA256_DIGEST_LEN] != 0)
+    return FALSE;
+
+  memcpy (slot, csum, OSTREE_SHA256_DIGEST_LEN);
+  slot[OSTREE_SHA256_DIGEST_LEN] = objtype;
+  set->n_items++;
+  return TRUE;
+}
+
+/**
+ * ostree_repo_object_set_add:
+ * @set: A set
+ * @checksum: ASCII SHA256 checksum
+ * @objtype: Object type
+ *
+ * Add an object to @set.
+ *
+ * Returns: %TRUE if the object was not already in @set
+ *
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_object_set_add (OstreeRepoObjectSet *set, const char *checksum,
+                            OstreeObjectType objtype)
+{
+  guint8 csum[OSTREE_SHA256_DIGEST_LEN];
+  ostree_checksum_inplace_to_bytes (checksum, csum);
+  return ostree_repo_object_set_add_bytes (set, csum, objtype);
+}
+
+/**
+ * ostree_repo_object_set_contains_bytes:
+ * @set: A set
+ * @csum: (array fixed-size=32): Binary checksum
+ * @objtype: Object type
+ *
+ * Like ostree_repo_object_set_contains(), but taking a binary checksum.
+ *
+ * Returns: %TRUE if the object is in @set
+ *
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_object_set_contains_bytes (OstreeRepoObjectSet *set, const guint8 *csum,
+                                       OstreeObjectType objtype)
+{
+  const guint8 *slot = find_slot (set->slots, set->n_slots, csum, objtype);
+  return slot[OSTREE_SHA256_DIGEST_LEN] != 0;
+}
+
+/**
+ * ostree_repo_object_set_contains:
+ * @set: A set
+ * @checksum: ASCII SHA256 checksum
+ * @objtype: Object type
+ *
+ * Returns: %TRUE if the object is in @set
+ *
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_object_set_contains (OstreeRepoObjectSet *set, const char *checksum,
+                                 OstreeObjectType objtype)
+{
+  guint8 csum[OSTREE_SHA256_DIGEST_LEN];
+  ostree_checksum_inplace_to_bytes (checksum, csum);
+  return ostree_repo_object_set_contains_bytes (set, csum, objtype);
+}
+
+/**
+ * ostree_repo_object_set_size:
+ * @set: A set
+ *
+ * Returns: The number of objects in @set
+ *
+ * Since: 2026.5
+ */
+guint
+ostree_repo_object_set_size (OstreeRepoObjectSet *set)
+{
+  return set->n_items;
+}
+
+/**
+ * ostree_repo_object_set_iter_init:
+ * @iter: An uninitialized iterator
+ * @set: A set
+ *
+ * Initialize @iter to walk over the objects of @set, in no particular
+ * order.  The set must not be modified while iterating.
+ *
+ * Since: 2026.5
+ */
+void
+ostree_repo_object_set_iter_init (OstreeRepoObjectSetIter *iter, OstreeRepoObjectSet *set)
+{
+  memset (iter, 0, sizeof (*iter));
+  iter->set = set;
+}
+
+/**
+ * ostree_repo_object_set_iter_next:
+ * @iter: An iterator
+ * @out_checksum: (out) (transfer none) (optional): ASCII checksum, valid
+ *   until the next call
+ * @out_objtype: (out) (optional): Object type
+ *
+ * Returns: %FALSE once all objects have been returned
+ *
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_object_set_iter_next (OstreeRepoObjectSetIter *iter, const char **out_checksum,
+                                  OstreeObjectType *out_objtype)
+{
+  OstreeRepoObjectSet *set = iter->set;
+
+  while (iter->index < set->n_slots)
+    {
+      const guint8 *slot = set->slots + iter->index * SLOT_SIZE;
+      const guint8 objtype = slot[OSTREE_SHA256_DIGEST_LEN];
+      iter->index++;
+      if (objtype == 0)
+        continue;
+
+      ostree_checksum_inplace_from_bytes (slot, iter->checksum);
+      if (out_checksum)
+        *out_checksum = iter->checksum;
+      if (out_objtype)
+        *out_objtype = objtype;
+      return TRUE;
+    }
+
+  return FALSE;
+}
@@ -0,0 +1,823 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ostree-autocleanups.h"
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "otutil.h"
+
+/* Pack files are an alternative storage for the objects of archive
+ * repositories.  Many small loose files are expensive to store, to
+ * enumerate and to serve over HTTP, so ostree_repo_pack_objects() moves them
+ * into a single append-only data file plus a sorted index which is mmap()ed
+ * and binary searched on lookup.
+ *
+ * Packs are immutable once written; removing objects (see prune) writes a new
+ * pack holding the remaining objects and then deletes the old one.  Commit
+ * and detached metadata objects are never packed, since several code paths
+ * (listing commits, partial state, tombstones) only look at loose objects.
+ */
+
+typedef struct
+{
+  char *name;       /* Checksum of the pack data */
+  GVariant *index;  /* _OSTREE_PACK_INDEX_GVARIANT_FORMAT */
+  GVariant *entries; /* a(ayytt) */
+  GBytes *data;     /* Contents of the pack, usually mmap()ed */
+} OstreeRepoPack;
+
+static void
+pack_free (OstreeRepoPack *pack)
+{
+  g_free (pack->name);
+  g_clear_pointer (&pack->entries, g_variant_unref);
+  g_clear_pointer (&pack->index, g_variant_unref);
+  g_clear_pointer (&pack->data, g_bytes_unref);
+  g_free (pack);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (OstreeRepoPack, pack_free)
+
+/* An object to be written into a new pack */
+typedef struct
+{
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  OstreeObjectType objtype;
+  GBytes *data; /* If %NULL, read from the loose object */
+  guint64 offset;
+  guint64 size;
+} PackWriteEntry;
+
+static void
+pack_write_entry_free (PackWriteEntry *entry)
+{
+  g_clear_pointer (&entry->data, g_bytes_unref);
+  g_free (entry);
+}
+
+static PackWriteEntry *
+pack_write_entry_new (const char *checksum, OstreeObjectType objtype, GBytes *data)
+{
+  PackWriteEntry *entry = g_new0 (PackWriteEntry, 1);
+  memcpy (entry->checksum, checksum, OSTREE_SHA256_STRING_LEN);
+  entry->objtype = objtype;
+  entry->data = data ? g_bytes_ref (data) : NULL;
+  return entry;
+}
+
+static inline gboolean
+objtype_is_packable (OstreeObjectType objtype)
+{
+  switch (objtype)
+    {
+    case OSTREE_OBJECT_TYPE_FILE:
+    case OSTREE_OBJECT_TYPE_DIR_TREE:
+    case OSTREE_OBJECT_TYPE_DIR_META:
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+/* Order of the objects in the pack data: metadata first, so a client walking
+ * a commit can fetch it in few contiguous ranges, then content.
+ */
+static int
+compare_pack_data_order (gconstpointer a, gconstpointer b)
+{
+  const PackWriteEntry *entry_a = *(const PackWriteEntry **)a;
+  const PackWriteEntry *entry_b = *(const PackWriteEntry **)b;
+  gboolean a_is_meta = OSTREE_OBJECT_TYPE_IS_META (entry_a->objtype);
+  gboolean b_is_meta = OSTREE_OBJECT_TYPE_IS_META (entry_b->objtype);
+
+  if (a_is_meta != b_is_meta)
+    return a_is_meta ? -1 : 1;
+  int c = strcmp (entry_a->checksum, entry_b->checksum);
+  if (c != 0)
+    return c;
+  return (int)entry_a->objtype - (int)entry_b->objtype;
+}
+
+/* Order of the index entries; lowercase hex sorts the same as the raw bytes */
+static int
+compare_pack_index_order (gconstpointer a, gconstpointer b)
+{
+  const PackWriteEntry *entry_a = *(const PackWriteEntry **)a;
+  const PackWriteEntry *entry_b = *(const PackWriteEntry **)b;
+  int c = strcmp (entry_a->checksum, entry_b->checksum);
+  if (c != 0)
+    return c;
+  return (int)entry_a->objtype - (int)entry_b->objtype;
+}
+
+static gboolean
+load_one_pack (int pack_dfd, const char *name, OstreeRepoPack **out_pack, GError **error)
+{
+  g_autofree char *index_path = g_strconcat (name, ".index", NULL);
+  g_autofree char *data_path = g_strconcat (name, ".pack", NULL);
+  GLNX_AUTO_PREFIX_ERROR ("Loading pack", error);
+
+  g_autoptr (OstreeRepoPack) pack = g_new0 (OstreeRepoPack, 1);
+  pack->name = g_strdup (name);
+
+  glnx_autofd int index_fd = -1;
+  if (!glnx_openat_rdonly (pack_dfd, index_path, TRUE, &index_fd, error))
+    return FALSE;
+  if (!ot_variant_read_fd (index_fd, 0, _OSTREE_PACK_INDEX_GVARIANT_FORMAT, FALSE, &pack->index,
+                           error))
+    return FALSE;
+  pack->entries = g_variant_get_child_value (pack->index, 1);
+
+  glnx_autofd int data_fd = -1;
+  if (!glnx_openat_rdonly (pack_dfd, data_path, TRUE, &data_fd, error))
+    return FALSE;
+  pack->data = ot_fd_readall_or_mmap (data_fd, 0, error);
+  if (!pack->data)
+    return FALSE;
+
+  *out_pack = g_steal_pointer (&pack);
+  return TRUE;
+}
+
+/* Ensure self->packs is loaded; if @recheck is set and we haven't looked
+ * recently, pick up packs written by other processes.  Called with
+ * pack_lock held.
+ */
+static gboolean
+ensure_packs_locked (OstreeRepo *self, gboolean recheck, GError **error)
+{
+  const gint64 now = g_get_monotonic_time ();
+
+  if (self->packs != NULL && (!recheck || now - self->packs_checked_time < G_USEC_PER_SEC))
+    return TRUE;
+  self->packs_checked_time = now;
+
+  struct stat stbuf;
+  if (!glnx_fstatat_allow_noent (self->objects_dir_fd, _OSTREE_PACK_DIR, &stbuf, 0, error))
+    return FALSE;
+  struct timespec mtime = {
+    0,
+  };
+  if (errno == 0)
+    mtime = stbuf.st_mtim;
+
+  if (self->packs != NULL && mtime.tv_sec == self->packs_dir_mtime.tv_sec
+      && mtime.tv_nsec == self->packs_dir_mtime.tv_nsec)
+    return TRUE;
+
+  g_autoptr (GPtrArray) packs = g_ptr_array_new_with_free_func ((GDestroyNotify)pack_free);
+  g_auto (GLnxDirFdIterator) dfd_iter = {
+    0,
+  };
+  gboolean exists = FALSE;
+  if (!ot_dfd_iter_init_allow_noent (self->objects_dir_fd, _OSTREE_PACK_DIR, &dfd_iter, &exists,
+                                     error))
+    return FALSE;
+  while (exists)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, NULL, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+
+      /* The index is written last, so it marks a complete pack */
+      if (!g_str_has_suffix (dent->d_name, ".index"))
+        continue;
+      g_autofree char *name = g_strndup (dent->d_name, strlen (dent->d_name) - strlen (".index"));
+      if (!ostree_validate_checksum_string (name, NULL))
+        continue;
+
+      OstreeRepoPack *pack = NULL;
+      if (!load_one_pack (dfd_iter.fd, name, &pack, error))
+        return FALSE;
+      g_ptr_array_add (packs, pack);
+    }
+
+  g_clear_pointer (&self->packs, g_ptr_array_unref);
+  self->packs = g_steal_pointer (&packs);
+  self->packs_dir_mtime = mtime;
+  return TRUE;
+}
+
+/* Return a reference to the current set of packs, which stays valid even
+ * if they are reloaded concurrently.
+ */
+static gboolean
+get_packs (OstreeRepo *self, gboolean recheck, GPtrArray **out_packs, GError **error)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->pack_lock);
+
+  if (!ensure_packs_locked (self, recheck, error))
+    return FALSE;
+
+  *out_packs = g_ptr_array_ref (self->packs);
+  return TRUE;
+}
+
+/* Returns: (transfer full) (nullable): A copy of the object names queued by
+ * _ostree_repo_pack_queue_removal(), if any
+ */
+static GHashTable *
+copy_pending_removals (OstreeRepo *self)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->pack_lock);
+  if (self->packs_pending_removal == NULL)
+    return NULL;
+  GHashTable *ret = ostree_repo_traverse_new_reachable ();
+  GLNX_HASH_TABLE_FOREACH (self->packs_pending_removal, GVariant *, key)
+    g_hash_table_add (ret, g_variant_ref (key));
+  return ret;
+}
+
+static gboolean
+pack_removal_pending (OstreeRepo *self, const char *checksum, OstreeObjectType objtype)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->pack_lock);
+  if (self->packs_pending_removal == NULL)
+    return FALSE;
+  g_autoptr (GVariant) key = g_variant_ref_sink (ostree_object_name_serialize (checksum, objtype));
+  return g_hash_table_contains (self->packs_pending_removal, key);
+}
+
+static gboolean
+pack_find_entry (OstreeRepoPack *pack, const guint8 *csum, OstreeObjectType objtype,
+                 guint64 *out_offset, guint64 *out_size)
+{
+  gsize lo = 0;
+  gsize hi = g_variant_n_children (pack->entries);
+
+  while (lo < hi)
+    {
+      gsize mid = lo + (hi - lo) / 2;
+      g_autoptr (GVariant) entry_csum_v = NULL;
+      guint8 entry_objtype;
+      guint64 offset, size;
+      g_variant_get_child (pack->entries, mid, "(@ayytt)", &entry_csum_v, &entry_objtype, &offset,
+                           &size);
+      const guchar *entry_csum = ostree_checksum_bytes_peek (entry_csum_v);
+      if (entry_csum == NULL)
+        return FALSE;
+
+      int c = memcmp (csum, entry_csum, OSTREE_SHA256_DIGEST_LEN);
+      if (c == 0)
+        c = (int)objtype - (int)entry_objtype;
+      if (c < 0)
+        hi = mid;
+      else if (c > 0)
+        lo = mid + 1;
+      else
+        {
+          *out_offset = offset;
+          *out_size = size;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static gboolean
+packs_lookup (GPtrArray *packs, const guint8 *csum, OstreeObjectType objtype,
+              OstreeRepoPack **out_pack, guint64 *out_offset, guint64 *out_size)
+{
+  for (guint i = 0; i < packs->len; i++)
+    {
+      OstreeRepoPack *pack = packs->pdata[i];
+      if (pack_find_entry (pack, csum, objtype, out_offset, out_size))
+        {
+          *out_pack = pack;
+          return TRUE;
+        }
+    }
+  return FALSE;
+}
+
+static GBytes *
+pack_get_object_data (OstreeRepoPack *pack, guint64 offset, guint64 size, GError **error)
+{
+  gsize pack_size = g_bytes_get_size (pack->data);
+  if (offset > pack_size || size > pack_size - offset)
+    return glnx_null_throw (error, "Corrupted pack %s: object at %" G_GUINT64_FORMAT
+                                   " of size %" G_GUINT64_FORMAT " is out of bounds",
+                            pack->name, offset, size);
+  return g_bytes_new_from_bytes (pack->data, offset, size);
+}
+
+/*
+ * _ostree_repo_pack_lookup:
+ * @out_found: Set to %TRUE if the object is in a pack file
+ * @out_data: (out) (optional): The stored object, identical to the loose archive object
+ *
+ * Look up an object in the pack files of @self.  Repositories in modes other
+ * than archive never have packs.
+ */
+gboolean
+_ostree_repo_pack_lookup (OstreeRepo *self, const char *checksum, OstreeObjectType objtype,
+                          gboolean *out_found, GBytes **out_data, GError **error)
+{
+  *out_found = FALSE;
+  if (out_data)
+    *out_data = NULL;
+
+  if (self->mode != OSTREE_REPO_MODE_ARCHIVE || !objtype_is_packable (objtype))
+    return TRUE;
+
+  guint8 csum[OSTREE_SHA256_DIGEST_LEN];
+  ostree_checksum_inplace_to_bytes (checksum, csum);
+
+  g_autoptr (GPtrArray) packs = NULL;
+  if (!get_packs (self, FALSE, &packs, error))
+    return FALSE;
+
+  OstreeRepoPack *pack = NULL;
+  guint64 offset, size;
+  if (!packs_lookup (packs, csum, objtype, &pack, &offset, &size))
+    {
+      /* It may have been packed by another process since we last looked */
+      g_autoptr (GPtrArray) new_packs = NULL;
+      if (!get_packs (self, TRUE, &new_packs, error))
+        return FALSE;
+      if (new_packs == packs || !packs_lookup (new_packs, csum, objtype, &pack, &offset, &size))
+        return TRUE;
+      g_ptr_array_unref (packs);
+      packs = g_steal_pointer (&new_packs);
+    }
+
+  if (pack_removal_pending (self, checksum, objtype))
+    return TRUE;
+
+  if (out_data)
+    {
+      *out_data = pack_get_object_data (pack, offset, size, error);
+      if (!*out_data)
+        return FALSE;
+    }
+
+  *out_found = TRUE;
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_list_packed_objects:
+ *
+ * Add all objects stored in pack files to @inout_objects.  Loose objects
+ * already present keep their entry; if @with_values is set, packed objects
+ * get the value (FALSE, [pack name]).
+ */
+gboolean
+_ostree_repo_list_packed_objects (OstreeRepo *self, gboolean with_values,
+                                  GHashTable *inout_objects, GCancellable *cancellable,
+                                  GError **error)
+{
+  if (self->mode != OSTREE_REPO_MODE_ARCHIVE)
+    return TRUE;
+
+  g_autoptr (GPtrArray) packs = NULL;
+  if (!get_packs (self, TRUE, &packs, error))
+    return FALSE;
+  g_autoptr (GHashTable) pending = copy_pending_removals (self);
+
+  for (guint i = 0; i < packs->len; i++)
+    {
+      OstreeRepoPack *pack = packs->pdata[i];
+      const char *pack_names[] = { pack->name, NULL };
+      g_autoptr (GVariant) value = NULL;
+      if (with_values)
+        value = g_variant_ref_sink (
+            g_variant_new ("(b@as)", FALSE, g_variant_new_strv (pack_names, -1)));
+
+      const gsize n_entries = g_variant_n_children (pack->entries);
+      for (gsize j = 0; j < n_entries; j++)
+        {
+          g_autoptr (GVariant) csum_v = NULL;
+          guint8 objtype;
+          g_variant_get_child (pack->entries, j, "(@ayytt)", &csum_v, &objtype, NULL, NULL);
+          const guchar *csum = ostree_checksum_bytes_peek_validate (csum_v, error);
+          if (!csum)
+            return glnx_prefix_error (error, "Corrupted pack %s", pack->name);
+
+          char checksum[OSTREE_SHA256_STRING_LEN + 1];
+          ostree_checksum_inplace_from_bytes (csum, checksum);
+          g_autoptr (GVariant) key
+              = g_variant_ref_sink (ostree_object_name_serialize (checksum, objtype));
+          if (g_hash_table_contains (inout_objects, key)
+              || (pending && g_hash_table_contains (pending, key)))
+            continue;
+          g_hash_table_insert (inout_objects, g_steal_pointer (&key),
+                               value ? g_variant_ref (value) : NULL);
+        }
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_pack_queue_removal:
+ *
+ * Remove a packed object when the current transaction is committed, so that
+ * each pack is rewritten once however many of its objects are deleted.  The
+ * object is no longer found in the meantime.
+ */
+void
+_ostree_repo_pack_queue_removal (OstreeRepo *self, const char *checksum, OstreeObjectType objtype)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->pack_lock);
+  if (self->packs_pending_removal == NULL)
+    self->packs_pending_removal = ostree_repo_traverse_new_reachable ();
+  g_hash_table_add (self->packs_pending_removal,
+                    g_variant_ref_sink (ostree_object_name_serialize (checksum, objtype)));
+}
+
+/* Remove the objects queued by _ostree_repo_pack_queue_removal() */
+gboolean
+_ostree_repo_pack_flush_removals (OstreeRepo *self, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GHashTable) pending = copy_pending_removals (self);
+  if (pending == NULL)
+    return TRUE;
+
+  g_autoptr (OstreeRepoAutoLock) lock
+      = ostree_repo_auto_lock_push (self, OSTREE_REPO_LOCK_EXCLUSIVE, cancellable, error);
+  if (!lock)
+    return FALSE;
+  if (!_ostree_repo_pack_remove_objects (self, pending, cancellable, error))
+    return FALSE;
+
+  _ostree_repo_pack_discard_removals (self);
+  return TRUE;
+}
+
+/* Forget the objects queued by _ostree_repo_pack_queue_removal() */
+void
+_ostree_repo_pack_discard_removals (OstreeRepo *self)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->pack_lock);
+  g_clear_pointer (&self->packs_pending_removal, g_hash_table_unref);
+}
+
+static int
+compare_pack_names (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const char **)a, *(const char **)b);
+}
+
+/*
+ * _ostree_repo_list_pack_names:
+ *
+ * Returns: (transfer full): The names of the packs in @self as a sorted `as`
+ */
+GVariant *
+_ostree_repo_list_pack_names (OstreeRepo *self, GError **error)
+{
+  g_autoptr (GPtrArray) names = g_ptr_array_new ();
+
+  g_autoptr (GPtrArray) packs = NULL;
+  if (self->mode == OSTREE_REPO_MODE_ARCHIVE)
+    {
+      if (!get_packs (self, TRUE, &packs, error))
+        return NULL;
+      for (guint i = 0; i < packs->len; i++)
+        g_ptr_array_add (names, ((OstreeRepoPack *)packs->pdata[i])->name);
+    }
+
+  g_ptr_array_sort (names, compare_pack_names);
+  return g_variant_ref_sink (
+      g_variant_new_strv ((const char *const *)names->pdata, names->len));
+}
+
+void
+_ostree_repo_packs_clear (OstreeRepo *self)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->pack_lock);
+
+  g_clear_pointer (&self->packs, g_ptr_array_unref);
+  self->packs_checked_time = 0;
+  memset (&self->packs_dir_mtime, 0, sizeof (self->packs_dir_mtime));
+}
+
+static gboolean
+write_pack (OstreeRepo *self, GPtrArray *entries, char **out_name, GCancellable *cancellable,
+            GError **error)
+{
+  GLNX_AUTO_PREFIX_ERROR ("Writing pack", error);
+
+  g_auto (GLnxTmpfile) data_tmpf = {
+    0,
+  };
+  if (!glnx_open_tmpfile_linkable_at (self->tmp_dir_fd, ".", O_WRONLY | O_CLOEXEC, &data_tmpf,
+                                      error))
+    return FALSE;
+
+  g_ptr_array_sort (entries, compare_pack_data_order);
+
+  g_auto (OtChecksum) checksum = {
+    0,
+  };
+  ot_checksum_init (&checksum);
+  guint64 offset = 0;
+  for (guint i = 0; i < entries->len; i++)
+    {
+      PackWriteEntry *entry = entries->pdata[i];
+      g_autoptr (GBytes) data = entry->data ? g_bytes_ref (entry->data) : NULL;
+
+      if (data == NULL)
+        {
+          char loose_path[_OSTREE_LOOSE_PATH_MAX];
+          _ostree_loose_path (loose_path, entry->checksum, entry->objtype, self->mode);
+          glnx_autofd int fd = -1;
+          if (!glnx_openat_rdonly (self->objects_dir_fd, loose_path, FALSE, &fd, error))
+            return FALSE;
+          data = ot_fd_readall_or_mmap (fd, 0, error);
+          if (!data)
+            return FALSE;
+        }
+
+      gsize len;
+      const guint8 *buf = g_bytes_get_data (data, &len);
+      if (glnx_loop_write (data_tmpf.fd, buf, len) < 0)
+        return glnx_throw_errno_prefix (error, "write");
+      ot_checksum_update (&checksum, buf, len);
+
+      entry->offset = offset;
+      entry->size = len;
+      offset += len;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+    }
+
+  char name[OSTREE_SHA256_STRING_LEN + 1];
+  ot_checksum_get_hexdigest (&checksum, name, sizeof (name));
+
+  g_ptr_array_sort (entries, compare_pack_index_order);
+
+  g_autoptr (GVariantBuilder) entries_builder = g_variant_builder_new (G_VARIANT_TYPE ("a(ayytt)"));
+  for (guint i = 0; i < entries->len; i++)
+    {
+      PackWriteEntry *entry = entries->pdata[i];
+      g_variant_builder_add (entries_builder, "(@ayytt)",
+                             ostree_checksum_to_bytes_v (entry->checksum), (guint8)entry->objtype,
+                             entry->offset, entry->size);
+    }
+  g_autoptr (GVariantBuilder) metadata_builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (metadata_builder, "{sv}", _OSTREE_PACK_META_KEY_SIZE,
+                         g_variant_new_uint64 (offset));
+  g_autoptr (GVariant) index = g_variant_ref_sink (g_variant_new (
+      "(@a{sv}@a(ayytt))", g_variant_builder_end (metadata_builder),
+      g_variant_builder_end (entries_builder)));
+
+  g_auto (GLnxTmpfile) index_tmpf = {
+    0,
+  };
+  if (!glnx_open_tmpfile_linkable_at (self->tmp_dir_fd, ".", O_WRONLY | O_CLOEXEC, &index_tmpf,
+                                      error))
+    return FALSE;
+  if (glnx_loop_write (index_tmpf.fd, g_variant_get_data (index), g_variant_get_size (index)) < 0)
+    return glnx_throw_errno_prefix (error, "write");
+
+  if (!self->disable_fsync)
+    {
+      if (fsync (data_tmpf.fd) < 0)
+        return glnx_throw_errno_prefix (error, "fsync");
+      if (fsync (index_tmpf.fd) < 0)
+        return glnx_throw_errno_prefix (error, "fsync");
+    }
+
+  if (!glnx_shutil_mkdir_p_at (self->objects_dir_fd, _OSTREE_PACK_DIR, DEFAULT_DIRECTORY_MODE,
+                               cancellable, error))
+    return FALSE;
+  glnx_autofd int pack_dfd = -1;
+  if (!glnx_opendirat (self->objects_dir_fd, _OSTREE_PACK_DIR, TRUE, &pack_dfd, error))
+    return FALSE;
+
+  /* The data must be in place before the index makes the pack visible */
+  g_autofree char *data_path = g_strconcat (name, ".pack", NULL);
+  g_autofree char *index_path = g_strconcat (name, ".index", NULL);
+  if (!glnx_link_tmpfile_at (&data_tmpf, GLNX_LINK_TMPFILE_REPLACE, pack_dfd, data_path, error))
+    return FALSE;
+  if (!glnx_link_tmpfile_at (&index_tmpf, GLNX_LINK_TMPFILE_REPLACE, pack_dfd, index_path, error))
+    return FALSE;
+
+  if (!self->disable_fsync && fsync (pack_dfd) < 0)
+    return glnx_throw_errno_prefix (error, "fsync");
+
+  *out_name = g_strdup (name);
+  return TRUE;
+}
+
+/*
+ * _ostree_repo_pack_remove_objects:
+ * @objects: (element-type GVariant): Object names to remove
+ *
+ * Remove @objects from the pack files which contain them, by writing a new
+ * pack holding the rest of the objects of each affected pack.  Packs left
+ * without any objects are deleted.  The caller should hold an exclusive lock.
+ *
+ * Packs are never modified in place, so this copies all of the kept data of
+ * each affected pack.  The new pack is synced before the old index and then
+ * the old data are unlinked; after a crash the old pack may still be there,
+ * which only means its objects are found twice until the next prune.
+ */
+gboolean
+_ostree_repo_pack_remove_objects (OstreeRepo *self, GHashTable *objects,
+                                  GCancellable *cancellable, GError **error)
+{
+  if (self->mode != OSTREE_REPO_MODE_ARCHIVE)
+    return TRUE;
+
+  g_autoptr (GPtrArray) packs = NULL;
+  if (!get_packs (self, TRUE, &packs, error))
+    return FALSE;
+
+  gboolean changed = FALSE;
+  for (guint i = 0; i < packs->len; i++)
+    {
+      OstreeRepoPack *pack = packs->pdata[i];
+      g_autoptr (GPtrArray) keep
+          = g_ptr_array_new_with_free_func ((GDestroyNotify)pack_write_entry_free);
+      guint n_removed = 0;
+
+      const gsize n_entries = g_variant_n_children (pack->entries);
+      for (gsize j = 0; j < n_entries; j++)
+        {
+          g_autoptr (GVariant) csum_v = NULL;
+          guint8 objtype;
+          guint64 offset, size;
+          g_variant_get_child (pack->entries, j, "(@ayytt)", &csum_v, &objtype, &offset, &size);
+          const guchar *csum = ostree_checksum_bytes_peek_validate (csum_v, error);
+          if (!csum)
+            return glnx_prefix_error (error, "Corrupted pack %s", pack->name);
+
+          char checksum[OSTREE_SHA256_STRING_LEN + 1];
+          ostree_checksum_inplace_from_bytes (csum, checksum);
+          g_autoptr (GVariant) key
+              = g_variant_ref_sink (ostree_object_name_serialize (checksum, objtype));
+          if (g_hash_table_contains (objects, key))
+            {
+              _ostree_repo_metadata_cache_remove (self->metadata_cache, objtype, checksum);
+              n_removed++;
+              continue;
+            }
+
+          g_autoptr (GBytes) data = pack_get_object_data (pack, offset, size, error);
+          if (!data)
+            return FALSE;
+          g_ptr_array_add (keep, pack_write_entry_new (checksum, objtype, data));
+        }
+
+      if (n_removed == 0)
+        continue;
+
+      g_debug ("Removing %u objects from pack %s", n_removed, pack->name);
+
+      if (keep->len > 0)
+        {
+          g_autofree char *new_name = NULL;
+          if (!write_pack (self, keep, &new_name, cancellable, error))
+            return FALSE;
+        }
+
+      glnx_autofd int pack_dfd = -1;
+      if (!glnx_opendirat (self->objects_dir_fd, _OSTREE_PACK_DIR, TRUE, &pack_dfd, error))
+        return FALSE;
+      g_autofree char *index_path = g_strconcat (pack->name, ".index", NULL);
+      g_autofree char *data_path = g_strconcat (pack->name, ".pack", NULL);
+      if (!ot_ensure_unlinked_at (pack_dfd, index_path, error))
+        return FALSE;
+      if (!ot_ensure_unlinked_at (pack_dfd, data_path, error))
+        return FALSE;
+      changed = TRUE;
+    }
+
+  if (changed)
+    _ostree_repo_packs_clear (self);
+
+  return TRUE;
+}
+
+/**
+ * ostree_repo_pack_objects:
+ * @self: Repo
+ * @out_n_packed: (out) (optional): Number of objects moved into the new pack
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Move the loose directory and content objects of an archive repository into
+ * a new pack file under `objects/pack`.  Objects in pack files are still
+ * found by all object APIs such as ostree_repo_has_object(),
+ * ostree_repo_load_variant() and ostree_repo_load_file(), and are removed by
+ * ostree_repo_prune() when unreachable.  Commit objects are always kept loose.
+ *
+ * Only clients which understand pack files can pull objects stored in them
+ * over HTTP; a summary regenerated after packing lists the packs in its
+ * `ostree.summary.packs` metadata key.
+ *
+ * Packs are append-only: once written, a pack is never modified.  When
+ * ostree_repo_prune() deletes packed objects, each affected pack is rewritten
+ * in full without them and the old pack is deleted, so pruning a few objects
+ * from a large pack costs as much I/O as the size of the pack.  This is crash
+ * safe: the old pack is only deleted once the new one is on disk.
+ *
+ * Locking: exclusive
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_pack_objects (OstreeRepo *self, guint *out_n_packed, GCancellable *cancellable,
+                          GError **error)
+{
+  if (self->mode != OSTREE_REPO_MODE_ARCHIVE)
+    return glnx_throw (error, "Pack files are only supported in archive repositories");
+
+  g_autoptr (OstreeRepoAutoLock) lock
+      = ostree_repo_auto_lock_push (self, OSTREE_REPO_LOCK_EXCLUSIVE, cancellable, error);
+  if (!lock)
+    return FALSE;
+
+  g_autoptr (GHashTable) objects = ostree_repo_list_objects_set (
+      self, OSTREE_REPO_LIST_OBJECTS_LOOSE | OSTREE_REPO_LIST_OBJECTS_NO_PARENTS, cancellable,
+      error);
+  if (!objects)
+    return FALSE;
+
+  g_autoptr (GPtrArray) entries
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)pack_write_entry_free);
+  g_autoptr (GPtrArray) already_packed = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (objects, GVariant *, key)
+    {
+      const char *checksum;
+      OstreeObjectType objtype;
+      ostree_object_name_deserialize (key, &checksum, &objtype);
+      if (!objtype_is_packable (objtype))
+        continue;
+
+      /* Chunked objects are large, and have no loose object to pack */
+      gboolean is_chunked = FALSE;
+      if (objtype == OSTREE_OBJECT_TYPE_FILE
+          && !_ostree_repo_chunked_file_lookup (self, checksum, &is_chunked, NULL, error))
+        return FALSE;
+      if (is_chunked)
+        continue;
+
+      gboolean is_packed = FALSE;
+      if (!_ostree_repo_pack_lookup (self, checksum, objtype, &is_packed, NULL, error))
+        return FALSE;
+      if (is_packed)
+        g_ptr_array_add (already_packed, key);
+      else
+        g_ptr_array_add (entries, pack_write_entry_new (checksum, objtype, NULL));
+    }
+
+  const guint n_packed = entries->len;
+  if (entries->len > 0)
+    {
+      g_autofree char *name = NULL;
+      if (!write_pack (self, entries, &name, cancellable, error))
+        return FALSE;
+      g_debug ("Wrote pack %s with %u objects", name, entries->len);
+      _ostree_repo_packs_clear (self);
+    }
+
+  /* The pack is durable at this point, drop the loose copies */
+  for (guint i = 0; i < entries->len; i++)
+    {
+      PackWriteEntry *entry = entries->pdata[i];
+      char loose_path[_OSTREE_LOOSE_PATH_MAX];
+      _ostree_loose_path (loose_path, entry->checksum, entry->objtype, self->mode);
+      if (!ot_ensure_unlinked_at (self->objects_dir_fd, loose_path, error))
+        return FALSE;
+    }
+  for (guint i = 0; i < already_packed->len; i++)
+    {
+      const char *checksum;
+      OstreeObjectType objtype;
+      ostree_object_name_deserialize (already_packed->pdata[i], &checksum, &objtype);
+      char loose_path[_OSTREE_LOOSE_PATH_MAX];
+      _ostree_loose_path (loose_path, checksum, objtype, self->mode);
+      if (!ot_ensure_unlinked_at (self->objects_dir_fd, loose_path, error))
+        return FALSE;
+    }
+
+  if (out_n_packed)
+    *out_n_packed = n_packed;
+  return TRUE;
+}
@@ -33,7 +33,12 @@ G_BEGIN_DECLS
 #define _OSTREE_SUMMARY_CACHE_DIR "summaries"
 #define _OSTREE_CACHE_DIR "cache"
 
+/* By default we apply about one delta part per CPU, but at least this many,
+ * and no more than the maximum; each part being applied can use a fair
+ * amount of memory and disk space.
+ */
 #define _OSTREE_MAX_OUTSTANDING_DELTAPART_REQUESTS 2
+#define _OSTREE_MAX_OUTSTANDING_DELTAPART_REQUESTS_AUTO_MAX 8
 
 /* We want some parallelism with disk writes, but we also
  * want to avoid starting tens or hundreds of threads
@@ -55,6 +60,117 @@ G_BEGIN_DECLS
 #define OSTREE_SUMMARY_MODE "ostree.summary.mode"
 #define OSTREE_SUMMARY_TOMBSTONE_COMMITS "ostree.summary.tombstone-commits"
 #define OSTREE_SUMMARY_INDEXED_DELTAS "ostree.summary.indexed-deltas"
+#define OSTREE_SUMMARY_PACKS "ostree.summary.packs"
+#define OSTREE_SUMMARY_DIFFS "ostree.summary.diffs"
+#define OSTREE_SUMMARY_CHUNKED_FILES "ostree.summary.chunked-files"
+
+/* A summary index lists shards of the summary, each holding a range of its
+ * refs, so that clients can fetch only the refs they need; see
+ * ostree-repo-summary-index.c.  It is signed like the summary, and is:
+ *
+ * a(sssay) - Shards sorted by (collection ID, first ref): collection ID, or
+ *            "" for the main refs, first and last ref in the shard, and the
+ *            SHA-256 of the shard
+ * a{sv} - The additional metadata of the summary, without the collection
+ *         map, and with _OSTREE_SUMMARY_INDEX_KEY
+ *
+ * Each shard is a summary (OSTREE_SUMMARY_GVARIANT_FORMAT) with only those
+ * refs and no other metadata, stored in summary-shards/ named by its SHA-256.
+ */
+#define _OSTREE_SUMMARY_INDEX "summary.idx"
+/* Index metadata key: b - always true.  The index is signed with the same
+ * keys as the summary, so this tells the two apart.
+ */
+#define _OSTREE_SUMMARY_INDEX_KEY "ostree.summary-index"
+#define _OSTREE_SUMMARY_SHARDS_DIR "summary-shards"
+#define _OSTREE_SUMMARY_INDEX_GVARIANT_STRING "(a(sssay)a{sv})"
+#define _OSTREE_SUMMARY_INDEX_GVARIANT_FORMAT G_VARIANT_TYPE (_OSTREE_SUMMARY_INDEX_GVARIANT_STRING)
+
+/* Diffs between summaries live in summary-diffs/, each named by the SHA-256
+ * of the summary it applies to; see ostree-repo-summary-diff.c.  They are:
+ *
+ * ay - SHA-256 of the summary the diff applies to
+ * ay - SHA-256 of the summary it results in
+ * u - Number of summary updates the diff spans
+ * a(sa(s(taya{sv}))as) - Per collection ID ("" for the main refs), sorted:
+ *                        the added or changed refs, and the removed ref names
+ * a{smv} - The metadata of the resulting summary, in its order; values which
+ *          are unchanged, and the collection map, are Nothing
+ */
+#define _OSTREE_SUMMARY_DIFFS_DIR "summary-diffs"
+#define _OSTREE_SUMMARY_DIFF_GVARIANT_STRING "(ayayua(sa(s(taya{sv}))as)a{smv})"
+#define _OSTREE_SUMMARY_DIFF_GVARIANT_FORMAT G_VARIANT_TYPE (_OSTREE_SUMMARY_DIFF_GVARIANT_STRING)
+
+/* Pack files live in objects/pack as <checksum>.pack, where the checksum
+ * covers the pack data, alongside a <checksum>.index describing it.
+ * The index is:
+ *
+ * a{sv} - Metadata
+ * a(ayytt) - Entries sorted by (checksum, objtype): checksum, objtype,
+ *            offset and size of the object data within the pack.
+ *
+ * The object data is byte-for-byte identical to the loose archive object.
+ */
+#define _OSTREE_PACK_DIR "pack"
+/* Index metadata key: t - size of the pack data */
+#define _OSTREE_PACK_META_KEY_SIZE "ostree.pack.size"
+#define _OSTREE_PACK_INDEX_GVARIANT_STRING "(a{sv}a(ayytt))"
+#define _OSTREE_PACK_INDEX_GVARIANT_FORMAT G_VARIANT_TYPE (_OSTREE_PACK_INDEX_GVARIANT_STRING)
+
+/* Chunked file objects store large content objects of archive repositories
+ * as chunks in objects/chunks/$xx/$rest.chunk, each named by the SHA-256 of
+ * its data and raw deflate compressed like .filez objects, plus a descriptor
+ * objects/$xx/$rest.filechunks in place of the .filez, which is:
+ *
+ * t - Big-endian size of the file content
+ * u - Big-endian uid
+ * u - Big-endian gid
+ * u - Big-endian mode
+ * a(ayay) - Extended attributes
+ * a(ayt) - Chunks in content order: SHA-256 and big-endian size of the data
+ */
+#define _OSTREE_CHUNK_DIR "chunks"
+#define _OSTREE_CHUNKED_FILE_GVARIANT_STRING "(tuuua(ayay)a(ayt))"
+#define _OSTREE_CHUNKED_FILE_GVARIANT_FORMAT G_VARIANT_TYPE (_OSTREE_CHUNKED_FILE_GVARIANT_STRING)
+
+/* The prune index caches object reachability between prunes; see
+ * ostree-repo-prune-index.c.  It is:
+ *
+ * u - Big-endian format version
+ * a(ayayay) - Root commits sorted by checksum: commit checksum, root dirtree
+ *             and root dirmeta checksums
+ * ay - Fixed-size records sorted by (checksum, objtype): binary checksum,
+ *      objtype byte and big-endian 32 bit reference count
+ */
+#define _OSTREE_PRUNE_INDEX_PATH "state/prune-index"
+#define _OSTREE_PRUNE_INDEX_GVARIANT_STRING "(ua(ayayay)ay)"
+#define _OSTREE_PRUNE_INDEX_GVARIANT_FORMAT G_VARIANT_TYPE (_OSTREE_PRUNE_INDEX_GVARIANT_STRING)
+
+/* The summary state caches what summary regeneration read from commits and
+ * delta superblocks; see ostree-repo-summary-state.c.  It is:
+ *
+ * u - Big-endian format version
+ * a(ayta{sv}) - Commits sorted by checksum: binary checksum, big-endian
+ *               object size, and metadata for the summary entry
+ * a(stttay) - Deltas sorted by name: name, big-endian inode, size and mtime
+ *             in nanoseconds of the superblock, and its SHA-256
+ */
+#define _OSTREE_SUMMARY_STATE_PATH "state/summary-state"
+#define _OSTREE_SUMMARY_STATE_GVARIANT_STRING "(ua(ayta{sv})a(stttay))"
+#define _OSTREE_SUMMARY_STATE_GVARIANT_FORMAT G_VARIANT_TYPE (_OSTREE_SUMMARY_STATE_GVARIANT_STRING)
+
+#define _OSTREE_FSCK_JOURNAL_PATH "state/fsck-journal"
+#define _OSTREE_FSCK_JOURNAL_GVARIANT_STRING "(uay)"
+#define _OSTREE_FSCK_JOURNAL_GVARIANT_FORMAT G_VARIANT_TYPE (_OSTREE_FSCK_JOURNAL_GVARIANT_STRING)
+
+/* The fs-verity index maps content objects to the fs-verity digest they
+ * were written with; see ostree-repo-verity.c.  Each transaction adds a
+ * segment file to this directory.
+ */
+#define _OSTREE_FSVERITY_INDEX_DIR "state/fsverity"
+#define _OSTREE_FSVERITY_INDEX_GVARIANT_STRING "(uay)"
+#define _OSTREE_FSVERITY_INDEX_GVARIANT_FORMAT \
+  G_VARIANT_TYPE (_OSTREE_FSVERITY_INDEX_GVARIANT_STRING)
 
 #define _OSTREE_PAYLOAD_LINK_PREFIX "../"
 #define _OSTREE_PAYLOAD_LINK_PREFIX_LEN (sizeof (_OSTREE_PAYLOAD_LINK_PREFIX) - 1)
@@ -93,6 +209,8 @@ struct OstreeRepoCommitModifier
   GLnxTmpDir sepolicy_tmpdir;
   OstreeSePolicy *sepolicy;
   GHashTable *devino_cache;
+
+  guint n_jobs; /* See ostree_repo_commit_modifier_set_n_jobs() */
 };
 
 typedef enum
@@ -112,6 +230,9 @@ typedef struct
   gulong blocksize;
   fsblkcnt_t max_blocks;
   gboolean disable_auto_summary;
+  /* fs-verity index records for objects written in this transaction;
+   * protected by txn_lock */
+  GByteArray *fsverity_records;
 } OstreeRepoTxn;
 
 typedef struct
@@ -154,6 +275,8 @@ static const char *const CFG_SYSROOT_BOOTLOADER_OPTS_STR[] = {
   "auto", "none", "grub2", "syslinux", "uboot", "zipl", "aboot", NULL,
 };
 
+typedef struct OstreeRepoMetadataCache OstreeRepoMetadataCache;
+
 /**
  * OstreeRepo:
  *
@@ -196,6 +319,19 @@ struct OstreeRepo
   guint dirmeta_cache_refcount;
   /* char * checksum → GVariant * for dirmeta objects, used in the checkout path */
   GHashTable *dirmeta_cache;
+  /* See the metadata-cache-size config option; never NULL */
+  OstreeRepoMetadataCache *metadata_cache;
+
+  GMutex pack_lock;
+  GPtrArray *packs; /* (element-type OstreeRepoPack); NULL until loaded */
+  struct timespec packs_dir_mtime;
+  gint64 packs_checked_time; /* Monotonic time of the last objects/pack stat */
+  /* Names of packed objects deleted in the current transaction */
+  GHashTable *packs_pending_removal;
+
+  GMutex fsverity_index_lock;
+  GPtrArray *fsverity_index; /* (element-type GVariant) segments; NULL until loaded */
+  struct timespec fsverity_index_mtime;
 
   gboolean inited;
   gboolean writable;
@@ -248,6 +384,7 @@ struct OstreeRepo
       *bls_append_values;     /* Parsed key-values from bls-append-except-default key in config. */
   gboolean enable_bootprefix; /* If true, prepend bootloader entries with /boot */
   guint boot_counting;
+  guint checkout_n_jobs; /* Threads used to check out deployments */
 
   OstreeRepo *parent_repo;
 };
@@ -296,6 +433,155 @@ gboolean _ostree_repo_has_loose_object (OstreeRepo *self, const char *checksum,
                                         OstreeObjectType objtype, gboolean *out_is_stored,
                                         GCancellable *cancellable, GError **error);
 
+gboolean _ostree_repo_pack_lookup (OstreeRepo *self, const char *checksum,
+                                   OstreeObjectType objtype, gboolean *out_found,
+                                   GBytes **out_data, GError **error);
+
+gboolean _ostree_repo_list_packed_objects (OstreeRepo *self, gboolean with_values,
+                                           GHashTable *inout_objects, GCancellable *cancellable,
+                                           GError **error);
+
+gboolean _ostree_repo_pack_remove_objects (OstreeRepo *self, GHashTable *objects,
+                                           GCancellable *cancellable, GError **error);
+
+void _ostree_repo_pack_queue_removal (OstreeRepo *self, const char *checksum,
+                                      OstreeObjectType objtype);
+
+gboolean _ostree_repo_pack_flush_removals (OstreeRepo *self, GCancellable *cancellable,
+                                           GError **error);
+
+void _ostree_repo_pack_discard_removals (OstreeRepo *self);
+
+GVariant *_ostree_repo_list_pack_names (OstreeRepo *self, GError **error);
+
+void _ostree_repo_packs_clear (OstreeRepo *self);
+
+void _ostree_repo_chunked_file_path (char *buf, const char *checksum);
+
+gboolean _ostree_repo_chunked_file_lookup (OstreeRepo *self, const char *checksum,
+                                           gboolean *out_found, GVariant **out_descriptor,
+                                           GError **error);
+
+gboolean _ostree_chunked_file_validate (GVariant *descriptor, GError **error);
+
+gboolean _ostree_repo_chunked_file_parse (OstreeRepo *self, GVariant *descriptor,
+                                          GInputStream **out_input, GFileInfo **out_file_info,
+                                          GVariant **out_xattrs, GError **error);
+
+gboolean _ostree_repo_chunked_file_storage_size (OstreeRepo *self, const char *checksum,
+                                                 guint64 *out_size, GError **error);
+
+gboolean _ostree_repo_has_chunk (OstreeRepo *self, const char *digest, gboolean *out_have_chunk,
+                                 GError **error);
+
+gboolean _ostree_repo_write_chunk (OstreeRepo *self, const char *digest, guint64 size,
+                                   GBytes *compressed, GCancellable *cancellable, GError **error);
+
+gboolean _ostree_repo_write_chunked_file (OstreeRepo *self, const char *expected_checksum,
+                                          GVariant *descriptor, GCancellable *cancellable,
+                                          GError **error);
+
+gboolean _ostree_repo_prune_chunks (OstreeRepo *self, guint *out_n_pruned,
+                                    GCancellable *cancellable, GError **error);
+
+typedef struct OstreeRepoPruneIndex OstreeRepoPruneIndex;
+
+gboolean _ostree_repo_prune_index_update (OstreeRepo *self, GHashTable *commits,
+                                          gboolean persist, GHashTable *inout_reachable,
+                                          OstreeRepoPruneIndex **out_index,
+                                          GCancellable *cancellable, GError **error);
+
+gboolean _ostree_repo_prune_index_contains (OstreeRepoPruneIndex *index, const char *checksum,
+                                            OstreeObjectType objtype);
+
+void _ostree_repo_prune_index_free (OstreeRepoPruneIndex *index);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (OstreeRepoPruneIndex, _ostree_repo_prune_index_free)
+
+OstreeRepoMetadataCache *_ostree_repo_metadata_cache_new (void);
+
+void _ostree_repo_metadata_cache_free (OstreeRepoMetadataCache *cache);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (OstreeRepoMetadataCache, _ostree_repo_metadata_cache_free)
+
+gboolean _ostree_repo_metadata_cache_accepts (OstreeObjectType objtype);
+
+GVariant *_ostree_repo_metadata_cache_lookup (OstreeRepoMetadataCache *cache,
+                                              OstreeObjectType objtype, const char *checksum);
+
+void _ostree_repo_metadata_cache_insert (OstreeRepoMetadataCache *cache, OstreeObjectType objtype,
+                                         const char *checksum, GVariant *variant);
+
+void _ostree_repo_metadata_cache_remove (OstreeRepoMetadataCache *cache, OstreeObjectType objtype,
+                                         const char *checksum);
+
+void _ostree_repo_metadata_cache_set_max_size (OstreeRepoMetadataCache *cache, gsize max_size);
+
+void _ostree_repo_metadata_cache_get_stats (OstreeRepoMetadataCache *cache, guint64 *out_hits,
+                                            guint64 *out_misses, guint64 *out_evictions,
+                                            guint64 *out_size);
+
+gboolean _ostree_repo_add_gpg_signature_summary_at (OstreeRepo *self, int dir_fd,
+                                                    const gchar **key_id, const gchar *homedir,
+                                                    GCancellable *cancellable, GError **error);
+
+gboolean _ostree_repo_update_summary_index (OstreeRepo *self, GVariant *summary, int tmpdir_fd,
+                                            const char *const *gpg_key_ids,
+                                            const char *gpg_homedir, OstreeSign *sign,
+                                            GVariant *sign_keys, GCancellable *cancellable,
+                                            GError **error);
+
+gboolean _ostree_summary_check_is_index (GBytes *data, gboolean is_index, GError **error);
+
+typedef struct OstreeRepoSummaryState OstreeRepoSummaryState;
+
+gboolean _ostree_repo_summary_state_load (OstreeRepo *self, OstreeRepoSummaryState **out_state,
+                                          GError **error);
+gboolean _ostree_repo_summary_state_get_commit (OstreeRepo *self, OstreeRepoSummaryState *state,
+                                                const char *checksum, guint64 *out_size,
+                                                GVariant **out_metadata, GError **error);
+GVariant *_ostree_repo_summary_state_get_delta_digest (OstreeRepo *self,
+                                                       OstreeRepoSummaryState *state,
+                                                       const char *from, const char *to,
+                                                       GCancellable *cancellable, GError **error);
+gboolean _ostree_repo_summary_state_save (OstreeRepo *self, OstreeRepoSummaryState *state,
+                                          GCancellable *cancellable, GError **error);
+void _ostree_repo_summary_state_free (OstreeRepoSummaryState *state);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (OstreeRepoSummaryState, _ostree_repo_summary_state_free)
+
+GVariant *_ostree_summary_diff_apply (GVariant *summary, GVariant *diff, GError **error);
+
+gboolean _ostree_repo_update_summary_diffs (OstreeRepo *self, GVariant *summary,
+                                            guint max_updates, GCancellable *cancellable,
+                                            GError **error);
+
+typedef struct OstreeRepoFsckJournal OstreeRepoFsckJournal;
+
+typedef struct
+{
+  guint8 key[OSTREE_SHA256_DIGEST_LEN + 1]; /* Binary checksum and object type */
+  guint64 ino;
+  guint64 size;
+  guint64 mtime; /* Nanoseconds */
+  guint64 ctime; /* Nanoseconds */
+  guint64 verified; /* Seconds since the epoch */
+} OstreeRepoFsckJournalRecord;
+
+gboolean _ostree_repo_fsck_journal_load (OstreeRepo *self, guint64 max_age,
+                                         OstreeRepoFsckJournal **out_journal, GError **error);
+
+gboolean _ostree_repo_fsck_journal_check (OstreeRepoFsckJournal *journal, const char *checksum,
+                                          OstreeObjectType objtype,
+                                          OstreeRepoFsckJournalRecord *out_record,
+                                          gboolean *out_current, GError **error);
+
+void _ostree_repo_fsck_journal_add (OstreeRepoFsckJournal *journal,
+                                    const OstreeRepoFsckJournalRecord *record);
+
+gboolean _ostree_repo_fsck_journal_write (OstreeRepoFsckJournal *journal,
+                                          GCancellable *cancellable, GError **error);
+
+void _ostree_repo_fsck_journal_free (OstreeRepoFsckJournal *journal);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (OstreeRepoFsckJournal, _ostree_repo_fsck_journal_free)
+
 gboolean _ostree_write_bareuser_metadata (int fd, guint32 uid, guint32 gid, guint32 mode,
                                           GVariant *xattrs, GError **error);
 
@@ -360,9 +646,16 @@ gboolean _ostree_repo_import_object (OstreeRepo *self, OstreeRepo *source, Ostre
 
 gboolean _ostree_repo_commit_tmpf_final (OstreeRepo *self, const char *checksum,
                                          OstreeObjectType objtype, GLnxTmpfile *tmpf,
+                                         gboolean content_verified, GBytes *file_header,
                                          gboolean *out_existed, GCancellable *cancellable,
                                          GError **error);
 
+gboolean _ostree_repo_write_metadata_many (OstreeRepo *self, guint n_objects,
+                                           const OstreeObjectType *objtypes,
+                                           const char *const *expected_checksums,
+                                           GVariant *const *objects, guint8 *out_csums,
+                                           GCancellable *cancellable, GError **error);
+
 typedef struct
 {
   gboolean initialized;
@@ -385,6 +678,23 @@ gboolean _ostree_repo_bare_content_commit (OstreeRepo *self, OstreeRepoBareConte
                                            char *checksum_buf, size_t buflen,
                                            GCancellable *cancellable, GError **error);
 
+typedef struct OstreeRepoContentIngest OstreeRepoContentIngest;
+
+gboolean _ostree_repo_content_ingest_supported (OstreeRepo *self);
+
+OstreeRepoContentIngest *_ostree_repo_content_ingest_new (OstreeRepo *self,
+                                                          const char *expected_checksum,
+                                                          OstreeRepoImportFlags flags);
+
+gboolean _ostree_repo_content_ingest_write (OstreeRepoContentIngest *ingest, const guint8 *buf,
+                                            gsize len, GError **error);
+
+gboolean _ostree_repo_content_ingest_commit (OstreeRepoContentIngest *ingest,
+                                             GCancellable *cancellable, GError **error);
+
+void _ostree_repo_content_ingest_free (OstreeRepoContentIngest *ingest);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (OstreeRepoContentIngest, _ostree_repo_content_ingest_free)
+
 OstreeContentWriter *_ostree_content_writer_new (OstreeRepo *repo, const char *checksum, guint uid,
                                                  guint gid, guint mode, guint64 content_len,
                                                  GVariant *xattrs, GError **error);
@@ -418,6 +728,21 @@ gboolean _ostree_tmpf_fsverity (OstreeRepo *self, GLnxTmpfile *tmpf, GBytes *sig
 gboolean _ostree_ensure_fsverity (OstreeRepo *self, gboolean allow_enoent, int dirfd,
                                   const char *path, gboolean *supported, GError **error);
 
+void _ostree_repo_fsverity_record (OstreeRepo *self, int fd, const char *checksum,
+                                   GBytes *file_header);
+
+gboolean _ostree_repo_fsverity_flush (OstreeRepo *self, GCancellable *cancellable,
+                                      GError **error);
+
+gboolean _ostree_repo_fsverity_compact (OstreeRepo *self, gboolean drop_missing,
+                                        GCancellable *cancellable, GError **error);
+
+gboolean _ostree_repo_fsverity_verify_content (OstreeRepo *self, const char *checksum,
+                                               gboolean *out_verified, GCancellable *cancellable,
+                                               GError **error);
+
+void _ostree_repo_fsverity_index_clear (OstreeRepo *self);
+
 gboolean _ostree_repo_verify_bindings (const char *collection_id, const char *ref_name,
                                        GVariant *commit, GError **error);
 
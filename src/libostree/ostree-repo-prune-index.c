@@ -0,0 +1,570 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ostree-autocleanups.h"
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "otutil.h"
+
+/* The prune index caches the reachability of objects between prunes, so
+ * that a prune only needs to walk the part of the object graph that changed
+ * rather than every commit.
+ *
+ * It holds a reference count for every object reachable from a set of root
+ * commits: one for each root commit, plus one for each time the object is
+ * listed in a reachable dirtree.  Since objects are immutable, these only
+ * change when the set of roots does.  Adding a root increments its
+ * references, and when a dirtree becomes reachable we read it and increment
+ * its children in turn; removing a root does the reverse.  Shared subtrees
+ * are thus only ever read once, whether building from scratch or updating.
+ *
+ * Partial commits may lack objects, so they are never added as roots;
+ * instead they are traversed in full on each prune.  If the index turns out
+ * not to match the repository (e.g. a dirtree it needs to drop was deleted
+ * behind our back), it is rebuilt from scratch.
+ */
+
+#define INDEX_KEY_LEN (OSTREE_SHA256_DIGEST_LEN + 1)
+#define INDEX_RECORD_LEN (INDEX_KEY_LEN + sizeof (guint32))
+#define INDEX_VERSION 1
+
+/* A record is the binary checksum, the object type, and the big-endian
+ * reference count.
+ */
+typedef struct
+{
+  guint8 key[INDEX_KEY_LEN];
+} IndexKey;
+
+struct OstreeRepoPruneIndex
+{
+  OstreeRepo *repo;
+  GVariant *data;         /* _OSTREE_PRUNE_INDEX_GVARIANT_FORMAT, or %NULL */
+  const guint8 *records;  /* Sorted by key */
+  gsize n_records;
+  GHashTable *deltas;     /* Map<IndexKey,int> changes against @records */
+  GHashTable *roots;      /* Map<checksum,GVariant> of (ayay) root dirtree and dirmeta */
+};
+
+static guint
+index_key_hash (gconstpointer v)
+{
+  /* Checksums are already uniformly distributed */
+  const IndexKey *key = v;
+  guint ret;
+  memcpy (&ret, key->key, sizeof (ret));
+  return ret ^ key->key[OSTREE_SHA256_DIGEST_LEN];
+}
+
+static gboolean
+index_key_equal (gconstpointer a, gconstpointer b)
+{
+  return memcmp (a, b, INDEX_KEY_LEN) == 0;
+}
+
+static int
+compare_index_keys (gconstpointer a, gconstpointer b)
+{
+  return memcmp (*(const IndexKey **)a, *(const IndexKey **)b, INDEX_KEY_LEN);
+}
+
+static int
+compare_checksums (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const char **)a, *(const char **)b);
+}
+
+static void
+index_key_init (IndexKey *key, const char *checksum, OstreeObjectType objtype)
+{
+  ostree_checksum_inplace_to_bytes (checksum, key->key);
+  key->key[OSTREE_SHA256_DIGEST_LEN] = objtype;
+}
+
+void
+_ostree_repo_prune_index_free (OstreeRepoPruneIndex *index)
+{
+  g_clear_object (&index->repo);
+  g_clear_pointer (&index->data, g_variant_unref);
+  g_clear_pointer (&index->deltas, g_hash_table_unref);
+  g_clear_pointer (&index->roots, g_hash_table_unref);
+  g_free (index);
+}
+
+/* Drop all state, as if there was no index on disk */
+static void
+index_reset (OstreeRepoPruneIndex *index)
+{
+  g_clear_pointer (&index->data, g_variant_unref);
+  index->records = NULL;
+  index->n_records = 0;
+  g_hash_table_remove_all (index->deltas);
+  g_hash_table_remove_all (index->roots);
+}
+
+/* Load the index from disk.  Anything we can't make sense of (including
+ * an index from a future version) is treated as absent.
+ */
+static gboolean
+index_load (OstreeRepoPruneIndex *index, GError **error)
+{
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (index->repo->repo_dir_fd, _OSTREE_PRUNE_INDEX_PATH, &fd, error))
+    return FALSE;
+  if (fd == -1)
+    return TRUE;
+
+  g_autoptr (GVariant) data = NULL;
+  if (!ot_variant_read_fd (fd, 0, _OSTREE_PRUNE_INDEX_GVARIANT_FORMAT, FALSE, &data, error))
+    return FALSE;
+
+  guint32 version;
+  g_autoptr (GVariant) roots = NULL;
+  g_autoptr (GVariant) records = NULL;
+  g_variant_get (data, "(u@a(ayayay)@ay)", &version, &roots, &records);
+  version = GUINT32_FROM_BE (version);
+  const gsize records_size = g_variant_get_size (records);
+  if (version != INDEX_VERSION || records_size % INDEX_RECORD_LEN != 0)
+    {
+      g_debug ("Ignoring invalid prune index");
+      return TRUE;
+    }
+
+  const guint n_roots = g_variant_n_children (roots);
+  for (guint i = 0; i < n_roots; i++)
+    {
+      g_autoptr (GVariant) commit_v = NULL;
+      g_autoptr (GVariant) tree_v = NULL;
+      g_autoptr (GVariant) meta_v = NULL;
+      g_variant_get_child (roots, i, "(@ay@ay@ay)", &commit_v, &tree_v, &meta_v);
+      if (!ostree_validate_structureof_csum_v (commit_v, NULL)
+          || !ostree_validate_structureof_csum_v (tree_v, NULL)
+          || !ostree_validate_structureof_csum_v (meta_v, NULL))
+        {
+          g_debug ("Ignoring invalid prune index");
+          g_hash_table_remove_all (index->roots);
+          return TRUE;
+        }
+      g_hash_table_insert (index->roots, ostree_checksum_from_bytes_v (commit_v),
+                           g_variant_ref_sink (g_variant_new ("(@ay@ay)", tree_v, meta_v)));
+    }
+
+  index->records = g_variant_get_data (records);
+  index->n_records = records_size / INDEX_RECORD_LEN;
+  index->data = g_steal_pointer (&data);
+  return TRUE;
+}
+
+static guint32
+index_get_base_refcount (OstreeRepoPruneIndex *index, const IndexKey *key)
+{
+  gsize lo = 0;
+  gsize hi = index->n_records;
+
+  while (lo < hi)
+    {
+      gsize mid = lo + (hi - lo) / 2;
+      const guint8 *record = index->records + mid * INDEX_RECORD_LEN;
+      int c = memcmp (key->key, record, INDEX_KEY_LEN);
+      if (c < 0)
+        hi = mid;
+      else if (c > 0)
+        lo = mid + 1;
+      else
+        {
+          guint32 refcount;
+          memcpy (&refcount, record + INDEX_KEY_LEN, sizeof (refcount));
+          return GUINT32_FROM_BE (refcount);
+        }
+    }
+
+  return 0;
+}
+
+static guint32
+index_get_refcount (OstreeRepoPruneIndex *index, const IndexKey *key)
+{
+  gpointer delta = NULL;
+  g_hash_table_lookup_extended (index->deltas, key, NULL, &delta);
+  return index_get_base_refcount (index, key) + GPOINTER_TO_INT (delta);
+}
+
+/* Adjust the reference count of @key by @change, returning the old count */
+static guint32
+index_adjust (OstreeRepoPruneIndex *index, const IndexKey *key, int change)
+{
+  gpointer orig_key = NULL;
+  gpointer delta = NULL;
+  if (!g_hash_table_lookup_extended (index->deltas, key, &orig_key, &delta))
+    orig_key = g_memdup2 (key, sizeof (*key));
+  else
+    g_hash_table_steal (index->deltas, key);
+
+  const guint32 old = index_get_base_refcount (index, key) + GPOINTER_TO_INT (delta);
+  g_hash_table_insert (index->deltas, orig_key, GINT_TO_POINTER (GPOINTER_TO_INT (delta) + change));
+  return old;
+}
+
+static gboolean index_ref (OstreeRepoPruneIndex *index, const char *checksum,
+                           OstreeObjectType objtype, int change, GCancellable *cancellable,
+                           GError **error);
+
+/* Apply @change to the references held by the children of a dirtree */
+static gboolean
+index_ref_dirtree_children (OstreeRepoPruneIndex *index, const char *checksum, int change,
+                            GCancellable *cancellable, GError **error)
+{
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  g_autoptr (GVariant) dirtree = NULL;
+  if (!ostree_repo_load_variant (index->repo, OSTREE_OBJECT_TYPE_DIR_TREE, checksum, &dirtree,
+                                 error))
+    return FALSE;
+
+  ostree_cleanup_repo_commit_traverse_iter OstreeRepoCommitTraverseIter iter = {
+    0,
+  };
+  if (!ostree_repo_commit_traverse_iter_init_dirtree (&iter, index->repo, dirtree,
+                                                      OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, error))
+    return FALSE;
+
+  while (TRUE)
+    {
+      OstreeRepoCommitIterResult iterres
+          = ostree_repo_commit_traverse_iter_next (&iter, cancellable, error);
+      if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_ERROR)
+        return FALSE;
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_END)
+        break;
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_FILE)
+        {
+          char *name;
+          char *file_checksum;
+          ostree_repo_commit_traverse_iter_get_file (&iter, &name, &file_checksum);
+          if (!index_ref (index, file_checksum, OSTREE_OBJECT_TYPE_FILE, change, cancellable,
+                          error))
+            return FALSE;
+        }
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_DIR)
+        {
+          char *name;
+          char *content_checksum;
+          char *meta_checksum;
+          ostree_repo_commit_traverse_iter_get_dir (&iter, &name, &content_checksum,
+                                                    &meta_checksum);
+          if (!index_ref (index, meta_checksum, OSTREE_OBJECT_TYPE_DIR_META, change, cancellable,
+                          error))
+            return FALSE;
+          if (!index_ref (index, content_checksum, OSTREE_OBJECT_TYPE_DIR_TREE, change,
+                          cancellable, error))
+            return FALSE;
+        }
+      else
+        g_assert_not_reached ();
+    }
+
+  return TRUE;
+}
+
+/* Add (@change is 1) or drop (-1) a reference to an object; a dirtree
+ * becoming reachable or unreachable propagates to its children.
+ */
+static gboolean
+index_ref (OstreeRepoPruneIndex *index, const char *checksum, OstreeObjectType objtype,
+           int change, GCancellable *cancellable, GError **error)
+{
+  IndexKey key;
+  index_key_init (&key, checksum, objtype);
+
+  const guint32 old = index_adjust (index, &key, change);
+  if (change < 0 && old == 0)
+    return glnx_throw (error, "Prune index is inconsistent for %s.%s", checksum,
+                       ostree_object_type_to_string (objtype));
+
+  const gboolean became_reachable = change > 0 && old == 0;
+  const gboolean became_unreachable = change < 0 && old == 1;
+  if (objtype == OSTREE_OBJECT_TYPE_DIR_TREE && (became_reachable || became_unreachable))
+    return index_ref_dirtree_children (index, checksum, change, cancellable, error);
+
+  return TRUE;
+}
+
+/* Add or drop the references held by a root commit with the given root
+ * dirtree and dirmeta.
+ */
+static gboolean
+index_ref_root (OstreeRepoPruneIndex *index, const char *checksum, GVariant *root, int change,
+                GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GVariant) tree_v = NULL;
+  g_autoptr (GVariant) meta_v = NULL;
+  g_variant_get (root, "(@ay@ay)", &tree_v, &meta_v);
+  g_autofree char *tree_checksum = ostree_checksum_from_bytes_v (tree_v);
+  g_autofree char *meta_checksum = ostree_checksum_from_bytes_v (meta_v);
+
+  g_debug ("%s prune index root %s", change > 0 ? "Adding" : "Removing", checksum);
+
+  if (!index_ref (index, checksum, OSTREE_OBJECT_TYPE_COMMIT, change, cancellable, error))
+    return FALSE;
+  if (!index_ref (index, meta_checksum, OSTREE_OBJECT_TYPE_DIR_META, change, cancellable, error))
+    return FALSE;
+  if (!index_ref (index, tree_checksum, OSTREE_OBJECT_TYPE_DIR_TREE, change, cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Bring the index in line with the root set @commits, traversing partial
+ * commits into @inout_reachable instead.
+ */
+static gboolean
+index_update_roots (OstreeRepoPruneIndex *index, GHashTable *commits, GHashTable *inout_reachable,
+                    GCancellable *cancellable, GError **error)
+{
+  OstreeRepo *repo = index->repo;
+  g_autoptr (GHashTable) new_roots = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+
+  GLNX_HASH_TABLE_FOREACH (commits, GVariant *, serialized_key)
+    {
+      const char *checksum;
+      OstreeObjectType objtype;
+      ostree_object_name_deserialize (serialized_key, &checksum, &objtype);
+      if (objtype != OSTREE_OBJECT_TYPE_COMMIT)
+        continue;
+
+      g_autoptr (GVariant) commit = NULL;
+      OstreeRepoCommitState commitstate;
+      if (!ostree_repo_load_commit (repo, checksum, &commit, &commitstate, error))
+        return FALSE;
+
+      if ((commitstate & OSTREE_REPO_COMMIT_STATE_PARTIAL) != 0)
+        {
+          if (!ostree_repo_traverse_commit_with_flags (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE,
+                                                       checksum, 0, inout_reachable, NULL,
+                                                       cancellable, error))
+            return FALSE;
+          continue;
+        }
+
+      g_autoptr (GVariant) tree_v = NULL;
+      g_autoptr (GVariant) meta_v = NULL;
+      g_variant_get_child (commit, 6, "@ay", &tree_v);
+      g_variant_get_child (commit, 7, "@ay", &meta_v);
+      if (!ostree_validate_structureof_csum_v (tree_v, error)
+          || !ostree_validate_structureof_csum_v (meta_v, error))
+        return FALSE;
+      g_hash_table_insert (new_roots, g_strdup (checksum),
+                           g_variant_ref_sink (g_variant_new ("(@ay@ay)", tree_v, meta_v)));
+    }
+
+  /* Drop the roots that went away first, so that objects moving between
+   * commits don't bounce through being unreferenced.  Order the work so
+   * it's deterministic.
+   */
+  g_autoptr (GPtrArray) removed = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (index->roots, const char *, checksum)
+    {
+      if (!g_hash_table_contains (new_roots, checksum))
+        g_ptr_array_add (removed, (char *)checksum);
+    }
+  g_ptr_array_sort (removed, compare_checksums);
+
+  g_autoptr (GPtrArray) added = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (new_roots, const char *, checksum)
+    {
+      if (!g_hash_table_contains (index->roots, checksum))
+        g_ptr_array_add (added, (char *)checksum);
+    }
+  g_ptr_array_sort (added, compare_checksums);
+
+  g_debug ("Prune index: %u roots, %u added, %u removed", g_hash_table_size (new_roots),
+           added->len, removed->len);
+
+  for (guint i = 0; i < removed->len; i++)
+    {
+      const char *checksum = removed->pdata[i];
+      GVariant *root = g_hash_table_lookup (index->roots, checksum);
+      if (!index_ref_root (index, checksum, root, -1, cancellable, error))
+        return FALSE;
+    }
+
+  for (guint i = 0; i < added->len; i++)
+    {
+      const char *checksum = added->pdata[i];
+      GVariant *root = g_hash_table_lookup (new_roots, checksum);
+      if (!index_ref_root (index, checksum, root, 1, cancellable, error))
+        return FALSE;
+    }
+
+  g_hash_table_unref (index->roots);
+  index->roots = g_steal_pointer (&new_roots);
+  return TRUE;
+}
+
+/* Merge the changes into a new sorted record array and write it out */
+static gboolean
+index_write (OstreeRepoPruneIndex *index, GCancellable *cancellable, GError **error)
+{
+  OstreeRepo *repo = index->repo;
+
+  g_autoptr (GPtrArray) changed = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (index->deltas, IndexKey *, key)
+    g_ptr_array_add (changed, key);
+  g_ptr_array_sort (changed, compare_index_keys);
+
+  g_autoptr (GByteArray) records = g_byte_array_sized_new (
+      (index->n_records + changed->len) * INDEX_RECORD_LEN);
+  gsize base_i = 0;
+  guint changed_i = 0;
+  while (base_i < index->n_records || changed_i < changed->len)
+    {
+      const guint8 *base = base_i < index->n_records
+                               ? index->records + base_i * INDEX_RECORD_LEN
+                               : NULL;
+      const IndexKey *key = changed_i < changed->len ? changed->pdata[changed_i] : NULL;
+      int c = base == NULL ? 1 : key == NULL ? -1 : memcmp (base, key->key, INDEX_KEY_LEN);
+
+      if (c < 0)
+        {
+          g_byte_array_append (records, base, INDEX_RECORD_LEN);
+          base_i++;
+          continue;
+        }
+
+      const guint32 refcount = index_get_refcount (index, key);
+      if (refcount > 0)
+        {
+          const guint32 refcount_be = GUINT32_TO_BE (refcount);
+          g_byte_array_append (records, key->key, INDEX_KEY_LEN);
+          g_byte_array_append (records, (const guint8 *)&refcount_be, sizeof (refcount_be));
+        }
+      if (c == 0)
+        base_i++;
+      changed_i++;
+    }
+
+  g_autoptr (GPtrArray) root_names = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (index->roots, const char *, checksum)
+    g_ptr_array_add (root_names, (char *)checksum);
+  g_ptr_array_sort (root_names, compare_checksums);
+
+  g_auto (GVariantBuilder) roots_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&roots_builder, G_VARIANT_TYPE ("a(ayayay)"));
+  for (guint i = 0; i < root_names->len; i++)
+    {
+      const char *checksum = root_names->pdata[i];
+      GVariant *root = g_hash_table_lookup (index->roots, checksum);
+      g_autoptr (GVariant) tree_v = NULL;
+      g_autoptr (GVariant) meta_v = NULL;
+      g_variant_get (root, "(@ay@ay)", &tree_v, &meta_v);
+      g_variant_builder_add (&roots_builder, "(@ay@ay@ay)", ostree_checksum_to_bytes_v (checksum),
+                             tree_v, meta_v);
+    }
+
+  g_autoptr (GBytes) records_bytes = g_byte_array_free_to_bytes (g_steal_pointer (&records));
+  g_autoptr (GVariant) data = g_variant_ref_sink (g_variant_new (
+      "(u@a(ayayay)@ay)", GUINT32_TO_BE (INDEX_VERSION), g_variant_builder_end (&roots_builder),
+      g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, records_bytes, TRUE)));
+
+  if (!glnx_shutil_mkdir_p_at (repo->repo_dir_fd, "state", 0775, cancellable, error))
+    return FALSE;
+  if (!glnx_file_replace_contents_at (
+          repo->repo_dir_fd, _OSTREE_PRUNE_INDEX_PATH, g_variant_get_data (data),
+          g_variant_get_size (data),
+          repo->disable_fsync ? GLNX_FILE_REPLACE_NODATASYNC : GLNX_FILE_REPLACE_DATASYNC_NEW,
+          cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * _ostree_repo_prune_index_update:
+ * @self: Repo
+ * @commits: (element-type GVariant GVariant): Set of root commits
+ * @persist: Whether to write the updated index back to disk
+ * @inout_reachable: (element-type GVariant GVariant): Objects reachable from
+ *   partial commits in @commits are added here
+ * @out_index: (out): The index, which answers whether an object is reachable
+ *   from a (non-partial) commit in @commits
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Load the prune index and update it for the root set @commits, which only
+ * traverses the parts of the object graph which changed since it was last
+ * written.  Must be called with an exclusive lock held, as otherwise
+ * objects may be deleted under us.
+ */
+gboolean
+_ostree_repo_prune_index_update (OstreeRepo *self, GHashTable *commits, gboolean persist,
+                                 GHashTable *inout_reachable, OstreeRepoPruneIndex **out_index,
+                                 GCancellable *cancellable, GError **error)
+{
+  g_autoptr (OstreeRepoPruneIndex) index = g_new0 (OstreeRepoPruneIndex, 1);
+  index->repo = g_object_ref (self);
+  index->deltas = g_hash_table_new_full (index_key_hash, index_key_equal, g_free, NULL);
+  index->roots = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify)g_variant_unref);
+
+  if (!index_load (index, error))
+    return FALSE;
+
+  /* Partial commits may be traversed into @inout_reachable; don't do that
+   * twice if we need to start again.
+   */
+  g_autoptr (GHashTable) partial_reachable = ostree_repo_traverse_new_reachable ();
+  g_autoptr (GError) local_error = NULL;
+  if (!index_update_roots (index, commits, partial_reachable, cancellable, &local_error))
+    {
+      if (index->data == NULL || g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_propagate_error (error, g_steal_pointer (&local_error));
+          return FALSE;
+        }
+
+      /* Something the index relied on is gone; start from scratch */
+      g_debug ("Rebuilding prune index: %s", local_error->message);
+      g_clear_error (&local_error);
+      index_reset (index);
+      g_hash_table_remove_all (partial_reachable);
+      if (!index_update_roots (index, commits, partial_reachable, cancellable, error))
+        return FALSE;
+    }
+
+  if (persist && !index_write (index, cancellable, error))
+    return FALSE;
+
+  GLNX_HASH_TABLE_FOREACH (partial_reachable, GVariant *, serialized_key)
+    g_hash_table_add (inout_reachable, g_variant_ref (serialized_key));
+
+  *out_index = g_steal_pointer (&index);
+  return TRUE;
+}
+
+/* Whether the object is reachable from a root commit of @index */
+gboolean
+_ostree_repo_prune_index_contains (OstreeRepoPruneIndex *index, const char *checksum,
+                                   OstreeObjectType objtype)
+{
+  IndexKey key;
+  index_key_init (&key, checksum, objtype);
+  return index_get_refcount (index, &key) > 0;
+}
@@ -30,13 +30,24 @@ typedef struct
 {
   OstreeRepo *repo;
   GHashTable *reachable;
+  OstreeRepoPruneIndex *index; /* Optional; reachable objects beyond @reachable */
   guint n_reachable_meta;
   guint n_reachable_content;
   guint n_unreachable_meta;
   guint n_unreachable_content;
   guint64 freed_bytes;
+  GHashTable *packed_unreachable; /* Removed from their packs in one batch */
 } OtPruneData;
 
+static gboolean
+object_is_reachable (OtPruneData *data, GVariant *key, const char *checksum,
+                     OstreeObjectType objtype)
+{
+  if (g_hash_table_contains (data->reachable, key))
+    return TRUE;
+  return data->index != NULL && _ostree_repo_prune_index_contains (data->index, checksum, objtype);
+}
+
 static gboolean
 maybe_prune_loose_object (OtPruneData *data, OstreeRepoPruneFlags flags, GVariant *key,
                           GCancellable *cancellable, GError **error)
@@ -51,7 +62,7 @@ maybe_prune_loose_object (OtPruneData *data, OstreeRepoPruneFlags flags, GVarian
   if (commit_only && (objtype != OSTREE_OBJECT_TYPE_COMMIT))
     goto exit;
 
-  if (g_hash_table_lookup_extended (data->reachable, key, NULL, NULL))
+  if (object_is_reachable (data, key, checksum, objtype))
     reachable = TRUE;
   else
     {
@@ -90,7 +101,8 @@ maybe_prune_loose_object (OtPruneData *data, OstreeRepoPruneFlags flags, GVarian
               g_autoptr (GVariant) target_key
                   = ostree_object_name_serialize (target_checksum, OSTREE_OBJECT_TYPE_FILE);
 
-              if (g_hash_table_lookup_extended (data->reachable, target_key, NULL, NULL))
+              if (object_is_reachable (data, target_key, target_checksum,
+                                       OSTREE_OBJECT_TYPE_FILE))
                 {
                   guint64 target_storage_size = 0;
                   if (!ostree_repo_query_object_storage_size (data->repo, OSTREE_OBJECT_TYPE_FILE,
@@ -109,7 +121,19 @@ maybe_prune_loose_object (OtPruneData *data, OstreeRepoPruneFlags flags, GVarian
                 return FALSE;
             }
 
-          if (!ostree_repo_delete_object (data->repo, objtype, checksum, cancellable, error))
+          gboolean is_packed = FALSE;
+          if (!_ostree_repo_pack_lookup (data->repo, checksum, objtype, &is_packed, NULL, error))
+            return FALSE;
+
+          if (is_packed)
+            {
+              char loose_path_buf[_OSTREE_LOOSE_PATH_MAX];
+              _ostree_loose_path (loose_path_buf, checksum, objtype, data->repo->mode);
+              if (!ot_ensure_unlinked_at (data->repo->objects_dir_fd, loose_path_buf, error))
+                return FALSE;
+              g_hash_table_add (data->packed_unreachable, g_variant_ref (key));
+            }
+          else if (!ostree_repo_delete_object (data->repo, objtype, checksum, cancellable, error))
             return FALSE;
         }
 
@@ -136,18 +160,17 @@ exit:
   return TRUE;
 }
 
+/* Remove the cached summaries (or summary indexes) and their signatures in
+ * @path of remotes which no longer exist */
 static gboolean
-_ostree_repo_prune_tmp (OstreeRepo *self, GCancellable *cancellable, GError **error)
+prune_cached_summaries (OstreeRepo *self, int dfd, const char *path, GCancellable *cancellable,
+                        GError **error)
 {
-  if (self->cache_dir_fd == -1)
-    return TRUE;
-
   g_auto (GLnxDirFdIterator) dfd_iter = {
     0,
   };
   gboolean exists;
-  if (!ot_dfd_iter_init_allow_noent (self->cache_dir_fd, _OSTREE_SUMMARY_CACHE_DIR, &dfd_iter,
-                                     &exists, error))
+  if (!ot_dfd_iter_init_allow_noent (dfd, path, &dfd_iter, &exists, error))
     return FALSE;
   /* Note early return */
   if (!exists)
@@ -160,10 +183,12 @@ _ostree_repo_prune_tmp (OstreeRepo *self, GCancellable *cancellable, GError **er
       struct dirent *dent;
       g_autofree gchar *d_name = NULL;
 
-      if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, cancellable, error))
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter, &dent, cancellable, error))
         return FALSE;
       if (dent == NULL)
         break;
+      if (dent->d_type == DT_DIR)
+        continue;
 
       /* dirent->d_name can't be modified directly; see `man 3 readdir` */
       d_name = g_strdup (dent->d_name);
@@ -188,6 +213,101 @@ _ostree_repo_prune_tmp (OstreeRepo *self, GCancellable *cancellable, GError **er
   return TRUE;
 }
 
+/* Add the shards listed in the cached summary index @name to @shards */
+static gboolean
+add_cached_summary_shards (int dfd, const char *name, GHashTable *shards, GError **error)
+{
+  glnx_autofd int fd = -1;
+  if (!glnx_openat_rdonly (dfd, name, TRUE, &fd, error))
+    return FALSE;
+  g_autoptr (GBytes) bytes = ot_fd_readall_or_mmap (fd, 0, error);
+  if (!bytes)
+    return FALSE;
+
+  g_autoptr (GVariant) index = g_variant_ref_sink (
+      g_variant_new_from_bytes (_OSTREE_SUMMARY_INDEX_GVARIANT_FORMAT, bytes, FALSE));
+  g_autoptr (GVariant) index_shards = g_variant_get_child_value (index, 0);
+  const gsize n_shards = g_variant_n_children (index_shards);
+  for (gsize i = 0; i < n_shards; i++)
+    {
+      g_autoptr (GVariant) csum_v = NULL;
+      g_variant_get_child (index_shards, i, "(&s&s&s@ay)", NULL, NULL, NULL, &csum_v);
+      if (ostree_validate_structureof_csum_v (csum_v, NULL))
+        g_hash_table_add (shards, ostree_checksum_from_bytes_v (csum_v));
+    }
+
+  return TRUE;
+}
+
+/* Remove the cached summary shards which no cached summary index lists */
+static gboolean
+prune_cached_summary_shards (int summaries_dfd, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GHashTable) keep = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_auto (GLnxDirFdIterator) index_iter = {
+    0,
+  };
+  gboolean exists;
+  if (!ot_dfd_iter_init_allow_noent (summaries_dfd, "index", &index_iter, &exists, error))
+    return FALSE;
+  while (exists)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&index_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+      if (dent->d_type != DT_REG || g_str_has_suffix (dent->d_name, ".sig"))
+        continue;
+      if (!add_cached_summary_shards (index_iter.fd, dent->d_name, keep, error))
+        return FALSE;
+    }
+
+  g_auto (GLnxDirFdIterator) shards_iter = {
+    0,
+  };
+  if (!ot_dfd_iter_init_allow_noent (summaries_dfd, "shards", &shards_iter, &exists, error))
+    return FALSE;
+  while (exists)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent (&shards_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+      if (g_hash_table_contains (keep, dent->d_name))
+        continue;
+      if (!glnx_unlinkat (shards_iter.fd, dent->d_name, 0, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+_ostree_repo_prune_tmp (OstreeRepo *self, GCancellable *cancellable, GError **error)
+{
+  if (self->cache_dir_fd == -1)
+    return TRUE;
+
+  glnx_autofd int summaries_dfd = -1;
+  if (!ot_openat_ignore_enoent (self->cache_dir_fd, _OSTREE_SUMMARY_CACHE_DIR, &summaries_dfd,
+                                error))
+    return FALSE;
+  /* Note early return */
+  if (summaries_dfd == -1)
+    return TRUE;
+
+  if (!prune_cached_summaries (self, summaries_dfd, ".", cancellable, error))
+    return FALSE;
+  if (!prune_cached_summaries (self, summaries_dfd, "index", cancellable, error))
+    return FALSE;
+  if (!prune_cached_summary_shards (summaries_dfd, cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
+
 /**
  * ostree_repo_prune_static_deltas:
  * @self: Repo
@@ -259,18 +379,21 @@ ostree_repo_prune_static_deltas (OstreeRepo *self, const char *commit, GCancella
 
 static gboolean
 repo_prune_internal (OstreeRepo *self, GHashTable *objects, OstreeRepoPruneOptions *options,
-                     gint *out_objects_total, gint *out_objects_pruned,
-                     guint64 *out_pruned_object_size_total, GCancellable *cancellable,
-                     GError **error)
+                     OstreeRepoPruneIndex *index, gint *out_objects_total,
+                     gint *out_objects_pruned, guint64 *out_pruned_object_size_total,
+                     GCancellable *cancellable, GError **error)
 {
   OtPruneData data = {
     0,
   };
 
   data.repo = self;
+  data.index = index;
   /* We unref this when we're done */
   g_autoptr (GHashTable) reachable_owned = g_hash_table_ref (options->reachable);
   data.reachable = reachable_owned;
+  g_autoptr (GHashTable) packed_unreachable = ostree_repo_traverse_new_reachable ();
+  data.packed_unreachable = packed_unreachable;
 
   GLNX_HASH_TABLE_FOREACH (objects, GVariant *, serialized_key)
     {
@@ -278,12 +401,29 @@ repo_prune_internal (OstreeRepo *self, GHashTable *objects, OstreeRepoPruneOptio
         return FALSE;
     }
 
+  if (g_hash_table_size (packed_unreachable) > 0)
+    {
+      if (!_ostree_repo_pack_remove_objects (self, packed_unreachable, cancellable, error))
+        return FALSE;
+    }
+
+  if (!(options->flags & OSTREE_REPO_PRUNE_FLAGS_NO_PRUNE))
+    {
+      guint n_chunks_pruned = 0;
+      if (!_ostree_repo_prune_chunks (self, &n_chunks_pruned, cancellable, error))
+        return FALSE;
+    }
+
   if (!ostree_repo_prune_static_deltas (self, NULL, cancellable, error))
     return FALSE;
 
   if (!_ostree_repo_prune_tmp (self, cancellable, error))
     return FALSE;
 
+  if (!(options->flags & OSTREE_REPO_PRUNE_FLAGS_NO_PRUNE)
+      && !_ostree_repo_fsverity_compact (self, TRUE, cancellable, error))
+    return FALSE;
+
   *out_objects_total = (data.n_reachable_meta + data.n_unreachable_meta + data.n_reachable_content
                         + data.n_unreachable_content);
   *out_objects_pruned = (data.n_unreachable_meta + data.n_unreachable_content);
@@ -406,7 +546,7 @@ ostree_repo_prune (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
   if (commit_only)
     traverse_flags |= OSTREE_REPO_COMMIT_TRAVERSE_FLAG_COMMIT_ONLY;
 
-  if (refs_only)
+  if (refs_only && commit_only)
     {
       if (!traverse_reachable_internal (self, traverse_flags, depth, reachable, cancellable, error))
         return FALSE;
@@ -427,7 +567,31 @@ ostree_repo_prune (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
   if (!objects)
     return FALSE;
 
-  if (!refs_only)
+  /* Rather than traversing every root commit, we keep an index of what's
+   * reachable from them on disk, and only walk the objects of commits which
+   * came or went since the last prune.  The root set is either the commits
+   * we find via the refs, or every commit.
+   */
+  g_autoptr (OstreeRepoPruneIndex) index = NULL;
+  if (!commit_only)
+    {
+      g_autoptr (GHashTable) roots = NULL;
+      if (refs_only)
+        {
+          roots = ostree_repo_traverse_new_reachable ();
+          if (!traverse_reachable_internal (self, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_COMMIT_ONLY,
+                                            depth, roots, cancellable, error))
+            return FALSE;
+        }
+      else
+        roots = g_hash_table_ref (objects);
+
+      const gboolean persist = (flags & OSTREE_REPO_PRUNE_FLAGS_NO_PRUNE) == 0;
+      if (!_ostree_repo_prune_index_update (self, roots, persist, reachable, &index, cancellable,
+                                            error))
+        return FALSE;
+    }
+  else if (!refs_only)
     {
       GLNX_HASH_TABLE_FOREACH (objects, GVariant *, serialized_key)
         {
@@ -448,8 +612,9 @@ ostree_repo_prune (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
 
   {
     OstreeRepoPruneOptions opts = { flags, reachable };
-    return repo_prune_internal (self, objects, &opts, out_objects_total, out_objects_pruned,
-                                out_pruned_object_size_total, cancellable, error);
+    return repo_prune_internal (self, objects, &opts, index, out_objects_total,
+                                out_objects_pruned, out_pruned_object_size_total, cancellable,
+                                error);
   }
 }
 
@@ -507,6 +672,6 @@ ostree_repo_prune_from_reachable (OstreeRepo *self, OstreeRepoPruneOptions *opti
   if (!objects)
     return FALSE;
 
-  return repo_prune_internal (self, objects, options, out_objects_total, out_objects_pruned,
+  return repo_prune_internal (self, objects, options, NULL, out_objects_total, out_objects_pruned,
                               out_pruned_object_size_total, cancellable, error);
 }
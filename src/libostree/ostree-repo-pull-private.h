@@ -32,6 +32,35 @@ typedef enum
   OSTREE_FETCHER_SECURITY_STATE_INSECURE,
 } OstreeFetcherSecurityState;
 
+/* Timed phases of a pull; see ostree-repo-pull-trace.c */
+typedef enum
+{
+  OSTREE_PULL_TRACE_METADATA_SCAN,
+  OSTREE_PULL_TRACE_FETCH_METADATA,
+  OSTREE_PULL_TRACE_FETCH_CONTENT,
+  OSTREE_PULL_TRACE_FETCH_PACK,
+  OSTREE_PULL_TRACE_FETCH_DELTA_PART,
+  OSTREE_PULL_TRACE_WRITE_METADATA,
+  OSTREE_PULL_TRACE_WRITE_CONTENT,
+  OSTREE_PULL_TRACE_IMPORT_CONTENT,
+  OSTREE_PULL_TRACE_EXECUTE_DELTA_PART,
+} OstreePullTracePhase;
+
+#define OSTREE_PULL_TRACE_N_PHASES (OSTREE_PULL_TRACE_EXECUTE_DELTA_PART + 1)
+
+/* Bucket i counts durations of [2^i, 2^(i+1)) microseconds, except that
+ * the first also counts zero and the last everything longer.
+ */
+#define OSTREE_PULL_TRACE_N_BUCKETS 32
+
+typedef struct
+{
+  guint64 count;
+  guint64 total_usec;
+  guint64 max_usec;
+  guint64 buckets[OSTREE_PULL_TRACE_N_BUCKETS];
+} OstreePullTraceHistogram;
+
 typedef struct
 {
   OstreeRepo *repo;
@@ -58,6 +87,23 @@ typedef struct
   guint32 low_speed_time;
   gboolean retry_all;
   guint32 max_outstanding_fetcher_requests;
+  guint max_outstanding_deltapart_requests;
+  guint max_outstanding_write_requests;
+
+  /* Current limits on in-flight requests; these are the maximums above unless
+   * adaptive concurrency is enabled.  See pull_concurrency_update().
+   */
+  gboolean adaptive_concurrency;
+  guint cur_fetch_limit;
+  guint cur_deltapart_limit;
+  guint cur_write_limit;
+  guint64 concurrency_window_start; /* monotonic time, usec */
+  guint64 concurrency_window_bytes; /* bytes transferred at window start */
+  guint64 concurrency_window_latency_sum;
+  guint concurrency_window_n_completed;
+  gboolean concurrency_window_saturated; /* did we hit the fetch limit in this window */
+  guint64 concurrency_last_throughput;   /* bytes per second */
+  guint64 concurrency_last_latency;      /* mean per-request usec */
 
   gboolean dry_run;
   gboolean dry_run_emitted_progress;
@@ -107,12 +153,24 @@ typedef struct
   GHashTable *pending_fetch_delta_indexes;     /* Set<FetchDeltaIndexData> */
   GHashTable *pending_fetch_delta_superblocks; /* Set<FetchDeltaSuperData> */
   GHashTable *pending_fetch_deltaparts;        /* Set<FetchStaticDeltaData> */
+  GPtrArray *pending_fetch_packed;             /* Array<FetchObjectData> to batch */
+  GPtrArray *pending_fetch_chunks;             /* Array<FetchChunkData> */
+  GHashTable *remote_packs;                    /* Map<ObjectName,RemotePackEntry> */
+  GPtrArray *remote_pack_names;                /* Array<char*> indexed by RemotePackEntry */
+  GPtrArray *pending_fetch_pack_indexes;       /* Array<FetchObjectData> waiting for indexes */
+  GPtrArray *pending_fetch_pack_index_data;    /* Array<FetchPackIndexData> */
+  guint n_remote_pack_indexes_pending;
+  gboolean remote_packs_requested;
+  gboolean remote_packs_loaded;
+  gboolean remote_chunked_files;               /* Missing .filez may be chunked */
   guint n_outstanding_metadata_fetches;
   guint n_outstanding_metadata_write_requests;
   guint n_outstanding_content_fetches;
   guint n_outstanding_content_write_requests;
   guint n_outstanding_deltapart_fetches;
   guint n_outstanding_deltapart_write_requests;
+  guint64 deltapart_usize_outstanding; /* Uncompressed size of parts being fetched or applied */
+  guint64 deltapart_memory_budget;     /* Limit for the above, or 0 */
   guint n_total_deltaparts;
   guint n_total_delta_fallbacks;
   guint64 fetched_deltapart_size; /* How much of the delta we have now */
@@ -154,6 +212,10 @@ typedef struct
 
   GQueue scan_object_queue;
   GSource *idle_src;
+  GSource *pack_batch_idle_src;
+  GThreadPool *content_ingest_pool; /* Writes content objects as they are fetched */
+
+  OstreePullTraceHistogram trace[OSTREE_PULL_TRACE_N_PHASES];
 } OtPullData;
 
 gboolean _signapi_init_for_remote (OstreeRepo *repo, const char *remote_name,
@@ -166,6 +228,14 @@ gboolean _verify_unwritten_commit (OtPullData *pull_data, const char *checksum,
                                    GVariant *detached_metadata, const OstreeCollectionRef *ref,
                                    GCancellable *cancellable, GError **error);
 
+void _ostree_pull_trace_record (OtPullData *pull_data, OstreePullTracePhase phase,
+                                guint64 start_time);
+
+void _ostree_pull_trace_update_progress (OtPullData *pull_data);
+
+gboolean _ostree_pull_trace_write (OtPullData *pull_data, const char *path, gboolean succeeded,
+                                   const GError *pull_error, GError **error);
+
 gboolean _process_gpg_verify_result (OtPullData *pull_data, const char *checksum,
                                      OstreeGpgVerifyResult *result, GError **error);
 
@@ -0,0 +1,182 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include "ostree-repo-pull-private.h"
+#include "otutil.h"
+#include "ul-jsonwrt.h"
+
+#ifdef HAVE_LIBCURL_OR_LIBSOUP
+
+/* Most of a pull is asynchronous, so each request is timed from when it
+ * is started to when its callback runs on the pull's main context; this
+ * includes any time it spends queued behind others, for example for a
+ * worker thread.  Everything here runs on that main context.
+ */
+
+static const char *const phase_names[] = {
+  [OSTREE_PULL_TRACE_METADATA_SCAN] = "metadata-scan",
+  [OSTREE_PULL_TRACE_FETCH_METADATA] = "fetch-metadata",
+  [OSTREE_PULL_TRACE_FETCH_CONTENT] = "fetch-content",
+  [OSTREE_PULL_TRACE_FETCH_PACK] = "fetch-pack",
+  [OSTREE_PULL_TRACE_FETCH_DELTA_PART] = "fetch-delta-part",
+  [OSTREE_PULL_TRACE_WRITE_METADATA] = "write-metadata",
+  [OSTREE_PULL_TRACE_WRITE_CONTENT] = "write-content",
+  [OSTREE_PULL_TRACE_IMPORT_CONTENT] = "import-content",
+  [OSTREE_PULL_TRACE_EXECUTE_DELTA_PART] = "execute-delta-part",
+};
+G_STATIC_ASSERT (G_N_ELEMENTS (phase_names) == OSTREE_PULL_TRACE_N_PHASES);
+
+/**
+ * _ostree_pull_trace_record:
+ * @pull_data: Pull
+ * @phase: Phase
+ * @start_time: Monotonic time the operation started, or 0 if it wasn't timed
+ *
+ * Record that an operation finished now.
+ */
+void
+_ostree_pull_trace_record (OtPullData *pull_data, OstreePullTracePhase phase, guint64 start_time)
+{
+  if (start_time == 0)
+    return;
+
+  const guint64 usec = g_get_monotonic_time () - start_time;
+  OstreePullTraceHistogram *histogram = &pull_data->trace[phase];
+  histogram->count++;
+  histogram->total_usec += usec;
+  histogram->max_usec = MAX (histogram->max_usec, usec);
+
+  const guint bucket = usec > 0 ? g_bit_storage (MIN (usec, G_MAXUINT32)) - 1 : 0;
+  histogram->buckets[MIN (bucket, OSTREE_PULL_TRACE_N_BUCKETS - 1)]++;
+}
+
+/* For each phase, `timing-PHASE-count` is the number of operations which
+ * finished and `timing-PHASE-usec` the total time they took.
+ */
+void
+_ostree_pull_trace_update_progress (OtPullData *pull_data)
+{
+  for (guint i = 0; i < OSTREE_PULL_TRACE_N_PHASES; i++)
+    {
+      const OstreePullTraceHistogram *histogram = &pull_data->trace[i];
+      g_autofree char *count_key = g_strconcat ("timing-", phase_names[i], "-count", NULL);
+      g_autofree char *usec_key = g_strconcat ("timing-", phase_names[i], "-usec", NULL);
+      ostree_async_progress_set_uint64 (pull_data->progress, count_key, histogram->count);
+      ostree_async_progress_set_uint64 (pull_data->progress, usec_key, histogram->total_usec);
+    }
+}
+
+static void
+write_histogram (struct ul_jsonwrt *jo, const char *name,
+                 const OstreePullTraceHistogram *histogram)
+{
+  ul_jsonwrt_object_open (jo, NULL);
+  ul_jsonwrt_value_s (jo, "name", name);
+  ul_jsonwrt_value_u64 (jo, "count", histogram->count);
+  ul_jsonwrt_value_u64 (jo, "total-usec", histogram->total_usec);
+  ul_jsonwrt_value_u64 (jo, "max-usec", histogram->max_usec);
+
+  /* Only the buckets which aren't empty; each covers durations from its
+   * minimum up to twice that.
+   */
+  ul_jsonwrt_array_open (jo, "histogram");
+  for (guint i = 0; i < OSTREE_PULL_TRACE_N_BUCKETS; i++)
+    {
+      if (histogram->buckets[i] == 0)
+        continue;
+      ul_jsonwrt_object_open (jo, NULL);
+      ul_jsonwrt_value_u64 (jo, "min-usec", i == 0 ? 0 : G_GUINT64_CONSTANT (1) << i);
+      ul_jsonwrt_value_u64 (jo, "count", histogram->buckets[i]);
+      ul_jsonwrt_object_close (jo);
+    }
+  ul_jsonwrt_array_close (jo);
+
+  ul_jsonwrt_object_close (jo);
+}
+
+/**
+ * _ostree_pull_trace_write:
+ * @pull_data: Pull
+ * @path: Where to write the trace
+ * @succeeded: Whether the pull succeeded
+ * @pull_error: (nullable): Why the pull failed, if known
+ * @error: Error
+ *
+ * Write the phase timings and other statistics of the pull as JSON.
+ */
+gboolean
+_ostree_pull_trace_write (OtPullData *pull_data, const char *path, gboolean succeeded,
+                          const GError *pull_error, GError **error)
+{
+  g_autofree char *buf = NULL;
+  gsize len = 0;
+  FILE *out = open_memstream (&buf, &len);
+  if (!out)
+    return glnx_throw_errno_prefix (error, "open_memstream");
+
+  struct ul_jsonwrt jo;
+  ul_jsonwrt_init (&jo, out, 0);
+  ul_jsonwrt_root_open (&jo);
+
+  if (pull_data->remote_name)
+    ul_jsonwrt_value_s (&jo, "remote", pull_data->remote_name);
+  ul_jsonwrt_value_boolean (&jo, "success", succeeded);
+  if (!succeeded && pull_error)
+    ul_jsonwrt_value_s (&jo, "error", pull_error->message);
+  if (pull_data->start_time > 0)
+    ul_jsonwrt_value_u64 (&jo, "elapsed-usec", g_get_monotonic_time () - pull_data->start_time);
+  if (pull_data->fetcher)
+    ul_jsonwrt_value_u64 (&jo, "bytes-transferred",
+                          _ostree_fetcher_bytes_transferred (pull_data->fetcher));
+  ul_jsonwrt_value_u64 (&jo, "fetched-metadata", pull_data->n_fetched_metadata);
+  ul_jsonwrt_value_u64 (&jo, "fetched-content", pull_data->n_fetched_content);
+  ul_jsonwrt_value_u64 (&jo, "imported-metadata", pull_data->n_imported_metadata);
+  ul_jsonwrt_value_u64 (&jo, "imported-content", pull_data->n_imported_content);
+  ul_jsonwrt_value_u64 (&jo, "fetched-delta-parts", pull_data->n_fetched_deltaparts);
+
+  OstreeFetcherConnectionStats stats;
+  if (pull_data->fetcher && _ostree_fetcher_get_connection_stats (pull_data->fetcher, &stats))
+    {
+      ul_jsonwrt_object_open (&jo, "connections");
+      ul_jsonwrt_value_u64 (&jo, "count", stats.n_connections);
+      ul_jsonwrt_value_u64 (&jo, "dns-usec", stats.dns_usec);
+      ul_jsonwrt_value_u64 (&jo, "connect-usec", stats.connect_usec);
+      ul_jsonwrt_value_u64 (&jo, "tls-usec", stats.tls_usec);
+      ul_jsonwrt_object_close (&jo);
+    }
+
+  ul_jsonwrt_array_open (&jo, "phases");
+  for (guint i = 0; i < OSTREE_PULL_TRACE_N_PHASES; i++)
+    write_histogram (&jo, phase_names[i], &pull_data->trace[i]);
+  ul_jsonwrt_array_close (&jo);
+
+  ul_jsonwrt_root_close (&jo);
+  if (fclose (out) != 0)
+    return glnx_throw_errno_prefix (error, "Writing trace");
+
+  if (!glnx_file_replace_contents_at (AT_FDCWD, path, (guint8 *)buf, len,
+                                      GLNX_FILE_REPLACE_NODATASYNC, NULL, error))
+    return glnx_prefix_error (error, "Writing trace to %s", path);
+
+  return TRUE;
+}
+
+#endif /* HAVE_LIBCURL_OR_LIBSOUP */
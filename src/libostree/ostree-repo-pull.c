@@ -46,6 +46,7 @@
 #include <gio/gunixinputstream.h>
 #include <sys/statvfs.h>
 #include <sys/time.h>
+#include <unistd.h>
 #ifdef HAVE_LIBSYSTEMD
 #include <systemd/sd-journal.h>
 #endif
@@ -65,6 +66,20 @@
 #define OPT_LOWSPEEDTIME_DEFAULT 30
 #define OPT_RETRYALL_DEFAULT TRUE
 #define OPT_OSTREE_MAX_OUTSTANDING_FETCHER_REQUESTS_DEFAULT 8
+/* With adaptive concurrency, the fetcher and write limits may grow up to this
+ * multiple of their defaults unless configured otherwise.
+ */
+#define OPT_ADAPTIVE_CONCURRENCY_GROWTH_DEFAULT 4
+#define CONCURRENCY_WINDOW_USEC (G_USEC_PER_SEC)
+/* Objects in a remote pack up to this size are coalesced with their neighbours
+ * into a single range request, as long as the range doesn't grow past
+ * PACK_BATCH_MAX_LENGTH and we don't fetch more than PACK_BATCH_MAX_GAP bytes
+ * we don't need between any two of them.
+ */
+#define PACK_BATCH_MAX_OBJECT_SIZE (1024 * 1024)
+#define PACK_BATCH_MAX_LENGTH (4 * 1024 * 1024)
+#define PACK_BATCH_MAX_GAP (64 * 1024)
+#define PACK_BATCH_MAX_OBJECTS 512
 
 typedef struct
 {
@@ -80,6 +95,8 @@ typedef struct
 
   OstreeCollectionRef *requested_ref; /* (nullable) */
   guint n_retries_remaining;
+  guint64 start_time;       /* monotonic time the current request was started */
+  guint64 write_start_time; /* monotonic time the write was started */
 } FetchObjectData;
 
 typedef struct
@@ -89,10 +106,13 @@ typedef struct
   char *expected_checksum;
   char *from_revision;
   char *to_revision;
+  GBytes *zstd_dictionary; /* From the superblock, may be NULL */
   guint i;
   guint64 size;
   guint64 usize;
   guint n_retries_remaining;
+  guint64 start_time;         /* monotonic time the current request was started */
+  guint64 execute_start_time; /* monotonic time execution was started */
 } FetchStaticDeltaData;
 
 typedef struct
@@ -122,6 +142,55 @@ typedef struct
   guint n_retries_remaining;
 } FetchDeltaIndexData;
 
+typedef struct
+{
+  guint pack_idx; /* Index into pull_data->remote_pack_names */
+  guint64 offset;
+  guint64 size;
+} RemotePackEntry;
+
+typedef struct
+{
+  OtPullData *pull_data;
+  guint pack_idx;
+  guint64 offset;
+  guint64 length;
+  gboolean is_meta;
+  GPtrArray *objects; /* Array<FetchObjectData>; entries are cleared once written */
+  guint n_retries_remaining;
+  guint64 start_time; /* monotonic time the current request was started */
+} FetchPackBatchData;
+
+typedef struct
+{
+  OtPullData *pull_data;
+  guint pack_idx;
+  guint n_retries_remaining;
+  guint64 start_time;
+} FetchPackIndexData;
+
+/* A content object the remote stores chunked; see ostree-repo-chunks.c */
+typedef struct
+{
+  OtPullData *pull_data;
+  FetchObjectData *fetch_data;
+  GVariant *descriptor;    /* Set once fetched and validated */
+  guint n_pending_chunks;  /* Chunks not fetched and stored yet */
+  gboolean failed;         /* A chunk couldn't be fetched or stored */
+  guint n_retries_remaining;
+  guint64 start_time;
+} FetchChunkedData;
+
+typedef struct
+{
+  FetchChunkedData *chunked;
+  char digest[OSTREE_SHA256_STRING_LEN + 1];
+  guint64 size;
+  GBytes *data; /* Set while the fetched chunk is being stored */
+  guint n_retries_remaining;
+  guint64 start_time;
+} FetchChunkData;
+
 static void
 variant_or_null_unref (gpointer data)
 {
@@ -134,6 +203,7 @@ static void start_fetch_deltapart (OtPullData *pull_data, FetchStaticDeltaData *
 static void start_fetch_delta_superblock (OtPullData *pull_data, FetchDeltaSuperData *fetch_data);
 static void start_fetch_delta_index (OtPullData *pull_data, FetchDeltaIndexData *fetch_data);
 static gboolean fetcher_queue_is_full (OtPullData *pull_data);
+static void pull_fetch_deferred (OtPullData *pull_data);
 static void queue_scan_one_metadata_object (OtPullData *pull_data, const char *csum,
                                             OstreeObjectType objtype, const char *path,
                                             guint recursion_depth, const OstreeCollectionRef *ref);
@@ -153,6 +223,14 @@ static void enqueue_one_static_delta_superblock_request_s (OtPullData *pull_data
 static void enqueue_one_static_delta_part_request_s (OtPullData *pull_data,
                                                      FetchStaticDeltaData *fetch_data);
 static void ensure_idle_queued (OtPullData *pull_data);
+static void ensure_pack_batch_queued (OtPullData *pull_data);
+static void pending_fetch_packed_clear (OtPullData *pull_data);
+static void start_fetch_chunked (OtPullData *pull_data, FetchChunkedData *chunked);
+static FetchChunkedData *fetch_chunked_data_new (OtPullData *pull_data,
+                                                 FetchObjectData *fetch_data);
+static void start_fetch_chunk (OtPullData *pull_data, FetchChunkData *chunk);
+static void pending_fetch_chunks_clear (OtPullData *pull_data);
+static void start_fetch_pack_index (OtPullData *pull_data, FetchPackIndexData *fetch);
 
 static gboolean scan_one_metadata_object (OtPullData *pull_data, const char *checksum,
                                           OstreeObjectType objtype, const char *path,
@@ -222,6 +300,7 @@ update_progress (gpointer user_data)
       "metadata-fetched", "u", pull_data->n_fetched_metadata,
       /* Overall status. */
       "status", "s", "", NULL);
+  _ostree_pull_trace_update_progress (pull_data);
 
   if (pull_data->dry_run)
     pull_data->dry_run_emitted_progress = TRUE;
@@ -235,7 +314,10 @@ pull_termination_condition (OtPullData *pull_data)
 {
   gboolean current_fetch_idle = (pull_data->n_outstanding_metadata_fetches == 0
                                  && pull_data->n_outstanding_content_fetches == 0
-                                 && pull_data->n_outstanding_deltapart_fetches == 0);
+                                 && pull_data->n_outstanding_deltapart_fetches == 0
+                                 && pull_data->pending_fetch_packed->len == 0
+                                 && pull_data->pending_fetch_pack_index_data->len == 0
+                                 && pull_data->pending_fetch_chunks->len == 0);
   gboolean current_write_idle = (pull_data->n_outstanding_metadata_write_requests == 0
                                  && pull_data->n_outstanding_content_write_requests == 0
                                  && pull_data->n_outstanding_deltapart_write_requests == 0);
@@ -291,6 +373,8 @@ check_outstanding_requests_handle_error (OtPullData *pull_data, GError **errorp)
       g_hash_table_remove_all (pull_data->pending_fetch_delta_superblocks);
       g_hash_table_remove_all (pull_data->pending_fetch_deltaparts);
       g_hash_table_remove_all (pull_data->pending_fetch_content);
+      pending_fetch_packed_clear (pull_data);
+      pending_fetch_chunks_clear (pull_data);
     }
   else
     {
@@ -320,6 +404,26 @@ check_outstanding_requests_handle_error (OtPullData *pull_data, GError **errorp)
           g_variant_unref (objname);
         }
 
+      /* Pack indexes are metadata too; other objects wait for them */
+      guint n_pack_indexes_started = 0;
+      while (!fetcher_queue_is_full (pull_data)
+             && n_pack_indexes_started < pull_data->pending_fetch_pack_index_data->len)
+        {
+          FetchPackIndexData *fetch
+              = pull_data->pending_fetch_pack_index_data->pdata[n_pack_indexes_started];
+          /* This takes ownership of the value */
+          start_fetch_pack_index (pull_data, fetch);
+          n_pack_indexes_started++;
+        }
+      g_ptr_array_remove_range (pull_data->pending_fetch_pack_index_data, 0,
+                                n_pack_indexes_started);
+
+      /* Objects from remote packs are coalesced into range requests from an
+       * idle, so more of them can accumulate while scanning.
+       */
+      if (pull_data->pending_fetch_packed->len > 0)
+        ensure_pack_batch_queued (pull_data);
+
       /* Next, process delta index requests */
       g_hash_table_iter_init (&hiter, pull_data->pending_fetch_delta_indexes);
       while (!fetcher_queue_is_full (pull_data) && g_hash_table_iter_next (&hiter, &key, &value))
@@ -348,6 +452,19 @@ check_outstanding_requests_handle_error (OtPullData *pull_data, GError **errorp)
           start_fetch_deltapart (pull_data, fetch);
         }
 
+      /* Chunks of objects we've already started fetching come before new
+       * content, so those objects can be finished.
+       */
+      guint n_chunks_started = 0;
+      while (!fetcher_queue_is_full (pull_data)
+             && n_chunks_started < pull_data->pending_fetch_chunks->len)
+        {
+          /* This takes ownership of the value */
+          start_fetch_chunk (pull_data, pull_data->pending_fetch_chunks->pdata[n_chunks_started]);
+          n_chunks_started++;
+        }
+      g_ptr_array_remove_range (pull_data->pending_fetch_chunks, 0, n_chunks_started);
+
       /* Next, fill the queue with content */
       g_hash_table_iter_init (&hiter, pull_data->pending_fetch_content);
       while (!fetcher_queue_is_full (pull_data) && g_hash_table_iter_next (&hiter, &key, &value))
@@ -364,31 +481,169 @@ check_outstanding_requests_handle_error (OtPullData *pull_data, GError **errorp)
           g_free (checksum);
         }
 
+      if (g_hash_table_size (pull_data->pending_fetch_metadata) > 0
+          || pull_data->pending_fetch_pack_index_data->len > 0
+          || g_hash_table_size (pull_data->pending_fetch_delta_indexes) > 0
+          || g_hash_table_size (pull_data->pending_fetch_delta_superblocks) > 0
+          || g_hash_table_size (pull_data->pending_fetch_deltaparts) > 0
+          || pull_data->pending_fetch_chunks->len > 0
+          || g_hash_table_size (pull_data->pending_fetch_content) > 0)
+        pull_fetch_deferred (pull_data);
+
       /* Finally, if we still have capacity, scan more metadata objects */
       if (!g_queue_is_empty (&pull_data->scan_object_queue))
         ensure_idle_queued (pull_data);
     }
 }
 
-/* We have a total-request limit, as well has a hardcoded max of 2 for delta
- * parts. The logic for the delta one is that processing them is expensive, and
- * doing multiple simultaneously could risk space/memory on smaller devices. We
- * also throttle on outstanding writes in case fetches are faster.
+/* Delta parts in flight may use up to this many bytes in total, as
+ * estimated from their uncompressed size; by default we use a quarter of
+ * physical memory, see also the max-deltapart-memory remote option.
+ * Returns 0 if unknown, in which case there's no limit.
+ */
+static guint64
+get_deltapart_memory_budget (void)
+{
+  const long pages = sysconf (_SC_PHYS_PAGES);
+  const long page_size = sysconf (_SC_PAGESIZE);
+  if (pages <= 0 || page_size <= 0)
+    return 0;
+  return ((guint64)pages * (guint64)page_size) / 4;
+}
+
+/* We have a total-request limit, as well has a separate limit for delta parts
+ * being fetched or applied. The logic for the delta one is that processing
+ * them is expensive, so by default we only run about one per CPU, and we also
+ * stop once the parts in flight would expand to more than our memory budget,
+ * to avoid risking space/memory on smaller devices. We also throttle on
+ * outstanding writes in case fetches are faster.  The fetch and write limits
+ * may be adjusted during the pull; see pull_concurrency_update().
  */
 static gboolean
-fetcher_queue_is_full (OtPullData *pull_data)
+fetcher_fetches_full (OtPullData *pull_data)
 {
   const gboolean fetch_full
       = ((pull_data->n_outstanding_metadata_fetches + pull_data->n_outstanding_content_fetches
           + pull_data->n_outstanding_deltapart_fetches)
-         == pull_data->max_outstanding_fetcher_requests);
+         >= pull_data->cur_fetch_limit);
   const gboolean deltas_full
-      = (pull_data->n_outstanding_deltapart_fetches == _OSTREE_MAX_OUTSTANDING_DELTAPART_REQUESTS);
+      = ((pull_data->n_outstanding_deltapart_fetches
+          + pull_data->n_outstanding_deltapart_write_requests)
+         >= pull_data->cur_deltapart_limit)
+        || (pull_data->deltapart_memory_budget > 0
+            && pull_data->deltapart_usize_outstanding >= pull_data->deltapart_memory_budget);
+  return fetch_full || deltas_full;
+}
+
+static gboolean
+fetcher_queue_is_full (OtPullData *pull_data)
+{
   const gboolean writes_full = ((pull_data->n_outstanding_metadata_write_requests
-                                 + pull_data->n_outstanding_content_write_requests
-                                 + pull_data->n_outstanding_deltapart_write_requests)
-                                >= _OSTREE_MAX_OUTSTANDING_WRITE_REQUESTS);
-  return fetch_full || deltas_full || writes_full;
+                                 + pull_data->n_outstanding_content_write_requests)
+                                >= pull_data->cur_write_limit);
+  return fetcher_fetches_full (pull_data) || writes_full;
+}
+
+/* Called when a fetch is left queued because fetcher_queue_is_full(); if
+ * that's down to the fetch limits rather than writes, a higher fetch limit
+ * might help.  See pull_concurrency_update().
+ */
+static void
+pull_fetch_deferred (OtPullData *pull_data)
+{
+  if (fetcher_fetches_full (pull_data))
+    pull_data->concurrency_window_saturated = TRUE;
+}
+
+/* Set the limit on in-flight fetches, and scale the write limit along with
+ * it, keeping the ratio between their defaults.  Delta parts are mostly
+ * bound by CPU rather than the network, so their limit stays fixed.
+ */
+static void
+pull_concurrency_set_fetch_limit (OtPullData *pull_data, guint limit)
+{
+  pull_data->cur_fetch_limit = CLAMP (limit, 1, pull_data->max_outstanding_fetcher_requests);
+  pull_data->cur_write_limit
+      = CLAMP (pull_data->cur_fetch_limit * _OSTREE_MAX_OUTSTANDING_WRITE_REQUESTS
+                   / OPT_OSTREE_MAX_OUTSTANDING_FETCHER_REQUESTS_DEFAULT,
+               1, pull_data->max_outstanding_write_requests);
+}
+
+static void
+pull_concurrency_init (OtPullData *pull_data)
+{
+  pull_data->cur_deltapart_limit = MAX (pull_data->max_outstanding_deltapart_requests, 1);
+  if (pull_data->adaptive_concurrency)
+    pull_concurrency_set_fetch_limit (pull_data,
+                                      OPT_OSTREE_MAX_OUTSTANDING_FETCHER_REQUESTS_DEFAULT);
+  else
+    {
+      pull_data->cur_fetch_limit = pull_data->max_outstanding_fetcher_requests;
+      pull_data->cur_write_limit = pull_data->max_outstanding_write_requests;
+    }
+  pull_data->concurrency_window_start = g_get_monotonic_time ();
+}
+
+/* Called when a fetch that was started at @request_start_time completes.  With
+ * adaptive concurrency, once per window we compare the throughput and mean
+ * request latency against the previous window.  If we were held back by the
+ * limits and throughput improved, there's spare capacity on the link (e.g. a
+ * high bandwidth-delay product), so we allow more requests in flight.  If
+ * instead latency went up without any gain in throughput, the extra requests
+ * are just queuing somewhere, so we back off.
+ */
+static void
+pull_concurrency_update (OtPullData *pull_data, guint64 request_start_time)
+{
+  if (!pull_data->adaptive_concurrency || pull_data->fetcher == NULL)
+    return;
+
+  const guint64 now = g_get_monotonic_time ();
+  pull_data->concurrency_window_latency_sum += now - request_start_time;
+  pull_data->concurrency_window_n_completed++;
+
+  const guint64 elapsed = now - pull_data->concurrency_window_start;
+  if (elapsed < CONCURRENCY_WINDOW_USEC)
+    return;
+
+  const guint64 bytes = _ostree_fetcher_bytes_transferred (pull_data->fetcher);
+  /* The count is reset if the fetcher was recreated; just start a new window */
+  if (bytes >= pull_data->concurrency_window_bytes)
+    {
+      const guint64 throughput
+          = (bytes - pull_data->concurrency_window_bytes) * G_USEC_PER_SEC / elapsed;
+      const guint64 latency = pull_data->concurrency_window_latency_sum
+                              / pull_data->concurrency_window_n_completed;
+      const guint64 last_throughput = pull_data->concurrency_last_throughput;
+      const guint64 last_latency = pull_data->concurrency_last_latency;
+      const guint step = MAX (pull_data->cur_fetch_limit / 4, 1);
+      guint new_limit = pull_data->cur_fetch_limit;
+
+      if (pull_data->concurrency_window_saturated
+          && throughput > last_throughput + last_throughput / 10)
+        new_limit += step;
+      else if (last_latency > 0 && latency > last_latency + last_latency / 2
+               && throughput <= last_throughput)
+        new_limit = new_limit > step ? new_limit - step : 1;
+
+      if (new_limit != pull_data->cur_fetch_limit)
+        {
+          pull_concurrency_set_fetch_limit (pull_data, new_limit);
+          g_debug ("pull: %" G_GUINT64_FORMAT " B/s, %" G_GUINT64_FORMAT
+                   " us/request; limits now fetch=%u deltapart=%u write=%u",
+                   throughput, latency, pull_data->cur_fetch_limit,
+                   pull_data->cur_deltapart_limit, pull_data->cur_write_limit);
+        }
+
+      pull_data->concurrency_last_throughput = throughput;
+      pull_data->concurrency_last_latency = latency;
+    }
+
+  pull_data->concurrency_window_start = now;
+  pull_data->concurrency_window_bytes = bytes;
+  pull_data->concurrency_window_latency_sum = 0;
+  pull_data->concurrency_window_n_completed = 0;
+  pull_data->concurrency_window_saturated = FALSE;
 }
 
 static void
@@ -421,9 +676,11 @@ idle_worker (gpointer user_data)
 
   char checksum[OSTREE_SHA256_STRING_LEN + 1];
   ostree_checksum_inplace_from_bytes (scan_data->csum, checksum);
+  const guint64 scan_start_time = g_get_monotonic_time ();
   scan_one_metadata_object (pull_data, checksum, scan_data->objtype, scan_data->path,
                             scan_data->recursion_depth, scan_data->requested_ref,
                             pull_data->cancellable, &error);
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_METADATA_SCAN, scan_start_time);
 
   /* No need to retry scan tasks, since they’re local. */
   check_outstanding_requests_handle_error (pull_data, &error);
@@ -560,6 +817,7 @@ typedef struct
   OtPullData *pull_data;
   OstreeRepo *src_repo;
   char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  guint64 start_time;
 } ImportLocalAsyncData;
 
 /* Asynchronously import a single content object. @src_repo is either
@@ -596,6 +854,7 @@ async_import_one_local_content_object (OtPullData *pull_data, OstreeRepo *src_re
   iataskdata->pull_data = pull_data;
   iataskdata->src_repo = src_repo;
   memcpy (iataskdata->checksum, checksum, OSTREE_SHA256_STRING_LEN);
+  iataskdata->start_time = g_get_monotonic_time ();
   g_autoptr (GTask) task = g_task_new (pull_data->repo, cancellable, callback, user_data);
   g_task_set_source_tag (task, async_import_one_local_content_object);
   g_task_set_task_data (task, iataskdata, g_free);
@@ -618,6 +877,9 @@ on_local_object_imported (GObject *object, GAsyncResult *result, gpointer user_d
   g_autoptr (GError) local_error = NULL;
   GError **error = &local_error;
 
+  ImportLocalAsyncData *iataskdata = g_task_get_task_data ((GTask *)result);
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_IMPORT_CONTENT, iataskdata->start_time);
+
   if (!async_import_one_local_content_object_finish (pull_data, result, error))
     goto out;
 
@@ -887,6 +1149,9 @@ content_fetch_on_write_complete (GObject *object, GAsyncResult *result, gpointer
   g_autofree char *checksum = NULL;
   g_autofree char *checksum_obj = NULL;
 
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_WRITE_CONTENT,
+                             fetch_data->write_start_time);
+
   if (!ostree_repo_write_content_finish ((OstreeRepo *)object, result, &csum, error))
     goto out;
 
@@ -912,6 +1177,51 @@ out:
   fetch_object_data_free (fetch_data);
 }
 
+/* Parse an archive content object of @size bytes from @input, and start
+ * writing it to the repo.  On success, ownership of @fetch_data is transferred
+ * to the write.
+ */
+static gboolean
+write_fetched_content (OtPullData *pull_data, FetchObjectData *fetch_data, GInputStream *input,
+                       guint64 size, GError **error)
+{
+  GCancellable *cancellable = NULL;
+  guint64 length;
+  g_autoptr (GFileInfo) file_info = NULL;
+  g_autoptr (GVariant) xattrs = NULL;
+  g_autoptr (GInputStream) file_in = NULL;
+  g_autoptr (GInputStream) object_input = NULL;
+  const char *checksum;
+  OstreeObjectType objtype;
+
+  ostree_object_name_deserialize (fetch_data->object, &checksum, &objtype);
+  g_assert (objtype == OSTREE_OBJECT_TYPE_FILE);
+
+  if (!ostree_content_stream_parse (TRUE, input, size, FALSE, &file_in, &file_info, &xattrs,
+                                    cancellable, error))
+    {
+      g_autofree char *checksum_obj = ostree_object_to_string (checksum, objtype);
+      g_prefix_error (error, "Parsing %s: ", checksum_obj);
+      return FALSE;
+    }
+
+  if ((pull_data->importflags & _OSTREE_REPO_IMPORT_FLAGS_VERIFY_BAREUSERONLY) > 0)
+    {
+      if (!_ostree_validate_bareuseronly_mode_finfo (file_info, checksum, error))
+        return FALSE;
+    }
+
+  if (!ostree_raw_file_to_content_stream (file_in, file_info, xattrs, &object_input, &length,
+                                          cancellable, error))
+    return FALSE;
+
+  pull_data->n_outstanding_content_write_requests++;
+  fetch_data->write_start_time = g_get_monotonic_time ();
+  ostree_repo_write_content_async (pull_data->repo, checksum, object_input, length, cancellable,
+                                   content_fetch_on_write_complete, fetch_data);
+  return TRUE;
+}
+
 static void
 content_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_data)
 {
@@ -921,22 +1231,29 @@ content_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_
   g_autoptr (GError) local_error = NULL;
   GError **error = &local_error;
   GCancellable *cancellable = NULL;
-  guint64 length;
   g_auto (GLnxTmpfile) tmpf = {
     0,
   };
   g_autoptr (GInputStream) tmpf_input = NULL;
-  g_autoptr (GFileInfo) file_info = NULL;
-  g_autoptr (GVariant) xattrs = NULL;
-  g_autoptr (GInputStream) file_in = NULL;
-  g_autoptr (GInputStream) object_input = NULL;
   const char *checksum;
   g_autofree char *checksum_obj = NULL;
   OstreeObjectType objtype;
   gboolean free_fetch_data = TRUE;
+  gboolean fetch_chunked = FALSE;
+
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_FETCH_CONTENT, fetch_data->start_time);
 
   if (!_ostree_fetcher_request_to_tmpfile_finish (fetcher, result, &tmpf, NULL, NULL, NULL, error))
-    goto out;
+    {
+      /* Chunked objects have no .filez in the remote */
+      if (pull_data->remote_chunked_files
+          && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        {
+          g_clear_error (&local_error);
+          fetch_chunked = TRUE;
+        }
+      goto out;
+    }
 
   ostree_object_name_deserialize (fetch_data->object, &checksum, &objtype);
   g_assert (objtype == OSTREE_OBJECT_TYPE_FILE);
@@ -953,8 +1270,9 @@ content_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_
   if (pull_data->trusted_http_direct)
     {
       g_assert (!verifying_bareuseronly);
-      if (!_ostree_repo_commit_tmpf_final (pull_data->repo, checksum, objtype, &tmpf, NULL,
-                                           cancellable, error))
+      /* The content isn't checksummed, so no fs-verity digest is recorded */
+      if (!_ostree_repo_commit_tmpf_final (pull_data->repo, checksum, objtype, &tmpf, FALSE, NULL,
+                                           NULL, cancellable, error))
         goto out;
       pull_data->n_fetched_content++;
     }
@@ -966,35 +1284,20 @@ content_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_
       /* Non-mirroring path */
       tmpf_input = g_unix_input_stream_new (g_steal_fd (&tmpf.fd), TRUE);
 
-      /* If it appears corrupted, we'll delete it below */
-      if (!ostree_content_stream_parse (TRUE, tmpf_input, stbuf.st_size, FALSE, &file_in,
-                                        &file_info, &xattrs, cancellable, error))
-        {
-          g_prefix_error (error, "Parsing %s: ", checksum_obj);
-          goto out;
-        }
-
-      if (verifying_bareuseronly)
-        {
-          if (!_ostree_validate_bareuseronly_mode_finfo (file_info, checksum, error))
-            goto out;
-        }
-
-      if (!ostree_raw_file_to_content_stream (file_in, file_info, xattrs, &object_input, &length,
-                                              cancellable, error))
+      if (!write_fetched_content (pull_data, fetch_data, tmpf_input, stbuf.st_size, error))
         goto out;
-
-      pull_data->n_outstanding_content_write_requests++;
-      ostree_repo_write_content_async (pull_data->repo, checksum, object_input, length, cancellable,
-                                       content_fetch_on_write_complete, fetch_data);
       free_fetch_data = FALSE;
     }
 
 out:
   g_assert (pull_data->n_outstanding_content_fetches > 0);
   pull_data->n_outstanding_content_fetches--;
+  pull_concurrency_update (pull_data, fetch_data->start_time);
 
-  if (_ostree_fetcher_should_retry_request (local_error, fetch_data->n_retries_remaining--))
+  if (fetch_chunked)
+    start_fetch_chunked (pull_data,
+                         fetch_chunked_data_new (pull_data, g_steal_pointer (&fetch_data)));
+  else if (_ostree_fetcher_should_retry_request (local_error, fetch_data->n_retries_remaining--))
     enqueue_one_object_request_s (pull_data, g_steal_pointer (&fetch_data));
   else
     check_outstanding_requests_handle_error (pull_data, &local_error);
@@ -1003,6 +1306,259 @@ out:
     g_clear_pointer (&fetch_data, fetch_object_data_free);
 }
 
+/* At most this much received data is kept in memory for each streamed
+ * content object; past it, the rest is spilled to a temporary file.
+ */
+#define CONTENT_INGEST_MAX_QUEUED (4 * 1024 * 1024)
+
+/* A content object which is written as it is fetched.  The fetcher's write
+ * callback queues the received data, and a worker from
+ * pull_data->content_ingest_pool decompresses, checksums and writes it, so
+ * none of that happens on the main loop.  If the worker falls behind, say
+ * with a fast network and a slow disk, the data is appended to @spill
+ * instead, as the tmpfile path would have, so memory use stays bounded.
+ */
+typedef struct
+{
+  FetchObjectData *fetch_data;
+  OstreeRepoContentIngest *ingest;
+
+  GMutex lock;
+  GCond cond;
+  GQueue chunks;      /* Queue<GBytes> */
+  gsize queued_bytes; /* Total size of @chunks */
+  GLnxTmpfile spill;  /* Everything received once the queue was full */
+  guint64 spill_written;
+  guint64 spill_read;
+  gboolean fetched;   /* The request completed; see @fetch_error */
+  gboolean failed;    /* Set by the worker once it stops consuming data */
+
+  GError *error;       /* Owned by the worker until content_ingest_done() */
+  GError *fetch_error; /* Set before @fetched */
+} ContentIngestJob;
+
+static ContentIngestJob *
+content_ingest_job_new (FetchObjectData *fetch_data, OstreeRepoContentIngest *ingest)
+{
+  ContentIngestJob *job = g_new0 (ContentIngestJob, 1);
+  job->fetch_data = fetch_data;
+  job->ingest = ingest;
+  g_mutex_init (&job->lock);
+  g_cond_init (&job->cond);
+  g_queue_init (&job->chunks);
+  return job;
+}
+
+static void
+content_ingest_job_free (ContentIngestJob *job)
+{
+  g_clear_pointer (&job->fetch_data, fetch_object_data_free);
+  g_clear_pointer (&job->ingest, _ostree_repo_content_ingest_free);
+  g_queue_clear_full (&job->chunks, (GDestroyNotify)g_bytes_unref);
+  glnx_tmpfile_clear (&job->spill);
+  g_mutex_clear (&job->lock);
+  g_cond_clear (&job->cond);
+  g_clear_error (&job->error);
+  g_clear_error (&job->fetch_error);
+  g_free (job);
+}
+
+static gboolean
+content_stream_write (const guint8 *buf, gsize len, gpointer user_data, GError **error)
+{
+  ContentIngestJob *job = user_data;
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&job->lock);
+
+  /* The actual error is reported from content_ingest_done() */
+  if (job->failed)
+    return glnx_throw (error, "Writing content failed");
+  if (len == 0)
+    return TRUE;
+
+  /* Once spilling, everything goes there to keep the data in order */
+  if (!job->spill.initialized && job->queued_bytes + len > CONTENT_INGEST_MAX_QUEUED)
+    {
+      if (!glnx_open_anonymous_tmpfile (O_RDWR | O_CLOEXEC, &job->spill, error))
+        return FALSE;
+    }
+
+  if (job->spill.initialized)
+    {
+      if (glnx_loop_write (job->spill.fd, buf, len) < 0)
+        return glnx_throw_errno_prefix (error, "write");
+      job->spill_written += len;
+    }
+  else
+    {
+      g_queue_push_tail (&job->chunks, g_bytes_new (buf, len));
+      job->queued_bytes += len;
+    }
+
+  g_cond_signal (&job->cond);
+  return TRUE;
+}
+
+/* Back on the main loop once the worker is done with @user_data */
+static gboolean
+content_ingest_done (gpointer user_data)
+{
+  ContentIngestJob *job = user_data;
+  FetchObjectData *fetch_data = g_steal_pointer (&job->fetch_data);
+  OtPullData *pull_data = fetch_data->pull_data;
+  g_autoptr (GError) local_error = NULL;
+  const char *checksum;
+  OstreeObjectType objtype;
+  gboolean fetch_chunked = FALSE;
+
+  ostree_object_name_deserialize (fetch_data->object, &checksum, &objtype);
+  g_assert (objtype == OSTREE_OBJECT_TYPE_FILE);
+
+  /* If writing failed, that's also why the request was aborted */
+  if (job->error != NULL)
+    local_error = g_steal_pointer (&job->error);
+  else if (job->fetch_error != NULL)
+    {
+      local_error = g_steal_pointer (&job->fetch_error);
+      /* Chunked objects have no .filez in the remote */
+      if (pull_data->remote_chunked_files
+          && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        {
+          g_clear_error (&local_error);
+          fetch_chunked = TRUE;
+        }
+    }
+  else
+    {
+      _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_WRITE_CONTENT,
+                                 fetch_data->write_start_time);
+      pull_data->n_fetched_content++;
+      /* Was this a delta fallback? */
+      if (g_hash_table_remove (pull_data->requested_fallback_content, checksum))
+        pull_data->n_fetched_deltapart_fallbacks++;
+    }
+
+  g_assert (pull_data->n_outstanding_content_fetches > 0);
+  pull_data->n_outstanding_content_fetches--;
+  pull_concurrency_update (pull_data, fetch_data->start_time);
+
+  if (fetch_chunked)
+    start_fetch_chunked (pull_data,
+                         fetch_chunked_data_new (pull_data, g_steal_pointer (&fetch_data)));
+  else if (_ostree_fetcher_should_retry_request (local_error, fetch_data->n_retries_remaining--))
+    enqueue_one_object_request_s (pull_data, g_steal_pointer (&fetch_data));
+  else
+    check_outstanding_requests_handle_error (pull_data, &local_error);
+
+  g_clear_pointer (&fetch_data, fetch_object_data_free);
+  content_ingest_job_free (job);
+  return G_SOURCE_REMOVE;
+}
+
+/* Returns: (transfer full) (nullable): The next piece of received data, or
+ * %NULL once all of it was consumed
+ */
+static GBytes *
+content_ingest_job_next (ContentIngestJob *job, GError **error)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&job->lock);
+
+  while (g_queue_is_empty (&job->chunks) && job->spill_read == job->spill_written && !job->fetched)
+    g_cond_wait (&job->cond, &job->lock);
+
+  if (!g_queue_is_empty (&job->chunks))
+    {
+      GBytes *chunk = g_queue_pop_head (&job->chunks);
+      job->queued_bytes -= g_bytes_get_size (chunk);
+      return chunk;
+    }
+  if (job->spill_read == job->spill_written)
+    return NULL;
+
+  /* The spill file is only appended to, so read what's there without the lock */
+  const gsize len = MIN (job->spill_written - job->spill_read, 65536);
+  g_autofree guint8 *buf = g_malloc (len);
+  const guint64 offset = job->spill_read;
+  job->spill_read += len;
+  g_clear_pointer (&locker, g_mutex_locker_free);
+  if (pread (job->spill.fd, buf, len, offset) != (gssize)len)
+    {
+      glnx_throw_errno_prefix (error, "pread");
+      return NULL;
+    }
+  return g_bytes_new_take (g_steal_pointer (&buf), len);
+}
+
+/* Runs in pull_data->content_ingest_pool */
+static void
+content_ingest_worker (gpointer data, gpointer user_data)
+{
+  ContentIngestJob *job = data;
+  OtPullData *pull_data = user_data;
+
+  /* Keep consuming after errors, until the aborted request is complete */
+  while (TRUE)
+    {
+      g_autoptr (GError) local_error = NULL;
+      g_autoptr (GBytes) chunk = content_ingest_job_next (job, &local_error);
+      if (chunk == NULL && local_error == NULL)
+        break;
+      if (job->error != NULL)
+        continue;
+
+      if (chunk != NULL)
+        {
+          gsize len;
+          const guint8 *buf = g_bytes_get_data (chunk, &len);
+          (void)_ostree_repo_content_ingest_write (job->ingest, buf, len, &local_error);
+        }
+      if (local_error != NULL)
+        {
+          job->error = g_steal_pointer (&local_error);
+          g_mutex_lock (&job->lock);
+          job->failed = TRUE;
+          g_mutex_unlock (&job->lock);
+        }
+    }
+
+  if (job->error == NULL && job->fetch_error == NULL)
+    {
+      g_autofree char *checksum_obj = NULL;
+      const char *checksum;
+      OstreeObjectType objtype;
+
+      ostree_object_name_deserialize (job->fetch_data->object, &checksum, &objtype);
+      checksum_obj = ostree_object_to_string (checksum, objtype);
+      g_debug ("fetch of %s complete", checksum_obj);
+
+      job->fetch_data->write_start_time = g_get_monotonic_time ();
+      if (!_ostree_repo_content_ingest_commit (job->ingest, pull_data->cancellable, &job->error))
+        g_prefix_error (&job->error, "Writing %s: ", checksum_obj);
+    }
+
+  g_main_context_invoke (pull_data->main_context, content_ingest_done, job);
+}
+
+static void
+content_stream_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_data)
+{
+  OstreeFetcher *fetcher = (OstreeFetcher *)object;
+  ContentIngestJob *job = user_data;
+  OtPullData *pull_data = job->fetch_data->pull_data;
+  g_autoptr (GError) local_error = NULL;
+
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_FETCH_CONTENT,
+                             job->fetch_data->start_time);
+
+  (void)_ostree_fetcher_request_to_stream_finish (fetcher, result, &local_error);
+
+  /* The worker finishes up, then calls content_ingest_done() */
+  g_mutex_lock (&job->lock);
+  job->fetch_error = g_steal_pointer (&local_error);
+  job->fetched = TRUE;
+  g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->lock);
+}
+
 static void
 on_metadata_written (GObject *object, GAsyncResult *result, gpointer user_data)
 {
@@ -1016,6 +1572,9 @@ on_metadata_written (GObject *object, GAsyncResult *result, gpointer user_data)
   g_autofree guchar *csum = NULL;
   g_autofree char *stringified_object = NULL;
 
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_WRITE_METADATA,
+                             fetch_data->write_start_time);
+
   if (!ostree_repo_write_metadata_finish ((OstreeRepo *)object, result, &csum, error))
     goto out;
 
@@ -1080,6 +1639,7 @@ meta_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_dat
   checksum_obj = ostree_object_to_string (checksum, objtype);
   g_debug ("fetch of %s%s complete", checksum_obj,
            fetch_data->is_detached_meta ? " (detached)" : "");
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_FETCH_METADATA, fetch_data->start_time);
 
   if (!_ostree_fetcher_request_to_tmpfile_finish (fetcher, result, &tmpf, NULL, NULL, NULL, error))
     {
@@ -1192,6 +1752,7 @@ meta_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_dat
        * just `glnx_link_tmpfile_at()` into the repository, like the content
        * fetch path does for trusted commits.
        */
+      fetch_data->write_start_time = g_get_monotonic_time ();
       ostree_repo_write_metadata_async (pull_data->repo, objtype, NULL, metadata,
                                         pull_data->cancellable, on_metadata_written, fetch_data);
       pull_data->n_outstanding_metadata_write_requests++;
@@ -1199,19 +1760,885 @@ meta_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_dat
     }
 
 out:
-  g_assert (pull_data->n_outstanding_metadata_fetches > 0);
-  pull_data->n_outstanding_metadata_fetches--;
+  g_assert (pull_data->n_outstanding_metadata_fetches > 0);
+  pull_data->n_outstanding_metadata_fetches--;
+  pull_concurrency_update (pull_data, fetch_data->start_time);
+
+  if (local_error == NULL && !was_enoent)
+    pull_data->n_fetched_metadata++;
+
+  if (_ostree_fetcher_should_retry_request (local_error, fetch_data->n_retries_remaining--))
+    enqueue_one_object_request_s (pull_data, g_steal_pointer (&fetch_data));
+  else
+    check_outstanding_requests_handle_error (pull_data, &local_error);
+
+  if (free_fetch_data)
+    g_clear_pointer (&fetch_data, fetch_object_data_free);
+}
+
+static const RemotePackEntry *
+lookup_remote_pack_entry (OtPullData *pull_data, FetchObjectData *fetch_data)
+{
+  if (fetch_data->is_detached_meta)
+    return NULL;
+  return g_hash_table_lookup (pull_data->remote_packs, fetch_data->object);
+}
+
+static gboolean
+fetch_object_data_is_meta (FetchObjectData *fetch_data)
+{
+  const char *checksum;
+  OstreeObjectType objtype;
+
+  ostree_object_name_deserialize (fetch_data->object, &checksum, &objtype);
+  return OSTREE_OBJECT_TYPE_IS_META (objtype);
+}
+
+static void
+fetch_pack_batch_data_free (FetchPackBatchData *batch)
+{
+  for (guint i = 0; i < batch->objects->len; i++)
+    g_clear_pointer (&batch->objects->pdata[i], fetch_object_data_free);
+  g_ptr_array_unref (batch->objects);
+  g_free (batch);
+}
+
+static void
+pending_fetch_packed_clear (OtPullData *pull_data)
+{
+  for (guint i = 0; i < pull_data->pending_fetch_packed->len; i++)
+    fetch_object_data_free (pull_data->pending_fetch_packed->pdata[i]);
+  g_ptr_array_set_size (pull_data->pending_fetch_packed, 0);
+  for (guint i = 0; i < pull_data->pending_fetch_pack_indexes->len; i++)
+    fetch_object_data_free (pull_data->pending_fetch_pack_indexes->pdata[i]);
+  g_ptr_array_set_size (pull_data->pending_fetch_pack_indexes, 0);
+  for (guint i = 0; i < pull_data->pending_fetch_pack_index_data->len; i++)
+    g_free (pull_data->pending_fetch_pack_index_data->pdata[i]);
+  g_ptr_array_set_size (pull_data->pending_fetch_pack_index_data, 0);
+}
+
+/* Verify one object sliced out of a pack batch, and start writing it; on
+ * success, ownership of @fetch_data is transferred to the write.
+ */
+static gboolean
+write_packed_object (OtPullData *pull_data, FetchObjectData *fetch_data, GBytes *data,
+                     GError **error)
+{
+  const char *checksum;
+  OstreeObjectType objtype;
+
+  ostree_object_name_deserialize (fetch_data->object, &checksum, &objtype);
+  g_debug ("fetch of %s.%s complete (packed)", checksum, ostree_object_type_to_string (objtype));
+
+  if (OSTREE_OBJECT_TYPE_IS_META (objtype))
+    {
+      /* Only dirtree and dirmeta objects are accepted from remote pack indexes,
+       * so there are no signatures to check here; see add_remote_pack_index().
+       */
+      g_autoptr (GVariant) metadata = g_variant_ref_sink (
+          g_variant_new_from_bytes (ostree_metadata_variant_type (objtype), data, FALSE));
+      if (!_ostree_verify_metadata_object (objtype, checksum, metadata, error))
+        return FALSE;
+
+      fetch_data->write_start_time = g_get_monotonic_time ();
+      ostree_repo_write_metadata_async (pull_data->repo, objtype, NULL, metadata,
+                                        pull_data->cancellable, on_metadata_written, fetch_data);
+      pull_data->n_outstanding_metadata_write_requests++;
+      pull_data->n_fetched_metadata++;
+    }
+  else
+    {
+      g_autoptr (GInputStream) input = g_memory_input_stream_new_from_bytes (data);
+      if (!write_fetched_content (pull_data, fetch_data, input, g_bytes_get_size (data), error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void start_fetch_pack_batch (OtPullData *pull_data, FetchPackBatchData *batch);
+
+static void
+pack_batch_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_data)
+{
+  OstreeFetcher *fetcher = (OstreeFetcher *)object;
+  FetchPackBatchData *batch = user_data;
+  OtPullData *pull_data = batch->pull_data;
+  g_autoptr (GBytes) data = NULL;
+  g_autoptr (GError) local_error = NULL;
+  GError **error = &local_error;
+
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_FETCH_PACK, batch->start_time);
+
+  if (!_ostree_fetcher_request_to_membuf_finish (fetcher, result, &data, NULL, NULL, NULL, error))
+    goto out;
+
+  g_debug ("fetch of %u objects from pack %s complete", batch->objects->len,
+           (char *)pull_data->remote_pack_names->pdata[batch->pack_idx]);
+
+  if (g_bytes_get_size (data) != batch->length)
+    {
+      glnx_throw (error, "Expected %" G_GUINT64_FORMAT " bytes from pack %s, got %" G_GSIZE_FORMAT,
+                  batch->length, (char *)pull_data->remote_pack_names->pdata[batch->pack_idx],
+                  g_bytes_get_size (data));
+      goto out;
+    }
+
+  for (guint i = 0; i < batch->objects->len; i++)
+    {
+      FetchObjectData *fetch_data = batch->objects->pdata[i];
+      /* Already written by an earlier attempt */
+      if (fetch_data == NULL)
+        continue;
+
+      const RemotePackEntry *entry = lookup_remote_pack_entry (pull_data, fetch_data);
+      g_assert (entry != NULL);
+      g_autoptr (GBytes) object_data
+          = g_bytes_new_from_bytes (data, entry->offset - batch->offset, entry->size);
+      if (!write_packed_object (pull_data, fetch_data, object_data, error))
+        goto out;
+      batch->objects->pdata[i] = NULL;
+    }
+
+out:
+  if (batch->is_meta)
+    {
+      g_assert (pull_data->n_outstanding_metadata_fetches > 0);
+      pull_data->n_outstanding_metadata_fetches--;
+    }
+  else
+    {
+      g_assert (pull_data->n_outstanding_content_fetches > 0);
+      pull_data->n_outstanding_content_fetches--;
+    }
+  pull_concurrency_update (pull_data, batch->start_time);
+
+  if (_ostree_fetcher_should_retry_request (local_error, batch->n_retries_remaining--))
+    start_fetch_pack_batch (pull_data, g_steal_pointer (&batch));
+  else
+    check_outstanding_requests_handle_error (pull_data, &local_error);
+
+  if (batch)
+    fetch_pack_batch_data_free (batch);
+}
+
+static void
+start_fetch_pack_batch (OtPullData *pull_data, FetchPackBatchData *batch)
+{
+  const char *pack_name = pull_data->remote_pack_names->pdata[batch->pack_idx];
+  g_autofree char *pack_subpath
+      = g_strdup_printf ("objects/%s/%s.pack", _OSTREE_PACK_DIR, pack_name);
+
+  g_debug ("starting fetch of %u objects from pack %s", batch->objects->len, pack_name);
+
+  if (batch->is_meta)
+    pull_data->n_outstanding_metadata_fetches++;
+  else
+    pull_data->n_outstanding_content_fetches++;
+  batch->start_time = g_get_monotonic_time ();
+
+  _ostree_fetcher_request_range_to_membuf (
+      pull_data->fetcher, pull_data->content_mirrorlist, pack_subpath, 0, batch->offset,
+      batch->length,
+      batch->is_meta ? OSTREE_REPO_PULL_METADATA_PRIORITY : OSTREE_REPO_PULL_CONTENT_PRIORITY,
+      pull_data->cancellable, pack_batch_fetch_on_complete, batch);
+}
+
+/* Order pending packed objects so that neighbours in the same pack are
+ * adjacent, with metadata first since scanning it yields more requests.
+ */
+static gint
+compare_pending_packed (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  OtPullData *pull_data = user_data;
+  FetchObjectData *fetch_a = *(FetchObjectData **)a;
+  FetchObjectData *fetch_b = *(FetchObjectData **)b;
+  const gboolean is_meta_a = fetch_object_data_is_meta (fetch_a);
+  const gboolean is_meta_b = fetch_object_data_is_meta (fetch_b);
+  const RemotePackEntry *entry_a = lookup_remote_pack_entry (pull_data, fetch_a);
+  const RemotePackEntry *entry_b = lookup_remote_pack_entry (pull_data, fetch_b);
+
+  if (is_meta_a != is_meta_b)
+    return is_meta_a ? -1 : 1;
+  if (entry_a->pack_idx != entry_b->pack_idx)
+    return entry_a->pack_idx < entry_b->pack_idx ? -1 : 1;
+  if (entry_a->offset != entry_b->offset)
+    return entry_a->offset < entry_b->offset ? -1 : 1;
+  return 0;
+}
+
+/* Coalesce runs of pending packed objects which are close together in the
+ * same pack into single range requests, as long as the fetcher has capacity.
+ */
+static void
+start_pack_batches (OtPullData *pull_data)
+{
+  GPtrArray *pending = pull_data->pending_fetch_packed;
+  guint i = 0;
+
+  g_ptr_array_sort_with_data (pending, compare_pending_packed, pull_data);
+
+  while (i < pending->len && !fetcher_queue_is_full (pull_data))
+    {
+      FetchObjectData *first = pending->pdata[i];
+      const RemotePackEntry *first_entry = lookup_remote_pack_entry (pull_data, first);
+      const gboolean is_meta = fetch_object_data_is_meta (first);
+      guint64 end = first_entry->offset + first_entry->size;
+      guint j;
+
+      for (j = i + 1; j < pending->len && j - i < PACK_BATCH_MAX_OBJECTS; j++)
+        {
+          FetchObjectData *fetch_data = pending->pdata[j];
+          const RemotePackEntry *entry = lookup_remote_pack_entry (pull_data, fetch_data);
+
+          if (fetch_object_data_is_meta (fetch_data) != is_meta
+              || entry->pack_idx != first_entry->pack_idx || entry->offset < end
+              || entry->offset - end > PACK_BATCH_MAX_GAP
+              || entry->offset + entry->size - first_entry->offset > PACK_BATCH_MAX_LENGTH)
+            break;
+          end = entry->offset + entry->size;
+        }
+
+      if (j - i == 1)
+        {
+          /* This takes ownership of the value */
+          start_fetch (pull_data, first);
+        }
+      else
+        {
+          FetchPackBatchData *batch = g_new0 (FetchPackBatchData, 1);
+          batch->pull_data = pull_data;
+          batch->pack_idx = first_entry->pack_idx;
+          batch->offset = first_entry->offset;
+          batch->length = end - first_entry->offset;
+          batch->is_meta = is_meta;
+          batch->objects = g_ptr_array_sized_new (j - i);
+          for (guint k = i; k < j; k++)
+            g_ptr_array_add (batch->objects, pending->pdata[k]);
+          batch->n_retries_remaining = pull_data->n_network_retries;
+          start_fetch_pack_batch (pull_data, batch);
+        }
+
+      i = j;
+    }
+
+  if (i < pending->len)
+    pull_fetch_deferred (pull_data);
+
+  /* The requests started above own these now */
+  g_ptr_array_remove_range (pending, 0, i);
+}
+
+/* Called out of the main loop to start fetching objects waiting in
+ * pending_fetch_packed.  While metadata is still being scanned, wait for more
+ * requests to accumulate so they can be coalesced.
+ */
+static gboolean
+pack_batch_idle_worker (gpointer user_data)
+{
+  OtPullData *pull_data = user_data;
+
+  g_clear_pointer (&pull_data->pack_batch_idle_src, g_source_destroy);
+
+  if (pull_data->caught_error || pull_data->pending_fetch_packed->len == 0)
+    return G_SOURCE_REMOVE;
+  if (fetcher_queue_is_full (pull_data))
+    {
+      pull_fetch_deferred (pull_data);
+      return G_SOURCE_REMOVE;
+    }
+
+  /* We're queued again by check_outstanding_requests_handle_error() after
+   * each scanned object and each completed fetch, so just wait for those.
+   */
+  if (!g_queue_is_empty (&pull_data->scan_object_queue)
+      && pull_data->pending_fetch_packed->len < PACK_BATCH_MAX_OBJECTS)
+    {
+      ensure_idle_queued (pull_data);
+      return G_SOURCE_REMOVE;
+    }
+
+  start_pack_batches (pull_data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ensure_pack_batch_queued (OtPullData *pull_data)
+{
+  GSource *idle_src;
+
+  if (pull_data->pack_batch_idle_src)
+    return;
+
+  idle_src = g_idle_source_new ();
+  g_source_set_callback (idle_src, pack_batch_idle_worker, pull_data, NULL);
+  g_source_attach (idle_src, pull_data->main_context);
+  pull_data->pack_batch_idle_src = idle_src;
+  /* Ownership is transferred to pull_data */
+  g_source_unref (idle_src);
+}
+
+/* Add the objects listed in the index of remote pack @pack_idx to
+ * pull_data->remote_packs.
+ */
+static gboolean
+add_remote_pack_index (OtPullData *pull_data, guint pack_idx, GBytes *index_bytes, GError **error)
+{
+  const char *pack_name = pull_data->remote_pack_names->pdata[pack_idx];
+  g_autoptr (GVariant) index = g_variant_ref_sink (
+      g_variant_new_from_bytes (_OSTREE_PACK_INDEX_GVARIANT_FORMAT, index_bytes, FALSE));
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (index, 0);
+  g_autoptr (GVariant) entries = g_variant_get_child_value (index, 1);
+
+  guint64 pack_size;
+  if (!g_variant_lookup (metadata, _OSTREE_PACK_META_KEY_SIZE, "t", &pack_size))
+    return glnx_throw (error, "Index of pack %s is missing %s", pack_name,
+                       _OSTREE_PACK_META_KEY_SIZE);
+
+  const gsize n_entries = g_variant_n_children (entries);
+  for (gsize i = 0; i < n_entries; i++)
+    {
+      g_autoptr (GVariant) csum_v = NULL;
+      guchar objtype;
+      guint64 offset, size;
+
+      g_variant_get_child (entries, i, "(@ayytt)", &csum_v, &objtype, &offset, &size);
+      const guchar *csum = ostree_checksum_bytes_peek_validate (csum_v, error);
+      if (!csum)
+        return glnx_prefix_error (error, "Index of pack %s", pack_name);
+
+      /* Packs only ever hold these; in particular we must not accept commits
+       * from here, since batched objects skip signature verification.
+       */
+      if (objtype != OSTREE_OBJECT_TYPE_FILE && objtype != OSTREE_OBJECT_TYPE_DIR_TREE
+          && objtype != OSTREE_OBJECT_TYPE_DIR_META)
+        continue;
+      /* These are used for range requests and to slice batches, so must be
+       * within the pack.
+       */
+      if (offset > pack_size || size > pack_size - offset)
+        return glnx_throw (error,
+                           "Index of pack %s: entry at offset %" G_GUINT64_FORMAT
+                           " of size %" G_GUINT64_FORMAT " is outside the pack",
+                           pack_name, offset, size);
+      if (size == 0)
+        continue;
+
+      RemotePackEntry *entry = g_new0 (RemotePackEntry, 1);
+      entry->pack_idx = pack_idx;
+      entry->offset = offset;
+      entry->size = size;
+
+      char checksum[OSTREE_SHA256_STRING_LEN + 1];
+      ostree_checksum_inplace_from_bytes (csum, checksum);
+      g_hash_table_replace (pull_data->remote_packs,
+                            ostree_object_name_serialize (checksum, objtype), entry);
+    }
+
+  return TRUE;
+}
+
+/* Start fetching the index of a remote pack if the fetcher has capacity, or
+ * queue it for check_outstanding_requests_handle_error().  Takes ownership
+ * of @fetch.
+ */
+static void
+enqueue_one_pack_index_request_s (OtPullData *pull_data, FetchPackIndexData *fetch)
+{
+  if (fetcher_queue_is_full (pull_data))
+    {
+      g_debug ("queuing fetch of index of pack %s",
+               (char *)pull_data->remote_pack_names->pdata[fetch->pack_idx]);
+      pull_fetch_deferred (pull_data);
+
+      g_ptr_array_add (pull_data->pending_fetch_pack_index_data, fetch);
+    }
+  else
+    {
+      start_fetch_pack_index (pull_data, fetch);
+    }
+}
+
+static void
+pack_index_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_data)
+{
+  OstreeFetcher *fetcher = (OstreeFetcher *)object;
+  FetchPackIndexData *fetch = user_data;
+  OtPullData *pull_data = fetch->pull_data;
+  g_autoptr (GBytes) index_bytes = NULL;
+  g_autoptr (GError) local_error = NULL;
+  GError **error = &local_error;
+
+  if (!_ostree_fetcher_request_to_membuf_finish (fetcher, result, &index_bytes, NULL, NULL, NULL,
+                                                 error))
+    {
+      glnx_prefix_error (error, "Fetching index of pack %s",
+                         (char *)pull_data->remote_pack_names->pdata[fetch->pack_idx]);
+      goto out;
+    }
+
+  if (!add_remote_pack_index (pull_data, fetch->pack_idx, index_bytes, error))
+    goto out;
+
+  g_assert_cmpuint (pull_data->n_remote_pack_indexes_pending, >, 0);
+  pull_data->n_remote_pack_indexes_pending--;
+  if (pull_data->n_remote_pack_indexes_pending == 0)
+    {
+      g_debug ("pull: %u objects available from %u remote packs",
+               g_hash_table_size (pull_data->remote_packs), pull_data->remote_pack_names->len);
+      pull_data->remote_packs_loaded = TRUE;
+
+      /* Now they can be routed to pack batches or plain fetches */
+      g_autoptr (GPtrArray) waiting = g_steal_pointer (&pull_data->pending_fetch_pack_indexes);
+      pull_data->pending_fetch_pack_indexes = g_ptr_array_new ();
+      for (guint i = 0; i < waiting->len; i++)
+        enqueue_one_object_request_s (pull_data, waiting->pdata[i]);
+    }
+
+out:
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_FETCH_METADATA, fetch->start_time);
+  g_assert (pull_data->n_outstanding_metadata_fetches > 0);
+  pull_data->n_outstanding_metadata_fetches--;
+
+  if (local_error == NULL)
+    pull_data->n_fetched_metadata++;
+
+  if (_ostree_fetcher_should_retry_request (local_error, fetch->n_retries_remaining--))
+    enqueue_one_pack_index_request_s (pull_data, g_steal_pointer (&fetch));
+  else
+    check_outstanding_requests_handle_error (pull_data, &local_error);
+
+  g_free (fetch);
+}
+
+static void
+start_fetch_pack_index (OtPullData *pull_data, FetchPackIndexData *fetch)
+{
+  g_autofree char *index_subpath
+      = g_strdup_printf ("objects/%s/%s.index", _OSTREE_PACK_DIR,
+                         (char *)pull_data->remote_pack_names->pdata[fetch->pack_idx]);
+
+  g_debug ("starting fetch of pack index %s", index_subpath);
+  fetch->start_time = g_get_monotonic_time ();
+  _ostree_fetcher_request_to_membuf (pull_data->fetcher, pull_data->content_mirrorlist,
+                                     index_subpath, 0, NULL, 0, pull_data->max_metadata_size,
+                                     OSTREE_REPO_PULL_METADATA_PRIORITY, pull_data->cancellable,
+                                     pack_index_fetch_on_complete, fetch);
+  pull_data->n_outstanding_metadata_fetches++;
+  pull_data->n_requested_metadata++;
+}
+
+/* Objects may only be routed once the indexes of the remote packs are known.
+ * They are fetched the first time an object which could be in a pack is
+ * requested, so pulls which need no objects (or get them all from deltas)
+ * don't download any.  Returns %TRUE if @fetch_data was parked until then.
+ */
+static gboolean
+wait_for_remote_packs (OtPullData *pull_data, FetchObjectData *fetch_data)
+{
+  if (pull_data->remote_packs_loaded || pull_data->remote_pack_names->len == 0
+      || fetch_data->is_detached_meta)
+    return FALSE;
+
+  const char *checksum;
+  OstreeObjectType objtype;
+  ostree_object_name_deserialize (fetch_data->object, &checksum, &objtype);
+  if (objtype == OSTREE_OBJECT_TYPE_COMMIT)
+    return FALSE;
+
+  g_ptr_array_add (pull_data->pending_fetch_pack_indexes, fetch_data);
+
+  if (!pull_data->remote_packs_requested)
+    {
+      pull_data->remote_packs_requested = TRUE;
+      pull_data->n_remote_pack_indexes_pending = pull_data->remote_pack_names->len;
+      for (guint i = 0; i < pull_data->remote_pack_names->len; i++)
+        {
+          FetchPackIndexData *fetch = g_new0 (FetchPackIndexData, 1);
+          fetch->pull_data = pull_data;
+          fetch->pack_idx = i;
+          fetch->n_retries_remaining = pull_data->n_network_retries;
+          enqueue_one_pack_index_request_s (pull_data, fetch);
+        }
+    }
+
+  return TRUE;
+}
+
+static FetchChunkedData *
+fetch_chunked_data_new (OtPullData *pull_data, FetchObjectData *fetch_data)
+{
+  FetchChunkedData *chunked = g_new0 (FetchChunkedData, 1);
+  chunked->pull_data = pull_data;
+  chunked->fetch_data = fetch_data;
+  chunked->n_retries_remaining = pull_data->n_network_retries;
+  return chunked;
+}
+
+static void
+fetch_chunked_data_free (FetchChunkedData *chunked)
+{
+  g_clear_pointer (&chunked->fetch_data, fetch_object_data_free);
+  g_clear_pointer (&chunked->descriptor, g_variant_unref);
+  g_free (chunked);
+}
+
+static void
+write_chunked_in_thread (GTask *task, gpointer source, gpointer task_data,
+                         GCancellable *cancellable)
+{
+  FetchChunkedData *chunked = task_data;
+  g_autoptr (GError) local_error = NULL;
+  const char *checksum;
+  OstreeObjectType objtype;
+
+  ostree_object_name_deserialize (chunked->fetch_data->object, &checksum, &objtype);
+  if (!_ostree_repo_write_chunked_file (chunked->pull_data->repo, checksum, chunked->descriptor,
+                                        cancellable, &local_error))
+    g_task_return_error (task, g_steal_pointer (&local_error));
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+on_chunked_written (GObject *object, GAsyncResult *result, gpointer user_data)
+{
+  OtPullData *pull_data = user_data;
+  FetchChunkedData *chunked = g_task_get_task_data ((GTask *)result);
+  g_autoptr (GError) local_error = NULL;
+  const char *checksum;
+  OstreeObjectType objtype;
+
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_WRITE_CONTENT, chunked->start_time);
+
+  if (g_task_propagate_boolean ((GTask *)result, &local_error))
+    {
+      ostree_object_name_deserialize (chunked->fetch_data->object, &checksum, &objtype);
+      g_debug ("write of chunked %s complete", checksum);
+      pull_data->n_fetched_content++;
+      /* Was this a delta fallback? */
+      if (g_hash_table_remove (pull_data->requested_fallback_content, checksum))
+        pull_data->n_fetched_deltapart_fallbacks++;
+    }
+
+  g_assert_cmpint (pull_data->n_outstanding_content_write_requests, >, 0);
+  pull_data->n_outstanding_content_write_requests--;
+  /* No retries for local writes. */
+  check_outstanding_requests_handle_error (pull_data, &local_error);
+}
+
+/* Reassemble a chunked object once all its chunks are stored, in a thread
+ * since that also checksums the content.  Takes ownership of @chunked.
+ */
+static void
+start_write_chunked (OtPullData *pull_data, FetchChunkedData *chunked)
+{
+  g_autoptr (GError) local_error = NULL;
+  const char *checksum;
+  OstreeObjectType objtype;
+
+  ostree_object_name_deserialize (chunked->fetch_data->object, &checksum, &objtype);
+
+  if ((pull_data->importflags & _OSTREE_REPO_IMPORT_FLAGS_VERIFY_BAREUSERONLY) > 0)
+    {
+      g_autoptr (GFileInfo) file_info = NULL;
+      if (!_ostree_repo_chunked_file_parse (pull_data->repo, chunked->descriptor, NULL, &file_info,
+                                            NULL, &local_error)
+          || !_ostree_validate_bareuseronly_mode_finfo (file_info, checksum, &local_error))
+        {
+          fetch_chunked_data_free (chunked);
+          check_outstanding_requests_handle_error (pull_data, &local_error);
+          return;
+        }
+    }
+
+  pull_data->n_outstanding_content_write_requests++;
+  chunked->start_time = g_get_monotonic_time ();
+  g_autoptr (GTask) task
+      = g_task_new (pull_data->repo, pull_data->cancellable, on_chunked_written, pull_data);
+  g_task_set_source_tag (task, start_write_chunked);
+  g_task_set_task_data (task, chunked, (GDestroyNotify)fetch_chunked_data_free);
+  g_task_run_in_thread (task, write_chunked_in_thread);
+}
+
+/* Called when one of the chunk fetches of @chunked is done; the last one
+ * starts writing the object.
+ */
+static void
+chunked_chunk_done (OtPullData *pull_data, FetchChunkedData *chunked)
+{
+  g_assert_cmpuint (chunked->n_pending_chunks, >, 0);
+  if (--chunked->n_pending_chunks > 0)
+    return;
+
+  if (chunked->failed)
+    fetch_chunked_data_free (chunked);
+  else
+    start_write_chunked (pull_data, chunked);
+}
+
+static void
+fetch_chunk_data_free (FetchChunkData *chunk)
+{
+  g_clear_pointer (&chunk->data, g_bytes_unref);
+  g_free (chunk);
+}
+
+/* Drop chunk fetches which haven't been started, failing their objects */
+static void
+pending_fetch_chunks_clear (OtPullData *pull_data)
+{
+  for (guint i = 0; i < pull_data->pending_fetch_chunks->len; i++)
+    {
+      FetchChunkData *chunk = pull_data->pending_fetch_chunks->pdata[i];
+      FetchChunkedData *chunked = chunk->chunked;
+
+      fetch_chunk_data_free (chunk);
+      chunked->failed = TRUE;
+      chunked_chunk_done (pull_data, chunked);
+    }
+  g_ptr_array_set_size (pull_data->pending_fetch_chunks, 0);
+}
+
+/* Start fetching @chunk if the fetcher has capacity, or queue it for
+ * check_outstanding_requests_handle_error().  Takes ownership of @chunk.
+ */
+static void
+enqueue_one_chunk_request_s (OtPullData *pull_data, FetchChunkData *chunk)
+{
+  if (fetcher_queue_is_full (pull_data))
+    {
+      g_debug ("queuing fetch of chunk %s", chunk->digest);
+      pull_fetch_deferred (pull_data);
+
+      g_ptr_array_add (pull_data->pending_fetch_chunks, chunk);
+    }
+  else
+    {
+      start_fetch_chunk (pull_data, chunk);
+    }
+}
+
+static void
+write_chunk_in_thread (GTask *task, gpointer source, gpointer task_data,
+                       GCancellable *cancellable)
+{
+  FetchChunkData *chunk = task_data;
+  g_autoptr (GError) local_error = NULL;
+
+  if (!_ostree_repo_write_chunk (chunk->chunked->pull_data->repo, chunk->digest, chunk->size,
+                                 chunk->data, cancellable, &local_error))
+    g_task_return_error (task, g_steal_pointer (&local_error));
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+on_chunk_written (GObject *object, GAsyncResult *result, gpointer user_data)
+{
+  OtPullData *pull_data = user_data;
+  FetchChunkData *chunk = g_task_get_task_data ((GTask *)result);
+  FetchChunkedData *chunked = chunk->chunked;
+  g_autoptr (GError) local_error = NULL;
+
+  if (g_task_propagate_boolean ((GTask *)result, &local_error))
+    g_debug ("write of chunk %s complete", chunk->digest);
+  else
+    chunked->failed = TRUE;
+
+  g_assert_cmpint (pull_data->n_outstanding_content_write_requests, >, 0);
+  pull_data->n_outstanding_content_write_requests--;
+  chunked_chunk_done (pull_data, chunked);
+  /* No retries for local writes. */
+  check_outstanding_requests_handle_error (pull_data, &local_error);
+}
+
+/* Verify and store a fetched chunk in a thread, since that decompresses
+ * and checksums up to 16 MiB of data.  Takes ownership of @chunk.
+ */
+static void
+start_write_chunk (OtPullData *pull_data, FetchChunkData *chunk)
+{
+  pull_data->n_outstanding_content_write_requests++;
+  g_autoptr (GTask) task
+      = g_task_new (pull_data->repo, pull_data->cancellable, on_chunk_written, pull_data);
+  g_task_set_source_tag (task, start_write_chunk);
+  g_task_set_task_data (task, chunk, (GDestroyNotify)fetch_chunk_data_free);
+  g_task_run_in_thread (task, write_chunk_in_thread);
+}
+
+static void
+chunk_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_data)
+{
+  OstreeFetcher *fetcher = (OstreeFetcher *)object;
+  FetchChunkData *chunk = user_data;
+  FetchChunkedData *chunked = chunk->chunked;
+  OtPullData *pull_data = chunked->pull_data;
+  g_autoptr (GError) local_error = NULL;
+
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_FETCH_CONTENT, chunk->start_time);
+
+  const gboolean fetched = _ostree_fetcher_request_to_membuf_finish (
+      fetcher, result, &chunk->data, NULL, NULL, NULL, &local_error);
+
+  g_assert (pull_data->n_outstanding_content_fetches > 0);
+  pull_data->n_outstanding_content_fetches--;
+  pull_concurrency_update (pull_data, chunk->start_time);
+
+  if (fetched)
+    {
+      g_debug ("fetch of chunk %s complete", chunk->digest);
+      start_write_chunk (pull_data, chunk);
+      return;
+    }
+
+  if (_ostree_fetcher_should_retry_request (local_error, chunk->n_retries_remaining--))
+    {
+      enqueue_one_chunk_request_s (pull_data, chunk);
+      return;
+    }
+
+  fetch_chunk_data_free (chunk);
+  chunked->failed = TRUE;
+  chunked_chunk_done (pull_data, chunked);
+  check_outstanding_requests_handle_error (pull_data, &local_error);
+}
+
+static void
+start_fetch_chunk (OtPullData *pull_data, FetchChunkData *chunk)
+{
+  g_autofree char *chunk_subpath = g_strdup_printf ("objects/%s/%.2s/%s.chunk", _OSTREE_CHUNK_DIR,
+                                                    chunk->digest, chunk->digest + 2);
+
+  g_debug ("starting fetch of chunk %s", chunk->digest);
+
+  pull_data->n_outstanding_content_fetches++;
+  chunk->start_time = g_get_monotonic_time ();
+
+  /* Allow for chunks which don't compress */
+  const guint64 max_size = chunk->size + chunk->size / 1000 + 1024;
+  _ostree_fetcher_request_to_membuf (pull_data->fetcher, pull_data->content_mirrorlist,
+                                     chunk_subpath, 0, NULL, 0, max_size,
+                                     OSTREE_REPO_PULL_CONTENT_PRIORITY, pull_data->cancellable,
+                                     chunk_fetch_on_complete, chunk);
+}
+
+/* Fetch the chunks of @chunked we don't have yet, as capacity allows */
+static gboolean
+start_fetch_chunks (OtPullData *pull_data, FetchChunkedData *chunked, GError **error)
+{
+  g_autoptr (GHashTable) seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_autoptr (GVariant) chunks = g_variant_get_child_value (chunked->descriptor, 5);
+  guint n_fetched = 0;
+
+  const gsize n_chunks = g_variant_n_children (chunks);
+  for (gsize i = 0; i < n_chunks; i++)
+    {
+      g_autoptr (GVariant) digest_v = NULL;
+      guint64 size;
+      g_variant_get_child (chunks, i, "(@ayt)", &digest_v, &size);
+      g_autofree char *digest = ostree_checksum_from_bytes_v (digest_v);
+      if (g_hash_table_contains (seen, digest))
+        continue;
+
+      gboolean have_chunk = FALSE;
+      if (!_ostree_repo_has_chunk (pull_data->repo, digest, &have_chunk, error))
+        return FALSE;
+      if (!have_chunk)
+        {
+          FetchChunkData *chunk = g_new0 (FetchChunkData, 1);
+          chunk->chunked = chunked;
+          memcpy (chunk->digest, digest, OSTREE_SHA256_STRING_LEN);
+          chunk->size = GUINT64_FROM_BE (size);
+          chunk->n_retries_remaining = pull_data->n_network_retries;
+          chunked->n_pending_chunks++;
+          enqueue_one_chunk_request_s (pull_data, chunk);
+          n_fetched++;
+        }
+      g_hash_table_add (seen, g_steal_pointer (&digest));
+    }
+
+  g_debug ("fetching %u of %u distinct chunks", n_fetched, g_hash_table_size (seen));
+  return TRUE;
+}
+
+static void
+chunked_descriptor_fetch_on_complete (GObject *object, GAsyncResult *result, gpointer user_data)
+{
+  OstreeFetcher *fetcher = (OstreeFetcher *)object;
+  FetchChunkedData *chunked = user_data;
+  OtPullData *pull_data = chunked->pull_data;
+  g_autoptr (GBytes) data = NULL;
+  g_autoptr (GError) local_error = NULL;
+  GError **error = &local_error;
+  const char *checksum;
+  OstreeObjectType objtype;
+  gboolean fetched = FALSE;
+
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_FETCH_CONTENT, chunked->start_time);
+
+  ostree_object_name_deserialize (chunked->fetch_data->object, &checksum, &objtype);
+
+  if (!_ostree_fetcher_request_to_membuf_finish (fetcher, result, &data, NULL, NULL, NULL, error))
+    goto out;
+  fetched = TRUE;
+
+  g_debug ("fetch of chunked %s complete", checksum);
+
+  {
+    g_autoptr (GVariant) descriptor = g_variant_ref_sink (
+        g_variant_new_from_bytes (_OSTREE_CHUNKED_FILE_GVARIANT_FORMAT, data, FALSE));
+    if (!_ostree_chunked_file_validate (descriptor, error))
+      {
+        glnx_prefix_error (error, "Chunked object %s", checksum);
+        goto out;
+      }
+    chunked->descriptor = g_steal_pointer (&descriptor);
+  }
+
+  /* Hold a reference of our own while starting the chunk fetches */
+  chunked->n_pending_chunks = 1;
+  if (!start_fetch_chunks (pull_data, chunked, error))
+    chunked->failed = TRUE;
+
+out:
+  g_assert (pull_data->n_outstanding_content_fetches > 0);
+  pull_data->n_outstanding_content_fetches--;
+  pull_concurrency_update (pull_data, chunked->start_time);
 
-  if (local_error == NULL && !was_enoent)
-    pull_data->n_fetched_metadata++;
+  if (!fetched
+      && _ostree_fetcher_should_retry_request (local_error, chunked->n_retries_remaining--))
+    {
+      start_fetch_chunked (pull_data, chunked);
+      return;
+    }
 
-  if (_ostree_fetcher_should_retry_request (local_error, fetch_data->n_retries_remaining--))
-    enqueue_one_object_request_s (pull_data, g_steal_pointer (&fetch_data));
+  if (chunked->n_pending_chunks > 0)
+    chunked_chunk_done (pull_data, chunked);
   else
-    check_outstanding_requests_handle_error (pull_data, &local_error);
+    fetch_chunked_data_free (chunked);
+  check_outstanding_requests_handle_error (pull_data, &local_error);
+}
 
-  if (free_fetch_data)
-    g_clear_pointer (&fetch_data, fetch_object_data_free);
+static void
+start_fetch_chunked (OtPullData *pull_data, FetchChunkedData *chunked)
+{
+  const char *checksum;
+  OstreeObjectType objtype;
+
+  ostree_object_name_deserialize (chunked->fetch_data->object, &checksum, &objtype);
+  g_debug ("starting fetch of chunked %s", checksum);
+
+  char path[_OSTREE_LOOSE_PATH_MAX];
+  _ostree_repo_chunked_file_path (path, checksum);
+  g_autofree char *descriptor_subpath = g_build_filename ("objects", path, NULL);
+
+  pull_data->n_outstanding_content_fetches++;
+  chunked->start_time = g_get_monotonic_time ();
+  _ostree_fetcher_request_to_membuf (pull_data->fetcher, pull_data->content_mirrorlist,
+                                     descriptor_subpath, 0, NULL, 0, pull_data->max_metadata_size,
+                                     OSTREE_REPO_PULL_CONTENT_PRIORITY, pull_data->cancellable,
+                                     chunked_descriptor_fetch_on_complete, chunked);
 }
 
 static void
@@ -1222,9 +2649,18 @@ fetch_static_delta_data_free (gpointer data)
   g_variant_unref (fetch_data->objects);
   g_free (fetch_data->from_revision);
   g_free (fetch_data->to_revision);
+  g_clear_pointer (&fetch_data->zstd_dictionary, g_bytes_unref);
   g_free (fetch_data);
 }
 
+/* Called once a delta part is no longer being fetched or applied */
+static void
+deltapart_release_usize (OtPullData *pull_data, FetchStaticDeltaData *fetch_data)
+{
+  g_assert_cmpuint (pull_data->deltapart_usize_outstanding, >=, fetch_data->usize);
+  pull_data->deltapart_usize_outstanding -= fetch_data->usize;
+}
+
 static void
 on_static_delta_written (GObject *object, GAsyncResult *result, gpointer user_data)
 {
@@ -1234,6 +2670,8 @@ on_static_delta_written (GObject *object, GAsyncResult *result, gpointer user_da
   GError **error = &local_error;
 
   g_debug ("execute static delta part %s complete", fetch_data->expected_checksum);
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_EXECUTE_DELTA_PART,
+                             fetch_data->execute_start_time);
 
   if (!_ostree_static_delta_part_execute_finish (pull_data->repo, result, error))
     goto out;
@@ -1241,6 +2679,7 @@ on_static_delta_written (GObject *object, GAsyncResult *result, gpointer user_da
 out:
   g_assert (pull_data->n_outstanding_deltapart_write_requests > 0);
   pull_data->n_outstanding_deltapart_write_requests--;
+  deltapart_release_usize (pull_data, fetch_data);
   /* No need to retry on failure to write locally. */
   check_outstanding_requests_handle_error (pull_data, &local_error);
   /* Always free state */
@@ -1257,12 +2696,12 @@ static_deltapart_fetch_on_complete (GObject *object, GAsyncResult *result, gpoin
     0,
   };
   g_autoptr (GInputStream) in = NULL;
-  g_autoptr (GVariant) part = NULL;
   g_autoptr (GError) local_error = NULL;
   GError **error = &local_error;
   gboolean free_fetch_data = TRUE;
 
   g_debug ("fetch static delta part %s complete", fetch_data->expected_checksum);
+  _ostree_pull_trace_record (pull_data, OSTREE_PULL_TRACE_FETCH_DELTA_PART, fetch_data->start_time);
 
   if (!_ostree_fetcher_request_to_tmpfile_finish (fetcher, result, &tmpf, NULL, NULL, NULL, error))
     goto out;
@@ -1270,20 +2709,21 @@ static_deltapart_fetch_on_complete (GObject *object, GAsyncResult *result, gpoin
   /* Transfer ownership of the fd */
   in = g_unix_input_stream_new (g_steal_fd (&tmpf.fd), TRUE);
 
-  /* TODO - make async */
-  if (!_ostree_static_delta_part_open (in, NULL, 0, fetch_data->expected_checksum, &part,
-                                       pull_data->cancellable, error))
-    goto out;
-
-  _ostree_static_delta_part_execute_async (pull_data->repo, fetch_data->objects, part,
-                                           pull_data->cancellable, on_static_delta_written,
-                                           fetch_data);
+  fetch_data->execute_start_time = g_get_monotonic_time ();
+  _ostree_static_delta_part_execute_async (pull_data->repo, fetch_data->objects, in, NULL, 0,
+                                           fetch_data->zstd_dictionary,
+                                           fetch_data->expected_checksum, pull_data->cancellable,
+                                           on_static_delta_written, fetch_data);
   pull_data->n_outstanding_deltapart_write_requests++;
   free_fetch_data = FALSE;
 
 out:
   g_assert (pull_data->n_outstanding_deltapart_fetches > 0);
   pull_data->n_outstanding_deltapart_fetches--;
+  /* If we're retrying, this is accounted again when the fetch restarts */
+  if (free_fetch_data)
+    deltapart_release_usize (pull_data, fetch_data);
+  pull_concurrency_update (pull_data, fetch_data->start_time);
 
   if (local_error == NULL)
     pull_data->n_fetched_deltaparts++;
@@ -1838,14 +3278,27 @@ enqueue_one_object_request_s (OtPullData *pull_data, FetchObjectData *fetch_data
   const char *checksum;
   OstreeObjectType objtype;
 
+  if (wait_for_remote_packs (pull_data, fetch_data))
+    return;
+
   ostree_object_name_deserialize (fetch_data->object, &checksum, &objtype);
   gboolean is_meta = OSTREE_OBJECT_TYPE_IS_META (objtype);
 
+  /* Small objects in remote packs wait to be coalesced with their neighbours */
+  const RemotePackEntry *pack_entry = lookup_remote_pack_entry (pull_data, fetch_data);
+  if (pack_entry != NULL && pack_entry->size <= PACK_BATCH_MAX_OBJECT_SIZE)
+    {
+      g_debug ("queuing fetch of %s.%s for batching", checksum,
+               ostree_object_type_to_string (objtype));
+      g_ptr_array_add (pull_data->pending_fetch_packed, fetch_data);
+      ensure_pack_batch_queued (pull_data);
+    }
   /* Are too many requests are in flight? */
-  if (fetcher_queue_is_full (pull_data))
+  else if (fetcher_queue_is_full (pull_data))
     {
       g_debug ("queuing fetch of %s.%s%s", checksum, ostree_object_type_to_string (objtype),
                fetch_data->is_detached_meta ? " (detached)" : "");
+      pull_fetch_deferred (pull_data);
 
       if (is_meta)
         {
@@ -1907,6 +3360,7 @@ start_fetch (OtPullData *pull_data, FetchObjectData *fetch)
     pull_data->n_outstanding_metadata_fetches++;
   else
     pull_data->n_outstanding_content_fetches++;
+  fetch->start_time = g_get_monotonic_time ();
 
   OstreeFetcherRequestFlags flags = 0;
   /* Override the path if we're trying to fetch the .commitmeta file first */
@@ -1941,6 +3395,42 @@ start_fetch (OtPullData *pull_data, FetchObjectData *fetch)
 
   if (!is_meta && pull_data->trusted_http_direct)
     flags |= OSTREE_FETCHER_REQUEST_LINKABLE;
+
+  /* If the object is only available inside a pack, fetch just its range */
+  const RemotePackEntry *pack_entry = lookup_remote_pack_entry (pull_data, fetch);
+  if (pack_entry != NULL)
+    {
+      const char *pack_name = pull_data->remote_pack_names->pdata[pack_entry->pack_idx];
+      g_free (obj_subpath);
+      obj_subpath = g_strdup_printf ("objects/%s/%s.pack", _OSTREE_PACK_DIR, pack_name);
+      _ostree_fetcher_request_range_to_tmpfile (
+          pull_data->fetcher, mirrorlist, obj_subpath, flags, pack_entry->offset, pack_entry->size,
+          is_meta ? OSTREE_REPO_PULL_METADATA_PRIORITY : OSTREE_REPO_PULL_CONTENT_PRIORITY,
+          pull_data->cancellable, is_meta ? meta_fetch_on_complete : content_fetch_on_complete,
+          fetch);
+      return;
+    }
+
+  /* Content is written into the repo by content_ingest_worker() as it
+   * arrives, rather than going through a tmpfile which we'd read back to
+   * decompress and checksum.  The trusted path already stores the fetched
+   * tmpfile as the object.
+   */
+  if (!is_meta && !pull_data->trusted_http_direct
+      && _ostree_repo_content_ingest_supported (pull_data->repo))
+    {
+      ContentIngestJob *job = content_ingest_job_new (
+          fetch, _ostree_repo_content_ingest_new (
+                     pull_data->repo, expected_checksum,
+                     pull_data->importflags & _OSTREE_REPO_IMPORT_FLAGS_VERIFY_BAREUSERONLY));
+      g_thread_pool_push (pull_data->content_ingest_pool, job, NULL);
+      _ostree_fetcher_request_to_stream (pull_data->fetcher, mirrorlist, obj_subpath, flags,
+                                         expected_max_size, OSTREE_REPO_PULL_CONTENT_PRIORITY,
+                                         content_stream_write, job, pull_data->cancellable,
+                                         content_stream_fetch_on_complete, job);
+      return;
+    }
+
   _ostree_fetcher_request_to_tmpfile (
       pull_data->fetcher, mirrorlist, obj_subpath, flags, NULL, 0, expected_max_size,
       is_meta ? OSTREE_REPO_PULL_METADATA_PRIORITY : OSTREE_REPO_PULL_CONTENT_PRIORITY,
@@ -2039,6 +3529,7 @@ enqueue_one_static_delta_part_request_s (OtPullData *pull_data, FetchStaticDelta
     {
       g_debug ("queuing fetch of static delta %s-%s part %u", fetch_data->from_revision ?: "empty",
                fetch_data->to_revision, fetch_data->i);
+      pull_fetch_deferred (pull_data);
 
       g_hash_table_add (pull_data->pending_fetch_deltaparts, fetch_data);
     }
@@ -2053,10 +3544,15 @@ start_fetch_deltapart (OtPullData *pull_data, FetchStaticDeltaData *fetch)
 {
   g_autofree char *deltapart_path = _ostree_get_relative_static_delta_part_path (
       fetch->from_revision, fetch->to_revision, fetch->i);
-  g_debug ("starting fetch of deltapart %s", deltapart_path);
   pull_data->n_outstanding_deltapart_fetches++;
-  g_assert_cmpint (pull_data->n_outstanding_deltapart_fetches, <=,
-                   _OSTREE_MAX_OUTSTANDING_DELTAPART_REQUESTS);
+  g_assert_cmpint (pull_data->n_outstanding_deltapart_fetches, <=, pull_data->cur_deltapart_limit);
+  pull_data->deltapart_usize_outstanding += fetch->usize;
+  g_debug ("starting fetch of deltapart %s (%u in flight, %" G_GUINT64_FORMAT " bytes)",
+           deltapart_path,
+           pull_data->n_outstanding_deltapart_fetches
+               + pull_data->n_outstanding_deltapart_write_requests,
+           pull_data->deltapart_usize_outstanding);
+  fetch->start_time = g_get_monotonic_time ();
   _ostree_fetcher_request_to_tmpfile (pull_data->fetcher, pull_data->content_mirrorlist,
                                       deltapart_path, 0, NULL, 0, fetch->size,
                                       OSTREE_FETCHER_DEFAULT_PRIORITY, pull_data->cancellable,
@@ -2075,6 +3571,10 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
   g_autoptr (GVariant) headers = g_variant_get_child_value (delta_superblock, 6);
   g_autoptr (GVariant) fallback_objects = g_variant_get_child_value (delta_superblock, 7);
 
+  g_autoptr (GBytes) zstd_dictionary = NULL;
+  if (!_ostree_delta_get_compression (delta_superblock, NULL, &zstd_dictionary, error))
+    return FALSE;
+
   /* Gather free space so we can do a check below */
   struct statvfs stvfsbuf;
   if (TEMP_FAILURE_RETRY (fstatvfs (pull_data->repo->repo_dir_fd, &stvfsbuf)) < 0)
@@ -2133,6 +3633,7 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
           fetch_data->requested_ref = (ref != NULL) ? ostree_collection_ref_dup (ref) : NULL;
           fetch_data->n_retries_remaining = pull_data->n_network_retries;
 
+          fetch_data->write_start_time = g_get_monotonic_time ();
           ostree_repo_write_metadata_async (pull_data->repo, OSTREE_OBJECT_TYPE_COMMIT, to_checksum,
                                             to_commit, pull_data->cancellable, on_metadata_written,
                                             fetch_data);
@@ -2201,6 +3702,7 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
       fetch_data->pull_data = pull_data;
       fetch_data->objects = g_variant_ref (objects);
       fetch_data->expected_checksum = ostree_checksum_from_bytes_v (csum_v);
+      fetch_data->zstd_dictionary = zstd_dictionary ? g_bytes_ref (zstd_dictionary) : NULL;
       fetch_data->size = size;
       fetch_data->usize = usize;
       fetch_data->i = i;
@@ -2209,21 +3711,15 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
       if (inline_part_bytes != NULL)
         {
           g_autoptr (GInputStream) memin = g_memory_input_stream_new_from_bytes (inline_part_bytes);
-          g_autoptr (GVariant) inline_delta_part = NULL;
 
           /* For inline parts we are relying on per-commit GPG, so don't bother checksumming. */
-          if (!_ostree_static_delta_part_open (memin, inline_part_bytes,
-                                               OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM, NULL,
-                                               &inline_delta_part, cancellable, error))
-            {
-              fetch_static_delta_data_free (fetch_data);
-              return FALSE;
-            }
-
-          _ostree_static_delta_part_execute_async (pull_data->repo, fetch_data->objects,
-                                                   inline_delta_part, pull_data->cancellable,
-                                                   on_static_delta_written, fetch_data);
+          fetch_data->execute_start_time = g_get_monotonic_time ();
+          _ostree_static_delta_part_execute_async (
+              pull_data->repo, fetch_data->objects, memin, inline_part_bytes,
+              OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM, zstd_dictionary, NULL,
+              pull_data->cancellable, on_static_delta_written, fetch_data);
           pull_data->n_outstanding_deltapart_write_requests++;
+          pull_data->deltapart_usize_outstanding += fetch_data->usize;
         }
       else
         {
@@ -2475,6 +3971,25 @@ on_superblock_fetched (GObject *src, GAsyncResult *res, gpointer data)
       delta_superblock = g_variant_ref_sink (g_variant_new_from_bytes (
           (GVariantType *)OSTREE_STATIC_DELTA_SUPERBLOCK_FORMAT, delta_superblock_data, FALSE));
 
+      /* If we can't decompress the parts (e.g. zstd, but built without
+       * it), fall back to fetching objects like for a missing delta.
+       */
+      {
+        g_autoptr (GError) compression_error = NULL;
+        if (!_ostree_delta_get_compression (delta_superblock, NULL, NULL, &compression_error))
+          {
+            if (pull_data->require_static_deltas)
+              {
+                g_propagate_error (error, g_steal_pointer (&compression_error));
+                goto out;
+              }
+            g_debug ("Not using static delta %s: %s", delta, compression_error->message);
+            queue_scan_one_metadata_object (pull_data, to_revision, OSTREE_OBJECT_TYPE_COMMIT,
+                                            NULL, 0, fetch_data->requested_ref);
+            goto out;
+          }
+      }
+
       g_hash_table_add (pull_data->static_delta_targets, g_strdup (to_revision));
       if (!process_one_static_delta (pull_data, from_revision, to_revision, delta_superblock,
                                      fetch_data->requested_ref, pull_data->cancellable, error))
@@ -2518,6 +4033,7 @@ enqueue_one_static_delta_superblock_request_s (OtPullData *pull_data,
     {
       g_debug ("queuing fetch of static delta superblock %s-%s",
                fetch_data->from_revision ?: "empty", fetch_data->to_revision);
+      pull_fetch_deferred (pull_data);
 
       g_hash_table_add (pull_data->pending_fetch_delta_superblocks, g_steal_pointer (&fetch_data));
     }
@@ -2579,6 +4095,31 @@ collect_available_deltas_for_pull (OtPullData *pull_data, GVariant *deltas, GErr
   return TRUE;
 }
 
+/* Record the packs listed in the remote's summary, so objects which are only
+ * stored in them can be fetched with range requests; see
+ * ostree_repo_pack_objects().  Their indexes are only fetched once an object
+ * is requested, in wait_for_remote_packs().
+ */
+static gboolean
+init_remote_packs (OtPullData *pull_data, GError **error)
+{
+  g_autoptr (GVariant) additional_metadata = g_variant_get_child_value (pull_data->summary, 1);
+  g_autofree const char **pack_names = NULL;
+
+  if (!g_variant_lookup (additional_metadata, OSTREE_SUMMARY_PACKS, "^a&s", &pack_names))
+    return TRUE;
+
+  for (const char **it = pack_names; it && *it; it++)
+    {
+      const char *pack_name = *it;
+      if (!ostree_validate_checksum_string (pack_name, error))
+        return glnx_prefix_error (error, "Invalid pack name");
+      g_ptr_array_add (pull_data->remote_pack_names, g_strdup (pack_name));
+    }
+
+  return TRUE;
+}
+
 static void
 on_delta_index_fetched (GObject *src, GAsyncResult *res, gpointer data)
 
@@ -2651,6 +4192,7 @@ enqueue_one_static_delta_index_request_s (OtPullData *pull_data, FetchDeltaIndex
   if (fetcher_queue_is_full (pull_data))
     {
       g_debug ("queuing fetch of static delta index to %s", fetch_data->to_revision);
+      pull_fetch_deferred (pull_data);
 
       g_hash_table_add (pull_data->pending_fetch_delta_indexes, g_steal_pointer (&fetch_data));
     }
@@ -2899,8 +4441,9 @@ _ostree_repo_save_cache_summary_file (OstreeRepo *self, const char *filename, co
   if (self->cache_dir_fd == -1)
     return TRUE;
 
-  if (!glnx_shutil_mkdir_p_at (self->cache_dir_fd, _OSTREE_SUMMARY_CACHE_DIR,
-                               DEFAULT_DIRECTORY_MODE, cancellable, error))
+  /* Summary indexes and their shards are cached in subdirectories */
+  g_autofree char *dir = g_path_get_dirname (file);
+  if (!glnx_shutil_mkdir_p_at (self->cache_dir_fd, dir, DEFAULT_DIRECTORY_MODE, cancellable, error))
     return FALSE;
 
   if (!glnx_file_replace_contents_at (
@@ -2934,6 +4477,360 @@ _ostree_repo_cache_summary (OstreeRepo *self, const char *remote, GBytes *summar
   return TRUE;
 }
 
+/* If the remote publishes summary diffs, reconstruct its current summary from
+ * the cached one and the diff from it.  Sets @out_summary to %NULL if that
+ * isn't possible, in which case the full summary should be fetched.  Like a
+ * cached summary, the result still has to be verified against summary.sig.
+ */
+static gboolean
+fetch_summary_from_diff (OtPullData *pull_data, const char *remote, GBytes **out_summary,
+                         GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GBytes) cached_bytes = NULL;
+
+  *out_summary = NULL;
+
+  if (!_ostree_repo_load_cache_summary_file (pull_data->repo, remote, NULL, &cached_bytes,
+                                             cancellable, error))
+    return FALSE;
+  if (cached_bytes == NULL)
+    return TRUE;
+
+  g_autoptr (GVariant) cached = g_variant_ref_sink (
+      g_variant_new_from_bytes (OSTREE_SUMMARY_GVARIANT_FORMAT, cached_bytes, FALSE));
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (cached, 1);
+  gboolean has_diffs = FALSE;
+  if (!g_variant_lookup (metadata, OSTREE_SUMMARY_DIFFS, "b", &has_diffs) || !has_diffs)
+    return TRUE;
+
+  g_autofree char *checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, cached_bytes);
+  const char *path = glnx_strjoina (_OSTREE_SUMMARY_DIFFS_DIR, "/", checksum);
+  g_autoptr (GBytes) diff_bytes = NULL;
+  if (!_ostree_fetcher_mirrored_request_to_membuf (
+          pull_data->fetcher, pull_data->meta_mirrorlist, path,
+          OSTREE_FETCHER_REQUEST_OPTIONAL_CONTENT, NULL, 0, pull_data->n_network_retries,
+          &diff_bytes, NULL, NULL, NULL, OSTREE_MAX_METADATA_SIZE, cancellable, error))
+    return FALSE;
+  if (diff_bytes == NULL)
+    {
+      g_debug ("Remote %s has no summary diff from %s", remote, checksum);
+      return TRUE;
+    }
+
+  g_autoptr (GVariant) diff = g_variant_ref_sink (
+      g_variant_new_from_bytes (_OSTREE_SUMMARY_DIFF_GVARIANT_FORMAT, diff_bytes, FALSE));
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GVariant) summary = _ostree_summary_diff_apply (cached, diff, &local_error);
+  if (summary == NULL)
+    {
+      /* Most likely the summary was updated again since summary.sig was fetched */
+      g_debug ("Failed to apply summary diff of remote %s: %s", remote, local_error->message);
+      return TRUE;
+    }
+
+  g_debug ("Reconstructed %s summary from a %" G_GSIZE_FORMAT " byte diff", remote,
+           g_bytes_get_size (diff_bytes));
+  *out_summary = g_variant_get_data_as_bytes (summary);
+  return TRUE;
+}
+
+/* Whether @ref, if present on the remote, would be listed in the shard of
+ * @shard_collection_id spanning @first_ref to @last_ref */
+static gboolean
+summary_shard_covers_ref (const char *main_collection_id, const char *shard_collection_id,
+                          const char *first_ref, const char *last_ref,
+                          const OstreeCollectionRef *ref)
+{
+  const char *collection_id = ref->collection_id;
+  if (collection_id == NULL || g_strcmp0 (collection_id, main_collection_id) == 0)
+    collection_id = "";
+
+  return strcmp (collection_id, shard_collection_id) == 0
+         && strcmp (first_ref, ref->ref_name) <= 0 && strcmp (ref->ref_name, last_ref) <= 0;
+}
+
+/* Load the summary shard with SHA-256 @checksum from the cache, or from the
+ * remote, verifying it against @checksum either way */
+static gboolean
+fetch_summary_shard (OtPullData *pull_data, const char *checksum, GBytes **out_shard,
+                     GCancellable *cancellable, GError **error)
+{
+  const char *cache_name = glnx_strjoina ("shards/", checksum);
+  g_autoptr (GBytes) shard = NULL;
+
+  if (!_ostree_repo_load_cache_summary_file (pull_data->repo, cache_name, NULL, &shard,
+                                             cancellable, error))
+    return FALSE;
+  if (shard != NULL)
+    {
+      g_autofree char *actual = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, shard);
+      if (strcmp (checksum, actual) == 0)
+        {
+          *out_shard = g_steal_pointer (&shard);
+          return TRUE;
+        }
+      g_debug ("Cached summary shard %s invalid, pulling new version", checksum);
+      g_clear_pointer (&shard, g_bytes_unref);
+    }
+
+  const char *path = glnx_strjoina (_OSTREE_SUMMARY_SHARDS_DIR, "/", checksum);
+  if (!_ostree_fetcher_mirrored_request_to_membuf (
+          pull_data->fetcher, pull_data->meta_mirrorlist, path, 0, NULL, 0,
+          pull_data->n_network_retries, &shard, NULL, NULL, NULL, OSTREE_MAX_METADATA_SIZE,
+          cancellable, error))
+    return glnx_prefix_error (error, "Fetching summary shard %s", checksum);
+
+  g_autofree char *actual = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, shard);
+  if (strcmp (checksum, actual) != 0)
+    return glnx_throw (error, "Corrupted summary shard %s; actual checksum %s", checksum, actual);
+
+  if (!_ostree_repo_save_cache_summary_file (pull_data->repo, cache_name, NULL, shard, NULL, 0,
+                                             cancellable, error))
+    return FALSE;
+
+  *out_shard = g_steal_pointer (&shard);
+  return TRUE;
+}
+
+/* Fetch the summary index of the remote, and only those of its shards which
+ * cover @requested_refs, and assemble them into a summary listing just those
+ * refs, with the rest of the metadata of the full summary.  The index is
+ * verified like the summary would be, and records the checksum of each
+ * shard.  Sets @out_summary to %NULL if the remote doesn't publish an index,
+ * in which case the full summary should be used.
+ */
+static gboolean
+fetch_summary_from_index (OtPullData *pull_data, GHashTable *requested_refs,
+                          GBytes **out_summary, GCancellable *cancellable, GError **error)
+{
+  OstreeRepo *self = pull_data->repo;
+  const char *cache_name = glnx_strjoina ("index/", pull_data->remote_name);
+  g_autoptr (GBytes) bytes_sig = NULL;
+  g_autoptr (GBytes) bytes_index = NULL;
+  g_autofree char *sig_etag = NULL;
+  guint64 sig_last_modified = 0;
+  g_autofree char *index_etag = NULL;
+  guint64 index_last_modified = 0;
+  gboolean not_modified = FALSE;
+
+  *out_summary = NULL;
+
+  /* As for the summary, the signature tells whether the cached index is current */
+  g_autofree char *sig_if_none_match = NULL;
+  guint64 sig_if_modified_since = 0;
+  _ostree_repo_load_cache_summary_properties (self, cache_name, ".sig", &sig_if_none_match,
+                                              &sig_if_modified_since);
+  if (!_ostree_fetcher_mirrored_request_to_membuf (
+          pull_data->fetcher, pull_data->meta_mirrorlist, _OSTREE_SUMMARY_INDEX ".sig",
+          OSTREE_FETCHER_REQUEST_OPTIONAL_CONTENT, sig_if_none_match, sig_if_modified_since,
+          pull_data->n_network_retries, &bytes_sig, &not_modified, &sig_etag, &sig_last_modified,
+          OSTREE_MAX_METADATA_SIZE, cancellable, error))
+    return FALSE;
+  if (not_modified)
+    {
+      g_clear_pointer (&bytes_sig, g_bytes_unref);
+      if (!_ostree_repo_load_cache_summary_file (self, cache_name, ".sig", &bytes_sig,
+                                                 cancellable, error))
+        return FALSE;
+    }
+
+  if (bytes_sig
+      && !_ostree_repo_load_cache_summary_if_same_sig (self, cache_name, bytes_sig, &bytes_index,
+                                                       cancellable, error))
+    return FALSE;
+  gboolean index_from_cache = bytes_index != NULL;
+
+  if (!bytes_index)
+    {
+      g_autofree char *if_none_match = NULL;
+      guint64 if_modified_since = 0;
+      _ostree_repo_load_cache_summary_properties (self, cache_name, NULL, &if_none_match,
+                                                  &if_modified_since);
+      if (!_ostree_fetcher_mirrored_request_to_membuf (
+              pull_data->fetcher, pull_data->meta_mirrorlist, _OSTREE_SUMMARY_INDEX,
+              OSTREE_FETCHER_REQUEST_OPTIONAL_CONTENT, if_none_match, if_modified_since,
+              pull_data->n_network_retries, &bytes_index, &not_modified, &index_etag,
+              &index_last_modified, OSTREE_MAX_METADATA_SIZE, cancellable, error))
+        return FALSE;
+      if (not_modified)
+        {
+          g_clear_pointer (&bytes_index, g_bytes_unref);
+          if (!_ostree_repo_load_cache_summary_file (self, cache_name, NULL, &bytes_index,
+                                                     cancellable, error))
+            return FALSE;
+          index_from_cache = TRUE;
+        }
+    }
+
+  if (!bytes_index)
+    {
+      g_debug ("Remote %s has no summary index", pull_data->remote_name);
+      return TRUE;
+    }
+
+  g_autoptr (GError) temp_error = NULL;
+  if (!_ostree_repo_verify_summary (self, pull_data->remote_name, pull_data->gpg_verify_summary,
+                                    pull_data->signapi_summary_verifiers, bytes_index, bytes_sig,
+                                    cancellable, &temp_error))
+    {
+      if (!index_from_cache)
+        {
+          g_propagate_error (error, g_steal_pointer (&temp_error));
+          return FALSE;
+        }
+
+      /* The cached index doesn't match, fetch a new one and verify again */
+      g_debug ("Remote %s cached summary index invalid, pulling new version",
+               pull_data->remote_name);
+      index_from_cache = FALSE;
+      g_clear_pointer (&bytes_index, g_bytes_unref);
+      g_clear_pointer (&index_etag, g_free);
+      index_last_modified = 0;
+      if (!_ostree_fetcher_mirrored_request_to_membuf (
+              pull_data->fetcher, pull_data->meta_mirrorlist, _OSTREE_SUMMARY_INDEX, 0, NULL, 0,
+              pull_data->n_network_retries, &bytes_index, NULL, &index_etag, &index_last_modified,
+              OSTREE_MAX_METADATA_SIZE, cancellable, error))
+        return FALSE;
+      if (!_ostree_repo_verify_summary (self, pull_data->remote_name,
+                                        pull_data->gpg_verify_summary,
+                                        pull_data->signapi_summary_verifiers, bytes_index,
+                                        bytes_sig, cancellable, error))
+        return FALSE;
+    }
+
+  if (!_ostree_summary_check_is_index (bytes_index, TRUE, error))
+    return FALSE;
+
+  g_autoptr (GVariant) index = g_variant_ref_sink (
+      g_variant_new_from_bytes (_OSTREE_SUMMARY_INDEX_GVARIANT_FORMAT, bytes_index, FALSE));
+  if (!g_variant_is_normal_form (index))
+    return glnx_throw (error, "Summary index not in normal form");
+
+  if (!index_from_cache)
+    {
+      if (bytes_sig)
+        {
+          if (!_ostree_repo_cache_summary (self, cache_name, bytes_index, index_etag,
+                                           index_last_modified, bytes_sig, sig_etag,
+                                           sig_last_modified, cancellable, error))
+            return FALSE;
+        }
+      else if (!_ostree_repo_save_cache_summary_file (self, cache_name, NULL, bytes_index,
+                                                      index_etag, index_last_modified,
+                                                      cancellable, error))
+        return FALSE;
+    }
+
+  g_autoptr (GVariant) shards = g_variant_get_child_value (index, 0);
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (index, 1);
+  const char *main_collection_id = NULL;
+  if (!g_variant_lookup (metadata, OSTREE_SUMMARY_COLLECTION_ID, "&s", &main_collection_id))
+    main_collection_id = NULL;
+
+  /* The index is sorted by collection ID, as is the collection map, so the
+   * refs of consecutive shards can be appended as they are. */
+  g_auto (GVariantBuilder) refs_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&refs_builder, G_VARIANT_TYPE ("a(s(taya{sv}))"));
+  g_auto (GVariantBuilder) map_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&map_builder, G_VARIANT_TYPE ("a{sa(s(taya{sv}))}"));
+  const char *open_collection_id = NULL;
+  guint n_fetched = 0;
+
+  const gsize n_shards = g_variant_n_children (shards);
+  for (gsize i = 0; i < n_shards; i++)
+    {
+      const char *shard_collection_id;
+      const char *first_ref;
+      const char *last_ref;
+      g_autoptr (GVariant) csum_v = NULL;
+      g_variant_get_child (shards, i, "(&s&s&s@ay)", &shard_collection_id, &first_ref, &last_ref,
+                           &csum_v);
+
+      gboolean wanted = FALSE;
+      GLNX_HASH_TABLE_FOREACH (requested_refs, const OstreeCollectionRef *, ref)
+        {
+          if (summary_shard_covers_ref (main_collection_id, shard_collection_id, first_ref,
+                                        last_ref, ref))
+            {
+              wanted = TRUE;
+              break;
+            }
+        }
+      if (!wanted)
+        continue;
+
+      if (!ostree_validate_structureof_csum_v (csum_v, error))
+        return glnx_prefix_error (error, "Summary index");
+      char checksum[OSTREE_SHA256_STRING_LEN + 1];
+      ostree_checksum_inplace_from_bytes (ostree_checksum_bytes_peek (csum_v), checksum);
+
+      g_autoptr (GBytes) bytes_shard = NULL;
+      if (!fetch_summary_shard (pull_data, checksum, &bytes_shard, cancellable, error))
+        return FALSE;
+      g_autoptr (GVariant) shard = g_variant_ref_sink (
+          g_variant_new_from_bytes (OSTREE_SUMMARY_GVARIANT_FORMAT, bytes_shard, FALSE));
+      n_fetched++;
+
+      g_autoptr (GVariant) shard_refs = NULL;
+      if (*shard_collection_id == '\0')
+        shard_refs = g_variant_get_child_value (shard, 0);
+      else
+        {
+          g_autoptr (GVariant) shard_metadata = g_variant_get_child_value (shard, 1);
+          g_autoptr (GVariant) shard_map = g_variant_lookup_value (
+              shard_metadata, OSTREE_SUMMARY_COLLECTION_MAP, G_VARIANT_TYPE ("a{sa(s(taya{sv}))}"));
+          if (shard_map != NULL)
+            shard_refs = g_variant_lookup_value (shard_map, shard_collection_id,
+                                                 G_VARIANT_TYPE ("a(s(taya{sv}))"));
+          if (shard_refs == NULL)
+            return glnx_throw (error, "Summary shard %s lacks collection %s", checksum,
+                               shard_collection_id);
+
+          if (g_strcmp0 (open_collection_id, shard_collection_id) != 0)
+            {
+              if (open_collection_id != NULL)
+                {
+                  g_variant_builder_close (&map_builder);
+                  g_variant_builder_close (&map_builder);
+                }
+              g_variant_builder_open (&map_builder, G_VARIANT_TYPE ("{sa(s(taya{sv}))}"));
+              g_variant_builder_add (&map_builder, "s", shard_collection_id);
+              g_variant_builder_open (&map_builder, G_VARIANT_TYPE ("a(s(taya{sv}))"));
+              open_collection_id = shard_collection_id;
+            }
+        }
+
+      GVariantBuilder *builder
+          = (*shard_collection_id == '\0') ? &refs_builder : &map_builder;
+      const gsize n_refs = g_variant_n_children (shard_refs);
+      for (gsize j = 0; j < n_refs; j++)
+        {
+          g_autoptr (GVariant) ref = g_variant_get_child_value (shard_refs, j);
+          g_variant_builder_add_value (builder, ref);
+        }
+    }
+
+  g_debug ("Fetched %u of %" G_GSIZE_FORMAT " summary shards of remote %s", n_fetched, n_shards,
+           pull_data->remote_name);
+
+  g_auto (GVariantDict) metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_dict_init (&metadata_builder, metadata);
+  g_variant_dict_remove (&metadata_builder, _OSTREE_SUMMARY_INDEX_KEY);
+  if (open_collection_id != NULL)
+    {
+      g_variant_builder_close (&map_builder);
+      g_variant_builder_close (&map_builder);
+      g_variant_dict_insert_value (&metadata_builder, OSTREE_SUMMARY_COLLECTION_MAP,
+                                   g_variant_builder_end (&map_builder));
+    }
+
+  g_autoptr (GVariant) summary = g_variant_ref_sink (
+      g_variant_new ("(@a(s(taya{sv}))@a{sv})", g_variant_builder_end (&refs_builder),
+                     g_variant_dict_end (&metadata_builder)));
+  *out_summary = g_variant_get_data_as_bytes (summary);
+  return TRUE;
+}
+
 static OstreeFetcher *
 _ostree_repo_remote_new_fetcher (OstreeRepo *self, const char *remote_name, gboolean gzip,
                                  GVariant *extra_headers, const char *append_user_agent,
@@ -3228,6 +5125,39 @@ compute_effective_mirrorlist (OstreeRepo *self, const char *remote_name_or_baseu
   return TRUE;
 }
 
+/* Look up a positive integer option for @remote_name of at most @max, or
+ * @default_value if unset */
+static gboolean
+get_remote_uint64_option (OstreeRepo *self, const char *remote_name, const char *option_name,
+                          guint64 default_value, guint64 max, guint64 *out_value, GError **error)
+{
+  g_autofree char *value_str = NULL;
+  if (!ostree_repo_get_remote_option (self, remote_name, option_name, NULL, &value_str, error))
+    return FALSE;
+
+  if (value_str == NULL)
+    {
+      *out_value = default_value;
+      return TRUE;
+    }
+
+  if (!g_ascii_string_to_unsigned (value_str, 10, 1, max, out_value, error))
+    return glnx_prefix_error (error, "Parsing remote '%s' option %s", remote_name, option_name);
+  return TRUE;
+}
+
+static gboolean
+get_remote_uint_option (OstreeRepo *self, const char *remote_name, const char *option_name,
+                        guint default_value, guint *out_value, GError **error)
+{
+  guint64 value;
+  if (!get_remote_uint64_option (self, remote_name, option_name, default_value, G_MAXUINT32,
+                                 &value, error))
+    return FALSE;
+  *out_value = (guint)value;
+  return TRUE;
+}
+
 /* Create the fetcher by unioning options from the remote config, plus
  * any options specific to this pull (such as extra headers).
  */
@@ -3474,6 +5404,7 @@ all_requested_refs_have_commit (
  *   * `retry-all-network-errors` (`b`): Retry when network issues happen, instead of
  *      failing automatically. Currently only affects libcurl. (Default set to true)
  *   * `max-outstanding-fetcher-requests` (`u`): The max amount of concurrent connections allowed.
+ *     This overrides the remote's `max-outstanding-fetcher-requests` option.
  *   * `ref-keyring-map` (`a(sss)`): Array of (collection ID, ref name, keyring
  *     remote name) tuples specifying which remote's keyring should be used when
  *     doing GPG verification of each collection-ref. This is useful to prevent a
@@ -3492,6 +5423,11 @@ all_requested_refs_have_commit (
  *     is specified, `summary-bytes` must also be specified. Since: 2020.5
  *   * `disable-verify-bindings` (`b`): Disable verification of commit bindings.
  *     Since: 2020.9
+ *   * `trace-file` (`s`): Path of a file to write a JSON trace of the pull to,
+ *     whether or not it succeeds: the time spent in each phase with a
+ *     histogram of latencies, and (with libcurl) connection setup times.
+ *     The totals are also reported in the `timing-*` progress keys.
+ *     Since: 2026.5
  */
 gboolean
 ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_baseurl,
@@ -3540,8 +5476,10 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
   gboolean need_summary = FALSE;
   const char *main_collection_id = NULL;
   const char *url_override = NULL;
+  const char *opt_trace_file = NULL;
   gboolean inherit_transaction = FALSE;
   gboolean require_summary_for_mirror = FALSE;
+  gboolean use_summary_index = FALSE;
   g_autoptr (GHashTable) updated_requested_refs_to_fetch
       = NULL; /* (element-type OstreeCollectionRef utf8) */
   gsize i;
@@ -3605,7 +5543,7 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
       opt_retry_all_set
           = g_variant_lookup (options, "retry-all-network-errors", "b", &pull_data->retry_all);
       opt_max_outstanding_fetcher_requests_set
-          = g_variant_lookup (options, "max-outstanding-fetcher-requests", "b",
+          = g_variant_lookup (options, "max-outstanding-fetcher-requests", "u",
                               &pull_data->max_outstanding_fetcher_requests);
       opt_n_network_retries_set
           = g_variant_lookup (options, "n-network-retries", "u", &pull_data->n_network_retries);
@@ -3615,6 +5553,7 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
       (void)g_variant_lookup (options, "summary-sig-bytes", "@ay", &summary_sig_bytes_v);
       (void)g_variant_lookup (options, "disable-verify-bindings", "b",
                               &pull_data->disable_verify_bindings);
+      (void)g_variant_lookup (options, "trace-file", "&s", &opt_trace_file);
 
       if (pull_data->remote_refspec_name != NULL)
         pull_data->remote_name = g_strdup (pull_data->remote_refspec_name);
@@ -3687,9 +5626,12 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
     pull_data->low_speed_time = OPT_LOWSPEEDTIME_DEFAULT;
   if (!opt_retry_all_set)
     pull_data->retry_all = OPT_RETRYALL_DEFAULT;
-  if (!opt_max_outstanding_fetcher_requests_set)
-    pull_data->max_outstanding_fetcher_requests
-        = OPT_OSTREE_MAX_OUTSTANDING_FETCHER_REQUESTS_DEFAULT;
+  pull_data->adaptive_concurrency = TRUE;
+  pull_data->max_outstanding_deltapart_requests
+      = CLAMP (g_get_num_processors (), _OSTREE_MAX_OUTSTANDING_DELTAPART_REQUESTS,
+               _OSTREE_MAX_OUTSTANDING_DELTAPART_REQUESTS_AUTO_MAX);
+  pull_data->deltapart_memory_budget = get_deltapart_memory_budget ();
+  pull_data->max_outstanding_write_requests = _OSTREE_MAX_OUTSTANDING_WRITE_REQUESTS;
 
   pull_data->repo = self;
   pull_data->progress = progress;
@@ -3731,6 +5673,13 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
       = g_hash_table_new_full (NULL, NULL, (GDestroyNotify)fetch_delta_super_data_free, NULL);
   pull_data->pending_fetch_deltaparts
       = g_hash_table_new_full (NULL, NULL, (GDestroyNotify)fetch_static_delta_data_free, NULL);
+  pull_data->pending_fetch_packed = g_ptr_array_new ();
+  pull_data->pending_fetch_chunks = g_ptr_array_new ();
+  pull_data->pending_fetch_pack_indexes = g_ptr_array_new ();
+  pull_data->pending_fetch_pack_index_data = g_ptr_array_new ();
+  pull_data->remote_packs = g_hash_table_new_full (ostree_hash_object_name, g_variant_equal,
+                                                   (GDestroyNotify)g_variant_unref, g_free);
+  pull_data->remote_pack_names = g_ptr_array_new_with_free_func (g_free);
 
   if (opt_localcache_repos && *opt_localcache_repos)
     {
@@ -3796,6 +5745,11 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
                                                         &pull_data->gpg_verify_summary, error))
           goto out;
 
+      if (!ostree_repo_get_remote_boolean_option (self, pull_data->remote_name,
+                                                  "use-summary-index", FALSE, &use_summary_index,
+                                                  error))
+        goto out;
+
       /* NOTE: If changing this, see the matching implementation in
        * ostree-sysroot-upgrader.c
        */
@@ -3821,8 +5775,55 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
                        pull_data->remote_name, custom_backend);
           goto out;
         }
+
+      if (!ostree_repo_get_remote_boolean_option (self, pull_data->remote_name,
+                                                  "adaptive-concurrency", TRUE,
+                                                  &pull_data->adaptive_concurrency, error))
+        goto out;
+      if (!opt_max_outstanding_fetcher_requests_set)
+        {
+          const guint fetch_default
+              = pull_data->adaptive_concurrency
+                    ? OPT_OSTREE_MAX_OUTSTANDING_FETCHER_REQUESTS_DEFAULT
+                          * OPT_ADAPTIVE_CONCURRENCY_GROWTH_DEFAULT
+                    : OPT_OSTREE_MAX_OUTSTANDING_FETCHER_REQUESTS_DEFAULT;
+          if (!get_remote_uint_option (self, pull_data->remote_name,
+                                       "max-outstanding-fetcher-requests", fetch_default,
+                                       &pull_data->max_outstanding_fetcher_requests, error))
+            goto out;
+          opt_max_outstanding_fetcher_requests_set = TRUE;
+        }
+      if (!get_remote_uint_option (self, pull_data->remote_name,
+                                   "max-outstanding-deltapart-requests",
+                                   pull_data->max_outstanding_deltapart_requests,
+                                   &pull_data->max_outstanding_deltapart_requests, error))
+        goto out;
+      if (!get_remote_uint64_option (self, pull_data->remote_name, "max-deltapart-memory",
+                                     pull_data->deltapart_memory_budget, G_MAXUINT64,
+                                     &pull_data->deltapart_memory_budget, error))
+        goto out;
+      const guint write_default = pull_data->adaptive_concurrency
+                                      ? _OSTREE_MAX_OUTSTANDING_WRITE_REQUESTS
+                                            * OPT_ADAPTIVE_CONCURRENCY_GROWTH_DEFAULT
+                                      : _OSTREE_MAX_OUTSTANDING_WRITE_REQUESTS;
+      if (!get_remote_uint_option (self, pull_data->remote_name, "max-outstanding-write-requests",
+                                   write_default, &pull_data->max_outstanding_write_requests,
+                                   error))
+        goto out;
     }
 
+  if (!opt_max_outstanding_fetcher_requests_set || pull_data->max_outstanding_fetcher_requests == 0)
+    pull_data->max_outstanding_fetcher_requests
+        = OPT_OSTREE_MAX_OUTSTANDING_FETCHER_REQUESTS_DEFAULT;
+  pull_concurrency_init (pull_data);
+
+  /* One worker per content fetch in flight at most; see start_fetch() */
+  pull_data->content_ingest_pool
+      = g_thread_pool_new (content_ingest_worker, pull_data,
+                           pull_data->max_outstanding_fetcher_requests, FALSE, error);
+  if (!pull_data->content_ingest_pool)
+    goto out;
+
   if (pull_data->remote_name && !(disable_sign_verify && disable_sign_verify_summary))
     {
       if (!_signapi_init_for_remote (pull_data->repo, pull_data->remote_name,
@@ -4108,6 +6109,8 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
       g_autoptr (GVariant) deltas = NULL;
       g_autoptr (GVariant) additional_metadata = NULL;
       gboolean summary_from_cache = FALSE;
+      gboolean summary_from_index = FALSE;
+      gboolean summary_from_diff = FALSE;
       gboolean tombstone_commits = FALSE;
 
       if (summary_sig_bytes_v)
@@ -4128,7 +6131,18 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
           g_debug ("Loaded %s summary from options", remote_name_or_baseurl);
         }
 
-      if (!bytes_sig)
+      /* If only some refs are needed, fetch just the parts of the summary
+       * listing them, if the remote publishes a summary index. */
+      if (!summary_bytes_v && use_summary_index && !require_summary_for_mirror
+          && !pull_data->remote_repo_local)
+        {
+          if (!fetch_summary_from_index (pull_data, requested_refs_to_fetch, &bytes_summary,
+                                         cancellable, error))
+            goto out;
+          summary_from_index = bytes_summary != NULL;
+        }
+
+      if (!bytes_sig && !summary_from_index)
         {
           g_autofree char *summary_sig_if_none_match = NULL;
           guint64 summary_sig_if_modified_since = 0;
@@ -4173,7 +6187,19 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
                                                            &bytes_summary, cancellable, error))
         goto out;
 
-      if (bytes_summary && !summary_bytes_v)
+      /* The summary changed; try to reconstruct it from the cached one */
+      if (bytes_sig && !bytes_summary && !pull_data->remote_repo_local)
+        {
+          if (!fetch_summary_from_diff (pull_data, remote_name_or_baseurl, &bytes_summary,
+                                        cancellable, error))
+            goto out;
+          summary_from_diff = bytes_summary != NULL;
+          /* The server syncs the times of the summary to its signature */
+          if (summary_from_diff)
+            summary_last_modified = summary_sig_last_modified;
+        }
+
+      if (bytes_summary && !summary_bytes_v && !summary_from_index)
         {
           g_debug ("Loaded %s summary from cache", remote_name_or_baseurl);
           summary_from_cache = TRUE;
@@ -4229,7 +6255,7 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
         }
 
 #ifndef OSTREE_DISABLE_GPGME
-      if (!bytes_sig && pull_data->gpg_verify_summary)
+      if (!bytes_sig && pull_data->gpg_verify_summary && !summary_from_index)
         {
           g_set_error (error, OSTREE_GPG_ERROR, OSTREE_GPG_ERROR_NO_SIGNATURE,
                        "GPG verification enabled, but no summary.sig found (use "
@@ -4291,7 +6317,7 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
 
       if (pull_data->signapi_summary_verifiers)
         {
-          if (!bytes_sig && pull_data->signapi_summary_verifiers)
+          if (!bytes_sig && !summary_from_index)
             {
               g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
                            "Signatures verification enabled, but no summary.sig found (use "
@@ -4355,6 +6381,9 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
 
       if (bytes_summary)
         {
+          if (!_ostree_summary_check_is_index (bytes_summary, FALSE, error))
+            goto out;
+
           pull_data->summary_data = g_bytes_ref (bytes_summary);
           pull_data->summary_etag = g_strdup (summary_etag);
           pull_data->summary_last_modified = summary_last_modified;
@@ -4381,7 +6410,8 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
             }
         }
 
-      if (!summary_from_cache && bytes_summary && bytes_sig && summary_sig_bytes_v == NULL)
+      if ((!summary_from_cache || summary_from_diff) && bytes_summary && bytes_sig
+          && summary_sig_bytes_v == NULL)
         {
           if (!pull_data->remote_repo_local
               && !_ostree_repo_cache_summary (
@@ -4521,6 +6551,17 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
       goto out;
     }
 
+  /* Local pulls read packed and chunked objects directly from the source repo */
+  if (pull_data->summary && pull_data->remote_repo_local == NULL)
+    {
+      g_autoptr (GVariant) additional_metadata = g_variant_get_child_value (pull_data->summary, 1);
+      g_variant_lookup (additional_metadata, OSTREE_SUMMARY_CHUNKED_FILES, "b",
+                        &pull_data->remote_chunked_files);
+
+      if (!init_remote_packs (pull_data, error))
+        goto out;
+    }
+
   /* Resolve the checksum for each ref. This has to be done into a new hash table,
    * since we can’t modify the keys of @requested_refs_to_fetch while iterating
    * over it, and we need to ensure the collection IDs are resolved too. */
@@ -4927,6 +6968,28 @@ out:
   else
     g_clear_error (&pull_data->cached_async_error);
 
+  if (opt_trace_file != NULL)
+    {
+      g_autoptr (GError) trace_error = NULL;
+      if (!_ostree_pull_trace_write (pull_data, opt_trace_file, ret, error ? *error : NULL,
+                                     &trace_error))
+        {
+          /* Don't hide why the pull itself failed */
+          if (ret)
+            {
+              g_propagate_error (error, g_steal_pointer (&trace_error));
+              ret = FALSE;
+            }
+          else
+            g_debug ("%s", trace_error->message);
+        }
+    }
+
+  /* Every job has completed by now, since each one counts as an outstanding
+   * content fetch until content_ingest_done().
+   */
+  if (pull_data->content_ingest_pool)
+    g_thread_pool_free (g_steal_pointer (&pull_data->content_ingest_pool), FALSE, TRUE);
   if (!inherit_transaction)
     ostree_repo_abort_transaction (pull_data->repo, cancellable, NULL);
   g_main_context_unref (pull_data->main_context);
@@ -4969,9 +7032,20 @@ out:
   g_clear_pointer (&pull_data->pending_fetch_delta_indexes, g_hash_table_unref);
   g_clear_pointer (&pull_data->pending_fetch_delta_superblocks, g_hash_table_unref);
   g_clear_pointer (&pull_data->pending_fetch_deltaparts, g_hash_table_unref);
+  if (pull_data->pending_fetch_packed)
+    pending_fetch_packed_clear (pull_data);
+  g_clear_pointer (&pull_data->pending_fetch_packed, g_ptr_array_unref);
+  if (pull_data->pending_fetch_chunks)
+    pending_fetch_chunks_clear (pull_data);
+  g_clear_pointer (&pull_data->pending_fetch_chunks, g_ptr_array_unref);
+  g_clear_pointer (&pull_data->pending_fetch_pack_indexes, g_ptr_array_unref);
+  g_clear_pointer (&pull_data->pending_fetch_pack_index_data, g_ptr_array_unref);
+  g_clear_pointer (&pull_data->remote_packs, g_hash_table_unref);
+  g_clear_pointer (&pull_data->remote_pack_names, g_ptr_array_unref);
   g_queue_foreach (&pull_data->scan_object_queue, (GFunc)scan_object_queue_data_free, NULL);
   g_queue_clear (&pull_data->scan_object_queue);
   g_clear_pointer (&pull_data->idle_src, g_source_destroy);
+  g_clear_pointer (&pull_data->pack_batch_idle_src, g_source_destroy);
   g_clear_pointer (&pull_data->dirs, g_ptr_array_unref);
   g_clear_pointer (&remote_config, g_key_file_unref);
   return ret;
@@ -6384,7 +8458,7 @@ ostree_repo_remote_fetch_summary_with_options (OstreeRepo *self, const char *nam
       (void)g_variant_lookup (options, "low-speed-limit-bytes", "u", &low_speed_limit);
       (void)g_variant_lookup (options, "low-speed-time-seconds", "u", &low_speed_time);
       (void)g_variant_lookup (options, "retry-all-network-errors", "b", &retry_all);
-      (void)g_variant_lookup (options, "max-outstanding-fetcher-requests", "b",
+      (void)g_variant_lookup (options, "max-outstanding-fetcher-requests", "u",
                               &max_outstanding_fetcher_requests);
     }
 
@@ -6481,6 +8555,8 @@ ostree_repo_remote_fetch_summary_with_options (OstreeRepo *self, const char *nam
   if (!_ostree_repo_verify_summary (self, name, gpg_verify_summary, signapi_summary_verifiers,
                                     summary, signatures, cancellable, error))
     return FALSE;
+  if (summary != NULL && !_ostree_summary_check_is_index (summary, FALSE, error))
+    return FALSE;
 
   if (!summary_is_from_cache && summary && signatures)
     {
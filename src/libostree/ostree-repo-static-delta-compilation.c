@@ -29,6 +29,9 @@
 #include "ostree-core-private.h"
 #include "ostree-diff.h"
 #include "ostree-lzma-compressor.h"
+#ifdef HAVE_ZSTD
+#include "ostree-zstd-compressor.h"
+#endif
 #include "ostree-repo-private.h"
 #include "ostree-repo-static-delta-private.h"
 #include "ostree-rollsum.h"
@@ -64,12 +67,15 @@ typedef struct
    * write_unique_variant_chunk() and current_part_size_estimate().
    */
   guint64 tables_size;
+  guint number; /* 1-based, for verbose output */
   GLnxTmpfile part_tmpf;
   GVariant *header;
 } OstreeStaticDeltaPartBuilder;
 
 typedef struct
 {
+  OstreeRepo *repo;
+  GCancellable *cancellable;
   GPtrArray *parts;
   GPtrArray *fallback_objects;
   guint64 loose_compressed_size;
@@ -83,8 +89,118 @@ typedef struct
   gboolean swap_endian;
   int parts_dfd;
   DeltaOpts delta_opts;
+  guint8 compression;    /* Part compression type, see OSTREE_STATIC_DELTA_PART_PAYLOAD_FORMAT_V0 */
+  GVariant *zstd_params; /* a{sv} for _ostree_zstd_compressor_new() */
+
+  /* With the n-jobs parameter, rollsum/bsdiff computation and part
+   * compression run on this pool; see delta_job_push().  Results are always
+   * consumed in a fixed order, so the output doesn't depend on it.
+   */
+  guint n_jobs;
+  GThreadPool *pool;
+  GMutex pool_lock;
+  GCond pool_cond;
+  guint n_pool_outstanding;
+  GError *pool_error; /* First error from a job */
 } OstreeStaticDeltaBuilder;
 
+typedef gboolean (*DeltaJobFunc) (OstreeStaticDeltaBuilder *builder, gpointer data,
+                                  GError **error);
+
+typedef struct
+{
+  DeltaJobFunc func;
+  gpointer data;
+} DeltaJob;
+
+static void
+delta_job_run (gpointer datap, gpointer user_data)
+{
+  g_autofree DeltaJob *job = datap;
+  OstreeStaticDeltaBuilder *builder = user_data;
+  g_autoptr (GError) local_error = NULL;
+
+  /* Once a job has failed, just drain the queue */
+  g_mutex_lock (&builder->pool_lock);
+  gboolean failed = builder->pool_error != NULL;
+  g_mutex_unlock (&builder->pool_lock);
+
+  if (!failed)
+    (void)job->func (builder, job->data, &local_error);
+
+  g_mutex_lock (&builder->pool_lock);
+  if (local_error != NULL && builder->pool_error == NULL)
+    builder->pool_error = g_steal_pointer (&local_error);
+  g_assert_cmpuint (builder->n_pool_outstanding, >, 0);
+  builder->n_pool_outstanding--;
+  g_cond_broadcast (&builder->pool_cond);
+  g_mutex_unlock (&builder->pool_lock);
+}
+
+/* Run @func on the worker pool, or right away if there isn't one.  @data
+ * must stay valid until delta_jobs_wait() has returned; errors are reported
+ * from there too.
+ */
+static void
+delta_job_push (OstreeStaticDeltaBuilder *builder, DeltaJobFunc func, gpointer data)
+{
+  if (builder->pool == NULL)
+    {
+      g_autoptr (GError) local_error = NULL;
+      if (builder->pool_error == NULL && !func (builder, data, &local_error))
+        builder->pool_error = g_steal_pointer (&local_error);
+      return;
+    }
+
+  DeltaJob *job = g_new0 (DeltaJob, 1);
+  job->func = func;
+  job->data = data;
+  g_mutex_lock (&builder->pool_lock);
+  builder->n_pool_outstanding++;
+  g_mutex_unlock (&builder->pool_lock);
+
+  g_autoptr (GError) local_error = NULL;
+  if (!g_thread_pool_push (builder->pool, job, &local_error))
+    {
+      /* The job never runs, so account for it here */
+      g_free (job);
+      g_mutex_lock (&builder->pool_lock);
+      if (builder->pool_error == NULL)
+        builder->pool_error = g_steal_pointer (&local_error);
+      builder->n_pool_outstanding--;
+      g_cond_broadcast (&builder->pool_cond);
+      g_mutex_unlock (&builder->pool_lock);
+    }
+}
+
+/* Wait until at most @max_outstanding jobs are still running */
+static gboolean
+delta_jobs_wait (OstreeStaticDeltaBuilder *builder, guint max_outstanding, GError **error)
+{
+  g_mutex_lock (&builder->pool_lock);
+  while (builder->n_pool_outstanding > max_outstanding)
+    g_cond_wait (&builder->pool_cond, &builder->pool_lock);
+  gboolean ret = builder->pool_error == NULL;
+  if (!ret)
+    g_propagate_error (error, g_error_copy (builder->pool_error));
+  g_mutex_unlock (&builder->pool_lock);
+
+  return ret;
+}
+
+static void
+ostree_static_delta_builder_clear (OstreeStaticDeltaBuilder *builder)
+{
+  /* Jobs may still be running after an error; wait for them */
+  if (builder->pool)
+    g_thread_pool_free (g_steal_pointer (&builder->pool), FALSE, TRUE);
+  g_mutex_clear (&builder->pool_lock);
+  g_cond_clear (&builder->pool_cond);
+  g_clear_error (&builder->pool_error);
+  g_clear_pointer (&builder->zstd_params, g_variant_unref);
+}
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (OstreeStaticDeltaBuilder, ostree_static_delta_builder_clear)
+
 /* Get an input stream for a GVariant */
 static GInputStream *
 variant_to_inputstream (GVariant *variant)
@@ -217,10 +333,14 @@ xattr_chunk_equals (const void *one, const void *two)
   return memcmp (g_variant_get_data (v1), g_variant_get_data (v2), l1) == 0;
 }
 
+/* Serialize, compress and checksum a completed part.  This only touches
+ * @part_builder and read-only state of @builder, so it may run on a worker
+ * thread while the next part is being filled.
+ */
 static gboolean
-finish_part (OstreeStaticDeltaBuilder *builder, GError **error)
+finish_part (OstreeStaticDeltaBuilder *builder, gpointer data, GError **error)
 {
-  OstreeStaticDeltaPartBuilder *part_builder = builder->parts->pdata[builder->parts->len - 1];
+  OstreeStaticDeltaPartBuilder *part_builder = data;
   g_autofree guchar *part_checksum = NULL;
   g_autoptr (GBytes) objtype_checksum_array = NULL;
   g_autoptr (GBytes) checksum_bytes = NULL;
@@ -233,9 +353,10 @@ finish_part (OstreeStaticDeltaBuilder *builder, GError **error)
   g_autoptr (GVariant) delta_part_content = NULL;
   g_autoptr (GVariant) delta_part = NULL;
   g_autoptr (GVariant) delta_part_header = NULL;
+  g_autoptr (GBytes) payload = NULL;
   g_auto (GVariantBuilder) mode_builder = OT_VARIANT_BUILDER_INITIALIZER;
   g_auto (GVariantBuilder) xattr_builder = OT_VARIANT_BUILDER_INITIALIZER;
-  guint8 compression_type_char;
+  const guint8 compression_type_char = builder->compression;
 
   g_variant_builder_init (&mode_builder, G_VARIANT_TYPE ("a(uuu)"));
   g_variant_builder_init (&xattr_builder, G_VARIANT_TYPE ("aa(ayay)"));
@@ -259,29 +380,46 @@ finish_part (OstreeStaticDeltaBuilder *builder, GError **error)
     g_variant_ref_sink (delta_part_content);
   }
 
-  /* Hardcode xz for now */
-  compressor = (GConverter *)_ostree_lzma_compressor_new (NULL);
-  compression_type_char = 'x';
-  part_payload_in = variant_to_inputstream (delta_part_content);
-  part_payload_out = (GMemoryOutputStream *)g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
-  part_payload_compressor = (GConverterOutputStream *)g_converter_output_stream_new (
-      (GOutputStream *)part_payload_out, compressor);
+  switch (compression_type_char)
+    {
+    case 0:
+      break;
+    case 'x':
+      compressor = (GConverter *)_ostree_lzma_compressor_new (NULL);
+      break;
+#ifdef HAVE_ZSTD
+    case 'z':
+      compressor = (GConverter *)_ostree_zstd_compressor_new (builder->zstd_params);
+      break;
+#endif
+    default:
+      g_assert_not_reached ();
+    }
 
-  {
-    gssize n_bytes_written = g_output_stream_splice (
-        (GOutputStream *)part_payload_compressor, part_payload_in,
-        G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET | G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE, NULL, error);
-    if (n_bytes_written < 0)
-      return FALSE;
-  }
+  if (compressor == NULL)
+    payload = g_variant_get_data_as_bytes (delta_part_content);
+  else
+    {
+      part_payload_in = variant_to_inputstream (delta_part_content);
+      part_payload_out
+          = (GMemoryOutputStream *)g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+      part_payload_compressor = (GConverterOutputStream *)g_converter_output_stream_new (
+          (GOutputStream *)part_payload_out, compressor);
+
+      gssize n_bytes_written = g_output_stream_splice (
+          (GOutputStream *)part_payload_compressor, part_payload_in,
+          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET | G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE, NULL, error);
+      if (n_bytes_written < 0)
+        return FALSE;
+
+      payload = g_memory_output_stream_steal_as_bytes (part_payload_out);
+    }
 
   g_clear_pointer (&delta_part_content, g_variant_unref);
 
-  {
-    g_autoptr (GBytes) payload = g_memory_output_stream_steal_as_bytes (part_payload_out);
-    delta_part = g_variant_ref_sink (
-        g_variant_new ("(y@ay)", compression_type_char, ot_gvariant_new_ay_bytes (payload)));
-  }
+  delta_part = g_variant_ref_sink (
+      g_variant_new ("(y@ay)", compression_type_char, ot_gvariant_new_ay_bytes (payload)));
+  g_clear_pointer (&payload, g_bytes_unref);
 
   if (!glnx_open_tmpfile_linkable_at (builder->parts_dfd, ".", O_RDWR | O_CLOEXEC,
                                       &part_builder->part_tmpf, error))
@@ -310,23 +448,40 @@ finish_part (OstreeStaticDeltaBuilder *builder, GError **error)
     {
       g_printerr ("part %u n:%u compressed:%" G_GUINT64_FORMAT " uncompressed:%" G_GUINT64_FORMAT
                   "\n",
-                  builder->parts->len, part_builder->objects->len, part_builder->compressed_size,
+                  part_builder->number, part_builder->objects->len, part_builder->compressed_size,
                   part_builder->uncompressed_size);
     }
 
   return TRUE;
 }
 
+/* Hand off the last part for compression.  With a worker pool, this keeps
+ * at most n_jobs parts in flight so memory use stays bounded.
+ */
+static gboolean
+queue_finish_part (OstreeStaticDeltaBuilder *builder, GError **error)
+{
+  OstreeStaticDeltaPartBuilder *part_builder = builder->parts->pdata[builder->parts->len - 1];
+
+  if (builder->pool && !delta_jobs_wait (builder, builder->n_jobs - 1, error))
+    return FALSE;
+  delta_job_push (builder, finish_part, part_builder);
+  if (!builder->pool)
+    return delta_jobs_wait (builder, 0, error);
+  return TRUE;
+}
+
 static OstreeStaticDeltaPartBuilder *
 allocate_part (OstreeStaticDeltaBuilder *builder, GError **error)
 {
   if (builder->parts->len > 0)
     {
-      if (!finish_part (builder, error))
+      if (!queue_finish_part (builder, error))
         return NULL;
     }
 
   OstreeStaticDeltaPartBuilder *part = g_new0 (OstreeStaticDeltaPartBuilder, 1);
+  part->number = builder->parts->len + 1;
   part->objects = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
   part->payload = g_string_new (NULL);
   part->operations = g_string_new (NULL);
@@ -532,6 +687,7 @@ process_one_object (OstreeRepo *repo, OstreeStaticDeltaBuilder *builder,
 typedef struct
 {
   char *from_checksum;
+  GBytes *payload; /* Computed by compute_bsdiff_payload() */
 } ContentBsdiff;
 
 typedef struct
@@ -552,6 +708,7 @@ static void
 content_bsdiffs_free (ContentBsdiff *bsdiff)
 {
   g_free (bsdiff->from_checksum);
+  g_clear_pointer (&bsdiff->payload, g_bytes_unref);
   g_free (bsdiff);
 }
 
@@ -785,6 +942,54 @@ process_one_rollsum (OstreeRepo *repo, OstreeStaticDeltaBuilder *builder,
   return TRUE;
 }
 
+typedef struct
+{
+  const char *to_checksum;
+  ContentBsdiff *bsdiff;
+} BsdiffJob;
+
+/* Run bsdiff for one object; this is the expensive part of
+ * process_one_bsdiff(), split out so it can run on the worker pool.
+ */
+static gboolean
+compute_bsdiff_payload (OstreeStaticDeltaBuilder *builder, gpointer data, GError **error)
+{
+  BsdiffJob *job = data;
+  GCancellable *cancellable = builder->cancellable;
+
+  g_autoptr (GBytes) tmp_from = NULL;
+  if (!get_unpacked_unlinked_content (builder->repo, job->bsdiff->from_checksum, &tmp_from,
+                                      cancellable, error))
+    return FALSE;
+  g_autoptr (GBytes) tmp_to = NULL;
+  if (!get_unpacked_unlinked_content (builder->repo, job->to_checksum, &tmp_to, cancellable,
+                                      error))
+    return FALSE;
+
+  gsize tmp_to_len;
+  const guint8 *tmp_to_buf = g_bytes_get_data (tmp_to, &tmp_to_len);
+  gsize tmp_from_len;
+  const guint8 *tmp_from_buf = g_bytes_get_data (tmp_from, &tmp_from_len);
+
+  struct bsdiff_stream stream;
+  struct bzdiff_opaque_s op;
+  g_autoptr (GOutputStream) out = g_memory_output_stream_new_resizable ();
+  stream.malloc = malloc;
+  stream.free = free;
+  stream.write = bzdiff_write;
+  op.out = out;
+  op.cancellable = cancellable;
+  op.error = error;
+  stream.opaque = &op;
+  if (bsdiff (tmp_from_buf, tmp_from_len, tmp_to_buf, tmp_to_len, &stream) < 0)
+    return glnx_throw (error, "bsdiff generation failed");
+
+  if (!g_output_stream_close (out, cancellable, error))
+    return FALSE;
+  job->bsdiff->payload = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+  return TRUE;
+}
+
 static gboolean
 process_one_bsdiff (OstreeRepo *repo, OstreeStaticDeltaBuilder *builder,
                     OstreeStaticDeltaPartBuilder **current_part_val, const char *to_checksum,
@@ -802,18 +1007,7 @@ process_one_bsdiff (OstreeRepo *repo, OstreeStaticDeltaBuilder *builder,
       *current_part_val = current_part;
     }
 
-  g_autoptr (GBytes) tmp_from = NULL;
-  if (!get_unpacked_unlinked_content (repo, bsdiff_content->from_checksum, &tmp_from, cancellable,
-                                      error))
-    return FALSE;
-  g_autoptr (GBytes) tmp_to = NULL;
-  if (!get_unpacked_unlinked_content (repo, to_checksum, &tmp_to, cancellable, error))
-    return FALSE;
-
-  gsize tmp_to_len;
-  const guint8 *tmp_to_buf = g_bytes_get_data (tmp_to, &tmp_to_len);
-  gsize tmp_from_len;
-  const guint8 *tmp_from_buf = g_bytes_get_data (tmp_from, &tmp_from_len);
+  g_assert (bsdiff_content->payload != NULL);
 
   g_autoptr (GFileInfo) content_finfo = NULL;
   g_autoptr (GVariant) content_xattrs = NULL;
@@ -821,7 +1015,6 @@ process_one_bsdiff (OstreeRepo *repo, OstreeStaticDeltaBuilder *builder,
                               error))
     return FALSE;
   const guint64 content_size = g_file_info_get_size (content_finfo);
-  g_assert_cmpint (tmp_to_len, ==, content_size);
 
   current_part->uncompressed_size += content_size;
 
@@ -848,23 +1041,8 @@ process_one_bsdiff (OstreeRepo *repo, OstreeStaticDeltaBuilder *builder,
     _ostree_write_varuint64 (current_part->operations, content_size);
 
     {
-      struct bsdiff_stream stream;
-      struct bzdiff_opaque_s op;
-      const gchar *payload;
-      gssize payload_size;
-      g_autoptr (GOutputStream) out = g_memory_output_stream_new_resizable ();
-      stream.malloc = malloc;
-      stream.free = free;
-      stream.write = bzdiff_write;
-      op.out = out;
-      op.cancellable = cancellable;
-      op.error = error;
-      stream.opaque = &op;
-      if (bsdiff (tmp_from_buf, tmp_from_len, tmp_to_buf, tmp_to_len, &stream) < 0)
-        return glnx_throw (error, "bsdiff generation failed");
-
-      payload = g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (out));
-      payload_size = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (out));
+      gsize payload_size;
+      const gchar *payload = g_bytes_get_data (bsdiff_content->payload, &payload_size);
 
       g_string_append_c (current_part->operations, (gchar)OSTREE_STATIC_DELTA_OP_BSPATCH);
       _ostree_write_varuint64 (current_part->operations, current_part->payload->len);
@@ -877,11 +1055,11 @@ process_one_bsdiff (OstreeRepo *repo, OstreeStaticDeltaBuilder *builder,
        * hard/messy as it's quite optimized for execution now.
        */
 #if 0
-      g_printerr ("bspatch %s [%llu] → %s [%llu] bsdiff:%llu (%f)\n",
-                  bsdiff_content->from_checksum, (unsigned long long)tmp_from_len,
-                  to_checksum, (unsigned long long)tmp_to_len,
+      g_printerr ("bspatch %s → %s [%llu] bsdiff:%llu (%f)\n",
+                  bsdiff_content->from_checksum,
+                  to_checksum, (unsigned long long)content_size,
                   (unsigned long long)payload_size,
-                  ((double)payload_size)/tmp_to_len);
+                  ((double)payload_size)/content_size);
 #endif
 
       g_string_append_len (current_part->payload, payload, payload_size);
@@ -909,20 +1087,114 @@ check_object_world_readable (OstreeRepo *repo, const char *checksum, gboolean *o
   return TRUE;
 }
 
+typedef struct
+{
+  const char *from_checksum;
+  const char *to_checksum;
+  ContentRollsum *rollsum;
+  ContentBsdiff *bsdiff;
+} ModifiedContent;
+
+static void
+modified_content_free (ModifiedContent *modified)
+{
+  g_clear_pointer (&modified->rollsum, content_rollsums_free);
+  g_clear_pointer (&modified->bsdiff, content_bsdiffs_free);
+  g_free (modified);
+}
+
+/* Decide how to ship a modified file: rollsum if enough of it matches the
+ * old version, otherwise bsdiff if it's small enough.  Runs on the worker
+ * pool; results are merged afterwards in checksum order.
+ */
+static gboolean
+analyze_modified_content (OstreeStaticDeltaBuilder *builder, gpointer data, GError **error)
+{
+  ModifiedContent *modified = data;
+  OstreeRepo *repo = builder->repo;
+  GCancellable *cancellable = builder->cancellable;
+  gboolean from_world_readable = FALSE;
+
+  /* We only want to include in the delta objects that we are sure will
+   * be readable by the client when applying the delta, regardless its
+   * access privileges, so that we don't run into permissions problems
+   * when the client is trying to update a bare-user repository with a
+   * bare repository defined as its parent.
+   */
+  if (!check_object_world_readable (repo, modified->from_checksum, &from_world_readable,
+                                    cancellable, error))
+    return FALSE;
+  if (!from_world_readable)
+    return TRUE;
+
+  if (!try_content_rollsum (repo, builder->delta_opts, modified->from_checksum,
+                            modified->to_checksum, &modified->rollsum, cancellable, error))
+    return FALSE;
+  if (modified->rollsum)
+    return TRUE;
+
+  if (!(builder->delta_opts & DELTAOPT_FLAG_DISABLE_BSDIFF))
+    {
+      if (!try_content_bsdiff (repo, modified->from_checksum, modified->to_checksum,
+                               &modified->bsdiff, builder->max_bsdiff_size_bytes, cancellable,
+                               error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static int
+compare_checksums_for_sorting (gconstpointer a_pp, gconstpointer b_pp)
+{
+  const char *a = *((const char **)a_pp);
+  const char *b = *((const char **)b_pp);
+
+  return strcmp (a, b);
+}
+
+static int
+compare_object_names_for_sorting (gconstpointer a_pp, gconstpointer b_pp)
+{
+  GVariant *a = *((GVariant **)a_pp);
+  GVariant *b = *((GVariant **)b_pp);
+  const char *a_checksum, *b_checksum;
+  OstreeObjectType a_objtype, b_objtype;
+
+  ostree_object_name_deserialize (a, &a_checksum, &a_objtype);
+  ostree_object_name_deserialize (b, &b_checksum, &b_objtype);
+
+  int r = strcmp (a_checksum, b_checksum);
+  if (r != 0)
+    return r;
+  return (int)a_objtype - (int)b_objtype;
+}
+
+/* Objects are emitted in sorted order rather than hash table order, so
+ * that the generated parts are reproducible.
+ */
+static GPtrArray *
+sorted_table_keys (GHashTable *table, GCompareFunc compare)
+{
+  GPtrArray *ret = g_ptr_array_sized_new (g_hash_table_size (table));
+  GLNX_HASH_TABLE_FOREACH (table, gpointer, key)
+    g_ptr_array_add (ret, key);
+  g_ptr_array_sort (ret, compare);
+  return ret;
+}
+
 static gboolean
 generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, DeltaOpts opts,
                            OstreeStaticDeltaBuilder *builder, GCancellable *cancellable,
                            GError **error)
 {
-  GHashTableIter hashiter;
-  gpointer key, value;
   OstreeStaticDeltaPartBuilder *current_part = NULL;
   g_autoptr (GFile) root_from = NULL;
   g_autoptr (GVariant) from_commit = NULL;
   g_autoptr (GFile) root_to = NULL;
   g_autoptr (GVariant) to_commit = NULL;
-  g_autoptr (GHashTable) to_reachable_objects = NULL;
-  g_autoptr (GHashTable) from_reachable_objects = NULL;
+  g_autoptr (OstreeRepoObjectSet) to_reachable_objects = ostree_repo_object_set_new ();
+  g_autoptr (OstreeRepoObjectSet) from_reachable_objects = NULL;
   g_autoptr (GHashTable) new_reachable_metadata = NULL;
   g_autoptr (GHashTable) new_reachable_regfile_content = NULL;
   g_autoptr (GHashTable) new_reachable_symlink_content = NULL;
@@ -938,7 +1210,9 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
       if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_COMMIT, from, &from_commit, error))
         return FALSE;
 
-      if (!ostree_repo_traverse_commit (repo, from, 0, &from_reachable_objects, cancellable, error))
+      from_reachable_objects = ostree_repo_object_set_new ();
+      if (!ostree_repo_traverse_commit_set (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, from, 0,
+                                            from_reachable_objects, cancellable, error))
         return FALSE;
     }
 
@@ -947,40 +1221,40 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
   if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_COMMIT, to, &to_commit, error))
     return FALSE;
 
-  if (!ostree_repo_traverse_commit (repo, to, 0, &to_reachable_objects, cancellable, error))
+  if (!ostree_repo_traverse_commit_set (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, to, 0,
+                                        to_reachable_objects, cancellable, error))
     return FALSE;
 
   new_reachable_metadata = ostree_repo_traverse_new_reachable ();
   new_reachable_regfile_content = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
   new_reachable_symlink_content = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
 
-  g_hash_table_iter_init (&hashiter, to_reachable_objects);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
+  OstreeRepoObjectSetIter setiter;
+  const char *new_checksum;
+  OstreeObjectType new_objtype;
+  ostree_repo_object_set_iter_init (&setiter, to_reachable_objects);
+  while (ostree_repo_object_set_iter_next (&setiter, &new_checksum, &new_objtype))
     {
-      GVariant *serialized_key = key;
-      const char *checksum;
-      OstreeObjectType objtype;
-
-      if (from_reachable_objects && g_hash_table_contains (from_reachable_objects, serialized_key))
+      if (from_reachable_objects
+          && ostree_repo_object_set_contains (from_reachable_objects, new_checksum, new_objtype))
         continue;
 
-      ostree_object_name_deserialize (serialized_key, &checksum, &objtype);
-
-      if (OSTREE_OBJECT_TYPE_IS_META (objtype))
-        g_hash_table_add (new_reachable_metadata, g_variant_ref (serialized_key));
+      if (OSTREE_OBJECT_TYPE_IS_META (new_objtype))
+        g_hash_table_add (new_reachable_metadata, g_variant_ref_sink (ostree_object_name_serialize (
+                                                      new_checksum, new_objtype)));
       else
         {
           g_autoptr (GFileInfo) finfo = NULL;
           GFileType ftype;
 
-          if (!ostree_repo_load_file (repo, checksum, NULL, &finfo, NULL, cancellable, error))
+          if (!ostree_repo_load_file (repo, new_checksum, NULL, &finfo, NULL, cancellable, error))
             return FALSE;
 
           ftype = g_file_info_get_file_type (finfo);
           if (ftype == G_FILE_TYPE_REGULAR)
-            g_hash_table_add (new_reachable_regfile_content, g_strdup (checksum));
+            g_hash_table_add (new_reachable_regfile_content, g_strdup (new_checksum));
           else if (ftype == G_FILE_TYPE_SYMBOLIC_LINK)
-            g_hash_table_add (new_reachable_symlink_content, g_strdup (checksum));
+            g_hash_table_add (new_reachable_symlink_content, g_strdup (new_checksum));
           else
             g_assert_not_reached ();
         }
@@ -1018,48 +1292,38 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
   bsdiff_optimized_content_objects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
                                                             (GDestroyNotify)content_bsdiffs_free);
 
-  g_hash_table_iter_init (&hashiter, modified_regfile_content);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
-    {
-      const char *to_checksum = key;
-      const char *from_checksum = value;
-      ContentRollsum *rollsum;
-      ContentBsdiff *bsdiff;
-      gboolean from_world_readable = FALSE;
-
-      /* We only want to include in the delta objects that we are sure will
-       * be readable by the client when applying the delta, regardless its
-       * access privileges, so that we don't run into permissions problems
-       * when the client is trying to update a bare-user repository with a
-       * bare repository defined as its parent.
-       */
-      if (!check_object_world_readable (repo, from_checksum, &from_world_readable, cancellable,
-                                        error))
-        return FALSE;
-      if (!from_world_readable)
-        continue;
-
-      if (!try_content_rollsum (repo, opts, from_checksum, to_checksum, &rollsum, cancellable,
-                                error))
-        return FALSE;
-
-      if (rollsum)
-        {
-          g_hash_table_insert (rollsum_optimized_content_objects, g_strdup (to_checksum), rollsum);
-          builder->rollsum_size += rollsum->matches->match_size;
-          continue;
-        }
+  {
+    g_autoptr (GPtrArray) modified
+        = g_ptr_array_new_with_free_func ((GDestroyNotify)modified_content_free);
+    g_autoptr (GPtrArray) sorted_modified
+        = sorted_table_keys (modified_regfile_content, compare_checksums_for_sorting);
 
-      if (!(opts & DELTAOPT_FLAG_DISABLE_BSDIFF))
-        {
-          if (!try_content_bsdiff (repo, from_checksum, to_checksum, &bsdiff,
-                                   builder->max_bsdiff_size_bytes, cancellable, error))
-            return FALSE;
+    for (guint i = 0; i < sorted_modified->len; i++)
+      {
+        ModifiedContent *m = g_new0 (ModifiedContent, 1);
+        m->to_checksum = sorted_modified->pdata[i];
+        m->from_checksum = g_hash_table_lookup (modified_regfile_content, m->to_checksum);
+        g_ptr_array_add (modified, m);
+        delta_job_push (builder, analyze_modified_content, m);
+      }
+    if (!delta_jobs_wait (builder, 0, error))
+      return FALSE;
 
-          if (bsdiff)
-            g_hash_table_insert (bsdiff_optimized_content_objects, g_strdup (to_checksum), bsdiff);
-        }
-    }
+    for (guint i = 0; i < modified->len; i++)
+      {
+        ModifiedContent *m = modified->pdata[i];
+
+        if (m->rollsum)
+          {
+            builder->rollsum_size += m->rollsum->matches->match_size;
+            g_hash_table_insert (rollsum_optimized_content_objects, g_strdup (m->to_checksum),
+                                 g_steal_pointer (&m->rollsum));
+          }
+        else if (m->bsdiff)
+          g_hash_table_insert (bsdiff_optimized_content_objects, g_strdup (m->to_checksum),
+                               g_steal_pointer (&m->bsdiff));
+      }
+  }
 
   if (opts & DELTAOPT_FLAG_VERBOSE)
     {
@@ -1073,10 +1337,11 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
     return FALSE;
 
   /* Pack the metadata first */
-  g_hash_table_iter_init (&hashiter, new_reachable_metadata);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
+  g_autoptr (GPtrArray) sorted_metadata
+      = sorted_table_keys (new_reachable_metadata, compare_object_names_for_sorting);
+  for (guint i = 0; i < sorted_metadata->len; i++)
     {
-      GVariant *serialized_key = key;
+      GVariant *serialized_key = sorted_metadata->pdata[i];
       const char *checksum;
       OstreeObjectType objtype;
 
@@ -1088,11 +1353,12 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
 
   /* Now do rollsummed objects */
 
-  g_hash_table_iter_init (&hashiter, rollsum_optimized_content_objects);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
+  g_autoptr (GPtrArray) sorted_rollsum
+      = sorted_table_keys (rollsum_optimized_content_objects, compare_checksums_for_sorting);
+  for (guint i = 0; i < sorted_rollsum->len; i++)
     {
-      const char *checksum = key;
-      ContentRollsum *rollsum = value;
+      const char *checksum = sorted_rollsum->pdata[i];
+      ContentRollsum *rollsum = g_hash_table_lookup (rollsum_optimized_content_objects, checksum);
 
       if (!process_one_rollsum (repo, builder, &current_part, checksum, rollsum, cancellable,
                                 error))
@@ -1101,36 +1367,57 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
       builder->n_rollsum++;
     }
 
-  /* Now do bsdiff'ed objects */
+  /* Now do bsdiff'ed objects.  The diffs are computed a window at a time on
+   * the worker pool, then appended to the parts in order.
+   */
 
-  const guint n_bsdiff = g_hash_table_size (bsdiff_optimized_content_objects);
+  g_autoptr (GPtrArray) sorted_bsdiff
+      = sorted_table_keys (bsdiff_optimized_content_objects, compare_checksums_for_sorting);
+  const guint n_bsdiff = sorted_bsdiff->len;
   if (n_bsdiff > 0)
     {
       const guint mod = n_bsdiff / 10;
-      g_hash_table_iter_init (&hashiter, bsdiff_optimized_content_objects);
-      while (g_hash_table_iter_next (&hashiter, &key, &value))
-        {
-          const char *checksum = key;
-          ContentBsdiff *bsdiff = value;
+      const guint window = MAX (builder->n_jobs, 1) * 2;
+      g_autofree BsdiffJob *jobs = g_new0 (BsdiffJob, window);
 
-          if (opts & DELTAOPT_FLAG_VERBOSE && (mod == 0 || builder->n_bsdiff % mod == 0))
-            g_printerr ("processing bsdiff: [%u/%u]\n", builder->n_bsdiff, n_bsdiff);
+      for (guint i = 0; i < n_bsdiff; i += window)
+        {
+          const guint n = MIN (window, n_bsdiff - i);
 
-          if (!process_one_bsdiff (repo, builder, &current_part, checksum, bsdiff, cancellable,
-                                   error))
+          for (guint j = 0; j < n; j++)
+            {
+              jobs[j].to_checksum = sorted_bsdiff->pdata[i + j];
+              jobs[j].bsdiff
+                  = g_hash_table_lookup (bsdiff_optimized_content_objects, jobs[j].to_checksum);
+              delta_job_push (builder, compute_bsdiff_payload, &jobs[j]);
+            }
+          if (!delta_jobs_wait (builder, 0, error))
             return FALSE;
 
-          builder->n_bsdiff++;
+          for (guint j = 0; j < n; j++)
+            {
+              if (opts & DELTAOPT_FLAG_VERBOSE && (mod == 0 || builder->n_bsdiff % mod == 0))
+                g_printerr ("processing bsdiff: [%u/%u]\n", builder->n_bsdiff, n_bsdiff);
+
+              if (!process_one_bsdiff (repo, builder, &current_part, jobs[j].to_checksum,
+                                       jobs[j].bsdiff, cancellable, error))
+                return FALSE;
+              g_clear_pointer (&jobs[j].bsdiff->payload, g_bytes_unref);
+
+              builder->n_bsdiff++;
+            }
         }
     }
 
   /* Scan for large objects, so we can fall back to plain HTTP-based
    * fetch.
    */
-  g_hash_table_iter_init (&hashiter, new_reachable_regfile_content);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
+  g_autoptr (GHashTable) fallback_content = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr (GPtrArray) sorted_regfile
+      = sorted_table_keys (new_reachable_regfile_content, compare_checksums_for_sorting);
+  for (guint i = 0; i < sorted_regfile->len; i++)
     {
-      const char *checksum = key;
+      const char *checksum = sorted_regfile->pdata[i];
       guint64 uncompressed_size;
       gboolean fallback = FALSE;
 
@@ -1155,20 +1442,20 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
 
           g_ptr_array_add (builder->fallback_objects,
                            ostree_object_name_serialize (checksum, OSTREE_OBJECT_TYPE_FILE));
-          g_hash_table_iter_remove (&hashiter);
+          g_hash_table_add (fallback_content, (char *)checksum);
           builder->n_fallback++;
         }
     }
 
   /* Now non-rollsummed or bsdiff'ed regular file content */
-  g_hash_table_iter_init (&hashiter, new_reachable_regfile_content);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
+  for (guint i = 0; i < sorted_regfile->len; i++)
     {
-      const char *checksum = key;
+      const char *checksum = sorted_regfile->pdata[i];
 
-      /* Skip content objects we rollsum'd */
+      /* Skip content objects we rollsum'd or are shipping as fallbacks */
       if (g_hash_table_contains (rollsum_optimized_content_objects, checksum)
-          || g_hash_table_contains (bsdiff_optimized_content_objects, checksum))
+          || g_hash_table_contains (bsdiff_optimized_content_objects, checksum)
+          || g_hash_table_contains (fallback_content, checksum))
         continue;
 
       if (!process_one_object (repo, builder, &current_part, checksum, OSTREE_OBJECT_TYPE_FILE,
@@ -1177,17 +1464,20 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
     }
 
   /* Now symlinks */
-  g_hash_table_iter_init (&hashiter, new_reachable_symlink_content);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
+  g_autoptr (GPtrArray) sorted_symlinks
+      = sorted_table_keys (new_reachable_symlink_content, compare_checksums_for_sorting);
+  for (guint i = 0; i < sorted_symlinks->len; i++)
     {
-      const char *checksum = key;
+      const char *checksum = sorted_symlinks->pdata[i];
 
       if (!process_one_object (repo, builder, &current_part, checksum, OSTREE_OBJECT_TYPE_FILE,
                                cancellable, error))
         return FALSE;
     }
 
-  if (!finish_part (builder, error))
+  if (!queue_finish_part (builder, error))
+    return FALSE;
+  if (!delta_jobs_wait (builder, 0, error))
     return FALSE;
 
   return TRUE;
@@ -1265,10 +1555,16 @@ get_fallback_headers (OstreeRepo *self, OstreeStaticDeltaBuilder *builder, GVari
  *   - max-chunk-size: u: Maximum size in megabytes of a delta part
  *   - max-bsdiff-size: u: Maximum size in megabytes to consider bsdiff compression
  *   for input files
- *   - compression: y: Compression type: 0=none, x=lzma, g=gzip
+ *   - compression: y: Compression type: 0=none, x=lzma, z=zstd.  Default x.  g=gzip was
+ * documented but never implemented, and is still accepted as lzma.  Other values are an error.
+ *   - zstd-long: b: Enable zstd long-range matching.  Default FALSE.  (Since: 2026.5)
+ *   - zstd-dictionary: ay: Dictionary for zstd; it is stored in the superblock and shared by all
+ * parts.  (Since: 2026.5)
  *   - bsdiff-enabled: b: Enable bsdiff compression.  Default TRUE.
  *   - inline-parts: b: Put part data in header, to get a single file delta.  Default FALSE.
  *   - verbose: b: Print diagnostic messages.  Default FALSE.
+ *   - n-jobs: u: Number of threads used to compute diffs and compress parts; 0 or 1 means no
+ * threads.  The output does not depend on this.  Default 1.  (Since: 2026.5)
  *   - endianness: b: Deltas use host byte order by default; this option allows choosing
  * (G_BIG_ENDIAN or G_LITTLE_ENDIAN)
  *   - filename: ^ay: Save delta superblock to this filename (bytestring), and parts in the same
@@ -1281,9 +1577,6 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
                                    const char *from, const char *to, GVariant *metadata,
                                    GVariant *params, GCancellable *cancellable, GError **error)
 {
-  OstreeStaticDeltaBuilder builder = {
-    0,
-  };
   guint i;
   guint min_fallback_size;
   guint max_bsdiff_size;
@@ -1304,6 +1597,14 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
       = g_ptr_array_new_with_free_func ((GDestroyNotify)ostree_static_delta_part_builder_unref);
   g_autoptr (GPtrArray) builder_fallback_objects
       = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+  /* Declared after the arrays above so any in-flight jobs are waited for
+   * before the parts are freed.
+   */
+  g_auto (OstreeStaticDeltaBuilder) builder = {
+    0,
+  };
+  g_mutex_init (&builder.pool_lock);
+  g_cond_init (&builder.pool_cond);
   g_auto (GLnxTmpfile) descriptor_tmpf = {
     0,
   };
@@ -1348,6 +1649,50 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
   if (!g_variant_lookup (params, "inline-parts", "b", &inline_parts))
     inline_parts = FALSE;
 
+  guint8 compression;
+  if (!g_variant_lookup (params, "compression", "y", &compression))
+    compression = 'x';
+  g_autoptr (GVariant) zstd_dictionary
+      = g_variant_lookup_value (params, "zstd-dictionary", G_VARIANT_TYPE ("ay"));
+  switch (compression)
+    {
+    case 'g':
+      /* Earlier versions ignored this option and always used lzma */
+      compression = 'x';
+      break;
+    case 0:
+    case 'x':
+      break;
+    case 'z':
+#ifdef HAVE_ZSTD
+      {
+        gboolean zstd_long;
+        if (!g_variant_lookup (params, "zstd-long", "b", &zstd_long))
+          zstd_long = FALSE;
+
+        g_auto (GVariantBuilder) zstd_builder = OT_VARIANT_BUILDER_INITIALIZER;
+        g_variant_builder_init (&zstd_builder, G_VARIANT_TYPE ("a{sv}"));
+        g_variant_builder_add (&zstd_builder, "{sv}", "long", g_variant_new_boolean (zstd_long));
+        if (zstd_dictionary)
+          g_variant_builder_add (&zstd_builder, "{sv}", "dictionary", zstd_dictionary);
+        builder.zstd_params = g_variant_ref_sink (g_variant_builder_end (&zstd_builder));
+      }
+      break;
+#else
+      return glnx_throw (error, "zstd compression is not supported by this build");
+#endif
+    default:
+      return glnx_throw (error, "Invalid compression type '%u'", compression);
+    }
+  if (zstd_dictionary && compression != 'z')
+    return glnx_throw (error, "zstd-dictionary requires zstd compression");
+  builder.compression = compression;
+
+  guint n_jobs;
+  if (!g_variant_lookup (params, "n-jobs", "u", &n_jobs))
+    n_jobs = 1;
+  n_jobs = MAX (n_jobs, 1);
+
   if (!g_variant_lookup (params, "filename", "^&ay", &opt_filename))
     opt_filename = NULL;
   else if (opt_filename[0] == '\0')
@@ -1365,6 +1710,15 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
     return FALSE;
 
   builder.delta_opts = delta_opts;
+  builder.repo = self;
+  builder.cancellable = cancellable;
+  builder.n_jobs = n_jobs;
+  if (n_jobs > 1)
+    {
+      builder.pool = g_thread_pool_new (delta_job_run, &builder, n_jobs, FALSE, error);
+      if (!builder.pool)
+        return FALSE;
+    }
 
   if (opt_filename)
     {
@@ -1445,6 +1799,18 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
       return FALSE;
   }
 
+  /* Let clients check that they can decompress the parts before fetching
+   * any of them.
+   */
+  if (!ot_variant_builder_add (descriptor_builder, error, "{sv}",
+                               OSTREE_STATIC_DELTA_META_COMPRESSION,
+                               g_variant_new_byte (builder.compression)))
+    return FALSE;
+  if (zstd_dictionary != NULL
+      && !ot_variant_builder_add (descriptor_builder, error, "{sv}",
+                                  OSTREE_STATIC_DELTA_META_ZSTD_DICTIONARY, zstd_dictionary))
+    return FALSE;
+
   part_headers = g_variant_builder_new (G_VARIANT_TYPE ("a" OSTREE_STATIC_DELTA_META_ENTRY_FORMAT));
   for (i = 0; i < builder.parts->len; i++)
     {
@@ -1504,13 +1870,16 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
 
   /* Generate OSTREE_STATIC_DELTA_SUPERBLOCK_FORMAT */
   {
-    GDateTime *now = g_date_time_new_now_utc ();
+    /* Like commits, honor SOURCE_DATE_EPOCH for reproducible output */
+    gint64 timestamp;
+    if (!_ostree_get_timestamp_now (&timestamp, error))
+      return FALSE;
     /* floating */ GVariant *from_csum_v
         = from ? ostree_checksum_to_bytes_v (from) : ot_gvariant_new_bytearray ((guchar *)"", 0);
     /* floating */ GVariant *to_csum_v = ostree_checksum_to_bytes_v (to);
 
     if (!ot_variant_builder_add (descriptor_builder, error, "t",
-                                 GUINT64_TO_BE (g_date_time_to_unix (now)))
+                                 GUINT64_TO_BE ((guint64)timestamp))
         || !ot_variant_builder_add_value (descriptor_builder, from_csum_v, error)
         || !ot_variant_builder_add_value (descriptor_builder, to_csum_v, error)
         || !ot_variant_builder_add_value (descriptor_builder, to_commit, error)
@@ -1523,8 +1892,6 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
 
     if (!ot_variant_builder_end (descriptor_builder, error))
       return FALSE;
-
-    g_date_time_unref (now);
   }
 
   if (delta_opts & DELTAOPT_FLAG_VERBOSE)
@@ -23,6 +23,9 @@
 #include "ostree-cmd-private.h"
 #include "ostree-core-private.h"
 #include "ostree-lzma-decompressor.h"
+#ifdef HAVE_ZSTD
+#include "ostree-zstd-decompressor.h"
+#endif
 #include "ostree-repo-private.h"
 #include "ostree-repo-static-delta-private.h"
 #include "otutil.h"
@@ -474,6 +477,10 @@ ostree_repo_static_delta_execute_offline_with_signature (OstreeRepo *self, GFile
 
   g_autoptr (GVariant) metadata = g_variant_get_child_value (meta, 0);
 
+  g_autoptr (GBytes) zstd_dictionary = NULL;
+  if (!_ostree_delta_get_compression (meta, NULL, &zstd_dictionary, error))
+    return FALSE;
+
   g_autofree char *to_checksum = NULL;
   g_autofree char *from_checksum = NULL;
   /* Write the to-commit object */
@@ -585,8 +592,8 @@ ostree_repo_static_delta_execute_offline_with_signature (OstreeRepo *self, GFile
            */
           delta_open_flags |= OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM;
 
-          if (!_ostree_static_delta_part_open (part_in, inline_part_bytes, delta_open_flags, NULL,
-                                               &part, cancellable, error))
+          if (!_ostree_static_delta_part_open (part_in, inline_part_bytes, delta_open_flags,
+                                               zstd_dictionary, NULL, &part, cancellable, error))
             return FALSE;
         }
       else
@@ -598,8 +605,8 @@ ostree_repo_static_delta_execute_offline_with_signature (OstreeRepo *self, GFile
 
           part_in = g_unix_input_stream_new (part_fd, FALSE);
 
-          if (!_ostree_static_delta_part_open (part_in, NULL, delta_open_flags, checksum, &part,
-                                               cancellable, error))
+          if (!_ostree_static_delta_part_open (part_in, NULL, delta_open_flags, zstd_dictionary,
+                                               checksum, &part, cancellable, error))
             return FALSE;
         }
 
@@ -633,10 +640,59 @@ ostree_repo_static_delta_execute_offline (OstreeRepo *self, GFile *dir_or_file,
       self, dir_or_file, NULL, skip_validation, cancellable, error);
 }
 
+/* Whether this build can decompress parts with compression type @comptype */
+gboolean
+_ostree_static_delta_compression_supported (guint8 comptype)
+{
+  switch (comptype)
+    {
+    case 0:
+    case 'x':
+      return TRUE;
+#ifdef HAVE_ZSTD
+    case 'z':
+      return TRUE;
+#endif
+    default:
+      return FALSE;
+    }
+}
+
+/* Read the part compression type and optional zstd dictionary from the
+ * superblock metadata.  Deltas predating these keys always use LZMA.
+ */
+gboolean
+_ostree_delta_get_compression (GVariant *superblock, guint8 *out_comptype,
+                               GBytes **out_zstd_dictionary, GError **error)
+{
+  g_autoptr (GVariant) delta_meta = g_variant_get_child_value (superblock, 0);
+
+  guint8 comptype;
+  if (!g_variant_lookup (delta_meta, OSTREE_STATIC_DELTA_META_COMPRESSION, "y", &comptype))
+    comptype = 'x';
+  if (!_ostree_static_delta_compression_supported (comptype))
+    {
+      if (comptype == 'z')
+        return glnx_throw (error, "Static delta uses zstd compression, which is not supported "
+                                  "by this build");
+      return glnx_throw (error, "Invalid compression type '%u'", comptype);
+    }
+
+  g_autoptr (GVariant) dict_v = g_variant_lookup_value (
+      delta_meta, OSTREE_STATIC_DELTA_META_ZSTD_DICTIONARY, G_VARIANT_TYPE ("ay"));
+
+  if (out_comptype)
+    *out_comptype = comptype;
+  if (out_zstd_dictionary)
+    *out_zstd_dictionary = dict_v ? g_variant_get_data_as_bytes (dict_v) : NULL;
+  return TRUE;
+}
+
 gboolean
 _ostree_static_delta_part_open (GInputStream *part_in, GBytes *inline_part_bytes,
-                                OstreeStaticDeltaOpenFlags flags, const char *expected_checksum,
-                                GVariant **out_part, GCancellable *cancellable, GError **error)
+                                OstreeStaticDeltaOpenFlags flags, GBytes *zstd_dictionary,
+                                const char *expected_checksum, GVariant **out_part,
+                                GCancellable *cancellable, GError **error)
 {
   const gboolean trusted = (flags & OSTREE_STATIC_DELTA_OPEN_FLAGS_VARIANT_TRUSTED) > 0;
   const gboolean skip_checksum = (flags & OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM) > 0;
@@ -708,6 +764,21 @@ _ostree_static_delta_part_open (GInputStream *part_in, GBytes *inline_part_bytes
             G_VARIANT_TYPE (OSTREE_STATIC_DELTA_PART_PAYLOAD_FORMAT_V0), buf, FALSE);
       }
       break;
+#ifdef HAVE_ZSTD
+    case 'z':
+      {
+        g_autoptr (GConverter) decomp
+            = (GConverter *)_ostree_zstd_decompressor_new (zstd_dictionary);
+        g_autoptr (GInputStream) convin = g_converter_input_stream_new (source_in, decomp);
+        g_autoptr (GBytes) buf = ot_map_anonymous_tmpfile_from_content (convin, cancellable, error);
+        if (!buf)
+          return FALSE;
+
+        ret_part = g_variant_new_from_bytes (
+            G_VARIANT_TYPE (OSTREE_STATIC_DELTA_PART_PAYLOAD_FORMAT_V0), buf, FALSE);
+      }
+      break;
+#endif
     default:
       return glnx_throw (error, "Invalid compression type '%u'", comptype);
     }
@@ -730,9 +801,9 @@ _ostree_static_delta_part_open (GInputStream *part_in, GBytes *inline_part_bytes
  */
 
 static gboolean
-show_one_part (OstreeRepo *self, gboolean swap_endian, const char *from, const char *to,
-               GVariant *meta_entries, guint i, guint64 *total_size_ref, guint64 *total_usize_ref,
-               GCancellable *cancellable, GError **error)
+show_one_part (OstreeRepo *self, gboolean swap_endian, GBytes *zstd_dictionary, const char *from,
+               const char *to, GVariant *meta_entries, guint i, guint64 *total_size_ref,
+               guint64 *total_usize_ref, GCancellable *cancellable, GError **error)
 {
   g_autofree char *part_path = _ostree_get_relative_static_delta_part_path (from, to, i);
 
@@ -755,7 +826,7 @@ show_one_part (OstreeRepo *self, gboolean swap_endian, const char *from, const c
 
   g_autoptr (GVariant) part = NULL;
   if (!_ostree_static_delta_part_open (part_in, NULL, OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM,
-                                       NULL, &part, cancellable, error))
+                                       zstd_dictionary, NULL, &part, cancellable, error))
     return FALSE;
 
   {
@@ -1047,6 +1118,40 @@ _ostree_repo_static_delta_dump (OstreeRepo *self, const char *delta_id, GCancell
     g_print ("Endianness: %s\n", endianness_description);
   }
 
+  g_autoptr (GBytes) zstd_dictionary = NULL;
+  {
+    g_autoptr (GVariant) delta_meta = g_variant_get_child_value (delta_superblock, 0);
+    guint8 comptype;
+    const char *compression_description;
+
+    if (!g_variant_lookup (delta_meta, OSTREE_STATIC_DELTA_META_COMPRESSION, "y", &comptype))
+      comptype = 'x';
+    switch (comptype)
+      {
+      case 0:
+        compression_description = "none";
+        break;
+      case 'x':
+        compression_description = "lzma";
+        break;
+      case 'z':
+        compression_description = "zstd";
+        break;
+      default:
+        compression_description = "invalid";
+        break;
+      }
+    g_print ("Compression: %s\n", compression_description);
+
+    g_autoptr (GVariant) dict_v = g_variant_lookup_value (
+        delta_meta, OSTREE_STATIC_DELTA_META_ZSTD_DICTIONARY, G_VARIANT_TYPE ("ay"));
+    if (dict_v)
+      {
+        zstd_dictionary = g_variant_get_data_as_bytes (dict_v);
+        g_print ("Zstd Dictionary Size: %" G_GSIZE_FORMAT "\n", g_bytes_get_size (zstd_dictionary));
+      }
+  }
+
   guint64 ts;
   g_variant_get_child (delta_superblock, 1, "t", &ts);
   g_print ("Timestamp: %" G_GUINT64_FORMAT "\n", GUINT64_FROM_BE (ts));
@@ -1095,8 +1200,8 @@ _ostree_repo_static_delta_dump (OstreeRepo *self, const char *delta_id, GCancell
 
   for (guint i = 0; i < n_parts; i++)
     {
-      if (!show_one_part (self, swap_endian, from_commit, to_commit, meta_entries, i, &total_size,
-                          &total_usize, cancellable, error))
+      if (!show_one_part (self, swap_endian, zstd_dictionary, from_commit, to_commit, meta_entries,
+                          i, &total_size, &total_usize, cancellable, error))
         return FALSE;
     }
 
@@ -1218,6 +1323,16 @@ gboolean
 ostree_repo_static_delta_reindex (OstreeRepo *repo, OstreeStaticDeltaIndexFlags flags,
                                   const char *opt_to_commit, GCancellable *cancellable,
                                   GError **error)
+{
+  return _ostree_repo_static_delta_reindex (repo, NULL, opt_to_commit, cancellable, error);
+}
+
+/* Like ostree_repo_static_delta_reindex(), reusing the superblock digests in
+ * @summary_state if non-%NULL */
+gboolean
+_ostree_repo_static_delta_reindex (OstreeRepo *repo, OstreeRepoSummaryState *summary_state,
+                                   const char *opt_to_commit, GCancellable *cancellable,
+                                   GError **error)
 {
   g_autoptr (GPtrArray) all_deltas = NULL;
   g_autoptr (GHashTable) deltas_to_commit_ht
@@ -1327,8 +1442,12 @@ ostree_repo_static_delta_reindex (OstreeRepo *repo, OstreeStaticDeltaIndexFlags
               g_autofree char *delta_name = NULL;
               GVariant *digest;
 
-              digest = _ostree_repo_static_delta_superblock_digest (repo, from, to, cancellable,
-                                                                    error);
+              if (summary_state != NULL)
+                digest = _ostree_repo_summary_state_get_delta_digest (repo, summary_state, from,
+                                                                      to, cancellable, error);
+              else
+                digest = _ostree_repo_static_delta_superblock_digest (repo, from, to,
+                                                                      cancellable, error);
               if (digest == NULL)
                 return FALSE;
 
@@ -31,7 +31,7 @@ G_BEGIN_DECLS
 /**
  * OSTREE_STATIC_DELTA_PART_PAYLOAD_FORMAT_V0:
  *
- *   y  compression type (0: none, 'x': lzma)
+ *   y  compression type (0: none, 'x': lzma, 'z': zstd)
  *   ---
  *   a(uuu) modes
  *   aa(ayay) xattrs
@@ -40,6 +40,13 @@ G_BEGIN_DECLS
  */
 #define OSTREE_STATIC_DELTA_PART_PAYLOAD_FORMAT_V0 "(a(uuu)aa(ayay)ayay)"
 
+/* Superblock metadata keys describing how the parts are compressed.  The
+ * first is the compression type byte used by the parts ('y'); the second
+ * is an optional dictionary shared by all zstd parts of the delta ('ay').
+ */
+#define OSTREE_STATIC_DELTA_META_COMPRESSION "ostree.compression"
+#define OSTREE_STATIC_DELTA_META_ZSTD_DICTIONARY "ostree.zstd-dictionary"
+
 /**
  * OSTREE_STATIC_DELTA_META_ENTRY_FORMAT:
  *
@@ -140,10 +147,15 @@ typedef enum
 #define OSTREE_STATIC_DELTA_N_OPS 7
 
 gboolean _ostree_static_delta_part_open (GInputStream *part_in, GBytes *inline_part_bytes,
-                                         OstreeStaticDeltaOpenFlags flags,
+                                         OstreeStaticDeltaOpenFlags flags, GBytes *zstd_dictionary,
                                          const char *expected_checksum, GVariant **out_part,
                                          GCancellable *cancellable, GError **error);
 
+gboolean _ostree_static_delta_compression_supported (guint8 comptype);
+
+gboolean _ostree_delta_get_compression (GVariant *superblock, guint8 *out_comptype,
+                                        GBytes **out_zstd_dictionary, GError **error);
+
 typedef struct
 {
   guint n_ops_executed[OSTREE_STATIC_DELTA_N_OPS];
@@ -155,7 +167,11 @@ gboolean _ostree_static_delta_part_execute (OstreeRepo *repo, GVariant *header,
                                             GCancellable *cancellable, GError **error);
 
 void _ostree_static_delta_part_execute_async (OstreeRepo *repo, GVariant *header,
-                                              GVariant *part_payload, GCancellable *cancellable,
+                                              GInputStream *part_in, GBytes *inline_part_bytes,
+                                              OstreeStaticDeltaOpenFlags flags,
+                                              GBytes *zstd_dictionary,
+                                              const char *expected_checksum,
+                                              GCancellable *cancellable,
                                               GAsyncReadyCallback callback, gpointer user_data);
 
 gboolean _ostree_static_delta_part_execute_finish (OstreeRepo *repo, GAsyncResult *result,
@@ -198,8 +214,10 @@ gboolean _ostree_repo_static_delta_dump (OstreeRepo *repo, const char *delta_id,
 
 gboolean _ostree_repo_static_delta_delete (OstreeRepo *repo, const char *delta_id,
                                            GCancellable *cancellable, GError **error);
-gboolean _ostree_repo_static_delta_reindex (OstreeRepo *repo, const char *opt_to_commit,
-                                            GCancellable *cancellable, GError **error);
+gboolean _ostree_repo_static_delta_reindex (OstreeRepo *repo,
+                                            struct OstreeRepoSummaryState *summary_state,
+                                            const char *opt_to_commit, GCancellable *cancellable,
+                                            GError **error);
 
 /* Used for static deltas which due to a historical mistake are
  * inconsistent endian.
@@ -21,6 +21,8 @@
 #include "config.h"
 
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <gio/gfiledescriptorbased.h>
 #include <gio/gunixinputstream.h>
@@ -38,6 +40,30 @@
 /* This should really always be true, but hey, let's just assert it */
 G_STATIC_ASSERT (sizeof (guint) >= sizeof (guint32));
 
+/* How much of the payload we let the interpreter read before we hand the
+ * pages behind it back to the kernel.  See release_consumed_payload().
+ */
+#define PAYLOAD_RELEASE_WINDOW (8 * 1024 * 1024)
+
+/* Metadata objects are small and numerous, so they're checksummed and
+ * written in batches; see flush_pending_metadata().
+ */
+#define MAX_PENDING_METADATA 64
+
+typedef struct
+{
+  OstreeObjectType objtype;
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  GVariant *metadata;
+} PendingMetadata;
+
+static void
+pending_metadata_clear (gpointer data)
+{
+  PendingMetadata *pending = data;
+  g_clear_pointer (&pending->metadata, g_variant_unref);
+}
+
 typedef struct
 {
   gboolean stats_only;
@@ -73,6 +99,10 @@ typedef struct
 
   const guint8 *payload_data;
   guint64 payload_size;
+  guint64 payload_consumed; /* Highest offset read so far */
+  guint64 payload_released; /* Pages below this were released */
+
+  GArray *pending_metadata; /* (element-type PendingMetadata) */
 } StaticDeltaExecutionState;
 
 typedef struct
@@ -101,6 +131,93 @@ static void
 static_delta_execution_state_init (StaticDeltaExecutionState *state)
 {
   state->read_source_fd = -1;
+  state->pending_metadata = g_array_new (FALSE, FALSE, sizeof (PendingMetadata));
+  g_array_set_clear_func (state->pending_metadata, pending_metadata_clear);
+}
+
+/* Write out the metadata objects queued by open-splice-and-close.  No
+ * later opcode reads them back, so there's no need to write them sooner.
+ */
+static gboolean
+flush_pending_metadata (StaticDeltaExecutionState *state, GCancellable *cancellable,
+                        GError **error)
+{
+  const guint n = state->pending_metadata->len;
+  if (n == 0)
+    return TRUE;
+
+  g_autofree OstreeObjectType *objtypes = g_new (OstreeObjectType, n);
+  g_autofree const char **checksums = g_new (const char *, n);
+  g_autofree GVariant **objects = g_new (GVariant *, n);
+  for (guint i = 0; i < n; i++)
+    {
+      PendingMetadata *pending = &g_array_index (state->pending_metadata, PendingMetadata, i);
+      objtypes[i] = pending->objtype;
+      checksums[i] = pending->checksum;
+      objects[i] = pending->metadata;
+    }
+
+  if (!_ostree_repo_write_metadata_many (state->repo, n, objtypes, checksums, objects, NULL,
+                                         cancellable, error))
+    return FALSE;
+
+  g_array_set_size (state->pending_metadata, 0);
+  return TRUE;
+}
+
+/* Decompressed parts are spilled to an anonymous temporary file and mapped,
+ * and the opcodes mostly walk the payload front to back.  Rather than letting
+ * every page of a large part stay resident for the whole execution, once the
+ * interpreter has moved a window past them we ask the kernel to reclaim the
+ * pages before @offset.  This doesn't discard anything; an out-of-order read
+ * just faults the data back in.  Peak memory is then bounded by roughly the
+ * window rather than the part size.
+ */
+static void
+release_payload_before (StaticDeltaExecutionState *state, guint64 offset)
+{
+#ifdef MADV_PAGEOUT
+  if (offset < state->payload_released + PAYLOAD_RELEASE_WINDOW)
+    return;
+
+  const guintptr page_size = sysconf (_SC_PAGESIZE);
+  const guintptr start
+      = ((guintptr)state->payload_data + state->payload_released + page_size - 1)
+        & ~(page_size - 1);
+  const guintptr end = ((guintptr)state->payload_data + offset) & ~(page_size - 1);
+  /* This is purely advisory, so ignore errors from e.g. older kernels */
+  if (end > start)
+    (void)madvise ((void *)start, end - start, MADV_PAGEOUT);
+  state->payload_released = offset;
+#endif
+}
+
+static void
+release_consumed_payload (StaticDeltaExecutionState *state)
+{
+  release_payload_before (state, state->payload_consumed);
+}
+
+/* Write @length bytes of the payload at @offset to the content object being
+ * written.  Large objects would otherwise be read by a single opcode, so
+ * they're written a window at a time, releasing the pages behind us.
+ */
+static gboolean
+write_payload_to_content (OstreeRepo *repo, StaticDeltaExecutionState *state, guint64 offset,
+                          guint64 length, GCancellable *cancellable, GError **error)
+{
+  while (length > 0)
+    {
+      const guint64 n = MIN (length, PAYLOAD_RELEASE_WINDOW);
+      if (!_ostree_repo_bare_content_write (repo, &state->content_out, state->payload_data + offset,
+                                            n, cancellable, error))
+        return FALSE;
+      offset += n;
+      length -= n;
+      release_payload_before (state, offset);
+    }
+
+  return TRUE;
 }
 
 static gboolean
@@ -258,14 +375,20 @@ _ostree_static_delta_part_execute (OstreeRepo *repo, GVariant *objects, GVariant
       n_executed++;
       if (stats)
         stats->n_ops_executed[delta_opcode_index (opcode)]++;
+
+      release_consumed_payload (state);
     }
 
   if (state->caught_error)
     goto out;
 
+  if (!flush_pending_metadata (state, cancellable, error))
+    goto out;
+
   ret = TRUE;
 out:
   _ostree_repo_bare_content_cleanup (&state->content_out);
+  g_clear_pointer (&state->pending_metadata, g_array_unref);
   return ret;
 }
 
@@ -273,7 +396,11 @@ typedef struct
 {
   OstreeRepo *repo;
   GVariant *header;
-  GVariant *part;
+  GInputStream *part_in;
+  GBytes *inline_part_bytes;
+  OstreeStaticDeltaOpenFlags flags;
+  GBytes *zstd_dictionary;
+  char *expected_checksum;
   GCancellable *cancellable;
 } StaticDeltaPartExecuteAsyncData;
 
@@ -284,7 +411,10 @@ static_delta_part_execute_async_data_free (gpointer user_data)
 
   g_clear_object (&data->repo);
   g_variant_unref (data->header);
-  g_variant_unref (data->part);
+  g_clear_object (&data->part_in);
+  g_clear_pointer (&data->inline_part_bytes, g_bytes_unref);
+  g_clear_pointer (&data->zstd_dictionary, g_bytes_unref);
+  g_free (data->expected_checksum);
   g_clear_object (&data->cancellable);
   g_free (data);
 }
@@ -295,18 +425,32 @@ static_delta_part_execute_thread (GTask *task, GObject *object, gpointer datap,
 {
   GError *error = NULL;
   StaticDeltaPartExecuteAsyncData *data = datap;
-
-  if (!_ostree_static_delta_part_execute (data->repo, data->header, data->part, FALSE, NULL,
-                                          cancellable, &error))
+  g_autoptr (GVariant) part = NULL;
+
+  /* Both decompression and checksumming of the part happen here, so that
+   * multiple parts can be processed in parallel and the main loop stays free
+   * to drive fetches.
+   */
+  if (!_ostree_static_delta_part_open (data->part_in, data->inline_part_bytes, data->flags,
+                                       data->zstd_dictionary, data->expected_checksum, &part,
+                                       cancellable, &error)
+      || !_ostree_static_delta_part_execute (data->repo, data->header, part, FALSE, NULL,
+                                             cancellable, &error))
     g_task_return_error (task, error);
   else
     g_task_return_boolean (task, TRUE);
 }
 
+/* Asynchronously open (i.e. decompress and verify) and then execute a delta
+ * part in a worker thread.  The arguments are as for
+ * _ostree_static_delta_part_open().
+ */
 void
-_ostree_static_delta_part_execute_async (OstreeRepo *repo, GVariant *header, GVariant *part,
-                                         GCancellable *cancellable, GAsyncReadyCallback callback,
-                                         gpointer user_data)
+_ostree_static_delta_part_execute_async (OstreeRepo *repo, GVariant *header, GInputStream *part_in,
+                                         GBytes *inline_part_bytes,
+                                         OstreeStaticDeltaOpenFlags flags, GBytes *zstd_dictionary,
+                                         const char *expected_checksum, GCancellable *cancellable,
+                                         GAsyncReadyCallback callback, gpointer user_data)
 {
   g_autoptr (GTask) task = NULL;
   StaticDeltaPartExecuteAsyncData *asyncdata;
@@ -314,7 +458,11 @@ _ostree_static_delta_part_execute_async (OstreeRepo *repo, GVariant *header, GVa
   asyncdata = g_new0 (StaticDeltaPartExecuteAsyncData, 1);
   asyncdata->repo = g_object_ref (repo);
   asyncdata->header = g_variant_ref (header);
-  asyncdata->part = g_variant_ref (part);
+  asyncdata->part_in = g_object_ref (part_in);
+  asyncdata->inline_part_bytes = inline_part_bytes ? g_bytes_ref (inline_part_bytes) : NULL;
+  asyncdata->flags = flags;
+  asyncdata->zstd_dictionary = zstd_dictionary ? g_bytes_ref (zstd_dictionary) : NULL;
+  asyncdata->expected_checksum = g_strdup (expected_checksum);
   asyncdata->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
 
   task = g_task_new (G_OBJECT (repo), cancellable, callback, user_data);
@@ -346,6 +494,8 @@ validate_ofs (StaticDeltaExecutionState *state, guint64 offset, guint64 length,
                    length);
       return FALSE;
     }
+  /* Every read of the payload is validated first, so track how far we got */
+  state->payload_consumed = MAX (state->payload_consumed, offset + length);
   return TRUE;
 }
 
@@ -490,16 +640,15 @@ dispatch_open_splice_and_close (OstreeRepo *repo, StaticDeltaExecutionState *sta
        * future.
        */
       g_autoptr (GBytes) metadata_copy = g_bytes_new (state->payload_data + offset, length);
-      metadata = g_variant_new_from_bytes (ostree_metadata_variant_type (state->output_objtype),
-                                           metadata_copy, FALSE);
-
-      {
-        g_autofree guchar *actual_csum = NULL;
-
-        if (!ostree_repo_write_metadata (state->repo, state->output_objtype, state->checksum,
-                                         metadata, &actual_csum, cancellable, error))
-          goto out;
-      }
+      metadata = g_variant_ref_sink (g_variant_new_from_bytes (
+          ostree_metadata_variant_type (state->output_objtype), metadata_copy, FALSE));
+
+      PendingMetadata pending = { state->output_objtype, "", g_variant_ref (metadata) };
+      memcpy (pending.checksum, state->checksum, sizeof (pending.checksum));
+      g_array_append_val (state->pending_metadata, pending);
+      if (state->pending_metadata->len >= MAX_PENDING_METADATA
+          && !flush_pending_metadata (state, cancellable, error))
+        goto out;
     }
   else
     {
@@ -538,9 +687,8 @@ dispatch_open_splice_and_close (OstreeRepo *repo, StaticDeltaExecutionState *sta
                       state->mode, state->xattrs, &state->content_out, cancellable, error))
                 goto out;
 
-              if (!_ostree_repo_bare_content_write (repo, &state->content_out,
-                                                    state->payload_data + content_offset,
-                                                    state->content_size, cancellable, error))
+              if (!write_payload_to_content (repo, state, content_offset, state->content_size,
+                                             cancellable, error))
                 goto out;
             }
         }
@@ -678,9 +826,8 @@ dispatch_write (OstreeRepo *repo, StaticDeltaExecutionState *state, GCancellable
           if (!validate_ofs (state, content_offset, content_size, error))
             return FALSE;
 
-          if (!_ostree_repo_bare_content_write (repo, &state->content_out,
-                                                state->payload_data + content_offset, content_size,
-                                                cancellable, error))
+          if (!write_payload_to_content (repo, state, content_offset, content_size, cancellable,
+                                         error))
             return FALSE;
         }
     }
@@ -0,0 +1,557 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "otutil.h"
+
+/* A summary diff lists the refs which changed between two summaries, and
+ * the metadata of the newer one, so that a client with the older summary
+ * cached can reconstruct the newer one without downloading it.  The
+ * reconstructed summary is checked against the checksum recorded in the
+ * diff, and then verified against summary.sig as usual.
+ *
+ * The server publishes diffs from each of the last core.summary-diffs
+ * summaries to the current one, named by the checksum of the older summary.
+ * Rather than keeping old summaries around, each update composes the
+ * existing diffs with the diff from the previous summary.
+ */
+
+/* Maps collection ID ("" for the main refs) to a map of ref name to its
+ * (s(taya{sv})) summary entry */
+static GHashTable *
+refs_map_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                (GDestroyNotify)g_hash_table_unref);
+}
+
+static GHashTable *
+refs_map_get (GHashTable *refs_map, const char *collection_id)
+{
+  GHashTable *refs = g_hash_table_lookup (refs_map, collection_id);
+  if (refs == NULL)
+    {
+      refs = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                    (GDestroyNotify)g_variant_unref);
+      g_hash_table_insert (refs_map, g_strdup (collection_id), refs);
+    }
+  return refs;
+}
+
+static void
+refs_map_add (GHashTable *refs_map, const char *collection_id, GVariant *refs)
+{
+  GHashTable *collection_refs = refs_map_get (refs_map, collection_id);
+  const gsize n_refs = g_variant_n_children (refs);
+  for (gsize i = 0; i < n_refs; i++)
+    {
+      GVariant *ref = g_variant_get_child_value (refs, i);
+      const char *ref_name;
+      g_variant_get_child (ref, 0, "&s", &ref_name);
+      /* The key points into the value */
+      g_hash_table_replace (collection_refs, (char *)ref_name, ref);
+    }
+}
+
+static GHashTable *
+refs_map_new_from_summary (GVariant *summary)
+{
+  g_autoptr (GHashTable) refs_map = refs_map_new ();
+
+  g_autoptr (GVariant) refs = g_variant_get_child_value (summary, 0);
+  refs_map_add (refs_map, "", refs);
+
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (summary, 1);
+  g_autoptr (GVariant) collection_map = g_variant_lookup_value (
+      metadata, OSTREE_SUMMARY_COLLECTION_MAP, G_VARIANT_TYPE ("a{sa(s(taya{sv}))}"));
+  if (collection_map != NULL)
+    {
+      GVariantIter iter;
+      const char *collection_id;
+      GVariant *collection_refs;
+      g_variant_iter_init (&iter, collection_map);
+      while (g_variant_iter_loop (&iter, "{&s@a(s(taya{sv}))}", &collection_id,
+                                  &collection_refs))
+        refs_map_add (refs_map, collection_id, collection_refs);
+    }
+
+  return g_steal_pointer (&refs_map);
+}
+
+/* Add the entries of @refs to @builder, sorted by ref name */
+static void
+add_sorted_refs (GVariantBuilder *builder, GHashTable *refs)
+{
+  g_autoptr (GList) ordered_refs = g_hash_table_get_keys (refs);
+  ordered_refs = g_list_sort (ordered_refs, (GCompareFunc)strcmp);
+  for (GList *iter = ordered_refs; iter != NULL; iter = iter->next)
+    g_variant_builder_add_value (builder, g_hash_table_lookup (refs, iter->data));
+}
+
+/* The changes of a diff, as maps of collection ID to the changed refs (see
+ * refs_map_new()) and to the set of removed ref names */
+typedef struct
+{
+  GHashTable *changed;
+  GHashTable *removed;
+} SummaryDiffChanges;
+
+static void
+summary_diff_changes_clear (SummaryDiffChanges *changes)
+{
+  g_clear_pointer (&changes->changed, g_hash_table_unref);
+  g_clear_pointer (&changes->removed, g_hash_table_unref);
+}
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (SummaryDiffChanges, summary_diff_changes_clear)
+
+static void
+summary_diff_changes_init (SummaryDiffChanges *changes)
+{
+  changes->changed = refs_map_new ();
+  changes->removed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                            (GDestroyNotify)g_hash_table_unref);
+}
+
+static GHashTable *
+summary_diff_changes_get_removed (SummaryDiffChanges *changes, const char *collection_id)
+{
+  GHashTable *removed = g_hash_table_lookup (changes->removed, collection_id);
+  if (removed == NULL)
+    {
+      removed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+      g_hash_table_insert (changes->removed, g_strdup (collection_id), removed);
+    }
+  return removed;
+}
+
+/* Apply the a(sa(s(taya{sv}))as) changes of a diff to @changes */
+static void
+summary_diff_changes_add (SummaryDiffChanges *changes, GVariant *diff_changes)
+{
+  GVariantIter iter;
+  const char *collection_id;
+  GVariant *changed_refs;
+  GVariant *removed_refs;
+  g_variant_iter_init (&iter, diff_changes);
+  while (g_variant_iter_loop (&iter, "(&s@a(s(taya{sv}))@as)", &collection_id, &changed_refs,
+                              &removed_refs))
+    {
+      GHashTable *changed = refs_map_get (changes->changed, collection_id);
+      GHashTable *removed = summary_diff_changes_get_removed (changes, collection_id);
+
+      const gsize n_changed = g_variant_n_children (changed_refs);
+      for (gsize i = 0; i < n_changed; i++)
+        {
+          GVariant *ref = g_variant_get_child_value (changed_refs, i);
+          const char *ref_name;
+          g_variant_get_child (ref, 0, "&s", &ref_name);
+          g_hash_table_remove (removed, ref_name);
+          g_hash_table_replace (changed, (char *)ref_name, ref);
+        }
+
+      const gsize n_removed = g_variant_n_children (removed_refs);
+      for (gsize i = 0; i < n_removed; i++)
+        {
+          const char *ref_name;
+          g_variant_get_child (removed_refs, i, "&s", &ref_name);
+          g_hash_table_remove (changed, ref_name);
+          g_hash_table_add (removed, g_strdup (ref_name));
+        }
+    }
+}
+
+static GVariant *
+summary_diff_changes_serialize (SummaryDiffChanges *changes)
+{
+  g_autoptr (GHashTable) collection_ids = g_hash_table_new (g_str_hash, g_str_equal);
+  GLNX_HASH_TABLE_FOREACH_KV (changes->changed, const char *, collection_id, GHashTable *, refs)
+    {
+      if (g_hash_table_size (refs) > 0)
+        g_hash_table_add (collection_ids, (char *)collection_id);
+    }
+  GLNX_HASH_TABLE_FOREACH_KV (changes->removed, const char *, collection_id, GHashTable *, refs)
+    {
+      if (g_hash_table_size (refs) > 0)
+        g_hash_table_add (collection_ids, (char *)collection_id);
+    }
+
+  g_auto (GVariantBuilder) builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa(s(taya{sv}))as)"));
+  g_autoptr (GList) ordered_collection_ids = g_hash_table_get_keys (collection_ids);
+  ordered_collection_ids = g_list_sort (ordered_collection_ids, (GCompareFunc)strcmp);
+  for (GList *iter = ordered_collection_ids; iter != NULL; iter = iter->next)
+    {
+      const char *collection_id = iter->data;
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("(sa(s(taya{sv}))as)"));
+      g_variant_builder_add (&builder, "s", collection_id);
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(s(taya{sv}))"));
+      GHashTable *changed = g_hash_table_lookup (changes->changed, collection_id);
+      if (changed != NULL)
+        add_sorted_refs (&builder, changed);
+      g_variant_builder_close (&builder);
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("as"));
+      GHashTable *removed = g_hash_table_lookup (changes->removed, collection_id);
+      if (removed != NULL)
+        {
+          g_autoptr (GList) ordered_refs = g_hash_table_get_keys (removed);
+          ordered_refs = g_list_sort (ordered_refs, (GCompareFunc)strcmp);
+          for (GList *ref_iter = ordered_refs; ref_iter != NULL; ref_iter = ref_iter->next)
+            g_variant_builder_add (&builder, "s", ref_iter->data);
+        }
+      g_variant_builder_close (&builder);
+
+      g_variant_builder_close (&builder);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+summary_checksum_v (GVariant *summary)
+{
+  g_autofree char *checksum = g_compute_checksum_for_data (
+      G_CHECKSUM_SHA256, g_variant_get_data (summary), g_variant_get_size (summary));
+  return ostree_checksum_to_bytes_v (checksum);
+}
+
+/* Compute the diff from summary @from to summary @to */
+static GVariant *
+summary_diff_new (GVariant *from, GVariant *to)
+{
+  g_autoptr (GHashTable) from_refs = refs_map_new_from_summary (from);
+  g_autoptr (GHashTable) to_refs = refs_map_new_from_summary (to);
+  g_auto (SummaryDiffChanges) changes = {
+    0,
+  };
+  summary_diff_changes_init (&changes);
+
+  GLNX_HASH_TABLE_FOREACH_KV (to_refs, const char *, collection_id, GHashTable *, refs)
+    {
+      GHashTable *old_refs = g_hash_table_lookup (from_refs, collection_id);
+      GLNX_HASH_TABLE_FOREACH_KV (refs, const char *, ref_name, GVariant *, ref)
+        {
+          GVariant *old_ref = old_refs ? g_hash_table_lookup (old_refs, ref_name) : NULL;
+          if (old_ref == NULL || !g_variant_equal (old_ref, ref))
+            g_hash_table_replace (refs_map_get (changes.changed, collection_id), (char *)ref_name,
+                                  g_variant_ref (ref));
+        }
+    }
+  GLNX_HASH_TABLE_FOREACH_KV (from_refs, const char *, collection_id, GHashTable *, refs)
+    {
+      GHashTable *new_refs = g_hash_table_lookup (to_refs, collection_id);
+      GLNX_HASH_TABLE_FOREACH (refs, const char *, ref_name)
+        {
+          if (new_refs == NULL || !g_hash_table_contains (new_refs, ref_name))
+            g_hash_table_add (summary_diff_changes_get_removed (&changes, collection_id),
+                              g_strdup (ref_name));
+        }
+    }
+
+  /* Keep the metadata in the order of @to, so that it can be reconstructed
+   * byte for byte; values which didn't change, and the collection map, which
+   * is rebuilt from the refs, are left out. */
+  g_autoptr (GVariant) from_metadata = g_variant_get_child_value (from, 1);
+  g_autoptr (GVariant) to_metadata = g_variant_get_child_value (to, 1);
+  g_auto (GVariantBuilder) metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&metadata_builder, G_VARIANT_TYPE ("a{smv}"));
+  GVariantIter iter;
+  const char *key;
+  GVariant *value;
+  g_variant_iter_init (&iter, to_metadata);
+  while (g_variant_iter_loop (&iter, "{&sv}", &key, &value))
+    {
+      g_autoptr (GVariant) old_value = g_variant_lookup_value (from_metadata, key, NULL);
+      gboolean unchanged = g_str_equal (key, OSTREE_SUMMARY_COLLECTION_MAP)
+                           || (old_value != NULL && g_variant_equal (old_value, value));
+      g_variant_builder_add (&metadata_builder, "{smv}", key, unchanged ? NULL : value);
+    }
+
+  return g_variant_ref_sink (g_variant_new (
+      "(@ay@ayu@a(sa(s(taya{sv}))as)@a{smv})", summary_checksum_v (from), summary_checksum_v (to),
+      1, summary_diff_changes_serialize (&changes), g_variant_builder_end (&metadata_builder)));
+}
+
+/* Compose the diff @first from summary A to B with the diff @second from B
+ * to C, into a diff from A to C */
+static GVariant *
+summary_diff_compose (GVariant *first, GVariant *second, GError **error)
+{
+  g_autoptr (GVariant) first_from = NULL;
+  g_autoptr (GVariant) first_to = NULL;
+  guint32 first_n_updates;
+  g_autoptr (GVariant) first_changes = NULL;
+  g_autoptr (GVariant) first_metadata = NULL;
+  g_variant_get (first, "(@ay@ayu@a(sa(s(taya{sv}))as)@a{smv})", &first_from, &first_to,
+                 &first_n_updates, &first_changes, &first_metadata);
+  g_autoptr (GVariant) second_from = NULL;
+  g_autoptr (GVariant) second_to = NULL;
+  guint32 second_n_updates;
+  g_autoptr (GVariant) second_changes = NULL;
+  g_autoptr (GVariant) second_metadata = NULL;
+  g_variant_get (second, "(@ay@ayu@a(sa(s(taya{sv}))as)@a{smv})", &second_from, &second_to,
+                 &second_n_updates, &second_changes, &second_metadata);
+
+  if (!g_variant_equal (first_to, second_from))
+    return glnx_null_throw (error, "Summary diffs don't follow each other");
+
+  g_auto (SummaryDiffChanges) changes = {
+    0,
+  };
+  summary_diff_changes_init (&changes);
+  summary_diff_changes_add (&changes, first_changes);
+  summary_diff_changes_add (&changes, second_changes);
+
+  /* A value left out of @second is the one in B, which is either in @first,
+   * or left out of it too */
+  g_auto (GVariantBuilder) metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&metadata_builder, G_VARIANT_TYPE ("a{smv}"));
+  GVariantIter iter;
+  const char *key;
+  GVariant *value;
+  g_variant_iter_init (&iter, second_metadata);
+  while (g_variant_iter_loop (&iter, "{&smv}", &key, &value))
+    {
+      g_autoptr (GVariant) first_value = NULL;
+      if (value == NULL && !g_str_equal (key, OSTREE_SUMMARY_COLLECTION_MAP))
+        {
+          g_autoptr (GVariant) maybe_value
+              = g_variant_lookup_value (first_metadata, key, G_VARIANT_TYPE ("mv"));
+          if (maybe_value == NULL)
+            return glnx_null_throw (error, "Summary diff lacks metadata %s", key);
+          first_value = g_variant_get_maybe (maybe_value);
+        }
+      g_variant_builder_add (&metadata_builder, "{smv}", key, value ? value : first_value);
+    }
+
+  return g_variant_ref_sink (g_variant_new (
+      "(@ay@ayu@a(sa(s(taya{sv}))as)@a{smv})", first_from, second_to,
+      first_n_updates + second_n_updates, summary_diff_changes_serialize (&changes),
+      g_variant_builder_end (&metadata_builder)));
+}
+
+/**
+ * _ostree_summary_diff_apply:
+ * @summary: Summary
+ * @diff: Diff from @summary, in _OSTREE_SUMMARY_DIFF_GVARIANT_FORMAT
+ * @error: Error
+ *
+ * Reconstruct the summary @diff leads to from @summary, and check it against
+ * the checksum recorded in @diff.
+ *
+ * Returns: (transfer full): The new summary
+ */
+GVariant *
+_ostree_summary_diff_apply (GVariant *summary, GVariant *diff, GError **error)
+{
+  g_autoptr (GVariant) from = NULL;
+  g_autoptr (GVariant) to = NULL;
+  guint32 n_updates;
+  g_autoptr (GVariant) diff_changes = NULL;
+  g_autoptr (GVariant) diff_metadata = NULL;
+  g_variant_get (diff, "(@ay@ayu@a(sa(s(taya{sv}))as)@a{smv})", &from, &to, &n_updates,
+                 &diff_changes, &diff_metadata);
+
+  g_autoptr (GVariant) summary_checksum = summary_checksum_v (summary);
+  if (!g_variant_equal (from, summary_checksum))
+    return glnx_null_throw (error, "Summary diff is not from this summary");
+
+  g_autoptr (GHashTable) refs_map = refs_map_new_from_summary (summary);
+  g_auto (SummaryDiffChanges) changes = {
+    0,
+  };
+  summary_diff_changes_init (&changes);
+  summary_diff_changes_add (&changes, diff_changes);
+  GLNX_HASH_TABLE_FOREACH_KV (changes.removed, const char *, collection_id, GHashTable *, removed)
+    {
+      GHashTable *refs = refs_map_get (refs_map, collection_id);
+      GLNX_HASH_TABLE_FOREACH (removed, const char *, ref_name)
+        g_hash_table_remove (refs, ref_name);
+    }
+  GLNX_HASH_TABLE_FOREACH_KV (changes.changed, const char *, collection_id, GHashTable *, changed)
+    {
+      GHashTable *refs = refs_map_get (refs_map, collection_id);
+      GLNX_HASH_TABLE_FOREACH_KV (changed, const char *, ref_name, GVariant *, ref)
+        g_hash_table_replace (refs, (char *)ref_name, g_variant_ref (ref));
+    }
+
+  /* Rebuild the summary the way regenerate_metadata() does */
+  g_auto (GVariantBuilder) refs_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&refs_builder, G_VARIANT_TYPE ("a(s(taya{sv}))"));
+  add_sorted_refs (&refs_builder, refs_map_get (refs_map, ""));
+
+  g_auto (GVariantBuilder) collection_map_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&collection_map_builder, G_VARIANT_TYPE ("a{sa(s(taya{sv}))}"));
+  gsize collection_map_size = 0;
+  g_autoptr (GList) ordered_collection_ids = g_hash_table_get_keys (refs_map);
+  ordered_collection_ids = g_list_sort (ordered_collection_ids, (GCompareFunc)strcmp);
+  for (GList *iter = ordered_collection_ids; iter != NULL; iter = iter->next)
+    {
+      const char *collection_id = iter->data;
+      GHashTable *refs = g_hash_table_lookup (refs_map, collection_id);
+      if (*collection_id == '\0' || g_hash_table_size (refs) == 0)
+        continue;
+      g_variant_builder_open (&collection_map_builder, G_VARIANT_TYPE ("{sa(s(taya{sv}))}"));
+      g_variant_builder_add (&collection_map_builder, "s", collection_id);
+      g_variant_builder_open (&collection_map_builder, G_VARIANT_TYPE ("a(s(taya{sv}))"));
+      add_sorted_refs (&collection_map_builder, refs);
+      g_variant_builder_close (&collection_map_builder);
+      g_variant_builder_close (&collection_map_builder);
+      collection_map_size++;
+    }
+
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (summary, 1);
+  g_auto (GVariantBuilder) metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&metadata_builder, G_VARIANT_TYPE ("a{sv}"));
+  GVariantIter iter;
+  const char *key;
+  GVariant *value;
+  g_variant_iter_init (&iter, diff_metadata);
+  while (g_variant_iter_loop (&iter, "{&smv}", &key, &value))
+    {
+      if (g_str_equal (key, OSTREE_SUMMARY_COLLECTION_MAP))
+        {
+          if (collection_map_size > 0)
+            g_variant_builder_add (&metadata_builder, "{sv}", key,
+                                   g_variant_builder_end (&collection_map_builder));
+        }
+      else if (value != NULL)
+        g_variant_builder_add (&metadata_builder, "{sv}", key, value);
+      else
+        {
+          g_autoptr (GVariant) old_value = g_variant_lookup_value (metadata, key, NULL);
+          if (old_value == NULL)
+            return glnx_null_throw (error, "Summary diff lacks metadata %s", key);
+          g_variant_builder_add (&metadata_builder, "{sv}", key, old_value);
+        }
+    }
+
+  g_autoptr (GVariant) new_summary = g_variant_ref_sink (
+      g_variant_new ("(@a(s(taya{sv}))@a{sv})", g_variant_builder_end (&refs_builder),
+                     g_variant_builder_end (&metadata_builder)));
+  g_autoptr (GVariant) new_summary_checksum = summary_checksum_v (new_summary);
+  if (!g_variant_equal (to, new_summary_checksum))
+    return glnx_null_throw (error, "Summary reconstructed from diff doesn't match its checksum");
+
+  return g_steal_pointer (&new_summary);
+}
+
+/**
+ * _ostree_repo_update_summary_diffs:
+ * @self: Repo
+ * @summary: The summary being published
+ * @max_updates: Value of core.summary-diffs
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Publish diffs to @summary from the currently published summary, and from
+ * up to @max_updates - 1 summaries before it; or remove them all if
+ * @max_updates is 0.  This must be called before @summary replaces the
+ * published one.
+ */
+gboolean
+_ostree_repo_update_summary_diffs (OstreeRepo *self, GVariant *summary, guint max_updates,
+                                   GCancellable *cancellable, GError **error)
+{
+  if (max_updates == 0)
+    return glnx_shutil_rm_rf_at (self->repo_dir_fd, _OSTREE_SUMMARY_DIFFS_DIR, cancellable,
+                                 error);
+
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, "summary", &fd, error))
+    return FALSE;
+  /* Without a previous summary, any existing diffs lead nowhere */
+  if (fd == -1)
+    return glnx_shutil_rm_rf_at (self->repo_dir_fd, _OSTREE_SUMMARY_DIFFS_DIR, cancellable,
+                                 error);
+  g_autoptr (GVariant) old_summary = NULL;
+  if (!ot_variant_read_fd (fd, 0, OSTREE_SUMMARY_GVARIANT_FORMAT, TRUE, &old_summary, error))
+    return FALSE;
+
+  g_autoptr (GVariant) diff = summary_diff_new (old_summary, summary);
+  g_autoptr (GVariant) from = g_variant_get_child_value (diff, 0);
+  g_autoptr (GVariant) to = g_variant_get_child_value (diff, 1);
+  if (g_variant_equal (from, to))
+    return TRUE;
+
+  if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, _OSTREE_SUMMARY_DIFFS_DIR,
+                               DEFAULT_DIRECTORY_MODE, cancellable, error))
+    return FALSE;
+  glnx_autofd int diffs_dfd = -1;
+  if (!glnx_opendirat (self->repo_dir_fd, _OSTREE_SUMMARY_DIFFS_DIR, TRUE, &diffs_dfd, error))
+    return FALSE;
+
+  /* Rewriting the diffs while reading the directory could list them twice */
+  g_autoptr (GPtrArray) names = g_ptr_array_new_with_free_func (g_free);
+  {
+    g_auto (GLnxDirFdIterator) dfd_iter = {
+      0,
+    };
+    if (!glnx_dirfd_iterator_init_at (diffs_dfd, ".", FALSE, &dfd_iter, error))
+      return FALSE;
+    while (TRUE)
+      {
+        struct dirent *dent;
+        if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, cancellable, error))
+          return FALSE;
+        if (dent == NULL)
+          break;
+        g_ptr_array_add (names, g_strdup (dent->d_name));
+      }
+  }
+
+  /* Extend the diffs which led to the previous summary, dropping the rest */
+  for (guint i = 0; i < names->len; i++)
+    {
+      const char *name = names->pdata[i];
+      glnx_autofd int diff_fd = -1;
+      g_autoptr (GVariant) old_diff = NULL;
+      if (!glnx_openat_rdonly (diffs_dfd, name, TRUE, &diff_fd, error))
+        return FALSE;
+      if (!ot_variant_read_fd (diff_fd, 0, _OSTREE_SUMMARY_DIFF_GVARIANT_FORMAT, TRUE, &old_diff,
+                               error))
+        return FALSE;
+
+      g_autoptr (GVariant) old_to = g_variant_get_child_value (old_diff, 1);
+      guint32 old_n_updates;
+      g_variant_get_child (old_diff, 2, "u", &old_n_updates);
+      g_autoptr (GVariant) new_diff = NULL;
+      if (g_variant_equal (old_to, from) && old_n_updates < max_updates)
+        new_diff = summary_diff_compose (old_diff, diff, NULL);
+
+      if (new_diff == NULL)
+        {
+          if (!glnx_unlinkat (diffs_dfd, name, 0, error))
+            return FALSE;
+        }
+      else if (!_ostree_repo_file_replace_contents (self, diffs_dfd, name,
+                                                    g_variant_get_data (new_diff),
+                                                    g_variant_get_size (new_diff), cancellable,
+                                                    error))
+        return FALSE;
+    }
+
+  char from_checksum[OSTREE_SHA256_STRING_LEN + 1];
+  ostree_checksum_inplace_from_bytes (ostree_checksum_bytes_peek (from), from_checksum);
+  return _ostree_repo_file_replace_contents (self, diffs_dfd, from_checksum,
+                                             g_variant_get_data (diff), g_variant_get_size (diff),
+                                             cancellable, error);
+}
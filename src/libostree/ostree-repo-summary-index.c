@@ -0,0 +1,310 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "ostree-sign-private.h"
+#include "otutil.h"
+
+/* A repository with many refs can publish a summary index alongside its
+ * summary, so that clients which only want a few refs don't have to fetch
+ * and verify the whole summary.  The refs are split into shards of at most
+ * core.summary-shard-size refs each; since the index is signed and records
+ * the SHA-256 of each shard, the shards themselves are not signed, and are
+ * named by that checksum so that they can be cached indefinitely.
+ */
+
+static gboolean
+add_shard (OstreeRepo *self, int shards_dfd, GVariantBuilder *index_builder,
+           const char *collection_id, GVariant *refs, gsize start, gsize end,
+           GHashTable *shard_names, GCancellable *cancellable, GError **error)
+{
+  g_auto (GVariantBuilder) refs_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&refs_builder, G_VARIANT_TYPE ("a(s(taya{sv}))"));
+  for (gsize i = start; i < end; i++)
+    {
+      g_autoptr (GVariant) ref = g_variant_get_child_value (refs, i);
+      g_variant_builder_add_value (&refs_builder, ref);
+    }
+  GVariant *shard_refs = g_variant_builder_end (&refs_builder);
+
+  g_auto (GVariantDict) metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_dict_init (&metadata_builder, NULL);
+  g_autoptr (GVariant) shard = NULL;
+  if (*collection_id == '\0')
+    shard = g_variant_ref_sink (g_variant_new ("(@a(s(taya{sv}))@a{sv})", shard_refs,
+                                               g_variant_dict_end (&metadata_builder)));
+  else
+    {
+      g_auto (GVariantBuilder) map_builder = OT_VARIANT_BUILDER_INITIALIZER;
+      g_variant_builder_init (&map_builder, G_VARIANT_TYPE ("a{sa(s(taya{sv}))}"));
+      g_variant_builder_add (&map_builder, "{s@a(s(taya{sv}))}", collection_id, shard_refs);
+      g_variant_dict_insert_value (&metadata_builder, OSTREE_SUMMARY_COLLECTION_MAP,
+                                   g_variant_builder_end (&map_builder));
+      GVariant *main_refs = g_variant_new_array (G_VARIANT_TYPE ("(s(taya{sv}))"), NULL, 0);
+      shard = g_variant_ref_sink (g_variant_new ("(@a(s(taya{sv}))@a{sv})", main_refs,
+                                                 g_variant_dict_end (&metadata_builder)));
+    }
+
+  const guint8 *data = g_variant_get_data (shard);
+  const gsize size = g_variant_get_size (shard);
+  g_autofree char *checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, size);
+
+  if (!glnx_fstatat_allow_noent (shards_dfd, checksum, NULL, AT_SYMLINK_NOFOLLOW, error))
+    return FALSE;
+  if (errno == ENOENT
+      && !_ostree_repo_file_replace_contents (self, shards_dfd, checksum, data, size, cancellable,
+                                              error))
+    return FALSE;
+
+  const char *first_ref;
+  const char *last_ref;
+  g_variant_get_child (refs, start, "(&s(taya{sv}))", &first_ref, NULL, NULL, NULL);
+  g_variant_get_child (refs, end - 1, "(&s(taya{sv}))", &last_ref, NULL, NULL, NULL);
+  g_variant_builder_add (index_builder, "(sss@ay)", collection_id, first_ref, last_ref,
+                         ostree_checksum_to_bytes_v (checksum));
+  g_hash_table_add (shard_names, g_steal_pointer (&checksum));
+  return TRUE;
+}
+
+static gboolean
+add_shards (OstreeRepo *self, int shards_dfd, GVariantBuilder *index_builder,
+            const char *collection_id, GVariant *refs, guint64 shard_size,
+            GHashTable *shard_names, GCancellable *cancellable, GError **error)
+{
+  const gsize n_refs = g_variant_n_children (refs);
+  for (gsize start = 0; start < n_refs; start += shard_size)
+    {
+      const gsize end = MIN (n_refs, start + shard_size);
+      if (!add_shard (self, shards_dfd, index_builder, collection_id, refs, start, end,
+                      shard_names, cancellable, error))
+        return FALSE;
+    }
+  return TRUE;
+}
+
+/* Add the names of the shards listed in the published index to @shard_names */
+static gboolean
+add_published_shard_names (OstreeRepo *self, GHashTable *shard_names, GError **error)
+{
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, _OSTREE_SUMMARY_INDEX, &fd, error))
+    return FALSE;
+  if (fd == -1)
+    return TRUE;
+
+  g_autoptr (GBytes) bytes = ot_fd_readall_or_mmap (fd, 0, error);
+  if (!bytes)
+    return FALSE;
+  g_autoptr (GVariant) index
+      = g_variant_ref_sink (g_variant_new_from_bytes (_OSTREE_SUMMARY_INDEX_GVARIANT_FORMAT, bytes,
+                                                      FALSE));
+  g_autoptr (GVariant) shards = g_variant_get_child_value (index, 0);
+  const gsize n_shards = g_variant_n_children (shards);
+  for (gsize i = 0; i < n_shards; i++)
+    {
+      g_autoptr (GVariant) csum_v = NULL;
+      g_variant_get_child (shards, i, "(&s&s&s@ay)", NULL, NULL, NULL, &csum_v);
+      /* Skip anything corrupt; it's only used to keep shards around */
+      if (ostree_validate_structureof_csum_v (csum_v, NULL))
+        g_hash_table_add (shard_names, ostree_checksum_from_bytes_v (csum_v));
+    }
+  return TRUE;
+}
+
+static gboolean
+prune_shards (int shards_dfd, GHashTable *keep, GCancellable *cancellable, GError **error)
+{
+  g_auto (GLnxDirFdIterator) dfd_iter = {
+    0,
+  };
+  if (!glnx_dirfd_iterator_init_at (shards_dfd, ".", FALSE, &dfd_iter, error))
+    return FALSE;
+
+  while (TRUE)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+      if (g_hash_table_contains (keep, dent->d_name))
+        continue;
+      if (!glnx_unlinkat (dfd_iter.fd, dent->d_name, 0, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * _ostree_summary_check_is_index:
+ * @data: A summary or summary index
+ * @is_index: Whether @data should be a summary index
+ * @error: Error
+ *
+ * Check that @data is a summary index if @is_index is set, and a summary
+ * otherwise.  Both are signed with the same keys, so a valid signature
+ * alone doesn't tell which one was fetched.
+ */
+gboolean
+_ostree_summary_check_is_index (GBytes *data, gboolean is_index, GError **error)
+{
+  /* Both end with their metadata, which is found the same way in either */
+  g_autoptr (GVariant) v = g_variant_ref_sink (
+      g_variant_new_from_bytes (OSTREE_SUMMARY_GVARIANT_FORMAT, data, FALSE));
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (v, 1);
+  gboolean marked = FALSE;
+  if (!g_variant_lookup (metadata, _OSTREE_SUMMARY_INDEX_KEY, "b", &marked))
+    marked = FALSE;
+
+  if (is_index && !marked)
+    return glnx_throw (error, "Summary index lacks %s", _OSTREE_SUMMARY_INDEX_KEY);
+  if (!is_index && marked)
+    return glnx_throw (error, "Summary is a summary index");
+  return TRUE;
+}
+
+/**
+ * _ostree_repo_update_summary_index:
+ * @self: Repo
+ * @summary: The summary being published
+ * @tmpdir_fd: Temporary directory to sign the index in
+ * @gpg_key_ids: (nullable): GPG keys to sign the index with
+ * @gpg_homedir: (nullable): GPG home directory
+ * @sign: (nullable): Signing engine for @sign_keys
+ * @sign_keys: (nullable): Keys to sign the index with
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Publish `summary.idx`, signed the same way as @summary, and the shards it
+ * lists, if core.summary-shard-size is set; otherwise remove them.
+ *
+ * Shards listed in the previously published index are kept, so that clients
+ * which fetched it just before can still fetch its shards.
+ */
+gboolean
+_ostree_repo_update_summary_index (OstreeRepo *self, GVariant *summary, int tmpdir_fd,
+                                   const char *const *gpg_key_ids, const char *gpg_homedir,
+                                   OstreeSign *sign, GVariant *sign_keys,
+                                   GCancellable *cancellable, GError **error)
+{
+  g_autofree char *shard_size_str = NULL;
+  if (!ot_keyfile_get_value_with_default (self->config, "core", "summary-shard-size", "0",
+                                          &shard_size_str, error))
+    return FALSE;
+  guint64 shard_size;
+  if (!g_ascii_string_to_unsigned (shard_size_str, 10, 0, G_MAXUINT32, &shard_size, error))
+    return glnx_prefix_error (error, "Invalid core.summary-shard-size");
+
+  if (shard_size == 0)
+    {
+      if (!ot_ensure_unlinked_at (self->repo_dir_fd, _OSTREE_SUMMARY_INDEX, error))
+        return FALSE;
+      if (!ot_ensure_unlinked_at (self->repo_dir_fd, _OSTREE_SUMMARY_INDEX ".sig", error))
+        return FALSE;
+      return glnx_shutil_rm_rf_at (self->repo_dir_fd, _OSTREE_SUMMARY_SHARDS_DIR, cancellable,
+                                   error);
+    }
+
+  if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, _OSTREE_SUMMARY_SHARDS_DIR,
+                               DEFAULT_DIRECTORY_MODE, cancellable, error))
+    return FALSE;
+  glnx_autofd int shards_dfd = -1;
+  if (!glnx_opendirat (self->repo_dir_fd, _OSTREE_SUMMARY_SHARDS_DIR, TRUE, &shards_dfd, error))
+    return FALSE;
+
+  g_autoptr (GHashTable) shard_names
+      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_auto (GVariantBuilder) index_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&index_builder, G_VARIANT_TYPE ("a(sssay)"));
+
+  /* The refs and collection map are already sorted, as is the index */
+  g_autoptr (GVariant) refs = g_variant_get_child_value (summary, 0);
+  if (!add_shards (self, shards_dfd, &index_builder, "", refs, shard_size, shard_names,
+                   cancellable, error))
+    return FALSE;
+
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (summary, 1);
+  g_autoptr (GVariant) collection_map = g_variant_lookup_value (
+      metadata, OSTREE_SUMMARY_COLLECTION_MAP, G_VARIANT_TYPE ("a{sa(s(taya{sv}))}"));
+  if (collection_map != NULL)
+    {
+      const gsize n_collections = g_variant_n_children (collection_map);
+      for (gsize i = 0; i < n_collections; i++)
+        {
+          const char *collection_id;
+          g_autoptr (GVariant) collection_refs = NULL;
+          g_variant_get_child (collection_map, i, "{&s@a(s(taya{sv}))}", &collection_id,
+                               &collection_refs);
+          if (!add_shards (self, shards_dfd, &index_builder, collection_id, collection_refs,
+                           shard_size, shard_names, cancellable, error))
+            return FALSE;
+        }
+    }
+
+  g_auto (GVariantDict) index_metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_dict_init (&index_metadata_builder, metadata);
+  g_variant_dict_remove (&index_metadata_builder, OSTREE_SUMMARY_COLLECTION_MAP);
+  g_variant_dict_insert_value (&index_metadata_builder, _OSTREE_SUMMARY_INDEX_KEY,
+                               g_variant_new_boolean (TRUE));
+  g_autoptr (GVariant) index = g_variant_ref_sink (
+      g_variant_new ("(@a(sssay)@a{sv})", g_variant_builder_end (&index_builder),
+                     g_variant_dict_end (&index_metadata_builder)));
+
+  /* Sign it as a summary in its own directory, then rename the results into place */
+  if (!glnx_ensure_dir (tmpdir_fd, "index", DEFAULT_DIRECTORY_MODE, error))
+    return FALSE;
+  glnx_autofd int index_dfd = -1;
+  if (!glnx_opendirat (tmpdir_fd, "index", TRUE, &index_dfd, error))
+    return FALSE;
+  if (!_ostree_repo_file_replace_contents (self, index_dfd, "summary", g_variant_get_data (index),
+                                           g_variant_get_size (index), cancellable, error))
+    return FALSE;
+
+  if (gpg_key_ids != NULL
+      && !_ostree_repo_add_gpg_signature_summary_at (self, index_dfd, (const char **)gpg_key_ids,
+                                                     gpg_homedir, cancellable, error))
+    return FALSE;
+
+  if (sign_keys != NULL
+      && !_ostree_sign_summary_at (sign, self, index_dfd, sign_keys, cancellable, error))
+    return FALSE;
+
+  /* Keep the shards of both the new and the previous index */
+  if (!add_published_shard_names (self, shard_names, error))
+    return FALSE;
+
+  if (!glnx_renameat (index_dfd, "summary", self->repo_dir_fd, _OSTREE_SUMMARY_INDEX, error))
+    return glnx_prefix_error (error, "Unable to rename summary index");
+
+  if (gpg_key_ids != NULL || sign_keys != NULL)
+    {
+      if (!glnx_renameat (index_dfd, "summary.sig", self->repo_dir_fd, _OSTREE_SUMMARY_INDEX ".sig",
+                          error))
+        {
+          (void)ot_ensure_unlinked_at (self->repo_dir_fd, _OSTREE_SUMMARY_INDEX ".sig", NULL);
+          return glnx_prefix_error (error, "Unable to rename summary index signature");
+        }
+    }
+  else if (!ot_ensure_unlinked_at (self->repo_dir_fd, _OSTREE_SUMMARY_INDEX ".sig", error))
+    return FALSE;
+
+  return prune_shards (shards_dfd, shard_names, cancellable, error);
+}
@@ -0,0 +1,313 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "ostree-repo-static-delta-private.h"
+#include "otutil.h"
+
+/* Regenerating the summary used to load the commit object of every ref, and
+ * read every static delta superblock twice (for the summary and for the
+ * delta indexes).  The summary state remembers what that produced, so that
+ * a regeneration only has to read the commits and deltas which changed
+ * since the previous one.
+ *
+ * Commit objects are immutable, so their entries are always valid; delta
+ * superblocks can be regenerated under the same name, so their digests are
+ * only reused while the superblock's inode, size and mtime are unchanged.
+ * Only the entries used by a regeneration are written back.
+ */
+
+#define STATE_VERSION 1
+
+struct OstreeRepoSummaryState
+{
+  GHashTable *commits;     /* checksum -> (ta{sv}) from disk */
+  GHashTable *deltas;      /* delta name -> (tttay) from disk */
+  GHashTable *new_commits; /* Entries used by this regeneration */
+  GHashTable *new_deltas;
+  gboolean dirty;
+};
+
+void
+_ostree_repo_summary_state_free (OstreeRepoSummaryState *state)
+{
+  g_hash_table_unref (state->commits);
+  g_hash_table_unref (state->deltas);
+  g_hash_table_unref (state->new_commits);
+  g_hash_table_unref (state->new_deltas);
+  g_free (state);
+}
+
+static GHashTable *
+state_table_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+}
+
+/**
+ * _ostree_repo_summary_state_load:
+ * @self: Repo
+ * @out_state: (out): Summary state
+ * @error: Error
+ *
+ * Load the state saved by the previous summary regeneration.  Anything we
+ * can't make sense of (including state from a future version) is treated as
+ * absent.
+ */
+gboolean
+_ostree_repo_summary_state_load (OstreeRepo *self, OstreeRepoSummaryState **out_state,
+                                 GError **error)
+{
+  g_autoptr (OstreeRepoSummaryState) state = g_new0 (OstreeRepoSummaryState, 1);
+  state->commits = state_table_new ();
+  state->deltas = state_table_new ();
+  state->new_commits = state_table_new ();
+  state->new_deltas = state_table_new ();
+
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, _OSTREE_SUMMARY_STATE_PATH, &fd, error))
+    return FALSE;
+  if (fd != -1)
+    {
+      g_autoptr (GVariant) data = NULL;
+      if (!ot_variant_read_fd (fd, 0, _OSTREE_SUMMARY_STATE_GVARIANT_FORMAT, FALSE, &data, error))
+        return FALSE;
+
+      guint32 version;
+      g_autoptr (GVariant) commits = NULL;
+      g_autoptr (GVariant) deltas = NULL;
+      g_variant_get (data, "(u@a(ayta{sv})@a(stttay))", &version, &commits, &deltas);
+      if (GUINT32_FROM_BE (version) == STATE_VERSION)
+        {
+          const gsize n_commits = g_variant_n_children (commits);
+          for (gsize i = 0; i < n_commits; i++)
+            {
+              g_autoptr (GVariant) csum_v = NULL;
+              guint64 size;
+              g_autoptr (GVariant) metadata = NULL;
+              g_variant_get_child (commits, i, "(@ayt@a{sv})", &csum_v, &size, &metadata);
+              if (!ostree_validate_structureof_csum_v (csum_v, NULL))
+                continue;
+              g_hash_table_replace (
+                  state->commits, ostree_checksum_from_bytes_v (csum_v),
+                  g_variant_ref_sink (g_variant_new ("(t@a{sv})", GUINT64_FROM_BE (size),
+                                                     metadata)));
+            }
+
+          const gsize n_deltas = g_variant_n_children (deltas);
+          for (gsize i = 0; i < n_deltas; i++)
+            {
+              const char *name;
+              guint64 ino, size, mtime;
+              g_autoptr (GVariant) digest = NULL;
+              g_variant_get_child (deltas, i, "(&sttt@ay)", &name, &ino, &size, &mtime, &digest);
+              if (g_variant_n_children (digest) != OSTREE_SHA256_DIGEST_LEN)
+                continue;
+              g_hash_table_replace (state->deltas, g_strdup (name),
+                                    g_variant_ref_sink (g_variant_new (
+                                        "(ttt@ay)", GUINT64_FROM_BE (ino), GUINT64_FROM_BE (size),
+                                        GUINT64_FROM_BE (mtime), digest)));
+            }
+        }
+      else
+        g_debug ("Ignoring summary state of version %u", GUINT32_FROM_BE (version));
+    }
+
+  *out_state = g_steal_pointer (&state);
+  return TRUE;
+}
+
+/**
+ * _ostree_repo_summary_state_get_commit:
+ * @self: Repo
+ * @state: Summary state
+ * @checksum: Commit checksum
+ * @out_size: (out): Size of the commit object
+ * @out_metadata: (out): Metadata of the commit for its summary entry
+ * @error: Error
+ *
+ * Get the summary entry data of commit @checksum, loading the commit only if
+ * the previous regeneration didn't.
+ */
+gboolean
+_ostree_repo_summary_state_get_commit (OstreeRepo *self, OstreeRepoSummaryState *state,
+                                       const char *checksum, guint64 *out_size,
+                                       GVariant **out_metadata, GError **error)
+{
+  GVariant *entry = g_hash_table_lookup (state->new_commits, checksum);
+  if (entry == NULL)
+    {
+      entry = g_hash_table_lookup (state->commits, checksum);
+      if (entry == NULL)
+        {
+          g_autoptr (GVariant) commit_obj = NULL;
+          if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_COMMIT, checksum, &commit_obj,
+                                         error))
+            return FALSE;
+          g_autoptr (GVariant) orig_metadata = g_variant_get_child_value (commit_obj, 0);
+
+          g_auto (GVariantDict) commit_metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
+          g_variant_dict_init (&commit_metadata_builder, NULL);
+
+          /* Forward the commit’s timestamp and version if they're valid. */
+          guint64 commit_timestamp = ostree_commit_get_timestamp (commit_obj);
+          g_autoptr (GDateTime) dt = g_date_time_new_from_unix_utc (commit_timestamp);
+
+          if (dt != NULL)
+            g_variant_dict_insert_value (&commit_metadata_builder, OSTREE_COMMIT_TIMESTAMP,
+                                         g_variant_new_uint64 (GUINT64_TO_BE (commit_timestamp)));
+
+          const char *version = NULL;
+          if (g_variant_lookup (orig_metadata, OSTREE_COMMIT_META_KEY_VERSION, "&s", &version))
+            g_variant_dict_insert (&commit_metadata_builder, OSTREE_COMMIT_VERSION, "s", version);
+
+          entry = g_variant_new ("(t@a{sv})", (guint64)g_variant_get_size (commit_obj),
+                                 g_variant_dict_end (&commit_metadata_builder));
+          state->dirty = TRUE;
+        }
+      g_hash_table_replace (state->new_commits, g_strdup (checksum), g_variant_ref_sink (entry));
+    }
+
+  g_variant_get (entry, "(t@a{sv})", out_size, out_metadata);
+  return TRUE;
+}
+
+/**
+ * _ostree_repo_summary_state_get_delta_digest:
+ * @self: Repo
+ * @state: Summary state
+ * @from: (nullable): Source commit of the delta
+ * @to: Target commit of the delta
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like _ostree_repo_static_delta_superblock_digest(), but only reads the
+ * superblock if it changed since the previous regeneration.
+ *
+ * Returns: (transfer full): Digest of the delta superblock
+ */
+GVariant *
+_ostree_repo_summary_state_get_delta_digest (OstreeRepo *self, OstreeRepoSummaryState *state,
+                                             const char *from, const char *to,
+                                             GCancellable *cancellable, GError **error)
+{
+  g_autofree char *name = (from && from[0]) ? g_strconcat (from, "-", to, NULL) : g_strdup (to);
+  g_autofree char *superblock
+      = _ostree_get_relative_static_delta_superblock_path ((from && from[0]) ? from : NULL, to);
+  struct stat stbuf;
+  if (!glnx_fstatat (self->repo_dir_fd, superblock, &stbuf, 0, error))
+    return NULL;
+  const guint64 mtime = stbuf.st_mtim.tv_sec * G_GUINT64_CONSTANT (1000000000)
+                        + stbuf.st_mtim.tv_nsec;
+
+  GVariant *entry = g_hash_table_lookup (state->new_deltas, name);
+  if (entry == NULL)
+    entry = g_hash_table_lookup (state->deltas, name);
+  if (entry != NULL)
+    {
+      guint64 ino, size, old_mtime;
+      GVariant *digest;
+      g_variant_get (entry, "(ttt@ay)", &ino, &size, &old_mtime, &digest);
+      if (ino == (guint64)stbuf.st_ino && size == (guint64)stbuf.st_size && old_mtime == mtime)
+        {
+          g_hash_table_replace (state->new_deltas, g_steal_pointer (&name),
+                                g_variant_ref (entry));
+          return digest;
+        }
+      g_variant_unref (digest);
+    }
+
+  g_autoptr (GVariant) digest
+      = _ostree_repo_static_delta_superblock_digest (self, from, to, cancellable, error);
+  if (digest == NULL)
+    return NULL;
+  g_hash_table_replace (state->new_deltas, g_steal_pointer (&name),
+                        g_variant_ref_sink (g_variant_new ("(ttt@ay)", (guint64)stbuf.st_ino,
+                                                           (guint64)stbuf.st_size, mtime,
+                                                           digest)));
+  state->dirty = TRUE;
+  return g_steal_pointer (&digest);
+}
+
+/**
+ * _ostree_repo_summary_state_save:
+ * @self: Repo
+ * @state: Summary state
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Save the entries used since @state was loaded, if they differ from the
+ * ones loaded.
+ */
+gboolean
+_ostree_repo_summary_state_save (OstreeRepo *self, OstreeRepoSummaryState *state,
+                                 GCancellable *cancellable, GError **error)
+{
+  if (!state->dirty && g_hash_table_size (state->new_commits) == g_hash_table_size (state->commits)
+      && g_hash_table_size (state->new_deltas) == g_hash_table_size (state->deltas))
+    return TRUE;
+
+  g_auto (GVariantBuilder) commits_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&commits_builder, G_VARIANT_TYPE ("a(ayta{sv})"));
+  g_autoptr (GList) checksums = g_hash_table_get_keys (state->new_commits);
+  checksums = g_list_sort (checksums, (GCompareFunc)strcmp);
+  for (GList *iter = checksums; iter != NULL; iter = iter->next)
+    {
+      const char *checksum = iter->data;
+      guint64 size;
+      g_autoptr (GVariant) metadata = NULL;
+      g_variant_get (g_hash_table_lookup (state->new_commits, checksum), "(t@a{sv})", &size,
+                     &metadata);
+      g_variant_builder_add (&commits_builder, "(@ayt@a{sv})",
+                             ostree_checksum_to_bytes_v (checksum), GUINT64_TO_BE (size),
+                             metadata);
+    }
+
+  g_auto (GVariantBuilder) deltas_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&deltas_builder, G_VARIANT_TYPE ("a(stttay)"));
+  g_autoptr (GList) names = g_hash_table_get_keys (state->new_deltas);
+  names = g_list_sort (names, (GCompareFunc)strcmp);
+  for (GList *iter = names; iter != NULL; iter = iter->next)
+    {
+      const char *name = iter->data;
+      guint64 ino, size, mtime;
+      g_autoptr (GVariant) digest = NULL;
+      g_variant_get (g_hash_table_lookup (state->new_deltas, name), "(ttt@ay)", &ino, &size,
+                     &mtime, &digest);
+      g_variant_builder_add (&deltas_builder, "(sttt@ay)", name, GUINT64_TO_BE (ino),
+                             GUINT64_TO_BE (size), GUINT64_TO_BE (mtime), digest);
+    }
+
+  g_autoptr (GVariant) data = g_variant_ref_sink (
+      g_variant_new ("(u@a(ayta{sv})@a(stttay))", GUINT32_TO_BE (STATE_VERSION),
+                     g_variant_builder_end (&commits_builder),
+                     g_variant_builder_end (&deltas_builder)));
+
+  if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, "state", 0775, cancellable, error))
+    return FALSE;
+  if (!glnx_file_replace_contents_at (
+          self->repo_dir_fd, _OSTREE_SUMMARY_STATE_PATH, g_variant_get_data (data),
+          g_variant_get_size (data),
+          self->disable_fsync ? GLNX_FILE_REPLACE_NODATASYNC : GLNX_FILE_REPLACE_DATASYNC_NEW,
+          cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
@@ -605,6 +605,179 @@ ostree_repo_traverse_commit_with_flags (OstreeRepo *repo, OstreeRepoCommitTraver
   return TRUE;
 }
 
+static gboolean traverse_dirtree_set (OstreeRepo *repo, const char *checksum,
+                                      OstreeRepoObjectSet *inout_reachable,
+                                      gboolean ignore_missing_dirs, GCancellable *cancellable,
+                                      GError **error);
+
+/* Like traverse_iter(), but accumulating into an #OstreeRepoObjectSet and
+ * without tracking parents.
+ */
+static gboolean
+traverse_iter_set (OstreeRepo *repo, OstreeRepoCommitTraverseIter *iter,
+                   OstreeRepoObjectSet *inout_reachable, gboolean ignore_missing_dirs,
+                   GCancellable *cancellable, GError **error)
+{
+  while (TRUE)
+    {
+      g_autoptr (GError) local_error = NULL;
+      OstreeRepoCommitIterResult iterres
+          = ostree_repo_commit_traverse_iter_next (iter, cancellable, &local_error);
+
+      if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_ERROR)
+        {
+          if (ignore_missing_dirs
+              && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+            {
+              g_debug ("Ignoring not-found dirmeta");
+              return TRUE; /* Note early return */
+            }
+
+          g_propagate_error (error, g_steal_pointer (&local_error));
+          return FALSE;
+        }
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_END)
+        break;
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_FILE)
+        {
+          char *name;
+          char *checksum;
+
+          ostree_repo_commit_traverse_iter_get_file (iter, &name, &checksum);
+          ostree_repo_object_set_add (inout_reachable, checksum, OSTREE_OBJECT_TYPE_FILE);
+        }
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_DIR)
+        {
+          char *name;
+          char *content_checksum;
+          char *meta_checksum;
+
+          ostree_repo_commit_traverse_iter_get_dir (iter, &name, &content_checksum, &meta_checksum);
+          ostree_repo_object_set_add (inout_reachable, meta_checksum,
+                                      OSTREE_OBJECT_TYPE_DIR_META);
+          if (ostree_repo_object_set_add (inout_reachable, content_checksum,
+                                          OSTREE_OBJECT_TYPE_DIR_TREE))
+            {
+              if (!traverse_dirtree_set (repo, content_checksum, inout_reachable,
+                                         ignore_missing_dirs, cancellable, error))
+                return FALSE;
+            }
+        }
+      else
+        g_assert_not_reached ();
+    }
+
+  return TRUE;
+}
+
+static gboolean
+traverse_dirtree_set (OstreeRepo *repo, const char *checksum, OstreeRepoObjectSet *inout_reachable,
+                      gboolean ignore_missing_dirs, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GError) local_error = NULL;
+
+  g_autoptr (GVariant) dirtree = NULL;
+  if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_TREE, checksum, &dirtree,
+                                 &local_error))
+    {
+      if (ignore_missing_dirs && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        {
+          g_debug ("Ignoring not-found dirmeta %s", checksum);
+          return TRUE; /* Early return */
+        }
+
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return FALSE;
+    }
+
+  ostree_cleanup_repo_commit_traverse_iter OstreeRepoCommitTraverseIter iter = {
+    0,
+  };
+  if (!ostree_repo_commit_traverse_iter_init_dirtree (&iter, repo, dirtree,
+                                                      OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, error))
+    return FALSE;
+
+  return traverse_iter_set (repo, &iter, inout_reachable, ignore_missing_dirs, cancellable, error);
+}
+
+/**
+ * ostree_repo_traverse_commit_set:
+ * @repo: Repo
+ * @flags: change traversal behaviour according to these flags
+ * @commit_checksum: ASCII SHA256 checksum
+ * @maxdepth: Traverse this many parent commits, -1 for unlimited
+ * @inout_reachable: Set of reachable objects
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like ostree_repo_traverse_commit_with_flags(), but accumulates into an
+ * #OstreeRepoObjectSet, which uses far less memory than a #GHashTable of
+ * serialized object names when traversing large repositories.  Parent
+ * tracking is not supported.
+ *
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_traverse_commit_set (OstreeRepo *repo, OstreeRepoCommitTraverseFlags flags,
+                                 const char *commit_checksum, int maxdepth,
+                                 OstreeRepoObjectSet *inout_reachable, GCancellable *cancellable,
+                                 GError **error)
+{
+  g_autofree char *tmp_checksum = NULL;
+  gboolean commit_only = flags & OSTREE_REPO_COMMIT_TRAVERSE_FLAG_COMMIT_ONLY;
+
+  while (TRUE)
+    {
+      if (ostree_repo_object_set_contains (inout_reachable, commit_checksum,
+                                           OSTREE_OBJECT_TYPE_COMMIT))
+        break;
+
+      g_autoptr (GVariant) commit = NULL;
+      if (!ostree_repo_load_variant_if_exists (repo, OSTREE_OBJECT_TYPE_COMMIT, commit_checksum,
+                                               &commit, error))
+        return FALSE;
+
+      /* Just return if the parent isn't found */
+      if (!commit)
+        break;
+
+      OstreeRepoCommitState commitstate;
+      if (!ostree_repo_load_commit (repo, commit_checksum, NULL, &commitstate, error))
+        return FALSE;
+
+      gboolean ignore_missing_dirs = (commitstate & OSTREE_REPO_COMMIT_STATE_PARTIAL) != 0;
+
+      ostree_repo_object_set_add (inout_reachable, commit_checksum, OSTREE_OBJECT_TYPE_COMMIT);
+
+      if (!commit_only)
+        {
+          g_debug ("Traversing commit %s", commit_checksum);
+          ostree_cleanup_repo_commit_traverse_iter OstreeRepoCommitTraverseIter iter = {
+            0,
+          };
+          if (!ostree_repo_commit_traverse_iter_init_commit (
+                  &iter, repo, commit, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, error))
+            return FALSE;
+
+          if (!traverse_iter_set (repo, &iter, inout_reachable, ignore_missing_dirs, cancellable,
+                                  error))
+            return FALSE;
+        }
+
+      if (maxdepth != -1 && maxdepth <= 0)
+        break;
+      g_free (tmp_checksum);
+      tmp_checksum = ostree_commit_get_parent (commit);
+      if (!tmp_checksum)
+        break;
+      commit_checksum = tmp_checksum;
+      if (maxdepth > 0)
+        maxdepth -= 1;
+    }
+
+  return TRUE;
+}
+
 /**
  * ostree_repo_traverse_commit_union_with_parents: (skip)
  * @repo: Repo
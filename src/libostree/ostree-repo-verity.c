@@ -245,3 +245,412 @@ _ostree_ensure_fsverity (OstreeRepo *self, gboolean allow_enoent, int dirfd, con
 
   return TRUE;
 }
+
+/* The fs-verity index lets fsck skip reading content objects which have
+ * fs-verity enabled.  When a content object is written we measure its
+ * fs-verity digest (the kernel computed it when enabling verity) and record
+ * it, keyed by the object checksum; since we just validated the content,
+ * the digest stands in for the checksum from then on.  To verify the object
+ * later it suffices to ask the kernel for the current digest and compare:
+ * the kernel refuses to return data which doesn't match it.
+ *
+ * In archive repositories the object file holds the whole object.  In bare
+ * repositories the ownership, mode and xattrs are outside the file data
+ * covered by fs-verity, so we also record a digest of the file header,
+ * which is cheap to recompute from the object's metadata.
+ *
+ * Each transaction appends a sorted segment file; once there are more than
+ * a few they are merged, and prune drops records for deleted objects.  A
+ * missing or stale record just means falling back to a full read.
+ */
+
+#define FSVERITY_KEY_LEN (OSTREE_SHA256_DIGEST_LEN + 1)
+#define FSVERITY_RECORD_LEN (FSVERITY_KEY_LEN + 2 * OSTREE_SHA256_DIGEST_LEN)
+#define FSVERITY_INDEX_VERSION 1
+#define FSVERITY_MAX_SEGMENTS 16
+
+static const guint8 no_header_digest[OSTREE_SHA256_DIGEST_LEN] = {
+  0,
+};
+
+static int
+compare_fsverity_records (gconstpointer a, gconstpointer b)
+{
+  return memcmp (a, b, FSVERITY_KEY_LEN);
+}
+
+/* Get the fs-verity digest of @fd, returning %FALSE if it doesn't have
+ * (SHA-256) fs-verity enabled.
+ */
+static gboolean
+measure_fsverity (int fd, guint8 out_digest[OSTREE_SHA256_DIGEST_LEN])
+{
+#ifdef HAVE_LINUX_FSVERITY_H
+  union
+  {
+    struct fsverity_digest d;
+    char buf[sizeof (struct fsverity_digest) + OSTREE_SHA256_DIGEST_LEN];
+  } result;
+
+  result.d.digest_size = OSTREE_SHA256_DIGEST_LEN;
+  if (ioctl (fd, FS_IOC_MEASURE_VERITY, &result) != 0
+      || result.d.digest_size != OSTREE_SHA256_DIGEST_LEN
+      || result.d.digest_algorithm != FS_VERITY_HASH_ALG_SHA256)
+    return FALSE;
+
+  memcpy (out_digest, result.d.digest, OSTREE_SHA256_DIGEST_LEN);
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * _ostree_repo_fsverity_record:
+ * @self: Repo
+ * @fd: The object file, after fs-verity was enabled
+ * @checksum: Content object checksum, already validated
+ * @file_header: (nullable): File header from _ostree_file_header_new(),
+ *   required for bare repositories
+ *
+ * Add @fd's fs-verity digest to the index for the current transaction;
+ * does nothing if it doesn't have fs-verity enabled.
+ */
+void
+_ostree_repo_fsverity_record (OstreeRepo *self, int fd, const char *checksum, GBytes *file_header)
+{
+  if (self->fs_verity_wanted == _OSTREE_FEATURE_NO)
+    return;
+  if (file_header == NULL && self->mode != OSTREE_REPO_MODE_ARCHIVE)
+    return;
+
+  guint8 record[FSVERITY_RECORD_LEN];
+  if (!measure_fsverity (fd, record + FSVERITY_KEY_LEN))
+    return;
+  ostree_checksum_inplace_to_bytes (checksum, record);
+  record[OSTREE_SHA256_DIGEST_LEN] = OSTREE_OBJECT_TYPE_FILE;
+  guint8 *header_digest = record + FSVERITY_KEY_LEN + OSTREE_SHA256_DIGEST_LEN;
+  if (file_header)
+    ot_checksum_bytes (file_header, header_digest);
+  else
+    memcpy (header_digest, no_header_digest, OSTREE_SHA256_DIGEST_LEN);
+
+  g_mutex_lock (&self->txn_lock);
+  if (self->txn.fsverity_records == NULL)
+    self->txn.fsverity_records = g_byte_array_new ();
+  g_byte_array_append (self->txn.fsverity_records, record, sizeof (record));
+  g_mutex_unlock (&self->txn_lock);
+}
+
+void
+_ostree_repo_fsverity_index_clear (OstreeRepo *self)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->fsverity_index_lock);
+  g_clear_pointer (&self->fsverity_index, g_ptr_array_unref);
+}
+
+/* Read the records of one segment; anything we can't make sense of is
+ * treated as empty.
+ */
+static gboolean
+load_fsverity_segment (int dfd, const char *name, GVariant **out_records, GError **error)
+{
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (dfd, name, &fd, error))
+    return FALSE;
+  if (fd == -1)
+    return TRUE;
+
+  g_autoptr (GVariant) data = NULL;
+  if (!ot_variant_read_fd (fd, 0, _OSTREE_FSVERITY_INDEX_GVARIANT_FORMAT, FALSE, &data, error))
+    return FALSE;
+
+  guint32 version;
+  g_autoptr (GVariant) records = NULL;
+  g_variant_get (data, "(u@ay)", &version, &records);
+  if (GUINT32_FROM_BE (version) != FSVERITY_INDEX_VERSION
+      || g_variant_get_size (records) % FSVERITY_RECORD_LEN != 0)
+    {
+      g_debug ("Ignoring invalid fs-verity index segment %s", name);
+      return TRUE;
+    }
+
+  *out_records = g_steal_pointer (&records);
+  return TRUE;
+}
+
+/* List and load the segments of the index, optionally returning their
+ * names too.
+ */
+static gboolean
+load_fsverity_segments (OstreeRepo *self, GPtrArray **out_segments, GPtrArray **out_names,
+                        GError **error)
+{
+  g_autoptr (GPtrArray) segments = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+  g_autoptr (GPtrArray) names = g_ptr_array_new_with_free_func (g_free);
+  g_auto (GLnxDirFdIterator) dfd_iter = {
+    0,
+  };
+  gboolean exists = FALSE;
+  if (!ot_dfd_iter_init_allow_noent (self->repo_dir_fd, _OSTREE_FSVERITY_INDEX_DIR, &dfd_iter,
+                                     &exists, error))
+    return FALSE;
+  while (exists)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, NULL, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+      if (!g_str_has_suffix (dent->d_name, ".segment"))
+        continue;
+
+      g_autoptr (GVariant) records = NULL;
+      if (!load_fsverity_segment (dfd_iter.fd, dent->d_name, &records, error))
+        return FALSE;
+      if (records)
+        g_ptr_array_add (segments, g_steal_pointer (&records));
+      g_ptr_array_add (names, g_strdup (dent->d_name));
+    }
+
+  *out_segments = g_steal_pointer (&segments);
+  if (out_names)
+    *out_names = g_steal_pointer (&names);
+  return TRUE;
+}
+
+/* Return a reference to the current set of segments, reloading them if
+ * another transaction added one.
+ */
+static gboolean
+get_fsverity_index (OstreeRepo *self, GPtrArray **out_segments, GError **error)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->fsverity_index_lock);
+
+  struct stat stbuf;
+  if (!glnx_fstatat_allow_noent (self->repo_dir_fd, _OSTREE_FSVERITY_INDEX_DIR, &stbuf, 0, error))
+    return FALSE;
+  struct timespec mtime = {
+    0,
+  };
+  if (errno == 0)
+    mtime = stbuf.st_mtim;
+
+  if (self->fsverity_index == NULL || mtime.tv_sec != self->fsverity_index_mtime.tv_sec
+      || mtime.tv_nsec != self->fsverity_index_mtime.tv_nsec)
+    {
+      g_autoptr (GPtrArray) segments = NULL;
+      if (!load_fsverity_segments (self, &segments, NULL, error))
+        return FALSE;
+      g_clear_pointer (&self->fsverity_index, g_ptr_array_unref);
+      self->fsverity_index = g_steal_pointer (&segments);
+      self->fsverity_index_mtime = mtime;
+    }
+
+  *out_segments = g_ptr_array_ref (self->fsverity_index);
+  return TRUE;
+}
+
+static gboolean
+write_fsverity_segment (OstreeRepo *self, guint8 *records, gsize n_records,
+                        GCancellable *cancellable, GError **error)
+{
+  qsort (records, n_records, FSVERITY_RECORD_LEN, compare_fsverity_records);
+
+  g_autoptr (GVariant) data = g_variant_ref_sink (g_variant_new (
+      "(u@ay)", GUINT32_TO_BE (FSVERITY_INDEX_VERSION),
+      g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, records, n_records * FSVERITY_RECORD_LEN,
+                                 1)));
+
+  if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, _OSTREE_FSVERITY_INDEX_DIR, 0775, cancellable,
+                               error))
+    return FALSE;
+
+  g_autofree char *uuid = g_uuid_string_random ();
+  g_autofree char *path = g_strconcat (_OSTREE_FSVERITY_INDEX_DIR, "/", uuid, ".segment", NULL);
+  if (!glnx_file_replace_contents_at (
+          self->repo_dir_fd, path, g_variant_get_data (data), g_variant_get_size (data),
+          self->disable_fsync ? GLNX_FILE_REPLACE_NODATASYNC : GLNX_FILE_REPLACE_DATASYNC_NEW,
+          cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * _ostree_repo_fsverity_compact:
+ * @self: Repo
+ * @drop_missing: Also drop records for objects which no longer exist
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Merge the segments of the fs-verity index into one.
+ */
+gboolean
+_ostree_repo_fsverity_compact (OstreeRepo *self, gboolean drop_missing, GCancellable *cancellable,
+                               GError **error)
+{
+  g_autoptr (GPtrArray) segments = NULL;
+  g_autoptr (GPtrArray) names = NULL;
+  if (!load_fsverity_segments (self, &segments, &names, error))
+    return FALSE;
+  if (names->len == 0 || (names->len == 1 && !drop_missing))
+    return TRUE;
+
+  g_autoptr (GByteArray) records = g_byte_array_new ();
+  for (guint i = 0; i < segments->len; i++)
+    {
+      GVariant *segment = segments->pdata[i];
+      g_byte_array_append (records, g_variant_get_data (segment), g_variant_get_size (segment));
+    }
+  qsort (records->data, records->len / FSVERITY_RECORD_LEN, FSVERITY_RECORD_LEN,
+         compare_fsverity_records);
+
+  gsize n_kept = 0;
+  for (gsize i = 0; i < records->len / FSVERITY_RECORD_LEN; i++)
+    {
+      guint8 *record = records->data + i * FSVERITY_RECORD_LEN;
+      guint8 *last = n_kept > 0 ? records->data + (n_kept - 1) * FSVERITY_RECORD_LEN : NULL;
+      if (last && memcmp (last, record, FSVERITY_KEY_LEN) == 0)
+        continue;
+
+      if (drop_missing)
+        {
+          char checksum[OSTREE_SHA256_STRING_LEN + 1];
+          char loose_path[_OSTREE_LOOSE_PATH_MAX];
+          ostree_checksum_inplace_from_bytes (record, checksum);
+          _ostree_loose_path (loose_path, checksum, OSTREE_OBJECT_TYPE_FILE, self->mode);
+          if (!glnx_fstatat_allow_noent (self->objects_dir_fd, loose_path, NULL,
+                                         AT_SYMLINK_NOFOLLOW, error))
+            return FALSE;
+          if (errno == ENOENT)
+            continue;
+        }
+
+      memmove (records->data + n_kept * FSVERITY_RECORD_LEN, record, FSVERITY_RECORD_LEN);
+      n_kept++;
+    }
+
+  if (n_kept > 0
+      && !write_fsverity_segment (self, records->data, n_kept, cancellable, error))
+    return FALSE;
+
+  /* Records for the same object are interchangeable, so removing the old
+   * segments only after writing the new one is safe against concurrent
+   * writers and compactions.
+   */
+  for (guint i = 0; i < names->len; i++)
+    {
+      g_autofree char *path
+          = g_strconcat (_OSTREE_FSVERITY_INDEX_DIR, "/", (char *)names->pdata[i], NULL);
+      if (!ot_ensure_unlinked_at (self->repo_dir_fd, path, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * _ostree_repo_fsverity_flush:
+ * @self: Repo
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Write out the records for objects committed by the current transaction.
+ */
+gboolean
+_ostree_repo_fsverity_flush (OstreeRepo *self, GCancellable *cancellable, GError **error)
+{
+  g_mutex_lock (&self->txn_lock);
+  g_autoptr (GByteArray) records = g_steal_pointer (&self->txn.fsverity_records);
+  g_mutex_unlock (&self->txn_lock);
+
+  if (records == NULL)
+    return TRUE;
+
+  if (!write_fsverity_segment (self, records->data, records->len / FSVERITY_RECORD_LEN,
+                               cancellable, error))
+    return FALSE;
+
+  g_autoptr (GPtrArray) segments = NULL;
+  if (!get_fsverity_index (self, &segments, error))
+    return FALSE;
+  if (segments->len > FSVERITY_MAX_SEGMENTS
+      && !_ostree_repo_fsverity_compact (self, FALSE, cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * _ostree_repo_fsverity_verify_content:
+ * @self: Repo
+ * @checksum: Content object checksum
+ * @out_verified: (out): Whether the object was verified
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Verify a content object using its fs-verity digest, if it is in the
+ * index.  If @out_verified is %FALSE, the object must be verified by
+ * reading it; in particular no error is returned for a broken object.
+ * May be called from any thread.
+ */
+gboolean
+_ostree_repo_fsverity_verify_content (OstreeRepo *self, const char *checksum,
+                                      gboolean *out_verified, GCancellable *cancellable,
+                                      GError **error)
+{
+  *out_verified = FALSE;
+
+#ifdef HAVE_LINUX_FSVERITY_H
+  g_autoptr (GPtrArray) segments = NULL;
+  if (!get_fsverity_index (self, &segments, error))
+    return FALSE;
+
+  guint8 key[FSVERITY_KEY_LEN];
+  ostree_checksum_inplace_to_bytes (checksum, key);
+  key[OSTREE_SHA256_DIGEST_LEN] = OSTREE_OBJECT_TYPE_FILE;
+  const guint8 *record = NULL;
+  for (guint i = 0; i < segments->len && record == NULL; i++)
+    {
+      GVariant *segment = segments->pdata[i];
+      record = bsearch (key, g_variant_get_data (segment),
+                        g_variant_get_size (segment) / FSVERITY_RECORD_LEN, FSVERITY_RECORD_LEN,
+                        compare_fsverity_records);
+    }
+  if (record == NULL)
+    return TRUE;
+
+  char loose_path[_OSTREE_LOOSE_PATH_MAX];
+  _ostree_loose_path (loose_path, checksum, OSTREE_OBJECT_TYPE_FILE, self->mode);
+  glnx_autofd int fd = openat (self->objects_dir_fd, loose_path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd < 0)
+    return TRUE;
+
+  guint8 digest[OSTREE_SHA256_DIGEST_LEN];
+  if (!measure_fsverity (fd, digest)
+      || memcmp (digest, record + FSVERITY_KEY_LEN, OSTREE_SHA256_DIGEST_LEN) != 0)
+    return TRUE;
+
+  if (self->mode != OSTREE_REPO_MODE_ARCHIVE)
+    {
+      const guint8 *expected_header_digest = record + FSVERITY_KEY_LEN + OSTREE_SHA256_DIGEST_LEN;
+      if (memcmp (expected_header_digest, no_header_digest, OSTREE_SHA256_DIGEST_LEN) == 0)
+        return TRUE;
+
+      g_autoptr (GFileInfo) file_info = NULL;
+      g_autoptr (GVariant) xattrs = NULL;
+      if (!ostree_repo_load_file (self, checksum, NULL, &file_info, &xattrs, cancellable, error))
+        return FALSE;
+      g_autoptr (GBytes) header = _ostree_file_header_new (file_info, xattrs);
+      guint8 header_digest[OSTREE_SHA256_DIGEST_LEN];
+      ot_checksum_bytes (header, header_digest);
+      if (memcmp (header_digest, expected_header_digest, OSTREE_SHA256_DIGEST_LEN) != 0)
+        return TRUE;
+    }
+
+  g_debug ("Content object %s verified by fs-verity", checksum);
+  *out_verified = TRUE;
+#endif
+  return TRUE;
+}
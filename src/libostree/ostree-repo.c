@@ -1167,7 +1167,14 @@ ostree_repo_finalize (GObject *object)
   g_clear_error (&self->writable_error);
   g_clear_pointer (&self->object_sizes, g_hash_table_unref);
   g_clear_pointer (&self->dirmeta_cache, g_hash_table_unref);
+  g_clear_pointer (&self->metadata_cache, _ostree_repo_metadata_cache_free);
   g_mutex_clear (&self->cache_lock);
+  _ostree_repo_packs_clear (self);
+  _ostree_repo_pack_discard_removals (self);
+  g_mutex_clear (&self->pack_lock);
+  _ostree_repo_fsverity_index_clear (self);
+  g_mutex_clear (&self->fsverity_index_lock);
+  g_clear_pointer (&self->txn.fsverity_records, g_byte_array_unref);
   g_mutex_clear (&self->txn_lock);
   g_free (self->collection_id);
   g_strfreev (self->repo_finders);
@@ -1324,6 +1331,9 @@ ostree_repo_init (OstreeRepo *self)
 
   g_mutex_init (&self->lock.mutex);
   g_mutex_init (&self->cache_lock);
+  self->metadata_cache = _ostree_repo_metadata_cache_new ();
+  g_mutex_init (&self->pack_lock);
+  g_mutex_init (&self->fsverity_index_lock);
   g_mutex_init (&self->txn_lock);
 
   self->remotes = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify)NULL,
@@ -2995,6 +3005,31 @@ min_free_space_calculate_reserved_bytes (OstreeRepo *self, guint64 *bytes, GErro
   return TRUE;
 }
 
+/* Parse the decimal number @size_str followed by the unit @unit, which is
+ * empty or one of the characters of @units.  The first of @units is
+ * 2^@first_shift times the unit of the result, and each of the others is
+ * 1024 times the one before it; an empty @unit leaves the number as is.
+ */
+static gboolean
+parse_size_suffix (const char *size_str, const char *unit, const char *units, guint first_shift,
+                   guint64 *out_size, GError **error)
+{
+  guint shifts = 0;
+  if (*unit != '\0')
+    {
+      const char *found = strchr (units, *unit);
+      g_assert (found != NULL);
+      shifts = first_shift + 10 * (found - units);
+    }
+
+  guint64 size = g_ascii_strtoull (size_str, NULL, 10);
+  if (shifts > 0 && g_bit_nth_lsf (size, 63 - shifts) != -1)
+    return glnx_throw (error, "Value was too high");
+
+  *out_size = size << shifts;
+  return TRUE;
+}
+
 static gboolean
 min_free_space_size_validate_and_convert (OstreeRepo *self, const char *min_free_space_size_str,
                                           GError **error)
@@ -3014,30 +3049,29 @@ min_free_space_size_validate_and_convert (OstreeRepo *self, const char *min_free
 
   g_autofree char *size_str = g_match_info_fetch (match, 1);
   g_autofree char *unit = g_match_info_fetch (match, 2);
-  guint shifts;
+  return parse_size_suffix (size_str, unit, "MGT", 0, &self->min_free_space_mb, error);
+}
 
-  switch (*unit)
+static gboolean
+metadata_cache_size_parse (const char *str, guint64 *out_size, GError **error)
+{
+  static GRegex *regex;
+  static gsize regex_initialized;
+  if (g_once_init_enter (&regex_initialized))
     {
-    case 'M':
-      shifts = 0;
-      break;
-    case 'G':
-      shifts = 10;
-      break;
-    case 'T':
-      shifts = 20;
-      break;
-    default:
-      g_assert_not_reached ();
+      regex = g_regex_new ("^([0-9]+)(K|M|G)?B?$", 0, 0, NULL);
+      g_assert (regex);
+      g_once_init_leave (&regex_initialized, 1);
     }
 
-  guint64 min_free_space = g_ascii_strtoull (size_str, NULL, 10);
-  if (shifts > 0 && g_bit_nth_lsf (min_free_space, 63 - shifts) != -1)
-    return glnx_throw (error, "Value was too high");
-
-  self->min_free_space_mb = min_free_space << shifts;
+  g_autoptr (GMatchInfo) match = NULL;
+  if (!g_regex_match (regex, str, 0, &match))
+    return glnx_throw (error, "It should be a number of bytes, or of the format '123KB', "
+                              "'123MB' or '123GB'");
 
-  return TRUE;
+  g_autofree char *size_str = g_match_info_fetch (match, 1);
+  g_autofree char *unit = g_match_info_fetch (match, 2);
+  return parse_size_suffix (size_str, unit, "KMG", 10, out_size, error);
 }
 
 static gboolean
@@ -3259,6 +3293,21 @@ reload_core_config (OstreeRepo *self, GCancellable *cancellable, GError **error)
     self->payload_link_threshold = g_ascii_strtoull (payload_threshold, NULL, 10);
   }
 
+  {
+    g_autofree char *metadata_cache_size_str = NULL;
+    guint64 metadata_cache_size;
+
+    if (!ot_keyfile_get_value_with_default (self->config, "core", "metadata-cache-size", "0",
+                                            &metadata_cache_size_str, error))
+      return FALSE;
+    if (!metadata_cache_size_parse (metadata_cache_size_str, &metadata_cache_size, error))
+      return glnx_prefix_error (error, "Invalid metadata-cache-size '%s'",
+                                metadata_cache_size_str);
+
+    /* Resized in place, since other threads may be loading objects */
+    _ostree_repo_metadata_cache_set_max_size (self->metadata_cache, metadata_cache_size);
+  }
+
   {
     g_auto (GStrv) configured_finders = NULL;
     g_autoptr (GError) local_error = NULL;
@@ -3357,6 +3406,14 @@ reload_sysroot_config (OstreeRepo *self, GCancellable *cancellable, GError **err
     return glnx_prefix_error (error, "Parsing sysroot.boot-counting-tries");
   self->boot_counting = (guint)v;
 
+  g_autofree char *checkout_jobs_str = NULL;
+  if (!ot_keyfile_get_value_with_default_group_optional (self->config, "sysroot", "checkout-jobs",
+                                                         "1", &checkout_jobs_str, error))
+    return FALSE;
+  if (!g_ascii_string_to_unsigned (checkout_jobs_str, 10, 0, G_MAXINT, &v, error))
+    return glnx_prefix_error (error, "Parsing sysroot.checkout-jobs");
+  self->checkout_n_jobs = (guint)v;
+
   g_autofree char *bootloader = NULL;
 
   if (!ot_keyfile_get_value_with_default_group_optional (self->config, "sysroot", "bootloader",
@@ -3784,6 +3841,41 @@ ostree_repo_get_min_free_space_bytes (OstreeRepo *self, guint64 *out_reserved_by
   return TRUE;
 }
 
+/**
+ * ostree_repo_get_metadata_cache_stats:
+ * @self: Repo
+ * @out_hits: (out) (optional): Number of metadata loads served from the cache
+ * @out_misses: (out) (optional): Number of metadata loads which missed the cache
+ * @out_evictions: (out) (optional): Number of objects evicted to make room for others
+ * @out_size: (out) (optional): Bytes currently used by the cache
+ *
+ * Get statistics for the in-memory cache of commit, dirtree and dirmeta
+ * objects sized by the core.metadata-cache-size repo config option.  All
+ * of them are zero if the cache is disabled.  They are counted from when
+ * the cache size was configured, which happens again when the configuration
+ * is reloaded.
+ *
+ * Since: 2026.5
+ */
+void
+ostree_repo_get_metadata_cache_stats (OstreeRepo *self, guint64 *out_hits, guint64 *out_misses,
+                                      guint64 *out_evictions, guint64 *out_size)
+{
+  g_return_if_fail (OSTREE_IS_REPO (self));
+
+  guint64 hits, misses, evictions, size;
+  _ostree_repo_metadata_cache_get_stats (self->metadata_cache, &hits, &misses, &evictions, &size);
+
+  if (out_hits)
+    *out_hits = hits;
+  if (out_misses)
+    *out_misses = misses;
+  if (out_evictions)
+    *out_evictions = evictions;
+  if (out_size)
+    *out_size = size;
+}
+
 /**
  * ostree_repo_get_parent:
  * @self: Repo
@@ -3834,7 +3926,8 @@ list_loose_objects_at (OstreeRepo *self, GVariant *dummy_value, GHashTable *inou
         continue;
 
       OstreeObjectType objtype;
-      if ((self->mode == OSTREE_REPO_MODE_ARCHIVE && strcmp (dot, ".filez") == 0)
+      if ((self->mode == OSTREE_REPO_MODE_ARCHIVE
+           && (strcmp (dot, ".filez") == 0 || strcmp (dot, ".filechunks") == 0))
           || ((_ostree_repo_mode_is_bare (self->mode)) && strcmp (dot, ".file") == 0))
         objtype = OSTREE_OBJECT_TYPE_FILE;
       else if (strcmp (dot, ".dirtree") == 0)
@@ -3903,9 +3996,12 @@ list_loose_objects (OstreeRepo *self, GVariant *dummy_value, GHashTable *inout_o
   return TRUE;
 }
 
+/* With @use_cache unset, the object is always read from disk; that's what
+ * fsck needs to check.
+ */
 static gboolean
 load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *sha256,
-                        gboolean error_if_not_found, GVariant **out_variant,
+                        gboolean error_if_not_found, gboolean use_cache, GVariant **out_variant,
                         GInputStream **out_stream, guint64 *out_size,
                         OstreeRepoCommitState *out_state, GCancellable *cancellable, GError **error)
 {
@@ -3925,7 +4021,7 @@ load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *
    * times.
    */
   const gboolean is_dirmeta_cachable
-      = (objtype == OSTREE_OBJECT_TYPE_DIR_META && out_variant && !out_stream);
+      = (use_cache && objtype == OSTREE_OBJECT_TYPE_DIR_META && out_variant && !out_stream);
   if (is_dirmeta_cachable)
     {
       GMutex *lock = &self->cache_lock;
@@ -3941,15 +4037,38 @@ load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *
         return TRUE;
     }
 
+  /* And the bounded cache of all immutable metadata, if enabled */
+  const gboolean is_cachable = (use_cache && out_variant && !out_stream && !out_size && !out_state
+                                && _ostree_repo_metadata_cache_accepts (objtype));
+  if (is_cachable)
+    {
+      *out_variant = _ostree_repo_metadata_cache_lookup (self->metadata_cache, objtype, sha256);
+      if (*out_variant)
+        return TRUE;
+    }
+
   _ostree_loose_path (loose_path_buf, sha256, objtype, self->mode);
 
   if (!ot_openat_ignore_enoent (self->objects_dir_fd, loose_path_buf, &fd, error))
     return FALSE;
 
+  /* Objects in the staging directory go away if the transaction is aborted,
+   * so they aren't cached.
+   */
+  gboolean is_staged = FALSE;
   if (fd < 0 && self->commit_stagedir.initialized)
     {
       if (!ot_openat_ignore_enoent (self->commit_stagedir.fd, loose_path_buf, &fd, error))
         return FALSE;
+      is_staged = fd != -1;
+    }
+
+  g_autoptr (GBytes) packed_data = NULL;
+  if (fd < 0)
+    {
+      gboolean is_packed = FALSE;
+      if (!_ostree_repo_pack_lookup (self, sha256, objtype, &is_packed, &packed_data, error))
+        return FALSE;
     }
 
   if (fd != -1)
@@ -3973,6 +4092,9 @@ load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *
                                       g_variant_ref (ret_variant));
               g_mutex_unlock (lock);
             }
+          if (is_cachable && !is_staged)
+            _ostree_repo_metadata_cache_insert (self->metadata_cache, objtype, sha256,
+                                                ret_variant);
         }
       else if (out_stream)
         {
@@ -4006,12 +4128,41 @@ load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *
             }
         }
     }
+  else if (packed_data != NULL)
+    {
+      /* Commit objects are never packed, so there is no state to load */
+      g_assert (out_state == NULL);
+
+      if (out_variant)
+        {
+          ret_variant = g_variant_ref_sink (
+              g_variant_new_from_bytes (ostree_metadata_variant_type (objtype), packed_data, TRUE));
+
+          if (is_dirmeta_cachable)
+            {
+              GMutex *lock = &self->cache_lock;
+              g_mutex_lock (lock);
+              if (self->dirmeta_cache)
+                g_hash_table_replace (self->dirmeta_cache, g_strdup (sha256),
+                                      g_variant_ref (ret_variant));
+              g_mutex_unlock (lock);
+            }
+          if (is_cachable)
+            _ostree_repo_metadata_cache_insert (self->metadata_cache, objtype, sha256,
+                                                ret_variant);
+        }
+      else if (out_stream)
+        ret_stream = g_memory_input_stream_new_from_bytes (packed_data);
+
+      if (out_size)
+        *out_size = g_bytes_get_size (packed_data);
+    }
   else if (self->parent_repo)
     {
       /* Directly recurse to simplify out parameters */
       return load_metadata_internal (self->parent_repo, objtype, sha256, error_if_not_found,
-                                     out_variant, out_stream, out_size, out_state, cancellable,
-                                     error);
+                                     use_cache, out_variant, out_stream, out_size, out_state,
+                                     cancellable, error);
     }
   else if (error_if_not_found)
     {
@@ -4068,6 +4219,30 @@ repo_load_file_archive (OstreeRepo *self, const char *checksum, GInputStream **o
       return ostree_content_stream_parse (TRUE, tmp_stream, stbuf.st_size, TRUE, out_input,
                                           out_file_info, out_xattrs, cancellable, error);
     }
+
+  gboolean is_chunked = FALSE;
+  g_autoptr (GVariant) chunked_descriptor = NULL;
+  if (!_ostree_repo_chunked_file_lookup (self, checksum, &is_chunked, &chunked_descriptor, error))
+    return FALSE;
+  if (is_chunked)
+    /* Note return here */
+    return _ostree_repo_chunked_file_parse (self, chunked_descriptor, out_input, out_file_info,
+                                            out_xattrs, error);
+
+  gboolean is_packed = FALSE;
+  g_autoptr (GBytes) packed_data = NULL;
+  if (!_ostree_repo_pack_lookup (self, checksum, OSTREE_OBJECT_TYPE_FILE, &is_packed,
+                                 &packed_data, error))
+    return FALSE;
+
+  if (is_packed)
+    {
+      gsize size = g_bytes_get_size (packed_data);
+      g_autoptr (GInputStream) tmp_stream = g_memory_input_stream_new_from_bytes (packed_data);
+      /* Note return here */
+      return ostree_content_stream_parse (TRUE, tmp_stream, size, TRUE, out_input, out_file_info,
+                                          out_xattrs, cancellable, error);
+    }
   else if (self->parent_repo)
     {
       return ostree_repo_load_file (self->parent_repo, checksum, out_input, out_file_info,
@@ -4338,8 +4513,8 @@ ostree_repo_load_object_stream (OstreeRepo *self, OstreeObjectType objtype, cons
 
   if (OSTREE_OBJECT_TYPE_IS_META (objtype))
     {
-      if (!load_metadata_internal (self, objtype, checksum, TRUE, NULL, &ret_input, &size, NULL,
-                                   cancellable, error))
+      if (!load_metadata_internal (self, objtype, checksum, TRUE, TRUE, NULL, &ret_input, &size,
+                                   NULL, cancellable, error))
         return FALSE;
     }
   else
@@ -4367,6 +4542,8 @@ ostree_repo_load_object_stream (OstreeRepo *self, OstreeObjectType objtype, cons
  *
  * Locate object in repository; if it exists, @out_is_stored will be
  * set to TRUE.  @loose_path_buf is always set to the loose path.
+ * Objects stored in a pack file also count as stored, since they
+ * don't need to be written again.
  */
 gboolean
 _ostree_repo_has_loose_object (OstreeRepo *self, const char *checksum, OstreeObjectType objtype,
@@ -4400,6 +4577,18 @@ _ostree_repo_has_loose_object (OstreeRepo *self, const char *checksum, OstreeObj
         }
     }
 
+  if (!found)
+    {
+      if (!_ostree_repo_pack_lookup (self, checksum, objtype, &found, NULL, error))
+        return FALSE;
+    }
+
+  if (!found && objtype == OSTREE_OBJECT_TYPE_FILE)
+    {
+      if (!_ostree_repo_chunked_file_lookup (self, checksum, &found, NULL, error))
+        return FALSE;
+    }
+
   *out_is_stored = found;
   return TRUE;
 }
@@ -4428,8 +4617,6 @@ ostree_repo_has_object (OstreeRepo *self, OstreeObjectType objtype, const char *
                                       error))
     return FALSE;
 
-  /* In the future, here is where we would also look up in metadata pack files */
-
   if (!ret_have_object && self->parent_repo)
     {
       if (!ostree_repo_has_object (self->parent_repo, objtype, checksum, &ret_have_object,
@@ -4453,6 +4640,12 @@ ostree_repo_has_object (OstreeRepo *self, OstreeObjectType objtype, const char *
  * Remove the object of type @objtype with checksum @sha256
  * from the repository.  An error of type %G_IO_ERROR_NOT_FOUND
  * is thrown if the object does not exist.
+ *
+ * Removing an object stored in a pack file means rewriting the pack.  When
+ * called within a transaction, that is deferred until
+ * ostree_repo_commit_transaction(), which rewrites each pack once however
+ * many of its objects were deleted; the object is no longer found in the
+ * meantime, and stays in the pack if the transaction is aborted.
  */
 gboolean
 ostree_repo_delete_object (OstreeRepo *self, OstreeObjectType objtype, const char *sha256,
@@ -4461,6 +4654,9 @@ ostree_repo_delete_object (OstreeRepo *self, OstreeObjectType objtype, const cha
   char loose_path[_OSTREE_LOOSE_PATH_MAX];
   _ostree_loose_path (loose_path, sha256, objtype, self->mode);
 
+  if (_ostree_repo_metadata_cache_accepts (objtype))
+    _ostree_repo_metadata_cache_remove (self->metadata_cache, objtype, sha256);
+
   if (objtype == OSTREE_OBJECT_TYPE_COMMIT)
     {
       char meta_loose[_OSTREE_LOOSE_PATH_MAX];
@@ -4471,7 +4667,43 @@ ostree_repo_delete_object (OstreeRepo *self, OstreeObjectType objtype, const cha
         return FALSE;
     }
 
-  if (!glnx_unlinkat (self->objects_dir_fd, loose_path, 0, error))
+  gboolean is_chunked = FALSE;
+  if (objtype == OSTREE_OBJECT_TYPE_FILE
+      && !_ostree_repo_chunked_file_lookup (self, sha256, &is_chunked, NULL, error))
+    return FALSE;
+
+  gboolean is_packed = FALSE;
+  if (!_ostree_repo_pack_lookup (self, sha256, objtype, &is_packed, NULL, error))
+    return FALSE;
+
+  if (is_chunked)
+    {
+      /* The chunks are left for prune to remove once unused */
+      char chunked_path[_OSTREE_LOOSE_PATH_MAX];
+      _ostree_repo_chunked_file_path (chunked_path, sha256);
+      if (!glnx_unlinkat (self->objects_dir_fd, chunked_path, 0, error))
+        return glnx_prefix_error (error, "Deleting object %s.%s", sha256,
+                                  ostree_object_type_to_string (objtype));
+      if (!ot_ensure_unlinked_at (self->objects_dir_fd, loose_path, error))
+        return FALSE;
+    }
+  else if (is_packed)
+    {
+      if (self->in_transaction)
+        _ostree_repo_pack_queue_removal (self, sha256, objtype);
+      else
+        {
+          g_autoptr (GHashTable) objects = ostree_repo_traverse_new_reachable ();
+          g_hash_table_add (objects,
+                            g_variant_ref_sink (ostree_object_name_serialize (sha256, objtype)));
+          if (!_ostree_repo_pack_remove_objects (self, objects, cancellable, error))
+            return glnx_prefix_error (error, "Deleting object %s.%s", sha256,
+                                      ostree_object_type_to_string (objtype));
+        }
+      if (!ot_ensure_unlinked_at (self->objects_dir_fd, loose_path, error))
+        return FALSE;
+    }
+  else if (!glnx_unlinkat (self->objects_dir_fd, loose_path, 0, error))
     return glnx_prefix_error (error, "Deleting object %s.%s", sha256,
                               ostree_object_type_to_string (objtype));
 
@@ -4510,19 +4742,32 @@ fsck_metadata_object (OstreeRepo *self, OstreeObjectType objtype, const char *sh
   const char *errmsg = glnx_strjoina ("fsck ", sha256, ".", ostree_object_type_to_string (objtype));
   GLNX_AUTO_PREFIX_ERROR (errmsg, error);
   g_autoptr (GVariant) metadata = NULL;
-  if (!load_metadata_internal (self, objtype, sha256, TRUE, &metadata, NULL, NULL, NULL,
-                               cancellable, error))
+  if (!load_metadata_internal (self, objtype, sha256, TRUE, FALSE, &metadata, NULL, NULL,
+                               NULL, cancellable, error))
     return FALSE;
 
   return _ostree_verify_metadata_object (objtype, sha256, metadata, error);
 }
 
+/* Verify a content object; but if @out_buf is given and the object is no
+ * larger than @max_deferred_size, return the data covered by its checksum
+ * there instead, for the caller to verify together with others.
+ */
 static gboolean
-fsck_content_object (OstreeRepo *self, const char *sha256, GCancellable *cancellable,
-                     GError **error)
+fsck_content_object_maybe_deferred (OstreeRepo *self, const char *sha256,
+                                    gsize max_deferred_size, GBytes **out_buf,
+                                    GCancellable *cancellable, GError **error)
 {
   const char *errmsg = glnx_strjoina ("fsck content object ", sha256);
   GLNX_AUTO_PREFIX_ERROR (errmsg, error);
+
+  /* If the kernel vouches for the content, there's no need to read it */
+  gboolean verified = FALSE;
+  if (!_ostree_repo_fsverity_verify_content (self, sha256, &verified, cancellable, error))
+    return FALSE;
+  if (verified)
+    return TRUE;
+
   g_autoptr (GInputStream) input = NULL;
   g_autoptr (GFileInfo) file_info = NULL;
   g_autoptr (GVariant) xattrs = NULL;
@@ -4535,6 +4780,27 @@ fsck_content_object (OstreeRepo *self, const char *sha256, GCancellable *cancell
   if (!ostree_validate_structureof_file_mode (mode, error))
     return FALSE;
 
+  const GFileType file_type = g_file_info_get_file_type (file_info);
+  if (out_buf
+      && (file_type == G_FILE_TYPE_SYMBOLIC_LINK
+          || (file_type == G_FILE_TYPE_REGULAR
+              && (guint64)g_file_info_get_size (file_info) <= max_deferred_size)))
+    {
+      /* Same as ostree_checksum_file_from_input() */
+      g_autoptr (GBytes) header = _ostree_file_header_new (file_info, xattrs);
+      g_autoptr (GOutputStream) buf = g_memory_output_stream_new_resizable ();
+      if (!g_output_stream_write_all (buf, g_bytes_get_data (header, NULL),
+                                      g_bytes_get_size (header), NULL, cancellable, error))
+        return FALSE;
+      if (file_type == G_FILE_TYPE_REGULAR
+          && g_output_stream_splice (buf, input, 0, cancellable, error) < 0)
+        return FALSE;
+      if (!g_output_stream_close (buf, cancellable, error))
+        return FALSE;
+      *out_buf = g_memory_output_stream_steal_as_bytes ((GMemoryOutputStream *)buf);
+      return TRUE;
+    }
+
   g_autofree guchar *computed_csum = NULL;
   if (!ostree_checksum_file_from_input (file_info, xattrs, input, OSTREE_OBJECT_TYPE_FILE,
                                         &computed_csum, cancellable, error))
@@ -4545,6 +4811,13 @@ fsck_content_object (OstreeRepo *self, const char *sha256, GCancellable *cancell
   return _ostree_compare_object_checksum (OSTREE_OBJECT_TYPE_FILE, sha256, actual_checksum, error);
 }
 
+static gboolean
+fsck_content_object (OstreeRepo *self, const char *sha256, GCancellable *cancellable,
+                     GError **error)
+{
+  return fsck_content_object_maybe_deferred (self, sha256, 0, NULL, cancellable, error);
+}
+
 /**
  * ostree_repo_fsck_object:
  * @self: Repo
@@ -4569,6 +4842,332 @@ ostree_repo_fsck_object (OstreeRepo *self, OstreeObjectType objtype, const char
     return fsck_content_object (self, sha256, cancellable, error);
 }
 
+typedef struct
+{
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  OstreeObjectType objtype;
+  OstreeRepoFsckJournalRecord record;
+  GError *error;
+} FsckObjectJob;
+
+/* Objects are verified in batches, so that small ones can be checksummed
+ * together with ot_checksum_many().
+ */
+#define FSCK_BATCH_SIZE 16
+#define FSCK_MAX_BATCHED_CONTENT_SIZE (16 * 1024)
+
+typedef struct
+{
+  guint n_jobs;
+  FsckObjectJob jobs[FSCK_BATCH_SIZE];
+} FsckObjectBatch;
+
+typedef struct
+{
+  OstreeRepo *repo;
+  OstreeRepoFsckJournal *journal;
+  GCancellable *cancellable;
+  GAsyncQueue *results;
+} FsckObjectsPool;
+
+/* Start verifying one object, unless the journal says it hasn't changed
+ * since it was last verified.  Returns the data covered by the object's
+ * checksum if it's left for the caller to check.
+ */
+static GBytes *
+fsck_objects_start_job (FsckObjectsPool *fpool, FsckObjectJob *job, GVariant **out_metadata)
+{
+  if (fpool->journal)
+    {
+      gboolean current = FALSE;
+      if (!_ostree_repo_fsck_journal_check (fpool->journal, job->checksum, job->objtype,
+                                            &job->record, &current, &job->error))
+        return NULL;
+      if (current)
+        return NULL;
+    }
+
+  if (OSTREE_OBJECT_TYPE_IS_META (job->objtype))
+    {
+      g_autoptr (GVariant) metadata = NULL;
+      if (!load_metadata_internal (fpool->repo, job->objtype, job->checksum, TRUE, FALSE,
+                                   &metadata, NULL, NULL, NULL, fpool->cancellable,
+                                   &job->error)
+          || !ot_variant_get_data (metadata, &job->error))
+        {
+          g_prefix_error (&job->error, "fsck %s.%s: ", job->checksum,
+                          ostree_object_type_to_string (job->objtype));
+          return NULL;
+        }
+      *out_metadata = g_steal_pointer (&metadata);
+      return g_variant_get_data_as_bytes (*out_metadata);
+    }
+  else
+    {
+      g_autoptr (GBytes) buf = NULL;
+      (void)fsck_content_object_maybe_deferred (fpool->repo, job->checksum,
+                                                FSCK_MAX_BATCHED_CONTENT_SIZE, &buf,
+                                                fpool->cancellable, &job->error);
+      return g_steal_pointer (&buf);
+    }
+}
+
+/* Verify each object of @batch, setting its error if it's broken */
+static void
+fsck_objects_run_batch (FsckObjectsPool *fpool, FsckObjectBatch *batch)
+{
+  GBytes *bufs[FSCK_BATCH_SIZE] = {
+    NULL,
+  };
+  GVariant *metadata[FSCK_BATCH_SIZE] = {
+    NULL,
+  };
+  const guint8 *datas[FSCK_BATCH_SIZE];
+  gsize lens[FSCK_BATCH_SIZE];
+  guint indexes[FSCK_BATCH_SIZE];
+  guint n_pending = 0;
+
+  for (guint i = 0; i < batch->n_jobs; i++)
+    {
+      bufs[i] = fsck_objects_start_job (fpool, &batch->jobs[i], &metadata[i]);
+      if (bufs[i] == NULL)
+        continue;
+      datas[n_pending] = g_bytes_get_data (bufs[i], &lens[n_pending]);
+      indexes[n_pending] = i;
+      n_pending++;
+    }
+
+  guint8 digests[FSCK_BATCH_SIZE * OSTREE_SHA256_DIGEST_LEN];
+  ot_checksum_many (datas, lens, n_pending, digests);
+
+  for (guint i = 0; i < n_pending; i++)
+    {
+      const guint j = indexes[i];
+      FsckObjectJob *job = &batch->jobs[j];
+      char actual_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      ostree_checksum_inplace_from_bytes (digests + i * OSTREE_SHA256_DIGEST_LEN, actual_checksum);
+      if (metadata[j])
+        {
+          if (!_ostree_verify_checksummed_metadata_object (job->objtype, job->checksum,
+                                                           actual_checksum, metadata[j],
+                                                           &job->error))
+            g_prefix_error (&job->error, "fsck %s.%s: ", job->checksum,
+                            ostree_object_type_to_string (job->objtype));
+        }
+      else if (!_ostree_compare_object_checksum (job->objtype, job->checksum, actual_checksum,
+                                                 &job->error))
+        g_prefix_error (&job->error, "fsck content object %s: ", job->checksum);
+    }
+
+  for (guint i = 0; i < batch->n_jobs; i++)
+    {
+      g_clear_pointer (&bufs[i], g_bytes_unref);
+      g_clear_pointer (&metadata[i], g_variant_unref);
+    }
+}
+
+static void
+fsck_objects_worker (gpointer data, gpointer user_data)
+{
+  FsckObjectBatch *batch = data;
+  FsckObjectsPool *fpool = user_data;
+
+  fsck_objects_run_batch (fpool, batch);
+  g_async_queue_push (fpool->results, batch);
+}
+
+/* Hand one verification result back to the caller; cancellation is never
+ * reported as a broken object.
+ */
+static gboolean
+fsck_objects_report (FsckObjectsPool *fpool, FsckObjectJob *job,
+                     OstreeRepoFsckObjectCallback callback, gpointer user_data, GError **error)
+{
+  if (job->error && g_error_matches (job->error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_propagate_error (error, g_error_copy (job->error));
+      return FALSE;
+    }
+
+  if (!callback (fpool->repo, job->checksum, job->objtype, job->error, user_data, error))
+    return FALSE;
+
+  if (fpool->journal && job->error == NULL)
+    _ostree_repo_fsck_journal_add (fpool->journal, &job->record);
+  return TRUE;
+}
+
+/* Report every result of @batch, stopping at the first failure, and free
+ * the errors.
+ */
+static gboolean
+fsck_objects_report_batch (FsckObjectsPool *fpool, FsckObjectBatch *batch,
+                           OstreeRepoFsckObjectCallback callback, gpointer user_data,
+                           GError **error)
+{
+  gboolean ret = TRUE;
+  for (guint i = 0; i < batch->n_jobs; i++)
+    {
+      FsckObjectJob *job = &batch->jobs[i];
+      if (ret && !fsck_objects_report (fpool, job, callback, user_data, error))
+        ret = FALSE;
+      g_clear_error (&job->error);
+    }
+  return ret;
+}
+
+/* Fill @batch with the next objects from @hashiter; returns %FALSE if
+ * there were none left.
+ */
+static gboolean
+fsck_object_batch_fill (FsckObjectBatch *batch, GHashTableIter *hashiter)
+{
+  gpointer key;
+  memset (batch, 0, sizeof (*batch));
+  while (batch->n_jobs < FSCK_BATCH_SIZE && g_hash_table_iter_next (hashiter, &key, NULL))
+    {
+      FsckObjectJob *job = &batch->jobs[batch->n_jobs++];
+      const char *checksum;
+      ostree_object_name_deserialize (key, &checksum, &job->objtype);
+      memcpy (job->checksum, checksum, sizeof (job->checksum));
+    }
+  return batch->n_jobs > 0;
+}
+
+/**
+ * ostree_repo_fsck_objects:
+ * @self: Repo
+ * @objects: (element-type GVariant GVariant): Set of serialized object names to verify
+ * @options: (nullable): A GVariant `a{sv}` with an extensible set of flags
+ * @callback: (scope call): Invoked with the result for each object
+ * @user_data: User data for @callback
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Verify each object in @objects as ostree_repo_fsck_object() does.
+ * @callback is invoked on the calling thread for every object, in
+ * completion order, with the verification error if any; it is responsible
+ * for deciding whether a broken object is fatal, and may modify the
+ * repository (for example to delete the object).  If @callback returns
+ * %FALSE, outstanding verifications are waited for and its error is
+ * returned.
+ *
+ * The following options are understood:
+ *
+ *   - n-jobs: u: Number of worker threads; 0 or 1 means no threads.
+ *     Defaults to 1.
+ *   - journal: b: Skip objects which are unchanged on disk since they were
+ *     last verified, according to the fsck journal, and record objects
+ *     which pass verification in it.  The journal only lists objects
+ *     which were checked in the last such run.  Defaults to %FALSE.
+ *   - journal-max-age: t: With `journal`, verify objects again once this
+ *     many seconds have passed since they were last verified, whether or
+ *     not they changed.  Defaults to no limit.
+ *
+ * Returns: %TRUE if every object was reported and @callback never failed
+ *
+ * Since: 2026.5
+ */
+gboolean
+ostree_repo_fsck_objects (OstreeRepo *self, GHashTable *objects, GVariant *options,
+                          OstreeRepoFsckObjectCallback callback, gpointer user_data,
+                          GCancellable *cancellable, GError **error)
+{
+  g_return_val_if_fail (callback != NULL, FALSE);
+
+  guint n_jobs = 1;
+  gboolean use_journal = FALSE;
+  guint64 journal_max_age = G_MAXUINT64;
+  if (options)
+    {
+      (void)g_variant_lookup (options, "n-jobs", "u", &n_jobs);
+      (void)g_variant_lookup (options, "journal", "b", &use_journal);
+      (void)g_variant_lookup (options, "journal-max-age", "t", &journal_max_age);
+    }
+  n_jobs = MAX (n_jobs, 1);
+
+  g_autoptr (OstreeRepoFsckJournal) journal = NULL;
+  if (use_journal && !_ostree_repo_fsck_journal_load (self, journal_max_age, &journal, error))
+    return FALSE;
+
+  g_autoptr (GAsyncQueue) results = g_async_queue_new ();
+  FsckObjectsPool fpool = { self, journal, cancellable, results };
+
+  GHashTableIter hashiter;
+  g_hash_table_iter_init (&hashiter, objects);
+
+  if (n_jobs == 1)
+    {
+      FsckObjectBatch batch;
+      while (fsck_object_batch_fill (&batch, &hashiter))
+        {
+          fsck_objects_run_batch (&fpool, &batch);
+          if (!fsck_objects_report_batch (&fpool, &batch, callback, user_data, error))
+            return FALSE;
+        }
+    }
+  else
+    {
+      GThreadPool *pool = g_thread_pool_new (fsck_objects_worker, &fpool, n_jobs, FALSE, error);
+      if (!pool)
+        return FALSE;
+
+      /* Keep a bounded number of objects queued, so that results (and any
+       * deletions done by @callback) track verification progress.
+       */
+      const guint max_outstanding = n_jobs * 2;
+      guint n_outstanding = 0;
+      gboolean more = TRUE;
+      g_autoptr (GError) local_error = NULL;
+      while (TRUE)
+        {
+          while (more && local_error == NULL && n_outstanding < max_outstanding)
+            {
+              FsckObjectBatch *batch = g_new (FsckObjectBatch, 1);
+              if (!fsck_object_batch_fill (batch, &hashiter))
+                {
+                  g_free (batch);
+                  more = FALSE;
+                  break;
+                }
+              if (!g_thread_pool_push (pool, batch, &local_error))
+                {
+                  g_free (batch);
+                  break;
+                }
+              n_outstanding++;
+            }
+
+          if (n_outstanding == 0)
+            break;
+
+          FsckObjectBatch *batch = g_async_queue_pop (results);
+          n_outstanding--;
+          if (local_error == NULL)
+            (void)fsck_objects_report_batch (&fpool, batch, callback, user_data, &local_error);
+          else
+            {
+              for (guint i = 0; i < batch->n_jobs; i++)
+                g_clear_error (&batch->jobs[i].error);
+            }
+          g_free (batch);
+        }
+
+      g_thread_pool_free (pool, FALSE, TRUE);
+
+      if (local_error)
+        {
+          g_propagate_error (error, g_steal_pointer (&local_error));
+          return FALSE;
+        }
+    }
+
+  if (journal && !_ostree_repo_fsck_journal_write (journal, cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
+
 /**
  * ostree_repo_import_object_from:
  * @self: Destination repo
@@ -4651,6 +5250,30 @@ ostree_repo_query_object_storage_size (OstreeRepo *self, OstreeObjectType objtyp
     res = TEMP_FAILURE_RETRY (
         fstatat (self->commit_stagedir.fd, loose_path, &stbuf, AT_SYMLINK_NOFOLLOW));
 
+  if (res < 0 && errno == ENOENT && objtype == OSTREE_OBJECT_TYPE_FILE)
+    {
+      gboolean is_chunked = FALSE;
+      if (!_ostree_repo_chunked_file_lookup (self, sha256, &is_chunked, NULL, error))
+        return FALSE;
+      if (is_chunked)
+        return _ostree_repo_chunked_file_storage_size (self, sha256, out_size, error);
+      errno = ENOENT;
+    }
+
+  if (res < 0 && errno == ENOENT)
+    {
+      gboolean is_packed = FALSE;
+      g_autoptr (GBytes) packed_data = NULL;
+      if (!_ostree_repo_pack_lookup (self, sha256, objtype, &is_packed, &packed_data, error))
+        return FALSE;
+      if (is_packed)
+        {
+          *out_size = g_bytes_get_size (packed_data);
+          return TRUE;
+        }
+      errno = ENOENT;
+    }
+
   if (res < 0)
     return glnx_throw_errno_prefix (error, "Querying object %s.%s", sha256,
                                     ostree_object_type_to_string (objtype));
@@ -4676,8 +5299,8 @@ gboolean
 ostree_repo_load_variant_if_exists (OstreeRepo *self, OstreeObjectType objtype, const char *sha256,
                                     GVariant **out_variant, GError **error)
 {
-  return load_metadata_internal (self, objtype, sha256, FALSE, out_variant, NULL, NULL, NULL, NULL,
-                                 error);
+  return load_metadata_internal (self, objtype, sha256, FALSE, TRUE, out_variant, NULL, NULL, NULL,
+                                 NULL, error);
 }
 
 /**
@@ -4695,8 +5318,8 @@ gboolean
 ostree_repo_load_variant (OstreeRepo *self, OstreeObjectType objtype, const char *sha256,
                           GVariant **out_variant, GError **error)
 {
-  return load_metadata_internal (self, objtype, sha256, TRUE, out_variant, NULL, NULL, NULL, NULL,
-                                 error);
+  return load_metadata_internal (self, objtype, sha256, TRUE, TRUE, out_variant, NULL, NULL, NULL,
+                                 NULL, error);
 }
 
 /**
@@ -4716,8 +5339,8 @@ gboolean
 ostree_repo_load_commit (OstreeRepo *self, const char *checksum, GVariant **out_variant,
                          OstreeRepoCommitState *out_state, GError **error)
 {
-  return load_metadata_internal (self, OSTREE_OBJECT_TYPE_COMMIT, checksum, TRUE, out_variant, NULL,
-                                 NULL, out_state, NULL, error);
+  return load_metadata_internal (self, OSTREE_OBJECT_TYPE_COMMIT, checksum, TRUE, TRUE,
+                                 out_variant, NULL, NULL, out_state, NULL, error);
 }
 
 static GHashTable *
@@ -4748,7 +5371,15 @@ repo_list_objects_impl (OstreeRepo *self, OstreeRepoListObjectsFlags flags, GVar
 
   if (flags & OSTREE_REPO_LIST_OBJECTS_PACKED)
     {
-      /* Nothing for now... */
+      if (!_ostree_repo_list_packed_objects (self, dummy_value != NULL, ret_objects, cancellable,
+                                             error))
+        return FALSE;
+      if ((flags & OSTREE_REPO_LIST_OBJECTS_NO_PARENTS) == 0 && self->parent_repo)
+        {
+          if (!_ostree_repo_list_packed_objects (self->parent_repo, dummy_value != NULL,
+                                                 ret_objects, cancellable, error))
+            return FALSE;
+        }
     }
 
   return g_steal_pointer (&ret_objects);
@@ -4764,9 +5395,9 @@ ostree_repo_list_objects_set (OstreeRepo *self, OstreeRepoListObjectsFlags flags
   return repo_list_objects_impl (self, flags, NULL, cancellable, error);
 }
 
-/* For unfortunate historical reasons we emit this dummy value.
- * It was intended to provide additional information about the object (e.g. "is in a pack file")
- * but we ended up not shipping pack files.
+/* For unfortunate historical reasons we emit this dummy value for loose
+ * objects; objects only found in a pack file are reported as
+ * (FALSE, [pack name]) instead.
  */
 static GVariant *
 get_dummy_list_objects_variant (void)
@@ -5321,7 +5952,7 @@ ostree_repo_sign_delta (OstreeRepo *self, const gchar *from_commit, const gchar
   return FALSE;
 }
 
-static gboolean
+gboolean
 _ostree_repo_add_gpg_signature_summary_at (OstreeRepo *self, int dir_fd, const gchar **key_id,
                                            const gchar *homedir, GCancellable *cancellable,
                                            GError **error)
@@ -5872,11 +6503,9 @@ ostree_repo_verify_local_summary (OstreeRepo *self, GBytes *summary, GBytes *sig
  * @refs_builder to go into a `summary` file. This includes building the
  * standard additional metadata keys for the ref. */
 static gboolean
-summary_add_ref_entry (OstreeRepo *self, const char *ref, const char *checksum,
-                       GVariantBuilder *refs_builder, GError **error)
+summary_add_ref_entry (OstreeRepo *self, OstreeRepoSummaryState *state, const char *ref,
+                       const char *checksum, GVariantBuilder *refs_builder, GError **error)
 {
-  g_auto (GVariantDict) commit_metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
-
   g_assert (ref);
   g_assert (checksum);
 
@@ -5888,29 +6517,16 @@ summary_add_ref_entry (OstreeRepo *self, const char *ref, const char *checksum,
   if (remotename != NULL)
     return TRUE;
 
-  g_autoptr (GVariant) commit_obj = NULL;
-  if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_COMMIT, checksum, &commit_obj, error))
+  guint64 commit_size;
+  g_autoptr (GVariant) commit_metadata = NULL;
+  if (!_ostree_repo_summary_state_get_commit (self, state, checksum, &commit_size,
+                                              &commit_metadata, error))
     return FALSE;
-  g_autoptr (GVariant) orig_metadata = g_variant_get_child_value (commit_obj, 0);
-
-  g_variant_dict_init (&commit_metadata_builder, NULL);
-
-  /* Forward the commit’s timestamp and version if they're valid. */
-  guint64 commit_timestamp = ostree_commit_get_timestamp (commit_obj);
-  g_autoptr (GDateTime) dt = g_date_time_new_from_unix_utc (commit_timestamp);
 
-  if (dt != NULL)
-    g_variant_dict_insert_value (&commit_metadata_builder, OSTREE_COMMIT_TIMESTAMP,
-                                 g_variant_new_uint64 (GUINT64_TO_BE (commit_timestamp)));
-
-  const char *version = NULL;
-  if (g_variant_lookup (orig_metadata, OSTREE_COMMIT_META_KEY_VERSION, "&s", &version))
-    g_variant_dict_insert (&commit_metadata_builder, OSTREE_COMMIT_VERSION, "s", version);
-
-  g_variant_builder_add_value (
-      refs_builder, g_variant_new ("(s(t@ay@a{sv}))", ref, (guint64)g_variant_get_size (commit_obj),
-                                   ostree_checksum_to_bytes_v (checksum),
-                                   g_variant_dict_end (&commit_metadata_builder)));
+  g_variant_builder_add_value (refs_builder,
+                               g_variant_new ("(s(t@ay@a{sv}))", ref, commit_size,
+                                              ostree_checksum_to_bytes_v (checksum),
+                                              commit_metadata));
 
   return TRUE;
 }
@@ -6008,6 +6624,11 @@ regenerate_metadata (OstreeRepo *self, gboolean do_metadata_commit, GVariant *ad
         return FALSE;
     }
 
+  /* Only read the commits and deltas which changed since the last time */
+  g_autoptr (OstreeRepoSummaryState) summary_state = NULL;
+  if (!_ostree_repo_summary_state_load (self, &summary_state, error))
+    return FALSE;
+
   g_auto (GVariantDict) additional_metadata_builder = OT_VARIANT_BUILDER_INITIALIZER;
   g_variant_dict_init (&additional_metadata_builder, additional_metadata);
   g_autoptr (GVariantBuilder) refs_builder
@@ -6028,7 +6649,7 @@ regenerate_metadata (OstreeRepo *self, gboolean do_metadata_commit, GVariant *ad
             const char *ref = iter->data;
             const char *commit = g_hash_table_lookup (refs, ref);
 
-            if (!summary_add_ref_entry (self, ref, commit, refs_builder, error))
+            if (!summary_add_ref_entry (self, summary_state, ref, commit, refs_builder, error))
               return FALSE;
           }
       }
@@ -6056,8 +6677,8 @@ regenerate_metadata (OstreeRepo *self, gboolean do_metadata_commit, GVariant *ad
           if (!_ostree_parse_delta_name (delta_names->pdata[i], &from, &to, error))
             return FALSE;
 
-          digest = _ostree_repo_static_delta_superblock_digest (
-              self, (from && from[0]) ? from : NULL, to, cancellable, error);
+          digest = _ostree_repo_summary_state_get_delta_digest (
+              self, summary_state, (from && from[0]) ? from : NULL, to, cancellable, error);
           if (digest == NULL)
             return FALSE;
 
@@ -6096,6 +6717,39 @@ regenerate_metadata (OstreeRepo *self, gboolean do_metadata_commit, GVariant *ad
   g_variant_dict_insert_value (&additional_metadata_builder, OSTREE_SUMMARY_INDEXED_DELTAS,
                                g_variant_new_boolean (TRUE));
 
+  guint64 summary_diffs = 0;
+  {
+    g_autofree char *summary_diffs_str = NULL;
+    if (!ot_keyfile_get_value_with_default (self->config, "core", "summary-diffs", "0",
+                                            &summary_diffs_str, error))
+      return FALSE;
+    if (!g_ascii_string_to_unsigned (summary_diffs_str, 10, 0, G_MAXUINT32, &summary_diffs, error))
+      return glnx_prefix_error (error, "Invalid core.summary-diffs");
+    /* Tell clients which cache this summary that they can ask for diffs from it */
+    if (summary_diffs > 0)
+      g_variant_dict_insert_value (&additional_metadata_builder, OSTREE_SUMMARY_DIFFS,
+                                   g_variant_new_boolean (TRUE));
+  }
+
+  {
+    g_autoptr (GVariant) pack_names = _ostree_repo_list_pack_names (self, error);
+    if (!pack_names)
+      return FALSE;
+    if (g_variant_n_children (pack_names) > 0)
+      g_variant_dict_insert_value (&additional_metadata_builder, OSTREE_SUMMARY_PACKS,
+                                   pack_names);
+  }
+
+  /* Tell clients to look for chunked objects where loose ones are missing */
+  if (self->mode == OSTREE_REPO_MODE_ARCHIVE)
+    {
+      if (!glnx_fstatat_allow_noent (self->objects_dir_fd, _OSTREE_CHUNK_DIR, NULL, 0, error))
+        return FALSE;
+      if (errno == 0)
+        g_variant_dict_insert_value (&additional_metadata_builder, OSTREE_SUMMARY_CHUNKED_FILES,
+                                     g_variant_new_boolean (TRUE));
+    }
+
   /* Add refs which have a collection specified, which could be in refs/mirrors,
    * refs/heads, and/or refs/remotes. */
   {
@@ -6160,7 +6814,7 @@ regenerate_metadata (OstreeRepo *self, gboolean do_metadata_commit, GVariant *ad
             GVariantBuilder *builder
                 = is_main_collection_id ? refs_builder : collection_refs_builder;
 
-            if (!summary_add_ref_entry (self, ref, commit, builder, error))
+            if (!summary_add_ref_entry (self, summary_state, ref, commit, builder, error))
               return FALSE;
 
             if (!is_main_collection_id)
@@ -6194,7 +6848,10 @@ regenerate_metadata (OstreeRepo *self, gboolean do_metadata_commit, GVariant *ad
     g_variant_ref_sink (summary);
   }
 
-  if (!ostree_repo_static_delta_reindex (self, 0, NULL, cancellable, error))
+  if (!_ostree_repo_static_delta_reindex (self, summary_state, NULL, cancellable, error))
+    return FALSE;
+
+  if (!_ostree_repo_summary_state_save (self, summary_state, cancellable, error))
     return FALSE;
 
   /* Create the summary and signature in a temporary directory so that
@@ -6238,6 +6895,14 @@ regenerate_metadata (OstreeRepo *self, gboolean do_metadata_commit, GVariant *ad
         return glnx_throw_errno_prefix (error, "Unable to change summary timestamps");
     }
 
+  if (!_ostree_repo_update_summary_diffs (self, summary, summary_diffs, cancellable, error))
+    return FALSE;
+
+  if (!_ostree_repo_update_summary_index (self, summary, summary_tmpdir.fd,
+                                          (const char *const *)gpg_key_ids, gpg_homedir, sign,
+                                          sign_keys, cancellable, error))
+    return FALSE;
+
   /* Rename them into place */
   if (!glnx_renameat (summary_tmpdir.fd, "summary", self->repo_dir_fd, "summary", error))
     return glnx_prefix_error (error, "Unable to rename summary file: ");
@@ -113,6 +113,10 @@ _OSTREE_PUBLIC
 gboolean ostree_repo_get_min_free_space_bytes (OstreeRepo *self, guint64 *out_reserved_bytes,
                                                GError **error);
 _OSTREE_PUBLIC
+void ostree_repo_get_metadata_cache_stats (OstreeRepo *self, guint64 *out_hits,
+                                           guint64 *out_misses, guint64 *out_evictions,
+                                           guint64 *out_size);
+_OSTREE_PUBLIC
 GKeyFile *ostree_repo_get_config (OstreeRepo *self);
 
 _OSTREE_PUBLIC
@@ -484,6 +488,31 @@ _OSTREE_PUBLIC
 gboolean ostree_repo_fsck_object (OstreeRepo *self, OstreeObjectType objtype, const char *sha256,
                                   GCancellable *cancellable, GError **error);
 
+/**
+ * OstreeRepoFsckObjectCallback:
+ * @repo: Repo
+ * @checksum: Object checksum
+ * @objtype: Object type
+ * @fsck_error: (nullable): Why the object failed verification, or %NULL if it is valid
+ * @user_data: User data
+ * @error: Error
+ *
+ * See ostree_repo_fsck_objects().
+ *
+ * Returns: %TRUE to continue verifying, %FALSE (with @error set) to stop
+ *
+ * Since: 2026.5
+ */
+typedef gboolean (*OstreeRepoFsckObjectCallback) (OstreeRepo *repo, const char *checksum,
+                                                  OstreeObjectType objtype,
+                                                  const GError *fsck_error, gpointer user_data,
+                                                  GError **error);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_fsck_objects (OstreeRepo *self, GHashTable *objects, GVariant *options,
+                                   OstreeRepoFsckObjectCallback callback, gpointer user_data,
+                                   GCancellable *cancellable, GError **error);
+
 /**
  * OstreeRepoCommitFilterResult:
  * @OSTREE_REPO_COMMIT_FILTER_ALLOW: Do commit this object
@@ -579,6 +608,9 @@ _OSTREE_PUBLIC
 void ostree_repo_commit_modifier_set_devino_cache (OstreeRepoCommitModifier *modifier,
                                                    OstreeRepoDevInoCache *cache);
 
+_OSTREE_PUBLIC
+void ostree_repo_commit_modifier_set_n_jobs (OstreeRepoCommitModifier *modifier, guint n_jobs);
+
 _OSTREE_PUBLIC
 OstreeRepoCommitModifier *ostree_repo_commit_modifier_ref (OstreeRepoCommitModifier *modifier);
 _OSTREE_PUBLIC
@@ -817,7 +849,12 @@ typedef struct
 
   OstreeRepoDevInoCache *devino_to_csum_cache;
 
-  int unused_ints[6];
+  /* Since: 2026.5.  Number of threads to check out directories with; 0 and
+   * 1 check out serially.  Checkouts with a filter, a sepolicy or
+   * process_whiteouts are always serial.
+   */
+  int n_jobs;
+  int unused_ints[5];
   gpointer unused_ptrs[3];
   OstreeRepoCheckoutFilter filter; /* Since: 2018.2 */
   gpointer filter_user_data;       /* Since: 2018.2 */
@@ -993,6 +1030,68 @@ gboolean ostree_repo_traverse_commit_with_flags (OstreeRepo *repo,
                                                  GHashTable *inout_parents,
                                                  GCancellable *cancellable, GError **error);
 
+_OSTREE_PUBLIC
+GType ostree_repo_object_set_get_type (void);
+
+_OSTREE_PUBLIC
+OstreeRepoObjectSet *ostree_repo_object_set_new (void);
+
+_OSTREE_PUBLIC
+OstreeRepoObjectSet *ostree_repo_object_set_ref (OstreeRepoObjectSet *set);
+
+_OSTREE_PUBLIC
+void ostree_repo_object_set_unref (OstreeRepoObjectSet *set);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_object_set_add (OstreeRepoObjectSet *set, const char *checksum,
+                                     OstreeObjectType objtype);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_object_set_add_bytes (OstreeRepoObjectSet *set, const guint8 *csum,
+                                           OstreeObjectType objtype);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_object_set_contains (OstreeRepoObjectSet *set, const char *checksum,
+                                          OstreeObjectType objtype);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_object_set_contains_bytes (OstreeRepoObjectSet *set, const guint8 *csum,
+                                                OstreeObjectType objtype);
+
+_OSTREE_PUBLIC
+guint ostree_repo_object_set_size (OstreeRepoObjectSet *set);
+
+/**
+ * OstreeRepoObjectSetIter:
+ *
+ * An iterator over an #OstreeRepoObjectSet; see
+ * ostree_repo_object_set_iter_init().
+ *
+ * Since: 2026.5
+ */
+typedef struct
+{
+  /*< private >*/
+  OstreeRepoObjectSet *set;
+  gsize index;
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  gpointer padding[4];
+} OstreeRepoObjectSetIter;
+
+_OSTREE_PUBLIC
+void ostree_repo_object_set_iter_init (OstreeRepoObjectSetIter *iter, OstreeRepoObjectSet *set);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_object_set_iter_next (OstreeRepoObjectSetIter *iter,
+                                           const char **out_checksum,
+                                           OstreeObjectType *out_objtype);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_traverse_commit_set (OstreeRepo *repo, OstreeRepoCommitTraverseFlags flags,
+                                          const char *commit_checksum, int maxdepth,
+                                          OstreeRepoObjectSet *inout_reachable,
+                                          GCancellable *cancellable, GError **error);
+
 struct _OstreeRepoCommitTraverseIter
 {
   gboolean initialized;
@@ -1097,6 +1196,14 @@ gboolean ostree_repo_prune_from_reachable (OstreeRepo *self, OstreeRepoPruneOpti
                                            guint64 *out_pruned_object_size_total,
                                            GCancellable *cancellable, GError **error);
 
+_OSTREE_PUBLIC
+gboolean ostree_repo_pack_objects (OstreeRepo *self, guint *out_n_packed,
+                                   GCancellable *cancellable, GError **error);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_chunk_objects (OstreeRepo *self, guint64 min_size, guint *out_n_chunked,
+                                    GCancellable *cancellable, GError **error);
+
 /**
  * OstreeRepoPullFlags:
  * @OSTREE_REPO_PULL_FLAGS_NONE: No special options for pull
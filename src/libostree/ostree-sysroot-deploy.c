@@ -630,7 +630,10 @@ checkout_deployment_tree (OstreeSysroot *sysroot, OstreeRepo *repo, const char *
     return FALSE;
 
   /* Generate hardlink farm, then opendir it */
-  OstreeRepoCheckoutAtOptions checkout_opts = { .process_passthrough_whiteouts = TRUE };
+  OstreeRepoCheckoutAtOptions checkout_opts = {
+    .process_passthrough_whiteouts = TRUE,
+    .n_jobs = repo->checkout_n_jobs,
+  };
 
   guint64 checkout_start_time = g_get_monotonic_time ();
   if (!ostree_repo_checkout_at (repo, &checkout_opts, osdeploy_dfd, checkout_target_name, csum,
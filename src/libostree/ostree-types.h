@@ -31,6 +31,7 @@ G_BEGIN_DECLS
 
 typedef struct OstreeRepo OstreeRepo;
 typedef struct OstreeRepoDevInoCache OstreeRepoDevInoCache;
+typedef struct OstreeRepoObjectSet OstreeRepoObjectSet;
 typedef struct OstreeSePolicy OstreeSePolicy;
 typedef struct OstreeSysroot OstreeSysroot;
 typedef struct OstreeSysrootUpgrader OstreeSysrootUpgrader;
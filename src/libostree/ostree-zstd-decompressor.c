@@ -0,0 +1,176 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ostree-zstd-decompressor.h"
+
+#include <zstd.h>
+
+/* Cap the decoder window at 128 MiB, the same bound zstd applies by default
+ * and enough for the compressor's long-range mode.  Like the LZMA memory
+ * limit, this keeps crafted static delta content from exhausting memory.
+ */
+#define OSTREE_ZSTD_DECODER_WINDOW_LOG_MAX 27
+
+/**
+ * SECTION:ostree-zstd-decompressor
+ * @title: Zstandard decompressor
+ *
+ * An implementation of #GConverter that decompresses data using
+ * zstd, optionally with a dictionary.
+ */
+
+static void _ostree_zstd_decompressor_iface_init (GConverterIface *iface);
+
+struct _OstreeZstdDecompressor
+{
+  GObject parent_instance;
+
+  GBytes *dictionary;
+  ZSTD_DCtx *dctx;
+};
+
+G_DEFINE_TYPE_WITH_CODE (OstreeZstdDecompressor, _ostree_zstd_decompressor, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER,
+                                                _ostree_zstd_decompressor_iface_init))
+
+static void
+_ostree_zstd_decompressor_finalize (GObject *object)
+{
+  OstreeZstdDecompressor *self = OSTREE_ZSTD_DECOMPRESSOR (object);
+
+  g_clear_pointer (&self->dctx, ZSTD_freeDCtx);
+  g_clear_pointer (&self->dictionary, g_bytes_unref);
+
+  G_OBJECT_CLASS (_ostree_zstd_decompressor_parent_class)->finalize (object);
+}
+
+static void
+_ostree_zstd_decompressor_init (OstreeZstdDecompressor *self)
+{
+}
+
+static void
+_ostree_zstd_decompressor_class_init (OstreeZstdDecompressorClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = _ostree_zstd_decompressor_finalize;
+}
+
+OstreeZstdDecompressor *
+_ostree_zstd_decompressor_new (GBytes *dictionary)
+{
+  OstreeZstdDecompressor *self = g_object_new (OSTREE_TYPE_ZSTD_DECOMPRESSOR, NULL);
+  if (dictionary)
+    self->dictionary = g_bytes_ref (dictionary);
+  return self;
+}
+
+static gboolean
+zstd_check (size_t res, GError **error)
+{
+  if (ZSTD_isError (res))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "zstd: %s", ZSTD_getErrorName (res));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+zstd_decompressor_setup (OstreeZstdDecompressor *self, GError **error)
+{
+  self->dctx = ZSTD_createDCtx ();
+  if (!self->dctx)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Out of memory");
+      return FALSE;
+    }
+
+  if (!zstd_check (ZSTD_DCtx_setParameter (self->dctx, ZSTD_d_windowLogMax,
+                                           OSTREE_ZSTD_DECODER_WINDOW_LOG_MAX),
+                   error))
+    return FALSE;
+
+  if (self->dictionary && g_bytes_get_size (self->dictionary) > 0)
+    {
+      gsize len;
+      const guint8 *buf = g_bytes_get_data (self->dictionary, &len);
+      if (!zstd_check (ZSTD_DCtx_loadDictionary (self->dctx, buf, len), error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+_ostree_zstd_decompressor_reset (GConverter *converter)
+{
+  OstreeZstdDecompressor *self = OSTREE_ZSTD_DECOMPRESSOR (converter);
+
+  if (self->dctx)
+    ZSTD_DCtx_reset (self->dctx, ZSTD_reset_session_only);
+}
+
+static GConverterResult
+_ostree_zstd_decompressor_convert (GConverter *converter, const void *inbuf, gsize inbuf_size,
+                                   void *outbuf, gsize outbuf_size, GConverterFlags flags,
+                                   gsize *bytes_read, gsize *bytes_written, GError **error)
+{
+  OstreeZstdDecompressor *self = OSTREE_ZSTD_DECOMPRESSOR (converter);
+
+  if (inbuf_size != 0 && outbuf_size == 0)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "Output buffer too small");
+      return G_CONVERTER_ERROR;
+    }
+
+  if (!self->dctx && !zstd_decompressor_setup (self, error))
+    return G_CONVERTER_ERROR;
+
+  ZSTD_inBuffer in = { inbuf, inbuf_size, 0 };
+  ZSTD_outBuffer out = { outbuf, outbuf_size, 0 };
+  size_t res = ZSTD_decompressStream (self->dctx, &out, &in);
+  if (!zstd_check (res, error))
+    return G_CONVERTER_ERROR;
+
+  *bytes_read = in.pos;
+  *bytes_written = out.pos;
+
+  /* A return of zero means a frame was completely decoded and flushed */
+  if (res == 0)
+    return G_CONVERTER_FINISHED;
+  if (in.pos == 0 && out.pos == 0)
+    {
+      if (flags & G_CONVERTER_INPUT_AT_END)
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                             "Truncated zstd stream");
+      else
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "Need more input");
+      return G_CONVERTER_ERROR;
+    }
+  return G_CONVERTER_CONVERTED;
+}
+
+static void
+_ostree_zstd_decompressor_iface_init (GConverterIface *iface)
+{
+  iface->convert = _ostree_zstd_decompressor_convert;
+  iface->reset = _ostree_zstd_decompressor_reset;
+}
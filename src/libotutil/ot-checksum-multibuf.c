@@ -0,0 +1,256 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ot-checksum-multibuf.h"
+
+#include <string.h>
+
+#ifdef OT_CHECKSUM_MULTIBUF_AVX2
+#include <immintrin.h>
+
+/* A single SHA-256 compression is a long dependency chain which leaves
+ * most of a modern CPU idle, and small messages are only one or two
+ * blocks.  So instead of vectorizing within a message we run one message
+ * per 32-bit lane of a 256-bit register, and refill a lane from the queue
+ * as soon as its message is done.
+ */
+
+#define N_LANES 8
+#define BLOCK_SIZE 64
+
+static const guint32 sha256_k[64]
+    = { 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+        0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+        0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+        0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+        0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+        0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+        0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+        0xc67178f2 };
+
+static const guint32 sha256_h0[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+/* A message being hashed in one lane */
+typedef struct
+{
+  const guint8 *data; /* Next whole block of the message */
+  gsize n_blocks;     /* Whole blocks left at @data */
+  guint8 tail[2 * BLOCK_SIZE];
+  guint n_tail_blocks; /* The padded end of the message, one or two blocks */
+  guint tail_index;
+  guint8 *out_digest;
+} Lane;
+
+static void
+lane_init (Lane *lane, const guint8 *buf, gsize len, guint8 *out_digest)
+{
+  const gsize rem = len % BLOCK_SIZE;
+
+  lane->data = buf;
+  lane->n_blocks = len / BLOCK_SIZE;
+  memset (lane->tail, 0, sizeof (lane->tail));
+  if (rem > 0)
+    memcpy (lane->tail, buf + lane->n_blocks * BLOCK_SIZE, rem);
+  lane->tail[rem] = 0x80;
+  /* The 0x80 byte and 64 bit length may not fit after the last bytes */
+  lane->n_tail_blocks = rem + 1 + sizeof (guint64) > BLOCK_SIZE ? 2 : 1;
+  const guint64 bitlen = GUINT64_TO_BE ((guint64)len * 8);
+  memcpy (lane->tail + lane->n_tail_blocks * BLOCK_SIZE - sizeof (bitlen), &bitlen,
+          sizeof (bitlen));
+  lane->tail_index = 0;
+  lane->out_digest = out_digest;
+}
+
+static const guint8 *
+lane_next_block (Lane *lane)
+{
+  if (lane->n_blocks > 0)
+    {
+      const guint8 *block = lane->data;
+      lane->data += BLOCK_SIZE;
+      lane->n_blocks--;
+      return block;
+    }
+
+  g_assert_cmpuint (lane->tail_index, <, lane->n_tail_blocks);
+  return lane->tail + BLOCK_SIZE * lane->tail_index++;
+}
+
+static gboolean
+lane_is_done (Lane *lane)
+{
+  return lane->n_blocks == 0 && lane->tail_index == lane->n_tail_blocks;
+}
+
+#define ROTR(x, n) _mm256_or_si256 (_mm256_srli_epi32 (x, n), _mm256_slli_epi32 (x, 32 - (n)))
+#define XOR3(a, b, c) _mm256_xor_si256 (_mm256_xor_si256 (a, b), c)
+#define BSIG0(x) XOR3 (ROTR (x, 2), ROTR (x, 13), ROTR (x, 22))
+#define BSIG1(x) XOR3 (ROTR (x, 6), ROTR (x, 11), ROTR (x, 25))
+#define SSIG0(x) XOR3 (ROTR (x, 7), ROTR (x, 18), _mm256_srli_epi32 (x, 3))
+#define SSIG1(x) XOR3 (ROTR (x, 17), ROTR (x, 19), _mm256_srli_epi32 (x, 10))
+#define CH(e, f, g) _mm256_xor_si256 (_mm256_and_si256 (e, f), _mm256_andnot_si256 (e, g))
+#define MAJ(a, b, c) \
+  _mm256_or_si256 (_mm256_and_si256 (a, b), _mm256_and_si256 (c, _mm256_or_si256 (a, b)))
+
+static inline guint32
+load_u32 (const guint8 *p)
+{
+  guint32 v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+/* Run one compression for each lane; @state is stored word-major, so
+ * that each row is one vector.
+ */
+__attribute__ ((target ("avx2"))) static void
+sha256_compress_x8 (guint32 state[8][N_LANES], const guint8 *const blocks[N_LANES])
+{
+  /* Message words are big-endian */
+  const __m256i bswap = _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3,
+                                          2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m256i w[64];
+
+  for (guint t = 0; t < 16; t++)
+    {
+      const guint off = t * 4;
+      w[t] = _mm256_shuffle_epi8 (
+          _mm256_setr_epi32 (load_u32 (blocks[0] + off), load_u32 (blocks[1] + off),
+                             load_u32 (blocks[2] + off), load_u32 (blocks[3] + off),
+                             load_u32 (blocks[4] + off), load_u32 (blocks[5] + off),
+                             load_u32 (blocks[6] + off), load_u32 (blocks[7] + off)),
+          bswap);
+    }
+  for (guint t = 16; t < 64; t++)
+    w[t] = _mm256_add_epi32 (_mm256_add_epi32 (SSIG1 (w[t - 2]), w[t - 7]),
+                             _mm256_add_epi32 (SSIG0 (w[t - 15]), w[t - 16]));
+
+  __m256i a = _mm256_loadu_si256 ((const __m256i *)state[0]);
+  __m256i b = _mm256_loadu_si256 ((const __m256i *)state[1]);
+  __m256i c = _mm256_loadu_si256 ((const __m256i *)state[2]);
+  __m256i d = _mm256_loadu_si256 ((const __m256i *)state[3]);
+  __m256i e = _mm256_loadu_si256 ((const __m256i *)state[4]);
+  __m256i f = _mm256_loadu_si256 ((const __m256i *)state[5]);
+  __m256i g = _mm256_loadu_si256 ((const __m256i *)state[6]);
+  __m256i h = _mm256_loadu_si256 ((const __m256i *)state[7]);
+
+  for (guint t = 0; t < 64; t++)
+    {
+      const __m256i t1 = _mm256_add_epi32 (
+          _mm256_add_epi32 (_mm256_add_epi32 (h, BSIG1 (e)), CH (e, f, g)),
+          _mm256_add_epi32 (_mm256_set1_epi32 ((int)sha256_k[t]), w[t]));
+      const __m256i t2 = _mm256_add_epi32 (BSIG0 (a), MAJ (a, b, c));
+      h = g;
+      g = f;
+      f = e;
+      e = _mm256_add_epi32 (d, t1);
+      d = c;
+      c = b;
+      b = a;
+      a = _mm256_add_epi32 (t1, t2);
+    }
+
+  const __m256i out[8] = { a, b, c, d, e, f, g, h };
+  for (guint i = 0; i < 8; i++)
+    {
+      __m256i *row = (__m256i *)state[i];
+      _mm256_storeu_si256 (row, _mm256_add_epi32 (_mm256_loadu_si256 (row), out[i]));
+    }
+}
+
+/* Hash @n_bufs independent messages; see ot_checksum_many() */
+void
+_ot_checksum_many_avx2 (const guint8 *const *bufs, const gsize *lens, guint n_bufs,
+                        guint8 *out_digests)
+{
+  static const guint8 idle_block[BLOCK_SIZE] = {
+    0,
+  };
+  Lane lanes[N_LANES];
+  gboolean active[N_LANES] = {
+    0,
+  };
+  guint32 state[8][N_LANES] = {
+    {
+        0,
+    },
+  };
+  guint n_active = 0;
+  guint next = 0;
+
+  while (TRUE)
+    {
+      for (guint l = 0; l < N_LANES && next < n_bufs; l++)
+        {
+          if (active[l])
+            continue;
+          lane_init (&lanes[l], bufs[next], lens[next], out_digests + next * 32);
+          for (guint i = 0; i < 8; i++)
+            state[i][l] = sha256_h0[i];
+          active[l] = TRUE;
+          n_active++;
+          next++;
+        }
+      if (n_active == 0)
+        break;
+
+      /* Idle lanes just compute garbage */
+      const guint8 *blocks[N_LANES];
+      for (guint l = 0; l < N_LANES; l++)
+        blocks[l] = active[l] ? lane_next_block (&lanes[l]) : idle_block;
+      sha256_compress_x8 (state, blocks);
+
+      for (guint l = 0; l < N_LANES; l++)
+        {
+          if (!active[l] || !lane_is_done (&lanes[l]))
+            continue;
+          for (guint i = 0; i < 8; i++)
+            {
+              const guint32 word = GUINT32_TO_BE (state[i][l]);
+              memcpy (lanes[l].out_digest + i * 4, &word, sizeof (word));
+            }
+          active[l] = FALSE;
+          n_active--;
+        }
+    }
+}
+#endif
+
+/* Whether _ot_checksum_many_avx2() may be used on this CPU */
+gboolean
+_ot_checksum_multibuf_supported (void)
+{
+#ifdef OT_CHECKSUM_MULTIBUF_AVX2
+  static gsize initialized;
+  static gboolean supported;
+
+  if (g_once_init_enter (&initialized))
+    {
+      __builtin_cpu_init ();
+      supported = __builtin_cpu_supports ("avx2") != 0;
+      g_once_init_leave (&initialized, 1);
+    }
+  return supported;
+#else
+  return FALSE;
+#endif
+}
@@ -0,0 +1,39 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "libglnx.h"
+
+G_BEGIN_DECLS
+
+/* The multi-buffer SHA-256 kernel hashes eight messages at once in AVX2
+ * registers; it is compiled on x86_64 and used if the CPU supports it.
+ * Use ot_checksum_many() rather than calling it directly.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define OT_CHECKSUM_MULTIBUF_AVX2 1
+#endif
+
+gboolean _ot_checksum_multibuf_supported (void);
+
+#ifdef OT_CHECKSUM_MULTIBUF_AVX2
+void _ot_checksum_many_avx2 (const guint8 *const *bufs, const gsize *lens, guint n_bufs,
+                             guint8 *out_digests);
+#endif
+
+G_END_DECLS
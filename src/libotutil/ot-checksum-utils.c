@@ -21,6 +21,7 @@
 
 #include "config.h"
 
+#include "ot-checksum-multibuf.h"
 #include "otutil.h"
 #if defined(HAVE_OPENSSL)
 #include <openssl/evp.h>
@@ -158,6 +159,23 @@ ot_checksum_clear (OtChecksum *checksum)
   real->initialized = FALSE;
 }
 
+/* Like ot_checksum_get_digest(), but leaves @checksum ready to hash a new
+ * message; this is cheaper than setting up a new one each time.
+ */
+static void
+ot_checksum_get_digest_and_reset (OtChecksum *checksum, guint8 *buf, size_t buflen)
+{
+  OtRealChecksum *real = (OtRealChecksum *)checksum;
+  ot_checksum_get_digest_internal (real, buf, buflen);
+#if defined(HAVE_OPENSSL)
+  g_assert (EVP_DigestInit_ex (real->checksum, EVP_sha256 (), NULL));
+#elif defined(HAVE_GNUTLS)
+  /* gnutls_hash_output() already reset it */
+#else
+  g_checksum_reset (real->checksum);
+#endif
+}
+
 guchar *
 ot_csum_from_gchecksum (GChecksum *checksum)
 {
@@ -270,3 +288,75 @@ ot_checksum_bytes (GBytes *data, guint8 out_digest[_OSTREE_SHA256_DIGEST_LEN])
   ot_checksum_update_bytes (&hasher, data);
   ot_checksum_get_digest (&hasher, out_digest, _OSTREE_SHA256_DIGEST_LEN);
 }
+
+/* Messages up to this size are hashed in parallel lanes when possible;
+ * larger ones are better served by a single stream.
+ */
+#define OT_CHECKSUM_MANY_MAX_LANE_SIZE (16 * 1024)
+
+/**
+ * ot_checksum_many:
+ * @bufs: (array length=n_bufs): Buffers to hash
+ * @lens: (array length=n_bufs): Length of each buffer
+ * @n_bufs: Number of buffers
+ * @out_digests: Return location for @n_bufs consecutive SHA-256 digests
+ *
+ * Compute the SHA-256 digest of each of @bufs.  This is meant for hashing
+ * many small independent buffers (such as metadata objects), where the
+ * per-message overhead of hashing them one by one dominates.  Where the
+ * CPU supports it, small buffers are hashed several at a time in SIMD
+ * lanes; otherwise a single hash context is reused for all of them.
+ */
+void
+ot_checksum_many (const guint8 *const *bufs, const gsize *lens, guint n_bufs, guint8 *out_digests)
+{
+  g_autofree gboolean *done = NULL;
+
+#ifdef OT_CHECKSUM_MULTIBUF_AVX2
+  if (n_bufs > 1 && _ot_checksum_multibuf_supported ())
+    {
+      g_autofree const guint8 **lane_bufs = g_new (const guint8 *, n_bufs);
+      g_autofree gsize *lane_lens = g_new (gsize, n_bufs);
+      g_autofree guint *lane_index = g_new (guint, n_bufs);
+      guint n_lane_bufs = 0;
+      for (guint i = 0; i < n_bufs; i++)
+        {
+          if (lens[i] > OT_CHECKSUM_MANY_MAX_LANE_SIZE)
+            continue;
+          lane_bufs[n_lane_bufs] = bufs[i];
+          lane_lens[n_lane_bufs] = lens[i];
+          lane_index[n_lane_bufs] = i;
+          n_lane_bufs++;
+        }
+
+      if (n_lane_bufs > 1)
+        {
+          g_autofree guint8 *lane_digests = g_malloc (n_lane_bufs * _OSTREE_SHA256_DIGEST_LEN);
+          _ot_checksum_many_avx2 (lane_bufs, lane_lens, n_lane_bufs, lane_digests);
+
+          done = g_new0 (gboolean, n_bufs);
+          for (guint i = 0; i < n_lane_bufs; i++)
+            {
+              memcpy (out_digests + lane_index[i] * _OSTREE_SHA256_DIGEST_LEN,
+                      lane_digests + i * _OSTREE_SHA256_DIGEST_LEN, _OSTREE_SHA256_DIGEST_LEN);
+              done[lane_index[i]] = TRUE;
+            }
+        }
+    }
+#endif
+
+  g_auto (OtChecksum) hasher = {
+    0,
+  };
+  for (guint i = 0; i < n_bufs; i++)
+    {
+      if (done && done[i])
+        continue;
+      if (!hasher.initialized)
+        ot_checksum_init (&hasher);
+      if (lens[i] > 0)
+        ot_checksum_update (&hasher, bufs[i], lens[i]);
+      ot_checksum_get_digest_and_reset (&hasher, out_digests + i * _OSTREE_SHA256_DIGEST_LEN,
+                                        _OSTREE_SHA256_DIGEST_LEN);
+    }
+}
@@ -77,4 +77,7 @@ char *ot_checksum_file_at (int dfd, const char *path, GChecksumType checksum_typ
 
 void ot_checksum_bytes (GBytes *data, guint8 out_digest[_OSTREE_SHA256_DIGEST_LEN]);
 
+void ot_checksum_many (const guint8 *const *bufs, const gsize *lens, guint n_bufs,
+                       guint8 *out_digests);
+
 G_END_DECLS
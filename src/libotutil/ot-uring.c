@@ -0,0 +1,413 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "otutil.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+/* Both the number of submission queue entries and the most operations we
+ * let be in flight at once, so that the completion queue (twice as large)
+ * never overflows.
+ */
+#define RING_ENTRIES 256
+
+typedef enum
+{
+  OP_STATX,
+  OP_LINKAT,
+  OP_RENAMEAT,
+} OtUringOpType;
+
+typedef struct
+{
+  OtUringOpType type;
+  int dfd;
+  const char *path; /* Owned by the paths chunk */
+  int newdfd;
+  const char *newpath;
+  guint flags;
+  guint mask;
+  struct statx *statxbuf; /* The caller's, filled in from stx on success */
+  struct statx stx;
+  int result;
+} OtUringOp;
+
+struct OtUring
+{
+  struct io_uring ring;
+  GArray *ops; /* OtUringOp */
+  GStringChunk *paths;
+  gboolean failed; /* If set, operations are run synchronously */
+};
+
+static const guint8 required_opcodes[] = { IORING_OP_STATX, IORING_OP_LINKAT, IORING_OP_RENAMEAT };
+
+OtUring *
+ot_uring_new (void)
+{
+  if (g_getenv ("OSTREE_DISABLE_IO_URING"))
+    return NULL;
+
+  OtUring *self = g_new0 (OtUring, 1);
+  int r = io_uring_queue_init (RING_ENTRIES, &self->ring, 0);
+  if (r < 0)
+    {
+      /* Commonly ENOSYS, or EPERM when blocked by a seccomp filter */
+      g_debug ("io_uring unavailable: %s", g_strerror (-r));
+      g_free (self);
+      return NULL;
+    }
+
+  struct io_uring_probe *probe = io_uring_get_probe_ring (&self->ring);
+  gboolean supported = probe != NULL;
+  for (guint i = 0; supported && i < G_N_ELEMENTS (required_opcodes); i++)
+    supported = io_uring_opcode_supported (probe, required_opcodes[i]);
+  if (probe)
+    io_uring_free_probe (probe);
+  if (!supported)
+    {
+      g_debug ("io_uring doesn't support the operations we need");
+      io_uring_queue_exit (&self->ring);
+      g_free (self);
+      return NULL;
+    }
+
+  self->ops = g_array_new (FALSE, FALSE, sizeof (OtUringOp));
+  self->paths = g_string_chunk_new (4096);
+  return self;
+}
+
+void
+ot_uring_free (OtUring *self)
+{
+  io_uring_queue_exit (&self->ring);
+  g_array_unref (self->ops);
+  g_string_chunk_free (self->paths);
+  g_free (self);
+}
+
+/**
+ * ot_uring_reset:
+ * @self: Ring
+ *
+ * Forget all queued operations and their results, to start a new batch.
+ */
+void
+ot_uring_reset (OtUring *self)
+{
+  g_array_set_size (self->ops, 0);
+  g_string_chunk_clear (self->paths);
+}
+
+static guint
+queue_op (OtUring *self, const OtUringOp *op)
+{
+  g_array_append_vals (self->ops, op, 1);
+  return self->ops->len - 1;
+}
+
+/**
+ * ot_uring_queue_statx:
+ * @self: Ring
+ * @dfd: Directory fd
+ * @path: Path relative to @dfd
+ * @flags: `AT_*` flags for statx()
+ * @mask: `STATX_*` fields to fill in
+ * @buf: Filled in by ot_uring_submit() if the operation succeeds
+ *
+ * Returns: The index of the operation, for ot_uring_get_result()
+ */
+guint
+ot_uring_queue_statx (OtUring *self, int dfd, const char *path, int flags, guint mask,
+                      struct statx *buf)
+{
+  const OtUringOp op = { .type = OP_STATX,
+                         .dfd = dfd,
+                         .path = g_string_chunk_insert (self->paths, path),
+                         .flags = flags,
+                         .mask = mask,
+                         .statxbuf = buf };
+  return queue_op (self, &op);
+}
+
+/**
+ * ot_uring_queue_linkat:
+ * @self: Ring
+ * @olddfd: Source directory fd
+ * @oldpath: Source path relative to @olddfd
+ * @newdfd: Target directory fd
+ * @newpath: Target path relative to @newdfd
+ *
+ * Returns: The index of the operation, for ot_uring_get_result()
+ */
+guint
+ot_uring_queue_linkat (OtUring *self, int olddfd, const char *oldpath, int newdfd,
+                       const char *newpath)
+{
+  const OtUringOp op = { .type = OP_LINKAT,
+                         .dfd = olddfd,
+                         .path = g_string_chunk_insert (self->paths, oldpath),
+                         .newdfd = newdfd,
+                         .newpath = g_string_chunk_insert (self->paths, newpath) };
+  return queue_op (self, &op);
+}
+
+/**
+ * ot_uring_queue_renameat:
+ * @self: Ring
+ * @olddfd: Source directory fd
+ * @oldpath: Source path relative to @olddfd
+ * @newdfd: Target directory fd
+ * @newpath: Target path relative to @newdfd
+ * @flags: 0 or `RENAME_NOREPLACE`, as for renameat2()
+ *
+ * Returns: The index of the operation, for ot_uring_get_result()
+ */
+guint
+ot_uring_queue_renameat (OtUring *self, int olddfd, const char *oldpath, int newdfd,
+                         const char *newpath, guint flags)
+{
+  const OtUringOp op = { .type = OP_RENAMEAT,
+                         .dfd = olddfd,
+                         .path = g_string_chunk_insert (self->paths, oldpath),
+                         .newdfd = newdfd,
+                         .newpath = g_string_chunk_insert (self->paths, newpath),
+                         .flags = flags };
+  return queue_op (self, &op);
+}
+
+static void
+prep_op (struct io_uring_sqe *sqe, const OtUringOp *op)
+{
+  switch (op->type)
+    {
+    case OP_STATX:
+      io_uring_prep_statx (sqe, op->dfd, op->path, op->flags, op->mask, (struct statx *)&op->stx);
+      break;
+    case OP_LINKAT:
+      io_uring_prep_linkat (sqe, op->dfd, op->path, op->newdfd, op->newpath, 0);
+      break;
+    case OP_RENAMEAT:
+      io_uring_prep_renameat (sqe, op->dfd, op->path, op->newdfd, op->newpath, op->flags);
+      break;
+    }
+}
+
+/* Record the results of the completed operations; returns how many there were */
+static guint
+reap_completions (OtUring *self)
+{
+  struct io_uring_cqe *cqe;
+  unsigned int head;
+  unsigned int n_seen = 0;
+  io_uring_for_each_cqe (&self->ring, head, cqe)
+  {
+    const guint i = GPOINTER_TO_UINT (io_uring_cqe_get_data (cqe));
+    OtUringOp *op = &g_array_index (self->ops, OtUringOp, i);
+    op->result = cqe->res;
+    if (op->type == OP_STATX && op->result == 0)
+      *op->statxbuf = op->stx;
+    n_seen++;
+  }
+  io_uring_cq_advance (&self->ring, n_seen);
+  return n_seen;
+}
+
+/* Run the queued operations one at a time, once the ring is unusable */
+static void
+run_ops_sync (OtUring *self)
+{
+  for (guint i = 0; i < self->ops->len; i++)
+    {
+      OtUringOp *op = &g_array_index (self->ops, OtUringOp, i);
+      int r = 0;
+      switch (op->type)
+        {
+        case OP_STATX:
+          r = statx (op->dfd, op->path, op->flags, op->mask, op->statxbuf);
+          break;
+        case OP_LINKAT:
+          r = linkat (op->dfd, op->path, op->newdfd, op->newpath, 0);
+          break;
+        case OP_RENAMEAT:
+          if (op->flags == 0)
+            r = renameat (op->dfd, op->path, op->newdfd, op->newpath);
+          else
+            r = glnx_renameat2_noreplace (op->dfd, op->path, op->newdfd, op->newpath);
+          break;
+        }
+      op->result = r < 0 ? -errno : 0;
+    }
+}
+
+/* Give up on operations the kernel may still be running.  Their paths and
+ * buffers are ours, so leak them rather than have the kernel write to
+ * freed memory.
+ */
+static void
+abandon_ops (OtUring *self)
+{
+  (void)g_steal_pointer (&self->ops);
+  (void)g_steal_pointer (&self->paths);
+  self->ops = g_array_new (FALSE, FALSE, sizeof (OtUringOp));
+  self->paths = g_string_chunk_new (4096);
+}
+
+/**
+ * ot_uring_submit:
+ * @self: Ring
+ * @error: Error
+ *
+ * Run all queued operations and wait for them to complete.  An error is
+ * only returned if io_uring itself fails; the result of each operation is
+ * available from ot_uring_get_result().
+ *
+ * After such an error the ring isn't used again, and later batches are run
+ * synchronously.  Operations which may still be in flight are leaked.
+ */
+gboolean
+ot_uring_submit (OtUring *self, GError **error)
+{
+  if (self->failed)
+    {
+      run_ops_sync (self);
+      return TRUE;
+    }
+
+  const guint n_ops = self->ops->len;
+  guint n_submitted = 0;
+  guint n_completed = 0;
+
+  while (n_completed < n_ops)
+    {
+      while (n_submitted < n_ops && n_submitted - n_completed < RING_ENTRIES)
+        {
+          struct io_uring_sqe *sqe = io_uring_get_sqe (&self->ring);
+          if (!sqe)
+            break;
+          prep_op (sqe, &g_array_index (self->ops, OtUringOp, n_submitted));
+          io_uring_sqe_set_data (sqe, GUINT_TO_POINTER (n_submitted));
+          n_submitted++;
+        }
+
+      int r = io_uring_submit_and_wait (&self->ring, 1);
+      if (r < 0 && r != -EINTR && r != -EAGAIN)
+        {
+          const int submit_errno = -r;
+          self->failed = TRUE;
+
+          /* Entries still in the submission queue were never started, and
+           * won't be once the ring is freed.
+           */
+          n_completed += reap_completions (self);
+          guint n_in_flight = n_submitted - io_uring_sq_ready (&self->ring) - n_completed;
+          while (n_in_flight > 0)
+            {
+              struct io_uring_cqe *cqe;
+              int wait_r = io_uring_wait_cqe (&self->ring, &cqe);
+              if (wait_r < 0 && wait_r != -EINTR && wait_r != -EAGAIN)
+                {
+                  abandon_ops (self);
+                  errno = -wait_r;
+                  return glnx_throw_errno_prefix (error, "io_uring_wait_cqe");
+                }
+              n_in_flight -= MIN (n_in_flight, reap_completions (self));
+            }
+
+          errno = submit_errno;
+          return glnx_throw_errno_prefix (error, "io_uring_submit");
+        }
+
+      n_completed += reap_completions (self);
+    }
+
+  return TRUE;
+}
+
+/**
+ * ot_uring_get_result:
+ * @self: Ring
+ * @op: Index of a submitted operation
+ *
+ * Returns: 0 if the operation succeeded, otherwise a negative errno value
+ */
+int
+ot_uring_get_result (OtUring *self, guint op)
+{
+  g_assert_cmpuint (op, <, self->ops->len);
+  return g_array_index (self->ops, OtUringOp, op).result;
+}
+
+#else /* !HAVE_LIBURING */
+
+OtUring *
+ot_uring_new (void)
+{
+  return NULL;
+}
+
+/* There are no rings to use the rest with */
+
+void
+ot_uring_free (OtUring *self)
+{
+  g_return_if_reached ();
+}
+
+void
+ot_uring_reset (OtUring *self)
+{
+  g_return_if_reached ();
+}
+
+guint
+ot_uring_queue_statx (OtUring *self, int dfd, const char *path, int flags, guint mask,
+                      struct statx *buf)
+{
+  g_return_val_if_reached (0);
+}
+
+guint
+ot_uring_queue_linkat (OtUring *self, int olddfd, const char *oldpath, int newdfd,
+                       const char *newpath)
+{
+  g_return_val_if_reached (0);
+}
+
+guint
+ot_uring_queue_renameat (OtUring *self, int olddfd, const char *oldpath, int newdfd,
+                         const char *newpath, guint flags)
+{
+  g_return_val_if_reached (0);
+}
+
+gboolean
+ot_uring_submit (OtUring *self, GError **error)
+{
+  g_return_val_if_reached (FALSE);
+}
+
+int
+ot_uring_get_result (OtUring *self, guint op)
+{
+  g_return_val_if_reached (0);
+}
+
+#endif /* HAVE_LIBURING */
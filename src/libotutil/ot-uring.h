@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "libglnx.h"
+
+G_BEGIN_DECLS
+
+struct statx;
+
+/* Batches of filesystem operations submitted through io_uring: queue any
+ * number of operations, submit them all, then read back each result.  The
+ * operations in a batch may run in any order, so they must not depend on
+ * each other.
+ *
+ * ot_uring_new() returns %NULL if io_uring can't be used, because ostree
+ * was built without liburing, the kernel doesn't support it (or the
+ * operations we need), or `OSTREE_DISABLE_IO_URING` is set in the
+ * environment; callers should then do the same operations synchronously.
+ */
+typedef struct OtUring OtUring;
+
+OtUring *ot_uring_new (void);
+void ot_uring_free (OtUring *self);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (OtUring, ot_uring_free)
+
+void ot_uring_reset (OtUring *self);
+guint ot_uring_queue_statx (OtUring *self, int dfd, const char *path, int flags, guint mask,
+                            struct statx *buf);
+guint ot_uring_queue_linkat (OtUring *self, int olddfd, const char *oldpath, int newdfd,
+                             const char *newpath);
+guint ot_uring_queue_renameat (OtUring *self, int olddfd, const char *oldpath, int newdfd,
+                               const char *newpath, guint flags);
+gboolean ot_uring_submit (OtUring *self, GError **error);
+int ot_uring_get_result (OtUring *self, guint op);
+
+G_END_DECLS
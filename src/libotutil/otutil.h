@@ -112,6 +112,7 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC (GMainContextPopDefault, _ostree_main_context_pop_
 #include <ot-opt-utils.h>
 #include <ot-tool-util.h>
 #include <ot-unix-utils.h>
+#include <ot-uring.h>
 #include <ot-variant-builder.h>
 #include <ot-variant-utils.h>
 
@@ -49,6 +49,7 @@ static gboolean opt_bareuseronly_dirs;
 static char *opt_skiplist_file;
 static char *opt_selinux_policy;
 static char *opt_selinux_prefix;
+static gint opt_jobs = 1;
 
 static gboolean
 parse_fsync_cb (const char *option_name, const char *value, gpointer data, GError **error)
@@ -109,6 +110,8 @@ static GOptionEntry options[] = {
     "PATH" },
   { "selinux-prefix", 0, 0, G_OPTION_ARG_STRING, &opt_selinux_prefix,
     "When setting SELinux labels, prefix all paths by PREFIX", "PREFIX" },
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs,
+    "Number of threads to use for checking out files (default: 1)", "N" },
   { "composefs", 0, 0, G_OPTION_ARG_NONE, &opt_composefs, "Only create a composefs blob", NULL },
   { "composefs-noverity", 0, 0, G_OPTION_ARG_NONE, &opt_composefs_noverity,
     "Only create a composefs blob, and disable fsverity", NULL },
@@ -145,7 +148,7 @@ process_one_checkout (OstreeRepo *repo, const char *resolved_commit, const char
                              || opt_union_add || opt_force_copy || opt_force_copy_zerosized
                              || opt_bareuseronly_dirs || opt_union_identical || opt_skiplist_file
                              || opt_selinux_policy || opt_selinux_prefix
-                             || opt_process_passthrough_whiteouts;
+                             || opt_process_passthrough_whiteouts || opt_jobs != 1;
 
   /* If we're doing composefs, then this is it */
   if (opt_composefs || opt_composefs_noverity)
@@ -231,6 +234,7 @@ process_one_checkout (OstreeRepo *repo, const char *resolved_commit, const char
       checkout_options.force_copy = opt_force_copy;
       checkout_options.force_copy_zerosized = opt_force_copy_zerosized;
       checkout_options.bareuseronly_dirs = opt_bareuseronly_dirs;
+      checkout_options.n_jobs = opt_jobs;
 
       if (!ostree_repo_checkout_at (repo, &checkout_options, AT_FDCWD, destination, resolved_commit,
                                     cancellable, error))
@@ -355,6 +359,9 @@ ostree_builtin_checkout (int argc, char **argv, OstreeCommandInvocation *invocat
   if (opt_disable_fsync)
     ostree_repo_set_disable_fsync (repo, TRUE);
 
+  if (opt_jobs < 0)
+    return glnx_throw (error, "--jobs must not be negative");
+
   if (argc < 2)
     {
       g_autofree char *help = g_option_context_get_help (context, TRUE, NULL);
@@ -58,6 +58,7 @@ static gboolean opt_canonical_permissions;
 static gboolean opt_ro_executables;
 static gboolean opt_consume;
 static gboolean opt_devino_canonical;
+static gint opt_jobs = 1;
 static char *opt_base;
 static char **opt_trees;
 static gint opt_owner_uid = -1;
@@ -154,6 +155,9 @@ static GOptionEntry options[] = {
     "File containing list of files to skip", "PATH" },
   { "consume", 0, 0, G_OPTION_ARG_NONE, &opt_consume,
     "Consume (delete) content after commit (for local directories)", NULL },
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs,
+    "Checksum and write up to N files concurrently (for local directories)",
+    "N" },
   { "table-output", 0, 0, G_OPTION_ARG_NONE, &opt_table_output,
     "Output more information in a KEY: VALUE format", NULL },
 #ifndef OSTREE_DISABLE_GPGME
@@ -624,13 +628,21 @@ ostree_builtin_commit (int argc, char **argv, OstreeCommandInvocation *invocatio
   if (opt_disable_fsync)
     ostree_repo_set_disable_fsync (repo, TRUE);
 
+  if (opt_jobs < 0)
+    {
+      glnx_throw (error, "Invalid --jobs value: %d", opt_jobs);
+      goto out;
+    }
+
   if (flags != 0 || opt_owner_uid >= 0 || opt_owner_gid >= 0 || opt_statoverride_file != NULL
       || opt_skiplist_file != NULL || opt_no_xattrs || opt_ro_executables || opt_selinux_policy
-      || opt_selinux_policy_from_base)
+      || opt_selinux_policy_from_base || opt_jobs != 1)
     {
       filter_data.mode_adds = mode_adds;
       filter_data.skip_list = skip_list;
       modifier = ostree_repo_commit_modifier_new (flags, commit_filter, &filter_data, NULL);
+      if (opt_jobs != 1)
+        ostree_repo_commit_modifier_set_n_jobs (modifier, opt_jobs);
 
       if (opt_selinux_policy)
         {
@@ -47,13 +47,79 @@ static GOptionEntry options[]
           "Use file ownership group id for local files", "GID" },
         { NULL } };
 
+static gboolean
+arg_is_path (const char *arg)
+{
+  return g_str_has_prefix (arg, "/") || g_str_has_prefix (arg, "./");
+}
+
+typedef struct
+{
+  GPtrArray *modified;
+  GPtrArray *removed;
+  GPtrArray *added;
+} CommitDiff;
+
+static gboolean
+collect_commit_change (OstreeDiffChange change, const char *path, OstreeObjectType objtype,
+                       const char *src_checksum, const char *target_checksum, gpointer user_data,
+                       GError **error)
+{
+  CommitDiff *diff = user_data;
+  switch (change)
+    {
+    case OSTREE_DIFF_CHANGE_MODIFIED:
+      g_ptr_array_add (diff->modified, g_strdup (path));
+      break;
+    case OSTREE_DIFF_CHANGE_REMOVED:
+      g_ptr_array_add (diff->removed, g_strdup (path));
+      break;
+    case OSTREE_DIFF_CHANGE_ADDED:
+      g_ptr_array_add (diff->added, g_strdup (path));
+      break;
+    }
+  return TRUE;
+}
+
+/* Same output as ostree_diff_print(), but only walking the parts of the
+ * commits which differ.
+ */
+static gboolean
+diff_commits (OstreeRepo *repo, const char *src, const char *target, GCancellable *cancellable,
+              GError **error)
+{
+  g_autofree char *src_checksum = NULL;
+  g_autofree char *target_checksum = NULL;
+  if (!ostree_repo_resolve_rev (repo, src, FALSE, &src_checksum, error))
+    return FALSE;
+  if (!ostree_repo_resolve_rev (repo, target, FALSE, &target_checksum, error))
+    return FALSE;
+
+  g_autoptr (GPtrArray) modified = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr (GPtrArray) removed = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr (GPtrArray) added = g_ptr_array_new_with_free_func (g_free);
+  CommitDiff diff = { modified, removed, added };
+  if (!ostree_diff_commits (repo, src_checksum, target_checksum, collect_commit_change, &diff,
+                            cancellable, error))
+    return FALSE;
+
+  for (guint i = 0; i < modified->len; i++)
+    g_print ("M    %s\n", (char *)modified->pdata[i]);
+  for (guint i = 0; i < removed->len; i++)
+    g_print ("D    %s\n", (char *)removed->pdata[i]);
+  for (guint i = 0; i < added->len; i++)
+    g_print ("A    %s\n", (char *)added->pdata[i]);
+
+  return TRUE;
+}
+
 static gboolean
 parse_file_or_commit (OstreeRepo *repo, const char *arg, GFile **out_file,
                       GCancellable *cancellable, GError **error)
 {
   g_autoptr (GFile) ret_file = NULL;
 
-  if (g_str_has_prefix (arg, "/") || g_str_has_prefix (arg, "./"))
+  if (arg_is_path (arg))
     {
       ret_file = g_file_new_for_path (arg);
     }
@@ -155,7 +221,12 @@ ostree_builtin_diff (int argc, char **argv, OstreeCommandInvocation *invocation,
   g_autoptr (GPtrArray) removed = NULL;
   g_autoptr (GPtrArray) added = NULL;
 
-  if (opt_fs_diff)
+  if (opt_fs_diff && !arg_is_path (src) && !arg_is_path (target))
+    {
+      if (!diff_commits (repo, src, target, cancellable, error))
+        return FALSE;
+    }
+  else if (opt_fs_diff)
     {
       OstreeDiffFlags diff_flags = OSTREE_DIFF_FLAGS_NONE;
 
@@ -33,6 +33,9 @@ static gboolean opt_all;
 static gboolean opt_add_tombstones;
 static gboolean opt_verify_bindings;
 static gboolean opt_verify_back_refs;
+static gint opt_jobs = 1;
+static gboolean opt_incremental;
+static gint opt_max_age = 30;
 
 /* ATTENTION:
  * Please remember to update the bash-completion script (bash/ostree) and
@@ -49,83 +52,92 @@ static GOptionEntry options[]
           NULL },
         { "verify-back-refs", 0, 0, G_OPTION_ARG_NONE, &opt_verify_back_refs,
           "Verify back-references (implies --verify-bindings)", NULL },
+        { "jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs,
+          "Number of threads to use for verifying objects (default: 1)",
+          "N" },
+        { "incremental", 0, 0, G_OPTION_ARG_NONE, &opt_incremental,
+          "Skip objects unchanged since last verified by an incremental fsck", NULL },
+        { "max-age", 0, 0, G_OPTION_ARG_INT, &opt_max_age,
+          "With --incremental, verify objects last verified more than DAYS ago (default: 30)",
+          "DAYS" },
         { NULL } };
 
+/* Handle a verification failure @fsck_error for an object; takes ownership
+ * of the error.
+ */
 static gboolean
-fsck_one_object (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
-                 GHashTable *object_parents, GVariant *key, gboolean *out_found_corruption,
-                 GCancellable *cancellable, GError **error)
+fsck_handle_broken_object (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
+                           GHashTable *object_parents, GVariant *key, GError *fsck_error,
+                           gboolean *out_found_corruption, GCancellable *cancellable,
+                           GError **error)
 {
-  g_autoptr (GError) temp_error = NULL;
-  if (!ostree_repo_fsck_object (repo, objtype, checksum, cancellable, &temp_error))
+  g_autoptr (GError) temp_error = fsck_error;
+  gboolean object_missing = FALSE;
+  g_auto (GStrv) parent_commits = NULL;
+  g_autofree char *parent_commits_str = NULL;
+
+  if (object_parents)
+    {
+      parent_commits = ostree_repo_traverse_parents_get_commits (object_parents, key);
+      parent_commits_str = g_strjoinv (", ", parent_commits);
+    }
+
+  if (g_error_matches (temp_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+    {
+      g_clear_error (&temp_error);
+      if (parent_commits_str)
+        g_printerr ("Object missing in commits %s: %s.%s\n", parent_commits_str, checksum,
+                    ostree_object_type_to_string (objtype));
+      else
+        g_printerr ("Object missing: %s.%s\n", checksum,
+                    ostree_object_type_to_string (objtype));
+      object_missing = TRUE;
+    }
+  else
     {
-      gboolean object_missing = FALSE;
-      g_auto (GStrv) parent_commits = NULL;
-      g_autofree char *parent_commits_str = NULL;
+      if (parent_commits_str)
+        g_prefix_error (&temp_error, "In commits %s: ", parent_commits_str);
 
-      if (object_parents)
+      if (opt_delete)
         {
-          parent_commits = ostree_repo_traverse_parents_get_commits (object_parents, key);
-          parent_commits_str = g_strjoinv (", ", parent_commits);
+          g_printerr ("%s\n", temp_error->message);
+          (void)ostree_repo_delete_object (repo, objtype, checksum, cancellable, NULL);
+          object_missing = TRUE;
         }
-
-      if (g_error_matches (temp_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+      else if (opt_all)
         {
-          g_clear_error (&temp_error);
-          if (parent_commits_str)
-            g_printerr ("Object missing in commits %s: %s.%s\n", parent_commits_str, checksum,
-                        ostree_object_type_to_string (objtype));
-          else
-            g_printerr ("Object missing: %s.%s\n", checksum,
-                        ostree_object_type_to_string (objtype));
-          object_missing = TRUE;
+          *out_found_corruption = TRUE;
+          g_printerr ("%s\n", temp_error->message);
         }
       else
         {
-          if (parent_commits_str)
-            g_prefix_error (&temp_error, "In commits %s: ", parent_commits_str);
-
-          if (opt_delete)
-            {
-              g_printerr ("%s\n", temp_error->message);
-              (void)ostree_repo_delete_object (repo, objtype, checksum, cancellable, NULL);
-              object_missing = TRUE;
-            }
-          else if (opt_all)
-            {
-              *out_found_corruption = TRUE;
-              g_printerr ("%s\n", temp_error->message);
-            }
-          else
-            {
-              g_propagate_error (error, g_steal_pointer (&temp_error));
-              return FALSE;
-            }
+          g_propagate_error (error, g_steal_pointer (&temp_error));
+          return FALSE;
         }
+    }
+
+  if (object_missing)
+    {
+      *out_found_corruption = TRUE;
 
-      if (object_missing)
+      if (parent_commits != NULL && objtype != OSTREE_OBJECT_TYPE_COMMIT)
         {
-          *out_found_corruption = TRUE;
+          int i;
 
-          if (parent_commits != NULL && objtype != OSTREE_OBJECT_TYPE_COMMIT)
+          /* The commit was missing or deleted, mark the commit partial */
+          for (i = 0; parent_commits[i] != NULL; i++)
             {
-              int i;
-
-              /* The commit was missing or deleted, mark the commit partial */
-              for (i = 0; parent_commits[i] != NULL; i++)
+              const char *parent_commit = parent_commits[i];
+              OstreeRepoCommitState state;
+              if (!ostree_repo_load_commit (repo, parent_commit, NULL, &state, error))
+                return FALSE;
+              if ((state & OSTREE_REPO_COMMIT_STATE_PARTIAL) == 0)
                 {
-                  const char *parent_commit = parent_commits[i];
-                  OstreeRepoCommitState state;
-                  if (!ostree_repo_load_commit (repo, parent_commit, NULL, &state, error))
+                  g_printerr ("Marking commit as partial: %s\n", parent_commit);
+                  if (!ostree_repo_mark_commit_partial_reason (
+                          repo, parent_commit, TRUE, OSTREE_REPO_COMMIT_STATE_FSCK_PARTIAL,
+                          error))
                     return FALSE;
-                  if ((state & OSTREE_REPO_COMMIT_STATE_PARTIAL) == 0)
-                    {
-                      g_printerr ("Marking commit as partial: %s\n", parent_commit);
-                      if (!ostree_repo_mark_commit_partial_reason (
-                              repo, parent_commit, TRUE, OSTREE_REPO_COMMIT_STATE_FSCK_PARTIAL,
-                              error))
-                        return FALSE;
-                    }
                 }
             }
         }
@@ -134,6 +146,49 @@ fsck_one_object (OstreeRepo *repo, const char *checksum, OstreeObjectType objtyp
   return TRUE;
 }
 
+static gboolean
+fsck_one_object (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
+                 GHashTable *object_parents, GVariant *key, gboolean *out_found_corruption,
+                 GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GError) temp_error = NULL;
+  if (!ostree_repo_fsck_object (repo, objtype, checksum, cancellable, &temp_error))
+    return fsck_handle_broken_object (repo, checksum, objtype, object_parents, key,
+                                      g_steal_pointer (&temp_error), out_found_corruption,
+                                      cancellable, error);
+  return TRUE;
+}
+
+typedef struct
+{
+  GHashTable *object_parents;
+  gboolean *out_found_corruption;
+  GCancellable *cancellable;
+  guint n_done;
+  guint count;
+} FsckReachableData;
+
+static gboolean
+fsck_object_result (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
+                    const GError *fsck_error, gpointer user_data, GError **error)
+{
+  FsckReachableData *data = user_data;
+
+  if (fsck_error)
+    {
+      g_autoptr (GVariant) key
+          = g_variant_ref_sink (ostree_object_name_serialize (checksum, objtype));
+      if (!fsck_handle_broken_object (repo, checksum, objtype, data->object_parents, key,
+                                      g_error_copy (fsck_error), data->out_found_corruption,
+                                      data->cancellable, error))
+        return FALSE;
+    }
+
+  data->n_done++;
+  glnx_console_progress_n_items ("fsck objects", data->n_done, data->count);
+  return TRUE;
+}
+
 static gboolean
 fsck_reachable_objects_from_commits (OstreeRepo *repo, GHashTable *commits,
                                      gboolean *out_found_corruption, GCancellable *cancellable,
@@ -165,24 +220,22 @@ fsck_reachable_objects_from_commits (OstreeRepo *repo, GHashTable *commits,
   };
   glnx_console_lock (&console);
 
-  const guint count = g_hash_table_size (reachable_objects);
-  guint i = 0;
-  g_hash_table_iter_init (&hash_iter, reachable_objects);
-  while (g_hash_table_iter_next (&hash_iter, &key, &value))
+  g_auto (GVariantBuilder) builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "n-jobs", g_variant_new_uint32 (opt_jobs));
+  if (opt_incremental)
     {
-      GVariant *serialized_key = key;
-      const char *checksum;
-      OstreeObjectType objtype;
-
-      ostree_object_name_deserialize (serialized_key, &checksum, &objtype);
-
-      if (!fsck_one_object (repo, checksum, objtype, object_parents, serialized_key,
-                            out_found_corruption, cancellable, error))
-        return FALSE;
-
-      i++;
-      glnx_console_progress_n_items ("fsck objects", i, count);
+      g_variant_builder_add (&builder, "{sv}", "journal", g_variant_new_boolean (TRUE));
+      g_variant_builder_add (&builder, "{sv}", "journal-max-age",
+                             g_variant_new_uint64 ((guint64)opt_max_age * 24 * 60 * 60));
     }
+  g_autoptr (GVariant) fsck_options = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  FsckReachableData data = { object_parents, out_found_corruption, cancellable, 0,
+                             g_hash_table_size (reachable_objects) };
+  if (!ostree_repo_fsck_objects (repo, reachable_objects, fsck_options, fsck_object_result, &data,
+                                 cancellable, error))
+    return FALSE;
 
   return TRUE;
 }
@@ -308,6 +361,11 @@ ostree_builtin_fsck (int argc, char **argv, OstreeCommandInvocation *invocation,
                                     error))
     return FALSE;
 
+  if (opt_jobs < 0)
+    return glnx_throw (error, "--jobs must not be negative");
+  if (opt_max_age < 0)
+    return glnx_throw (error, "--max-age must not be negative");
+
   if (!opt_quiet)
     g_print ("Validating refs...\n");
 
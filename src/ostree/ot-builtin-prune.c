@@ -36,6 +36,8 @@ static char *opt_keep_younger_than;
 static char **opt_retain_branch_depth;
 static char **opt_only_branches;
 static gboolean opt_commit_only;
+static gboolean opt_pack;
+static char *opt_chunk_min_size;
 
 /* ATTENTION:
  * Please remember to update the bash-completion script (bash/ostree) and
@@ -61,6 +63,12 @@ static GOptionEntry options[] = {
     "Only prune BRANCH (may be specified multiple times)", "BRANCH" },
   { "commit-only", 0, 0, G_OPTION_ARG_NONE, &opt_commit_only,
     "Only traverse and delete commit objects.", NULL },
+  { "pack", 0, 0, G_OPTION_ARG_NONE, &opt_pack,
+    "After pruning, move loose objects into a pack file (archive repositories only)", NULL },
+  { "chunk-min-size", 0, 0, G_OPTION_ARG_STRING, &opt_chunk_min_size,
+    "After pruning, store content objects of at least BYTES bytes as chunks (archive repositories "
+    "only)",
+    "BYTES" },
   { NULL }
 };
 
@@ -196,6 +204,26 @@ ostree_builtin_prune (int argc, char **argv, OstreeCommandInvocation *invocation
                                   "https://github.com/ostreedev/ostree/issues/1479");
     }
 
+  if (opt_pack && opt_no_prune)
+    {
+      ot_util_usage_error (context, "Cannot specify both --pack and --no-prune", error);
+      return FALSE;
+    }
+
+  guint64 chunk_min_size = 0;
+  if (opt_chunk_min_size)
+    {
+      if (opt_no_prune)
+        {
+          ot_util_usage_error (context, "Cannot specify both --chunk-min-size and --no-prune",
+                               error);
+          return FALSE;
+        }
+      if (!g_ascii_string_to_unsigned (opt_chunk_min_size, 10, 1, G_MAXUINT64, &chunk_min_size,
+                                       error))
+        return glnx_prefix_error (error, "Invalid --chunk-min-size");
+    }
+
   OstreeRepoPruneFlags pruneflags = 0;
   if (opt_refs_only)
     pruneflags |= OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY;
@@ -375,5 +403,22 @@ ostree_builtin_prune (int argc, char **argv, OstreeCommandInvocation *invocation
   else
     g_print ("Deleted %u objects, %s freed\n", n_objects_pruned, formatted_freed_size);
 
+  /* Chunk first, so that large objects don't end up in a pack */
+  if (opt_chunk_min_size)
+    {
+      guint n_chunked = 0;
+      if (!ostree_repo_chunk_objects (repo, chunk_min_size, &n_chunked, cancellable, error))
+        return FALSE;
+      g_print ("Chunked %u objects\n", n_chunked);
+    }
+
+  if (opt_pack)
+    {
+      guint n_packed = 0;
+      if (!ostree_repo_pack_objects (repo, &n_packed, cancellable, error))
+        return FALSE;
+      g_print ("Packed %u objects\n", n_packed);
+    }
+
   return TRUE;
 }
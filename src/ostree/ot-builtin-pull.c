@@ -51,6 +51,7 @@ static int opt_low_speed_time_seconds = -1;
 static int opt_max_outstanding_fetcher_requests = -1;
 static char *opt_url;
 static char **opt_localcache_repos;
+static char *opt_trace_file;
 
 /* ATTENTION:
  * Please remember to update the bash-completion script (bash/ostree) and
@@ -114,6 +115,8 @@ static GOptionEntry options[]
           "Require fetched commits to have newer timestamps than given rev", NULL },
         { "disable-verify-bindings", 0, 0, G_OPTION_ARG_NONE, &opt_disable_verify_bindings,
           "Do not verify commit bindings", NULL },
+        { "trace-file", 0, 0, G_OPTION_ARG_FILENAME, &opt_trace_file,
+          "Write a JSON trace of the time spent in each phase to FILE", "FILE" },
         /* let's leave this hidden for now; we just need it for tests */
         { "append-user-agent", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &opt_append_user_agent,
           "Append string to user agent", NULL },
@@ -436,6 +439,10 @@ ostree_builtin_pull (int argc, char **argv, OstreeCommandInvocation *invocation,
       g_variant_builder_add (&builder, "{s@v}", "append-user-agent",
                              g_variant_new_variant (g_variant_new_string (opt_append_user_agent)));
 
+    if (opt_trace_file)
+      g_variant_builder_add (&builder, "{s@v}", "trace-file",
+                             g_variant_new_variant (g_variant_new_string (opt_trace_file)));
+
     if (!opt_dry_run)
       {
         if (console.is_tty)
@@ -36,6 +36,10 @@ static gboolean opt_swap_endianness;
 static gboolean opt_inline;
 static gboolean opt_disable_bsdiff;
 static gboolean opt_if_not_exists;
+static gint opt_jobs = 1;
+static char *opt_compression;
+static gboolean opt_zstd_long;
+static char *opt_zstd_dictionary;
 static char **opt_key_ids;
 static char *opt_sign_name;
 static char *opt_keysfilename;
@@ -97,6 +101,15 @@ static GOptionEntry generate_options[] = {
     "Maximum size in megabytes to consider bsdiff compression for input files", NULL },
   { "max-chunk-size", 0, 0, G_OPTION_ARG_STRING, &opt_max_chunk_size,
     "Maximum size of delta chunks in megabytes", NULL },
+  { "compression", 0, 0, G_OPTION_ARG_STRING, &opt_compression,
+    "Compress delta parts with lzma (default), zstd or none", "TYPE" },
+  { "zstd-long", 0, 0, G_OPTION_ARG_NONE, &opt_zstd_long,
+    "Enable zstd long-range matching (implies --compression=zstd)", NULL },
+  { "zstd-dictionary", 0, 0, G_OPTION_ARG_FILENAME, &opt_zstd_dictionary,
+    "Use PATH as zstd dictionary (implies --compression=zstd)", "PATH" },
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs,
+    "Number of threads to use for diffing and compressing (default: 1)",
+    "N" },
   { "filename", 0, 0, G_OPTION_ARG_FILENAME, &opt_filename,
     "Write the delta content to PATH (a directory).  If not specified, the OSTree repository is "
     "used",
@@ -299,6 +312,9 @@ ot_static_delta_builtin_generate (int argc, char **argv, OstreeCommandInvocation
   if (argc >= 3 && opt_to_rev == NULL)
     opt_to_rev = argv[2];
 
+  if (opt_jobs < 0)
+    return glnx_throw (error, "--jobs must not be negative");
+
   if (argc < 3 && opt_to_rev == NULL)
     {
       g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "TO revision must be specified");
@@ -408,6 +424,37 @@ ot_static_delta_builtin_generate (int argc, char **argv, OstreeCommandInvocation
                                g_variant_new_boolean (FALSE));
       if (opt_inline)
         g_variant_builder_add (parambuilder, "{sv}", "inline-parts", g_variant_new_boolean (TRUE));
+      if (opt_jobs != 1)
+        g_variant_builder_add (parambuilder, "{sv}", "n-jobs", g_variant_new_uint32 (opt_jobs));
+      if (opt_compression || opt_zstd_long || opt_zstd_dictionary)
+        {
+          const char *compression = opt_compression ?: "zstd";
+          guint8 comptype;
+          if (g_str_equal (compression, "lzma") || g_str_equal (compression, "xz"))
+            comptype = 'x';
+          else if (g_str_equal (compression, "zstd"))
+            comptype = 'z';
+          else if (g_str_equal (compression, "none"))
+            comptype = 0;
+          else
+            return glnx_throw (error, "Invalid compression type '%s'", compression);
+          if ((opt_zstd_long || opt_zstd_dictionary) && comptype != 'z')
+            return glnx_throw (error, "--zstd-long and --zstd-dictionary require zstd compression");
+          g_variant_builder_add (parambuilder, "{sv}", "compression", g_variant_new_byte (comptype));
+        }
+      if (opt_zstd_long)
+        g_variant_builder_add (parambuilder, "{sv}", "zstd-long", g_variant_new_boolean (TRUE));
+      if (opt_zstd_dictionary)
+        {
+          glnx_autofd int dict_fd = -1;
+          if (!glnx_openat_rdonly (AT_FDCWD, opt_zstd_dictionary, TRUE, &dict_fd, error))
+            return FALSE;
+          g_autoptr (GBytes) dictionary = ot_fd_readall_or_mmap (dict_fd, 0, error);
+          if (!dictionary)
+            return FALSE;
+          g_variant_builder_add (parambuilder, "{sv}", "zstd-dictionary",
+                                 g_variant_new_from_bytes (G_VARIANT_TYPE ("ay"), dictionary, TRUE));
+        }
       if (opt_filename)
         g_variant_builder_add (parambuilder, "{sv}", "filename",
                                g_variant_new_bytestring (opt_filename));
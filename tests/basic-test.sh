@@ -19,7 +19,7 @@
 
 set -euo pipefail
 
-echo "1..$((91 + ${extra_basic_tests:-0}))"
+echo "1..$((94 + ${extra_basic_tests:-0}))"
 
 CHECKOUT_U_ARG=""
 CHECKOUT_H_ARGS="-H"
@@ -92,6 +92,17 @@ done
 
 echo "ok checkout -C"
 
+rm checkout-test2 checkout-test2-jobs -rf
+$OSTREE checkout test2 checkout-test2
+$OSTREE checkout --jobs=4 test2 checkout-test2-jobs
+for d in checkout-test2 checkout-test2-jobs; do
+    # Directory metadata is applied last, so also compare directory mtimes
+    (cd $d && find . -printf '%P %y %m\n' && find . -type d -printf '%P %T@\n') | sort > $d-find.txt
+done
+assert_files_equal checkout-test2-find.txt checkout-test2-jobs-find.txt
+rm checkout-test2-jobs -rf
+echo "ok checkout --jobs"
+
 $OSTREE rev-parse test2
 $OSTREE rev-parse 'test2^'
 $OSTREE rev-parse 'test2^^' 2>/dev/null && fatal "rev-parse test2^^ unexpectedly succeeded!"
@@ -238,6 +249,18 @@ $OSTREE commit ${COMMIT_ARGS} -b test2-no-parent -s '' --parent=none $test_tmpdi
 assert_streq $($OSTREE log test2-no-parent |grep '^commit' | wc -l) "1"
 echo "ok commit no parent"
 
+cd ${test_tmpdir}
+$OSTREE commit ${COMMIT_ARGS} -b test2-serial -s '' $test_tmpdir/checkout-test2-4
+$OSTREE commit ${COMMIT_ARGS} -b test2-jobs -s '' --jobs=4 $test_tmpdir/checkout-test2-4
+# The root dirtree and dirmeta checksums cover the whole tree
+$OSTREE ls -d -C test2-serial / > serial-root.txt
+$OSTREE ls -d -C test2-jobs / > jobs-root.txt
+assert_files_equal serial-root.txt jobs-root.txt
+$OSTREE diff test2-serial test2-jobs > diff.txt
+assert_file_empty diff.txt
+$OSTREE refs --delete test2-serial test2-jobs
+echo "ok commit --jobs"
+
 cd ${test_tmpdir}
 if $OSTREE commit ${COMMIT_ARGS} -b test-bootable --bootable $test_tmpdir/checkout-test2-4 2>err.txt; then
     fatal "committed non-bootable tree"
@@ -324,6 +347,31 @@ assert_file_has_content diff-test2 'A */yet/message$'
 assert_file_has_content diff-test2 'A */yet/another/tree/green$'
 echo "ok diff revisions"
 
+cd ${test_tmpdir}
+rm -rf diff-tree
+mkdir -p diff-tree/sub diff-tree/same diff-tree/gone/deep
+echo a > diff-tree/same/file
+echo b > diff-tree/sub/changed
+echo c > diff-tree/gone/deep/file
+echo d > diff-tree/typechange
+$OSTREE commit ${COMMIT_ARGS} -b diff-test -s diff --tree=dir=diff-tree
+echo b2 > diff-tree/sub/changed
+rm -rf diff-tree/gone diff-tree/typechange
+mkdir -p diff-tree/typechange diff-tree/new/dir
+echo e > diff-tree/new/dir/file
+$OSTREE commit ${COMMIT_ARGS} -b diff-test -s diff --tree=dir=diff-tree
+$OSTREE diff diff-test > diff-commits
+assert_file_has_content diff-commits '^M */sub/changed$'
+assert_file_has_content diff-commits '^M */typechange$'
+assert_file_has_content diff-commits '^D */gone$'
+assert_not_file_has_content diff-commits 'gone/deep'
+assert_not_file_has_content diff-commits 'same'
+assert_file_has_content diff-commits '^A */new$'
+assert_file_has_content diff-commits '^A */new/dir$'
+assert_file_has_content diff-commits '^A */new/dir/file$'
+assert_streq "$(wc -l < diff-commits)" "6"
+echo "ok diff commits"
+
 cd ${test_tmpdir}/checkout-test2-4
 echo afile > oh-look-a-file
 $OSTREE diff ${DIFF_ARGS} test2 ./ > ${test_tmpdir}/diff-test2-2
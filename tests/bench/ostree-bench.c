@@ -0,0 +1,819 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Benchmarks for core repository operations, run against a synthetic tree
+ * generated from a seed; see tests/bench/README.md.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <glib.h>
+#include <libglnx.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ostree.h"
+#include "ul-jsonwrt.h"
+
+#define BENCH_REF "bench"
+/* Commits use a fixed timestamp so that their checksums are reproducible */
+#define BENCH_COMMIT_TIME 1704067200
+
+static int opt_files = 2000;
+static int opt_dir_width = 64;
+static char *opt_size_distribution = "mixed";
+static int opt_xattr_percent = 10;
+static int opt_hardlink_percent = 5;
+static int opt_change_percent = 10;
+static int opt_seed = 0;
+static int opt_iterations = 3;
+static int opt_jobs = 1;
+static char *opt_mode = "bare-user";
+static gboolean opt_fsync;
+static char *opt_workdir = "/var/tmp";
+static char *opt_output;
+static char *opt_httpd;
+
+static GOptionEntry options[] = {
+  { "files", 0, 0, G_OPTION_ARG_INT, &opt_files, "Number of files in the tree (default 2000)",
+    "N" },
+  { "dir-width", 0, 0, G_OPTION_ARG_INT, &opt_dir_width,
+    "Number of entries per directory (default 64)", "N" },
+  { "size-distribution", 0, 0, G_OPTION_ARG_STRING, &opt_size_distribution,
+    "File sizes: small, mixed, large or fixed:BYTES (default mixed)", "DIST" },
+  { "xattr-percent", 0, 0, G_OPTION_ARG_INT, &opt_xattr_percent,
+    "Percentage of files with an extended attribute (default 10)", "PERCENT" },
+  { "hardlink-percent", 0, 0, G_OPTION_ARG_INT, &opt_hardlink_percent,
+    "Percentage of files which are hardlinks to another (default 5)", "PERCENT" },
+  { "change-percent", 0, 0, G_OPTION_ARG_INT, &opt_change_percent,
+    "Percentage of files which change between the two commits (default 10)", "PERCENT" },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &opt_seed, "Seed for the tree generator (default 0)",
+    "SEED" },
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &opt_iterations,
+    "Number of times to run each benchmark (default 3)", "N" },
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs,
+    "Number of threads for operations which support them (default 1)", "N" },
+  { "mode", 0, 0, G_OPTION_ARG_STRING, &opt_mode,
+    "Mode of the repositories written to (default bare-user)", "MODE" },
+  { "fsync", 0, 0, G_OPTION_ARG_NONE, &opt_fsync, "Do not disable fsync in the repositories",
+    NULL },
+  { "workdir", 0, 0, G_OPTION_ARG_FILENAME, &opt_workdir,
+    "Create the scratch directory in DIR (default /var/tmp)", "DIR" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+    "Write results to FILE rather than stdout", "FILE" },
+  { "httpd", 0, 0, G_OPTION_ARG_FILENAME, &opt_httpd,
+    "Path to ostree-trivial-httpd (default $OSTREE_HTTPD)", "PATH" },
+  { NULL }
+};
+
+typedef struct
+{
+  const char *name;
+  guint64 min;
+  guint64 max;
+  gboolean log_uniform;
+} SizeDistribution;
+
+static const SizeDistribution size_distributions[] = {
+  { "small", 0, 4096, FALSE },
+  { "mixed", 16, 256 * 1024, TRUE },
+  { "large", 1024 * 1024, 16 * 1024 * 1024, TRUE },
+};
+
+typedef struct
+{
+  GLnxTmpDir workdir;
+  OstreeRepoMode mode;
+  SizeDistribution size_dist;
+  GRand *rand;
+
+  /* The generated tree */
+  int tree_dfd;
+  GPtrArray *files;
+  guint n_hardlinks;
+  guint64 total_size;
+
+  /* An archive repository holding two commits of the tree, the second
+   * after some of the files were changed.
+   */
+  OstreeRepo *source_repo;
+  char *source_url;
+  char *rev1;
+  char *rev2;
+
+  /* Set up on demand */
+  OstreeRepo *local_repo;
+  char *delta_path;
+  GSubprocess *httpd;
+  char *http_url;
+} Bench;
+
+static void
+bench_clear (Bench *bench)
+{
+  if (bench->httpd)
+    {
+      g_subprocess_force_exit (bench->httpd);
+      (void)g_subprocess_wait (bench->httpd, NULL, NULL);
+    }
+  g_clear_object (&bench->httpd);
+  g_clear_pointer (&bench->http_url, g_free);
+  g_clear_pointer (&bench->delta_path, g_free);
+  g_clear_object (&bench->local_repo);
+  g_clear_pointer (&bench->rev2, g_free);
+  g_clear_pointer (&bench->rev1, g_free);
+  g_clear_pointer (&bench->source_url, g_free);
+  g_clear_object (&bench->source_repo);
+  g_clear_pointer (&bench->files, g_ptr_array_unref);
+  glnx_close_fd (&bench->tree_dfd);
+  g_clear_pointer (&bench->rand, g_rand_free);
+  (void)glnx_tmpdir_delete (&bench->workdir, NULL, NULL);
+}
+
+static gboolean
+parse_size_distribution (const char *str, SizeDistribution *out_dist, GError **error)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (size_distributions); i++)
+    {
+      if (g_str_equal (str, size_distributions[i].name))
+        {
+          *out_dist = size_distributions[i];
+          return TRUE;
+        }
+    }
+
+  if (g_str_has_prefix (str, "fixed:"))
+    {
+      guint64 size;
+      if (!g_ascii_string_to_unsigned (str + strlen ("fixed:"), 10, 0, G_MAXUINT32, &size, error))
+        return FALSE;
+      *out_dist = (SizeDistribution){ str, size, size, FALSE };
+      return TRUE;
+    }
+
+  return glnx_throw (error, "Unknown size distribution '%s'", str);
+}
+
+static guint64
+random_size (GRand *rand, const SizeDistribution *dist)
+{
+  if (dist->min == dist->max)
+    return dist->min;
+  if (!dist->log_uniform)
+    return dist->min + (guint64)(g_rand_double (rand) * (dist->max - dist->min + 1));
+
+  /* Pick a power of two uniformly, then a size uniformly within it; most
+   * files are small, but most of the data is in large files.
+   */
+  const guint lo = g_bit_storage (dist->min) - 1;
+  const guint hi = g_bit_storage (dist->max) - 1;
+  const guint64 base = G_GUINT64_CONSTANT (1) << (lo + g_rand_int_range (rand, 0, hi - lo));
+  return base + (guint64)(g_rand_double (rand) * base);
+}
+
+static gboolean
+write_random_file (Bench *bench, const char *path, guint64 *out_size, GError **error)
+{
+  const guint64 size = random_size (bench->rand, &bench->size_dist);
+  g_autofree guint8 *buf = g_malloc (MAX (size, 1));
+
+  /* Draw from 16 symbols, so the content compresses somewhat */
+  for (guint64 i = 0; i < size; i += 4)
+    {
+      const guint32 v = g_rand_int (bench->rand);
+      for (guint j = 0; j < 4 && i + j < size; j++)
+        buf[i + j] = 'a' + ((v >> (j * 8)) & 0xf);
+    }
+
+  if (!glnx_file_replace_contents_at (bench->tree_dfd, path, buf, size,
+                                      GLNX_FILE_REPLACE_NODATASYNC, NULL, error))
+    return FALSE;
+
+  *out_size = size;
+  return TRUE;
+}
+
+static gboolean
+generate_tree (Bench *bench, GError **error)
+{
+  if (!glnx_ensure_dir (bench->workdir.fd, "tree", 0755, error))
+    return FALSE;
+  if (!glnx_opendirat (bench->workdir.fd, "tree", TRUE, &bench->tree_dfd, error))
+    return FALSE;
+
+  for (guint i = 0; i < (guint)opt_files; i++)
+    {
+      const guint dir_index = i / opt_dir_width;
+      g_autofree char *dir
+          = g_strdup_printf ("d%u/d%u", dir_index / opt_dir_width, dir_index % opt_dir_width);
+      if (i % opt_dir_width == 0
+          && !glnx_shutil_mkdir_p_at (bench->tree_dfd, dir, 0755, NULL, error))
+        return FALSE;
+
+      g_autofree char *path = g_strdup_printf ("%s/f%u", dir, i);
+      if (bench->files->len > 0 && g_rand_int_range (bench->rand, 0, 100) < opt_hardlink_percent)
+        {
+          const char *target
+              = bench->files->pdata[g_rand_int_range (bench->rand, 0, bench->files->len)];
+          if (linkat (bench->tree_dfd, target, bench->tree_dfd, path, 0) < 0)
+            return glnx_throw_errno_prefix (error, "linkat(%s)", path);
+          bench->n_hardlinks++;
+        }
+      else
+        {
+          guint64 size;
+          if (!write_random_file (bench, path, &size, error))
+            return FALSE;
+          bench->total_size += size;
+        }
+
+      g_ptr_array_add (bench->files, g_steal_pointer (&path));
+    }
+
+  return TRUE;
+}
+
+/* Rewrite some of the files with new content; this breaks any hardlinks
+ * to them.
+ */
+static gboolean
+change_tree (Bench *bench, GError **error)
+{
+  for (guint i = 0; i < bench->files->len; i++)
+    {
+      if (g_rand_int_range (bench->rand, 0, 100) >= opt_change_percent)
+        continue;
+      guint64 size;
+      if (!write_random_file (bench, bench->files->pdata[i], &size, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Extended attributes come from here rather than the disk, so they are the
+ * same whatever the filesystem supports.
+ */
+static GVariant *
+bench_xattr_cb (OstreeRepo *repo, const char *path, GFileInfo *file_info, gpointer user_data)
+{
+  if (g_file_info_get_file_type (file_info) != G_FILE_TYPE_REGULAR)
+    return NULL;
+  if (g_str_hash (path) % 100 >= (guint)opt_xattr_percent)
+    return NULL;
+
+  g_auto (GVariantBuilder) builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ayay)"));
+  g_variant_builder_add (&builder, "(@ay@ay)", g_variant_new_bytestring ("user.bench"),
+                         g_variant_new_bytestring (path));
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static OstreeRepo *
+bench_create_repo (Bench *bench, const char *name, OstreeRepoMode mode, GError **error)
+{
+  if (!glnx_shutil_rm_rf_at (bench->workdir.fd, name, NULL, error))
+    return NULL;
+  g_autoptr (OstreeRepo) repo
+      = ostree_repo_create_at (bench->workdir.fd, name, mode, NULL, NULL, error);
+  if (!repo)
+    return NULL;
+  ostree_repo_set_disable_fsync (repo, !opt_fsync);
+  return g_steal_pointer (&repo);
+}
+
+static gboolean
+bench_commit (Bench *bench, OstreeRepo *repo, const char *parent, char **out_rev, GError **error)
+{
+  g_autoptr (OstreeRepoCommitModifier) modifier
+      = ostree_repo_commit_modifier_new (OSTREE_REPO_COMMIT_MODIFIER_FLAGS_SKIP_XATTRS, NULL, NULL,
+                                         NULL);
+  ostree_repo_commit_modifier_set_xattr_callback (modifier, bench_xattr_cb, NULL, NULL);
+  ostree_repo_commit_modifier_set_n_jobs (modifier, opt_jobs);
+
+  if (!ostree_repo_prepare_transaction (repo, NULL, NULL, error))
+    return FALSE;
+
+  g_autoptr (OstreeMutableTree) mtree = ostree_mutable_tree_new ();
+  if (!ostree_repo_write_dfd_to_mtree (repo, bench->tree_dfd, ".", mtree, modifier, NULL, error))
+    return FALSE;
+  g_autoptr (GFile) root = NULL;
+  if (!ostree_repo_write_mtree (repo, mtree, &root, NULL, error))
+    return FALSE;
+  g_autofree char *rev = NULL;
+  if (!ostree_repo_write_commit_with_time (repo, parent, "Benchmark", NULL, NULL,
+                                           OSTREE_REPO_FILE (root), BENCH_COMMIT_TIME, &rev, NULL,
+                                           error))
+    return FALSE;
+  ostree_repo_transaction_set_ref (repo, NULL, BENCH_REF, rev);
+
+  if (!ostree_repo_commit_transaction (repo, NULL, NULL, error))
+    return FALSE;
+
+  if (out_rev)
+    *out_rev = g_steal_pointer (&rev);
+  return TRUE;
+}
+
+/* @ref may also be a commit checksum */
+static gboolean
+bench_pull (OstreeRepo *repo, const char *url, const char *ref, int depth, GError **error)
+{
+  const char *refs[] = { ref, NULL };
+  g_auto (GVariantBuilder) builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{s@v}", "refs",
+                         g_variant_new_variant (g_variant_new_strv (refs, -1)));
+  g_variant_builder_add (&builder, "{s@v}", "depth",
+                         g_variant_new_variant (g_variant_new_int32 (depth)));
+  g_variant_builder_add (&builder, "{s@v}", "gpg-verify",
+                         g_variant_new_variant (g_variant_new_boolean (FALSE)));
+  g_variant_builder_add (&builder, "{s@v}", "gpg-verify-summary",
+                         g_variant_new_variant (g_variant_new_boolean (FALSE)));
+  g_autoptr (GVariant) pull_options = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  return ostree_repo_pull_with_options (repo, url, pull_options, NULL, NULL, error);
+}
+
+static gboolean
+ensure_local_repo (Bench *bench, GError **error)
+{
+  if (bench->local_repo)
+    return TRUE;
+
+  g_autoptr (OstreeRepo) repo = bench_create_repo (bench, "local", bench->mode, error);
+  if (!repo)
+    return FALSE;
+  if (!bench_pull (repo, bench->source_url, BENCH_REF, 1, error))
+    return FALSE;
+
+  bench->local_repo = g_steal_pointer (&repo);
+  return TRUE;
+}
+
+static gboolean
+generate_delta (Bench *bench, GError **error)
+{
+  g_auto (GVariantBuilder) builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{s@v}", "filename",
+                         g_variant_new_variant (g_variant_new_bytestring (bench->delta_path)));
+  g_variant_builder_add (&builder, "{s@v}", "inline-parts",
+                         g_variant_new_variant (g_variant_new_boolean (TRUE)));
+  g_variant_builder_add (&builder, "{s@v}", "n-jobs",
+                         g_variant_new_variant (g_variant_new_uint32 (opt_jobs)));
+  g_autoptr (GVariant) params = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  return ostree_repo_static_delta_generate (bench->source_repo,
+                                            OSTREE_STATIC_DELTA_GENERATE_OPT_MAJOR, bench->rev1,
+                                            bench->rev2, NULL, params, NULL, error);
+}
+
+static gboolean
+ensure_httpd (Bench *bench, GError **error)
+{
+  if (bench->http_url)
+    return TRUE;
+
+  const char *httpd = opt_httpd ?: g_getenv ("OSTREE_HTTPD");
+  if (!httpd || !*httpd)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           "ostree-trivial-httpd not found; set OSTREE_HTTPD or use --httpd");
+      return FALSE;
+    }
+
+  bench->httpd = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE, error, httpd, "--autoexit",
+                                   "--port-file", "-", bench->workdir.path, NULL);
+  if (!bench->httpd)
+    return FALSE;
+
+  g_autoptr (GDataInputStream) in
+      = g_data_input_stream_new (g_subprocess_get_stdout_pipe (bench->httpd));
+  g_autofree char *port = g_data_input_stream_read_line (in, NULL, NULL, error);
+  if (!port)
+    {
+      if (error && !*error)
+        glnx_throw (error, "%s exited without reporting its port", httpd);
+      return FALSE;
+    }
+
+  bench->http_url = g_strdup_printf ("http://127.0.0.1:%s/source", g_strstrip (port));
+  return TRUE;
+}
+
+typedef gboolean (*BenchFunc) (Bench *bench, gint64 *out_elapsed, GError **error);
+
+static gboolean
+run_commit (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  g_autoptr (OstreeRepo) repo = bench_create_repo (bench, "commit", bench->mode, error);
+  if (!repo)
+    return FALSE;
+
+  const gint64 start = g_get_monotonic_time ();
+  if (!bench_commit (bench, repo, NULL, NULL, error))
+    return FALSE;
+  *out_elapsed = g_get_monotonic_time () - start;
+
+  return glnx_shutil_rm_rf_at (bench->workdir.fd, "commit", NULL, error);
+}
+
+static gboolean
+run_checkout (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  if (!ensure_local_repo (bench, error))
+    return FALSE;
+
+  OstreeRepoCheckoutAtOptions checkout_options = {
+    0,
+  };
+  if (bench->mode != OSTREE_REPO_MODE_BARE)
+    checkout_options.mode = OSTREE_REPO_CHECKOUT_MODE_USER;
+  checkout_options.n_jobs = opt_jobs;
+
+  const gint64 start = g_get_monotonic_time ();
+  if (!ostree_repo_checkout_at (bench->local_repo, &checkout_options, bench->workdir.fd,
+                                "checkout", bench->rev1, NULL, error))
+    return FALSE;
+  *out_elapsed = g_get_monotonic_time () - start;
+
+  return glnx_shutil_rm_rf_at (bench->workdir.fd, "checkout", NULL, error);
+}
+
+static gboolean
+run_pull (Bench *bench, const char *url, gint64 *out_elapsed, GError **error)
+{
+  g_autoptr (OstreeRepo) repo = bench_create_repo (bench, "pull", bench->mode, error);
+  if (!repo)
+    return FALSE;
+
+  const gint64 start = g_get_monotonic_time ();
+  if (!bench_pull (repo, url, BENCH_REF, 0, error))
+    return FALSE;
+  *out_elapsed = g_get_monotonic_time () - start;
+
+  return glnx_shutil_rm_rf_at (bench->workdir.fd, "pull", NULL, error);
+}
+
+static gboolean
+run_pull_local (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  return run_pull (bench, bench->source_url, out_elapsed, error);
+}
+
+static gboolean
+run_pull_http (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  if (!ensure_httpd (bench, error))
+    return FALSE;
+  return run_pull (bench, bench->http_url, out_elapsed, error);
+}
+
+static gboolean
+run_delta_generate (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  const gint64 start = g_get_monotonic_time ();
+  if (!generate_delta (bench, error))
+    return FALSE;
+  *out_elapsed = g_get_monotonic_time () - start;
+
+  return TRUE;
+}
+
+static gboolean
+run_delta_apply (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  if (!g_file_test (bench->delta_path, G_FILE_TEST_EXISTS) && !generate_delta (bench, error))
+    return FALSE;
+
+  g_autoptr (OstreeRepo) repo = bench_create_repo (bench, "delta-apply", bench->mode, error);
+  if (!repo)
+    return FALSE;
+  if (!bench_pull (repo, bench->source_url, bench->rev1, 0, error))
+    return FALSE;
+  g_autoptr (GFile) delta = g_file_new_for_path (bench->delta_path);
+
+  const gint64 start = g_get_monotonic_time ();
+  if (!ostree_repo_prepare_transaction (repo, NULL, NULL, error))
+    return FALSE;
+  if (!ostree_repo_static_delta_execute_offline (repo, delta, FALSE, NULL, error))
+    return FALSE;
+  if (!ostree_repo_commit_transaction (repo, NULL, NULL, error))
+    return FALSE;
+  *out_elapsed = g_get_monotonic_time () - start;
+
+  return glnx_shutil_rm_rf_at (bench->workdir.fd, "delta-apply", NULL, error);
+}
+
+/* Prune the objects only reachable from the first commit */
+static gboolean
+run_prune (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  g_autoptr (OstreeRepo) repo = bench_create_repo (bench, "prune", bench->mode, error);
+  if (!repo)
+    return FALSE;
+  if (!bench_pull (repo, bench->source_url, BENCH_REF, 1, error))
+    return FALSE;
+
+  gint n_total, n_pruned;
+  guint64 pruned_size;
+  const gint64 start = g_get_monotonic_time ();
+  if (!ostree_repo_prune (repo, OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY, 0, &n_total, &n_pruned,
+                          &pruned_size, NULL, error))
+    return FALSE;
+  *out_elapsed = g_get_monotonic_time () - start;
+
+  return glnx_shutil_rm_rf_at (bench->workdir.fd, "prune", NULL, error);
+}
+
+static gboolean
+fsck_cb (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
+         const GError *fsck_error, gpointer user_data, GError **error)
+{
+  if (fsck_error)
+    return glnx_throw (error, "Object %s.%s is corrupt: %s", checksum,
+                       ostree_object_type_to_string (objtype), fsck_error->message);
+  return TRUE;
+}
+
+static gboolean
+run_fsck (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  if (!ensure_local_repo (bench, error))
+    return FALSE;
+
+  g_autoptr (GHashTable) objects = NULL;
+  if (!ostree_repo_list_objects (bench->local_repo, OSTREE_REPO_LIST_OBJECTS_ALL, &objects, NULL,
+                                 error))
+    return FALSE;
+  g_auto (GVariantBuilder) builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{s@v}", "n-jobs",
+                         g_variant_new_variant (g_variant_new_uint32 (opt_jobs)));
+  g_autoptr (GVariant) fsck_options = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  const gint64 start = g_get_monotonic_time ();
+  if (!ostree_repo_fsck_objects (bench->local_repo, objects, fsck_options, fsck_cb, NULL, NULL,
+                                 error))
+    return FALSE;
+  *out_elapsed = g_get_monotonic_time () - start;
+
+  return TRUE;
+}
+
+static gboolean
+run_summary (Bench *bench, gint64 *out_elapsed, GError **error)
+{
+  const gint64 start = g_get_monotonic_time ();
+  if (!ostree_repo_regenerate_summary (bench->source_repo, NULL, NULL, error))
+    return FALSE;
+  *out_elapsed = g_get_monotonic_time () - start;
+
+  return TRUE;
+}
+
+static const struct
+{
+  const char *name;
+  BenchFunc func;
+} benchmarks[] = {
+  { "commit", run_commit },
+  { "checkout", run_checkout },
+  { "pull-local", run_pull_local },
+  { "pull-http", run_pull_http },
+  { "delta-generate", run_delta_generate },
+  { "delta-apply", run_delta_apply },
+  { "prune", run_prune },
+  { "fsck", run_fsck },
+  { "summary", run_summary },
+};
+
+static gboolean
+bench_setup (Bench *bench, GError **error)
+{
+  g_autofree char *workdir = g_canonicalize_filename (opt_workdir, NULL);
+  g_autofree char *template = g_build_filename (workdir, "ostree-bench-XXXXXX", NULL);
+  if (!glnx_mkdtempat (AT_FDCWD, template, 0700, &bench->workdir, error))
+    return FALSE;
+
+  bench->rand = g_rand_new_with_seed (opt_seed);
+  bench->files = g_ptr_array_new_with_free_func (g_free);
+  bench->delta_path = g_build_filename (bench->workdir.path, "bench.delta", NULL);
+  bench->source_url = g_strconcat ("file://", bench->workdir.path, "/source", NULL);
+
+  g_printerr ("Generating tree in %s\n", bench->workdir.path);
+  if (!generate_tree (bench, error))
+    return FALSE;
+
+  bench->source_repo = bench_create_repo (bench, "source", OSTREE_REPO_MODE_ARCHIVE, error);
+  if (!bench->source_repo)
+    return FALSE;
+  if (!bench_commit (bench, bench->source_repo, NULL, &bench->rev1, error))
+    return FALSE;
+  if (!change_tree (bench, error))
+    return FALSE;
+  if (!bench_commit (bench, bench->source_repo, bench->rev1, &bench->rev2, error))
+    return FALSE;
+
+  return TRUE;
+}
+
+static int
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void
+write_samples (struct ul_jsonwrt *jo, GArray *samples)
+{
+  g_autoptr (GArray) sorted = g_array_copy (samples);
+  g_array_sort (sorted, compare_doubles);
+  double total = 0;
+  for (guint i = 0; i < samples->len; i++)
+    total += g_array_index (samples, double, i);
+
+  ul_jsonwrt_array_open (jo, "samples-ms");
+  for (guint i = 0; i < samples->len; i++)
+    ul_jsonwrt_value_double (jo, NULL, g_array_index (samples, double, i));
+  ul_jsonwrt_array_close (jo);
+  ul_jsonwrt_value_double (jo, "min-ms", g_array_index (sorted, double, 0));
+  ul_jsonwrt_value_double (jo, "median-ms", g_array_index (sorted, double, sorted->len / 2));
+  ul_jsonwrt_value_double (jo, "mean-ms", total / samples->len);
+  ul_jsonwrt_value_double (jo, "max-ms", g_array_index (sorted, double, sorted->len - 1));
+}
+
+static void
+write_config (struct ul_jsonwrt *jo, Bench *bench)
+{
+  ul_jsonwrt_object_open (jo, "config");
+  ul_jsonwrt_value_u64 (jo, "files", opt_files);
+  ul_jsonwrt_value_u64 (jo, "dir-width", opt_dir_width);
+  ul_jsonwrt_value_s (jo, "size-distribution", opt_size_distribution);
+  ul_jsonwrt_value_u64 (jo, "xattr-percent", opt_xattr_percent);
+  ul_jsonwrt_value_u64 (jo, "hardlink-percent", opt_hardlink_percent);
+  ul_jsonwrt_value_u64 (jo, "change-percent", opt_change_percent);
+  ul_jsonwrt_value_u64 (jo, "seed", (guint32)opt_seed);
+  ul_jsonwrt_value_u64 (jo, "iterations", opt_iterations);
+  ul_jsonwrt_value_u64 (jo, "jobs", opt_jobs);
+  ul_jsonwrt_value_s (jo, "mode", opt_mode);
+  ul_jsonwrt_value_boolean (jo, "fsync", opt_fsync);
+  ul_jsonwrt_object_close (jo);
+
+  ul_jsonwrt_object_open (jo, "tree");
+  ul_jsonwrt_value_u64 (jo, "files", bench->files->len);
+  ul_jsonwrt_value_u64 (jo, "hardlinks", bench->n_hardlinks);
+  ul_jsonwrt_value_u64 (jo, "bytes", bench->total_size);
+  ul_jsonwrt_value_s (jo, "commit", bench->rev1);
+  ul_jsonwrt_value_s (jo, "changed-commit", bench->rev2);
+  ul_jsonwrt_object_close (jo);
+}
+
+static gboolean
+run_benchmarks (Bench *bench, struct ul_jsonwrt *jo, GPtrArray *selected, GError **error)
+{
+  ul_jsonwrt_array_open (jo, "benchmarks");
+
+  for (guint i = 0; i < selected->len; i++)
+    {
+      const guint j = GPOINTER_TO_UINT (selected->pdata[i]);
+      const char *name = benchmarks[j].name;
+      g_autoptr (GArray) samples = g_array_new (FALSE, FALSE, sizeof (double));
+      g_autoptr (GError) local_error = NULL;
+
+      for (int iteration = 0; iteration < opt_iterations; iteration++)
+        {
+          gint64 elapsed = 0;
+          if (!benchmarks[j].func (bench, &elapsed, &local_error))
+            break;
+          const double ms = elapsed / 1000.0;
+          g_printerr ("%s: iteration %d/%d: %.1f ms\n", name, iteration + 1, opt_iterations, ms);
+          g_array_append_val (samples, ms);
+        }
+
+      if (local_error && !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+        {
+          g_propagate_prefixed_error (error, g_steal_pointer (&local_error), "%s: ", name);
+          return FALSE;
+        }
+
+      ul_jsonwrt_object_open (jo, NULL);
+      ul_jsonwrt_value_s (jo, "name", name);
+      if (local_error)
+        {
+          g_printerr ("%s: skipped: %s\n", name, local_error->message);
+          ul_jsonwrt_value_s (jo, "skipped", local_error->message);
+        }
+      else
+        write_samples (jo, samples);
+      ul_jsonwrt_object_close (jo);
+    }
+
+  ul_jsonwrt_array_close (jo);
+  return TRUE;
+}
+
+static gboolean
+run (int argc, char **argv, GError **error)
+{
+  g_autoptr (GOptionContext) context
+      = g_option_context_new ("[BENCHMARK...] - Benchmark core repository operations");
+  g_option_context_add_main_entries (context, options, NULL);
+  g_option_context_set_description (
+      context, "Benchmarks: commit, checkout, pull-local, pull-http, delta-generate, "
+               "delta-apply, prune, fsck, summary (default all)");
+  if (!g_option_context_parse (context, &argc, &argv, error))
+    return FALSE;
+
+  if (opt_files < 1 || opt_dir_width < 1 || opt_iterations < 1 || opt_jobs < 0)
+    return glnx_throw (error, "--files, --dir-width, --iterations and --jobs must be positive");
+  if (opt_xattr_percent < 0 || opt_xattr_percent > 100 || opt_hardlink_percent < 0
+      || opt_hardlink_percent > 100 || opt_change_percent < 0 || opt_change_percent > 100)
+    return glnx_throw (error, "Percentages must be between 0 and 100");
+
+  g_autoptr (GPtrArray) selected = g_ptr_array_new ();
+  for (int i = 1; i < argc; i++)
+    {
+      guint j;
+      for (j = 0; j < G_N_ELEMENTS (benchmarks); j++)
+        if (g_str_equal (argv[i], benchmarks[j].name))
+          break;
+      if (j == G_N_ELEMENTS (benchmarks))
+        return glnx_throw (error, "Unknown benchmark '%s'", argv[i]);
+      g_ptr_array_add (selected, GUINT_TO_POINTER (j));
+    }
+  if (selected->len == 0)
+    {
+      for (guint j = 0; j < G_N_ELEMENTS (benchmarks); j++)
+        g_ptr_array_add (selected, GUINT_TO_POINTER (j));
+    }
+
+  __attribute__ ((cleanup (bench_clear))) Bench bench = {
+    .tree_dfd = -1,
+  };
+  if (!ostree_repo_mode_from_string (opt_mode, &bench.mode, error))
+    return FALSE;
+  if (!parse_size_distribution (opt_size_distribution, &bench.size_dist, error))
+    return FALSE;
+  if (!bench_setup (&bench, error))
+    return FALSE;
+
+  FILE *out = stdout;
+  if (opt_output)
+    {
+      out = fopen (opt_output, "w");
+      if (!out)
+        return glnx_throw_errno_prefix (error, "fopen(%s)", opt_output);
+    }
+
+  struct ul_jsonwrt jo;
+  ul_jsonwrt_init (&jo, out, 0);
+  ul_jsonwrt_root_open (&jo);
+  ul_jsonwrt_value_s (&jo, "version", PACKAGE_VERSION);
+  write_config (&jo, &bench);
+  gboolean ret = run_benchmarks (&bench, &jo, selected, error);
+  ul_jsonwrt_root_close (&jo);
+
+  if (fflush (out) != 0 && ret)
+    ret = glnx_throw_errno_prefix (error, "Writing results");
+  if (out != stdout)
+    fclose (out);
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr (GError) error = NULL;
+
+  /* No setlocale (): the JSON output must use '.' as decimal separator */
+
+  if (!run (argc, argv, &error))
+    {
+      g_printerr ("error: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -52,7 +52,7 @@ function verify_initial_contents() {
     assert_file_has_content baz/cow '^moo$'
 }
 
-n_base_tests=35
+n_base_tests=42
 gpg_tests=3
 if has_ostree_feature gpgme; then
     echo "1..$(($n_base_tests+$gpg_tests))"
@@ -83,6 +83,36 @@ ${CMD_PREFIX} ostree --repo=repo fsck
 verify_initial_contents
 echo "ok pull --per-object-fsync"
 
+# Fixed and adaptive request limits
+for adaptive in true false; do
+    repo_init --no-sign-verify --set=adaptive-concurrency=${adaptive} \
+        --set=max-outstanding-fetcher-requests=1 --set=max-outstanding-deltapart-requests=1 \
+        --set=max-outstanding-write-requests=1
+    ${CMD_PREFIX} ostree --repo=repo pull origin main
+    ${CMD_PREFIX} ostree --repo=repo fsck
+    verify_initial_contents
+done
+cd ${test_tmpdir}
+repo_init --no-sign-verify --set=max-outstanding-write-requests=0
+if ${CMD_PREFIX} ostree --repo=repo pull origin main 2>err.txt; then
+    assert_not_reached "pull with invalid max-outstanding-write-requests succeeded"
+fi
+assert_file_has_content err.txt "max-outstanding-write-requests"
+echo "ok pull concurrency limits"
+
+repo_init --no-sign-verify
+${CMD_PREFIX} ostree --repo=repo pull --trace-file=trace.json origin main
+jq -e '.success == true and .remote == "origin"' trace.json
+jq -e '.phases[] | select(.name == "fetch-content") | .count > 0' trace.json
+jq -e '.phases[] | select(.name == "write-metadata") | .count > 0' trace.json
+jq -e '[.phases[] | (.histogram | map(.count) | add // 0) == .count] | all' trace.json
+# The trace is written for failed pulls too
+if ${CMD_PREFIX} ostree --repo=repo pull --trace-file=trace.json origin nosuchbranch 2>err.txt; then
+    assert_not_reached "pull of nonexistent branch succeeded"
+fi
+jq -e '.success == false and (.error | length > 0)' trace.json
+echo "ok pull --trace-file"
+
 cd ${test_tmpdir}
 mkdir mirrorrepo
 ostree_repo_init mirrorrepo --mode=archive
@@ -230,6 +260,17 @@ if ! skip_one_without_user_xattrs; then
         if ${CMD_PREFIX} ostree --repo=corruptmirrorrepo fsck 2>err.txt; then
             fatal "corrupt mirror repo fsck?"
         fi
+        # Also when fs-verity digests are recorded at write time, since
+        # nothing was verified on the way in
+        rm corruptmirrorrepo-verity -rf
+        ostree_repo_init corruptmirrorrepo-verity --mode=archive
+        ${CMD_PREFIX} ostree --repo=corruptmirrorrepo-verity config set ex-integrity.fsverity maybe
+        ${CMD_PREFIX} ostree --repo=corruptmirrorrepo-verity remote add --set=gpg-verify=false corruptrepo $(cat httpd-address)/ostree/corruptrepo
+        ${CMD_PREFIX} ostree --repo=corruptmirrorrepo-verity pull --mirror --http-trusted corruptrepo main
+        if ${CMD_PREFIX} ostree --repo=corruptmirrorrepo-verity fsck 2>err.txt; then
+            fatal "corrupt mirror repo with fs-verity fsck?"
+        fi
+        assert_file_has_content err.txt "Corrupted.*${checksum}"
     done
 
     # And ensure the repo is reinitialized
@@ -491,6 +532,40 @@ assert_not_has_file baz/saucer
 
 echo "ok static delta"
 
+cd ${test_tmpdir}
+rm deltaparts-files -rf
+mkdir deltaparts-files
+for i in $(seq 8); do
+    head -c 300000 /dev/urandom > deltaparts-files/file${i}
+done
+${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo commit ${COMMIT_ARGS} -b deltaparts -s 'delta parts' --tree=dir=deltaparts-files
+rm deltaparts-files -rf
+deltaparts_rev=$(${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo rev-parse deltaparts)
+${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo static-delta generate --empty --max-chunk-size=1 deltaparts
+${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo static-delta show ${deltaparts_rev} > show.txt
+assert_file_has_content show.txt "Number of parts: [3-9]"
+${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo summary -u
+
+# Several parts are fetched and applied at once
+repo_init --no-sign-verify --set=max-outstanding-deltapart-requests=4
+${CMD_PREFIX} ostree --repo=repo -v pull --require-static-deltas origin deltaparts 2>err.txt
+assert_file_has_content err.txt "starting fetch of deltapart .* ([2-4] in flight"
+${CMD_PREFIX} ostree --repo=repo fsck
+assert_streq "$(${CMD_PREFIX} ostree --repo=repo rev-parse origin:deltaparts)" "${deltaparts_rev}"
+
+# Parts larger than the memory budget are still applied, one at a time
+repo_init --no-sign-verify --set=max-outstanding-deltapart-requests=4 --set=max-deltapart-memory=1
+${CMD_PREFIX} ostree --repo=repo -v pull --require-static-deltas origin deltaparts 2>err.txt
+assert_file_has_content err.txt "starting fetch of deltapart .* (1 in flight"
+assert_not_file_has_content err.txt "starting fetch of deltapart .* ([2-9] in flight"
+${CMD_PREFIX} ostree --repo=repo fsck
+assert_streq "$(${CMD_PREFIX} ostree --repo=repo rev-parse origin:deltaparts)" "${deltaparts_rev}"
+
+${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo static-delta delete ${deltaparts_rev}
+${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo refs --delete deltaparts
+${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo summary -u
+echo "ok pull delta parts concurrently within the memory budget"
+
 cd ${test_tmpdir}
 ${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo static-delta generate --swap-endianness main
 ${CMD_PREFIX} ostree --repo=ostree-srv/gnomerepo summary -u
@@ -624,6 +699,107 @@ ${CMD_PREFIX} ostree --repo=repo remote delete fromcontainer2
 
 echo "ok custom backend"
 
+cd ${test_tmpdir}
+rm ostree-srv/packrepo -rf
+cp -a ostree-srv/gnomerepo ostree-srv/packrepo
+${CMD_PREFIX} ostree --repo=ostree-srv/packrepo prune --pack
+${CMD_PREFIX} ostree --repo=ostree-srv/packrepo summary -u
+test -z "$(find ostree-srv/packrepo/objects -name '*.dirtree' -o -name '*.filez')"
+packrev=$(${CMD_PREFIX} ostree --repo=ostree-srv/packrepo rev-parse main)
+repo_init --no-sign-verify
+${CMD_PREFIX} ostree --repo=repo remote add --no-sign-verify origin-pack $(cat httpd-address)/ostree/packrepo
+# Only ostree-trivial-httpd logs requests
+httpd_log=${test_tmpdir}/httpd/httpd.log
+if test -f ${httpd_log}; then
+    log_start=$(wc -l < ${httpd_log})
+fi
+${CMD_PREFIX} ostree --repo=repo pull --disable-static-deltas origin-pack main
+${CMD_PREFIX} ostree --repo=repo fsck
+assert_streq "$(${CMD_PREFIX} ostree --repo=repo rev-parse origin-pack:main)" "${packrev}"
+if test -f ${httpd_log}; then
+    # Packed objects are fetched with range requests covering several of them
+    tail -n +$((log_start + 1)) ${httpd_log} > pull-log.txt
+    n_pack_requests=$(grep -c 'serving .*/packrepo/objects/pack/.*\.pack$' pull-log.txt || true)
+    n_objects=$(find repo/objects -name '*.dirtree' -o -name '*.dirmeta' -o -name '*.file' -o -name '*.filez' | wc -l)
+    test ${n_pack_requests} -gt 0
+    test ${n_pack_requests} -lt ${n_objects}
+    # Nothing to fetch, so the pack indexes aren't either
+    log_start=$(wc -l < ${httpd_log})
+    ${CMD_PREFIX} ostree --repo=repo pull --disable-static-deltas origin-pack main
+    tail -n +$((log_start + 1)) ${httpd_log} > pull-log.txt
+    assert_not_file_has_content pull-log.txt '/objects/pack/'
+fi
+rm mirrorrepo-pack -rf
+ostree_repo_init mirrorrepo-pack --mode=archive
+${CMD_PREFIX} ostree --repo=mirrorrepo-pack remote add --no-sign-verify origin-pack $(cat httpd-address)/ostree/packrepo
+${CMD_PREFIX} ostree --repo=mirrorrepo-pack pull --mirror --disable-static-deltas origin-pack main
+${CMD_PREFIX} ostree --repo=mirrorrepo-pack fsck
+echo "ok pull from packed repo"
+
+cd ${test_tmpdir}
+rm ostree-srv/chunkrepo chunktree chunktree-co -rf
+cp -a ostree-srv/gnomerepo ostree-srv/chunkrepo
+mkdir chunktree
+dd if=/dev/urandom of=chunktree/big bs=1M count=3 2>/dev/null
+${CMD_PREFIX} ostree --repo=ostree-srv/chunkrepo commit --branch=big chunktree
+${CMD_PREFIX} ostree --repo=ostree-srv/chunkrepo prune --chunk-min-size=1048576
+${CMD_PREFIX} ostree --repo=ostree-srv/chunkrepo summary -u
+test -n "$(find ostree-srv/chunkrepo/objects -name '*.filechunks')"
+repo_init --no-sign-verify
+${CMD_PREFIX} ostree --repo=repo remote add --no-sign-verify origin-chunk $(cat httpd-address)/ostree/chunkrepo
+${CMD_PREFIX} ostree --repo=repo pull --disable-static-deltas origin-chunk big
+${CMD_PREFIX} ostree --repo=repo fsck
+${CMD_PREFIX} ostree --repo=repo checkout ${CHECKOUT_U_ARG} origin-chunk:big chunktree-co
+cmp chunktree/big chunktree-co/big
+rm mirrorrepo-chunk -rf
+ostree_repo_init mirrorrepo-chunk --mode=archive
+${CMD_PREFIX} ostree --repo=mirrorrepo-chunk remote add --no-sign-verify origin-chunk $(cat httpd-address)/ostree/chunkrepo
+${CMD_PREFIX} ostree --repo=mirrorrepo-chunk pull --mirror --disable-static-deltas origin-chunk big
+test -n "$(find mirrorrepo-chunk/objects -name '*.filechunks')"
+${CMD_PREFIX} ostree --repo=mirrorrepo-chunk fsck
+echo "ok pull from chunked repo"
+
+cd ${test_tmpdir}
+rm ostree-srv/truncrepo -rf
+cp -a ostree-srv/gnomerepo ostree-srv/truncrepo
+# Content is written as it is fetched; a short object must not be stored
+obj=$(find ostree-srv/truncrepo/objects -name '*.filez' -printf '%s %p\n' | sort -n | tail -1 | cut -d' ' -f2)
+checksum=$(echo ${obj} | sed -e 's,.*/\([0-9a-f]*\)/\([0-9a-f]*\)\.filez$,\1\2,')
+truncate -s -8 ${obj}
+repo_init --no-sign-verify
+${CMD_PREFIX} ostree --repo=repo remote add --no-sign-verify origin-trunc $(cat httpd-address)/ostree/truncrepo
+if ${CMD_PREFIX} ostree --repo=repo pull --disable-static-deltas origin-trunc main 2>err.txt; then
+    assert_not_reached "pulled truncated object"
+fi
+assert_file_has_content err.txt "${checksum}"
+test -z "$(find repo/objects/${checksum:0:2} -name "${checksum:2}.*" 2>/dev/null)"
+echo "ok pull truncated content"
+
+cd ${test_tmpdir}
+rm ostree-srv/junkrepo -rf
+cp -a ostree-srv/gnomerepo ostree-srv/junkrepo
+# Nothing after the end of the compressed content may be stored
+obj=$(find ostree-srv/junkrepo/objects -name '*.filez' -printf '%s %p\n' | sort -n | tail -1 | cut -d' ' -f2)
+checksum=$(echo ${obj} | sed -e 's,.*/\([0-9a-f]*\)/\([0-9a-f]*\)\.filez$,\1\2,')
+echo junk >> ${obj}
+repo_init --no-sign-verify
+${CMD_PREFIX} ostree --repo=repo remote add --no-sign-verify origin-junk $(cat httpd-address)/ostree/junkrepo
+if ${CMD_PREFIX} ostree --repo=repo pull --disable-static-deltas origin-junk main 2>err.txt; then
+    assert_not_reached "pulled object with trailing data"
+fi
+assert_file_has_content err.txt "Unexpected data after compressed content"
+test -z "$(find repo/objects/${checksum:0:2} -name "${checksum:2}.*" 2>/dev/null)"
+# Archive repos store the compressed stream itself
+rm mirrorrepo-junk -rf
+ostree_repo_init mirrorrepo-junk --mode=archive
+${CMD_PREFIX} ostree --repo=mirrorrepo-junk remote add --no-sign-verify origin-junk $(cat httpd-address)/ostree/junkrepo
+if ${CMD_PREFIX} ostree --repo=mirrorrepo-junk pull --mirror --disable-static-deltas origin-junk main 2>err.txt; then
+    assert_not_reached "mirrored object with trailing data"
+fi
+assert_file_has_content err.txt "Unexpected data after compressed content"
+test ! -e mirrorrepo-junk/objects/${checksum:0:2}/${checksum:2}.filez
+echo "ok pull content with trailing data"
+
 cd ${test_tmpdir}
 repo_init
 ${CMD_PREFIX} ostree --repo=repo remote add origin-bad $(cat httpd-address)/ostree/noent
@@ -0,0 +1,46 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: LGPL-2.0+
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library. If not, see <https://www.gnu.org/licenses/>.
+
+set -euo pipefail
+
+. $(dirname $0)/libtest.sh
+
+# Exports OSTREE_SYSROOT so --sysroot not needed.
+setup_os_repository "archive" "syslinux"
+
+${CMD_PREFIX} ostree --repo=sysroot/ostree/repo pull-local --remote=testos testos-repo testos/buildmain/x86_64-runtime
+rev=$(${CMD_PREFIX} ostree --repo=sysroot/ostree/repo rev-parse testos/buildmain/x86_64-runtime)
+
+# Serial by default
+${CMD_PREFIX} ostree admin deploy --os=testos testos:testos/buildmain/x86_64-runtime
+assert_has_dir sysroot/ostree/deploy/testos/deploy/${rev}.0/usr
+
+${CMD_PREFIX} ostree --repo=sysroot/ostree/repo config set sysroot.checkout-jobs 4
+${CMD_PREFIX} ostree admin deploy --os=testos testos:testos/buildmain/x86_64-runtime
+diff -r sysroot/ostree/deploy/testos/deploy/${rev}.0/usr sysroot/ostree/deploy/testos/deploy/${rev}.1/usr
+
+tap_ok "deploy with sysroot.checkout-jobs"
+
+${CMD_PREFIX} ostree --repo=sysroot/ostree/repo config set sysroot.checkout-jobs many
+if ${CMD_PREFIX} ostree admin deploy --os=testos testos:testos/buildmain/x86_64-runtime 2>err.txt; then
+  fatal "deployed with an invalid sysroot.checkout-jobs"
+fi
+assert_file_has_content_literal err.txt 'sysroot.checkout-jobs'
+
+tap_ok "invalid sysroot.checkout-jobs"
+
+tap_end
@@ -608,6 +608,57 @@ test_dirmeta_xattrs (void)
   g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_FAILED);
 }
 
+static void
+test_traverse_object_set (gconstpointer data)
+{
+  OstreeRepo *repo = OSTREE_REPO (data);
+  g_autofree gchar *commit_checksum = NULL;
+  g_autoptr (GHashTable) reachable = NULL;
+  g_autoptr (GError) error = NULL;
+  GHashTableIter iter;
+  GVariant *serialized_object;
+
+  ostree_repo_resolve_rev (repo, "test2", FALSE, &commit_checksum, &error);
+  g_assert_no_error (error);
+  ostree_repo_traverse_commit (repo, commit_checksum, -1, &reachable, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (OstreeRepoObjectSet) set = ostree_repo_object_set_new ();
+  ostree_repo_traverse_commit_set (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, commit_checksum,
+                                   -1, set, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (ostree_repo_object_set_size (set), ==, g_hash_table_size (reachable));
+
+  g_hash_table_iter_init (&iter, reachable);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&serialized_object, NULL))
+    {
+      const gchar *object_checksum;
+      OstreeObjectType object_type;
+
+      ostree_object_name_deserialize (serialized_object, &object_checksum, &object_type);
+      g_assert_true (ostree_repo_object_set_contains (set, object_checksum, object_type));
+      g_assert_false (ostree_repo_object_set_add (set, object_checksum, object_type));
+    }
+
+  OstreeRepoObjectSetIter setiter;
+  const char *checksum;
+  OstreeObjectType objtype;
+  guint n = 0;
+  ostree_repo_object_set_iter_init (&setiter, set);
+  while (ostree_repo_object_set_iter_next (&setiter, &checksum, &objtype))
+    {
+      g_autoptr (GVariant) key
+          = g_variant_ref_sink (ostree_object_name_serialize (checksum, objtype));
+      g_assert_true (g_hash_table_contains (reachable, key));
+      n++;
+    }
+  g_assert_cmpuint (n, ==, g_hash_table_size (reachable));
+
+  /* The same checksum with a different type is a distinct entry */
+  g_assert_false (
+      ostree_repo_object_set_contains (set, commit_checksum, OSTREE_OBJECT_TYPE_DIR_TREE));
+}
+
 int
 main (int argc, char **argv)
 {
@@ -623,6 +674,7 @@ main (int argc, char **argv)
   g_test_add_data_func ("/repo-not-system", repo, test_repo_is_not_system);
   g_test_add_data_func ("/raw-file-to-archive-stream", repo, test_raw_file_to_archive_stream);
   g_test_add_data_func ("/objectwrites", repo, test_object_writes);
+  g_test_add_data_func ("/traverse-object-set", repo, test_traverse_object_set);
   g_test_add_func ("/xattrs-devino-cache", test_devino_cache_xattrs);
   g_test_add_func ("/break-hardlink", test_break_hardlink);
   g_test_add_func ("/remotename", test_validate_remotename);
@@ -21,6 +21,7 @@
 
 #include "libglnx.h"
 #include "ostree-core-private.h"
+#include "ot-checksum-multibuf.h"
 #include <gio/gio.h>
 #include <glib.h>
 #include <stdlib.h>
@@ -86,10 +87,68 @@ test_ostree_parse_delta_name (void)
   }
 }
 
+static void
+assert_digests_match (const guint8 *const *bufs, const gsize *lens, guint n,
+                      const guint8 *digests)
+{
+  for (guint i = 0; i < n; i++)
+    {
+      g_auto (OtChecksum) hasher = {
+        0,
+      };
+      ot_checksum_init (&hasher);
+      if (lens[i] > 0)
+        ot_checksum_update (&hasher, bufs[i], lens[i]);
+      char expected[OSTREE_SHA256_STRING_LEN + 1];
+      ot_checksum_get_hexdigest (&hasher, expected, sizeof (expected));
+      char actual[OSTREE_SHA256_STRING_LEN + 1];
+      ot_bin2hex (actual, digests + i * OSTREE_SHA256_DIGEST_LEN, OSTREE_SHA256_DIGEST_LEN);
+      g_assert_cmpstr (actual, ==, expected);
+    }
+}
+
+static void
+test_checksum_many (void)
+{
+  /* Lengths around the padding boundaries, and some too big for a lane */
+  static const gsize lens[] = { 0,   1,   55,   56,   63,   64,    65,   119, 120,
+                                128, 500, 1000, 4096, 5000, 20000, 3,    64,  100 };
+  const guint n = G_N_ELEMENTS (lens);
+  g_autofree guint8 *data = g_malloc (20000 + n);
+  for (gsize i = 0; i < 20000 + n; i++)
+    data[i] = (i * 7) ^ (i >> 8);
+  /* Use different offsets so that the buffers are unaligned */
+  const guint8 *bufs[G_N_ELEMENTS (lens)];
+  for (guint i = 0; i < n; i++)
+    bufs[i] = data + i;
+  guint8 digests[G_N_ELEMENTS (lens) * OSTREE_SHA256_DIGEST_LEN];
+
+  ot_checksum_many (bufs, lens, n, digests);
+  assert_digests_match (bufs, lens, n, digests);
+  char empty_checksum[OSTREE_SHA256_STRING_LEN + 1];
+  ot_bin2hex (empty_checksum, digests, OSTREE_SHA256_DIGEST_LEN);
+  g_assert_cmpstr (empty_checksum, ==,
+                   "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+  ot_checksum_many (bufs, lens, 1, digests);
+  assert_digests_match (bufs, lens, 1, digests);
+
+#ifdef OT_CHECKSUM_MULTIBUF_AVX2
+  /* Exercise the kernel directly, including the large buffers */
+  if (_ot_checksum_multibuf_supported ())
+    {
+      memset (digests, 0, sizeof (digests));
+      _ot_checksum_many_avx2 (bufs, lens, n, digests);
+      assert_digests_match (bufs, lens, n, digests);
+    }
+#endif
+}
+
 int
 main (int argc, char **argv)
 {
   g_test_init (&argc, &argv, NULL);
   g_test_add_func ("/ostree_parse_delta_name", test_ostree_parse_delta_name);
+  g_test_add_func ("/checksum-many", test_checksum_many);
   return g_test_run ();
 }
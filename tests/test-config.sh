@@ -21,7 +21,7 @@ set -euo pipefail
 
 . $(dirname $0)/libtest.sh
 
-echo '1..4'
+echo '1..5'
 
 ostree_repo_init repo
 ${CMD_PREFIX} ostree remote add --repo=repo --set=xa.title=Flathub --set=xa.title-is-set=true flathub https://dl.flathub.org/repo/
@@ -114,3 +114,26 @@ v=$(${CMD_PREFIX} ostree config --repo=repo get core.min-free-space-size)
 assert_streq "$v" "100MB"
 
 echo "ok config validation"
+
+if ${CMD_PREFIX} ostree config --repo=repo set core.metadata-cache-size "64MiB" 2>err.txt; then
+    assert_not_reached "ostree config set should reject invalid core.metadata-cache-size"
+fi
+assert_file_has_content err.txt "Invalid metadata-cache-size"
+
+# Small enough that objects get evicted while walking the tree
+ostree config --repo=repo set core.metadata-cache-size "1KB"
+mkdir -p tree/a/b/c tree/d
+echo hello > tree/a/b/c/file
+echo world > tree/d/file
+${CMD_PREFIX} ostree --repo=repo commit -b cached --tree=dir=tree
+rm tree/d/file
+${CMD_PREFIX} ostree --repo=repo commit -b cached --tree=dir=tree
+${CMD_PREFIX} ostree --repo=repo ls -R cached > ls.txt
+assert_file_has_content ls.txt "/a/b/c/file"
+${CMD_PREFIX} ostree --repo=repo diff cached^ cached > diff.txt
+assert_file_has_content diff.txt 'D */d/file'
+${CMD_PREFIX} ostree --repo=repo prune --refs-only --depth=0
+${CMD_PREFIX} ostree --repo=repo fsck
+ostree config --repo=repo unset core.metadata-cache-size
+
+echo "ok config metadata-cache-size"
@@ -26,7 +26,7 @@ skip_without_user_xattrs
 bindatafiles="bash true ostree"
 morebindatafiles="false ls"
 
-echo '1..14'
+echo '1..17'
 
 mkdir repo
 ostree_repo_init repo --mode=archive
@@ -159,6 +159,20 @@ assert_streq "${totalsize_orig}" "${totalsize_swapped}"
 
 echo 'ok generate + show endian swapped'
 
+mkdir delta-serial delta-parallel
+export SOURCE_DATE_EPOCH=1700000000
+${CMD_PREFIX} ostree --repo=repo static-delta generate --max-bsdiff-size=10000 --from=${origrev} --to=${newrev} --filename=delta-serial/superblock
+${CMD_PREFIX} ostree --repo=repo static-delta generate --max-bsdiff-size=10000 --from=${origrev} --to=${newrev} --filename=delta-parallel/superblock --jobs=4
+unset SOURCE_DATE_EPOCH
+assert_has_file delta-parallel/0
+for f in delta-serial/*; do
+    cmp ${f} delta-parallel/$(basename ${f})
+done
+assert_streq "$(ls delta-serial)" "$(ls delta-parallel)"
+rm delta-serial delta-parallel -rf
+
+echo 'ok generate with --jobs is reproducible'
+
 tar xf ${test_srcdir}/pre-endian-deltas-repo-big.tar.xz
 mv pre-endian-deltas-repo{,-big}
 tar xf ${test_srcdir}/pre-endian-deltas-repo-little.tar.xz
@@ -232,6 +246,40 @@ ${CMD_PREFIX} ostree --repo=repo2 ls ${newrev} >/dev/null
 
 echo 'ok apply offline inline'
 
+${CMD_PREFIX} ostree --repo=repo static-delta generate --compression=none --from=${origrev} --to=${newrev}
+${CMD_PREFIX} ostree --repo=repo static-delta show ${origrev}-${newrev} > show.txt
+assert_file_has_content show.txt 'Compression: none'
+rm repo2 -rf
+ostree_repo_init repo2 --mode=bare-user
+${CMD_PREFIX} ostree --repo=repo2 pull-local repo ${origrev}
+${CMD_PREFIX} ostree --repo=repo2 static-delta apply-offline repo/deltas/${deltaprefix}/${deltadir}
+${CMD_PREFIX} ostree --repo=repo2 fsck
+${CMD_PREFIX} ostree --repo=repo2 ls ${newrev} >/dev/null
+
+echo 'ok apply offline uncompressed'
+
+if has_ostree_feature zstd; then
+    head -c 16384 files/bash > zstd-dict
+    ${CMD_PREFIX} ostree --repo=repo static-delta generate --zstd-long --zstd-dictionary=zstd-dict --from=${origrev} --to=${newrev}
+    ${CMD_PREFIX} ostree --repo=repo static-delta show ${origrev}-${newrev} > show.txt
+    assert_file_has_content show.txt 'Compression: zstd'
+    assert_file_has_content show.txt 'Zstd Dictionary Size: 16384'
+    rm repo2 -rf
+    ostree_repo_init repo2 --mode=bare-user
+    ${CMD_PREFIX} ostree --repo=repo2 pull-local repo ${origrev}
+    ${CMD_PREFIX} ostree --repo=repo2 static-delta apply-offline repo/deltas/${deltaprefix}/${deltadir}
+    ${CMD_PREFIX} ostree --repo=repo2 fsck
+    ${CMD_PREFIX} ostree --repo=repo2 ls ${newrev} >/dev/null
+    rm zstd-dict
+    echo 'ok apply offline zstd'
+else
+    if ${CMD_PREFIX} ostree --repo=repo static-delta generate --compression=zstd --from=${origrev} --to=${newrev} 2>err.txt; then
+        assert_not_reached "zstd delta generation unexpectedly succeeded"
+    fi
+    assert_file_has_content err.txt 'not supported by this build'
+    echo 'ok zstd unsupported'
+fi
+
 ${CMD_PREFIX} ostree --repo=repo static-delta list | grep ^${origrev}-${newrev}$ || exit 1
 ${CMD_PREFIX} ostree --repo=repo static-delta list | grep ^${origrev}$ || exit 1
 
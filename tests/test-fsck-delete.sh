@@ -21,7 +21,7 @@ set -euo pipefail
 
 . $(dirname $0)/libtest.sh
 
-echo '1..6'
+echo '1..8'
 
 cd ${test_tmpdir}
 
@@ -79,3 +79,46 @@ fi
 assert_file_has_content fsck "^Validating refs\.\.\.$"
 assert_file_empty fsck-error
 echo "ok 6 fsck-good"
+
+# The same cycle, verifying objects concurrently
+rm $file
+echo whoops > $file
+if ${CMD_PREFIX} ostree fsck --jobs=4 --repo=./f2 > fsck 2> fsck-error; then
+  assert_not_reached "fsck --jobs did not fail"
+fi
+assert_file_has_content fsck-error "^error: In commits"
+if ${CMD_PREFIX} ostree fsck -j 0 --delete --repo=./f2 > fsck 2> fsck-error; then
+  assert_not_reached "fsck --jobs --delete did not fail"
+fi
+assert_file_has_content fsck-error "^In commits"
+assert_file_has_content fsck-error "^Marking commit as partial"
+${CMD_PREFIX} ostree --repo=./f2 pull-local ./f1 > /dev/null
+${CMD_PREFIX} ostree fsck --jobs=4 --repo=./f2 > fsck 2> fsck-error
+assert_file_empty fsck-error
+if ${CMD_PREFIX} ostree fsck --jobs=-1 --repo=./f2 2> fsck-error; then
+  assert_not_reached "fsck --jobs=-1 succeeded"
+fi
+echo "ok 7 fsck-jobs"
+
+${CMD_PREFIX} ostree fsck --incremental --repo=./f2 > fsck 2> fsck-error
+assert_file_empty fsck-error
+test -f f2/state/fsck-journal
+${CMD_PREFIX} ostree fsck --incremental -j 2 --repo=./f2 > fsck 2> fsck-error
+assert_file_empty fsck-error
+# Rewriting an object changes its identity, so it is verified again
+rm $file
+echo whoops > $file
+if ${CMD_PREFIX} ostree fsck --incremental --repo=./f2 > fsck 2> fsck-error; then
+  assert_not_reached "fsck --incremental did not fail"
+fi
+assert_file_has_content fsck-error "^error: In commits"
+# A failed object is not journaled, so it is found and deleted again
+if ${CMD_PREFIX} ostree fsck --incremental --max-age=0 --delete --repo=./f2 > fsck 2> fsck-error; then
+  assert_not_reached "fsck --incremental --delete did not fail"
+fi
+assert_file_has_content fsck-error "^Marking commit as partial"
+test ! -e $file
+${CMD_PREFIX} ostree --repo=./f2 pull-local ./f1 > /dev/null
+${CMD_PREFIX} ostree fsck --incremental --max-age=0 --repo=./f2 > fsck 2> fsck-error
+assert_file_empty fsck-error
+echo "ok 8 fsck-incremental"
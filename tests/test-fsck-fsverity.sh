@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: LGPL-2.0+
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library. If not, see <https://www.gnu.org/licenses/>.
+
+set -euo pipefail
+
+. $(dirname $0)/libtest.sh
+
+cd ${test_tmpdir}
+
+ostree_repo_init repo --mode=archive
+${CMD_PREFIX} ostree --repo=repo config set ex-integrity.fsverity maybe
+mkdir files
+echo first > files/first
+echo second > files/second
+${CMD_PREFIX} ostree --repo=repo commit -b main --tree=dir=files
+if ! test -d repo/state/fsverity; then
+    skip "no fs-verity support"
+fi
+
+echo '1..2'
+
+# The digests recorded at commit time stand in for reading the content
+${CMD_PREFIX} ostree --repo=repo -v fsck 2>err.txt
+assert_file_has_content err.txt "Content object .* verified by fs-verity"
+echo "ok fsck uses recorded fs-verity digests"
+
+# Without them, every object is read again
+rm -rf repo/state/fsverity
+${CMD_PREFIX} ostree --repo=repo -v fsck 2>err.txt
+assert_not_file_has_content err.txt "verified by fs-verity"
+echo "ok fsck reads content without recorded fs-verity digests"
@@ -375,4 +375,108 @@ for i in {1..10}; do
 done
 tap_ok commit and prune together
 
+cd ${test_tmpdir}
+rm -rf repo-pack repo-pack-copy packtree packtree-co
+ostree_repo_init repo-pack --mode=archive
+mkdir -p packtree/subdir
+echo one > packtree/subdir/one
+echo two > packtree/two
+${CMD_PREFIX} ostree --repo=repo-pack commit --branch=packtest packtree
+echo three > packtree/three
+${CMD_PREFIX} ostree --repo=repo-pack commit --branch=packtest2 packtree
+${CMD_PREFIX} ostree --repo=repo-pack prune --pack > out.txt
+assert_file_has_content out.txt "Packed [1-9][0-9]* objects"
+assert_streq "$(find repo-pack/objects -name '*.filez' -o -name '*.dirtree' -o -name '*.dirmeta' | wc -l)" 0
+assert_repo_has_n_commits repo-pack 2
+ls repo-pack/objects/pack/*.index
+${CMD_PREFIX} ostree --repo=repo-pack fsck
+${CMD_PREFIX} ostree --repo=repo-pack cat packtest2 /three > out.txt
+assert_file_has_content out.txt three
+${CMD_PREFIX} ostree --repo=repo-pack checkout packtest packtree-co
+assert_file_has_content packtree-co/subdir/one one
+ostree_repo_init repo-pack-copy --mode=archive
+${CMD_PREFIX} ostree --repo=repo-pack-copy pull-local repo-pack packtest2
+${CMD_PREFIX} ostree --repo=repo-pack-copy fsck
+tap_ok prune --pack
+
+${CMD_PREFIX} ostree --repo=repo-pack refs --delete packtest2
+${CMD_PREFIX} ostree --repo=repo-pack prune --refs-only > out.txt
+assert_file_has_content out.txt "Deleted [1-9][0-9]* objects"
+${CMD_PREFIX} ostree --repo=repo-pack prune --refs-only --no-prune > out.txt
+assert_file_has_content out.txt "No unreachable objects"
+${CMD_PREFIX} ostree --repo=repo-pack fsck
+rm -rf packtree-co
+${CMD_PREFIX} ostree --repo=repo-pack checkout packtest packtree-co
+assert_file_has_content packtree-co/two two
+tap_ok prune packed objects
+
+cd ${test_tmpdir}
+rm -rf repo-index indextree
+ostree_repo_init repo-index --mode=archive
+mkdir -p indextree/shared
+echo shared > indextree/shared/file
+echo one > indextree/one
+${CMD_PREFIX} ostree --repo=repo-index commit --branch=index1 indextree
+rm indextree/one
+echo two > indextree/two
+${CMD_PREFIX} ostree --repo=repo-index commit --branch=index2 indextree
+${CMD_PREFIX} ostree --repo=repo-index prune > out.txt
+assert_file_has_content out.txt "No unreachable objects"
+test -f repo-index/state/prune-index
+# Dropping a root only releases what nothing else references
+${CMD_PREFIX} ostree --repo=repo-index refs --delete index1
+${CMD_PREFIX} ostree --repo=repo-index prune --refs-only > out.txt
+assert_file_has_content out.txt "Deleted [1-9][0-9]* objects"
+${CMD_PREFIX} ostree --repo=repo-index fsck
+${CMD_PREFIX} ostree --repo=repo-index cat index2 /shared/file > out.txt
+assert_file_has_content out.txt shared
+# Deleting a commit uses the recorded root tree, since the commit is gone
+echo three > indextree/three
+rev=$(${CMD_PREFIX} ostree --repo=repo-index commit --branch=index3 indextree)
+${CMD_PREFIX} ostree --repo=repo-index prune > out.txt
+assert_file_has_content out.txt "No unreachable objects"
+${CMD_PREFIX} ostree --repo=repo-index refs --delete index3
+${CMD_PREFIX} ostree --repo=repo-index prune --delete-commit=${rev} > out.txt
+assert_file_has_content out.txt "Deleted [1-9][0-9]* objects"
+${CMD_PREFIX} ostree --repo=repo-index fsck
+# A corrupt index is rebuilt
+echo garbage > repo-index/state/prune-index
+${CMD_PREFIX} ostree --repo=repo-index prune > out.txt
+assert_file_has_content out.txt "No unreachable objects"
+${CMD_PREFIX} ostree --repo=repo-index fsck
+tap_ok prune index
+
+
+cd ${test_tmpdir}
+rm -rf repo-chunk chunktree chunktree-co
+ostree_repo_init repo-chunk --mode=archive
+mkdir chunktree
+dd if=/dev/urandom of=chunktree/big bs=1M count=4 2>/dev/null
+echo small > chunktree/small
+${CMD_PREFIX} ostree --repo=repo-chunk commit --branch=chunktest chunktree
+${CMD_PREFIX} ostree --repo=repo-chunk prune --chunk-min-size=1048576 > out.txt
+assert_file_has_content out.txt "Chunked 1 objects"
+n_chunks_v1=$(find repo-chunk/objects/chunks -name '*.chunk' | wc -l)
+# Change a few bytes in the middle; all but the chunks around it are shared
+printf 'modified' | dd of=chunktree/big bs=1 seek=2000000 conv=notrunc 2>/dev/null
+${CMD_PREFIX} ostree --repo=repo-chunk commit --branch=chunktest2 chunktree
+${CMD_PREFIX} ostree --repo=repo-chunk prune --chunk-min-size=1048576 > out.txt
+assert_file_has_content out.txt "Chunked 1 objects"
+assert_streq "$(find repo-chunk/objects -name '*.filechunks' | wc -l)" 2
+assert_streq "$(find repo-chunk/objects -name '*.filez' | wc -l)" 1
+n_chunks=$(find repo-chunk/objects/chunks -name '*.chunk' | wc -l)
+test ${n_chunks} -gt ${n_chunks_v1}
+test ${n_chunks} -le $((n_chunks_v1 + 3))
+${CMD_PREFIX} ostree --repo=repo-chunk fsck
+${CMD_PREFIX} ostree --repo=repo-chunk checkout chunktest2 chunktree-co
+cmp chunktree/big chunktree-co/big
+tap_ok prune --chunk-min-size
+
+${CMD_PREFIX} ostree --repo=repo-chunk refs --delete chunktest2
+${CMD_PREFIX} ostree --repo=repo-chunk prune --refs-only > out.txt
+assert_file_has_content out.txt "Deleted [1-9][0-9]* objects"
+test $(find repo-chunk/objects/chunks -name '*.chunk' | wc -l) -lt ${n_chunks}
+${CMD_PREFIX} ostree --repo=repo-chunk fsck
+tap_ok prune chunked objects
+
 tap_end
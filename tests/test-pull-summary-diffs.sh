@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: LGPL-2.0+
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library. If not, see <https://www.gnu.org/licenses/>.
+
+set -euo pipefail
+
+. $(dirname $0)/libtest.sh
+
+skip_known_xfail_docker
+
+if ! has_ostree_feature gpgme; then
+    skip "this test requires GPG signed summaries"
+fi
+
+# Ensure repo caching is in use.
+unset OSTREE_SKIP_CACHE
+
+echo "1..3"
+
+COMMIT_SIGN="--gpg-homedir=${TEST_GPG_KEYHOME} --gpg-sign=${TEST_GPG_KEYID_1}"
+setup_fake_remote_repo1 "archive" "${COMMIT_SIGN}"
+srvrepo=${test_tmpdir}/ostree-srv/gnomerepo
+
+commit_branch () {
+    mkdir -p ${test_tmpdir}/ostree-srv/$1-files
+    echo "$2" > ${test_tmpdir}/ostree-srv/$1-files/hello
+    ${CMD_PREFIX} ostree --repo=${srvrepo} commit ${COMMIT_SIGN} -b $1 \
+        --tree=dir=${test_tmpdir}/ostree-srv/$1-files -s "A commit"
+    ${CMD_PREFIX} ostree --repo=${srvrepo} summary -u ${COMMIT_SIGN}
+}
+
+${CMD_PREFIX} ostree --repo=${srvrepo} config set core.summary-diffs 2
+${CMD_PREFIX} ostree --repo=${srvrepo} summary -u ${COMMIT_SIGN}
+assert_not_has_dir ${srvrepo}/summary-diffs
+commit_branch other "hello other"
+assert_streq "$(ls ${srvrepo}/summary-diffs | wc -l)" "1"
+commit_branch other "hello again"
+assert_streq "$(ls ${srvrepo}/summary-diffs | wc -l)" "2"
+commit_branch yet-another "hello yet another"
+# Only diffs from the last two summaries are kept
+assert_streq "$(ls ${srvrepo}/summary-diffs | wc -l)" "2"
+echo "ok summary diffs"
+
+cd ${test_tmpdir}
+ostree_repo_init repo --mode=archive
+${CMD_PREFIX} ostree --repo=repo remote add --set=gpg-verify-summary=true origin $(cat httpd-address)/ostree/gnomerepo
+${CMD_PREFIX} ostree --repo=repo pull origin main
+assert_has_file repo/tmp/cache/summaries/origin
+
+# Hide the full summary, so that the pull has to use a diff
+commit_branch other "hello once more"
+mv ${srvrepo}/summary ${srvrepo}/summary.full
+${CMD_PREFIX} ostree --repo=repo pull origin other
+mv ${srvrepo}/summary.full ${srvrepo}/summary
+cmp repo/tmp/cache/summaries/origin ${srvrepo}/summary
+${CMD_PREFIX} ostree --repo=repo checkout -U other other-copy
+assert_file_has_content other-copy/hello "hello once more"
+echo "ok pull with summary diff"
+
+# A corrupt diff falls back to the full summary
+commit_branch yet-another "hello in the end"
+echo garbage > ${srvrepo}/summary-diffs/$(sha256sum repo/tmp/cache/summaries/origin | cut -d' ' -f1)
+${CMD_PREFIX} ostree --repo=repo pull origin yet-another
+cmp repo/tmp/cache/summaries/origin ${srvrepo}/summary
+echo "ok pull with invalid summary diff"
@@ -0,0 +1,139 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: LGPL-2.0+
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library. If not, see <https://www.gnu.org/licenses/>.
+
+set -euo pipefail
+
+. $(dirname $0)/libtest.sh
+
+skip_known_xfail_docker
+
+# Ensure repo caching is in use.
+unset OSTREE_SKIP_CACHE
+
+COMMIT_SIGN=""
+if has_ostree_feature gpgme; then
+    COMMIT_SIGN="--gpg-homedir=${TEST_GPG_KEYHOME} --gpg-sign=${TEST_GPG_KEYID_1}"
+    echo "1..6"
+else
+    echo "1..4"
+fi
+
+setup_fake_remote_repo1 "archive" "${COMMIT_SIGN}"
+srvrepo=${test_tmpdir}/ostree-srv/gnomerepo
+
+for branch in other yet-another; do
+    mkdir ${test_tmpdir}/ostree-srv/${branch}-files
+    echo "hello ${branch}" > ${test_tmpdir}/ostree-srv/${branch}-files/hello
+    ${CMD_PREFIX} ostree --repo=${srvrepo} commit ${COMMIT_SIGN} -b ${branch} \
+        --tree=dir=${test_tmpdir}/ostree-srv/${branch}-files -s "A commit"
+done
+
+${CMD_PREFIX} ostree --repo=${srvrepo} config set core.summary-shard-size 1
+${CMD_PREFIX} ostree --repo=${srvrepo} summary -u
+assert_has_file ${srvrepo}/summary
+assert_has_file ${srvrepo}/summary.idx
+assert_not_has_file ${srvrepo}/summary.idx.sig
+assert_streq "$(ls ${srvrepo}/summary-shards | wc -l)" "3"
+echo "ok summary index"
+
+repo_reinit () {
+  cd ${test_tmpdir}
+  rm -rf repo
+  ostree_repo_init repo --mode=archive
+  ${CMD_PREFIX} ostree --repo=repo remote add --set=gpg-verify=false \
+      --set=use-summary-index=true "$@" origin $(cat httpd-address)/ostree/gnomerepo
+}
+
+repo_reinit
+${CMD_PREFIX} ostree --repo=repo pull origin other
+${CMD_PREFIX} ostree --repo=repo checkout -U other other-copy
+assert_file_has_content other-copy/hello "hello other"
+assert_has_file repo/tmp/cache/summaries/index/origin
+assert_not_has_file repo/tmp/cache/summaries/origin
+assert_streq "$(ls repo/tmp/cache/summaries/shards | wc -l)" "1"
+if ${CMD_PREFIX} ostree --repo=repo pull origin nosuchbranch 2>err.txt; then
+    assert_not_reached "pull of a missing ref succeeded"
+fi
+assert_file_has_content err.txt "No such branch 'nosuchbranch' in repository summary"
+echo "ok pull with summary index"
+
+# Shards no longer listed in a cached index are pruned
+touch repo/tmp/cache/summaries/shards/unused
+${CMD_PREFIX} ostree --repo=repo prune
+assert_not_has_file repo/tmp/cache/summaries/shards/unused
+assert_streq "$(ls repo/tmp/cache/summaries/shards | wc -l)" "1"
+${CMD_PREFIX} ostree --repo=repo remote delete origin
+${CMD_PREFIX} ostree --repo=repo prune
+assert_not_has_file repo/tmp/cache/summaries/index/origin
+assert_streq "$(ls repo/tmp/cache/summaries/shards | wc -l)" "0"
+echo "ok prune summary index cache"
+
+# Without an index, the full summary is used
+${CMD_PREFIX} ostree --repo=${srvrepo} config set core.summary-shard-size 0
+${CMD_PREFIX} ostree --repo=${srvrepo} summary -u
+assert_not_has_file ${srvrepo}/summary.idx
+assert_not_has_dir ${srvrepo}/summary-shards
+repo_reinit
+${CMD_PREFIX} ostree --repo=repo pull origin yet-another
+assert_has_file repo/tmp/cache/summaries/origin
+echo "ok pull without summary index"
+
+if ! has_ostree_feature gpgme; then
+    exit 0
+fi
+
+${CMD_PREFIX} ostree --repo=${srvrepo} config set core.summary-shard-size 2
+${CMD_PREFIX} ostree --repo=${srvrepo} summary -u ${COMMIT_SIGN}
+assert_has_file ${srvrepo}/summary.idx.sig
+repo_reinit --set=gpg-verify-summary=true
+${CMD_PREFIX} ostree --repo=repo pull origin yet-another
+assert_has_file repo/tmp/cache/summaries/index/origin.sig
+assert_not_has_file repo/tmp/cache/summaries/origin
+
+# A tampered index fails verification
+cp ${srvrepo}/summary.idx.sig ${srvrepo}/summary.idx.sig.orig
+cp ${srvrepo}/summary.sig ${srvrepo}/summary.idx.sig
+rm -rf repo/tmp/cache/summaries
+if ${CMD_PREFIX} ostree --repo=repo pull origin yet-another 2>err.txt; then
+    assert_not_reached "pull with a mismatched summary index signature succeeded"
+fi
+mv ${srvrepo}/summary.idx.sig.orig ${srvrepo}/summary.idx.sig
+echo "ok pull with signed summary index"
+
+# The index and the summary are signed with the same keys, but neither can
+# be passed off as the other
+for f in summary summary.sig summary.idx summary.idx.sig; do
+    cp ${srvrepo}/${f} ${srvrepo}/${f}.orig
+done
+cp ${srvrepo}/summary.orig ${srvrepo}/summary.idx
+cp ${srvrepo}/summary.sig.orig ${srvrepo}/summary.idx.sig
+rm -rf repo/tmp/cache/summaries
+if ${CMD_PREFIX} ostree --repo=repo pull origin yet-another 2>err.txt; then
+    assert_not_reached "pull with a summary served as the summary index succeeded"
+fi
+assert_file_has_content err.txt "Summary index lacks ostree.summary-index"
+cp ${srvrepo}/summary.idx.orig ${srvrepo}/summary
+cp ${srvrepo}/summary.idx.sig.orig ${srvrepo}/summary.sig
+repo_reinit --set=gpg-verify-summary=true --set=use-summary-index=false
+if ${CMD_PREFIX} ostree --repo=repo pull origin yet-another 2>err.txt; then
+    assert_not_reached "pull with the summary index served as the summary succeeded"
+fi
+assert_file_has_content err.txt "Summary is a summary index"
+for f in summary summary.sig summary.idx summary.idx.sig; do
+    mv ${srvrepo}/${f}.orig ${srvrepo}/${f}
+done
+echo "ok summary and summary index are not interchangeable"
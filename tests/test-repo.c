@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include <fcntl.h>
 #include <gio/gio.h>
 #include <glib-object.h>
 #include <glib.h>
@@ -29,9 +30,13 @@
 #include <linux/fs.h>
 #include <locale.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/statvfs.h>
+#include <unistd.h>
 
 #include "ostree-autocleanups.h"
+#include "ostree-mutable-tree.h"
+#include "ostree-repo-file.h"
 #include "ostree-repo-private.h"
 #include "ostree-types.h"
 
@@ -727,6 +732,290 @@ test_min_free_space_reflinked_content (Fixture *fixture, gconstpointer test_data
   g_assert_no_error (error);
 }
 
+static void
+set_metadata_cache_size (OstreeRepo *repo, const char *size)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GKeyFile) config = ostree_repo_copy_config (repo);
+  g_key_file_set_string (config, "core", "metadata-cache-size", size);
+  ostree_repo_write_config (repo, config, &error);
+  g_assert_no_error (error);
+  ostree_repo_reload_config (repo, NULL, &error);
+  g_assert_no_error (error);
+}
+
+/* Returns: (transfer full): Checksums of @n distinct dirmeta objects, differing
+ * in their mode, written to @repo
+ */
+static GPtrArray *
+write_dirmetas (OstreeRepo *repo, guint n)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GPtrArray) checksums = g_ptr_array_new_with_free_func (g_free);
+  for (guint i = 0; i < n; i++)
+    {
+      g_autoptr (GVariant) dirmeta = g_variant_ref_sink (
+          g_variant_new ("(uuu@a(ayay))", 0, 0, GUINT32_TO_BE (S_IFDIR | (0700 + i)),
+                         g_variant_new_array (G_VARIANT_TYPE ("(ayay)"), NULL, 0)));
+      g_autofree guchar *csum = NULL;
+      ostree_repo_write_metadata (repo, OSTREE_OBJECT_TYPE_DIR_META, NULL, dirmeta, &csum, NULL,
+                                  &error);
+      g_assert_no_error (error);
+      g_ptr_array_add (checksums, ostree_checksum_from_bytes (csum));
+    }
+  return g_steal_pointer (&checksums);
+}
+
+static void
+load_dirmeta (OstreeRepo *repo, const char *checksum)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GVariant) dirmeta = NULL;
+  ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_META, checksum, &dirmeta, &error);
+  g_assert_no_error (error);
+}
+
+static void
+test_repo_metadata_cache (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, ".", OSTREE_REPO_MODE_ARCHIVE, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (GPtrArray) checksums = write_dirmetas (repo, 64);
+
+  /* Disabled by default */
+  guint64 hits, misses, evictions, size;
+  load_dirmeta (repo, checksums->pdata[0]);
+  load_dirmeta (repo, checksums->pdata[0]);
+  ostree_repo_get_metadata_cache_stats (repo, &hits, &misses, &evictions, &size);
+  g_assert_cmpuint (hits, ==, 0);
+  g_assert_cmpuint (misses, ==, 0);
+  g_assert_cmpuint (size, ==, 0);
+
+  /* The second load is served from the cache */
+  set_metadata_cache_size (repo, "1KB");
+  load_dirmeta (repo, checksums->pdata[0]);
+  load_dirmeta (repo, checksums->pdata[0]);
+  ostree_repo_get_metadata_cache_stats (repo, &hits, &misses, &evictions, &size);
+  g_assert_cmpuint (hits, ==, 1);
+  g_assert_cmpuint (misses, ==, 1);
+  g_assert_cmpuint (evictions, ==, 0);
+  g_assert_cmpuint (size, >, 0);
+
+  /* Loading more than fits evicts the least recently used */
+  for (guint i = 0; i < checksums->len; i++)
+    load_dirmeta (repo, checksums->pdata[i]);
+  ostree_repo_get_metadata_cache_stats (repo, &hits, &misses, &evictions, &size);
+  g_assert_cmpuint (hits, ==, 2);
+  g_assert_cmpuint (misses, ==, checksums->len);
+  g_assert_cmpuint (evictions, >, 0);
+  g_assert_cmpuint (size, <=, 1024);
+  load_dirmeta (repo, checksums->pdata[0]);
+  load_dirmeta (repo, checksums->pdata[checksums->len - 1]);
+  ostree_repo_get_metadata_cache_stats (repo, &hits, &misses, NULL, NULL);
+  g_assert_cmpuint (hits, ==, 3);
+  g_assert_cmpuint (misses, ==, checksums->len + 1);
+
+  /* fsck checks what's on disk, not the cached object */
+  g_autofree char *path = ostree_get_relative_object_path (
+      checksums->pdata[0], OSTREE_OBJECT_TYPE_DIR_META, FALSE);
+  glnx_file_replace_contents_at (fixture->tmpdir.fd, path, (guint8 *)"corrupted", 9,
+                                 GLNX_FILE_REPLACE_NODATASYNC, NULL, &error);
+  g_assert_no_error (error);
+  load_dirmeta (repo, checksums->pdata[0]);
+  g_assert_false (ostree_repo_fsck_object (repo, OSTREE_OBJECT_TYPE_DIR_META, checksums->pdata[0],
+                                           NULL, &error));
+  g_assert_nonnull (error);
+  g_clear_error (&error);
+
+  /* Disabling the cache drops its objects */
+  set_metadata_cache_size (repo, "0");
+  ostree_repo_get_metadata_cache_stats (repo, &hits, &misses, &evictions, &size);
+  g_assert_cmpuint (hits, ==, 0);
+  g_assert_cmpuint (misses, ==, 0);
+  g_assert_cmpuint (size, ==, 0);
+}
+
+static gboolean
+has_dirmeta (OstreeRepo *repo, const char *checksum)
+{
+  g_autoptr (GError) error = NULL;
+  gboolean have_object = FALSE;
+  ostree_repo_has_object (repo, OSTREE_OBJECT_TYPE_DIR_META, checksum, &have_object, NULL,
+                          &error);
+  g_assert_no_error (error);
+  return have_object;
+}
+
+/* Deleting packed objects in a transaction rewrites the pack at commit */
+static void
+test_repo_pack_delete_in_transaction (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, ".", OSTREE_REPO_MODE_ARCHIVE, NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_autoptr (GPtrArray) checksums = write_dirmetas (repo, 3);
+  guint n_packed = 0;
+  ostree_repo_pack_objects (repo, &n_packed, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (n_packed, ==, 3);
+
+  /* Aborting keeps the objects */
+  ostree_repo_prepare_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+  ostree_repo_delete_object (repo, OSTREE_OBJECT_TYPE_DIR_META, checksums->pdata[0], NULL,
+                             &error);
+  g_assert_no_error (error);
+  g_assert_false (has_dirmeta (repo, checksums->pdata[0]));
+  ostree_repo_abort_transaction (repo, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (has_dirmeta (repo, checksums->pdata[0]));
+
+  ostree_repo_prepare_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+  for (guint i = 0; i < 2; i++)
+    {
+      ostree_repo_delete_object (repo, OSTREE_OBJECT_TYPE_DIR_META, checksums->pdata[i], NULL,
+                                 &error);
+      g_assert_no_error (error);
+      g_assert_false (has_dirmeta (repo, checksums->pdata[i]));
+    }
+  g_assert_true (has_dirmeta (repo, checksums->pdata[2]));
+  ostree_repo_commit_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (OstreeRepo) reopened = ostree_repo_open_at (fixture->tmpdir.fd, ".", NULL, &error);
+  g_assert_no_error (error);
+  g_assert_false (has_dirmeta (reopened, checksums->pdata[0]));
+  g_assert_false (has_dirmeta (reopened, checksums->pdata[1]));
+  g_assert_true (has_dirmeta (reopened, checksums->pdata[2]));
+}
+
+/* Returns: %FALSE if the peak RSS of this process can't be reset */
+static gboolean
+reset_peak_rss (void)
+{
+  glnx_autofd int fd = open ("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+  /* Writing 5 resets the peak RSS; see proc(5) */
+  return fd >= 0 && write (fd, "5", 1) == 1;
+}
+
+/* Returns: Peak resident set size of this process, in KiB */
+static guint64
+get_peak_rss_kib (void)
+{
+  g_autoptr (GError) error = NULL;
+  g_autofree char *status = NULL;
+  g_file_get_contents ("/proc/self/status", &status, NULL, &error);
+  g_assert_no_error (error);
+  const char *hwm = strstr (status, "VmHWM:");
+  g_assert_nonnull (hwm);
+  return g_ascii_strtoull (hwm + strlen ("VmHWM:"), NULL, 10);
+}
+
+/* Applying a delta part holding a large object doesn't keep all of it
+ * resident; see release_payload_before() in
+ * ostree-repo-static-delta-processing.c.
+ */
+static void
+test_repo_static_delta_resident_memory (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  const gsize file_size = 32 * 1024 * 1024;
+
+#ifdef MADV_PAGEOUT
+  {
+    /* Needs Linux 5.4 */
+    const gsize page_size = sysconf (_SC_PAGESIZE);
+    void *page = mmap (NULL, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    g_assert (page != MAP_FAILED);
+    int r = madvise (page, page_size, MADV_PAGEOUT);
+    munmap (page, page_size);
+    if (r < 0)
+      {
+        g_test_skip ("MADV_PAGEOUT is not supported");
+        return;
+      }
+  }
+#else
+  g_test_skip ("MADV_PAGEOUT is not available");
+  return;
+#endif
+  if (!reset_peak_rss ())
+    {
+      g_test_skip ("Can't reset the peak RSS");
+      return;
+    }
+
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, "src", OSTREE_REPO_MODE_ARCHIVE, NULL, NULL, &error);
+  g_assert_no_error (error);
+  ostree_repo_prepare_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_autofree char *file_checksum = NULL;
+  {
+    /* Compresses well, so the part is small until it is decompressed */
+    g_autofree guint8 *buf = g_malloc (file_size);
+    for (gsize i = 0; i < file_size; i++)
+      buf[i] = (i % 65536) * 7 % 251;
+    file_checksum = ostree_repo_write_regfile_inline (repo, NULL, 0, 0, S_IFREG | 0644, NULL, buf,
+                                                      file_size, NULL, &error);
+    g_assert_no_error (error);
+  }
+  g_autoptr (GPtrArray) dirmetas = write_dirmetas (repo, 1);
+  g_autoptr (OstreeMutableTree) mtree = ostree_mutable_tree_new ();
+  ostree_mutable_tree_set_metadata_checksum (mtree, dirmetas->pdata[0]);
+  ostree_mutable_tree_replace_file (mtree, "big", file_checksum, &error);
+  g_assert_no_error (error);
+  g_autoptr (GFile) root = NULL;
+  ostree_repo_write_mtree (repo, mtree, &root, NULL, &error);
+  g_assert_no_error (error);
+  g_autofree char *commit = NULL;
+  ostree_repo_write_commit (repo, NULL, "big", NULL, NULL, OSTREE_REPO_FILE (root), &commit, NULL,
+                            &error);
+  g_assert_no_error (error);
+  ostree_repo_commit_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autofree char *delta_path = g_build_filename (fixture->tmpdir.path, "delta", NULL);
+  GVariantBuilder params_builder;
+  g_variant_builder_init (&params_builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&params_builder, "{sv}", "min-fallback-size", g_variant_new_uint32 (0));
+  g_variant_builder_add (&params_builder, "{sv}", "inline-parts", g_variant_new_boolean (TRUE));
+  g_variant_builder_add (&params_builder, "{sv}", "filename",
+                         g_variant_new_bytestring (delta_path));
+  g_autoptr (GVariant) params = g_variant_ref_sink (g_variant_builder_end (&params_builder));
+  ostree_repo_static_delta_generate (repo, OSTREE_STATIC_DELTA_GENERATE_OPT_LOWLATENCY, NULL,
+                                     commit, NULL, params, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (OstreeRepo) dest = ostree_repo_create_at (
+      fixture->tmpdir.fd, "dest", OSTREE_REPO_MODE_BARE_USER_ONLY, NULL, NULL, &error);
+  g_assert_no_error (error);
+  ostree_repo_prepare_transaction (dest, NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (reset_peak_rss ());
+  const guint64 rss_before = get_peak_rss_kib ();
+  g_autoptr (GFile) delta_file = g_file_new_for_path (delta_path);
+  ostree_repo_static_delta_execute_offline (dest, delta_file, FALSE, NULL, &error);
+  g_assert_no_error (error);
+  const guint64 rss_growth = get_peak_rss_kib () - rss_before;
+  ostree_repo_commit_transaction (dest, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  gboolean have_file = FALSE;
+  ostree_repo_has_object (dest, OSTREE_OBJECT_TYPE_FILE, file_checksum, &have_file, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (have_file);
+
+  /* Roughly the 8 MiB release window, well short of the object size */
+  g_test_message ("Peak RSS grew by %" G_GUINT64_FORMAT " KiB", rss_growth);
+  g_assert_cmpuint (rss_growth, <, file_size / 1024 / 2);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -744,6 +1033,11 @@ main (int argc, char **argv)
   g_test_add ("/repo/min_free_space_reflinked_content", Fixture, NULL, setup,
               test_min_free_space_reflinked_content, teardown);
   g_test_add ("/repo/autolock", Fixture, NULL, setup, test_repo_autolock, teardown);
+  g_test_add ("/repo/metadata-cache", Fixture, NULL, setup, test_repo_metadata_cache, teardown);
+  g_test_add ("/repo/pack/delete-in-transaction", Fixture, NULL, setup,
+              test_repo_pack_delete_in_transaction, teardown);
+  g_test_add ("/repo/static-delta/resident-memory", Fixture, NULL, setup,
+              test_repo_static_delta_resident_memory, teardown);
   g_test_add ("/repo/lock/single", Fixture, NULL, lock_setup, test_repo_lock_single, teardown);
   g_test_add ("/repo/lock/unlock-never-locked", Fixture, NULL, lock_setup,
               test_repo_lock_unlock_never_locked, teardown);
@@ -24,7 +24,7 @@ set -euo pipefail
 
 . $(dirname $0)/libtest.sh
 
-echo "1..2"
+echo "1..3"
 
 COMMIT_SIGN=""
 if has_ostree_feature gpgme; then
@@ -132,3 +132,27 @@ cat files | wc -l > files-count
 assert_file_has_content files-count "^1$"
 
 echo "ok 2 update summary with collections"
+
+# Regenerating the summary reuses what the previous regeneration read, and
+# gives the same result as regenerating it from scratch.
+cd ${test_tmpdir}
+rm -rf repo
+ostree_repo_init repo
+seq 3 | while read i; do
+    echo b >> tree/root/a
+    ${CMD_PREFIX} ostree --repo=repo commit --branch=test-$i -m test -s test tree
+done
+${CMD_PREFIX} ostree --repo=repo static-delta generate test-3
+${CMD_PREFIX} ostree --repo=repo summary --update
+assert_has_file repo/state/summary-state
+echo b >> tree/root/a
+${CMD_PREFIX} ostree --repo=repo commit --branch=test-1 -m test -s test tree
+${CMD_PREFIX} ostree --repo=repo summary --update
+${CMD_PREFIX} ostree --repo=repo summary --view | grep -v 'Last-Modified' > summary-incremental
+assert_file_has_content summary-incremental "$(${CMD_PREFIX} ostree --repo=repo rev-parse test-1)"
+rm repo/state/summary-state
+${CMD_PREFIX} ostree --repo=repo summary --update
+${CMD_PREFIX} ostree --repo=repo summary --view | grep -v 'Last-Modified' > summary-full
+assert_files_equal summary-incremental summary-full
+
+echo "ok 3 incremental summary update"
@@ -10,6 +10,63 @@ import argparse
 import threading
 import time
 import contextlib
+import re
+
+class RangeRequestHandler(SimpleHTTPRequestHandler):
+    """Serve a single byte range when asked to, as pulling packed
+    objects does; anything else gets the whole file."""
+
+    _range_re = re.compile(r'^bytes=(\d*)-(\d*)$')
+
+    def send_head(self):
+        self._range = None
+        m = self._range_re.match(self.headers.get('Range', '').strip())
+        path = self.translate_path(self.path)
+        if m is None or not os.path.isfile(path):
+            return super().send_head()
+        try:
+            f = open(path, 'rb')
+        except OSError:
+            self.send_error(404, "File not found")
+            return None
+        size = os.fstat(f.fileno()).st_size
+        start, end = m.group(1), m.group(2)
+        if start:
+            start = int(start)
+            end = min(int(end), size - 1) if end else size - 1
+        elif end:
+            start = max(size - int(end), 0)
+            end = size - 1
+        else:
+            f.close()
+            return super().send_head()
+        if start >= size or start > end:
+            f.close()
+            self.send_response(416)
+            self.send_header("Content-Range", f"bytes */{size}")
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return None
+        self._range = (start, end)
+        self.send_response(206)
+        self.send_header("Content-Type", self.guess_type(path))
+        self.send_header("Content-Range", f"bytes {start}-{end}/{size}")
+        self.send_header("Content-Length", str(end - start + 1))
+        self.end_headers()
+        return f
+
+    def copyfile(self, source, outputfile):
+        if self._range is None:
+            return super().copyfile(source, outputfile)
+        start, end = self._range
+        source.seek(start)
+        remaining = end - start + 1
+        while remaining > 0:
+            buf = source.read(min(remaining, 64 * 1024))
+            if not buf:
+                break
+            outputfile.write(buf)
+            remaining -= len(buf)
 
 def _get_best_family(*address):
     infos = socket.getaddrinfo(
@@ -20,7 +77,7 @@ def _get_best_family(*address):
     family, ty, proto, canonname, sockaddr = next(iter(infos))
     return family, sockaddr
 
-def run(port_path, HandlerClass=SimpleHTTPRequestHandler,
+def run(port_path, HandlerClass=RangeRequestHandler,
         ServerClass=ThreadingHTTPServer,
         protocol="HTTP/1.1", port=0, bind=None):
     ServerClass.address_family, addr = _get_best_family(bind, port)